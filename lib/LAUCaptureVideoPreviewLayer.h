@@ -93,6 +93,284 @@ NS_CLASS_AVAILABLE(10_7, 7_0) __TVOS_PROHIBITED
  */
 - (void)setBlur:(CGFloat)blur animated:(BOOL)animated;
 
+/*!
+ @property blurRegions
+ @abstract
+ Rects of the layer (CGRect values in the layer coordinates) where the blur is applied. Default is empty.
+
+ @discussion
+ An empty array blurs the whole layer. Otherwise the rest of the layer shows the unblurred frame,
+ and the blur passes only draw the regions plus the texels their kernels read around them,
+ so the cost follows the blurred area. Rects outside the bounds are clipped, rects inside another
+ one are ignored and at most 16 regions are used.
+ */
+@property (nonatomic, copy) NSArray<NSValue *> * blurRegions;
+
+/*!
+ @method setBlurIntensityMap:width:height:bytesPerRow:
+ @abstract
+ Scales the blur of each pixel of the frame. Default is no map, every pixel has the blur of the layer.
+ 
+ @param intensities
+ One byte per pixel, 0 is unblurred and 255 is the blur of the layer. NULL removes the map. The bytes are copied.
+ @param width
+ Width of the map, any dimensions are stretched over the frame (bilinear sampling).
+ @param height
+ Height of the map.
+ @param bytesPerRow
+ Bytes of each row of intensities (at least width).
+ 
+ @discussion
+ The map covers the captured frames in the orientation of the capture output (ie. a segmentation mask of the
+ same frames), not the layer. Each pixel blends the two kernels closest to its intensity. The map is only used if the
+ layer is built with FilterKernelBankEnabled and the kernels fit the fragment uniforms of the device, otherwise it's ignored.
+ */
+- (void)setBlurIntensityMap:(const uint8_t *)intensities width:(NSUInteger)width height:(NSUInteger)height bytesPerRow:(NSUInteger)bytesPerRow;
+
+/*!
+ @enum LAUCaptureVideoPreviewLayerFrameQueuePolicy
+ @abstract
+ Which frame is rendered and which is dropped when the capture output is faster than the display.
+ 
+ @constant LAUCaptureVideoPreviewLayerFrameQueuePolicyLatestOnly
+ The newest frame is rendered, older frames are dropped. Lowest latency.
+ @constant LAUCaptureVideoPreviewLayerFrameQueuePolicyBoundedFIFO
+ Frames are rendered in order. New frames are dropped when the queue is full.
+ @constant LAUCaptureVideoPreviewLayerFrameQueuePolicyDropOldest
+ Frames are rendered in order. The oldest frame is dropped when the queue is full.
+ */
+typedef NS_ENUM(NSInteger, LAUCaptureVideoPreviewLayerFrameQueuePolicy) {
+    LAUCaptureVideoPreviewLayerFrameQueuePolicyLatestOnly = 0,
+    LAUCaptureVideoPreviewLayerFrameQueuePolicyBoundedFIFO = 1,
+    LAUCaptureVideoPreviewLayerFrameQueuePolicyDropOldest = 2,
+};
+
+/*!
+ @property frameQueueDepth
+ @abstract
+ Maximum number of frames waiting to be rendered. Default is 1.
+ */
+@property (nonatomic, readonly) NSUInteger frameQueueDepth;
+
+/*!
+ @property frameQueuePolicy
+ @abstract
+ Policy of the frame queue. Default is LAUCaptureVideoPreviewLayerFrameQueuePolicyLatestOnly.
+ */
+@property (nonatomic, readonly) LAUCaptureVideoPreviewLayerFrameQueuePolicy frameQueuePolicy;
+
+/*!
+ @method setFrameQueueDepth:policy:
+ @abstract
+ Changes the frame queue between the capture output and the display.
+ 
+ @param depth
+ Maximum number of frames waiting to be rendered (at least 1).
+ @param policy
+ Which frame is rendered and which is dropped when the queue is full.
+ 
+ @discussion
+ Queued frames and the frame counters are discarded. Must be called from the main thread.
+ */
+- (void)setFrameQueueDepth:(NSUInteger)depth policy:(LAUCaptureVideoPreviewLayerFrameQueuePolicy)policy;
+
+/*!
+ @property enqueuedFrameCount
+ @abstract
+ Number of frames received from the capture output.
+ */
+@property (nonatomic, readonly) NSUInteger enqueuedFrameCount;
+
+/*!
+ @property droppedFrameCount
+ @abstract
+ Number of frames received from the capture output that were never rendered.
+ */
+@property (nonatomic, readonly) NSUInteger droppedFrameCount;
+
+/*!
+ @property renderedFrameCount
+ @abstract
+ Number of frames rendered.
+ */
+@property (nonatomic, readonly) NSUInteger renderedFrameCount;
+
+/*!
+ @property frameAge
+ @abstract
+ Time between the presentation timestamp of the last rendered frame and its rendering.
+ 
+ @discussion
+ Capture-to-display latency. averageFrameAge and maxFrameAge cover all rendered frames.
+ */
+@property (nonatomic, readonly) NSTimeInterval frameAge;
+@property (nonatomic, readonly) NSTimeInterval averageFrameAge;
+@property (nonatomic, readonly) NSTimeInterval maxFrameAge;
+
+/*!
+ @property similarFrameSkippingEnabled
+ @abstract
+ Skip the blur filter for new frames nearly identical to the last blurred frame. Default is NO.
+ 
+ @discussion
+ Frames are compared with a low resolution luma signature computed on the CPU. The last blurred
+ frame is presented again instead. Frames without a new capture output and with the same blur
+ are always skipped.
+ */
+@property (nonatomic, readwrite) BOOL similarFrameSkippingEnabled;
+
+/*!
+ @property skippedFrameCount
+ @abstract
+ Number of frames presented without running the blur filter again (skippedFrameCount), and the
+ ones among them that were new frames similar to the last blurred frame (similarFrameCount).
+ */
+@property (nonatomic, readonly) NSUInteger skippedFrameCount;
+@property (nonatomic, readonly) NSUInteger similarFrameCount;
+
+/*!
+ @property frameTimingStatistics
+ @abstract
+ CPU and GPU time of each rendering stage over the last 120 frames, nil if the frame timings are disabled.
+ 
+ @discussion
+ Keyed by stage: textureImport, uniformUpdate, offscreenPass0...offscreenPassN, onscreenPass, present
+ and frame (the whole frame). Each stage has cpuMean, cpuP50, cpuP90, cpuP99 and cpuMax in seconds, and the
+ same gpu keys if the GPU supports timer queries (GL_EXT_disjoint_timer_query). The instrumentation is
+ compiled in with FrameTimingsEnabled (LAUCaptureVideoPreviewLayer.m).
+ */
+@property (nonatomic, readonly) NSDictionary<NSString *, NSDictionary<NSString *, NSNumber *> *> * frameTimingStatistics;
+
+/*!
+ @property adaptiveQualityEnabled
+ @abstract
+ Lower the quality of the blur when the frames take longer than frameTimeBudget to render. Default is NO.
+
+ @discussion
+ The render time of the blurred frames is measured over windows of 30 frames. A window over budget lowers the
+ quality level (larger downsampling factor, fewer passes, smaller kernels), the quality is raised again only after
+ several windows where the higher level is predicted to fit. The kernel of each level is chosen to keep the same
+ blur radius. Changing the property resets the quality level to 0 (the default filter parameters).
+ */
+@property (nonatomic, readwrite) BOOL adaptiveQualityEnabled;
+
+/*!
+ @property frameTimeBudget
+ @abstract
+ Render time per frame targeted by the adaptive quality, in seconds. Default is 8ms (half a 60Hz refresh).
+ */
+@property (nonatomic, readwrite) NSTimeInterval frameTimeBudget;
+
+/*!
+ @property qualityLevel
+ @abstract
+ Current quality level of the adaptive quality, 0 is the highest quality.
+ */
+@property (nonatomic, readonly) NSUInteger qualityLevel;
+
+/*!
+ @property programCacheHitCount
+ @abstract
+ Number of shader programs loaded from the persistent program binary cache (all layers).
+ 
+ @discussion
+ Programs are cached in the Caches directory, keyed on the shader sources and the GPU driver.
+ Without program binary support every program is compiled from source and counted in programCacheMissCount.
+ */
+@property (class, nonatomic, readonly) NSUInteger programCacheHitCount;
+@property (class, nonatomic, readonly) NSUInteger programCacheMissCount;
+
+/*!
+ @property programCompileTime
+ @abstract
+ Time spent compiling shader programs from source (programCompileTime) and loading
+ cached program binaries (programLoadTime), for all layers.
+ */
+@property (class, nonatomic, readonly) NSTimeInterval programCompileTime;
+@property (class, nonatomic, readonly) NSTimeInterval programLoadTime;
+
+/*!
+ @property renderTargetMemoryBudget
+ @abstract
+ Bytes of offscreen render targets kept allocated for reuse. Default is 16 MB.
+ 
+ @discussion
+ Render targets are recycled when the dimensions change back (ie. rotation, session format switches).
+ Unused render targets beyond the budget are deleted, least recently used first. Render targets
+ in use are never deleted, so the budget can be exceeded while they are needed.
+ */
+@property (nonatomic, readwrite) NSUInteger renderTargetMemoryBudget;
+
+/*!
+ @property renderTargetByteCount
+ @abstract
+ Bytes of offscreen render targets allocated (renderTargetByteCount) and its maximum (renderTargetPeakByteCount).
+ */
+@property (nonatomic, readonly) NSUInteger renderTargetByteCount;
+@property (nonatomic, readonly) NSUInteger renderTargetPeakByteCount;
+
+/*!
+ @property renderTargetAllocationCount
+ @abstract
+ Number of offscreen render targets created (renderTargetAllocationCount) and reused from the pool (renderTargetReuseCount).
+ */
+@property (nonatomic, readonly) NSUInteger renderTargetAllocationCount;
+@property (nonatomic, readonly) NSUInteger renderTargetReuseCount;
+
+/*!
+ @method snapshotImageWithCompletionHandler:
+ @abstract
+ Captures the current contents of the layer without stalling the rendering.
+ 
+ @param completionHandler
+ Called on the main thread with the snapshot image, or nil if the layer has no framebuffer.
+ 
+ @discussion
+ The framebuffer is copied on the GPU and read back once the copy is done, usually
+ at the next frame. Must be called from the main thread.
+ */
+- (void)snapshotImageWithCompletionHandler:(void (^)(UIImage * image))completionHandler;
+
+/*!
+ @property lowResolutionSnapshotEnabled
+ @abstract
+ Take the snapshot shown while the session restarts from the blurred offscreen texture. Default is YES.
+ 
+ @discussion
+ The blurred frame is read back at its downsampled resolution (about 1/16 of the pixels)
+ and upscaled by the compositor. Unblurred frames are always read back at full resolution.
+ */
+@property (nonatomic, readwrite) BOOL lowResolutionSnapshotEnabled;
+
+/*!
+ @method startFrameRecordingToPath:
+ @abstract
+ Records the captured frames, their timestamps, the view size and the blur changes (setBlur:animated:)
+ into a file, replays it offline with the headless harness (--replay).
+ 
+ @discussion
+ Frames are recorded as captured (BGRA or 420 bi-planar) in a chunked format, see LAUCaptureVideoPreviewLayerFrameRecording.h.
+ They are copied on the capture queue and written on a background thread, frames are dropped from the recording
+ (not from the preview) when more than 64 MB are waiting to be written. Replaces a recording in progress.
+ Returns NO if the file can't be created.
+ */
+- (BOOL)startFrameRecordingToPath:(NSString *)path;
+
+/*!
+ @method stopFrameRecording
+ @abstract
+ Waits for the pending frames to be written and closes the recording.
+ */
+- (void)stopFrameRecording;
+
+/*!
+ @property recordedFrameCount
+ @abstract
+ Frames written to the recording in progress (recordedFrameCount) and dropped from it (recordingDroppedFrameCount).
+ */
+@property (nonatomic, readonly) NSUInteger recordedFrameCount;
+@property (nonatomic, readonly) NSUInteger recordingDroppedFrameCount;
+
 /*!
  @method layerWithSession:
  @abstract
@@ -31,6 +31,15 @@
 #import "LAUCaptureVideoPreviewLayerShaders.h"
 #import "LAUCaptureVideoPreviewLayerUtilities.h"
 #import "LAUCaptureVideoPreviewLayerGaussianFilterKernel.h"
+#import "LAUCaptureVideoPreviewLayerProgramCache.h"
+#import "LAUCaptureVideoPreviewLayerShaderGenerator.h"
+#import "LAUCaptureVideoPreviewLayerRenderTargetPool.h"
+#import "LAUCaptureVideoPreviewLayerPixelReadback.h"
+#import "LAUCaptureVideoPreviewLayerFrameSignature.h"
+#import "LAUCaptureVideoPreviewLayerFrameTimings.h"
+#import "LAUCaptureVideoPreviewLayerQualityGovernor.h"
+#import "LAUCaptureVideoPreviewLayerFilterRegions.h"
+#import "LAUCaptureVideoPreviewLayerFilterPlanner.h"
 
 #import <AVFoundation/AVCaptureOutput.h>
 #import <QuartzCore/CAEAGLLayer.h>
@@ -38,6 +47,12 @@
 #import <OpenGLES/ES2/gl.h>
 #import <OpenGLES/ES2/glext.h>
 
+// Maximum number of levels of the dual filter pyramid (each level halves the dimensions)
+#define kFilterPyramidMaxLevelCount 6
+
+// Largest blur filter program variant (size of the uniform arrays of VertexShaderSourceBlurFilterBts)
+#define kFilterKernelVariantMaxSamples 14
+
 @interface LAUCaptureVideoPreviewLayer () <LAUCaptureVideoPreviewLayerInternalDelegate>
 {
     // OpenGL context
@@ -45,6 +60,11 @@
     
     // Layer used to display a snapshot image of the current framebuffer
     CALayer * _onscreenSnapshotImageSublayer;
+    BOOL _onscreenSnapshotImageSublayerRequested; // Snapshot requested and not removed yet (the image arrives asynchronously)
+    
+    // Asynchronous readback of the onscreen framebuffer (snapshots and renderInContext:)
+    PixelReadback_t * _pixelReadback;
+    PixelReadbackBufferPool_t * _pixelReadbackBufferPool; // Pixels of the snapshot images, given back when the images are released
     
     // CoreAnimation layer for previewing the visual output of an AVCaptureSession
     // Used for normal rendering. More efficient (CPU and GPU) than our own...
@@ -59,20 +79,56 @@
     // Last Pixel buffer set
     // Waiting to be rendered or last one rendered
     CVOpenGLESTextureRef _pixelBufferTexture;
+    CVOpenGLESTextureRef _pixelBufferChromaTexture; // Chroma plane of a 420 bi-planar pixelBuffer (_pixelBufferTexture is the luma plane), NULL for BGRA
     
     // Shader programs
     GLuint _defaultProgram; // On-screen
+    GLuint _defaultYUVProgram; // On-screen, converts the luma and chroma planes of 420 bi-planar pixel buffers (FilterYUVInputEnabled)
     GLuint _blurFilterProgram; // Off-screen
+    ProgramInstance_t _blurFilterProgramVariants[kFilterKernelVariantMaxSamples+1]; // Index is the number of kernel samples
+    GLuint _blurFilterProgramSamples; // Samples of the variant in use, 0 without variants
+    ProgramInstance_t _blurFilterPrefilterProgramVariants[kFilterKernelVariantMaxSamples+1]; // First split-pass of each variant (FilterPrefilterEnabled)
+    ProgramInstance_t * _blurFilterPrefilterProgramInstance; // Prefilter program of the variant in use, NULL if the first pass isn't prefiltered
+    BOOL _blurFilterKernelBankLoaded; // Variants read their kernel from the bank uploaded by loadFilterKernelBank (FilterKernelBankEnabled)
+    ProgramInstance_t _blurFilterIntensityMapProgramVariants[kFilterKernelVariantMaxSamples+1]; // Variants reading the kernel of each fragment (loaded with the first intensity map)
+    ProgramInstance_t _blurFilterIntensityMapPrefilterProgramVariants[kFilterKernelVariantMaxSamples+1];
     
     // Shader bindings
     struct UniformHandles _defaultUniforms;
     struct AttributeHandles _defaultAttributes;
+    struct UniformHandles _defaultYUVUniforms;
+    struct AttributeHandles _defaultYUVAttributes;
     struct UniformHandles _blurFilterUniforms;
     struct AttributeHandles _blurFilterAttributes;
     
     // Offscreen Framebuffer
+    RenderTargetPool_t * _renderTargetPool; // Textures and framebuffers of the offscreen texture instances
+    NSUInteger _renderTargetMemoryBudget;
+    BOOL _renderTargetMemoryBudgetNeedsUpdate; // YES if the budget changed between draw calls (free targets may be deleted)
+    GLuint _offscreenVertexArray; // Quad of the render target pool, blur filter program attributes (shared by the offscreen texture instances)
     TextureInstance_t _pixelBufferTextureInstance;
+    TextureInstance_t _pixelBufferChromaTextureInstance;
     TextureInstance_t _offscreenTextureInstances[2];
+    TextureInstance_t _offscreenChromaTextureInstances[2];
+    TextureInstance_t _filterPyramidTextureInstances[kFilterPyramidMaxLevelCount+1]; // Level 0 has the downsampled pixel buffer dimensions
+    TextureInstance_t * _filteredTextureInstance; // Fully filtered (downsampled) texture of the last frame, NULL if it wasn't filtered offscreen
+    TextureInstance_t * _filteredChromaTextureInstance; // Chroma plane of _filteredTextureInstance (420 bi-planar), NULL for BGRA
+    
+    // Redundant frames (the filtered texture instance is re-presented instead of filtering again)
+    FrameSignature_t _pixelBufferFrameSignature; // Signature of the current pixelBuffer (only if similarFrameSkippingEnabled)
+    FrameSignature_t _filteredFrameSignature; // Signature of the pixelBuffer in _filteredTextureInstance
+    NSUInteger _skippedFrameCount;
+    NSUInteger _similarFrameCount;
+    
+    // CPU and GPU time of the stages of the last frames (only if FrameTimingsEnabled)
+    FrameTimings_t * _frameTimings;
+    
+    // Filter parameters lowered when the frames are over budget (only if adaptiveQualityEnabled)
+    QualityGovernor_t * _qualityGovernor;
+    BOOL _adaptiveQualityEnabled;
+    
+    // Filter parameters of the current intensity (only if FilterPassPlannerEnabled and not adaptiveQualityEnabled)
+    FilterPlan_t _filterPlan;
     
     // Onscreen Framebuffer
     GLuint _onscreenFramebuffer;
@@ -80,16 +136,23 @@
     GLint _onscreenColorRenderbufferWidth;
     GLint _onscreenColorRenderbufferHeight;
     struct TextureInstance _onscreenTextureInstance;
+    struct TextureInstance _onscreenYUVTextureInstance; // Same vertices as _onscreenTextureInstance, default YUV program attributes
     
     // Filter (Kernel)
+    GaussianFilterKernelParameters_t _filterKernelParameters; // Sigma range, kernel count and truncation used to generate the kernels
     size_t _filterKernelCount; // Number of filter kernels created
     size_t _filterKernelIndex; // Currently loaded filter kernel
     FilterKernel_t * _filterKernelArray; // Kernels used for the interpolation between [0,1]
+    GaussianFilterKernelCache_t * _filterKernelCache; // Kernels generated for continuous intensity values
+    float _filterKernelStep; // Step [0,1] of the kernel to be used, uniforms are only updated when it changes
     
     // Filter (Parameters)
     GLfloat _filterSplitPassDirectionVector[2]; // Separable filter, apply 2x each in a specific direction (x or y)
+    GLfloat _filterKernelOffsetScale; // 1, 0.5 for the chroma plane (half resolution texels, same blur radius in view pixels)
     GLuint _filterMultiplePassCount; // Number of times filter should be applied before onscreen rendering
     GLfloat _filterDownsamplingFactor; // Downsample offscreen textures by a factor (ie. 2 = resize dimensions by 1/2)
+    GLuint _filterPyramidLevelCount; // Number of downsample (and upsample) passes of the dual filter
+    GLfloat _filterPyramidOffset; // Sample offset of the dual filter, in half pixels of the destination texture
     
     // Filter (Intensity)
     float _filterIntensity; // [0,1], 0 means no filter is applied
@@ -97,9 +160,21 @@
     dispatch_source_t _filterIntensityTransitionTimer; // Use for animated transition between different indices
     float _filterIntensityTransitionTarget;
     
-    // Filter (Bounds)
-    GLfloat _filterBounds[4];
-    BOOL _filterBoundsNeedsUpdate;
+    // Filter (Regions)
+    NSArray<NSValue *> * _blurRegions; // Layer coordinates (see blurRegions)
+    FilterRegions_t _filterRegions; // Normalized view coordinates, mapped to the texture coordinates of each filtered frame
+    BOOL _filterRegionsNeedsUpdate; // YES if the regions changed since the last filtered frame
+    GLuint _filterKernelRadius; // Radius of the kernel in use, texels read around the regions by each split-pass
+    GLuint _filterRegionsRemainingPassCount; // Split-passes after the one being drawn (scissor margin of its regions)
+    
+    // Filter (Intensity map)
+    NSData * _blurIntensityMap; // Copy of the intensities (see setBlurIntensityMap:width:height:bytesPerRow:), nil without a map
+    NSUInteger _blurIntensityMapWidth;
+    NSUInteger _blurIntensityMapHeight;
+    BOOL _filterIntensityMapNeedsUpdate; // YES if the map changed since the last filtered frame
+    BOOL _filterIntensityMapLoaded; // The intensity map variants are in use (FilterKernelBankEnabled)
+    BOOL _filterIntensityMapProgramVariantsLoaded; // Loading was attempted (once)
+    GLuint _filterIntensityMapTexture; // Texture unit 2
 }
 
 // Property used to control access to display link
@@ -109,8 +184,104 @@
 
 @implementation LAUCaptureVideoPreviewLayer
 
-#define FilterBoundsEnabled 0
+// Feature defaults, a build setting overrides any of them (ie. GCC_PREPROCESSOR_DEFINITIONS=FilterPyramidEnabled=1, see .travis.yml)
+#ifndef FilterBilinearTextureSamplingEnabled
 #define FilterBilinearTextureSamplingEnabled 1
+#endif
+#ifndef FilterContinuousIntensityEnabled
+#define FilterContinuousIntensityEnabled 1
+#endif
+#ifndef FilterPyramidEnabled
+#define FilterPyramidEnabled 0 // Dual filter (downsample/upsample pyramid) instead of the separable gaussian filter
+#endif
+#ifndef FilterKernelVariantsEnabled
+#define FilterKernelVariantsEnabled 1 // Blur filter programs unrolled for the number of kernel samples (bts only)
+#endif
+#ifndef FilterYUVInputEnabled
+#define FilterYUVInputEnabled 0 // Capture 420 bi-planar pixel buffers instead of BGRA, the luma and half resolution chroma planes are filtered separately and converted to RGB in the onscreen pass
+#endif
+#ifndef FrameTimingsEnabled
+#define FrameTimingsEnabled 0 // CPU and GPU time of each stage of drawPixelBuffer: (see frameTimingStatistics), the instrumentation is compiled out if disabled
+#endif
+#ifndef FilterPassPlannerEnabled
+#define FilterPassPlannerEnabled 0 // Downsampling factor, pass count and kernel planned for each intensity (fewest fetches for the blur of the default parameters, see FilterPlan_t) instead of the fixed factor 4 and 2 passes
+#endif
+#ifndef FilterPrefilterEnabled
+#define FilterPrefilterEnabled 1 // First split-pass averages 2x2 bilinear taps around each kernel sample (box over the texel footprint) instead of a single tap that reads 2 of every downsamplingFactor rows
+#endif
+#ifndef FilterKernelBankEnabled
+#define FilterKernelBankEnabled 0 // All the kernels uploaded once to each variant, an intensity change only sets the bank position (the two closest kernels are blended in the shaders) instead of the offsets and weights
+#endif
+
+#if FilterPyramidEnabled || !FilterBilinearTextureSamplingEnabled
+#undef FilterKernelVariantsEnabled
+#define FilterKernelVariantsEnabled 0
+#endif
+
+// The chroma plane goes through the split-passes
+#if FilterPyramidEnabled
+#undef FilterYUVInputEnabled
+#define FilterYUVInputEnabled 0
+#endif
+
+// The prefilter is generated in the kernel variants
+#if !FilterKernelVariantsEnabled
+#undef FilterPrefilterEnabled
+#define FilterPrefilterEnabled 0
+#endif
+
+// The planner solves the sigma of kernels generated on demand
+#if FilterPyramidEnabled || !FilterContinuousIntensityEnabled
+#undef FilterPassPlannerEnabled
+#define FilterPassPlannerEnabled 0
+#endif
+
+// The bank is read by the kernel variants and holds the kernels of the default parameters only
+#if !FilterKernelVariantsEnabled || FilterPassPlannerEnabled
+#undef FilterKernelBankEnabled
+#define FilterKernelBankEnabled 0
+#endif
+
+// Number of kernels kept in _filterKernelCache
+#define kFilterKernelCacheCapacity 16
+
+// Duration of the animated transition between intensity 0 and 1 (continuous intensity only)
+#define kFilterIntensityTransitionDuration 0.25f
+
+// Copied frames waiting to be written to the frame recording, frames are dropped from the recording beyond it (about 8 BGRA 1080p frames)
+#define kFrameRecordingMaxPendingByteCount (64 * 1024 * 1024)
+
+// Offscreen render targets kept allocated, free targets beyond it are deleted (least recently used first)
+#define kFilterRenderTargetMemoryBudget (16 * 1024 * 1024)
+
+// Onscreen framebuffer copies in flight
+#define kPixelReadbackDepth 2
+
+// Snapshot image buffers kept for reuse once their images are released
+#define kPixelReadbackBufferPoolCapacity 2
+
+// Interval between polls of the pending readbacks while the display link is paused
+#define kPixelReadbackPollInterval (1.0 / 60.0)
+
+// Maximum frame signature distance [0,255] of a new pixelBuffer that is not filtered again (see FrameSignature_t)
+#define kSimilarFrameSignatureThreshold 1.5f
+
+// Number of frames in the frame timings ring (2s at 60fps)
+#define kFrameTimingsFrameCapacity 120
+
+#if FrameTimingsEnabled
+#define FrameTimingsBeginFrame() frameTimingsBeginFrame(_frameTimings)
+#define FrameTimingsEndFrame() frameTimingsEndFrame(_frameTimings)
+#define FrameTimingsCancelFrame() frameTimingsCancelFrame(_frameTimings)
+#define FrameTimingsBeginStage(stage) frameTimingsBeginStage(_frameTimings, (stage))
+#define FrameTimingsEndStage(stage) frameTimingsEndStage(_frameTimings, (stage))
+#else
+#define FrameTimingsBeginFrame()
+#define FrameTimingsEndFrame()
+#define FrameTimingsCancelFrame()
+#define FrameTimingsBeginStage(stage)
+#define FrameTimingsEndStage(stage)
+#endif
 
 #pragma mark -
 #pragma mark Initialization
@@ -156,18 +327,63 @@
             return nil;
         }
         
+        // Offscreen render targets are allocated on first draw
+        _renderTargetMemoryBudget = kFilterRenderTargetMemoryBudget;
+        _renderTargetPool = createRenderTargetPool(_renderTargetMemoryBudget);
+        
+        // Snapshot images copy the readbacks into pooled buffers
+        _pixelReadbackBufferPool = createPixelReadbackBufferPool(kPixelReadbackBufferPoolCapacity);
+        
+        // Snapshots of blurred frames are read from the downsampled filtered texture
+        _lowResolutionSnapshotEnabled = YES;
+        
+#if FrameTimingsEnabled
+        // GPU times if the context supports timer queries
+        _frameTimings = createFrameTimings(kFrameTimingsFrameCapacity);
+#endif
+        
+        // Level 0 has the default filter parameters (see loadFilter)
+        _qualityGovernor = createQualityGovernor(NULL, 0, NULL);
+        
         // Preemptively load filter in memory
         [self loadFilter];
     }
     return self;
 }
 
+- (void)dealloc
+{
+    // Render targets are deleted with the context current
+    EAGLContext * oglContext = [EAGLContext currentContext];
+    if (_oglContext && [EAGLContext setCurrentContext:_oglContext])
+    {
+        releaseRenderTargetPool(_renderTargetPool);
+        releasePixelReadback(_pixelReadback);
+        releaseFrameTimings(_frameTimings);
+        
+        GLuint vertexArrays[] = {_offscreenVertexArray, _onscreenTextureInstance.vertexArray, _onscreenYUVTextureInstance.vertexArray};
+        GLuint vertexBuffers[] = {_onscreenTextureInstance.vertexBuffer, _onscreenYUVTextureInstance.vertexBuffer};
+        glDeleteVertexArraysOES(3, vertexArrays);
+        glDeleteBuffers(2, vertexBuffers);
+        glDeleteTextures(1, &_filterIntensityMapTexture);
+        
+        [EAGLContext setCurrentContext:oglContext];
+    }
+    
+    releaseQualityGovernor(_qualityGovernor);
+    releaseGaussianFilterKernelCache(_filterKernelCache);
+    releasePixelReadbackBufferPool(_pixelReadbackBufferPool); // Buffers of live images are freed with the images
+}
+
 - (void)layoutSublayers
 {
     PrettyLog;
     
     [super layoutSublayers];
     
+    // Regions are normalized with the bounds
+    [self loadFilterRegions];
+    
     if (!_onscreenFramebuffer)
     {
         // Create the onscreen framebuffer
@@ -175,6 +391,9 @@
 
         // Load glsl programs, uniforms and attributes
         [self loadBlurFilterProgram];
+#if FilterYUVInputEnabled
+        [self loadDefaultYUVProgram];
+#endif
         [self loadDefaultProgram];
         
         // Disable depth testing
@@ -191,9 +410,6 @@
         
         // Set filter intensity from blur value
         [self setFilterIntensity:_blur];
-    #if FilterBoundsEnabled
-        [self setFilterBoundsRect:CGRectMake(0, 0, 1, 0.5)];
-    #endif
     }
 }
 
@@ -205,7 +421,7 @@
     }
     
     // Load default program
-    _defaultProgram = loadProgram(VertexShaderSourceDefault, FragmentShaderSourceDefault);
+    _defaultProgram = programCacheLoadProgram([LAUCaptureVideoPreviewLayer programCache], VertexShaderSourceDefault, FragmentShaderSourceDefault);
     validateProgram(_defaultProgram);
     
     // Bind default attributes
@@ -219,6 +435,87 @@
     glUseProgram(_defaultProgram);
 }
 
+#if FilterYUVInputEnabled
+- (void)loadDefaultYUVProgram
+{
+    if (_defaultYUVProgram)
+    {
+        return;
+    }
+    
+    // Load default program for 420 bi-planar pixel buffers
+    _defaultYUVProgram = programCacheLoadProgram([LAUCaptureVideoPreviewLayer programCache], VertexShaderSourceDefault, FragmentShaderSourceDefaultYUV);
+    validateProgram(_defaultYUVProgram);
+    
+    // Bind default attributes
+    _defaultYUVAttributes.VertPosition = glGetAttribLocation(_defaultYUVProgram, "VertPosition");
+    _defaultYUVAttributes.VertTextureCoordinate = glGetAttribLocation(_defaultYUVProgram, "VertTextureCoordinate");
+    
+    // Bind default uniforms, luma on texture unit 0 and chroma on texture unit 1
+    _defaultYUVUniforms.FragTextureData = glGetUniformLocation(_defaultYUVProgram, "FragTextureData");
+    _defaultYUVUniforms.FragChromaTextureData = glGetUniformLocation(_defaultYUVProgram, "FragChromaTextureData");
+    
+    glUseProgram(_defaultYUVProgram);
+    glUniform1i(_defaultYUVUniforms.FragTextureData, 0);
+    glUniform1i(_defaultYUVUniforms.FragChromaTextureData, 1);
+}
+#endif
+
+#if FilterPyramidEnabled
+/*!
+ Fragment Shader (the other programs are in LAUCaptureVideoPreviewLayerShaders.h)
+ 
+ Implementation:
+ - Dual filter (pyramid)
+ - Downsample with 5 taps or upsample with 8 taps, bilinear texture sampling
+ */
+static const char * FragmentShaderSourceBlurFilterPyramid =
+{
+    "#ifdef GL_ES\n"
+    "precision highp float;\n"
+    "#endif\n"
+    "\n"
+    "// (In) Texture coordinate for the fragment\n"
+    "varying vec2 FragTextureCoordinate;\n"
+    "\n"
+    "// Uniforms (VideoFrame)\n"
+    "uniform sampler2D FragTextureData;\n"
+    "\n"
+    "// Uniforms (Filter)\n"
+    "uniform lowp int FilterPyramidUpsample; // 0 = downsample, 1 = upsample\n"
+    "uniform highp vec2 FilterPyramidHalfPixelOffset; // Offset * half pixel of the destination texture\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "  vec2 offset = FilterPyramidHalfPixelOffset;\n"
+    "\n"
+    "  if (FilterPyramidUpsample == 0)\n"
+    "  {\n"
+    "    // Center and 4 diagonal neighbours\n"
+    "    vec4 weightedColor = 4.0 * texture2D(FragTextureData, FragTextureCoordinate);\n"
+    "    weightedColor += texture2D(FragTextureData, FragTextureCoordinate - offset);\n"
+    "    weightedColor += texture2D(FragTextureData, FragTextureCoordinate + offset);\n"
+    "    weightedColor += texture2D(FragTextureData, FragTextureCoordinate + vec2(offset.x, -offset.y));\n"
+    "    weightedColor += texture2D(FragTextureData, FragTextureCoordinate - vec2(offset.x, -offset.y));\n"
+    "    gl_FragColor = weightedColor / 8.0;\n"
+    "  }\n"
+    "  else\n"
+    "  {\n"
+    "    // 4 neighbours on the axis and 4 diagonal neighbours (double weight)\n"
+    "    vec4 weightedColor = texture2D(FragTextureData, FragTextureCoordinate + vec2(-2.0 * offset.x, 0.0));\n"
+    "    weightedColor += texture2D(FragTextureData, FragTextureCoordinate + vec2(2.0 * offset.x, 0.0));\n"
+    "    weightedColor += texture2D(FragTextureData, FragTextureCoordinate + vec2(0.0, -2.0 * offset.y));\n"
+    "    weightedColor += texture2D(FragTextureData, FragTextureCoordinate + vec2(0.0, 2.0 * offset.y));\n"
+    "    weightedColor += 2.0 * texture2D(FragTextureData, FragTextureCoordinate + vec2(-offset.x, offset.y));\n"
+    "    weightedColor += 2.0 * texture2D(FragTextureData, FragTextureCoordinate + vec2(offset.x, offset.y));\n"
+    "    weightedColor += 2.0 * texture2D(FragTextureData, FragTextureCoordinate + vec2(offset.x, -offset.y));\n"
+    "    weightedColor += 2.0 * texture2D(FragTextureData, FragTextureCoordinate + vec2(-offset.x, -offset.y));\n"
+    "    gl_FragColor = weightedColor / 12.0;\n"
+    "  }\n"
+    "}\n"
+};
+#endif
+
 - (void)loadBlurFilterProgram
 {
     if (_blurFilterProgram)
@@ -226,37 +523,341 @@
         return;
     }
     
-    // Load blur filter program
-#if FilterBilinearTextureSamplingEnabled
-#if FilterBoundsEnabled
-    _blurFilterProgram = loadProgram(VertexShaderSourceBlurFilterBts, FragmentShaderSourceBlurFilterBtsBounds);
-#else
-    _blurFilterProgram = loadProgram(VertexShaderSourceBlurFilterBts, FragmentShaderSourceBlurFilterBts);
+#if FilterKernelVariantsEnabled
+    // Load a program for each number of kernel samples
+    [self loadBlurFilterProgramVariants];
+#if FilterKernelBankEnabled
+    [self loadFilterKernelBank];
+#endif
+    [self useBlurFilterProgramVariantForSamples:1];
+    
+    if (_blurFilterProgram)
+    {
+        return;
+    }
 #endif
+    
+    // Load blur filter program
+    ProgramInstance_t programInstance;
+#if FilterPyramidEnabled
+    [self loadBlurFilterProgramInstance:&programInstance vertexShaderSource:VertexShaderSourceDefault fragmentShaderSource:FragmentShaderSourceBlurFilterPyramid];
+#elif FilterBilinearTextureSamplingEnabled
+    [self loadBlurFilterProgramInstance:&programInstance vertexShaderSource:VertexShaderSourceBlurFilterBts fragmentShaderSource:FragmentShaderSourceBlurFilterBts];
 #else
-    _blurFilterProgram = loadProgram(VertexShaderSourceDefault, FragmentShaderSourceBlurFilterDts);
+    [self loadBlurFilterProgramInstance:&programInstance vertexShaderSource:VertexShaderSourceDefault fragmentShaderSource:FragmentShaderSourceBlurFilterDts];
 #endif
     
-    validateProgram(_blurFilterProgram);
+    _blurFilterProgram = programInstance.program;
+    _blurFilterUniforms = programInstance.uniforms;
+    _blurFilterAttributes = programInstance.attributes;
+}
+
+- (void)loadBlurFilterProgramInstance:(ProgramInstance_t *)programInstance vertexShaderSource:(const char *)vertexShaderSource fragmentShaderSource:(const char *)fragmentShaderSource
+{
+    programInstance->program = programCacheLoadProgram([LAUCaptureVideoPreviewLayer programCache], vertexShaderSource, fragmentShaderSource);
+    validateProgram(programInstance->program);
     
     // Bind blur filter attributes
-    _blurFilterAttributes.VertPosition = glGetAttribLocation(_blurFilterProgram, "VertPosition");
-    _blurFilterAttributes.VertTextureCoordinate = glGetAttribLocation(_blurFilterProgram, "VertTextureCoordinate");
+    programInstance->attributes.VertPosition = glGetAttribLocation(programInstance->program, "VertPosition");
+    programInstance->attributes.VertTextureCoordinate = glGetAttribLocation(programInstance->program, "VertTextureCoordinate");
     
     // Bind blur filter uniforms
-    _blurFilterUniforms.FragTextureData = glGetUniformLocation(_blurFilterProgram, "FragTextureData");
-    _blurFilterUniforms.FragFilterBounds = glGetUniformLocation(_blurFilterProgram, "FragFilterBounds");
-#if FilterBilinearTextureSamplingEnabled
-    _blurFilterUniforms.FilterKernelSamples = glGetUniformLocation(_blurFilterProgram, "FilterKernelSamples");
-    _blurFilterUniforms.VertFilterKernelOffsets = glGetUniformLocation(_blurFilterProgram, "VertFilterKernelOffsets");
-    _blurFilterUniforms.FragFilterKernelWeights = glGetUniformLocation(_blurFilterProgram, "FragFilterKernelWeights");
+    programInstance->uniforms.FragTextureData = glGetUniformLocation(programInstance->program, "FragTextureData");
+#if FilterPyramidEnabled
+    programInstance->uniforms.FilterPyramidUpsample = glGetUniformLocation(programInstance->program, "FilterPyramidUpsample");
+    programInstance->uniforms.FilterPyramidHalfPixelOffset = glGetUniformLocation(programInstance->program, "FilterPyramidHalfPixelOffset");
+#elif FilterBilinearTextureSamplingEnabled
+    programInstance->uniforms.FilterKernelSamples = glGetUniformLocation(programInstance->program, "FilterKernelSamples");
+    programInstance->uniforms.VertFilterKernelOffsets = glGetUniformLocation(programInstance->program, "VertFilterKernelOffsets");
+    programInstance->uniforms.FragFilterKernelWeights = glGetUniformLocation(programInstance->program, "FragFilterKernelWeights");
+    programInstance->uniforms.FilterPrefilterOffset = glGetUniformLocation(programInstance->program, "FilterPrefilterOffset");
+    programInstance->uniforms.VertFilterKernelBankOffsets = glGetUniformLocation(programInstance->program, "VertFilterKernelBankOffsets");
+    programInstance->uniforms.FragFilterKernelBankWeights = glGetUniformLocation(programInstance->program, "FragFilterKernelBankWeights");
+    programInstance->uniforms.FilterKernelBankPosition = glGetUniformLocation(programInstance->program, "FilterKernelBankPosition");
+    programInstance->uniforms.FragFilterIntensityMap = glGetUniformLocation(programInstance->program, "FragFilterIntensityMap");
+#else
+    programInstance->uniforms.FragFilterKernelRadius = glGetUniformLocation(programInstance->program, "FragFilterKernelRadius");
+    programInstance->uniforms.FragFilterKernelSize = glGetUniformLocation(programInstance->program, "FragFilterKernelSize");
+    programInstance->uniforms.FragFilterKernelWeights = glGetUniformLocation(programInstance->program, "FragFilterKernelWeights");
+#endif
+    
+    programInstance->uniforms.FilterSplitPassDirectionVector = glGetUniformLocation(programInstance->program, "FilterSplitPassDirectionVector");
+}
+
+#if FilterKernelVariantsEnabled
+- (void)loadBlurFilterProgramVariants
+{
+    GLint maxVaryingVectors = kBtsBlurFilterShaderMinVaryingVectors;
+    glGetIntegerv(GL_MAX_VARYING_VECTORS, &maxVaryingVectors);
+    
+    // Same parameters as loadFilter
+    unsigned int maxSamples = MIN(btsGaussianFilterMaxSamples(&kBtsGaussianFilterKernelDefaultParameters), kFilterKernelVariantMaxSamples);
+    const ProgramInstance_t * firstProgramInstance = NULL;
+    
+#if FilterKernelBankEnabled
+    // The bank takes kernelCount * stride / 4 vectors in both shaders, fall back to a kernel per intensity if it doesn't fit
+    unsigned int bankKernelCount = kBtsGaussianFilterKernelDefaultParameters.kernelCount;
+    unsigned int bankSamples = btsGaussianFilterMaxSamples(&kBtsGaussianFilterKernelDefaultParameters);
+    GLint maxVertexUniformVectors = 0, maxFragmentUniformVectors = 0;
+    glGetIntegerv(GL_MAX_VERTEX_UNIFORM_VECTORS, &maxVertexUniformVectors);
+    glGetIntegerv(GL_MAX_FRAGMENT_UNIFORM_VECTORS, &maxFragmentUniformVectors);
+    _blurFilterKernelBankLoaded = btsBlurFilterKernelBankFits(bankKernelCount, bankSamples, maxVertexUniformVectors, maxFragmentUniformVectors);
+#endif
+    
+    for (unsigned int samples = 1; samples <= maxSamples; ++samples)
+    {
+#if FilterKernelBankEnabled
+        char * vertexShaderSource = _blurFilterKernelBankLoaded ? createBtsKernelBankBlurFilterVertexShaderSource(samples, maxVaryingVectors, bankKernelCount, bankSamples) : createBtsBlurFilterVertexShaderSource(samples, maxVaryingVectors);
+        char * fragmentShaderSource = _blurFilterKernelBankLoaded ? createBtsKernelBankBlurFilterFragmentShaderSource(samples, maxVaryingVectors, bankKernelCount, bankSamples, false) : createBtsBlurFilterFragmentShaderSource(samples, maxVaryingVectors);
 #else
-    _blurFilterUniforms.FragFilterKernelRadius = glGetUniformLocation(_blurFilterProgram, "FragFilterKernelRadius");
-    _blurFilterUniforms.FragFilterKernelSize = glGetUniformLocation(_blurFilterProgram, "FragFilterKernelSize");
-    _blurFilterUniforms.FragFilterKernelWeights = glGetUniformLocation(_blurFilterProgram, "FragFilterKernelWeights");
+        char * vertexShaderSource = createBtsBlurFilterVertexShaderSource(samples, maxVaryingVectors);
+        char * fragmentShaderSource = createBtsBlurFilterFragmentShaderSource(samples, maxVaryingVectors);
 #endif
+        ProgramInstance_t * programInstance = &_blurFilterProgramVariants[samples];
+        
+        if (vertexShaderSource && fragmentShaderSource)
+        {
+            [self loadBlurFilterProgramInstance:programInstance vertexShaderSource:vertexShaderSource fragmentShaderSource:fragmentShaderSource];
+            
+            // The offscreen VAOs are shared by all variants, attributes must have the same locations
+            firstProgramInstance = firstProgramInstance ? firstProgramInstance : programInstance;
+            [self validateBlurFilterProgramVariant:programInstance firstProgramInstance:firstProgramInstance samples:samples];
+        }
+        
+#if FilterPrefilterEnabled
+        // Same vertex shader, the fragment shader averages 2x2 taps around each sample
+#if FilterKernelBankEnabled
+        char * prefilterFragmentShaderSource = _blurFilterKernelBankLoaded ? createBtsKernelBankBlurFilterFragmentShaderSource(samples, maxVaryingVectors, bankKernelCount, bankSamples, true) : createBtsPrefilterBlurFilterFragmentShaderSource(samples, maxVaryingVectors);
+#else
+        char * prefilterFragmentShaderSource = createBtsPrefilterBlurFilterFragmentShaderSource(samples, maxVaryingVectors);
+#endif
+        ProgramInstance_t * prefilterProgramInstance = &_blurFilterPrefilterProgramVariants[samples];
+        
+        if (programInstance->program && prefilterFragmentShaderSource)
+        {
+            [self loadBlurFilterProgramInstance:prefilterProgramInstance vertexShaderSource:vertexShaderSource fragmentShaderSource:prefilterFragmentShaderSource];
+            [self validateBlurFilterProgramVariant:prefilterProgramInstance firstProgramInstance:firstProgramInstance samples:samples];
+        }
+        
+        free(prefilterFragmentShaderSource);
+#endif
+        
+        free(vertexShaderSource);
+        free(fragmentShaderSource);
+    }
+}
+
+#if FilterKernelBankEnabled
+- (void)loadFilterKernelBank
+{
+    if (!_blurFilterKernelBankLoaded)
+    {
+        return;
+    }
+    
+    [self loadFilterKernelBankInProgramVariants:_blurFilterProgramVariants prefilterProgramVariants:_blurFilterPrefilterProgramVariants];
+}
+
+- (void)loadFilterKernelBankInProgramVariants:(ProgramInstance_t *)programVariants prefilterProgramVariants:(ProgramInstance_t *)prefilterProgramVariants
+{
+    // Same parameters as loadBlurFilterProgramVariants
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+    unsigned int stride = btsGaussianFilterKernelBankStride(parameters);
+    GLsizei vectorCount = (GLsizei)(parameters->kernelCount * stride / 4);
+    float * offsets = (float *)malloc(parameters->kernelCount * stride * sizeof(float));
+    float * weights = (float *)malloc(parameters->kernelCount * stride * sizeof(float));
+    btsGaussianFilterKernelBank(parameters, offsets, weights);
+    
+    // Uniforms belong to the program, upload to every variant (and its prefilter program)
+    for (unsigned int samples = 1; samples <= kFilterKernelVariantMaxSamples; ++samples)
+    {
+        const ProgramInstance_t * programInstances[2] = {&programVariants[samples], &prefilterProgramVariants[samples]};
+        
+        for (size_t i = 0; i < 2; ++i)
+        {
+            if (programInstances[i]->program)
+            {
+                glUseProgram(programInstances[i]->program);
+                glUniform4fv(programInstances[i]->uniforms.VertFilterKernelBankOffsets, vectorCount, offsets);
+                glUniform4fv(programInstances[i]->uniforms.FragFilterKernelBankWeights, vectorCount, weights);
+            }
+        }
+    }
+    
+    glUseProgram(_blurFilterProgram);
     
-    _blurFilterUniforms.FilterSplitPassDirectionVector = glGetUniformLocation(_blurFilterProgram, "FilterSplitPassDirectionVector");
+    free(offsets);
+    free(weights);
+}
+
+- (void)loadBlurFilterIntensityMapProgramVariants
+{
+    // Both banks are fragment uniforms, no intensity map if they don't fit (the kernel of the whole frame is used)
+    unsigned int bankKernelCount = kBtsGaussianFilterKernelDefaultParameters.kernelCount;
+    unsigned int bankSamples = btsGaussianFilterMaxSamples(&kBtsGaussianFilterKernelDefaultParameters);
+    GLint maxFragmentUniformVectors = 0;
+    glGetIntegerv(GL_MAX_FRAGMENT_UNIFORM_VECTORS, &maxFragmentUniformVectors);
+    
+    if (!_blurFilterKernelBankLoaded || !btsBlurFilterIntensityMapFits(bankKernelCount, bankSamples, maxFragmentUniformVectors))
+    {
+        Log(@"LAUCaptureVideoPreviewLayer: Intensity map not supported (%d fragment uniform vectors)", maxFragmentUniformVectors);
+        return;
+    }
+    
+    // Same samples as the variants, the vertex shader only passes the texture coordinate
+    unsigned int maxSamples = MIN(bankSamples, kFilterKernelVariantMaxSamples);
+    const ProgramInstance_t * firstProgramInstance = &_blurFilterProgramVariants[1];
+    
+    for (unsigned int samples = 1; samples <= maxSamples; ++samples)
+    {
+        char * fragmentShaderSource = createBtsIntensityMapBlurFilterFragmentShaderSource(samples, bankKernelCount, bankSamples, false);
+        ProgramInstance_t * programInstance = &_blurFilterIntensityMapProgramVariants[samples];
+        
+        if (fragmentShaderSource)
+        {
+            [self loadBlurFilterProgramInstance:programInstance vertexShaderSource:VertexShaderSourceDefault fragmentShaderSource:fragmentShaderSource];
+            [self validateBlurFilterProgramVariant:programInstance firstProgramInstance:firstProgramInstance samples:samples];
+        }
+        
+#if FilterPrefilterEnabled
+        char * prefilterFragmentShaderSource = createBtsIntensityMapBlurFilterFragmentShaderSource(samples, bankKernelCount, bankSamples, true);
+        ProgramInstance_t * prefilterProgramInstance = &_blurFilterIntensityMapPrefilterProgramVariants[samples];
+        
+        if (programInstance->program && prefilterFragmentShaderSource)
+        {
+            [self loadBlurFilterProgramInstance:prefilterProgramInstance vertexShaderSource:VertexShaderSourceDefault fragmentShaderSource:prefilterFragmentShaderSource];
+            [self validateBlurFilterProgramVariant:prefilterProgramInstance firstProgramInstance:firstProgramInstance samples:samples];
+        }
+        
+        free(prefilterFragmentShaderSource);
+#endif
+        
+        free(fragmentShaderSource);
+        
+        // The map is always read from texture unit 2
+        const ProgramInstance_t * programInstances[2] = {programInstance, &_blurFilterIntensityMapPrefilterProgramVariants[samples]};
+        
+        for (size_t i = 0; i < 2; ++i)
+        {
+            if (programInstances[i]->program)
+            {
+                glUseProgram(programInstances[i]->program);
+                glUniform1i(programInstances[i]->uniforms.FragFilterIntensityMap, 2);
+            }
+        }
+    }
+    
+    [self loadFilterKernelBankInProgramVariants:_blurFilterIntensityMapProgramVariants prefilterProgramVariants:_blurFilterIntensityMapPrefilterProgramVariants];
+}
+#endif
+
+- (void)validateBlurFilterProgramVariant:(ProgramInstance_t *)programInstance firstProgramInstance:(const ProgramInstance_t *)firstProgramInstance samples:(unsigned int)samples
+{
+    if (programInstance->attributes.VertPosition != firstProgramInstance->attributes.VertPosition ||
+        programInstance->attributes.VertTextureCoordinate != firstProgramInstance->attributes.VertTextureCoordinate)
+    {
+        Log(@"LAUCaptureVideoPreviewLayer: Program variant for %u samples has different attribute locations", samples);
+        unloadProgram(&programInstance->program);
+    }
+}
+
+- (void)useBlurFilterProgramVariantForSamples:(GLuint)samples
+{
+    ProgramInstance_t * programVariants = _blurFilterProgramVariants;
+    ProgramInstance_t * prefilterProgramVariants = _blurFilterPrefilterProgramVariants;
+    
+#if FilterKernelBankEnabled
+    // Kernel of each fragment (loadFilterIntensityMap)
+    if (_filterIntensityMapLoaded)
+    {
+        programVariants = _blurFilterIntensityMapProgramVariants;
+        prefilterProgramVariants = _blurFilterIntensityMapPrefilterProgramVariants;
+    }
+#endif
+    
+    // Smallest variant with enough samples (the extra samples have zero weights)
+    for (GLuint variantSamples = MAX(samples, 1); variantSamples <= kFilterKernelVariantMaxSamples; ++variantSamples)
+    {
+        ProgramInstance_t * programInstance = &programVariants[variantSamples];
+        
+        if (programInstance->program)
+        {
+            if (variantSamples != _blurFilterProgramSamples)
+            {
+                _blurFilterProgram = programInstance->program;
+                _blurFilterUniforms = programInstance->uniforms;
+                _blurFilterAttributes = programInstance->attributes;
+                _blurFilterProgramSamples = variantSamples;
+                
+#if FilterPrefilterEnabled
+                _blurFilterPrefilterProgramInstance = &prefilterProgramVariants[variantSamples];
+                _blurFilterPrefilterProgramInstance = _blurFilterPrefilterProgramInstance->program ? _blurFilterPrefilterProgramInstance : NULL;
+                
+                if (_blurFilterPrefilterProgramInstance)
+                {
+                    glUseProgram(_blurFilterPrefilterProgramInstance->program);
+                    glUniform1i(_blurFilterPrefilterProgramInstance->uniforms.FragTextureData, 0);
+                }
+#endif
+                
+                glUseProgram(_blurFilterProgram);
+                glUniform1i(_blurFilterUniforms.FragTextureData, 0);
+            }
+            
+            return;
+        }
+    }
+}
+#endif
+
++ (ProgramCache_t *)programCache
+{
+    static ProgramCache_t * programCache = NULL;
+    static dispatch_once_t onceToken;
+    
+    dispatch_once(&onceToken, ^{
+        // Shared by all layers, program binaries survive app launches
+        NSURL * cachesURL = [[[NSFileManager defaultManager] URLsForDirectory:NSCachesDirectory inDomains:NSUserDomainMask] firstObject];
+        NSURL * directoryURL = [cachesURL URLByAppendingPathComponent:@"LAUCaptureVideoPreviewLayer/Programs" isDirectory:YES];
+        
+        NSError * error = nil;
+        if (![[NSFileManager defaultManager] createDirectoryAtURL:directoryURL withIntermediateDirectories:YES attributes:nil error:&error])
+        {
+            Log(@"LAUCaptureVideoPreviewLayer: Program cache disabled %@", error);
+            directoryURL = nil;
+        }
+        
+        programCache = createProgramCache(directoryURL.fileSystemRepresentation);
+    });
+    
+    return programCache;
+}
+
++ (ProgramCacheStatistics_t)programCacheStatistics
+{
+    ProgramCacheStatistics_t statistics;
+    programCacheStatistics([self programCache], &statistics);
+    return statistics;
+}
+
++ (NSUInteger)programCacheHitCount
+{
+    return [self programCacheStatistics].hitCount;
+}
+
++ (NSUInteger)programCacheMissCount
+{
+    return [self programCacheStatistics].missCount;
+}
+
++ (NSTimeInterval)programCompileTime
+{
+    return [self programCacheStatistics].compileTime;
+}
+
++ (NSTimeInterval)programLoadTime
+{
+    return [self programCacheStatistics].loadTime;
 }
 
 - (void)unloadProgram
@@ -274,48 +875,201 @@
     [self renderInContext:context andRedrawPixelBuffer:YES];
 }
 
-- (void)renderInContext:(CGContextRef)context andRedrawPixelBuffer:(BOOL)redrawPixelBuffer
+// Draws the readback of the onscreen framebuffer in a CGContext
+struct PixelReadbackContext {
+    CGContextRef context;
+    CGFloat contentsScale;
+};
+
+static void drawPixelReadbackImageInContext(void * context, const PixelReadbackImage_t * image)
 {
-    // Assuming kEAGLColorFormatRGBA8 format is used
-    NSInteger pixelsDataSize = _onscreenColorRenderbufferWidth * _onscreenColorRenderbufferHeight * 4;
-    GLubyte * pixelsData = (GLubyte * )calloc(pixelsDataSize, sizeof(GLubyte));
+    struct PixelReadbackContext * readbackContext = (struct PixelReadbackContext *)context;
+    
+    // Create a CGImage instance with the pixels data, without copying (the image is drawn before the callback returns)
+    // Use kCGImageAlphaNoneSkipLast for opaque views (ignore the alpha channel) or kCGImageAlphaPremultipliedLast for non-opaque views
+    CGDataProviderRef dataProvider = CGDataProviderCreateWithData(NULL, image->data, image->bytesPerRow * image->height, NULL);
+    CGColorSpaceRef colorspace = CGColorSpaceCreateDeviceRGB();
+    CGImageRef cgImage = CGImageCreate(image->width,
+                                       image->height,
+                                       8,
+                                       32,
+                                       image->bytesPerRow,
+                                       colorspace,
+                                       kCGBitmapByteOrder32Big | kCGImageAlphaPremultipliedLast,
+                                       dataProvider,
+                                       NULL,
+                                       true,
+                                       kCGRenderingIntentDefault);
+    
+    // Flip the CGImage by rendering it to the flipped bitmap context (UIKit coordinate system is the inverse of the Quartz/OpenGL coordinate system)
+    CGContextSetBlendMode(readbackContext->context, kCGBlendModeCopy);
+    CGContextDrawImage(readbackContext->context, CGRectMake(0.0, 0.0, image->width / readbackContext->contentsScale, image->height / readbackContext->contentsScale), cgImage);
     
+    CFRelease(dataProvider);
+    CFRelease(colorspace);
+    CGImageRelease(cgImage);
+}
+
+- (void)renderInContext:(CGContextRef)context andRedrawPixelBuffer:(BOOL)redrawPixelBuffer
+{
     // Redraw pixelBuffer or read the current contents of the onscreen framebuffer
     if (redrawPixelBuffer) {
         [self drawPixelBuffer:nil];
     }
     
-    // Bind the offscreen framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, _onscreenFramebuffer);
+    // The context is drawn synchronously, but the pixels go through the (reused) readback buffers instead of a new allocation
+    struct PixelReadbackContext readbackContext = { context, self.contentsScale };
     
-    // Read pixel data from the framebuffer
-    glPixelStorei(GL_PACK_ALIGNMENT, 4);
-    glReadPixels(0, 0, _onscreenColorRenderbufferWidth, _onscreenColorRenderbufferHeight, GL_RGBA, GL_UNSIGNED_BYTE, pixelsData);
+    if ([self requestPixelReadbackWithCompletion:drawPixelReadbackImageInContext context:&readbackContext])
+    {
+        [self pollPixelReadbackWaitingUntilCompleted:YES];
+    }
+}
+
+#pragma mark -
+#pragma mark Onscreen framebuffer readback
+
+- (BOOL)requestPixelReadbackWithCompletion:(PixelReadbackCompletion)completion context:(void *)context
+{
+    return [self requestPixelReadbackOfFramebuffer:_onscreenFramebuffer width:_onscreenColorRenderbufferWidth height:_onscreenColorRenderbufferHeight completion:completion context:context];
+}
+
+- (BOOL)requestPixelReadbackOfFramebuffer:(GLuint)framebuffer width:(GLsizei)width height:(GLsizei)height completion:(PixelReadbackCompletion)completion context:(void *)context
+{
+    if (!framebuffer)
+    {
+        Log(@"Invalid framebuffer. I am just going to bailout.");
+        return NO;
+    }
     
-    // Create a CGImage instance with the pixels data
-    // Use kCGImageAlphaNoneSkipLast for opaque views (ignore the alpha channel) or kCGImageAlphaPremultipliedLast for non-opaque views
-    CGDataProviderRef dataProvider = CGDataProviderCreateWithData(NULL, pixelsData, pixelsDataSize, NULL);
-    CGColorSpaceRef colorspace = CGColorSpaceCreateDeviceRGB();
-    CGImageRef image = CGImageCreate(_onscreenColorRenderbufferWidth,
-                                     _onscreenColorRenderbufferHeight,
-                                     8,
-                                     32,
-                                     _onscreenColorRenderbufferWidth * 4,
-                                     colorspace,
-                                     kCGBitmapByteOrder32Big | kCGImageAlphaPremultipliedLast,
-                                     dataProvider,
-                                     NULL,
-                                     true,
-                                     kCGRenderingIntentDefault);
+    if (!_pixelReadback)
+    {
+        _pixelReadback = createPixelReadback(kPixelReadbackDepth);
+    }
     
-    // Flip the CGImage by rendering it to the flipped bitmap context (UIKit coordinate system is the inverse of the Quartz/OpenGL coordinate system)
-    CGContextSetBlendMode(context, kCGBlendModeCopy);
-    CGContextDrawImage(context, CGRectMake(0.0, 0.0, _onscreenColorRenderbufferWidth / self.contentsScale, _onscreenColorRenderbufferHeight / self.contentsScale), image);
+    EAGLContext * oglContext = [EAGLContext currentContext];
+    if (oglContext != _oglContext)
+    {
+        [EAGLContext setCurrentContext:_oglContext];
+    }
+    
+    BOOL requested = pixelReadbackRequest(_pixelReadback, framebuffer, width, height, completion, context);
+    
+    if (oglContext != _oglContext)
+    {
+        [EAGLContext setCurrentContext:oglContext];
+    }
+    
+    return requested;
+}
+
+- (void)pollPixelReadbackWaitingUntilCompleted:(BOOL)waitUntilCompleted
+{
+    if (!_pixelReadback || pixelReadbackPendingCount(_pixelReadback) == 0)
+    {
+        return;
+    }
+    
+    EAGLContext * oglContext = [EAGLContext currentContext];
+    if (oglContext != _oglContext)
+    {
+        [EAGLContext setCurrentContext:_oglContext];
+    }
+    
+    pixelReadbackPoll(_pixelReadback, waitUntilCompleted);
+    
+    if (oglContext != _oglContext)
+    {
+        [EAGLContext setCurrentContext:oglContext];
+    }
+    
+    // The display link polls after each frame, keep polling while it's paused
+    if (pixelReadbackPendingCount(_pixelReadback) > 0 && self.displayLink.paused)
+    {
+        __weak LAUCaptureVideoPreviewLayer * weakSelf = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kPixelReadbackPollInterval * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+            [weakSelf pollPixelReadbackWaitingUntilCompleted:NO];
+        });
+    }
+}
+
+// Gives the pixels of a released CGImage back to the pool
+static void releasePixelReadbackBufferData(void * info, const void * data, size_t size)
+{
+    pixelReadbackBufferRelinquish((PixelReadbackBuffer_t *)info);
+}
+
+// CGImage of a copy of the readback in a pooled buffer (the buffer goes back to the pool when the image is released)
+// Rows are flipped for the onscreen framebuffer (upright image), texture readbacks keep the texture row order
+static CGImageRef createPixelReadbackCGImage(PixelReadbackBufferPool_t * bufferPool, const PixelReadbackImage_t * image, BOOL flipped)
+{
+    size_t size = image->bytesPerRow * image->height;
+    PixelReadbackBuffer_t * buffer = pixelReadbackBufferPoolAcquire(bufferPool, size);
+    
+    if (!buffer)
+    {
+        return NULL;
+    }
+    
+    UInt8 * pixels = pixelReadbackBufferBytes(buffer);
+    
+    if (flipped)
+    {
+        for (size_t y = 0; y < image->height; ++y)
+        {
+            memcpy(pixels + y * image->bytesPerRow, image->data + (image->height - 1 - y) * image->bytesPerRow, image->bytesPerRow);
+        }
+    }
+    else
+    {
+        memcpy(pixels, image->data, size);
+    }
+    
+    CGDataProviderRef dataProvider = CGDataProviderCreateWithData(buffer, pixels, size, releasePixelReadbackBufferData);
+    
+    if (!dataProvider)
+    {
+        pixelReadbackBufferRelinquish(buffer);
+        return NULL;
+    }
+    
+    CGColorSpaceRef colorspace = CGColorSpaceCreateDeviceRGB();
+    CGImageRef cgImage = CGImageCreate(image->width, image->height, 8, 32, image->bytesPerRow, colorspace,
+                                       kCGBitmapByteOrder32Big | kCGImageAlphaNoneSkipLast, dataProvider, NULL, true, kCGRenderingIntentDefault);
     
-    free(pixelsData);
-    CFRelease(dataProvider);
     CFRelease(colorspace);
-    CGImageRelease(image);
+    CGDataProviderRelease(dataProvider);
+    
+    return cgImage;
+}
+
+// Calls the readback handler (the context), NULL image if the request failed
+static void completePixelReadbackImage(void * context, const PixelReadbackImage_t * image)
+{
+    void (^readbackHandler)(const PixelReadbackImage_t * image) = (__bridge_transfer void (^)(const PixelReadbackImage_t *))context;
+    readbackHandler(image);
+}
+
+- (void)snapshotImageWithCompletionHandler:(void (^)(UIImage * image))completionHandler
+{
+    CGFloat contentsScale = self.contentsScale;
+    PixelReadbackBufferPool_t * bufferPool = _pixelReadbackBufferPool;
+    void (^readbackHandler)(const PixelReadbackImage_t *) = ^(const PixelReadbackImage_t * image) {
+        CGImageRef cgImage = image ? createPixelReadbackCGImage(bufferPool, image, YES) : NULL;
+        completionHandler(cgImage ? [UIImage imageWithCGImage:cgImage scale:contentsScale orientation:UIImageOrientationUp] : nil);
+        CGImageRelease(cgImage);
+    };
+    
+    void * context = (__bridge_retained void *)[readbackHandler copy];
+    
+    if (![self requestPixelReadbackWithCompletion:completePixelReadbackImage context:context])
+    {
+        // Balance the retain, the completion won't be called
+        completePixelReadbackImage(context, NULL);
+        return;
+    }
+    
+    [self pollPixelReadbackWaitingUntilCompleted:NO];
 }
 
 #pragma mark -
@@ -354,6 +1108,9 @@
 {
     _blur = MIN(1.0f, MAX(0.0f, blur));
     [self setFilterIntensity:_blur animated:animated];
+    
+    // Blur timeline of the frame recording (if any)
+    [self.internal recordBlur:_blur transitionDuration:animated ? [self filterIntensityTransitionDuration] : 0.0f];
 }
 
 #pragma mark -
@@ -364,58 +1121,335 @@
     return self.internal.session;
 }
 
-- (void)setSession:(AVCaptureSession *)session
+- (void)setSession:(AVCaptureSession *)session
+{
+    self.internal.session = session;
+}
+
+#pragma mark -
+#pragma mark AVCaptureVideoPreviewLayer
+
+- (void)addAVCaptureVideoPreviewSublayer
+{
+    PrettyLog;
+    
+    if (self.internal.session)
+    {
+        if (!_videoPreviewSublayer)
+        {
+            // Create the session video preview layer from AVFoundation
+            _videoPreviewSublayer = [[AVCaptureVideoPreviewLayer alloc] initWithSession:self.internal.session];
+            
+            _videoPreviewSublayer.backgroundColor = self.backgroundColor;
+            _videoPreviewSublayer.videoGravity = AVLayerVideoGravityResizeAspectFill;  // TODO self.videoGravity
+            _videoPreviewSublayer.bounds = self.bounds;
+            _videoPreviewSublayer.anchorPoint = CGPointMake(0,0);
+            _videoPreviewSublayer.hidden = YES;
+            
+            [self addSublayer:_videoPreviewSublayer];
+        }
+        
+        [CATransaction begin];
+        [CATransaction setValue: (id) kCFBooleanTrue forKey: kCATransactionDisableActions];
+        _videoPreviewSublayer.hidden = NO;
+        [CATransaction commit];
+        
+        self.displayLink.paused = YES;
+        [self flushPixelBufferCache];
+    }
+}
+
+- (void)removeAVCaptureVideoPreviewSublayer
+{
+    PrettyLog;
+    
+    if (_videoPreviewSublayer)
+    {
+        [self drawPixelBuffer:nil];
+        self.displayLink.paused = NO;
+        
+        [CATransaction begin];
+        [CATransaction setValue: (id) kCFBooleanTrue forKey: kCATransactionDisableActions];
+        _videoPreviewSublayer.hidden = YES;
+        [CATransaction commit];
+    }
+}
+
+#pragma mark -
+#pragma mark Frame queue
+
+- (NSUInteger)frameQueueDepth
+{
+    return self.internal.sampleBufferQueueDepth;
+}
+
+- (LAUCaptureVideoPreviewLayerFrameQueuePolicy)frameQueuePolicy
+{
+    return (LAUCaptureVideoPreviewLayerFrameQueuePolicy)self.internal.sampleBufferQueuePolicy;
+}
+
+- (void)setFrameQueueDepth:(NSUInteger)depth policy:(LAUCaptureVideoPreviewLayerFrameQueuePolicy)policy
+{
+    [self.internal setSampleBufferQueueDepth:depth policy:(FrameQueuePolicy_t)policy];
+}
+
+- (NSUInteger)enqueuedFrameCount
+{
+    return self.internal.sampleBufferQueueStatistics.enqueuedFrameCount;
+}
+
+- (NSUInteger)droppedFrameCount
+{
+    return self.internal.sampleBufferQueueStatistics.droppedFrameCount;
+}
+
+- (NSUInteger)renderedFrameCount
+{
+    return self.internal.sampleBufferQueueStatistics.takenFrameCount;
+}
+
+- (NSTimeInterval)frameAge
+{
+    return self.internal.sampleBufferQueueStatistics.lastFrameAge;
+}
+
+- (NSTimeInterval)averageFrameAge
+{
+    return self.internal.sampleBufferQueueStatistics.averageFrameAge;
+}
+
+- (NSTimeInterval)maxFrameAge
+{
+    return self.internal.sampleBufferQueueStatistics.maxFrameAge;
+}
+
+- (NSUInteger)skippedFrameCount
+{
+    return _skippedFrameCount;
+}
+
+- (NSUInteger)similarFrameCount
+{
+    return _similarFrameCount;
+}
+
+#pragma mark -
+#pragma mark Frame timings
+
+- (NSDictionary<NSString *, NSDictionary<NSString *, NSNumber *> *> *)frameTimingStatistics
+{
+    if (!_frameTimings)
+    {
+        return nil;
+    }
+    
+    NSMutableDictionary * frameTimingStatistics = [NSMutableDictionary dictionary];
+    
+    for (unsigned int stage = 0; stage < FrameTimingStageCount; ++stage)
+    {
+        NSMutableDictionary * stageStatistics = [NSMutableDictionary dictionary];
+        FrameTimingStatistics_t statistics;
+        
+        if (frameTimingsStatistics(_frameTimings, stage, false, &statistics))
+        {
+            [stageStatistics addEntriesFromDictionary:@{ @"cpuMean" : @(statistics.mean), @"cpuP50" : @(statistics.p50), @"cpuP90" : @(statistics.p90), @"cpuP99" : @(statistics.p99), @"cpuMax" : @(statistics.max) }];
+        }
+        
+        if (frameTimingsStatistics(_frameTimings, stage, true, &statistics))
+        {
+            [stageStatistics addEntriesFromDictionary:@{ @"gpuMean" : @(statistics.mean), @"gpuP50" : @(statistics.p50), @"gpuP90" : @(statistics.p90), @"gpuP99" : @(statistics.p99), @"gpuMax" : @(statistics.max) }];
+        }
+        
+        if (stageStatistics.count > 0)
+        {
+            char stageName[32];
+            frameTimingsStageName(stage, stageName, sizeof(stageName));
+            frameTimingStatistics[@(stageName)] = stageStatistics;
+        }
+    }
+    
+    return frameTimingStatistics;
+}
+
+#pragma mark -
+#pragma mark Adaptive quality
+
+- (BOOL)adaptiveQualityEnabled
+{
+    return _adaptiveQualityEnabled;
+}
+
+- (void)setAdaptiveQualityEnabled:(BOOL)adaptiveQualityEnabled
+{
+    _adaptiveQualityEnabled = adaptiveQualityEnabled;
+    
+    // Start over from the default filter parameters
+    qualityGovernorReset(_qualityGovernor);
+    [self loadQualityLevel];
+}
+
+- (NSTimeInterval)frameTimeBudget
+{
+    return qualityGovernorFrameBudget(_qualityGovernor);
+}
+
+- (void)setFrameTimeBudget:(NSTimeInterval)frameTimeBudget
+{
+    qualityGovernorSetFrameBudget(_qualityGovernor, frameTimeBudget);
+}
+
+- (NSUInteger)qualityLevel
+{
+    return qualityGovernorLevelIndex(_qualityGovernor);
+}
+
+- (void)loadQualityLevel
+{
+    const QualityGovernorLevel_t * level = qualityGovernorLevel(_qualityGovernor, qualityGovernorLevelIndex(_qualityGovernor));
+    
+    _filterDownsamplingFactor = level->downsamplingFactor;
+    _filterMultiplePassCount = level->multiplePassCount;
+    
+    // The kernel changes with the level (same effective sigma), the next frame is filtered again
+    _filterIntensityNeedsUpdate = YES;
+}
+
+// Kernel step with the same blur at the current quality level as _filterKernelStep at level 0
+- (float)qualityLevelFilterKernelStep
+{
+    unsigned int levelIndex = qualityGovernorLevelIndex(_qualityGovernor);
+    
+    if (levelIndex == 0)
+    {
+        return _filterKernelStep;
+    }
+    
+    float sigma = gaussianFilterSigmaForStep(&_filterKernelParameters, _filterKernelStep);
+    float kernelSigma = qualityGovernorKernelSigma(qualityGovernorLevel(_qualityGovernor, levelIndex), qualityGovernorLevel(_qualityGovernor, 0), sigma, &_filterKernelParameters);
+    
+    return gaussianFilterStepForSigma(&_filterKernelParameters, kernelSigma);
+}
+
+#pragma mark -
+#pragma mark Pass planner
+
+// Kernel step of the current frame, the adaptive quality takes over the planner when it is enabled
+- (float)currentFilterKernelStep
+{
+#if FilterPassPlannerEnabled
+    if (!_adaptiveQualityEnabled)
+    {
+        return [self plannedFilterKernelStep];
+    }
+#endif
+    
+    return [self qualityLevelFilterKernelStep];
+}
+
+// Plans the cheapest chain with the blur of _filterKernelStep at quality level 0, loads its downsampling factor and pass count
+- (float)plannedFilterKernelStep
+{
+    const QualityGovernorLevel_t * level = qualityGovernorLevel(_qualityGovernor, 0);
+    
+    FilterPlannerParameters_t plannerParameters = kFilterPlannerDefaultParameters;
+#if !FilterBilinearTextureSamplingEnabled
+    plannerParameters.kernelType = GaussianFilterKernelTypeDts;
+#endif
+    plannerParameters.prefilterEnabled = FilterPrefilterEnabled;
+    
+    float sigma = gaussianFilterSigmaForStep(&_filterKernelParameters, _filterKernelStep);
+    float targetSigma = filterPlannerEffectiveSigma(&plannerParameters, &_filterKernelParameters, level->downsamplingFactor, level->multiplePassCount, sigma);
+    
+    // If no chain is under the error the most accurate one is used
+    filterPlannerPlanForSigma(&plannerParameters, &_filterKernelParameters, targetSigma, &_filterPlan);
+    
+    _filterDownsamplingFactor = _filterPlan.downsamplingFactor;
+    _filterMultiplePassCount = _filterPlan.multiplePassCount;
+    
+    return gaussianFilterStepForSigma(&_filterKernelParameters, _filterPlan.kernelSigma);
+}
+
+#pragma mark -
+#pragma mark Render targets
+
+- (NSUInteger)renderTargetMemoryBudget
+{
+    return _renderTargetMemoryBudget;
+}
+
+- (void)setRenderTargetMemoryBudget:(NSUInteger)renderTargetMemoryBudget
+{
+    // Applied on the next draw call, with the context current
+    _renderTargetMemoryBudget = renderTargetMemoryBudget;
+    _renderTargetMemoryBudgetNeedsUpdate = YES;
+}
+
+- (RenderTargetPoolStatistics_t)renderTargetPoolStatistics
+{
+    RenderTargetPoolStatistics_t statistics;
+    renderTargetPoolStatistics(_renderTargetPool, &statistics);
+    return statistics;
+}
+
+- (NSUInteger)renderTargetByteCount
+{
+    return [self renderTargetPoolStatistics].liveByteCount;
+}
+
+- (NSUInteger)renderTargetPeakByteCount
+{
+    return [self renderTargetPoolStatistics].peakByteCount;
+}
+
+- (NSUInteger)renderTargetAllocationCount
+{
+    return [self renderTargetPoolStatistics].allocationCount;
+}
+
+- (NSUInteger)renderTargetReuseCount
+{
+    return [self renderTargetPoolStatistics].reuseCount;
+}
+
+#pragma mark -
+#pragma mark Frame recording
+
+- (BOOL)startFrameRecordingToPath:(NSString *)path
+{
+    if (![self.internal startFrameRecordingToPath:path maxPendingByteCount:kFrameRecordingMaxPendingByteCount])
+    {
+        return NO;
+    }
+    
+    // The replay starts with the current view size and intensity, and the transition in progress
+    if (_onscreenFramebuffer)
+    {
+        [self.internal recordViewWidth:_onscreenColorRenderbufferWidth height:_onscreenColorRenderbufferHeight];
+    }
+    
+    [self.internal recordBlur:_filterIntensity transitionDuration:0.0f];
+    
+    if (_filterIntensity != _blur)
+    {
+        [self.internal recordBlur:_blur transitionDuration:[self filterIntensityTransitionDuration]];
+    }
+    
+    return YES;
+}
+
+- (void)stopFrameRecording
 {
-    self.internal.session = session;
+    [self.internal stopFrameRecording];
 }
 
-#pragma mark -
-#pragma mark AVCaptureVideoPreviewLayer
-
-- (void)addAVCaptureVideoPreviewSublayer
+- (NSUInteger)recordedFrameCount
 {
-    PrettyLog;
-    
-    if (self.internal.session)
-    {
-        if (!_videoPreviewSublayer)
-        {
-            // Create the session video preview layer from AVFoundation
-            _videoPreviewSublayer = [[AVCaptureVideoPreviewLayer alloc] initWithSession:self.internal.session];
-            
-            _videoPreviewSublayer.backgroundColor = self.backgroundColor;
-            _videoPreviewSublayer.videoGravity = AVLayerVideoGravityResizeAspectFill;  // TODO self.videoGravity
-            _videoPreviewSublayer.bounds = self.bounds;
-            _videoPreviewSublayer.anchorPoint = CGPointMake(0,0);
-            _videoPreviewSublayer.hidden = YES;
-            
-            [self addSublayer:_videoPreviewSublayer];
-        }
-        
-        [CATransaction begin];
-        [CATransaction setValue: (id) kCFBooleanTrue forKey: kCATransactionDisableActions];
-        _videoPreviewSublayer.hidden = NO;
-        [CATransaction commit];
-        
-        self.displayLink.paused = YES;
-        [self flushPixelBufferCache];
-    }
+    return self.internal.frameRecorderStatistics.recordedFrameCount;
 }
 
-- (void)removeAVCaptureVideoPreviewSublayer
+- (NSUInteger)recordingDroppedFrameCount
 {
-    PrettyLog;
-    
-    if (_videoPreviewSublayer)
-    {
-        [self drawPixelBuffer:nil];
-        self.displayLink.paused = NO;
-        
-        [CATransaction begin];
-        [CATransaction setValue: (id) kCFBooleanTrue forKey: kCATransactionDisableActions];
-        _videoPreviewSublayer.hidden = YES;
-        [CATransaction commit];
-    }
+    return self.internal.frameRecorderStatistics.droppedFrameCount;
 }
 
 #pragma mark -
@@ -427,6 +1461,9 @@
     {
         _internal = [LAUCaptureVideoPreviewLayerInternal new];
         _internal.delegate = self;
+#if FilterYUVInputEnabled
+        _internal.pixelFormatType = kCVPixelFormatType_420YpCbCr8BiPlanarFullRange;
+#endif
     }
     
     return _internal;
@@ -492,6 +1529,11 @@
 }
 
 - (CVOpenGLESTextureRef)oglTextureFromPixelBuffer:(CVPixelBufferRef)pixelBuffer
+{
+    return [self oglTextureFromPixelBuffer:pixelBuffer planeIndex:0];
+}
+
+- (CVOpenGLESTextureRef)oglTextureFromPixelBuffer:(CVPixelBufferRef)pixelBuffer planeIndex:(size_t)planeIndex
 {
     // Create a new CVOpenGLESTexture cache
     if (!_oglTextureCache)
@@ -509,18 +1551,29 @@
     // Create a CVOpenGLESTexture from a CVPixelBufferRef
     size_t textureWidth = CVPixelBufferGetWidth(pixelBuffer);
     size_t textureHeight = CVPixelBufferGetHeight(pixelBuffer);
+    GLint textureFormat = GL_RGBA;
+    GLenum pixelFormat = GL_BGRA;
+    
+    // 420 bi-planar: luma plane (GL_LUMINANCE) or interleaved CbCr plane at half resolution (GL_LUMINANCE_ALPHA, Cb in r and Cr in a)
+    if (CVPixelBufferIsPlanar(pixelBuffer))
+    {
+        textureWidth = CVPixelBufferGetWidthOfPlane(pixelBuffer, planeIndex);
+        textureHeight = CVPixelBufferGetHeightOfPlane(pixelBuffer, planeIndex);
+        textureFormat = pixelFormat = (planeIndex == 0) ? GL_LUMINANCE : GL_LUMINANCE_ALPHA;
+    }
+    
     CVOpenGLESTextureRef oglTexture = NULL;
     CVReturn result = CVOpenGLESTextureCacheCreateTextureFromImage(kCFAllocatorDefault,
                                                                    _oglTextureCache,
                                                                    pixelBuffer,
                                                                    NULL,
                                                                    GL_TEXTURE_2D,
-                                                                   GL_RGBA,
+                                                                   textureFormat,
                                                                    (GLsizei)textureWidth,
                                                                    (GLsizei)textureHeight,
-                                                                   GL_BGRA,
+                                                                   pixelFormat,
                                                                    GL_UNSIGNED_BYTE,
-                                                                   0,
+                                                                   planeIndex,
                                                                    &oglTexture);
     
     if (result != kCVReturnSuccess)
@@ -550,6 +1603,12 @@
         _pixelBufferTexture = NULL;
     }
     
+    if (_pixelBufferChromaTexture)
+    {
+        CFRelease(_pixelBufferChromaTexture);
+        _pixelBufferChromaTexture = NULL;
+    }
+    
     if (_oglTextureCache)
     {
         CVOpenGLESTextureCacheFlush(_oglTextureCache, 0);
@@ -561,39 +1620,12 @@
 
 - (GLuint)createFramebufferForOffscreenTextureInstance:(TextureInstance_t *)offscreenTextureInstance
 {
-    // Delete potential previously created framebuffer
-    if(offscreenTextureInstance->framebuffer)
-    {
-        glDeleteFramebuffers(1, &offscreenTextureInstance->framebuffer);
-    }
-    
-    // Allocating offscreen renderbuffer memory
-    glGenFramebuffers(1, &offscreenTextureInstance->framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, offscreenTextureInstance->framebuffer);
-    
-    // Create the texture to render
-    glGenTextures(1, &offscreenTextureInstance->textureName);
-    offscreenTextureInstance->textureTarget = GL_TEXTURE_2D;
-    glBindTexture(GL_TEXTURE_2D, offscreenTextureInstance->textureName);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, offscreenTextureInstance->textureWidth, offscreenTextureInstance->textureHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-    
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    
-    // Attach color component of renderbuffer to texture
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, offscreenTextureInstance->textureName, 0);
-    
-    if (!checkFramebufferStatusComplete())
+    // Recycle a texture and framebuffer with the same dimensions, the previous ones go back to the pool
+    if (!renderTargetPoolAcquireTextureInstance(_renderTargetPool, offscreenTextureInstance, offscreenTextureInstance->textureWidth, offscreenTextureInstance->textureHeight, GL_RGBA))
     {
         return 0;
     }
     
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    
     return offscreenTextureInstance->framebuffer;
 }
 
@@ -604,60 +1636,58 @@
     
     // Use triangle strip
     offscreenTextureInstance->primitiveType = GL_TRIANGLE_STRIP;
-    
-    // Vertex data
-    static const VertexData_t vertexData[] = {
-        {
-            {-1.0f, -1.0f}, // Position, bottom left
-            {0.0f, 0.0f} // Texture Coordinate
-        },
-        {
-            {1.0f, -1.0f}, // bottom right
-            {1.0f, 0.0f}
-        },
-        {
-            {-1.0f,  1.0f}, // top left
-            {0.0f,  1.0f}
-        },
-        {
-            {1.0f,  1.0f}, // top right
-            {1.0f,  1.0f}
-        }
-    };
-    
-    static const GLsizei stride = sizeof(VertexData_t);
     offscreenTextureInstance->vertexCount = 4;
     
-    // Vertex Array Object
-    glGenVertexArraysOES(1, &offscreenTextureInstance->vertexArray);
-    glBindVertexArrayOES(offscreenTextureInstance->vertexArray);
-    
-    // VBO
-    glGenBuffers(1, &(offscreenTextureInstance->vertexBuffer));
-    glBindBuffer(GL_ARRAY_BUFFER, offscreenTextureInstance->vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, offscreenTextureInstance->vertexCount * stride, vertexData, GL_STATIC_DRAW);
-    
-    // Position
-    glEnableVertexAttribArray(_blurFilterAttributes.VertPosition);
-    glVertexAttribPointer(_blurFilterAttributes.VertPosition, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(VertexData_t, position));
-    
-    // TextureCoordinate
-    glEnableVertexAttribArray(_blurFilterAttributes.VertTextureCoordinate);
-    glVertexAttribPointer(_blurFilterAttributes.VertTextureCoordinate, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(VertexData_t, textureCoordinate));
+    // The quad doesn't depend on the dimensions, a single VAO is created
+    if (!_offscreenVertexArray)
+    {
+        static const GLsizei stride = sizeof(VertexData_t);
+        
+        // Vertex Array Object
+        glGenVertexArraysOES(1, &_offscreenVertexArray);
+        glBindVertexArrayOES(_offscreenVertexArray);
+        
+        // VBO
+        glBindBuffer(GL_ARRAY_BUFFER, renderTargetPoolQuadVertexBuffer(_renderTargetPool));
+        
+        // Position
+        glEnableVertexAttribArray(_blurFilterAttributes.VertPosition);
+        glVertexAttribPointer(_blurFilterAttributes.VertPosition, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(VertexData_t, position));
+        
+        // TextureCoordinate
+        glEnableVertexAttribArray(_blurFilterAttributes.VertTextureCoordinate);
+        glVertexAttribPointer(_blurFilterAttributes.VertTextureCoordinate, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(VertexData_t, textureCoordinate));
+        
+        // Unbind VBO + VAO
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArrayOES(0);
+    }
     
-    // Unbind VBO + VAO
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArrayOES(0);
+    offscreenTextureInstance->vertexArray = _offscreenVertexArray;
+    offscreenTextureInstance->vertexBuffer = renderTargetPoolQuadVertexBuffer(_renderTargetPool);
 }
 
 - (void)scaleDownPixelBufferTextureInstanceDimensions
+{
+    [self scaleDownTextureInstanceDimensions:&_pixelBufferTextureInstance downsamplingFactor:_filterDownsamplingFactor];
+    
+#if FilterYUVInputEnabled
+    // The chroma plane is filtered at half the luma dimensions
+    if (_pixelBufferChromaTexture)
+    {
+        [self scaleDownTextureInstanceDimensions:&_pixelBufferChromaTextureInstance downsamplingFactor:2.0f * _filterDownsamplingFactor];
+    }
+#endif
+}
+
+- (void)scaleDownTextureInstanceDimensions:(TextureInstance_t *)textureInstance downsamplingFactor:(GLfloat)downsamplingFactor
 {
     // Default downsampling factor
-    GLfloat textureDownsamplingFactor = _filterDownsamplingFactor;
+    GLfloat textureDownsamplingFactor = downsamplingFactor;
     
     // Pixel buffer dimensions and ratio
-    GLfloat pixelBufferWidth = _pixelBufferTextureInstance.textureWidth;
-    GLfloat pixelBufferHeight = _pixelBufferTextureInstance.textureHeight;
+    GLfloat pixelBufferWidth = textureInstance->textureWidth;
+    GLfloat pixelBufferHeight = textureInstance->textureHeight;
     GLfloat pixelBufferRatio = pixelBufferWidth / pixelBufferHeight; // Usually the pixelBuffer w > h
     
     // Screen dimensions and ratio
@@ -668,12 +1698,12 @@
     if (onscreenRatio > pixelBufferRatio)
     {
         // Use height to calculate downsampling effective factor on pixelBuffer
-        textureDownsamplingFactor = pixelBufferWidth / (onscreenHeight / _filterDownsamplingFactor);
+        textureDownsamplingFactor = pixelBufferWidth / (onscreenHeight / downsamplingFactor);
     }
     else
     {
         // Use width to calculate downsampling effective factor on pixelBuffer
-        textureDownsamplingFactor = pixelBufferHeight / (onscreenWidth / _filterDownsamplingFactor);
+        textureDownsamplingFactor = pixelBufferHeight / (onscreenWidth / downsamplingFactor);
     }
     
     // Downsample input pixelBuffer by a specific factor
@@ -681,16 +1711,18 @@
     GLfloat scaledHeight = pixelBufferHeight / textureDownsamplingFactor;
     
     // Create a temporary offscreen texture instance wrapping the pixelBuffer
-    _pixelBufferTextureInstance.textureWidth = scaledWidth;
-    _pixelBufferTextureInstance.textureHeight = scaledHeight;
+    textureInstance->textureWidth = scaledWidth;
+    textureInstance->textureHeight = scaledHeight;
 }
 
 - (void)drawOffscreenTextureInstance:(TextureInstance_t *)srcTextureInstance onOffscreenTextureInstance:(TextureInstance_t *)destTextureInstance
 {
-    // Check dimensions of the source texture instance
-    GLfloat width = srcTextureInstance->textureWidth;
-    GLfloat height = srcTextureInstance->textureHeight;
-    
+    // Same dimensions as the source texture instance
+    [self drawOffscreenTextureInstance:srcTextureInstance onOffscreenTextureInstance:destTextureInstance width:srcTextureInstance->textureWidth height:srcTextureInstance->textureHeight];
+}
+
+- (void)drawOffscreenTextureInstance:(TextureInstance_t *)srcTextureInstance onOffscreenTextureInstance:(TextureInstance_t *)destTextureInstance width:(GLfloat)width height:(GLfloat)height
+{
     // Check if dimensions changed and load again if needed
     if (destTextureInstance->textureWidth != width || destTextureInstance->textureHeight != height)
     {
@@ -725,21 +1757,112 @@
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     
+#if FilterPyramidEnabled
+    // Set the dual filter sample offset
+    [self setFilterPyramidHalfPixelOffsetForTextureInstance:destTextureInstance];
+#else
     // Set the filter split-pass direction vector
     [self setFilterSplitPassDirectionVectorForTextureInstance:destTextureInstance];
+#endif
     
     // Bind VAO
     glBindVertexArrayOES(destTextureInstance->vertexArray);
     
-    // Draw the instance
+    // Draw the instance (only the regions)
+    [self drawOffscreenTextureInstanceInFilterRegions:destTextureInstance];
+}
+
+- (void)drawPrefilteredOffscreenTextureInstance:(TextureInstance_t *)srcTextureInstance onOffscreenTextureInstance:(TextureInstance_t *)destTextureInstance
+{
+    if (!_blurFilterPrefilterProgramInstance)
+    {
+        [self drawOffscreenTextureInstance:srcTextureInstance onOffscreenTextureInstance:destTextureInstance];
+        return;
+    }
+    
+    // The split-pass uniforms go to the prefilter program for this draw
+    GLuint blurFilterProgram = _blurFilterProgram;
+    struct UniformHandles blurFilterUniforms = _blurFilterUniforms;
+    _blurFilterProgram = _blurFilterPrefilterProgramInstance->program;
+    _blurFilterUniforms = _blurFilterPrefilterProgramInstance->uniforms;
+    glUseProgram(_blurFilterProgram);
+    
+    // A quarter of a destination texel (same dimensions as the scaled down source)
+    glUniform2f(_blurFilterUniforms.FilterPrefilterOffset, 0.25f/srcTextureInstance->textureWidth, 0.25f/srcTextureInstance->textureHeight);
+    
+    [self drawOffscreenTextureInstance:srcTextureInstance onOffscreenTextureInstance:destTextureInstance];
+    
+    _blurFilterProgram = blurFilterProgram;
+    _blurFilterUniforms = blurFilterUniforms;
+    glUseProgram(_blurFilterProgram);
+}
+
+- (void)drawOffscreenTextureInstanceInFilterRegions:(TextureInstance_t *)destTextureInstance
+{
+#if !FilterPyramidEnabled
+    // The regions are expanded by the texels read by the remaining split-passes
+    if (_filterRegions.count > 0)
+    {
+        GLfloat margin = filterRegionsPassMargin(_filterRegionsRemainingPassCount, _filterKernelRadius);
+        
+        glEnable(GL_SCISSOR_TEST);
+        
+        for (size_t i = 0; i < _filterRegions.count; ++i)
+        {
+            FilterRegionBox_t box = filterRegionsTextureBox(&_filterRegions, i, destTextureInstance->textureWidth, destTextureInstance->textureHeight, margin);
+            
+            if (box.width > 0 && box.height > 0)
+            {
+                glScissor(box.x, box.y, box.width, box.height);
+                glDrawArrays(destTextureInstance->primitiveType, 0, destTextureInstance->vertexCount);
+            }
+        }
+        
+        glDisable(GL_SCISSOR_TEST);
+        return;
+    }
+#endif
+    
+    // The dual filter levels are always drawn entirely
     glDrawArrays(destTextureInstance->primitiveType, 0, destTextureInstance->vertexCount);
 }
 
+#if FilterPyramidEnabled
+- (TextureInstance_t *)drawFilterPyramidForPixelBufferTextureInstance
+{
+    TextureInstance_t * levels = _filterPyramidTextureInstances;
+    
+    // Downsample: pixel buffer -> level 0 (downsampled dimensions) -> level 1 (1/2) -> ... -> level N
+    glUniform1i(_blurFilterUniforms.FilterPyramidUpsample, 0);
+    [self drawOffscreenTextureInstance:&_pixelBufferTextureInstance onOffscreenTextureInstance:&levels[0]];
+    
+    for (GLuint l=1; l<=_filterPyramidLevelCount; ++l)
+    {
+        GLfloat width = MAX(1.0f, floorf(levels[l-1].textureWidth * 0.5f));
+        GLfloat height = MAX(1.0f, floorf(levels[l-1].textureHeight * 0.5f));
+        [self drawOffscreenTextureInstance:&levels[l-1] onOffscreenTextureInstance:&levels[l] width:width height:height];
+    }
+    
+    // Upsample: level N -> level N-1 -> ... -> level 0
+    glUniform1i(_blurFilterUniforms.FilterPyramidUpsample, 1);
+    for (GLuint l=_filterPyramidLevelCount; l>0; --l)
+    {
+        [self drawOffscreenTextureInstance:&levels[l] onOffscreenTextureInstance:&levels[l-1] width:levels[l-1].textureWidth height:levels[l-1].textureHeight];
+    }
+    
+    return &levels[0];
+}
+#endif
+
 #pragma mark -
 #pragma mark Onscreen rendering
 
 - (GLuint)createOnscreenFramebufferForLayer:(CAEAGLLayer *)layer
 {
+    // The filtered texture instance dimensions depend on the onscreen dimensions
+    _filteredTextureInstance = NULL;
+    _filteredChromaTextureInstance = NULL;
+    
     // Delete potential previously created framebuffer
     if(_onscreenFramebuffer)
     {
@@ -766,6 +1889,9 @@
     glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_WIDTH, &_onscreenColorRenderbufferWidth);
     glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_HEIGHT, &_onscreenColorRenderbufferHeight);
     
+    // View size of the frame recording (if any)
+    [self.internal recordViewWidth:_onscreenColorRenderbufferWidth height:_onscreenColorRenderbufferHeight];
+    
     return _onscreenFramebuffer;
 }
 
@@ -777,12 +1903,12 @@
     // 2. Rotate 90 degrees clockwise by mapping the texture coordinates
     // The pixel bufferr (and texture) remain unchanged.
     // We only flip the viewHeight/viewWidth and map the texture to the appropriate vertices so it is rotated.
-    _onscreenTextureInstance.textureWidth = (GLfloat)textureInstance->textureWidth;
-    _onscreenTextureInstance.textureHeight = (GLfloat)textureInstance->textureHeight;
+    GLfloat textureWidth = (GLfloat)textureInstance->textureWidth;
+    GLfloat textureHeight = (GLfloat)textureInstance->textureHeight;
     
     // Ratio of view versus. texture
     GLfloat viewRatio = ((GLfloat)_onscreenColorRenderbufferHeight) / ((GLfloat)_onscreenColorRenderbufferWidth);
-    GLfloat textureRatio = _onscreenTextureInstance.textureWidth / _onscreenTextureInstance.textureHeight;
+    GLfloat textureRatio = textureWidth / textureHeight;
     
     // Change S (T=1) if texture ratio <= view ratio
     // Change T (S=1) if texture ration > view ratio
@@ -794,17 +1920,17 @@
     // Change T, means we need to check view height vs. texture height
     // T is going to map [0,1]
     if (changeT) {
-        textureScale = ((GLfloat)_onscreenColorRenderbufferWidth) / _onscreenTextureInstance.textureHeight;
+        textureScale = ((GLfloat)_onscreenColorRenderbufferWidth) / textureHeight;
     }
     // Change S, means we need to check view width vs. texture width
     // S is going to map [0,1]
     else {
-        textureScale = ((GLfloat)_onscreenColorRenderbufferHeight) / _onscreenTextureInstance.textureWidth;
+        textureScale = ((GLfloat)_onscreenColorRenderbufferHeight) / textureWidth;
     }
     
     // Calculate texture scaled dimensions
-    GLfloat _scaledTextureHeight = _onscreenTextureInstance.textureHeight * textureScale;
-    GLfloat _scaledTextureWidth = _onscreenTextureInstance.textureWidth * textureScale;
+    GLfloat _scaledTextureHeight = textureHeight * textureScale;
+    GLfloat _scaledTextureWidth = textureWidth * textureScale;
     
     // Calculate texture coordinates S and D deltas
     GLfloat _deltaTextureCoordinateS = (_scaledTextureWidth-((GLfloat)_onscreenColorRenderbufferHeight)) / _scaledTextureWidth / 2.0;
@@ -816,8 +1942,17 @@
 
 - (void)loadOnscreenTextureInstanceFor:(TextureInstance_t *)textureInstance
 {
+    [self loadOnscreenTextureInstance:&_onscreenTextureInstance forTextureInstance:textureInstance attributes:&_defaultAttributes];
+}
+
+- (void)loadOnscreenTextureInstance:(TextureInstance_t *)onscreenTextureInstance forTextureInstance:(TextureInstance_t *)textureInstance attributes:(struct AttributeHandles *)attributes
+{
+    // Dimensions of the texture the vertices were calculated for
+    onscreenTextureInstance->textureWidth = textureInstance->textureWidth;
+    onscreenTextureInstance->textureHeight = textureInstance->textureHeight;
+    
     // Use triangle strip
-    _onscreenTextureInstance.primitiveType = GL_TRIANGLE_STRIP;
+    onscreenTextureInstance->primitiveType = GL_TRIANGLE_STRIP;
     
     // Calculate the texture coordinates offsets for the input textureInstance
     CGPoint textureCoordinatesOffsets = [self onscreenTextureCoordinatesOffsetsForTextureInstance:textureInstance];
@@ -843,122 +1978,267 @@
     };
     
     static const GLsizei stride = sizeof(VertexData_t);
-    _onscreenTextureInstance.vertexCount = 4;
+    onscreenTextureInstance->vertexCount = 4;
     
-    // Vertex Array Object
-    glGenVertexArraysOES(1, &_onscreenTextureInstance.vertexArray);
-    glBindVertexArrayOES(_onscreenTextureInstance.vertexArray);
+    // Vertex Array Object and VBO are created once, only the vertex data changes with the dimensions
+    if (!onscreenTextureInstance->vertexArray)
+    {
+        glGenVertexArraysOES(1, &onscreenTextureInstance->vertexArray);
+        glGenBuffers(1, &onscreenTextureInstance->vertexBuffer);
+    }
+    
+    glBindVertexArrayOES(onscreenTextureInstance->vertexArray);
     
     // VBO
-    glGenBuffers(1, &_onscreenTextureInstance.vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, _onscreenTextureInstance.vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, _onscreenTextureInstance.vertexCount * stride, vertexData, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, onscreenTextureInstance->vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, onscreenTextureInstance->vertexCount * stride, vertexData, GL_STATIC_DRAW);
     
     // Position
-    glEnableVertexAttribArray(_defaultAttributes.VertPosition);
-    glVertexAttribPointer(_defaultAttributes.VertPosition, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(VertexData_t, position));
+    glEnableVertexAttribArray(attributes->VertPosition);
+    glVertexAttribPointer(attributes->VertPosition, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(VertexData_t, position));
     
     // TextureCoordinate
-    glEnableVertexAttribArray(_defaultAttributes.VertTextureCoordinate);
-    glVertexAttribPointer(_defaultAttributes.VertTextureCoordinate, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(VertexData_t, textureCoordinate));
+    glEnableVertexAttribArray(attributes->VertTextureCoordinate);
+    glVertexAttribPointer(attributes->VertTextureCoordinate, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(VertexData_t, textureCoordinate));
+    
+    // Unbind VBO + VAO
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArrayOES(0);
+}
+
+- (void)drawOnscreenOffscreenTextureInstance:(TextureInstance_t *)offscreenTextureInstance
+{
+    if (!_onscreenFramebuffer)
+    {
+        Log(@"Invalid onscreen framebuffer. I am just going to bailout.");
+        return;
+    }
+    
+    // Bind the offscreen framebuffer
+    glBindFramebuffer(GL_FRAMEBUFFER, _onscreenFramebuffer);
+    
+    // Set the view port to the entire view
+    glViewport( 0, 0, _onscreenColorRenderbufferWidth, _onscreenColorRenderbufferHeight);
+    
+    // Bind the texture
+    glBindTexture(offscreenTextureInstance->textureTarget, offscreenTextureInstance->textureName);
+    
+    // Set texture parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    
+    // Check dimensions of the pixelBuffer
+    GLfloat width = offscreenTextureInstance->textureWidth;
+    GLfloat height = offscreenTextureInstance->textureHeight;
+    
+    // Check if dimensions changed and load again if needed
+    if (_onscreenTextureInstance.textureWidth != width || _onscreenTextureInstance.textureHeight != height)
+    {
+        // Load texture instance
+        [self loadOnscreenTextureInstanceFor:offscreenTextureInstance];
+        
+        // Set Frame uniform
+        glUniform1i(_defaultUniforms.FragTextureData, 0);
+    }
+    
+    // Bind VAO
+    glBindVertexArrayOES(_onscreenTextureInstance.vertexArray);
+    
+    // Draw the instance
+    glDrawArrays(_onscreenTextureInstance.primitiveType, 0, _onscreenTextureInstance.vertexCount);
+}
+
+- (void)drawOnscreenOffscreenTextureInstance:(TextureInstance_t *)offscreenTextureInstance chromaTextureInstance:(TextureInstance_t *)chromaTextureInstance
+{
+    // BGRA pixel buffer (or its filtered texture)
+    if (!chromaTextureInstance)
+    {
+        glUseProgram(_defaultProgram);
+        [self drawOnscreenOffscreenTextureInstance:offscreenTextureInstance];
+        return;
+    }
+    
+    if (!_onscreenFramebuffer)
+    {
+        Log(@"Invalid onscreen framebuffer. I am just going to bailout.");
+        return;
+    }
+    
+    // Luma and chroma planes are converted to RGB
+    glUseProgram(_defaultYUVProgram);
+    
+    // Bind the onscreen framebuffer
+    glBindFramebuffer(GL_FRAMEBUFFER, _onscreenFramebuffer);
+    
+    // Set the view port to the entire view
+    glViewport( 0, 0, _onscreenColorRenderbufferWidth, _onscreenColorRenderbufferHeight);
+    
+    // Bind the chroma texture (texture unit 1), linear filtering upsamples it to the luma dimensions
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(chromaTextureInstance->textureTarget, chromaTextureInstance->textureName);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    
+    // Bind the luma texture (texture unit 0)
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(offscreenTextureInstance->textureTarget, offscreenTextureInstance->textureName);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    
+    // Same aspect-fill (and rotated) texture coordinates as the onscreen copy, the chroma plane has the same ratio
+    if (_onscreenYUVTextureInstance.textureWidth != offscreenTextureInstance->textureWidth || _onscreenYUVTextureInstance.textureHeight != offscreenTextureInstance->textureHeight)
+    {
+        [self loadOnscreenTextureInstance:&_onscreenYUVTextureInstance forTextureInstance:offscreenTextureInstance attributes:&_defaultYUVAttributes];
+    }
+    
+    // Bind VAO
+    glBindVertexArrayOES(_onscreenYUVTextureInstance.vertexArray);
+    
+    // Draw the instance
+    glDrawArrays(_onscreenYUVTextureInstance.primitiveType, 0, _onscreenYUVTextureInstance.vertexCount);
     
-    // Unbind VBO + VAO
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArrayOES(0);
+    // Unbind the chroma texture, CVOpenGLESTextureCache can recycle the plane
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
 }
 
-- (void)drawOnscreenOffscreenTextureInstance:(TextureInstance_t *)offscreenTextureInstance
+- (void)drawOnscreenFilteredTextureInstance:(TextureInstance_t *)filteredTextureInstance chromaTextureInstance:(TextureInstance_t *)filteredChromaTextureInstance
 {
-    if (!_onscreenFramebuffer)
+    if (_filterRegions.count == 0)
     {
-        Log(@"Invalid onscreen framebuffer. I am just going to bailout.");
+        [self drawOnscreenOffscreenTextureInstance:filteredTextureInstance chromaTextureInstance:filteredChromaTextureInstance];
         return;
     }
     
-    // Bind the offscreen framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, _onscreenFramebuffer);
-    
-    // Set the view port to the entire view
-    glViewport( 0, 0, _onscreenColorRenderbufferWidth, _onscreenColorRenderbufferHeight);
-    
-    // Bind the texture
-    glBindTexture(offscreenTextureInstance->textureTarget, offscreenTextureInstance->textureName);
+    // Unfiltered pixel buffer first, with the dimensions of the filtered texture (same ratio) the onscreen vertices stay loaded
+    TextureInstance_t pixelBufferTextureInstance = _pixelBufferTextureInstance;
+    pixelBufferTextureInstance.textureWidth = filteredTextureInstance->textureWidth;
+    pixelBufferTextureInstance.textureHeight = filteredTextureInstance->textureHeight;
     
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    [self drawOnscreenOffscreenTextureInstance:&pixelBufferTextureInstance chromaTextureInstance:(filteredChromaTextureInstance ? &_pixelBufferChromaTextureInstance : NULL)];
     
-    // Check dimensions of the pixelBuffer
-    GLfloat width = offscreenTextureInstance->textureWidth;
-    GLfloat height = offscreenTextureInstance->textureHeight;
+    // Filtered texture in the regions
+    glEnable(GL_SCISSOR_TEST);
     
-    // Check if dimensions changed and load again if needed
-    if (_onscreenTextureInstance.textureWidth != width || _onscreenTextureInstance.textureHeight != height)
+    for (size_t i = 0; i < _filterRegions.count; ++i)
     {
-        // Load texture instance
-        [self loadOnscreenTextureInstanceFor:offscreenTextureInstance];
+        FilterRegionBox_t box = filterRegionsViewBox(&_filterRegions, i, _onscreenColorRenderbufferWidth, _onscreenColorRenderbufferHeight);
         
-        // Set Frame uniform
-        glUniform1i(_defaultUniforms.FragTextureData, 0);
+        if (box.width == 0 || box.height == 0)
+        {
+            continue;
+        }
+        
+        glScissor(box.x, box.y, box.width, box.height);
+        
+        [self drawOnscreenOffscreenTextureInstance:filteredTextureInstance chromaTextureInstance:filteredChromaTextureInstance];
     }
     
-    // Bind VAO
-    glBindVertexArrayOES(_onscreenTextureInstance.vertexArray);
-    
-    // Draw the instance
-    glDrawArrays(_onscreenTextureInstance.primitiveType, 0, _onscreenTextureInstance.vertexCount);
+    glDisable(GL_SCISSOR_TEST);
 }
 
 #pragma mark -
 #pragma mark Onscreen framebuffer snapshot
 
-- (UIImage *)imageFromOnscreenFramebuffer
+- (void)addOnscreenSnapshotImageSublayer
+{
+    if (_pixelBufferTexture != nil)
+    {
+        _onscreenSnapshotImageSublayerRequested = YES;
+        
+        // The sublayer is added when the image arrives (a few ms, before the display link resumes)
+        // The filtered texture of a 420 bi-planar pixel buffer is only the luma plane, with regions it's only filtered around them
+        if (_lowResolutionSnapshotEnabled && _filteredTextureInstance && !_filteredChromaTextureInstance && _filterRegions.count == 0)
+        {
+            [self addLowResolutionSnapshotImageSublayer];
+        }
+        else
+        {
+            [self snapshotImageWithCompletionHandler:^(UIImage * image) {
+                
+                if (!image)
+                {
+                    return;
+                }
+                
+                [self addOnscreenSnapshotImageSublayerWithContents:image.CGImage bounds:self.bounds transform:CATransform3DIdentity];
+            }];
+        }
+    }
+}
+
+- (void)addLowResolutionSnapshotImageSublayer
 {
+    // The filtered texture is already blurred, the compositor upscales it
+    // Same mapping as the onscreen texture coordinates: the texture rows (T) are the view columns (right to left)
+    // and the texture columns (S) are the view rows (top to bottom), ie. the image rotated 90 degrees clockwise
     CGRect bounds = self.bounds;
+    CGRect rotatedBounds = CGRectMake(0, 0, CGRectGetHeight(bounds), CGRectGetWidth(bounds));
+    CATransform3D transform = CATransform3DMakeRotation(M_PI_2, 0, 0, 1);
     
-    NSAssert(CGRectGetWidth(bounds) > 0, @"Layer %@ width is zero", self);
-    NSAssert(CGRectGetHeight(bounds) > 0, @"Layer %@ height is zero", self);
-    
-    UIGraphicsBeginImageContextWithOptions(bounds.size, YES, 0);
-    
-    CGContextRef context = UIGraphicsGetCurrentContext();
-    
-    NSAssert(context != NULL, @"Invalid context for layer %@", self);
-    
-    CGContextSaveGState(context);
-    
-    [self renderInContext:context andRedrawPixelBuffer:NO];
-    
-    CGContextRestoreGState(context);
+    PixelReadbackBufferPool_t * bufferPool = _pixelReadbackBufferPool;
+    void (^readbackHandler)(const PixelReadbackImage_t *) = ^(const PixelReadbackImage_t * image) {
+        
+        CGImageRef cgImage = image ? createPixelReadbackCGImage(bufferPool, image, NO) : NULL;
+        
+        if (!cgImage)
+        {
+            return;
+        }
+        
+        [self addOnscreenSnapshotImageSublayerWithContents:cgImage bounds:rotatedBounds transform:transform];
+        CGImageRelease(cgImage);
+    };
     
-    UIImage * imageFromOnscreenFramebuffer = UIGraphicsGetImageFromCurrentImageContext();
+    void * context = (__bridge_retained void *)[readbackHandler copy];
     
-    UIGraphicsEndImageContext();
+    if (![self requestPixelReadbackOfFramebuffer:_filteredTextureInstance->framebuffer
+                                           width:(GLsizei)_filteredTextureInstance->textureWidth
+                                          height:(GLsizei)_filteredTextureInstance->textureHeight
+                                      completion:completePixelReadbackImage
+                                         context:context])
+    {
+        // Balance the retain, the completion won't be called
+        completePixelReadbackImage(context, NULL);
+        return;
+    }
     
-    return imageFromOnscreenFramebuffer;
+    [self pollPixelReadbackWaitingUntilCompleted:NO];
 }
 
-- (void)addOnscreenSnapshotImageSublayer
+- (void)addOnscreenSnapshotImageSublayerWithContents:(CGImageRef)contents bounds:(CGRect)bounds transform:(CATransform3D)transform
 {
-    if (_pixelBufferTexture != nil)
+    if (!_onscreenSnapshotImageSublayerRequested || _onscreenSnapshotImageSublayer)
     {
-        _onscreenSnapshotImageSublayer = [CALayer new];
-        _onscreenSnapshotImageSublayer.bounds = self.bounds;
-        _onscreenSnapshotImageSublayer.contentsScale = 2;
-        _onscreenSnapshotImageSublayer.anchorPoint = CGPointMake(0, 0);
-        _onscreenSnapshotImageSublayer.backgroundColor = self.backgroundColor;
-        
-        _onscreenSnapshotImageSublayer.contents = (__bridge id)[self imageFromOnscreenFramebuffer].CGImage;
-        _onscreenSnapshotImageSublayer.opacity = 1.0;
-        
-        [self addSublayer:_onscreenSnapshotImageSublayer];
+        return;
     }
+    
+    _onscreenSnapshotImageSublayer = [CALayer new];
+    _onscreenSnapshotImageSublayer.bounds = bounds;
+    _onscreenSnapshotImageSublayer.contentsScale = 2;
+    _onscreenSnapshotImageSublayer.position = CGPointMake(CGRectGetMidX(self.bounds), CGRectGetMidY(self.bounds));
+    _onscreenSnapshotImageSublayer.transform = transform;
+    _onscreenSnapshotImageSublayer.contentsGravity = kCAGravityResizeAspectFill;
+    _onscreenSnapshotImageSublayer.masksToBounds = YES;
+    _onscreenSnapshotImageSublayer.backgroundColor = self.backgroundColor;
+    
+    _onscreenSnapshotImageSublayer.contents = (__bridge id)contents;
+    _onscreenSnapshotImageSublayer.opacity = 1.0;
+    
+    [self addSublayer:_onscreenSnapshotImageSublayer];
 }
 
 - (void)removeOnscreenSnapshotImageSublayer
 {
+    _onscreenSnapshotImageSublayerRequested = NO;
+    
     if (_onscreenSnapshotImageSublayer)
     {
         [CATransaction begin];
@@ -1031,8 +2311,17 @@
 {
     PrettyLog;
     
+    FrameTimingsBeginFrame();
+    
+    // Render time of the frame (only if adaptiveQualityEnabled)
+    CFTimeInterval frameStartTime = CACurrentMediaTime();
+    BOOL pixelBufferIsFiltered = NO;
+    
     CMSampleBufferRef sampleBuffer = self.internal.sampleBuffer;
     
+    // New pixelBuffer close enough to the filtered one to skip the filter (only if similarFrameSkippingEnabled)
+    BOOL pixelBufferIsSimilar = NO;
+    
     if (sampleBuffer)
     {
         Log(@"*** CameraOGLPreviewView: sampleBuffer is OK (frame duration %fs)", aDisplayLink.duration);
@@ -1043,6 +2332,7 @@
         if (!pixelBuffer)
         {
             Log(@"*** CameraOGLPreviewView: pixelBuffer is nil");
+            FrameTimingsCancelFrame();
             return;
         }
         
@@ -1053,12 +2343,46 @@
             _pixelBufferTexture = NULL;
         }
         
+        if (_pixelBufferChromaTexture)
+        {
+            CFRelease(_pixelBufferChromaTexture);
+            _pixelBufferChromaTexture = NULL;
+        }
+        
         // Check dimensions of the pixelBuffer
         GLfloat width = (GLfloat)CVPixelBufferGetWidth(pixelBuffer);
         GLfloat height = (GLfloat)CVPixelBufferGetHeight(pixelBuffer);
         
-        // Get the OpenGL texture
+        // Compare a low resolution signature with the last filtered pixelBuffer
+        if (_similarFrameSkippingEnabled && CVPixelBufferLockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly) == kCVReturnSuccess)
+        {
+            if (CVPixelBufferIsPlanar(pixelBuffer))
+            {
+                frameSignatureComputeLuma(CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 0), CVPixelBufferGetWidthOfPlane(pixelBuffer, 0), CVPixelBufferGetHeightOfPlane(pixelBuffer, 0), CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 0), &_pixelBufferFrameSignature);
+            }
+            else
+            {
+                frameSignatureComputeBGRA(CVPixelBufferGetBaseAddress(pixelBuffer), CVPixelBufferGetWidth(pixelBuffer), CVPixelBufferGetHeight(pixelBuffer), CVPixelBufferGetBytesPerRow(pixelBuffer), &_pixelBufferFrameSignature);
+            }
+            CVPixelBufferUnlockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+            
+            pixelBufferIsSimilar = frameSignatureIsSimilar(&_pixelBufferFrameSignature, &_filteredFrameSignature, kSimilarFrameSignatureThreshold);
+        }
+        else
+        {
+            memset(&_pixelBufferFrameSignature, 0, sizeof(FrameSignature_t));
+        }
+        
+        // Get the OpenGL texture (the luma plane of a 420 bi-planar pixelBuffer)
+        FrameTimingsBeginStage(FrameTimingStageTextureImport);
         _pixelBufferTexture = [self oglTextureFromPixelBuffer:pixelBuffer];
+#if FilterYUVInputEnabled
+        if (CVPixelBufferIsPlanar(pixelBuffer))
+        {
+            _pixelBufferChromaTexture = [self oglTextureFromPixelBuffer:pixelBuffer planeIndex:1];
+        }
+#endif
+        FrameTimingsEndStage(FrameTimingStageTextureImport);
         
         // Create a temporary offscreen texture instance wrapping the pixelBuffer
         _pixelBufferTextureInstance.textureWidth = width;
@@ -1066,6 +2390,15 @@
         _pixelBufferTextureInstance.textureTarget = CVOpenGLESTextureGetTarget(_pixelBufferTexture);
         _pixelBufferTextureInstance.textureName = CVOpenGLESTextureGetName(_pixelBufferTexture);
         
+        // Chroma plane, half the luma dimensions
+        if (_pixelBufferChromaTexture)
+        {
+            _pixelBufferChromaTextureInstance.textureWidth = (GLfloat)CVPixelBufferGetWidthOfPlane(pixelBuffer, 1);
+            _pixelBufferChromaTextureInstance.textureHeight = (GLfloat)CVPixelBufferGetHeightOfPlane(pixelBuffer, 1);
+            _pixelBufferChromaTextureInstance.textureTarget = CVOpenGLESTextureGetTarget(_pixelBufferChromaTexture);
+            _pixelBufferChromaTextureInstance.textureName = CVOpenGLESTextureGetName(_pixelBufferChromaTexture);
+        }
+        
         CFRelease(pixelBuffer);
     }
     else if (_pixelBufferTexture)
@@ -1075,6 +2408,7 @@
     else
     {
         Log(@"*** CameraOGLPreviewView: sampleBuffer and pixelBufferTexture are NULL. NOT going to render. (frame duration %fs)", aDisplayLink.duration);
+        FrameTimingsCancelFrame();
         return;
     }
     
@@ -1091,45 +2425,161 @@
     // Avoid loading previous buffer contents
     glClear(GL_COLOR_BUFFER_BIT);
     
-    // Only filter if filter intensity is greater than 0
-    if (_filterIntensity > 0)
+    // Delete free render targets over the new budget
+    if (_renderTargetMemoryBudgetNeedsUpdate)
+    {
+        renderTargetPoolSetMemoryBudget(_renderTargetPool, _renderTargetMemoryBudget);
+        _renderTargetMemoryBudgetNeedsUpdate = NO;
+    }
+    
+    // Same pixelBuffer (or a similar one) and same filter parameters as the filtered texture instance
+    BOOL filteredTextureInstanceIsCurrent = _filteredTextureInstance && (!sampleBuffer || pixelBufferIsSimilar) && !_filterIntensityNeedsUpdate && !_filterRegionsNeedsUpdate && !_filterIntensityMapNeedsUpdate;
+    
+    // Only filter if filter intensity is greater than 0 (and some region is in the view)
+    BOOL filterIsVisible = _filterIntensity > 0 && (_filterRegions.count > 0 || _blurRegions.count == 0);
+    
+    if (filterIsVisible && filteredTextureInstanceIsCurrent)
+    {
+        // Skip the filter passes, re-present the last filtered texture instance (onscreen)
+        FrameTimingsBeginStage(FrameTimingStageOnscreenPass);
+        [self drawOnscreenFilteredTextureInstance:_filteredTextureInstance chromaTextureInstance:_filteredChromaTextureInstance];
+        FrameTimingsEndStage(FrameTimingStageOnscreenPass);
+        
+        ++_skippedFrameCount;
+        
+        if (sampleBuffer)
+        {
+            ++_similarFrameCount;
+        }
+    }
+    else if (filterIsVisible)
     {
+        pixelBufferIsFiltered = YES;
+        
+        // Upload the map changed since the last filtered frame (may switch the blur filter program)
+        if (_filterIntensityMapNeedsUpdate)
+        {
+#if FilterKernelBankEnabled
+            [self loadFilterIntensityMap];
+#endif
+            _filterIntensityMapNeedsUpdate = NO;
+        }
+        
         // Use the blur filter program
         glUseProgram(_blurFilterProgram);
         
         // Update any uniform value that changed since last frame
+        FrameTimingsBeginStage(FrameTimingStageUniformUpdate);
         [self updateBlurFilterProgramUniforms];
+        FrameTimingsEndStage(FrameTimingStageUniformUpdate);
         
         // Downsample pixel buffer texture dimensions
         [self scaleDownPixelBufferTextureInstanceDimensions];
         
+        // Regions in the texture coordinates of the offscreen passes
+        filterRegionsMapToTexture(&_filterRegions, _pixelBufferTextureInstance.textureWidth, _pixelBufferTextureInstance.textureHeight, _onscreenColorRenderbufferWidth, _onscreenColorRenderbufferHeight);
+        _filterRegionsNeedsUpdate = NO;
+        
+#if FilterPyramidEnabled
+        // Downsample and upsample through the pyramid levels (2 * level count + 1 draw calls)
+        FrameTimingsBeginStage(FrameTimingStageOffscreenPass);
+        TextureInstance_t * filteredTextureInstance = [self drawFilterPyramidForPixelBufferTextureInstance];
+        FrameTimingsEndStage(FrameTimingStageOffscreenPass);
+        TextureInstance_t * filteredChromaTextureInstance = NULL; // 420 bi-planar input needs the split-passes
+#else
+        // Every split-pass reads around the regions drawn by the previous one
+        GLuint passCount = 2*_filterMultiplePassCount;
+        
         // First Draw the pixel buffer in an offscreen texture instance (this is a special step)
-        [self drawOffscreenTextureInstance:&_pixelBufferTextureInstance onOffscreenTextureInstance:&_offscreenTextureInstances[0]];
+        FrameTimingsBeginStage(FrameTimingStageOffscreenPass);
+        _filterRegionsRemainingPassCount = passCount - 1;
+        [self drawPrefilteredOffscreenTextureInstance:&_pixelBufferTextureInstance onOffscreenTextureInstance:&_offscreenTextureInstances[0]];
+        FrameTimingsEndStage(FrameTimingStageOffscreenPass);
         
         // Draw the offscreen texture instances and keep applying the filter (ping, pong, ping, pong)
         // Because we did already drew once, the number of draw calls left = 2 * multiple-pass-count - 1
-        for (int p=1; p<(2*_filterMultiplePassCount); ++p)
+        for (int p=1; p<passCount; ++p)
         {
             // Draw split-pass (offscreen)
+            FrameTimingsBeginStage(FrameTimingStageOffscreenPass + p);
+            _filterRegionsRemainingPassCount = passCount - 1 - p;
             [self drawOffscreenTextureInstance:&_offscreenTextureInstances[(p+1)%2] onOffscreenTextureInstance:&_offscreenTextureInstances[p%2]];
+            FrameTimingsEndStage(FrameTimingStageOffscreenPass + p);
         }
         
-        // Disabled filtering for final onscreen rendering
-        glUseProgram(_defaultProgram);
+        TextureInstance_t * filteredTextureInstance = &_offscreenTextureInstances[(passCount+1)%2];
+        TextureInstance_t * filteredChromaTextureInstance = NULL;
         
-        // Draw (onscreen)
-        [self drawOnscreenOffscreenTextureInstance:&_offscreenTextureInstances[1]];
+        if (_pixelBufferChromaTexture)
+        {
+            // Same passes on the chroma plane, the pass count is even so the split-pass direction starts again with x
+            // The chroma texels are twice as large, half the kernel offsets give the same blur radius in view pixels
+            _filterKernelOffsetScale = 0.5f;
+            for (int p=0; p<passCount; ++p)
+            {
+                TextureInstance_t * srcTextureInstance = (p == 0) ? &_pixelBufferChromaTextureInstance : &_offscreenChromaTextureInstances[(p+1)%2];
+                
+                // Draw split-pass (offscreen)
+                FrameTimingsBeginStage(FrameTimingStageOffscreenPass + passCount + p);
+                _filterRegionsRemainingPassCount = passCount - 1 - p;
+                if (p == 0)
+                {
+                    [self drawPrefilteredOffscreenTextureInstance:srcTextureInstance onOffscreenTextureInstance:&_offscreenChromaTextureInstances[p%2]];
+                }
+                else
+                {
+                    [self drawOffscreenTextureInstance:srcTextureInstance onOffscreenTextureInstance:&_offscreenChromaTextureInstances[p%2]];
+                }
+                FrameTimingsEndStage(FrameTimingStageOffscreenPass + passCount + p);
+            }
+            
+            _filterKernelOffsetScale = 1.0f;
+            
+            filteredChromaTextureInstance = &_offscreenChromaTextureInstances[(passCount+1)%2];
+        }
+#endif
+        
+        // Disabled filtering for final onscreen rendering (420 bi-planar planes are converted to RGB)
+        FrameTimingsBeginStage(FrameTimingStageOnscreenPass);
+        [self drawOnscreenFilteredTextureInstance:filteredTextureInstance chromaTextureInstance:filteredChromaTextureInstance];
+        FrameTimingsEndStage(FrameTimingStageOnscreenPass);
+        
+        _filteredTextureInstance = filteredTextureInstance;
+        _filteredChromaTextureInstance = filteredChromaTextureInstance;
+        _filteredFrameSignature = _pixelBufferFrameSignature;
     }
     else
     {
+        _filteredTextureInstance = NULL;
+        _filteredChromaTextureInstance = NULL;
+        
         // Draw (onscreen)
-        [self drawOnscreenOffscreenTextureInstance:&_pixelBufferTextureInstance];
+        FrameTimingsBeginStage(FrameTimingStageOnscreenPass);
+        [self drawOnscreenOffscreenTextureInstance:&_pixelBufferTextureInstance chromaTextureInstance:(_pixelBufferChromaTexture ? &_pixelBufferChromaTextureInstance : NULL)];
+        FrameTimingsEndStage(FrameTimingStageOnscreenPass);
     }
     
+    FrameTimingsBeginStage(FrameTimingStagePresent);
     [_oglContext presentRenderbuffer:GL_RENDERBUFFER];
+    FrameTimingsEndStage(FrameTimingStagePresent);
+    
+    // Complete the readbacks of previous frames if their copies are done
+    if (_pixelReadback && pixelReadbackPendingCount(_pixelReadback) > 0)
+    {
+        pixelReadbackPoll(_pixelReadback, false);
+    }
     
     glBindTexture(_pixelBufferTextureInstance.textureTarget, 0);
     glBindTexture(GL_TEXTURE_2D, 0);
+    
+    // Only frames that ran the filter passes, presentRenderbuffer: blocks when the GPU falls behind
+    // A new level applies from the next frame
+    if (_adaptiveQualityEnabled && pixelBufferIsFiltered && qualityGovernorAddFrameTime(_qualityGovernor, CACurrentMediaTime() - frameStartTime))
+    {
+        [self loadQualityLevel];
+    }
+    
+    FrameTimingsEndFrame();
 
     if (oglContext != _oglContext)
     {
@@ -1141,30 +2591,94 @@
 {
     if (_filterIntensityNeedsUpdate)
     {
-        FilterKernel_t filterKernel = _filterKernelArray[_filterKernelIndex];
+#if FilterPyramidEnabled
+        // Same sigma as the separable filter applied _filterMultiplePassCount times
+        float sigma = gaussianFilterSigmaForStep(&_filterKernelParameters, [self qualityLevelFilterKernelStep]) * sqrtf(_filterMultiplePassCount);
+        float offset;
+        _filterPyramidLevelCount = dualFilterLevelCountForSigma(sigma, kFilterPyramidMaxLevelCount, &offset);
+        _filterPyramidOffset = offset;
+#else
+#if FilterKernelBankEnabled
+        if (_blurFilterKernelBankLoaded)
+        {
+            [self updateFilterKernelBankPosition];
+            _filterIntensityNeedsUpdate = NO;
+            return;
+        }
+#endif
+        
+#if FilterContinuousIntensityEnabled
+        const GaussianFilterKernel_t * filterKernel = gaussianFilterKernelCacheKernelForStep(_filterKernelCache, [self currentFilterKernelStep]);
+#else
+        // Closest kernel in the bank (_filterKernelIndex at quality level 0)
+        size_t filterKernelIndex = (size_t)roundf([self qualityLevelFilterKernelStep] * (_filterKernelCount-1));
+        const FilterKernel_t * filterKernel = &_filterKernelArray[filterKernelIndex];
+#endif
+        
+        _filterKernelRadius = filterKernel->radius;
         
 #if FilterBilinearTextureSamplingEnabled
-        glUniform1i(_blurFilterUniforms.FilterKernelSamples, filterKernel.samples);
-        glUniform1fv(_blurFilterUniforms.VertFilterKernelOffsets, filterKernel.samples, filterKernel.offsets);
-        glUniform1fv(_blurFilterUniforms.FragFilterKernelWeights, filterKernel.samples, filterKernel.weights);
+        GLuint filterKernelSamples = filterKernel->samples;
+        
+#if FilterKernelVariantsEnabled
+        // Switch to the program unrolled for the samples with non-zero weights
+        [self useBlurFilterProgramVariantForSamples:btsGaussianFilterSamplesForSize(2 * filterKernel->radius + 1)];
+        filterKernelSamples = _blurFilterProgramSamples ? MIN(filterKernelSamples, _blurFilterProgramSamples) : filterKernelSamples;
+#endif
+        
+        glUniform1i(_blurFilterUniforms.FilterKernelSamples, filterKernelSamples);
+        glUniform1fv(_blurFilterUniforms.VertFilterKernelOffsets, filterKernelSamples, filterKernel->offsets);
+        glUniform1fv(_blurFilterUniforms.FragFilterKernelWeights, filterKernelSamples, filterKernel->weights);
+        
+#if FilterPrefilterEnabled
+        // Same kernel in the prefilter program of the variant
+        if (_blurFilterPrefilterProgramInstance)
+        {
+            glUseProgram(_blurFilterPrefilterProgramInstance->program);
+            glUniform1fv(_blurFilterPrefilterProgramInstance->uniforms.VertFilterKernelOffsets, filterKernelSamples, filterKernel->offsets);
+            glUniform1fv(_blurFilterPrefilterProgramInstance->uniforms.FragFilterKernelWeights, filterKernelSamples, filterKernel->weights);
+            glUseProgram(_blurFilterProgram);
+        }
+#endif
 #else
-        glUniform1i(_blurFilterUniforms.FragFilterKernelRadius, filterKernel.radius);
-        glUniform1i(_blurFilterUniforms.FragFilterKernelSize, filterKernel.size);
-        glUniform1fv(_blurFilterUniforms.FragFilterKernelWeights, filterKernel.size, filterKernel.weights);
+        glUniform1i(_blurFilterUniforms.FragFilterKernelRadius, filterKernel->radius);
+        glUniform1i(_blurFilterUniforms.FragFilterKernelSize, filterKernel->size);
+        glUniform1fv(_blurFilterUniforms.FragFilterKernelWeights, filterKernel->size, filterKernel->weights);
+#endif
 #endif
         
         _filterIntensityNeedsUpdate = NO;
     }
+}
+
+#if FilterKernelBankEnabled
+- (void)updateFilterKernelBankPosition
+{
+#if FilterContinuousIntensityEnabled
+    float position = gaussianFilterKernelBankPositionForStep(&kBtsGaussianFilterKernelDefaultParameters, [self currentFilterKernelStep]);
+#else
+    // Closest kernel in the bank, no blending
+    float position = roundf(gaussianFilterKernelBankPositionForStep(&kBtsGaussianFilterKernelDefaultParameters, [self qualityLevelFilterKernelStep]));
+#endif
+    unsigned int size = gaussianFilterKernelBankSizeForPosition(&kBtsGaussianFilterKernelDefaultParameters, position);
+    
+    // Switch to the program unrolled for the samples with non-zero weights of both kernels
+    [self useBlurFilterProgramVariantForSamples:btsGaussianFilterSamplesForSize(size)];
+    
+    glUniform1f(_blurFilterUniforms.FilterKernelBankPosition, position);
     
-#if FilterBoundsEnabled
-    if (_filterBoundsNeedsUpdate)
+#if FilterPrefilterEnabled
+    if (_blurFilterPrefilterProgramInstance)
     {
-        glUniform4fv(_blurFilterUniforms.FragFilterBounds, 1, _filterBounds);
-        _filterBoundsNeedsUpdate = NO;
+        glUseProgram(_blurFilterPrefilterProgramInstance->program);
+        glUniform1f(_blurFilterPrefilterProgramInstance->uniforms.FilterKernelBankPosition, position);
+        glUseProgram(_blurFilterProgram);
     }
-    
 #endif
+    
+    _filterKernelRadius = gaussianFilterRadiusForSize(size);
 }
+#endif
 
 #pragma mark -
 #pragma mark Filtering (Intensity)
@@ -1188,13 +2702,25 @@
     // Assign the intensity value
     _filterIntensity = newIntensity;
     
+#if FilterContinuousIntensityEnabled || FilterPyramidEnabled
+    // Use a kernel generated for the exact intensity (see _filterKernelCache)
+    float filterKernelStep = newIntensity;
+#else
     // Map intensity to a integer kernel index
     size_t mappedIndex = (size_t)roundf(newIntensity * ((float)(_filterKernelCount-1)));
     
     // Assign the mapped index
     _filterKernelIndex =  MAX(0, MIN(_filterKernelCount-1, mappedIndex));
     
-    _filterIntensityNeedsUpdate = YES;
+    float filterKernelStep = gaussianFilterStepForKernelIndex(&_filterKernelParameters, (unsigned int)_filterKernelIndex);
+#endif
+    
+    // Uniforms are only uploaded if the kernel actually changed
+    if (filterKernelStep != _filterKernelStep)
+    {
+        _filterKernelStep = filterKernelStep;
+        _filterIntensityNeedsUpdate = YES;
+    }
     
     if (newIntensity > 0.0 && oldIntensity == 0.0)
     {
@@ -1206,6 +2732,16 @@
     }
 }
 
+- (float)filterIntensityTransitionDuration
+{
+#if FilterContinuousIntensityEnabled || FilterPyramidEnabled
+    return kFilterIntensityTransitionDuration;
+#else
+    // One kernel per timer step (see setFilterIntensity:animated:)
+    return _filterKernelCount / 60.0f;
+#endif
+}
+
 - (void)setFilterIntensity:(float)intensity animated:(BOOL)animated
 {
     if (!animated)
@@ -1217,8 +2753,13 @@
     // Assign target filter intensity
     _filterIntensityTransitionTarget = intensity;
     
+#if FilterContinuousIntensityEnabled || FilterPyramidEnabled
+    // Define timer step based on the transition duration, each step uses a different kernel
+    float const filterIntensityTransitionStep = (1.0f/60.0f) / kFilterIntensityTransitionDuration;
+#else
     // Define timer step based on the number of kernels available
     float const filterIntensityTransitionStep = 1.0f / _filterKernelCount;
+#endif
     
     _filterIntensityTransitionTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_main_queue());
     dispatch_source_set_timer(_filterIntensityTransitionTimer, DISPATCH_TIME_NOW, (1.0f/60.0f) * NSEC_PER_SEC, 0.0 * NSEC_PER_SEC);
@@ -1260,52 +2801,136 @@
 }
 
 #pragma mark -
-#pragma mark Filtering (Bounds)
+#pragma mark Filtering (Regions)
+
+- (NSArray<NSValue *> *)blurRegions
+{
+    return _blurRegions ?: @[];
+}
+
+- (void)setBlurRegions:(NSArray<NSValue *> *)blurRegions
+{
+    _blurRegions = [blurRegions copy];
+    
+    [self loadFilterRegions];
+}
+
+- (void)loadFilterRegions
+{
+    CGRect bounds = self.bounds;
+    FilterRegionRect_t rects[kFilterRegionMaxCount];
+    size_t count = 0;
+    
+    // Normalized view coordinates, same origin (top left) as the layer
+    if (CGRectGetWidth(bounds) > 0 && CGRectGetHeight(bounds) > 0)
+    {
+        for (NSValue * region in _blurRegions)
+        {
+            if (count == kFilterRegionMaxCount)
+            {
+                break;
+            }
+            
+            CGRect rect = CGRectStandardize(region.CGRectValue);
+            rects[count++] = (FilterRegionRect_t){
+                (CGRectGetMinX(rect) - CGRectGetMinX(bounds)) / CGRectGetWidth(bounds),
+                (CGRectGetMinY(rect) - CGRectGetMinY(bounds)) / CGRectGetHeight(bounds),
+                CGRectGetWidth(rect) / CGRectGetWidth(bounds),
+                CGRectGetHeight(rect) / CGRectGetHeight(bounds)
+            };
+        }
+    }
+    
+    filterRegionsSetViewRects(&_filterRegions, rects, count);
+    _filterRegionsNeedsUpdate = YES;
+}
+
+#pragma mark -
+#pragma mark Filtering (Intensity map)
+
+- (void)setBlurIntensityMap:(const uint8_t *)intensities width:(NSUInteger)width height:(NSUInteger)height bytesPerRow:(NSUInteger)bytesPerRow
+{
+    NSMutableData * blurIntensityMap = nil;
+    
+    // Tightly packed copy, uploaded with the next filtered frame (loadFilterIntensityMap)
+    if (intensities && width > 0 && height > 0)
+    {
+        blurIntensityMap = [NSMutableData dataWithLength:width * height];
+        
+        for (NSUInteger y = 0; y < height; ++y)
+        {
+            memcpy((uint8_t *)blurIntensityMap.mutableBytes + y * width, intensities + y * bytesPerRow, width);
+        }
+    }
+    
+    _blurIntensityMap = blurIntensityMap;
+    _blurIntensityMapWidth = blurIntensityMap ? width : 0;
+    _blurIntensityMapHeight = blurIntensityMap ? height : 0;
+    _filterIntensityMapNeedsUpdate = YES;
+}
 
-#if FilterBoundsEnabled
-- (void)setFilterBoundsRect:(CGRect)filterBoundsRect
+#if FilterKernelBankEnabled
+- (void)loadFilterIntensityMap
 {
-    GLfloat xMin = filterBoundsRect.origin.x;
-    GLfloat xMax = xMin + filterBoundsRect.size.width;
-    GLfloat yMin = filterBoundsRect.origin.y;
-    GLfloat yMax = yMin + filterBoundsRect.size.height;
+    // Variants are only loaded with the first map, most layers never use one
+    if (_blurIntensityMap && !_filterIntensityMapProgramVariantsLoaded)
+    {
+        [self loadBlurFilterIntensityMapProgramVariants];
+        _filterIntensityMapProgramVariantsLoaded = YES;
+    }
+    
+    // Ignore the map without a variant (the kernel of the whole frame is used)
+    BOOL filterIntensityMapLoaded = _blurIntensityMap && _blurFilterIntensityMapProgramVariants[1].program;
+    
+    if (filterIntensityMapLoaded)
+    {
+        // Bilinear, stretched over the frame texture coordinates of the offscreen passes
+        glActiveTexture(GL_TEXTURE2);
+        
+        if (!_filterIntensityMapTexture)
+        {
+            glGenTextures(1, &_filterIntensityMapTexture);
+        }
+        
+        glBindTexture(GL_TEXTURE_2D, _filterIntensityMapTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, (GLsizei)_blurIntensityMapWidth, (GLsizei)_blurIntensityMapHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, _blurIntensityMap.bytes);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glActiveTexture(GL_TEXTURE0);
+    }
     
-    // Bounds within the texture that are filtered [xMin, yMin, xMax, yMax]
-    // The textureCoordinates mapping rotate the texture 90 degrees clockwise
-    // We need to flip x/y in textureFilterBounds to work with the rotation
-    GLfloat filterBounds[4] = { yMin, 1.0 - xMax, yMax, 1.0 - xMin };
-    memcpy(_filterBounds, filterBounds, 4*sizeof(GLfloat));
-    _filterBoundsNeedsUpdate = YES;
+    // Switch between the variants of the bank (updateFilterKernelBankPosition selects the program again)
+    if (filterIntensityMapLoaded != _filterIntensityMapLoaded)
+    {
+        _filterIntensityMapLoaded = filterIntensityMapLoaded;
+        _blurFilterProgramSamples = 0;
+        _filterIntensityNeedsUpdate = YES;
+    }
 }
 #endif
 
 #pragma mark -
 #pragma mark Filtering (Kernel)
 
-void createFilterKernel(int kernelIndex, FilterKernel_t * filterKernel)
+void createFilterKernel(const GaussianFilterKernelParameters_t * filterKernelParameters, unsigned int kernelIndex, FilterKernel_t * filterKernel)
 {
+    GLfloat filterStep = gaussianFilterStepForKernelIndex(filterKernelParameters, kernelIndex);
+    GLfloat filterSigma = gaussianFilterSigmaForStep(filterKernelParameters, filterStep);
+    
 #if FilterBilinearTextureSamplingEnabled
-    GLuint filterSamples = btsGaussianFilterSamplesForKernelIndex(kernelIndex);
-    GLuint filterRadius = btsGaussianFilterRadiusForKernelIndex(kernelIndex);
-    GLfloat filterSigma = btsGaussianFilterSigmaForKernelIndex(kernelIndex);
-    GLfloat filterStep = btsGaussianFilterStepForKernelIndex(kernelIndex);
+    GLuint filterSamples = btsGaussianFilterMaxSamples(filterKernelParameters);
+    GLuint filterRadius = gaussianFilterRadiusForSize(gaussianFilterSizeForSigma(filterSigma, filterKernelParameters->truncation));
     
     // Create 1D kernel
     GLfloat * filterWeights = calloc(filterSamples, sizeof(GLfloat)); // float
     GLfloat * filterOffsets = calloc(filterSamples, sizeof(GLfloat)); // float
-    for (int sampleIndex=0; sampleIndex<filterSamples; ++sampleIndex)
-    {
-        filterWeights[sampleIndex] = btsGaussianFilterWeightForIndexes(kernelIndex, sampleIndex);
-        filterOffsets[sampleIndex] = btsGaussianFilterOffsetForIndexes(kernelIndex, sampleIndex);
-    }
+    btsGaussianFilterKernelForIndex(filterKernelParameters, kernelIndex, filterOffsets, filterWeights);
     
-    // Log kernel
-    printf("kernel (step = %f, radius = %u, sigma = %f, samples = %u) [", filterStep, filterRadius, filterSigma, filterSamples);
-    for (int i = 0; i<filterSamples; ++i)
-    {
-        printf(" (%f, %f) ", filterWeights[i], filterOffsets[i]);
-    }
-    printf("]\n");
+    Log(@"LAUCaptureVideoPreviewLayer: Kernel %u (step = %f, radius = %u, sigma = %f, samples = %u)", kernelIndex, filterStep, filterRadius, filterSigma, filterSamples);
     
     filterKernel->radius = filterRadius;
     filterKernel->samples = filterSamples;
@@ -1314,25 +2939,14 @@ void createFilterKernel(int kernelIndex, FilterKernel_t * filterKernel)
     
 #else
     
-    GLuint filterSize = dtsGaussianFilterSizeForKernelIndex(kernelIndex);
-    GLuint filterRadius = dtsGaussianFilterRadiusForKernelIndex(kernelIndex);
-    GLfloat filterSigma = dtsGaussianFilterSigmaForKernelIndex(kernelIndex);
-    GLfloat filterStep = dtsGaussianFilterStepForKernelIndex(kernelIndex);
+    GLuint filterSize = dtsGaussianFilterSizeForIndex(filterKernelParameters, kernelIndex);
+    GLuint filterRadius = gaussianFilterRadiusForSize(filterSize);
     
     // Create 1D kernel
     GLfloat * filterWeights = calloc(filterSize, sizeof(GLfloat)); // float
-    for (int weightIndex=0; weightIndex<filterSize; ++weightIndex)
-    {
-        filterWeights[weightIndex] = dtsGaussianFilterWeightForIndexes(kernelIndex, weightIndex);
-    }
+    dtsGaussianFilterKernelForIndex(filterKernelParameters, kernelIndex, filterWeights);
 
-    // Log kernel
-    printf("kernel (step = %f, size = %u, radius = %u, sigma = %f) [", filterStep, filterSize, filterRadius, filterSigma);
-    for (int i = 0; i<filterSize; ++i)
-    {
-        printf(" %f ", filterWeights[i]);
-    }
-    printf("]\n");
+    Log(@"LAUCaptureVideoPreviewLayer: Kernel %u (step = %f, size = %u, radius = %u, sigma = %f)", kernelIndex, filterStep, filterSize, filterRadius, filterSigma);
     
     filterKernel->radius = filterRadius;
     filterKernel->size = filterSize;
@@ -1359,23 +2973,46 @@ void releaseFilterKernel(FilterKernel_t * filterKernel)
         return;
     }
     
+    // Parameters used to generate the filter kernels
+    // The default parameters match the precomputed tables (no kernels are generated)
+#if FilterBilinearTextureSamplingEnabled
+    _filterKernelParameters = kBtsGaussianFilterKernelDefaultParameters;
+#else
+    _filterKernelParameters = kDtsGaussianFilterKernelDefaultParameters;
+#endif
+    
     // Define how many filter kernels should be generated
-    size_t filterKernelCount = gaussianFilterKernelCount();
+    size_t filterKernelCount = _filterKernelParameters.kernelCount;
+    
+#if FilterPyramidEnabled
+    // No kernels, the intensity is mapped to the sigma of the dual filter (see updateBlurFilterProgramUniforms)
+#elif FilterContinuousIntensityEnabled
+    // Kernels are generated on demand for each intensity value
+#if FilterBilinearTextureSamplingEnabled
+    _filterKernelCache = createGaussianFilterKernelCache(&_filterKernelParameters, GaussianFilterKernelTypeBts, kFilterKernelCacheCapacity);
+#else
+    _filterKernelCache = createGaussianFilterKernelCache(&_filterKernelParameters, GaussianFilterKernelTypeDts, kFilterKernelCacheCapacity);
+#endif
+#else
     FilterKernel_t * filterKernelArray = (FilterKernel_t *)calloc(filterKernelCount, sizeof(FilterKernel_t));
     
     // Create all filter kernels
     for (int i=0; i<filterKernelCount; ++i)
     {
-        createFilterKernel(i, &filterKernelArray[i]);
+        createFilterKernel(&_filterKernelParameters, i, &filterKernelArray[i]);
     }
     
     // Store in the TextureInstance
-    _filterKernelCount = filterKernelCount;
     _filterKernelArray = filterKernelArray;
+#endif
+    
+    _filterKernelCount = filterKernelCount;
+    _filterKernelStep = -1.0f; // No kernel loaded yet
     
     // Filter parameters
     _filterDownsamplingFactor = 4.0f;
     _filterMultiplePassCount = 2;
+    _filterKernelOffsetScale = 1.0f;
 }
 
 - (void)setFilterSplitPassDirectionVectorForTextureInstance:(TextureInstance_t *)textureInstance
@@ -1393,7 +3030,16 @@ void releaseFilterKernel(FilterKernel_t * filterKernel)
     }
 
     // Set the filter step uniform
-    glUniform2f(_blurFilterUniforms.FilterSplitPassDirectionVector, _filterSplitPassDirectionVector[0]/textureInstance->textureWidth, _filterSplitPassDirectionVector[1]/textureInstance->textureHeight);
+    glUniform2f(_blurFilterUniforms.FilterSplitPassDirectionVector, _filterKernelOffsetScale*_filterSplitPassDirectionVector[0]/textureInstance->textureWidth, _filterKernelOffsetScale*_filterSplitPassDirectionVector[1]/textureInstance->textureHeight);
 }
 
+#if FilterPyramidEnabled
+- (void)setFilterPyramidHalfPixelOffsetForTextureInstance:(TextureInstance_t *)textureInstance
+{
+    // Offset in half pixels of the destination texture (downsample and upsample)
+    GLfloat halfPixelOffset = 0.5f * _filterPyramidOffset;
+    glUniform2f(_blurFilterUniforms.FilterPyramidHalfPixelOffset, halfPixelOffset/textureInstance->textureWidth, halfPixelOffset/textureInstance->textureHeight);
+}
+#endif
+
 @end
@@ -0,0 +1,1585 @@
+/*
+
+ LAUCaptureVideoPreviewLayerBlurEngine.c
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "LAUCaptureVideoPreviewLayerBlurEngine.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #define BlurEngineSSE2Available 1
+    #include <emmintrin.h>
+#else
+    #define BlurEngineSSE2Available 0
+#endif
+
+#if BlurEngineSSE2Available && (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #define BlurEngineAVX2Available 1
+    #include <immintrin.h>
+#else
+    #define BlurEngineAVX2Available 0
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define BlurEngineNEONAvailable 1
+    #include <arm_neon.h>
+#else
+    #define BlurEngineNEONAvailable 0
+#endif
+
+// Weights below this value don't contribute to an 8 bit channel
+#define kBlurEngineWeightEpsilon 1e-7f
+
+// Full range BT.601 YCbCr to RGB (same as FragmentShaderSourceYUV)
+#define kBlurEngineYUVChromaOffset 128.0f
+#define kBlurEngineYUVCrToR 1.402f
+#define kBlurEngineYUVCbToG 0.344136f
+#define kBlurEngineYUVCrToG 0.714136f
+#define kBlurEngineYUVCbToB 1.772f
+
+// Planes of blurEngineFilterYUVImage: luma and chroma as BGRA (input), then filtered
+enum {
+    BlurEnginePlaneLumaInput = 0,
+    BlurEnginePlaneChromaInput,
+    BlurEnginePlaneLumaFiltered,
+    BlurEnginePlaneChromaFiltered,
+    BlurEnginePlaneCount,
+};
+
+// Channels of the column blocks of the vertical pass (64 pixels, a multiple of the SIMD loops)
+#define kBlurEngineVerticalBlockLength 256
+
+// Stripes per worker thread, so a worker that finishes early can steal stripes from a slower one
+#define kBlurEngineStripesPerThread 4
+#define kBlurEngineMinStripeHeight 8
+
+// Lines of the intermediate images are floats (8 bit values) so the passes don't convert every tap, the output is quantized
+typedef void (*ConvolveLineFunction)(const float * const * lines, const float * weights, size_t taps, float * output, size_t count);
+
+// First pass, each output pixel is the weighted sum of pairs of neighbouring texels (bilinear samples) of the interpolated line
+typedef void (*GatherLineFunction)(const float * interpolatedLine, const int32_t * indexes, const float * weights, size_t pairs, float * output, size_t width);
+
+// Texel taps of a split pass (same size source and destination)
+struct BlurEngineTaps {
+    int32_t * shifts;
+    float * weights;
+    size_t count;
+    size_t capacity;
+    long radius; // Largest shift, rows (vertical pass) read above and below a stripe
+};
+
+typedef struct BlurEngineTaps BlurEngineTaps_t;
+
+// Intermediate image, same role as the RGBA8 offscreen textures (quantized values stored as floats)
+struct BlurEngineFloatImage {
+    float * data;
+    size_t width;
+    size_t height;
+    size_t rowLength; // Floats per row
+};
+
+typedef struct BlurEngineFloatImage BlurEngineFloatImage_t;
+
+// Scratch memory of one worker thread
+struct BlurEngineWorker {
+    float * interpolatedLine;
+    size_t interpolatedLineSize;
+    float * paddedLine;
+    size_t paddedLineSize;
+    float * outputLine; // Last pass, converted to the 8 bit output image
+    size_t outputLineSize;
+    const float ** tapLines;
+    size_t tapLineCapacity;
+};
+
+typedef struct BlurEngineWorker BlurEngineWorker_t;
+
+struct BlurEngine {
+
+    BlurEngineBackend_t backend;
+    ConvolveLineFunction convolveLine;
+    GatherLineFunction gatherLine;
+
+    // Filter (Kernel)
+    unsigned int samples;
+    float * offsets;
+    float * weights;
+    float kernelOffsetScale; // 1, 0.5 for the chroma plane (same sigma in view pixels as the luma plane)
+
+    // Filter (Parameters)
+    float downsamplingFactor;
+    unsigned int multiplePassCount;
+    bool prefilterEnabled;
+    float prefilterOffsets[2]; // Texture coordinates of the 2x2 taps around each sample of the first pass (x, y)
+
+    // Ping-pong images, same role as _offscreenTextureInstances
+    float * images[2];
+    size_t imageSize;
+
+    // Planes of a 420 bi-planar image (blurEngineFilterYUVImage only)
+    uint8_t * planeImages[BlurEnginePlaneCount];
+    size_t planeImageSizes[BlurEnginePlaneCount];
+
+    // Stripes (not owned), one worker without a pool
+    WorkerPool_t * workerPool;
+    BlurEngineWorker_t * workers;
+    unsigned int workerCount;
+
+    // Taps and columns, computed once per image and read by all workers
+    BlurEngineTaps_t horizontalTaps;
+    BlurEngineTaps_t verticalTaps;
+    int32_t * columnIndexes; // First texel of each pair
+    float * columnWeights; // Weights of both texels of each pair
+    size_t columnCapacity;
+    size_t columnPairCount; // Pairs per output pixel
+};
+
+#pragma mark -
+#pragma mark Helpers
+
+static bool reserveBuffer(void ** buffer, size_t * capacity, size_t size)
+{
+    if (*capacity >= size)
+    {
+        return true;
+    }
+
+    void * newBuffer = realloc(*buffer, size);
+    if (!newBuffer)
+    {
+        return false;
+    }
+
+    *buffer = newBuffer;
+    *capacity = size;
+    return true;
+}
+
+static bool reserveTaps(BlurEngineTaps_t * taps, size_t count)
+{
+    if (taps->capacity >= count)
+    {
+        return true;
+    }
+
+    int32_t * shifts = (int32_t *)realloc(taps->shifts, count * sizeof(int32_t));
+    if (shifts)
+    {
+        taps->shifts = shifts;
+    }
+    float * weights = (float *)realloc(taps->weights, count * sizeof(float));
+    if (weights)
+    {
+        taps->weights = weights;
+    }
+
+    if (!shifts || !weights)
+    {
+        return false;
+    }
+
+    taps->capacity = count;
+    return true;
+}
+
+// Scratch memory of every worker, reserved before the stripes run so the workers never allocate
+static bool reserveWorkers(BlurEngine_t * blurEngine, size_t interpolatedLineSize, size_t paddedLineSize, size_t outputLineSize, size_t tapLineCount)
+{
+    for (unsigned int w = 0; w < blurEngine->workerCount; ++w)
+    {
+        BlurEngineWorker_t * worker = &blurEngine->workers[w];
+
+        if (!reserveBuffer((void **)&worker->interpolatedLine, &worker->interpolatedLineSize, interpolatedLineSize) ||
+            !reserveBuffer((void **)&worker->paddedLine, &worker->paddedLineSize, paddedLineSize) ||
+            !reserveBuffer((void **)&worker->outputLine, &worker->outputLineSize, outputLineSize))
+        {
+            return false;
+        }
+
+        if (worker->tapLineCapacity < tapLineCount)
+        {
+            const float ** tapLines = (const float **)realloc(worker->tapLines, tapLineCount * sizeof(float *));
+            if (!tapLines)
+            {
+                return false;
+            }
+
+            worker->tapLines = tapLines;
+            worker->tapLineCapacity = tapLineCount;
+        }
+    }
+
+    return true;
+}
+
+static bool reserveColumns(BlurEngine_t * blurEngine, size_t count)
+{
+    if (blurEngine->columnCapacity >= count)
+    {
+        return true;
+    }
+
+    int32_t * columnIndexes = (int32_t *)realloc(blurEngine->columnIndexes, count * sizeof(int32_t));
+    if (columnIndexes)
+    {
+        blurEngine->columnIndexes = columnIndexes;
+    }
+    float * columnWeights = (float *)realloc(blurEngine->columnWeights, 2 * count * sizeof(float));
+    if (columnWeights)
+    {
+        blurEngine->columnWeights = columnWeights;
+    }
+
+    if (!columnIndexes || !columnWeights)
+    {
+        return false;
+    }
+
+    blurEngine->columnCapacity = count;
+    return true;
+}
+
+static bool reserveImages(BlurEngine_t * blurEngine, size_t size)
+{
+    if (blurEngine->imageSize >= size)
+    {
+        return true;
+    }
+
+    float * image0 = (float *)realloc(blurEngine->images[0], size);
+    if (image0)
+    {
+        blurEngine->images[0] = image0;
+    }
+    float * image1 = (float *)realloc(blurEngine->images[1], size);
+    if (image1)
+    {
+        blurEngine->images[1] = image1;
+    }
+
+    if (!image0 || !image1)
+    {
+        return false;
+    }
+
+    blurEngine->imageSize = size;
+    return true;
+}
+
+static inline long clampIndex(long index, long count)
+{
+    return index < 0 ? 0 : (index >= count ? count - 1 : index);
+}
+
+static inline uint8_t quantize(float value)
+{
+    // Same as a float -> unorm8 conversion when writing to an RGBA8 framebuffer
+    int quantized = (int)(value + 0.5f);
+    return (uint8_t)(quantized < 0 ? 0 : (quantized > 255 ? 255 : quantized));
+}
+
+static void scaledDownDimensions(float downsamplingFactor, float inputWidth, float inputHeight, float viewWidth, float viewHeight, float * scaledWidth, float * scaledHeight)
+{
+    // Same as scaleDownPixelBufferTextureInstanceDimensions
+    float textureDownsamplingFactor = downsamplingFactor;
+    float inputRatio = inputWidth / inputHeight; // Usually the pixelBuffer w > h
+    float viewRatio = viewHeight / viewWidth;
+
+    if (viewRatio > inputRatio)
+    {
+        textureDownsamplingFactor = inputWidth / (viewHeight / downsamplingFactor);
+    }
+    else
+    {
+        textureDownsamplingFactor = inputHeight / (viewWidth / downsamplingFactor);
+    }
+
+    *scaledWidth = inputWidth / textureDownsamplingFactor;
+    *scaledHeight = inputHeight / textureDownsamplingFactor;
+}
+
+#pragma mark -
+#pragma mark Convolution (Scalar)
+
+static void convolveLineScalar(const float * const * lines, const float * weights, size_t taps, float * output, size_t count)
+{
+    for (size_t x = 0; x < count; ++x)
+    {
+        float weightedValue = 0.0f;
+        for (size_t k = 0; k < taps; ++k)
+        {
+            weightedValue += weights[k] * lines[k][x];
+        }
+        output[x] = quantize(weightedValue);
+    }
+}
+
+static void gatherLineScalar(const float * interpolatedLine, const int32_t * indexes, const float * weights, size_t pairs, float * output, size_t width)
+{
+    for (size_t x = 0; x < width; ++x, indexes += pairs, weights += 2 * pairs)
+    {
+        float weightedValue[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (size_t t = 0; t < pairs; ++t)
+        {
+            const float * texels = interpolatedLine + indexes[t] * 4;
+            for (size_t c = 0; c < 4; ++c)
+            {
+                weightedValue[c] += weights[2 * t] * texels[c] + weights[2 * t + 1] * texels[4 + c];
+            }
+        }
+
+        for (size_t c = 0; c < 4; ++c)
+        {
+            output[4 * x + c] = quantize(weightedValue[c]);
+        }
+    }
+}
+
+// Quantized line to the 8 bit output image (the last pass)
+static void storeLine(const float * line, uint8_t * output, size_t count)
+{
+    for (size_t x = 0; x < count; ++x)
+    {
+        output[x] = (uint8_t)line[x];
+    }
+}
+
+#pragma mark -
+#pragma mark Convolution (SSE2)
+
+#if BlurEngineSSE2Available
+static inline __m128 quantizeSSE2(__m128 value)
+{
+    // Same as quantize, rounded and clamped to 0...255
+    __m128 rounded = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_add_ps(value, _mm_set1_ps(0.5f))));
+    return _mm_min_ps(_mm_max_ps(rounded, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+}
+
+static void convolveLineSSE2(const float * const * lines, const float * weights, size_t taps, float * output, size_t count)
+{
+    size_t x = 0;
+
+    // 16 channels (4 pixels) per iteration
+    for (; x + 16 <= count; x += 16)
+    {
+        __m128 weightedValue0 = _mm_setzero_ps();
+        __m128 weightedValue1 = _mm_setzero_ps();
+        __m128 weightedValue2 = _mm_setzero_ps();
+        __m128 weightedValue3 = _mm_setzero_ps();
+
+        for (size_t k = 0; k < taps; ++k)
+        {
+            const float * line = lines[k] + x;
+            __m128 weight = _mm_set1_ps(weights[k]);
+
+            weightedValue0 = _mm_add_ps(weightedValue0, _mm_mul_ps(weight, _mm_loadu_ps(line)));
+            weightedValue1 = _mm_add_ps(weightedValue1, _mm_mul_ps(weight, _mm_loadu_ps(line + 4)));
+            weightedValue2 = _mm_add_ps(weightedValue2, _mm_mul_ps(weight, _mm_loadu_ps(line + 8)));
+            weightedValue3 = _mm_add_ps(weightedValue3, _mm_mul_ps(weight, _mm_loadu_ps(line + 12)));
+        }
+
+        _mm_storeu_ps(output + x, quantizeSSE2(weightedValue0));
+        _mm_storeu_ps(output + x + 4, quantizeSSE2(weightedValue1));
+        _mm_storeu_ps(output + x + 8, quantizeSSE2(weightedValue2));
+        _mm_storeu_ps(output + x + 12, quantizeSSE2(weightedValue3));
+    }
+
+    if (x < count)
+    {
+        const float * tailLines[taps];
+        for (size_t k = 0; k < taps; ++k)
+        {
+            tailLines[k] = lines[k] + x;
+        }
+        convolveLineScalar(tailLines, weights, taps, output + x, count - x);
+    }
+}
+
+static void gatherLineSSE2(const float * interpolatedLine, const int32_t * indexes, const float * weights, size_t pairs, float * output, size_t width)
+{
+    for (size_t x = 0; x < width; ++x, indexes += pairs, weights += 2 * pairs)
+    {
+        // Independent sums (pairs is always even, both sides of each sample) so the adds don't wait on each other
+        __m128 weightedValue0 = _mm_setzero_ps();
+        __m128 weightedValue1 = _mm_setzero_ps();
+        __m128 weightedValue2 = _mm_setzero_ps();
+        __m128 weightedValue3 = _mm_setzero_ps();
+
+        for (size_t t = 0; t < pairs; t += 2)
+        {
+            const float * texels0 = interpolatedLine + indexes[t] * 4;
+            const float * texels1 = interpolatedLine + indexes[t + 1] * 4;
+
+            weightedValue0 = _mm_add_ps(weightedValue0, _mm_mul_ps(_mm_set1_ps(weights[2 * t]), _mm_loadu_ps(texels0)));
+            weightedValue1 = _mm_add_ps(weightedValue1, _mm_mul_ps(_mm_set1_ps(weights[2 * t + 1]), _mm_loadu_ps(texels0 + 4)));
+            weightedValue2 = _mm_add_ps(weightedValue2, _mm_mul_ps(_mm_set1_ps(weights[2 * t + 2]), _mm_loadu_ps(texels1)));
+            weightedValue3 = _mm_add_ps(weightedValue3, _mm_mul_ps(_mm_set1_ps(weights[2 * t + 3]), _mm_loadu_ps(texels1 + 4)));
+        }
+
+        __m128 weightedValue = _mm_add_ps(_mm_add_ps(weightedValue0, weightedValue1), _mm_add_ps(weightedValue2, weightedValue3));
+        _mm_storeu_ps(output + 4 * x, quantizeSSE2(weightedValue));
+    }
+}
+#endif
+
+#pragma mark -
+#pragma mark Convolution (AVX2)
+
+#if BlurEngineAVX2Available
+__attribute__((target("avx2,fma")))
+static inline __m256 quantizeAVX2(__m256 value)
+{
+    __m256 rounded = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(_mm256_add_ps(value, _mm256_set1_ps(0.5f))));
+    return _mm256_min_ps(_mm256_max_ps(rounded, _mm256_setzero_ps()), _mm256_set1_ps(255.0f));
+}
+
+__attribute__((target("avx2,fma")))
+static void convolveLineAVX2(const float * const * lines, const float * weights, size_t taps, float * output, size_t count)
+{
+    size_t x = 0;
+
+    // 64 channels (16 pixels) per iteration, 8 channels per register
+    // The sums are independent so the multiply-adds don't wait on each other
+    for (; x + 64 <= count; x += 64)
+    {
+        __m256 weightedValue0 = _mm256_setzero_ps();
+        __m256 weightedValue1 = _mm256_setzero_ps();
+        __m256 weightedValue2 = _mm256_setzero_ps();
+        __m256 weightedValue3 = _mm256_setzero_ps();
+        __m256 weightedValue4 = _mm256_setzero_ps();
+        __m256 weightedValue5 = _mm256_setzero_ps();
+        __m256 weightedValue6 = _mm256_setzero_ps();
+        __m256 weightedValue7 = _mm256_setzero_ps();
+
+        for (size_t k = 0; k < taps; ++k)
+        {
+            const float * line = lines[k] + x;
+            __m256 weight = _mm256_set1_ps(weights[k]);
+
+            weightedValue0 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(line), weightedValue0);
+            weightedValue1 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(line + 8), weightedValue1);
+            weightedValue2 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(line + 16), weightedValue2);
+            weightedValue3 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(line + 24), weightedValue3);
+            weightedValue4 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(line + 32), weightedValue4);
+            weightedValue5 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(line + 40), weightedValue5);
+            weightedValue6 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(line + 48), weightedValue6);
+            weightedValue7 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(line + 56), weightedValue7);
+        }
+
+        _mm256_storeu_ps(output + x, quantizeAVX2(weightedValue0));
+        _mm256_storeu_ps(output + x + 8, quantizeAVX2(weightedValue1));
+        _mm256_storeu_ps(output + x + 16, quantizeAVX2(weightedValue2));
+        _mm256_storeu_ps(output + x + 24, quantizeAVX2(weightedValue3));
+        _mm256_storeu_ps(output + x + 32, quantizeAVX2(weightedValue4));
+        _mm256_storeu_ps(output + x + 40, quantizeAVX2(weightedValue5));
+        _mm256_storeu_ps(output + x + 48, quantizeAVX2(weightedValue6));
+        _mm256_storeu_ps(output + x + 56, quantizeAVX2(weightedValue7));
+    }
+
+    // 8 channels (2 pixels) per iteration
+    for (; x + 8 <= count; x += 8)
+    {
+        __m256 weightedValue = _mm256_setzero_ps();
+
+        for (size_t k = 0; k < taps; ++k)
+        {
+            weightedValue = _mm256_fmadd_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(lines[k] + x), weightedValue);
+        }
+
+        _mm256_storeu_ps(output + x, quantizeAVX2(weightedValue));
+    }
+
+    if (x < count)
+    {
+        const float * tailLines[taps];
+        for (size_t k = 0; k < taps; ++k)
+        {
+            tailLines[k] = lines[k] + x;
+        }
+        convolveLineScalar(tailLines, weights, taps, output + x, count - x);
+    }
+}
+
+// Weights (w0, w1) of a pair to (w0 w0 w0 w0 w1 w1 w1 w1), both texels of the pair are read with one load
+__attribute__((target("avx2,fma")))
+static inline __m256 loadPairWeightsAVX2(const float * weights, __m256i pairWeightIndexes)
+{
+    return _mm256_permutevar8x32_ps(_mm256_castps128_ps256(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)weights))), pairWeightIndexes);
+}
+
+__attribute__((target("avx2,fma")))
+static void gatherLineAVX2(const float * interpolatedLine, const int32_t * indexes, const float * weights, size_t pairs, float * output, size_t width)
+{
+    const __m256i pairWeightIndexes = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+
+    for (size_t x = 0; x < width; ++x, indexes += pairs, weights += 2 * pairs)
+    {
+        // Independent sums so the multiply-adds don't wait on each other (pairs is always even, both sides of each sample)
+        __m256 weightedValue0 = _mm256_setzero_ps();
+        __m256 weightedValue1 = _mm256_setzero_ps();
+        __m256 weightedValue2 = _mm256_setzero_ps();
+        __m256 weightedValue3 = _mm256_setzero_ps();
+        size_t t = 0;
+
+        for (; t + 4 <= pairs; t += 4)
+        {
+            weightedValue0 = _mm256_fmadd_ps(loadPairWeightsAVX2(weights + 2 * t, pairWeightIndexes), _mm256_loadu_ps(interpolatedLine + indexes[t] * 4), weightedValue0);
+            weightedValue1 = _mm256_fmadd_ps(loadPairWeightsAVX2(weights + 2 * t + 2, pairWeightIndexes), _mm256_loadu_ps(interpolatedLine + indexes[t + 1] * 4), weightedValue1);
+            weightedValue2 = _mm256_fmadd_ps(loadPairWeightsAVX2(weights + 2 * t + 4, pairWeightIndexes), _mm256_loadu_ps(interpolatedLine + indexes[t + 2] * 4), weightedValue2);
+            weightedValue3 = _mm256_fmadd_ps(loadPairWeightsAVX2(weights + 2 * t + 6, pairWeightIndexes), _mm256_loadu_ps(interpolatedLine + indexes[t + 3] * 4), weightedValue3);
+        }
+
+        if (t < pairs)
+        {
+            weightedValue0 = _mm256_fmadd_ps(loadPairWeightsAVX2(weights + 2 * t, pairWeightIndexes), _mm256_loadu_ps(interpolatedLine + indexes[t] * 4), weightedValue0);
+            weightedValue1 = _mm256_fmadd_ps(loadPairWeightsAVX2(weights + 2 * t + 2, pairWeightIndexes), _mm256_loadu_ps(interpolatedLine + indexes[t + 1] * 4), weightedValue1);
+        }
+
+        __m256 weightedValue = _mm256_add_ps(_mm256_add_ps(weightedValue0, weightedValue1), _mm256_add_ps(weightedValue2, weightedValue3));
+        __m128 pixelValue = _mm_add_ps(_mm256_castps256_ps128(weightedValue), _mm256_extractf128_ps(weightedValue, 1));
+        _mm_storeu_ps(output + 4 * x, quantizeSSE2(pixelValue));
+    }
+}
+#endif
+
+#pragma mark -
+#pragma mark Convolution (NEON)
+
+#if BlurEngineNEONAvailable
+static inline float32x4_t quantizeNEON(float32x4_t value)
+{
+    // Same as quantize, the unsigned conversion saturates negative values to 0
+    return vcvtq_f32_u32(vminq_u32(vcvtq_u32_f32(vaddq_f32(value, vdupq_n_f32(0.5f))), vdupq_n_u32(255)));
+}
+
+static void convolveLineNEON(const float * const * lines, const float * weights, size_t taps, float * output, size_t count)
+{
+    size_t x = 0;
+
+    // 16 channels (4 pixels) per iteration
+    for (; x + 16 <= count; x += 16)
+    {
+        float32x4_t weightedValue0 = vdupq_n_f32(0.0f);
+        float32x4_t weightedValue1 = vdupq_n_f32(0.0f);
+        float32x4_t weightedValue2 = vdupq_n_f32(0.0f);
+        float32x4_t weightedValue3 = vdupq_n_f32(0.0f);
+
+        for (size_t k = 0; k < taps; ++k)
+        {
+            const float * line = lines[k] + x;
+            float weight = weights[k];
+
+            weightedValue0 = vmlaq_n_f32(weightedValue0, vld1q_f32(line), weight);
+            weightedValue1 = vmlaq_n_f32(weightedValue1, vld1q_f32(line + 4), weight);
+            weightedValue2 = vmlaq_n_f32(weightedValue2, vld1q_f32(line + 8), weight);
+            weightedValue3 = vmlaq_n_f32(weightedValue3, vld1q_f32(line + 12), weight);
+        }
+
+        vst1q_f32(output + x, quantizeNEON(weightedValue0));
+        vst1q_f32(output + x + 4, quantizeNEON(weightedValue1));
+        vst1q_f32(output + x + 8, quantizeNEON(weightedValue2));
+        vst1q_f32(output + x + 12, quantizeNEON(weightedValue3));
+    }
+
+    if (x < count)
+    {
+        const float * tailLines[taps];
+        for (size_t k = 0; k < taps; ++k)
+        {
+            tailLines[k] = lines[k] + x;
+        }
+        convolveLineScalar(tailLines, weights, taps, output + x, count - x);
+    }
+}
+
+static void gatherLineNEON(const float * interpolatedLine, const int32_t * indexes, const float * weights, size_t pairs, float * output, size_t width)
+{
+    for (size_t x = 0; x < width; ++x, indexes += pairs, weights += 2 * pairs)
+    {
+        // Independent sums (pairs is always even, both sides of each sample) so the adds don't wait on each other
+        float32x4_t weightedValue0 = vdupq_n_f32(0.0f);
+        float32x4_t weightedValue1 = vdupq_n_f32(0.0f);
+        float32x4_t weightedValue2 = vdupq_n_f32(0.0f);
+        float32x4_t weightedValue3 = vdupq_n_f32(0.0f);
+
+        for (size_t t = 0; t < pairs; t += 2)
+        {
+            const float * texels0 = interpolatedLine + indexes[t] * 4;
+            const float * texels1 = interpolatedLine + indexes[t + 1] * 4;
+            float32x2_t weights0 = vld1_f32(weights + 2 * t);
+            float32x2_t weights1 = vld1_f32(weights + 2 * t + 2);
+
+            weightedValue0 = vmlaq_lane_f32(weightedValue0, vld1q_f32(texels0), weights0, 0);
+            weightedValue1 = vmlaq_lane_f32(weightedValue1, vld1q_f32(texels0 + 4), weights0, 1);
+            weightedValue2 = vmlaq_lane_f32(weightedValue2, vld1q_f32(texels1), weights1, 0);
+            weightedValue3 = vmlaq_lane_f32(weightedValue3, vld1q_f32(texels1 + 4), weights1, 1);
+        }
+
+        float32x4_t weightedValue = vaddq_f32(vaddq_f32(weightedValue0, weightedValue1), vaddq_f32(weightedValue2, weightedValue3));
+        vst1q_f32(output + 4 * x, quantizeNEON(weightedValue));
+    }
+}
+#endif
+
+#pragma mark -
+#pragma mark Backends
+
+bool blurEngineBackendAvailable(BlurEngineBackend_t backend)
+{
+    switch (backend)
+    {
+        case BlurEngineBackendScalar:
+            return true;
+        case BlurEngineBackendSSE2:
+            return BlurEngineSSE2Available;
+        case BlurEngineBackendAVX2:
+#if BlurEngineAVX2Available
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+            return false;
+#endif
+        case BlurEngineBackendNEON:
+            return BlurEngineNEONAvailable;
+    }
+
+    return false;
+}
+
+BlurEngineBackend_t blurEngineBestBackend(void)
+{
+    if (blurEngineBackendAvailable(BlurEngineBackendAVX2))
+    {
+        return BlurEngineBackendAVX2;
+    }
+    else if (blurEngineBackendAvailable(BlurEngineBackendSSE2))
+    {
+        return BlurEngineBackendSSE2;
+    }
+    else if (blurEngineBackendAvailable(BlurEngineBackendNEON))
+    {
+        return BlurEngineBackendNEON;
+    }
+
+    return BlurEngineBackendScalar;
+}
+
+BlurEngineBackend_t blurEngineBackend(const BlurEngine_t * blurEngine)
+{
+    return blurEngine->backend;
+}
+
+bool blurEngineSetBackend(BlurEngine_t * blurEngine, BlurEngineBackend_t backend)
+{
+    if (!blurEngineBackendAvailable(backend))
+    {
+        return false;
+    }
+
+    blurEngine->backend = backend;
+    blurEngine->convolveLine = convolveLineScalar;
+    blurEngine->gatherLine = gatherLineScalar;
+
+#if BlurEngineSSE2Available
+    if (backend == BlurEngineBackendSSE2)
+    {
+        blurEngine->convolveLine = convolveLineSSE2;
+        blurEngine->gatherLine = gatherLineSSE2;
+    }
+#endif
+#if BlurEngineAVX2Available
+    if (backend == BlurEngineBackendAVX2)
+    {
+        blurEngine->convolveLine = convolveLineAVX2;
+        blurEngine->gatherLine = gatherLineAVX2;
+    }
+#endif
+#if BlurEngineNEONAvailable
+    if (backend == BlurEngineBackendNEON)
+    {
+        blurEngine->convolveLine = convolveLineNEON;
+        blurEngine->gatherLine = gatherLineNEON;
+    }
+#endif
+
+    return true;
+}
+
+#pragma mark -
+#pragma mark Engine Memory Management
+
+static void releaseWorkers(BlurEngine_t * blurEngine)
+{
+    for (unsigned int w = 0; w < blurEngine->workerCount; ++w)
+    {
+        free(blurEngine->workers[w].interpolatedLine);
+        free(blurEngine->workers[w].paddedLine);
+        free(blurEngine->workers[w].outputLine);
+        free(blurEngine->workers[w].tapLines);
+    }
+
+    free(blurEngine->workers);
+    blurEngine->workers = NULL;
+    blurEngine->workerCount = 0;
+}
+
+BlurEngine_t * createBlurEngine(void)
+{
+    BlurEngine_t * blurEngine = (BlurEngine_t *)calloc(1, sizeof(BlurEngine_t));
+    if (!blurEngine)
+    {
+        return NULL;
+    }
+
+    if (!blurEngineSetWorkerPool(blurEngine, NULL))
+    {
+        free(blurEngine);
+        return NULL;
+    }
+
+    blurEngineSetBackend(blurEngine, blurEngineBestBackend());
+    blurEngineSetFilterParameters(blurEngine, 4.0f, 2);
+    blurEngineSetPrefilterEnabled(blurEngine, false);
+    blurEngine->kernelOffsetScale = 1.0f;
+
+    return blurEngine;
+}
+
+void releaseBlurEngine(BlurEngine_t * blurEngine)
+{
+    if (!blurEngine)
+    {
+        return;
+    }
+
+    free(blurEngine->offsets);
+    free(blurEngine->weights);
+    free(blurEngine->images[0]);
+    free(blurEngine->images[1]);
+    for (unsigned int plane = 0; plane < BlurEnginePlaneCount; ++plane)
+    {
+        free(blurEngine->planeImages[plane]);
+    }
+    releaseWorkers(blurEngine);
+    free(blurEngine->horizontalTaps.shifts);
+    free(blurEngine->horizontalTaps.weights);
+    free(blurEngine->verticalTaps.shifts);
+    free(blurEngine->verticalTaps.weights);
+    free(blurEngine->columnIndexes);
+    free(blurEngine->columnWeights);
+    free(blurEngine);
+}
+
+bool blurEngineSetWorkerPool(BlurEngine_t * blurEngine, WorkerPool_t * workerPool)
+{
+    unsigned int workerCount = workerPool ? workerPoolThreadCount(workerPool) : 1;
+
+    if (workerCount != blurEngine->workerCount)
+    {
+        BlurEngineWorker_t * workers = (BlurEngineWorker_t *)calloc(workerCount, sizeof(BlurEngineWorker_t));
+        if (!workers)
+        {
+            return false;
+        }
+
+        releaseWorkers(blurEngine);
+        blurEngine->workers = workers;
+        blurEngine->workerCount = workerCount;
+    }
+
+    blurEngine->workerPool = workerPool;
+    return true;
+}
+
+WorkerPool_t * blurEngineWorkerPool(const BlurEngine_t * blurEngine)
+{
+    return blurEngine->workerPool;
+}
+
+#pragma mark -
+#pragma mark Filter
+
+void blurEngineSetFilterKernel(BlurEngine_t * blurEngine, unsigned int samples, const float * offsets, const float * weights)
+{
+    free(blurEngine->offsets);
+    free(blurEngine->weights);
+
+    blurEngine->samples = samples;
+    blurEngine->offsets = (float *)malloc(samples * sizeof(float));
+    blurEngine->weights = (float *)malloc(samples * sizeof(float));
+    memcpy(blurEngine->offsets, offsets, samples * sizeof(float));
+    memcpy(blurEngine->weights, weights, samples * sizeof(float));
+}
+
+void blurEngineSetFilterParameters(BlurEngine_t * blurEngine, float downsamplingFactor, unsigned int multiplePassCount)
+{
+    blurEngine->downsamplingFactor = downsamplingFactor;
+    blurEngine->multiplePassCount = multiplePassCount > 0 ? multiplePassCount : 1;
+}
+
+void blurEngineSetPrefilterEnabled(BlurEngine_t * blurEngine, bool prefilterEnabled)
+{
+    blurEngine->prefilterEnabled = prefilterEnabled;
+}
+
+bool blurEnginePrefilterEnabled(const BlurEngine_t * blurEngine)
+{
+    return blurEngine->prefilterEnabled;
+}
+
+void blurEngineOutputDimensions(const BlurEngine_t * blurEngine, size_t inputWidth, size_t inputHeight, size_t viewWidth, size_t viewHeight, size_t * outputWidth, size_t * outputHeight)
+{
+    float scaledWidth, scaledHeight;
+    scaledDownDimensions(blurEngine->downsamplingFactor, inputWidth, inputHeight, viewWidth, viewHeight, &scaledWidth, &scaledHeight);
+
+    // glTexImage2D/glViewport truncate the float texture dimensions
+    *outputWidth = (size_t)scaledWidth;
+    *outputHeight = (size_t)scaledHeight;
+}
+
+#pragma mark -
+#pragma mark Passes
+
+// Expands the bilinear samples (pairs of texels) into texel taps for a pass where source and destination have the same size
+// The offset scale is the ratio between the texture size and the (float) size used for the split-pass direction vector
+static bool loadSplitPassTaps(BlurEngine_t * blurEngine, float offsetScale, BlurEngineTaps_t * taps)
+{
+    offsetScale *= blurEngine->kernelOffsetScale;
+
+    float maxOffset = 0.0f;
+    for (unsigned int s = 0; s < blurEngine->samples; ++s)
+    {
+        maxOffset = fmaxf(maxOffset, fabsf(blurEngine->offsets[s]) * offsetScale);
+    }
+
+    long r = (long)ceilf(maxOffset) + 1;
+    size_t denseSize = 2 * r + 1;
+
+    if (!reserveTaps(taps, denseSize))
+    {
+        return false;
+    }
+
+    float denseWeights[denseSize];
+    memset(denseWeights, 0, sizeof(denseWeights));
+
+    for (unsigned int s = 0; s < blurEngine->samples; ++s)
+    {
+        float weight = blurEngine->weights[s];
+
+        // Sample both sides of the center texel (-offset, +offset)
+        for (int side = -1; side <= 1; side += 2)
+        {
+            float position = side * blurEngine->offsets[s] * offsetScale;
+            float base = floorf(position);
+            float fraction = position - base;
+
+            denseWeights[(long)base + r] += weight * (1.0f - fraction);
+            denseWeights[(long)base + 1 + r] += weight * fraction;
+        }
+    }
+
+    // Skip the taps without weight (ie. kernels padded with zeros)
+    taps->count = 0;
+    taps->radius = 0;
+    for (long d = 0; d < (long)denseSize; ++d)
+    {
+        if (denseWeights[d] > kBlurEngineWeightEpsilon)
+        {
+            taps->shifts[taps->count] = (int32_t)(d - r);
+            taps->weights[taps->count] = denseWeights[d];
+            taps->radius = labs(d - r) > taps->radius ? labs(d - r) : taps->radius;
+            ++taps->count;
+        }
+    }
+
+    return taps->count > 0;
+}
+
+static void filterHorizontalSplitPassRows(const BlurEngine_t * blurEngine, BlurEngineWorker_t * worker, const BlurEngineFloatImage_t * src, BlurEngineFloatImage_t * dest, size_t firstRow, size_t lastRow)
+{
+    const BlurEngineTaps_t * taps = &blurEngine->horizontalTaps;
+    long radius = taps->radius;
+    size_t width = src->width;
+    float * paddedLine = worker->paddedLine;
+
+    for (size_t k = 0; k < taps->count; ++k)
+    {
+        worker->tapLines[k] = paddedLine + (radius + taps->shifts[k]) * 4;
+    }
+
+    for (size_t y = firstRow; y < lastRow; ++y)
+    {
+        const float * srcRow = src->data + y * src->rowLength;
+
+        // Clamp to edge by repeating the first and last pixels
+        for (long p = 0; p < radius; ++p)
+        {
+            memcpy(paddedLine + p * 4, srcRow, 4 * sizeof(float));
+            memcpy(paddedLine + (radius + width + p) * 4, srcRow + (width - 1) * 4, 4 * sizeof(float));
+        }
+        memcpy(paddedLine + radius * 4, srcRow, width * 4 * sizeof(float));
+
+        blurEngine->convolveLine(worker->tapLines, taps->weights, taps->count, dest->data + y * dest->rowLength, width * 4);
+    }
+}
+
+// The last pass (outputImage) is converted to 8 bits
+static void filterVerticalSplitPassRows(const BlurEngine_t * blurEngine, BlurEngineWorker_t * worker, const BlurEngineFloatImage_t * src, BlurEngineFloatImage_t * dest, BlurEngineImage_t * outputImage, size_t firstRow, size_t lastRow)
+{
+    const BlurEngineTaps_t * taps = &blurEngine->verticalTaps;
+    size_t count = src->width * 4;
+
+    // Convolve blocks of columns down the stripe, so the rows of the taps stay in the L1 cache from one output row to the next
+    // The rows above and below the stripe (up to the radius) are read from the shared source image
+    for (size_t block = 0; block < count; block += kBlurEngineVerticalBlockLength)
+    {
+        size_t blockLength = (count - block < kBlurEngineVerticalBlockLength) ? count - block : kBlurEngineVerticalBlockLength;
+
+        for (size_t y = firstRow; y < lastRow; ++y)
+        {
+            for (size_t k = 0; k < taps->count; ++k)
+            {
+                long row = clampIndex((long)y + taps->shifts[k], (long)src->height);
+                worker->tapLines[k] = src->data + row * src->rowLength + block;
+            }
+
+            if (outputImage)
+            {
+                blurEngine->convolveLine(worker->tapLines, taps->weights, taps->count, worker->outputLine, blockLength);
+                storeLine(worker->outputLine, outputImage->data + y * outputImage->bytesPerRow + block, blockLength);
+            }
+            else
+            {
+                blurEngine->convolveLine(worker->tapLines, taps->weights, taps->count, dest->data + y * dest->rowLength + block, blockLength);
+            }
+        }
+    }
+}
+
+// Adds a bilinear sample to the columns of an output pixel, as a pair of neighbouring texels
+// Clamped samples (GL_CLAMP_TO_EDGE) read a single texel, the pair starts before the last texel so both texels are in the line
+static void loadDownsamplingColumnPair(float position, float weight, size_t srcWidth, int32_t * index, float * weights)
+{
+    float base = floorf(position);
+    float fraction = position - base;
+    long lastIndex = (long)srcWidth - 2; // -1 with a single texel (the interpolated line is padded)
+
+    if ((long)base < 0 || lastIndex < 0)
+    {
+        *index = 0;
+        weights[0] = weight;
+        weights[1] = 0.0f;
+    }
+    else if ((long)base > lastIndex)
+    {
+        *index = (int32_t)lastIndex;
+        weights[0] = 0.0f;
+        weights[1] = weight;
+    }
+    else
+    {
+        *index = (int32_t)base;
+        weights[0] = weight * (1.0f - fraction);
+        weights[1] = weight * fraction;
+    }
+}
+
+// First pass: bilinear downsampling of the input and horizontal filter in one step
+// Each bilinear sample reads 2x2 input texels, the vertical interpolation is shared by all samples of a row
+// The input texels and weights of each output column are the same for every row (loadDownsamplingColumns)
+// With the prefilter each sample is the average of 2x2 bilinear samples, a quarter of an output texel around it
+static bool loadDownsamplingColumns(BlurEngine_t * blurEngine, const BlurEngineImage_t * src, size_t destWidth, float scaledWidth)
+{
+    unsigned int prefilterTaps = blurEngine->prefilterEnabled ? 2 : 1;
+    float prefilterOffset = blurEngine->prefilterOffsets[0];
+    size_t pairCount = 0;
+
+    for (unsigned int s = 0; s < blurEngine->samples; ++s)
+    {
+        if (blurEngine->weights[s] > kBlurEngineWeightEpsilon)
+        {
+            pairCount += 2 * prefilterTaps; // 2 samples (-/+) x prefilter taps
+        }
+    }
+
+    if (!reserveColumns(blurEngine, destWidth * pairCount))
+    {
+        return false;
+    }
+
+    float srcWidth = (float)src->width;
+
+    for (size_t x = 0; x < destWidth; ++x)
+    {
+        float textureCoordinate = (x + 0.5f) / (float)destWidth;
+        size_t c = x * pairCount;
+
+        for (unsigned int s = 0; s < blurEngine->samples; ++s)
+        {
+            float weight = blurEngine->weights[s];
+            if (weight <= kBlurEngineWeightEpsilon)
+            {
+                continue;
+            }
+
+            for (int side = -1; side <= 1; side += 2)
+            {
+                for (unsigned int p = 0; p < prefilterTaps; ++p)
+                {
+                    float prefilterTapOffset = (prefilterTaps > 1) ? (p ? prefilterOffset : -prefilterOffset) : 0.0f;
+                    float position = (textureCoordinate + side * blurEngine->offsets[s] * blurEngine->kernelOffsetScale / scaledWidth + prefilterTapOffset) * srcWidth - 0.5f;
+
+                    loadDownsamplingColumnPair(position, weight / prefilterTaps, src->width, &blurEngine->columnIndexes[c], &blurEngine->columnWeights[2 * c]);
+                    ++c;
+                }
+            }
+        }
+    }
+
+    blurEngine->columnPairCount = pairCount;
+    return true;
+}
+
+#if BlurEngineSSE2Available
+// 16 channels to 4 vectors of floats
+static inline void loadChannelsSSE2(const uint8_t * values, __m128 * channels0, __m128 * channels1, __m128 * channels2, __m128 * channels3)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i values8 = _mm_loadu_si128((const __m128i *)values);
+    __m128i valuesLow16 = _mm_unpacklo_epi8(values8, zero);
+    __m128i valuesHigh16 = _mm_unpackhi_epi8(values8, zero);
+
+    *channels0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(valuesLow16, zero));
+    *channels1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(valuesLow16, zero));
+    *channels2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(valuesHigh16, zero));
+    *channels3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(valuesHigh16, zero));
+}
+
+static inline __m128 interpolateSSE2(__m128 values0, __m128 values1, __m128 fraction)
+{
+    return _mm_add_ps(values0, _mm_mul_ps(fraction, _mm_sub_ps(values1, values0)));
+}
+#elif BlurEngineNEONAvailable
+// 16 channels to 4 vectors of floats
+static inline void loadChannelsNEON(const uint8_t * values, float32x4_t * channels0, float32x4_t * channels1, float32x4_t * channels2, float32x4_t * channels3)
+{
+    uint8x16_t values8 = vld1q_u8(values);
+    uint16x8_t valuesLow16 = vmovl_u8(vget_low_u8(values8));
+    uint16x8_t valuesHigh16 = vmovl_u8(vget_high_u8(values8));
+
+    *channels0 = vcvtq_f32_u32(vmovl_u16(vget_low_u16(valuesLow16)));
+    *channels1 = vcvtq_f32_u32(vmovl_u16(vget_high_u16(valuesLow16)));
+    *channels2 = vcvtq_f32_u32(vmovl_u16(vget_low_u16(valuesHigh16)));
+    *channels3 = vcvtq_f32_u32(vmovl_u16(vget_high_u16(valuesHigh16)));
+}
+
+static inline float32x4_t interpolateNEON(float32x4_t values0, float32x4_t values1, float32x4_t fraction)
+{
+    return vaddq_f32(values0, vmulq_f32(fraction, vsubq_f32(values1, values0)));
+}
+#endif
+
+// Vertical bilinear interpolation between two input rows
+// Same operations for every channel in the vectorized and scalar loops, so the result doesn't depend on the backend
+static void interpolateLine(const uint8_t * row0, const uint8_t * row1, float fraction, float * output, size_t count)
+{
+    size_t c = 0;
+
+#if BlurEngineSSE2Available
+    __m128 fractions = _mm_set1_ps(fraction);
+    for (; c + 16 <= count; c += 16)
+    {
+        __m128 values00, values01, values02, values03, values10, values11, values12, values13;
+        loadChannelsSSE2(row0 + c, &values00, &values01, &values02, &values03);
+        loadChannelsSSE2(row1 + c, &values10, &values11, &values12, &values13);
+
+        _mm_storeu_ps(output + c, interpolateSSE2(values00, values10, fractions));
+        _mm_storeu_ps(output + c + 4, interpolateSSE2(values01, values11, fractions));
+        _mm_storeu_ps(output + c + 8, interpolateSSE2(values02, values12, fractions));
+        _mm_storeu_ps(output + c + 12, interpolateSSE2(values03, values13, fractions));
+    }
+#elif BlurEngineNEONAvailable
+    float32x4_t fractions = vdupq_n_f32(fraction);
+    for (; c + 16 <= count; c += 16)
+    {
+        float32x4_t values00, values01, values02, values03, values10, values11, values12, values13;
+        loadChannelsNEON(row0 + c, &values00, &values01, &values02, &values03);
+        loadChannelsNEON(row1 + c, &values10, &values11, &values12, &values13);
+
+        vst1q_f32(output + c, interpolateNEON(values00, values10, fractions));
+        vst1q_f32(output + c + 4, interpolateNEON(values01, values11, fractions));
+        vst1q_f32(output + c + 8, interpolateNEON(values02, values12, fractions));
+        vst1q_f32(output + c + 12, interpolateNEON(values03, values13, fractions));
+    }
+#endif
+
+    for (; c < count; ++c)
+    {
+        output[c] = row0[c] + fraction * ((float)row1[c] - (float)row0[c]);
+    }
+}
+
+// Average of the vertical bilinear interpolations of two pairs of input rows (prefilter)
+static void interpolateLinePair(const uint8_t * row0, const uint8_t * row1, float fraction0, const uint8_t * row2, const uint8_t * row3, float fraction1, float * output, size_t count)
+{
+    size_t c = 0;
+
+#if BlurEngineSSE2Available
+    const __m128 half = _mm_set1_ps(0.5f);
+    __m128 fractions0 = _mm_set1_ps(fraction0);
+    __m128 fractions1 = _mm_set1_ps(fraction1);
+    for (; c + 16 <= count; c += 16)
+    {
+        __m128 values00, values01, values02, values03, values10, values11, values12, values13;
+        __m128 values20, values21, values22, values23, values30, values31, values32, values33;
+        loadChannelsSSE2(row0 + c, &values00, &values01, &values02, &values03);
+        loadChannelsSSE2(row1 + c, &values10, &values11, &values12, &values13);
+        loadChannelsSSE2(row2 + c, &values20, &values21, &values22, &values23);
+        loadChannelsSSE2(row3 + c, &values30, &values31, &values32, &values33);
+
+        _mm_storeu_ps(output + c, _mm_mul_ps(half, _mm_add_ps(interpolateSSE2(values00, values10, fractions0), interpolateSSE2(values20, values30, fractions1))));
+        _mm_storeu_ps(output + c + 4, _mm_mul_ps(half, _mm_add_ps(interpolateSSE2(values01, values11, fractions0), interpolateSSE2(values21, values31, fractions1))));
+        _mm_storeu_ps(output + c + 8, _mm_mul_ps(half, _mm_add_ps(interpolateSSE2(values02, values12, fractions0), interpolateSSE2(values22, values32, fractions1))));
+        _mm_storeu_ps(output + c + 12, _mm_mul_ps(half, _mm_add_ps(interpolateSSE2(values03, values13, fractions0), interpolateSSE2(values23, values33, fractions1))));
+    }
+#elif BlurEngineNEONAvailable
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    float32x4_t fractions0 = vdupq_n_f32(fraction0);
+    float32x4_t fractions1 = vdupq_n_f32(fraction1);
+    for (; c + 16 <= count; c += 16)
+    {
+        float32x4_t values00, values01, values02, values03, values10, values11, values12, values13;
+        float32x4_t values20, values21, values22, values23, values30, values31, values32, values33;
+        loadChannelsNEON(row0 + c, &values00, &values01, &values02, &values03);
+        loadChannelsNEON(row1 + c, &values10, &values11, &values12, &values13);
+        loadChannelsNEON(row2 + c, &values20, &values21, &values22, &values23);
+        loadChannelsNEON(row3 + c, &values30, &values31, &values32, &values33);
+
+        vst1q_f32(output + c, vmulq_f32(half, vaddq_f32(interpolateNEON(values00, values10, fractions0), interpolateNEON(values20, values30, fractions1))));
+        vst1q_f32(output + c + 4, vmulq_f32(half, vaddq_f32(interpolateNEON(values01, values11, fractions0), interpolateNEON(values21, values31, fractions1))));
+        vst1q_f32(output + c + 8, vmulq_f32(half, vaddq_f32(interpolateNEON(values02, values12, fractions0), interpolateNEON(values22, values32, fractions1))));
+        vst1q_f32(output + c + 12, vmulq_f32(half, vaddq_f32(interpolateNEON(values03, values13, fractions0), interpolateNEON(values23, values33, fractions1))));
+    }
+#endif
+
+    for (; c < count; ++c)
+    {
+        float top = row0[c] + fraction0 * ((float)row1[c] - (float)row0[c]);
+        float bottom = row2[c] + fraction1 * ((float)row3[c] - (float)row2[c]);
+        output[c] = 0.5f * (top + bottom);
+    }
+}
+
+static void filterDownsamplingHorizontalPassRows(const BlurEngine_t * blurEngine, BlurEngineWorker_t * worker, const BlurEngineImage_t * src, BlurEngineFloatImage_t * dest, size_t firstRow, size_t lastRow)
+{
+    float * interpolatedLine = worker->interpolatedLine;
+    float srcHeight = (float)src->height;
+
+    for (size_t y = firstRow; y < lastRow; ++y)
+    {
+        float textureCoordinate = (y + 0.5f) / (float)dest->height;
+
+        if (blurEngine->prefilterEnabled)
+        {
+            // Average of the vertical bilinear interpolations above and below the center of the output row
+            float positions[2] = {
+                (textureCoordinate - blurEngine->prefilterOffsets[1]) * srcHeight - 0.5f,
+                (textureCoordinate + blurEngine->prefilterOffsets[1]) * srcHeight - 0.5f,
+            };
+            float bases[2] = { floorf(positions[0]), floorf(positions[1]) };
+            float fractions[2] = { positions[0] - bases[0], positions[1] - bases[1] };
+
+            const uint8_t * row0 = src->data + clampIndex((long)bases[0], (long)src->height) * src->bytesPerRow;
+            const uint8_t * row1 = src->data + clampIndex((long)bases[0] + 1, (long)src->height) * src->bytesPerRow;
+            const uint8_t * row2 = src->data + clampIndex((long)bases[1], (long)src->height) * src->bytesPerRow;
+            const uint8_t * row3 = src->data + clampIndex((long)bases[1] + 1, (long)src->height) * src->bytesPerRow;
+
+            interpolateLinePair(row0, row1, fractions[0], row2, row3, fractions[1], interpolatedLine, src->width * 4);
+        }
+        else
+        {
+            // Vertical bilinear interpolation between two input rows
+            float position = textureCoordinate * srcHeight - 0.5f;
+            float base = floorf(position);
+            float fraction = position - base;
+
+            const uint8_t * row0 = src->data + clampIndex((long)base, (long)src->height) * src->bytesPerRow;
+            const uint8_t * row1 = src->data + clampIndex((long)base + 1, (long)src->height) * src->bytesPerRow;
+
+            interpolateLine(row0, row1, fraction, interpolatedLine, src->width * 4);
+        }
+
+        // Pairs always read 2 texels
+        if (src->width == 1)
+        {
+            memcpy(interpolatedLine + 4, interpolatedLine, 4 * sizeof(float));
+        }
+
+        blurEngine->gatherLine(interpolatedLine, blurEngine->columnIndexes, blurEngine->columnWeights, blurEngine->columnPairCount, dest->data + y * dest->rowLength, dest->width);
+    }
+}
+
+#pragma mark -
+#pragma mark Stripes
+
+typedef enum {
+    BlurEnginePassDownsamplingHorizontal = 0,
+    BlurEnginePassHorizontal,
+    BlurEnginePassVertical,
+} BlurEnginePass_t;
+
+struct BlurEngineStripes {
+    BlurEngine_t * blurEngine;
+    size_t stripeHeight;
+    size_t rowCount;
+    BlurEnginePass_t pass;
+    const BlurEngineImage_t * src; // Input image of the first pass
+    BlurEngineImage_t * dest; // Output image of the last pass
+    const BlurEngineFloatImage_t * floatSrc;
+    BlurEngineFloatImage_t * floatDest;
+    const void * data; // Other stripes (ie. YUV planes)
+};
+
+typedef struct BlurEngineStripes BlurEngineStripes_t;
+
+// Splits the rows in stripes and runs them on the worker pool (or the calling thread without a pool)
+static void runStripes(BlurEngineStripes_t * stripes, size_t rowCount, WorkerPoolTaskFunction function)
+{
+    BlurEngine_t * blurEngine = stripes->blurEngine;
+    size_t stripeCount = blurEngine->workerPool ? kBlurEngineStripesPerThread * blurEngine->workerCount : 1;
+    size_t stripeHeight = (rowCount + stripeCount - 1) / stripeCount;
+
+    if (stripeCount > 1 && stripeHeight < kBlurEngineMinStripeHeight)
+    {
+        stripeHeight = kBlurEngineMinStripeHeight;
+    }
+
+    stripes->stripeHeight = stripeHeight;
+    stripes->rowCount = rowCount;
+    stripeCount = (rowCount + stripeHeight - 1) / stripeHeight;
+
+    if (blurEngine->workerPool && stripeCount > 1)
+    {
+        workerPoolRun(blurEngine->workerPool, stripeCount, function, stripes);
+    }
+    else
+    {
+        for (size_t s = 0; s < stripeCount; ++s)
+        {
+            function(stripes, s, 0);
+        }
+    }
+}
+
+static void stripeRows(const BlurEngineStripes_t * stripes, size_t stripeIndex, size_t * firstRow, size_t * lastRow)
+{
+    *firstRow = stripeIndex * stripes->stripeHeight;
+    *lastRow = *firstRow + stripes->stripeHeight < stripes->rowCount ? *firstRow + stripes->stripeHeight : stripes->rowCount;
+}
+
+static void filterPassStripe(void * context, size_t stripeIndex, unsigned int workerIndex)
+{
+    const BlurEngineStripes_t * stripes = (const BlurEngineStripes_t *)context;
+    const BlurEngine_t * blurEngine = stripes->blurEngine;
+    BlurEngineWorker_t * worker = &blurEngine->workers[workerIndex];
+
+    size_t firstRow, lastRow;
+    stripeRows(stripes, stripeIndex, &firstRow, &lastRow);
+
+    switch (stripes->pass)
+    {
+        case BlurEnginePassDownsamplingHorizontal:
+            filterDownsamplingHorizontalPassRows(blurEngine, worker, stripes->src, stripes->floatDest, firstRow, lastRow);
+            break;
+        case BlurEnginePassHorizontal:
+            filterHorizontalSplitPassRows(blurEngine, worker, stripes->floatSrc, stripes->floatDest, firstRow, lastRow);
+            break;
+        case BlurEnginePassVertical:
+            filterVerticalSplitPassRows(blurEngine, worker, stripes->floatSrc, stripes->floatDest, stripes->dest, firstRow, lastRow);
+            break;
+    }
+}
+
+bool blurEngineFilterImage(BlurEngine_t * blurEngine, const BlurEngineImage_t * inputImage, size_t viewWidth, size_t viewHeight, BlurEngineImage_t * outputImage)
+{
+    if (!blurEngine->samples || !inputImage->width || !inputImage->height)
+    {
+        return false;
+    }
+
+    // Downsampled dimensions, float values are used for the split-pass direction vector
+    float scaledWidth, scaledHeight;
+    scaledDownDimensions(blurEngine->downsamplingFactor, inputImage->width, inputImage->height, viewWidth, viewHeight, &scaledWidth, &scaledHeight);
+
+    size_t width = (size_t)scaledWidth;
+    size_t height = (size_t)scaledHeight;
+
+    if (!width || !height || outputImage->width != width || outputImage->height != height)
+    {
+        return false;
+    }
+
+    if (!reserveImages(blurEngine, width * height * 4 * sizeof(float)))
+    {
+        return false;
+    }
+
+    // Prefilter taps a quarter of a downsampled texel around the samples (FilterPrefilterOffset)
+    blurEngine->prefilterOffsets[0] = 0.25f / scaledWidth;
+    blurEngine->prefilterOffsets[1] = 0.25f / scaledHeight;
+
+    // Taps and columns shared by all stripes, scratch memory for each worker
+    if (!loadDownsamplingColumns(blurEngine, inputImage, width, scaledWidth) ||
+        !loadSplitPassTaps(blurEngine, (float)width / scaledWidth, &blurEngine->horizontalTaps) ||
+        !loadSplitPassTaps(blurEngine, (float)height / scaledHeight, &blurEngine->verticalTaps))
+    {
+        return false;
+    }
+
+    size_t tapLineCount = blurEngine->horizontalTaps.count > blurEngine->verticalTaps.count ? blurEngine->horizontalTaps.count : blurEngine->verticalTaps.count;
+
+    // The interpolated line has at least 2 texels (pairs)
+    size_t interpolatedLineSize = (inputImage->width > 1 ? inputImage->width : 2) * 4 * sizeof(float);
+    size_t paddedLineSize = (width + 2 * blurEngine->horizontalTaps.radius) * 4 * sizeof(float);
+
+    if (!reserveWorkers(blurEngine, interpolatedLineSize, paddedLineSize, width * 4 * sizeof(float), tapLineCount))
+    {
+        return false;
+    }
+
+    BlurEngineFloatImage_t offscreenImages[2] = {
+        { blurEngine->images[0], width, height, width * 4 },
+        { blurEngine->images[1], width, height, width * 4 },
+    };
+
+    // Draw the offscreen images and keep applying the filter (ping, pong, ping, pong)
+    // The last pass is converted to the 8 bit output image
+    // Each pass reads rows of the whole source image (vertical pass), so the stripes of a pass must be done before the next pass
+    unsigned int passCount = 2 * blurEngine->multiplePassCount;
+
+    for (unsigned int p = 0; p < passCount; ++p)
+    {
+        BlurEngineStripes_t stripes = {
+            .blurEngine = blurEngine,
+            .pass = (p == 0) ? BlurEnginePassDownsamplingHorizontal : ((p % 2 == 0) ? BlurEnginePassHorizontal : BlurEnginePassVertical),
+            .src = (p == 0) ? inputImage : NULL,
+            .dest = (p == passCount - 1) ? outputImage : NULL,
+            .floatSrc = (p == 0) ? NULL : &offscreenImages[(p + 1) % 2],
+            .floatDest = (p == passCount - 1) ? NULL : &offscreenImages[p % 2],
+        };
+
+        runStripes(&stripes, height, filterPassStripe);
+    }
+
+    return true;
+}
+
+#pragma mark -
+#pragma mark 420 bi-planar (YUV)
+
+static bool reservePlaneImage(BlurEngine_t * blurEngine, unsigned int plane, size_t width, size_t height, BlurEngineImage_t * image)
+{
+    if (!reserveBuffer((void **)&blurEngine->planeImages[plane], &blurEngine->planeImageSizes[plane], width * height * 4))
+    {
+        return false;
+    }
+
+    image->data = blurEngine->planeImages[plane];
+    image->width = width;
+    image->height = height;
+    image->bytesPerRow = width * 4;
+    return true;
+}
+
+// Plane of the input image, 1 (luma) or 2 (chroma) bytes per pixel
+struct BlurEnginePlane {
+    const uint8_t * data;
+    size_t bytesPerRow;
+    size_t bytesPerPixel;
+};
+
+typedef struct BlurEnginePlane BlurEnginePlane_t;
+
+// Same texels as a GL_LUMINANCE (luma) or GL_LUMINANCE_ALPHA (chroma) texture: B = G = R = first byte, A = second byte or 255
+static void expandPlaneStripe(void * context, size_t stripeIndex, unsigned int workerIndex)
+{
+    (void)workerIndex; // No scratch lines
+    const BlurEngineStripes_t * stripes = (const BlurEngineStripes_t *)context;
+    const BlurEnginePlane_t * plane = (const BlurEnginePlane_t *)stripes->data;
+    BlurEngineImage_t * image = stripes->dest;
+    size_t bytesPerPixel = plane->bytesPerPixel;
+
+    size_t firstRow, lastRow;
+    stripeRows(stripes, stripeIndex, &firstRow, &lastRow);
+
+    for (size_t y = firstRow; y < lastRow; ++y)
+    {
+        const uint8_t * src = plane->data + y * plane->bytesPerRow;
+        uint8_t * dest = image->data + y * image->bytesPerRow;
+
+        for (size_t x = 0; x < image->width; ++x, src += bytesPerPixel, dest += 4)
+        {
+            dest[0] = dest[1] = dest[2] = src[0];
+            dest[3] = (bytesPerPixel == 2) ? src[1] : 255;
+        }
+    }
+}
+
+static void expandPlane(BlurEngine_t * blurEngine, const uint8_t * data, size_t bytesPerRow, size_t bytesPerPixel, BlurEngineImage_t * image)
+{
+    BlurEnginePlane_t plane = { data, bytesPerRow, bytesPerPixel };
+    BlurEngineStripes_t stripes = {
+        .blurEngine = blurEngine,
+        .dest = image,
+        .data = &plane,
+    };
+
+    runStripes(&stripes, image->height, expandPlaneStripe);
+}
+
+// Bilinear sample (GL_LINEAR, GL_CLAMP_TO_EDGE) of the filtered chroma plane at normalized coordinates s, t
+static void sampleChroma(const BlurEngineImage_t * chroma, float s, float t, float * cb, float * cr)
+{
+    float u = s * chroma->width - 0.5f;
+    float v = t * chroma->height - 0.5f;
+    float u0 = floorf(u);
+    float v0 = floorf(v);
+    float fu = u - u0;
+    float fv = v - v0;
+
+    long x0 = clampIndex((long)u0, (long)chroma->width);
+    long x1 = clampIndex((long)u0 + 1, (long)chroma->width);
+    const uint8_t * row0 = chroma->data + clampIndex((long)v0, (long)chroma->height) * chroma->bytesPerRow;
+    const uint8_t * row1 = chroma->data + clampIndex((long)v0 + 1, (long)chroma->height) * chroma->bytesPerRow;
+
+    // Cb in B (= R), Cr in A
+    for (int c = 0; c < 2; ++c)
+    {
+        size_t channel = c ? 3 : 0;
+        float top = row0[4 * x0 + channel] + fu * (row0[4 * x1 + channel] - row0[4 * x0 + channel]);
+        float bottom = row1[4 * x0 + channel] + fu * (row1[4 * x1 + channel] - row1[4 * x0 + channel]);
+        *(c ? cr : cb) = top + fv * (bottom - top);
+    }
+}
+
+// Full range BT.601 conversion of the filtered planes, chroma is sampled at the center of each luma pixel
+static void convertYUVStripe(void * context, size_t stripeIndex, unsigned int workerIndex)
+{
+    (void)workerIndex; // No scratch lines
+    const BlurEngineStripes_t * stripes = (const BlurEngineStripes_t *)context;
+    const BlurEngineImage_t * luma = stripes->src;
+    const BlurEngineImage_t * chroma = (const BlurEngineImage_t *)stripes->data;
+    BlurEngineImage_t * outputImage = stripes->dest;
+
+    size_t firstRow, lastRow;
+    stripeRows(stripes, stripeIndex, &firstRow, &lastRow);
+
+    for (size_t y = firstRow; y < lastRow; ++y)
+    {
+        const uint8_t * lumaRow = luma->data + y * luma->bytesPerRow;
+        uint8_t * outputRow = outputImage->data + y * outputImage->bytesPerRow;
+        float t = (y + 0.5f) / luma->height;
+
+        for (size_t x = 0; x < luma->width; ++x)
+        {
+            float cb, cr;
+            sampleChroma(chroma, (x + 0.5f) / luma->width, t, &cb, &cr);
+            cb -= kBlurEngineYUVChromaOffset;
+            cr -= kBlurEngineYUVChromaOffset;
+
+            float value = lumaRow[4 * x];
+            outputRow[4 * x + 0] = quantize(value + kBlurEngineYUVCbToB * cb);
+            outputRow[4 * x + 1] = quantize(value - kBlurEngineYUVCbToG * cb - kBlurEngineYUVCrToG * cr);
+            outputRow[4 * x + 2] = quantize(value + kBlurEngineYUVCrToR * cr);
+            outputRow[4 * x + 3] = 255;
+        }
+    }
+}
+
+bool blurEngineFilterYUVImage(BlurEngine_t * blurEngine, const BlurEngineYUVImage_t * inputImage, size_t viewWidth, size_t viewHeight, BlurEngineImage_t * outputImage)
+{
+    if (!inputImage->width || !inputImage->height)
+    {
+        return false;
+    }
+
+    size_t chromaWidth = (inputImage->width + 1) / 2;
+    size_t chromaHeight = (inputImage->height + 1) / 2;
+    float downsamplingFactor = blurEngine->downsamplingFactor;
+
+    // Filtered dimensions, the chroma plane has twice the downsampling factor (half the luma dimensions)
+    size_t lumaWidth, lumaHeight, filteredChromaWidth, filteredChromaHeight;
+    blurEngineOutputDimensions(blurEngine, inputImage->width, inputImage->height, viewWidth, viewHeight, &lumaWidth, &lumaHeight);
+    blurEngine->downsamplingFactor = 2.0f * downsamplingFactor;
+    blurEngineOutputDimensions(blurEngine, chromaWidth, chromaHeight, viewWidth, viewHeight, &filteredChromaWidth, &filteredChromaHeight);
+    blurEngine->downsamplingFactor = downsamplingFactor;
+
+    if (!lumaWidth || !lumaHeight || !filteredChromaWidth || !filteredChromaHeight || outputImage->width != lumaWidth || outputImage->height != lumaHeight)
+    {
+        return false;
+    }
+
+    BlurEngineImage_t planes[BlurEnginePlaneCount];
+
+    if (!reservePlaneImage(blurEngine, BlurEnginePlaneLumaInput, inputImage->width, inputImage->height, &planes[BlurEnginePlaneLumaInput]) ||
+        !reservePlaneImage(blurEngine, BlurEnginePlaneChromaInput, chromaWidth, chromaHeight, &planes[BlurEnginePlaneChromaInput]) ||
+        !reservePlaneImage(blurEngine, BlurEnginePlaneLumaFiltered, lumaWidth, lumaHeight, &planes[BlurEnginePlaneLumaFiltered]) ||
+        !reservePlaneImage(blurEngine, BlurEnginePlaneChromaFiltered, filteredChromaWidth, filteredChromaHeight, &planes[BlurEnginePlaneChromaFiltered]))
+    {
+        return false;
+    }
+
+    expandPlane(blurEngine, inputImage->luma, inputImage->lumaBytesPerRow, 1, &planes[BlurEnginePlaneLumaInput]);
+    expandPlane(blurEngine, inputImage->chroma, inputImage->chromaBytesPerRow, 2, &planes[BlurEnginePlaneChromaInput]);
+
+    // Same passes for both planes, the chroma texels are twice as large so the kernel offsets are halved
+    bool filtered = blurEngineFilterImage(blurEngine, &planes[BlurEnginePlaneLumaInput], viewWidth, viewHeight, &planes[BlurEnginePlaneLumaFiltered]);
+
+    blurEngine->downsamplingFactor = 2.0f * downsamplingFactor;
+    blurEngine->kernelOffsetScale = 0.5f;
+    filtered = filtered && blurEngineFilterImage(blurEngine, &planes[BlurEnginePlaneChromaInput], viewWidth, viewHeight, &planes[BlurEnginePlaneChromaFiltered]);
+    blurEngine->downsamplingFactor = downsamplingFactor;
+    blurEngine->kernelOffsetScale = 1.0f;
+
+    if (!filtered)
+    {
+        return false;
+    }
+
+    // Conversion pass, chroma is sampled at the center of each luma pixel
+    BlurEngineStripes_t stripes = {
+        .blurEngine = blurEngine,
+        .src = &planes[BlurEnginePlaneLumaFiltered],
+        .dest = outputImage,
+        .data = &planes[BlurEnginePlaneChromaFiltered],
+    };
+
+    runStripes(&stripes, lumaHeight, convertYUVStripe);
+
+    return true;
+}
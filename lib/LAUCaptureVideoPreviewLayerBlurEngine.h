@@ -0,0 +1,144 @@
+/*
+
+ LAUCaptureVideoPreviewLayerBlurEngine.h
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef LAUCaptureVideoPreviewLayerBlurEngine_h
+#define LAUCaptureVideoPreviewLayerBlurEngine_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LAUCaptureVideoPreviewLayerWorkerPool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ CPU implementation of the separable blur filter used by drawPixelBuffer:
+
+ 1. The input frame is downsampled with bilinear sampling (scaleDownPixelBufferTextureInstanceDimensions)
+    and the first horizontal pass is applied in the same step, exactly like the first offscreen draw call.
+    With the prefilter each sample of that pass averages 2x2 bilinear samples around it,
+    so every downsampled texel covers its footprint in the input instead of reading 2 of its rows.
+ 2. The remaining horizontal/vertical passes (2 * multiplePassCount - 1) run on the downsampled image.
+
+ Intermediate images are quantized to 8 bits per channel, like the RGBA8 offscreen textures,
+ so the result matches the bilinear texture sampling (bts) shaders. They are stored as floats, so the taps
+ of the passes aren't converted again for every output row.
+ It's plain C (no OpenGL, no Apple frameworks) and can be used wherever the GL pipeline isn't available.
+
+ With a worker pool, every pass is split in horizontal stripes of rows (4 per worker) that run in parallel.
+ The vertical pass reads the rows above and below its stripe (up to the kernel radius) from the source image
+ of the pass, so a pass starts when all stripes of the previous pass are done. The output doesn't depend on the pool.
+
+ One 1080p frame on one core (avx2, downsampling 4, 2 passes, 2 GHz Xeon, LAUCaptureVideoPreviewLayerBenchmark):
+ 3.7 ms with kernel 0, 7.5 ms with kernel 5 and 12 ms with kernel 10 (full intensity), about 5 ms in the first pass.
+ That misses the target of a few ms at full intensity, the 40 taps of each pass are bound by the multiply-adds.
+ Vectorized vertical interpolation and 16-bit intermediates (madd) of the vertical pass weren't consistently faster.
+
+ The SIMD backends match the scalar backend within 1 LSB (BlurEngineBackendTests). The NEON backend is only
+ built and checked on aarch64 (make check with a cross compiler and qemu, skipped if they aren't installed).
+ */
+
+// BGRA8 image. Rows may be padded (bytesPerRow >= 4 * width)
+struct BlurEngineImage {
+    uint8_t * data;
+    size_t width;
+    size_t height;
+    size_t bytesPerRow;
+};
+
+typedef struct BlurEngineImage BlurEngineImage_t;
+
+// 420 bi-planar image (NV12, ie. kCVPixelFormatType_420YpCbCr8BiPlanarFullRange)
+// The chroma plane has interleaved Cb Cr pairs at half resolution, (width+1)/2 x (height+1)/2
+struct BlurEngineYUVImage {
+    uint8_t * luma;
+    size_t lumaBytesPerRow;
+    uint8_t * chroma;
+    size_t chromaBytesPerRow;
+    size_t width;
+    size_t height;
+};
+
+typedef struct BlurEngineYUVImage BlurEngineYUVImage_t;
+
+// Kernels used to convolve one line (the hot loop)
+typedef enum {
+    BlurEngineBackendScalar = 0,
+    BlurEngineBackendSSE2,
+    BlurEngineBackendAVX2, // With FMA
+    BlurEngineBackendNEON,
+} BlurEngineBackend_t;
+
+typedef struct BlurEngine BlurEngine_t;
+
+// Engine memory management
+BlurEngine_t * createBlurEngine(void);
+void releaseBlurEngine(BlurEngine_t * blurEngine);
+
+// Backend selection, the best available backend is used by default
+bool blurEngineBackendAvailable(BlurEngineBackend_t backend);
+BlurEngineBackend_t blurEngineBestBackend(void);
+BlurEngineBackend_t blurEngineBackend(const BlurEngine_t * blurEngine);
+bool blurEngineSetBackend(BlurEngine_t * blurEngine, BlurEngineBackend_t backend);
+
+// Worker pool used to run the stripes (not retained, must outlive the engine or be replaced), NULL runs everything on the calling thread
+// Returns false if the worker scratch memory couldn't be allocated
+bool blurEngineSetWorkerPool(BlurEngine_t * blurEngine, WorkerPool_t * workerPool);
+WorkerPool_t * blurEngineWorkerPool(const BlurEngine_t * blurEngine);
+
+// Filter kernel (bts offsets and weights, see LAUCaptureVideoPreviewLayerGaussianFilterKernel.h)
+void blurEngineSetFilterKernel(BlurEngine_t * blurEngine, unsigned int samples, const float * offsets, const float * weights);
+
+// Filter parameters, same meaning as _filterDownsamplingFactor and _filterMultiplePassCount (defaults are 4.0 and 2)
+void blurEngineSetFilterParameters(BlurEngine_t * blurEngine, float downsamplingFactor, unsigned int multiplePassCount);
+
+// Prefilter of the first pass, same as FilterPrefilterEnabled (default is false, 4 times the taps of the first pass)
+void blurEngineSetPrefilterEnabled(BlurEngine_t * blurEngine, bool prefilterEnabled);
+bool blurEnginePrefilterEnabled(const BlurEngine_t * blurEngine);
+
+// Dimensions of the filtered image for a given input and view (onscreen renderbuffer) size
+void blurEngineOutputDimensions(const BlurEngine_t * blurEngine, size_t inputWidth, size_t inputHeight, size_t viewWidth, size_t viewHeight, size_t * outputWidth, size_t * outputHeight);
+
+// Filter the input image. The output image must have the dimensions returned by blurEngineOutputDimensions
+// Returns false if the dimensions don't match or memory couldn't be allocated
+bool blurEngineFilterImage(BlurEngine_t * blurEngine, const BlurEngineImage_t * inputImage, size_t viewWidth, size_t viewHeight, BlurEngineImage_t * outputImage);
+
+// Filter a 420 bi-planar image, same as drawPixelBuffer: with FilterYUVInputEnabled
+// The luma plane is filtered like a BGRA image (B = G = R = Y), the chroma plane like a BGRA image (B = G = R = Cb, A = Cr)
+// with twice the downsampling factor and half the kernel offsets (the same blur radius in view pixels as the luma plane).
+// Both are converted to BGRA (full range BT.601) with bilinear chroma upsampling.
+// The output image has the dimensions returned by blurEngineOutputDimensions for the luma plane
+bool blurEngineFilterYUVImage(BlurEngine_t * blurEngine, const BlurEngineYUVImage_t * inputImage, size_t viewWidth, size_t viewHeight, BlurEngineImage_t * outputImage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAUCaptureVideoPreviewLayerBlurEngine_h */
@@ -0,0 +1,325 @@
+/*
+
+ LAUCaptureVideoPreviewLayerFilterPlanner.c
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#include "LAUCaptureVideoPreviewLayerFilterPlanner.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bisection steps of filterPlannerKernelSigma
+#define kFilterPlannerSolverIterations 32
+
+const FilterPlannerParameters_t kFilterPlannerDefaultParameters = {
+    .downsamplingFactors = {1.0f, 1.5f, 2.0f, 3.0f, 4.0f, 6.0f, 8.0f},
+    .downsamplingFactorCount = 7,
+    .maxPassCount = 3,
+    .maxError = 0.05f,
+    .kernelType = GaussianFilterKernelTypeBts,
+    .prefilterEnabled = true,
+};
+
+#pragma mark -
+#pragma mark Variance
+
+// Variance (offscreen pixels^2) of the truncated and normalized kernel
+static double kernelVariance(float sigma, float truncation)
+{
+    unsigned int size = gaussianFilterSizeForSigma(sigma, truncation);
+    long radius = gaussianFilterRadiusForSize(size);
+    float weights[size];
+    generateDtsGaussianFilterWeights(sigma, size, weights);
+
+    double variance = 0.0;
+    for (long i = 0; i < (long)size; ++i)
+    {
+        variance += weights[i] * (double)((i - radius) * (i - radius));
+    }
+
+    return variance;
+}
+
+// Variance (view pixels^2) of the bilinear downsampling and upsampling, phase averaged
+// A tent of half width a has a variance of a^2/6. The pixel buffer pixels are assumed to have the size of the view pixels.
+// The prefilter averages 2 bilinear taps at +/- a quarter of a texel (downsamplingFactor/4 pixels) on each axis.
+static double samplingVariance(float downsamplingFactor, bool prefilterEnabled)
+{
+    double variance = 0.0;
+
+    if (downsamplingFactor > 1.0f)
+    {
+        variance = (downsamplingFactor * downsamplingFactor + 1.0) / 6.0;
+    }
+    else if (prefilterEnabled)
+    {
+        variance = (1.0 - downsamplingFactor / 4.0) * downsamplingFactor / 4.0; // The taps are off the pixel centers
+    }
+    // else: texels and pixels are aligned, nothing is interpolated
+
+    if (prefilterEnabled)
+    {
+        variance += downsamplingFactor * downsamplingFactor / 16.0;
+    }
+
+    return variance;
+}
+
+float filterPlannerEffectiveSigma(const FilterPlannerParameters_t * parameters, const GaussianFilterKernelParameters_t * kernelParameters, float downsamplingFactor, unsigned int multiplePassCount, float kernelSigma)
+{
+    // Each pass adds the variance of the kernel, scaled by the downsampling factor
+    double variance = multiplePassCount * kernelVariance(kernelSigma, kernelParameters->truncation) * downsamplingFactor * downsamplingFactor;
+    return (float)sqrt(variance + samplingVariance(downsamplingFactor, parameters->prefilterEnabled));
+}
+
+float filterPlannerKernelSigma(const FilterPlannerParameters_t * parameters, const GaussianFilterKernelParameters_t * kernelParameters, float downsamplingFactor, unsigned int multiplePassCount, float targetSigma)
+{
+    float minSigma = fminf(kernelParameters->minSigma, kernelParameters->maxSigma);
+    float maxSigma = fmaxf(kernelParameters->minSigma, kernelParameters->maxSigma);
+
+    // Variance left for the kernel of one pass, in offscreen pixels
+    double kernelVarianceTarget = (targetSigma * targetSigma - samplingVariance(downsamplingFactor, parameters->prefilterEnabled)) / (multiplePassCount * downsamplingFactor * downsamplingFactor);
+
+    if (kernelVarianceTarget <= kernelVariance(minSigma, kernelParameters->truncation))
+    {
+        return minSigma;
+    }
+
+    if (kernelVarianceTarget >= kernelVariance(maxSigma, kernelParameters->truncation))
+    {
+        return maxSigma;
+    }
+
+    // The variance grows with sigma (and jumps up when the kernel gets more taps)
+    for (unsigned int i = 0; i < kFilterPlannerSolverIterations; ++i)
+    {
+        float sigma = 0.5f * (minSigma + maxSigma);
+
+        if (kernelVariance(sigma, kernelParameters->truncation) < kernelVarianceTarget)
+        {
+            minSigma = sigma;
+        }
+        else
+        {
+            maxSigma = sigma;
+        }
+    }
+
+    return 0.5f * (minSigma + maxSigma);
+}
+
+#pragma mark -
+#pragma mark Response
+
+// Center of the offscreen texel t in view pixels (texels cover downsamplingFactor pixels)
+static inline double texelCenter(long t, double downsamplingFactor)
+{
+    return (t + 0.5) * downsamplingFactor - 0.5;
+}
+
+// Bilinear weight of a sample at a distance, in units of the sampled texels
+static inline double bilinearWeight(double distance)
+{
+    return fmax(0.0, 1.0 - fabs(distance));
+}
+
+// Worst total variation distance, over the pixel phases, between the response of the chain and the gaussian
+// The response of the view pixel y to the pixel buffer pixel x goes through
+// - the bilinear sample of the pixel buffer at the center of each offscreen texel j (prefilter: 2 samples at +/- a quarter texel)
+// - the kernel applied multiplePassCount times, from texel j to texel t
+// - the bilinear sample of the offscreen texture at the center of pixel y (onscreen pass)
+static float responseError(const FilterPlannerParameters_t * parameters, const GaussianFilterKernelParameters_t * kernelParameters, float downsamplingFactor, unsigned int multiplePassCount, float kernelSigma, float targetSigma)
+{
+    unsigned int size = gaussianFilterSizeForSigma(kernelSigma, kernelParameters->truncation);
+    long radius = gaussianFilterRadiusForSize(size);
+    float weights[size];
+    generateDtsGaussianFilterWeights(kernelSigma, size, weights);
+
+    // Kernel applied multiplePassCount times (offscreen texels)
+    long chainRadius = multiplePassCount * radius;
+    long chainSize = 2 * chainRadius + 1;
+    double * chain = (double *)calloc(chainSize, sizeof(double));
+    double * convolved = (double *)calloc(chainSize, sizeof(double));
+    chain[chainRadius] = 1.0;
+
+    for (unsigned int p = 0; p < multiplePassCount; ++p)
+    {
+        memset(convolved, 0, chainSize * sizeof(double));
+        for (long i = 0; i < chainSize; ++i)
+        {
+            for (long k = 0; k < (long)size && chain[i] != 0.0; ++k)
+            {
+                long j = i + k - radius;
+                if (j >= 0 && j < chainSize)
+                {
+                    convolved[j] += chain[i] * weights[k];
+                }
+            }
+        }
+        memcpy(chain, convolved, chainSize * sizeof(double));
+    }
+
+    // Pixels around y reached by the chain, and the gaussian tails
+    double d = downsamplingFactor;
+    long chainPixelRadius = (long)ceil((chainRadius + 2) * d) + 2;
+    double prefilterOffsets[2] = {0.0, 0.0};
+    unsigned int prefilterTaps = 1;
+    if (parameters->prefilterEnabled)
+    {
+        prefilterOffsets[0] = -0.25 * d;
+        prefilterOffsets[1] = 0.25 * d;
+        prefilterTaps = 2;
+    }
+    long gaussianPixelRadius = (long)ceilf(4.0f * targetSigma) + 1;
+    long pixelRadius = chainPixelRadius > gaussianPixelRadius ? chainPixelRadius : gaussianPixelRadius;
+    long pixelCount = 2 * pixelRadius + 1;
+    double * response = (double *)malloc(pixelCount * sizeof(double));
+
+    double gaussianSum = 0.0;
+    for (long x = -pixelRadius; x <= pixelRadius; ++x)
+    {
+        gaussianSum += exp(-(double)(x * x) / (2.0 * targetSigma * targetSigma));
+    }
+
+    // The phase of the pixels repeats with the texels, every pixel of 2 texels covers all the phases
+    double maxDistance = 0.0;
+    long phaseCount = (long)ceil(2.0 * d);
+
+    for (long y = 0; y < phaseCount; ++y)
+    {
+        memset(response, 0, pixelCount * sizeof(double));
+
+        // Texels sampled by the onscreen pass
+        long firstTexel = (long)floor((y + 0.5) / d - 0.5) - 1;
+        for (long t = firstTexel; t <= firstTexel + 3; ++t)
+        {
+            double onscreenWeight = bilinearWeight((y - texelCenter(t, d)) / (d > 1.0 ? d : 1.0));
+            if (onscreenWeight == 0.0)
+            {
+                continue;
+            }
+
+            for (long j = t - chainRadius; j <= t + chainRadius; ++j)
+            {
+                double weight = onscreenWeight * chain[j - t + chainRadius] / prefilterTaps;
+
+                // Pixels sampled by the first pass around the center of texel j
+                for (unsigned int tap = 0; tap < prefilterTaps; ++tap)
+                {
+                    double center = texelCenter(j, d) + prefilterOffsets[tap];
+                    for (long x = (long)floor(center); x <= (long)floor(center) + 1; ++x)
+                    {
+                        long index = x - y + pixelRadius;
+                        if (index >= 0 && index < pixelCount)
+                        {
+                            response[index] += weight * bilinearWeight(center - x);
+                        }
+                    }
+                }
+            }
+        }
+
+        double distance = 0.0;
+        for (long x = -pixelRadius; x <= pixelRadius; ++x)
+        {
+            double gaussian = exp(-(double)(x * x) / (2.0 * targetSigma * targetSigma)) / gaussianSum;
+            distance += fabs(response[x + pixelRadius] - gaussian);
+        }
+
+        maxDistance = fmax(maxDistance, 0.5 * distance);
+    }
+
+    free(chain);
+    free(convolved);
+    free(response);
+
+    return (float)maxDistance;
+}
+
+#pragma mark -
+#pragma mark Plans
+
+void filterPlannerEvaluate(const FilterPlannerParameters_t * parameters, const GaussianFilterKernelParameters_t * kernelParameters, float downsamplingFactor, unsigned int multiplePassCount, float kernelSigma, float targetSigma, FilterPlan_t * plan)
+{
+    unsigned int kernelSize = gaussianFilterSizeForSigma(kernelSigma, kernelParameters->truncation);
+    unsigned int kernelSamples = btsGaussianFilterSamplesForSize(kernelSize);
+
+    // Two split-passes per pass at 1/downsamplingFactor^2 of the view pixels, then one fetch onscreen
+    // The prefiltered first split-pass fetches 4 texels per sample
+    float passFetches = (parameters->kernelType == GaussianFilterKernelTypeBts) ? 2.0f * kernelSamples : (float)kernelSize;
+    float splitPassCount = 2.0f * multiplePassCount + (parameters->prefilterEnabled ? 3.0f : 0.0f);
+
+    plan->downsamplingFactor = downsamplingFactor;
+    plan->multiplePassCount = multiplePassCount;
+    plan->kernelSigma = kernelSigma;
+    plan->kernelSize = kernelSize;
+    plan->kernelSamples = kernelSamples;
+    plan->targetSigma = targetSigma;
+    plan->effectiveSigma = filterPlannerEffectiveSigma(parameters, kernelParameters, downsamplingFactor, multiplePassCount, kernelSigma);
+    plan->error = responseError(parameters, kernelParameters, downsamplingFactor, multiplePassCount, kernelSigma, targetSigma);
+    plan->fetchesPerPixel = splitPassCount * passFetches / (downsamplingFactor * downsamplingFactor) + 1.0f;
+}
+
+bool filterPlannerPlanForSigma(const FilterPlannerParameters_t * parameters, const GaussianFilterKernelParameters_t * kernelParameters, float targetSigma, FilterPlan_t * plan)
+{
+    bool planned = false;
+    bool evaluated = false;
+
+    for (unsigned int d = 0; d < parameters->downsamplingFactorCount && d < kFilterPlannerMaxDownsamplingFactorCount; ++d)
+    {
+        float downsamplingFactor = parameters->downsamplingFactors[d];
+
+        for (unsigned int multiplePassCount = 1; multiplePassCount <= parameters->maxPassCount; ++multiplePassCount)
+        {
+            FilterPlan_t candidate;
+            float kernelSigma = filterPlannerKernelSigma(parameters, kernelParameters, downsamplingFactor, multiplePassCount, targetSigma);
+            filterPlannerEvaluate(parameters, kernelParameters, downsamplingFactor, multiplePassCount, kernelSigma, targetSigma, &candidate);
+
+            bool accepted = candidate.error <= parameters->maxError;
+            bool better = false;
+
+            if (accepted)
+            {
+                // Fewest fetches, the smallest error between candidates with the same cost
+                better = !planned || candidate.fetchesPerPixel < plan->fetchesPerPixel ||
+                         (candidate.fetchesPerPixel == plan->fetchesPerPixel && candidate.error < plan->error);
+            }
+            else if (!planned)
+            {
+                better = !evaluated || candidate.error < plan->error;
+            }
+
+            if (better)
+            {
+                *plan = candidate;
+                planned = planned || accepted;
+            }
+
+            evaluated = true;
+        }
+    }
+
+    return planned;
+}
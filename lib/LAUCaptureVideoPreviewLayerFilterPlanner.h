@@ -0,0 +1,104 @@
+/*
+
+ LAUCaptureVideoPreviewLayerFilterPlanner.h
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#ifndef LAUCaptureVideoPreviewLayerFilterPlanner_h
+#define LAUCaptureVideoPreviewLayerFilterPlanner_h
+
+#include <stdbool.h>
+
+#include "LAUCaptureVideoPreviewLayerGaussianFilterKernel.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Pass planner, picks the filter parameters (downsampling factor, pass count and kernel sigma)
+ that blur with a target std. deviation for the fewest texture fetches
+
+ The blur of a chain, in view (onscreen) pixels, is the sum of the variances of
+ - the bilinear downsampling of the pixel buffer (tent of 1 pixel), averaged over 2 taps at +/- downsamplingFactor/4 pixels
+   on each axis if prefilterEnabled (see FilterPrefilterEnabled)
+ - the multiplePassCount kernels (2 split-passes each) at 1/downsamplingFactor resolution
+ - the bilinear upsampling of the onscreen pass (tent of downsamplingFactor pixels)
+ The kernel sigma is solved from the variance of the truncated (normalized) kernel, not from its sigma,
+ so kernels with few taps still add the right amount of blur.
+
+ Every plan is checked against the ideal gaussian: the discrete response of the chain is built for each phase of the
+ view pixels within the offscreen texels (the first pass reads the pixel buffer at the texel centers, the onscreen pass
+ interpolates the texels) and the error is the largest total variation distance to the gaussian, 0.5 * sum |response - gaussian|
+ in [0,1]. The plan is the cheapest candidate with an error under maxError. The fixed parameters of the layer
+ (downsampling factor 4, 2 passes) are one of the candidates and can be evaluated with filterPlannerEvaluate.
+ */
+
+#define kFilterPlannerMaxDownsamplingFactorCount 16
+
+struct FilterPlannerParameters {
+    float downsamplingFactors[kFilterPlannerMaxDownsamplingFactorCount]; // Candidates, multiples of 0.25
+    unsigned int downsamplingFactorCount;
+    unsigned int maxPassCount; // Candidates 1 ... maxPassCount
+    float maxError; // Largest total variation distance to the ideal gaussian
+    GaussianFilterKernelType_t kernelType; // Fetches per pass: 2 * samples (bts) or size (dts)
+    bool prefilterEnabled; // The first pass fetches 4 texels per sample (only with bts kernel variants)
+};
+
+typedef struct FilterPlannerParameters FilterPlannerParameters_t;
+
+// Downsampling factors 1, 1.5, 2, 3, 4, 6 and 8, up to 3 passes, 5% error, bts kernels with the prefilter
+extern const FilterPlannerParameters_t kFilterPlannerDefaultParameters;
+
+struct FilterPlan {
+    float downsamplingFactor; // _filterDownsamplingFactor
+    unsigned int multiplePassCount; // _filterMultiplePassCount
+    float kernelSigma; // Offscreen pixels, gaussianFilterStepForSigma gives the kernel step
+    unsigned int kernelSize; // m
+    unsigned int kernelSamples; // Bts samples per side
+    float targetSigma; // View pixels
+    float effectiveSigma; // View pixels, std. deviation of the chain
+    float error; // Total variation distance to the gaussian with the target sigma
+    float fetchesPerPixel; // Texture fetches per view pixel, offscreen passes and onscreen pass
+};
+
+typedef struct FilterPlan FilterPlan_t;
+
+// Kernel sigma (clamped to the sigma range of the kernel parameters) so that the chain blurs with targetSigma
+float filterPlannerKernelSigma(const FilterPlannerParameters_t * parameters, const GaussianFilterKernelParameters_t * kernelParameters, float downsamplingFactor, unsigned int multiplePassCount, float targetSigma);
+
+// Std. deviation (view pixels) of the chain with a kernel sigma
+float filterPlannerEffectiveSigma(const FilterPlannerParameters_t * parameters, const GaussianFilterKernelParameters_t * kernelParameters, float downsamplingFactor, unsigned int multiplePassCount, float kernelSigma);
+
+// Plan for a chain and a kernel sigma (ie. the fixed parameters of the layer), with the error for targetSigma
+void filterPlannerEvaluate(const FilterPlannerParameters_t * parameters, const GaussianFilterKernelParameters_t * kernelParameters, float downsamplingFactor, unsigned int multiplePassCount, float kernelSigma, float targetSigma, FilterPlan_t * plan);
+
+// Cheapest plan (fewest fetches per pixel) with an error under maxError, returns true
+// If no candidate is under maxError, the plan with the smallest error is returned and the result is false
+bool filterPlannerPlanForSigma(const FilterPlannerParameters_t * parameters, const GaussianFilterKernelParameters_t * kernelParameters, float targetSigma, FilterPlan_t * plan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAUCaptureVideoPreviewLayerFilterPlanner_h */
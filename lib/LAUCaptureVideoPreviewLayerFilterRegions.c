@@ -0,0 +1,168 @@
+/*
+
+ LAUCaptureVideoPreviewLayerFilterRegions.c
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#include "LAUCaptureVideoPreviewLayerFilterRegions.h"
+
+#include <math.h>
+#include <string.h>
+
+static bool rectContainsRect(const FilterRegionRect_t * rect, const FilterRegionRect_t * otherRect)
+{
+    return otherRect->x >= rect->x && otherRect->y >= rect->y &&
+           otherRect->x + otherRect->width <= rect->x + rect->width &&
+           otherRect->y + otherRect->height <= rect->y + rect->height;
+}
+
+size_t filterRegionsSetViewRects(FilterRegions_t * regions, const FilterRegionRect_t * rects, size_t count)
+{
+    memset(regions, 0, sizeof(FilterRegions_t));
+    
+    for (size_t i = 0; i < count && regions->count < kFilterRegionMaxCount; ++i)
+    {
+        // Clip to the view
+        float xMin = fmaxf(rects[i].x, 0.0f);
+        float yMin = fmaxf(rects[i].y, 0.0f);
+        float xMax = fminf(rects[i].x + rects[i].width, 1.0f);
+        float yMax = fminf(rects[i].y + rects[i].height, 1.0f);
+        
+        if (!(xMax > xMin && yMax > yMin))
+        {
+            continue;
+        }
+        
+        FilterRegionRect_t rect = { xMin, yMin, xMax - xMin, yMax - yMin };
+        bool contained = false;
+        
+        for (size_t j = 0; j < regions->count && !contained; ++j)
+        {
+            contained = rectContainsRect(&regions->viewRects[j], &rect);
+        }
+        
+        if (contained)
+        {
+            continue;
+        }
+        
+        // Drop the regions inside the new one
+        size_t keptCount = 0;
+        
+        for (size_t j = 0; j < regions->count; ++j)
+        {
+            if (!rectContainsRect(&rect, &regions->viewRects[j]))
+            {
+                regions->viewRects[keptCount++] = regions->viewRects[j];
+            }
+        }
+        
+        regions->viewRects[keptCount++] = rect;
+        regions->count = keptCount;
+    }
+    
+    // Identity until mapped to a texture
+    memcpy(regions->textureRects, regions->viewRects, sizeof(regions->viewRects));
+    
+    return regions->count;
+}
+
+void filterRegionsMapToTexture(FilterRegions_t * regions, float textureWidth, float textureHeight, float viewWidth, float viewHeight)
+{
+    if (regions->count == 0 || textureWidth <= 0.0f || textureHeight <= 0.0f || viewWidth <= 0.0f || viewHeight <= 0.0f)
+    {
+        return;
+    }
+    
+    // Same offsets as onscreenTextureCoordinatesOffsetsForTextureInstance: (landscape texture rotated 90 degrees, aspect-fill)
+    float textureScale = (textureWidth / textureHeight > viewHeight / viewWidth) ? viewWidth / textureHeight : viewHeight / textureWidth;
+    float deltaS = (textureWidth * textureScale - viewHeight) / (textureWidth * textureScale) / 2.0f;
+    float deltaT = (textureHeight * textureScale - viewWidth) / (textureHeight * textureScale) / 2.0f;
+    
+    // The view rows (top to bottom) are the texture columns S, the view columns (left to right) are the texture rows T (top to bottom)
+    for (size_t i = 0; i < regions->count; ++i)
+    {
+        const FilterRegionRect_t * viewRect = &regions->viewRects[i];
+        FilterRegionRect_t * textureRect = &regions->textureRects[i];
+        
+        textureRect->x = deltaS + viewRect->y * (1.0f - 2.0f * deltaS);
+        textureRect->width = viewRect->height * (1.0f - 2.0f * deltaS);
+        textureRect->y = (1.0f - deltaT) - (viewRect->x + viewRect->width) * (1.0f - 2.0f * deltaT);
+        textureRect->height = viewRect->width * (1.0f - 2.0f * deltaT);
+    }
+}
+
+float filterRegionsPassMargin(unsigned int remainingPassCount, unsigned int kernelRadius)
+{
+    return (float)remainingPassCount * (float)(kernelRadius + 1) + 1.0f;
+}
+
+static FilterRegionBox_t clippedBox(float xMin, float yMin, float xMax, float yMax, float width, float height)
+{
+    // glViewport truncates the float texture dimensions
+    float maxX = floorf(width);
+    float maxY = floorf(height);
+    
+    xMin = fminf(fmaxf(xMin, 0.0f), maxX);
+    yMin = fminf(fmaxf(yMin, 0.0f), maxY);
+    xMax = fminf(fmaxf(xMax, xMin), maxX);
+    yMax = fminf(fmaxf(yMax, yMin), maxY);
+    
+    FilterRegionBox_t box = { (int)xMin, (int)yMin, (int)(xMax - xMin), (int)(yMax - yMin) };
+    return box;
+}
+
+FilterRegionBox_t filterRegionsTextureBox(const FilterRegions_t * regions, size_t index, float width, float height, float margin)
+{
+    const FilterRegionRect_t * rect = &regions->textureRects[index];
+    
+    return clippedBox(floorf(rect->x * width - margin), floorf(rect->y * height - margin),
+                      ceilf((rect->x + rect->width) * width + margin), ceilf((rect->y + rect->height) * height + margin),
+                      width, height);
+}
+
+FilterRegionBox_t filterRegionsViewBox(const FilterRegions_t * regions, size_t index, float width, float height)
+{
+    const FilterRegionRect_t * rect = &regions->viewRects[index];
+    
+    return clippedBox(roundf(rect->x * width), roundf((1.0f - rect->y - rect->height) * height),
+                      roundf((rect->x + rect->width) * width), roundf((1.0f - rect->y) * height),
+                      width, height);
+}
+
+float filterRegionsArea(const FilterRegions_t * regions)
+{
+    if (regions->count == 0)
+    {
+        return 1.0f;
+    }
+    
+    float area = 0.0f;
+    
+    for (size_t i = 0; i < regions->count; ++i)
+    {
+        area += regions->viewRects[i].width * regions->viewRects[i].height;
+    }
+    
+    return area;
+}
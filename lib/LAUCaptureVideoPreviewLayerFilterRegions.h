@@ -0,0 +1,101 @@
+/*
+
+ LAUCaptureVideoPreviewLayerFilterRegions.h
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#ifndef LAUCaptureVideoPreviewLayerFilterRegions_h
+#define LAUCaptureVideoPreviewLayerFilterRegions_h
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Regions of the view that are blurred, the rest of the frame is copied unfiltered
+
+ - Regions are rects in normalized view coordinates (origin at the top left, y down), clipped to the view
+ - Each region is mapped to the texture coordinates of the offscreen passes: the landscape texture is rotated
+   90 degrees and aspect-filled, same mapping as the onscreen texture coordinates
+ - A split-pass only needs to write the texels read by the passes after it: the scissor box of a pass is the region
+   expanded by the kernel radius of each remaining pass (filterRegionsPassMargin), so the cost follows the blurred area
+ - Regions inside another region are dropped, overlapping regions are drawn twice in the overlap (same result)
+ */
+
+#define kFilterRegionMaxCount 16
+
+struct FilterRegionRect {
+    float x;
+    float y;
+    float width;
+    float height;
+};
+
+typedef struct FilterRegionRect FilterRegionRect_t;
+
+// Scissor box in pixels, origin at the bottom left (glScissor)
+struct FilterRegionBox {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+typedef struct FilterRegionBox FilterRegionBox_t;
+
+struct FilterRegions {
+    size_t count; // 0 means the whole frame is blurred
+    FilterRegionRect_t viewRects[kFilterRegionMaxCount]; // Normalized view coordinates (origin at the top left)
+    FilterRegionRect_t textureRects[kFilterRegionMaxCount]; // Normalized texture coordinates (origin at the bottom left), see filterRegionsMapToTexture
+};
+
+typedef struct FilterRegions FilterRegions_t;
+
+// Sets the regions from normalized view rects, empty rects (after clipping) and rects inside another one are dropped
+// Returns the number of regions kept, at most kFilterRegionMaxCount
+size_t filterRegionsSetViewRects(FilterRegions_t * regions, const FilterRegionRect_t * rects, size_t count);
+
+// Maps the view rects to the texture rects for a texture of textureWidth x textureHeight drawn in a view of viewWidth x viewHeight
+// Same rotation and aspect-fill as onscreenTextureCoordinatesOffsetsForTextureInstance: (the result only depends on the ratios)
+void filterRegionsMapToTexture(FilterRegions_t * regions, float textureWidth, float textureHeight, float viewWidth, float viewHeight);
+
+// Texels read around a region by the remaining split-passes, each one reads kernelRadius texels on both sides (plus one for the linear filtering)
+float filterRegionsPassMargin(unsigned int remainingPassCount, unsigned int kernelRadius);
+
+// Scissor box of a texture rect in a texture of width x height texels, expanded by margin texels, rounded outwards and clipped
+FilterRegionBox_t filterRegionsTextureBox(const FilterRegions_t * regions, size_t index, float width, float height, float margin);
+
+// Scissor box of a view rect in a renderbuffer of width x height pixels (the y axis is flipped), edges rounded to the nearest pixel
+FilterRegionBox_t filterRegionsViewBox(const FilterRegions_t * regions, size_t index, float width, float height);
+
+// Fraction of the view covered by the regions, overlaps are counted twice (1 if there is no region)
+float filterRegionsArea(const FilterRegions_t * regions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAUCaptureVideoPreviewLayerFilterRegions_h */
@@ -0,0 +1,302 @@
+/*
+
+ LAUCaptureVideoPreviewLayerFrameQueue.c
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "LAUCaptureVideoPreviewLayerFrameQueue.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ Ring buffer with monotonic head/tail indexes (no ABA, slot = index % depth)
+
+ - tail is only written by the producer
+ - head is advanced with compare-and-swap by the consumer (take) and by the producer (drop oldest)
+   whoever wins the compare-and-swap owns the frames between the old and new head
+ - A slot is only rewritten by the producer after head moved past it, so a reader that loaded
+   a slot and then lost the compare-and-swap never uses what it loaded
+ */
+
+struct FrameQueueSlot {
+    _Atomic(const void *) frame;
+    _Atomic(double) timestamp;
+};
+
+typedef struct FrameQueueSlot FrameQueueSlot_t;
+
+struct FrameQueue {
+
+    unsigned int depth;
+    FrameQueuePolicy_t policy;
+    FrameQueueRetainCallback retain;
+    FrameQueueReleaseCallback release;
+
+    FrameQueueSlot_t * slots;
+    _Atomic(uint64_t) head;
+    _Atomic(uint64_t) tail;
+
+    // Counters (producer and consumer)
+    atomic_ulong enqueuedFrameCount;
+    atomic_ulong droppedFrameCount;
+    atomic_ulong takenFrameCount;
+
+    // Consumer only
+    const void * currentFrame; // Last frame taken
+    const void ** skippedFrames; // Frames skipped by FrameQueuePolicyLatestOnly
+    double lastFrameAge;
+    double totalFrameAge;
+    double maxFrameAge;
+};
+
+#pragma mark -
+#pragma mark Memory management
+
+FrameQueue_t * createFrameQueue(unsigned int depth, FrameQueuePolicy_t policy, FrameQueueRetainCallback retain, FrameQueueReleaseCallback release)
+{
+    assert(depth > 0);
+
+    FrameQueue_t * queue = calloc(1, sizeof(FrameQueue_t));
+
+    if (!queue)
+    {
+        return NULL;
+    }
+
+    queue->depth = depth;
+    queue->policy = policy;
+    queue->retain = retain;
+    queue->release = release;
+    queue->slots = calloc(depth, sizeof(FrameQueueSlot_t));
+    queue->skippedFrames = calloc(depth, sizeof(const void *));
+
+    if (!queue->slots || !queue->skippedFrames)
+    {
+        free(queue->slots);
+        free(queue->skippedFrames);
+        free(queue);
+        return NULL;
+    }
+
+    for (unsigned int i = 0; i < depth; ++i)
+    {
+        atomic_init(&queue->slots[i].frame, NULL);
+        atomic_init(&queue->slots[i].timestamp, 0.0);
+    }
+
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->enqueuedFrameCount, 0);
+    atomic_init(&queue->droppedFrameCount, 0);
+    atomic_init(&queue->takenFrameCount, 0);
+
+    return queue;
+}
+
+void releaseFrameQueue(FrameQueue_t * queue)
+{
+    if (!queue)
+    {
+        return;
+    }
+
+    frameQueueFlush(queue);
+    free(queue->slots);
+    free(queue->skippedFrames);
+    free(queue);
+}
+
+unsigned int frameQueueDepth(const FrameQueue_t * queue)
+{
+    return queue->depth;
+}
+
+FrameQueuePolicy_t frameQueuePolicy(const FrameQueue_t * queue)
+{
+    return queue->policy;
+}
+
+#pragma mark -
+#pragma mark Producer
+
+bool frameQueueEnqueueFrame(FrameQueue_t * queue, const void * frame, double timestamp)
+{
+    if (!frame)
+    {
+        return true;
+    }
+
+    bool droppedFrame = false;
+    uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    while (tail - head >= queue->depth)
+    {
+        if (queue->policy == FrameQueuePolicyBoundedFIFO)
+        {
+            // Full, keep the queued frames
+            atomic_fetch_add_explicit(&queue->enqueuedFrameCount, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&queue->droppedFrameCount, 1, memory_order_relaxed);
+            return false;
+        }
+
+        // Full, drop the oldest frame unless the consumer takes it first
+        const void * oldestFrame = atomic_load_explicit(&queue->slots[head % queue->depth].frame, memory_order_relaxed);
+
+        if (atomic_compare_exchange_weak_explicit(&queue->head, &head, head + 1, memory_order_acq_rel, memory_order_acquire))
+        {
+            queue->release(oldestFrame);
+            atomic_fetch_add_explicit(&queue->droppedFrameCount, 1, memory_order_relaxed);
+            droppedFrame = true;
+            break;
+        }
+    }
+
+    queue->retain(frame);
+
+    FrameQueueSlot_t * slot = &queue->slots[tail % queue->depth];
+    atomic_store_explicit(&slot->frame, frame, memory_order_relaxed);
+    atomic_store_explicit(&slot->timestamp, timestamp, memory_order_relaxed);
+
+    // Publish the slot
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    atomic_fetch_add_explicit(&queue->enqueuedFrameCount, 1, memory_order_relaxed);
+
+    return !droppedFrame;
+}
+
+#pragma mark -
+#pragma mark Consumer
+
+const void * frameQueueTakeFrame(FrameQueue_t * queue, double now, double * timestamp)
+{
+    uint64_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    for (;;)
+    {
+        uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+        // Cheap check first, the display link is usually faster than the camera
+        if (head == tail)
+        {
+            return NULL;
+        }
+
+        // The producer dropped the oldest frames since head was loaded
+        if (tail - head > queue->depth)
+        {
+            head = atomic_load_explicit(&queue->head, memory_order_acquire);
+            continue;
+        }
+
+        // Latest only takes every queued frame and keeps the newest
+        uint64_t newHead = (queue->policy == FrameQueuePolicyLatestOnly) ? tail : head + 1;
+        unsigned int skippedFrameCount = (unsigned int)(newHead - head - 1);
+
+        FrameQueueSlot_t * slot = &queue->slots[(newHead - 1) % queue->depth];
+        const void * frame = atomic_load_explicit(&slot->frame, memory_order_relaxed);
+        double frameTimestamp = atomic_load_explicit(&slot->timestamp, memory_order_relaxed);
+
+        for (unsigned int i = 0; i < skippedFrameCount; ++i)
+        {
+            queue->skippedFrames[i] = atomic_load_explicit(&queue->slots[(head + i) % queue->depth].frame, memory_order_relaxed);
+        }
+
+        if (!atomic_compare_exchange_weak_explicit(&queue->head, &head, newHead, memory_order_acq_rel, memory_order_acquire))
+        {
+            // The producer dropped the oldest frame, try again
+            continue;
+        }
+
+        for (unsigned int i = 0; i < skippedFrameCount; ++i)
+        {
+            queue->release(queue->skippedFrames[i]);
+        }
+
+        // Ownership of the frame moves from the queue to the consumer
+        if (queue->currentFrame)
+        {
+            queue->release(queue->currentFrame);
+        }
+
+        queue->currentFrame = frame;
+
+        // Counters
+        double frameAge = now - frameTimestamp;
+        unsigned long takenFrameCount = atomic_fetch_add_explicit(&queue->takenFrameCount, 1, memory_order_relaxed) + 1;
+        atomic_fetch_add_explicit(&queue->droppedFrameCount, skippedFrameCount, memory_order_relaxed);
+        queue->lastFrameAge = frameAge;
+        queue->totalFrameAge += frameAge;
+        queue->maxFrameAge = (takenFrameCount == 1 || frameAge > queue->maxFrameAge) ? frameAge : queue->maxFrameAge;
+
+        if (timestamp)
+        {
+            *timestamp = frameTimestamp;
+        }
+
+        return frame;
+    }
+}
+
+void frameQueueFlush(FrameQueue_t * queue)
+{
+    uint64_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    // Take the queued frames one at a time, the producer may drop the oldest meanwhile
+    while (head < tail)
+    {
+        const void * frame = atomic_load_explicit(&queue->slots[head % queue->depth].frame, memory_order_relaxed);
+
+        if (atomic_compare_exchange_weak_explicit(&queue->head, &head, head + 1, memory_order_acq_rel, memory_order_acquire))
+        {
+            queue->release(frame);
+            atomic_fetch_add_explicit(&queue->droppedFrameCount, 1, memory_order_relaxed);
+            head++;
+        }
+    }
+
+    if (queue->currentFrame)
+    {
+        queue->release(queue->currentFrame);
+        queue->currentFrame = NULL;
+    }
+}
+
+void frameQueueStatistics(const FrameQueue_t * queue, FrameQueueStatistics_t * statistics)
+{
+    uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    uint64_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    statistics->enqueuedFrameCount = atomic_load_explicit(&queue->enqueuedFrameCount, memory_order_relaxed);
+    statistics->droppedFrameCount = atomic_load_explicit(&queue->droppedFrameCount, memory_order_relaxed);
+    statistics->takenFrameCount = atomic_load_explicit(&queue->takenFrameCount, memory_order_relaxed);
+    statistics->queuedFrameCount = (unsigned int)(tail > head ? tail - head : 0);
+    statistics->lastFrameAge = queue->lastFrameAge;
+    statistics->averageFrameAge = statistics->takenFrameCount ? queue->totalFrameAge / statistics->takenFrameCount : 0.0;
+    statistics->maxFrameAge = queue->maxFrameAge;
+}
@@ -0,0 +1,97 @@
+/*
+
+ LAUCaptureVideoPreviewLayerFrameQueue.h
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef LAUCaptureVideoPreviewLayerFrameQueue_h
+#define LAUCaptureVideoPreviewLayerFrameQueue_h
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Frame queue between one producer (capture queue) and one consumer (display link)
+
+ - The producer enqueues frames with a timestamp (ie. presentation time of the sample buffer)
+ - The consumer takes a frame, which stays retained by the queue until the next take or flush
+ - What happens when the queue is full, or has more than one frame, depends on the policy
+ - Both sides only use atomic operations, there are no locks and neither side waits for the other
+
+ Frames are opaque pointers (ie. CMSampleBufferRef) retained and released with the callbacks.
+ */
+
+typedef enum {
+    FrameQueuePolicyLatestOnly = 0, // Take the newest frame, older frames are dropped. The oldest frame is dropped when full
+    FrameQueuePolicyBoundedFIFO, // Take frames in order. New frames are dropped when full
+    FrameQueuePolicyDropOldest, // Take frames in order. The oldest frame is dropped when full
+} FrameQueuePolicy_t;
+
+// Counters since the queue was created
+struct FrameQueueStatistics {
+    unsigned long enqueuedFrameCount; // Frames passed to frameQueueEnqueueFrame (enqueued = dropped + taken + queued)
+    unsigned long droppedFrameCount; // Frames released without being taken
+    unsigned long takenFrameCount; // Frames taken by the consumer
+    unsigned int queuedFrameCount; // Frames waiting to be taken
+    double lastFrameAge; // Time between the timestamp and the take of the last frame taken
+    double averageFrameAge;
+    double maxFrameAge;
+};
+
+typedef struct FrameQueueStatistics FrameQueueStatistics_t;
+
+typedef const void * (*FrameQueueRetainCallback)(const void * frame);
+typedef void (*FrameQueueReleaseCallback)(const void * frame);
+
+typedef struct FrameQueue FrameQueue_t;
+
+// Queue memory management, remaining frames are released. The depth must be at least 1
+FrameQueue_t * createFrameQueue(unsigned int depth, FrameQueuePolicy_t policy, FrameQueueRetainCallback retain, FrameQueueReleaseCallback release);
+void releaseFrameQueue(FrameQueue_t * queue);
+
+unsigned int frameQueueDepth(const FrameQueue_t * queue);
+FrameQueuePolicy_t frameQueuePolicy(const FrameQueue_t * queue);
+
+// Producer: retain and enqueue the frame. Returns false if a frame was dropped (this one or an older one)
+bool frameQueueEnqueueFrame(FrameQueue_t * queue, const void * frame, double timestamp);
+
+// Consumer: next frame according to the policy, or NULL if there isn't a new frame
+// The frame is valid until the next call to frameQueueTakeFrame or frameQueueFlush
+// now is used to measure the age of the frame (same clock as the timestamps)
+const void * frameQueueTakeFrame(FrameQueue_t * queue, double now, double * timestamp);
+
+// Consumer: release the queued frames and the last frame taken
+void frameQueueFlush(FrameQueue_t * queue);
+
+// Consumer: current counters (the frame ages are only updated by the consumer)
+void frameQueueStatistics(const FrameQueue_t * queue, FrameQueueStatistics_t * statistics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAUCaptureVideoPreviewLayerFrameQueue_h */
@@ -0,0 +1,775 @@
+/*
+
+ LAUCaptureVideoPreviewLayerFrameRecording.c
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "LAUCaptureVideoPreviewLayerFrameRecording.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The chunks are copied as they are in memory (iOS and Linux targets are little-endian)
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "LAUCaptureVideoPreviewLayerFrameRecording needs a little-endian target"
+#endif
+
+#define kFrameRecordingMagic "LAUR"
+#define kFrameRecordingHeaderSize 8
+#define kFrameRecordingChunkHeaderSize 8
+#define kFrameRecordingFrameHeaderSize 24
+#define kFrameRecordingPlaneHeaderSize 12
+
+// Frame chunks kept for reuse by the recorder (avoids a large allocation per frame)
+#define kFrameRecorderFreeChunkCapacity 4
+
+#define FrameRecordingPadding(size) (((size) + 7) & ~(size_t)7)
+
+#pragma mark -
+#pragma mark Recorder
+
+struct FrameRecordingChunk {
+    struct FrameRecordingChunk * next;
+    size_t capacity;
+    size_t size; // Header, payload and padding
+    uint8_t * data;
+};
+
+typedef struct FrameRecordingChunk FrameRecordingChunk_t;
+
+struct FrameRecorder {
+
+    FILE * file;
+    pthread_t writerThread;
+    size_t maxPendingByteCount;
+    uint64_t nextFrameIndex; // Producer only
+
+    // Protected by the mutex
+    pthread_mutex_t mutex;
+    pthread_cond_t pendingCondition;
+    FrameRecordingChunk_t * pendingFront; // Written in order
+    FrameRecordingChunk_t * pendingBack;
+    FrameRecordingChunk_t * freeChunks;
+    unsigned int freeChunkCount;
+    bool shutdown;
+    FrameRecorderStatistics_t statistics;
+};
+
+static void writeUInt32(uint8_t ** cursor, uint32_t value)
+{
+    memcpy(*cursor, &value, sizeof(value));
+    *cursor += sizeof(value);
+}
+
+static void writeUInt64(uint8_t ** cursor, uint64_t value)
+{
+    memcpy(*cursor, &value, sizeof(value));
+    *cursor += sizeof(value);
+}
+
+static void writeFloat32(uint8_t ** cursor, float value)
+{
+    memcpy(*cursor, &value, sizeof(value));
+    *cursor += sizeof(value);
+}
+
+static void writeFloat64(uint8_t ** cursor, double value)
+{
+    memcpy(*cursor, &value, sizeof(value));
+    *cursor += sizeof(value);
+}
+
+static void releaseChunk(FrameRecordingChunk_t * chunk)
+{
+    if (chunk)
+    {
+        free(chunk->data);
+        free(chunk);
+    }
+}
+
+// Takes a free chunk large enough, or allocates one. Called with the mutex locked
+static FrameRecordingChunk_t * dequeueFreeChunk(FrameRecorder_t * recorder, size_t size)
+{
+    FrameRecordingChunk_t ** link = &recorder->freeChunks;
+    while (*link)
+    {
+        FrameRecordingChunk_t * chunk = *link;
+        if (chunk->capacity >= size)
+        {
+            *link = chunk->next;
+            --recorder->freeChunkCount;
+            chunk->next = NULL;
+            return chunk;
+        }
+        link = &chunk->next;
+    }
+
+    FrameRecordingChunk_t * chunk = calloc(1, sizeof(FrameRecordingChunk_t));
+    if (chunk)
+    {
+        chunk->data = malloc(size);
+        chunk->capacity = size;
+        if (!chunk->data)
+        {
+            free(chunk);
+            chunk = NULL;
+        }
+    }
+
+    return chunk;
+}
+
+// Called with the mutex locked
+static void enqueueFreeChunk(FrameRecorder_t * recorder, FrameRecordingChunk_t * chunk)
+{
+    if (recorder->freeChunkCount < kFrameRecorderFreeChunkCapacity)
+    {
+        chunk->next = recorder->freeChunks;
+        recorder->freeChunks = chunk;
+        ++recorder->freeChunkCount;
+    }
+    else
+    {
+        releaseChunk(chunk);
+    }
+}
+
+// Reserves a chunk of payloadSize bytes and writes its header, NULL if it doesn't fit the pending bytes (droppable chunks only)
+static FrameRecordingChunk_t * beginChunk(FrameRecorder_t * recorder, uint32_t type, size_t payloadSize, bool droppable, uint8_t ** cursor)
+{
+    size_t size = kFrameRecordingChunkHeaderSize + FrameRecordingPadding(payloadSize);
+    FrameRecordingChunk_t * chunk = NULL;
+
+    pthread_mutex_lock(&recorder->mutex);
+    bool fits = !droppable || recorder->statistics.pendingByteCount + size <= recorder->maxPendingByteCount;
+    if (!recorder->statistics.failed && fits && payloadSize <= UINT32_MAX)
+    {
+        chunk = dequeueFreeChunk(recorder, size);
+    }
+    if (chunk)
+    {
+        recorder->statistics.pendingByteCount += size;
+    }
+    pthread_mutex_unlock(&recorder->mutex);
+
+    if (!chunk)
+    {
+        return NULL;
+    }
+
+    chunk->size = size;
+    *cursor = chunk->data;
+    writeUInt32(cursor, type);
+    writeUInt32(cursor, (uint32_t)payloadSize);
+
+    // Zero the padding
+    memset(chunk->data + size - 8, 0, 8);
+
+    return chunk;
+}
+
+static void endChunk(FrameRecorder_t * recorder, FrameRecordingChunk_t * chunk)
+{
+    pthread_mutex_lock(&recorder->mutex);
+    if (recorder->pendingBack)
+    {
+        recorder->pendingBack->next = chunk;
+    }
+    else
+    {
+        recorder->pendingFront = chunk;
+    }
+    recorder->pendingBack = chunk;
+    pthread_cond_signal(&recorder->pendingCondition);
+    pthread_mutex_unlock(&recorder->mutex);
+}
+
+static void * frameRecorderWriterThread(void * context)
+{
+    FrameRecorder_t * recorder = context;
+
+    pthread_mutex_lock(&recorder->mutex);
+    for (;;)
+    {
+        while (!recorder->pendingFront && !recorder->shutdown)
+        {
+            pthread_cond_wait(&recorder->pendingCondition, &recorder->mutex);
+        }
+
+        // The pending chunks are written before the shutdown
+        FrameRecordingChunk_t * chunk = recorder->pendingFront;
+        if (!chunk)
+        {
+            break;
+        }
+
+        recorder->pendingFront = chunk->next;
+        recorder->pendingBack = recorder->pendingFront ? recorder->pendingBack : NULL;
+        bool failed = recorder->statistics.failed;
+        pthread_mutex_unlock(&recorder->mutex);
+
+        bool written = !failed && fwrite(chunk->data, 1, chunk->size, recorder->file) == chunk->size;
+        uint32_t type;
+        memcpy(&type, chunk->data, sizeof(type));
+
+        pthread_mutex_lock(&recorder->mutex);
+        recorder->statistics.pendingByteCount -= chunk->size;
+        if (written)
+        {
+            recorder->statistics.writtenByteCount += chunk->size;
+            recorder->statistics.recordedFrameCount += (type == FrameRecordingChunkTypeFrame);
+        }
+        else
+        {
+            recorder->statistics.failed = true;
+            recorder->statistics.droppedFrameCount += (type == FrameRecordingChunkTypeFrame);
+        }
+        enqueueFreeChunk(recorder, chunk);
+    }
+    pthread_mutex_unlock(&recorder->mutex);
+
+    return NULL;
+}
+
+FrameRecorder_t * createFrameRecorder(const char * path, size_t maxPendingByteCount)
+{
+    FILE * file = fopen(path, "wb");
+    if (!file)
+    {
+        return NULL;
+    }
+
+    uint8_t header[kFrameRecordingHeaderSize];
+    uint8_t * cursor = header;
+    memcpy(cursor, kFrameRecordingMagic, 4);
+    cursor += 4;
+    writeUInt32(&cursor, kFrameRecordingVersion);
+
+    FrameRecorder_t * recorder = calloc(1, sizeof(FrameRecorder_t));
+    if (!recorder || fwrite(header, 1, sizeof(header), file) != sizeof(header))
+    {
+        free(recorder);
+        fclose(file);
+        return NULL;
+    }
+
+    recorder->file = file;
+    recorder->maxPendingByteCount = maxPendingByteCount;
+    recorder->statistics.writtenByteCount = sizeof(header);
+    pthread_mutex_init(&recorder->mutex, NULL);
+    pthread_cond_init(&recorder->pendingCondition, NULL);
+
+    if (pthread_create(&recorder->writerThread, NULL, frameRecorderWriterThread, recorder) != 0)
+    {
+        pthread_cond_destroy(&recorder->pendingCondition);
+        pthread_mutex_destroy(&recorder->mutex);
+        fclose(file);
+        free(recorder);
+        return NULL;
+    }
+
+    return recorder;
+}
+
+void releaseFrameRecorder(FrameRecorder_t * recorder)
+{
+    if (!recorder)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&recorder->mutex);
+    recorder->shutdown = true;
+    pthread_cond_signal(&recorder->pendingCondition);
+    pthread_mutex_unlock(&recorder->mutex);
+
+    pthread_join(recorder->writerThread, NULL);
+    fclose(recorder->file);
+
+    while (recorder->freeChunks)
+    {
+        FrameRecordingChunk_t * chunk = recorder->freeChunks;
+        recorder->freeChunks = chunk->next;
+        releaseChunk(chunk);
+    }
+
+    pthread_cond_destroy(&recorder->pendingCondition);
+    pthread_mutex_destroy(&recorder->mutex);
+    free(recorder);
+}
+
+bool frameRecorderAppendFrame(FrameRecorder_t * recorder, const FrameRecordingFrame_t * frame)
+{
+    if (frame->planeCount == 0 || frame->planeCount > kFrameRecordingMaxPlaneCount)
+    {
+        return false;
+    }
+
+    size_t payloadSize = kFrameRecordingFrameHeaderSize + frame->planeCount * kFrameRecordingPlaneHeaderSize;
+    for (uint32_t i = 0; i < frame->planeCount; ++i)
+    {
+        const FrameRecordingPlane_t * plane = &frame->planes[i];
+        payloadSize = FrameRecordingPadding(payloadSize) + (size_t)plane->width * plane->bytesPerPixel * plane->height;
+    }
+
+    // Frames are counted even if dropped, the replay sees a gap
+    uint64_t frameIndex = recorder->nextFrameIndex++;
+
+    uint8_t * cursor;
+    FrameRecordingChunk_t * chunk = beginChunk(recorder, FrameRecordingChunkTypeFrame, payloadSize, true, &cursor);
+    if (!chunk)
+    {
+        pthread_mutex_lock(&recorder->mutex);
+        ++recorder->statistics.droppedFrameCount;
+        pthread_mutex_unlock(&recorder->mutex);
+        return false;
+    }
+
+    uint8_t * payload = cursor;
+    writeFloat64(&cursor, frame->timestamp);
+    writeUInt64(&cursor, frameIndex);
+    writeUInt32(&cursor, frame->pixelFormat);
+    writeUInt32(&cursor, frame->planeCount);
+
+    for (uint32_t i = 0; i < frame->planeCount; ++i)
+    {
+        writeUInt32(&cursor, frame->planes[i].width);
+        writeUInt32(&cursor, frame->planes[i].height);
+        writeUInt32(&cursor, frame->planes[i].bytesPerPixel);
+    }
+
+    // Rows are packed, the padding of the source rows isn't recorded
+    for (uint32_t i = 0; i < frame->planeCount; ++i)
+    {
+        const FrameRecordingPlane_t * plane = &frame->planes[i];
+        size_t rowSize = (size_t)plane->width * plane->bytesPerPixel;
+        size_t offset = cursor - payload;
+        memset(cursor, 0, FrameRecordingPadding(offset) - offset);
+        cursor = payload + FrameRecordingPadding(offset);
+
+        for (uint32_t y = 0; y < plane->height; ++y)
+        {
+            memcpy(cursor, plane->data + y * plane->bytesPerRow, rowSize);
+            cursor += rowSize;
+        }
+    }
+
+    endChunk(recorder, chunk);
+    return true;
+}
+
+bool frameRecorderAppendView(FrameRecorder_t * recorder, double timestamp, uint32_t width, uint32_t height)
+{
+    uint8_t * cursor;
+    FrameRecordingChunk_t * chunk = beginChunk(recorder, FrameRecordingChunkTypeView, 16, false, &cursor);
+    if (!chunk)
+    {
+        return false;
+    }
+
+    writeFloat64(&cursor, timestamp);
+    writeUInt32(&cursor, width);
+    writeUInt32(&cursor, height);
+
+    endChunk(recorder, chunk);
+    return true;
+}
+
+bool frameRecorderAppendBlur(FrameRecorder_t * recorder, double timestamp, float intensity, float transitionDuration)
+{
+    uint8_t * cursor;
+    FrameRecordingChunk_t * chunk = beginChunk(recorder, FrameRecordingChunkTypeBlur, 16, false, &cursor);
+    if (!chunk)
+    {
+        return false;
+    }
+
+    writeFloat64(&cursor, timestamp);
+    writeFloat32(&cursor, intensity);
+    writeFloat32(&cursor, transitionDuration);
+
+    endChunk(recorder, chunk);
+    return true;
+}
+
+void frameRecorderStatistics(FrameRecorder_t * recorder, FrameRecorderStatistics_t * statistics)
+{
+    pthread_mutex_lock(&recorder->mutex);
+    *statistics = recorder->statistics;
+    pthread_mutex_unlock(&recorder->mutex);
+}
+
+#pragma mark -
+#pragma mark Replay
+
+struct FrameReplay {
+
+    int fd;
+    uint64_t fileSize;
+    uint64_t offset; // Next chunk
+
+    // Memory-mapped file, the pages before releasedOffset were given back
+    const uint8_t * mapping;
+    uint64_t releasedOffset;
+    size_t pageSize;
+
+    // Streamed file, the current chunk is read in the buffer
+    uint8_t * buffer;
+    size_t bufferCapacity;
+};
+
+static uint32_t readUInt32(const uint8_t ** cursor)
+{
+    uint32_t value;
+    memcpy(&value, *cursor, sizeof(value));
+    *cursor += sizeof(value);
+    return value;
+}
+
+static uint64_t readUInt64(const uint8_t ** cursor)
+{
+    uint64_t value;
+    memcpy(&value, *cursor, sizeof(value));
+    *cursor += sizeof(value);
+    return value;
+}
+
+static float readFloat32(const uint8_t ** cursor)
+{
+    float value;
+    memcpy(&value, *cursor, sizeof(value));
+    *cursor += sizeof(value);
+    return value;
+}
+
+static double readFloat64(const uint8_t ** cursor)
+{
+    double value;
+    memcpy(&value, *cursor, sizeof(value));
+    *cursor += sizeof(value);
+    return value;
+}
+
+static bool readAt(const FrameReplay_t * replay, uint64_t offset, void * data, size_t size)
+{
+    uint8_t * bytes = data;
+    while (size > 0)
+    {
+        ssize_t count = pread(replay->fd, bytes, size, (off_t)offset);
+        if (count <= 0)
+        {
+            return false;
+        }
+        bytes += count;
+        offset += count;
+        size -= count;
+    }
+    return true;
+}
+
+// Bytes [offset, offset + size) of the file, NULL if the file is shorter
+static const uint8_t * replayBytes(FrameReplay_t * replay, uint64_t offset, size_t size)
+{
+    if (offset + size > replay->fileSize)
+    {
+        return NULL;
+    }
+
+    if (replay->mapping)
+    {
+        return replay->mapping + offset;
+    }
+
+    if (size > replay->bufferCapacity)
+    {
+        uint8_t * buffer = realloc(replay->buffer, size);
+        if (!buffer)
+        {
+            return NULL;
+        }
+        replay->buffer = buffer;
+        replay->bufferCapacity = size;
+    }
+
+    return readAt(replay, offset, replay->buffer, size) ? replay->buffer : NULL;
+}
+
+// The chunks before the offset won't be read again (until a rewind), their pages can be reclaimed
+static void releaseMappingBefore(FrameReplay_t * replay, uint64_t offset)
+{
+    uint64_t pageOffset = offset - offset % replay->pageSize;
+    if (replay->mapping && pageOffset > replay->releasedOffset)
+    {
+        madvise((void *)(replay->mapping + replay->releasedOffset), (size_t)(pageOffset - replay->releasedOffset), MADV_DONTNEED);
+        replay->releasedOffset = pageOffset;
+    }
+}
+
+static bool parseFrame(const uint8_t * payload, uint32_t payloadSize, FrameRecordingFrame_t * frame)
+{
+    const uint8_t * cursor = payload;
+    if (payloadSize < kFrameRecordingFrameHeaderSize)
+    {
+        return false;
+    }
+
+    frame->timestamp = readFloat64(&cursor);
+    frame->frameIndex = readUInt64(&cursor);
+    frame->pixelFormat = readUInt32(&cursor);
+    frame->planeCount = readUInt32(&cursor);
+
+    if (frame->planeCount == 0 || frame->planeCount > kFrameRecordingMaxPlaneCount ||
+        payloadSize < kFrameRecordingFrameHeaderSize + frame->planeCount * kFrameRecordingPlaneHeaderSize)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < frame->planeCount; ++i)
+    {
+        FrameRecordingPlane_t * plane = &frame->planes[i];
+        plane->width = readUInt32(&cursor);
+        plane->height = readUInt32(&cursor);
+        plane->bytesPerPixel = readUInt32(&cursor);
+        plane->bytesPerRow = (size_t)plane->width * plane->bytesPerPixel;
+    }
+
+    uint64_t offset = cursor - payload;
+    for (uint32_t i = 0; i < frame->planeCount; ++i)
+    {
+        FrameRecordingPlane_t * plane = &frame->planes[i];
+        offset = FrameRecordingPadding(offset);
+        if (offset + (uint64_t)plane->bytesPerRow * plane->height > payloadSize)
+        {
+            return false;
+        }
+        plane->data = payload + offset;
+        offset += (uint64_t)plane->bytesPerRow * plane->height;
+    }
+
+    return true;
+}
+
+FrameReplay_t * createFrameReplay(const char * path, bool memoryMapped)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    FrameReplay_t * replay = calloc(1, sizeof(FrameReplay_t));
+    struct stat fileStatus;
+    uint8_t header[kFrameRecordingHeaderSize];
+
+    if (!replay || fstat(fd, &fileStatus) != 0)
+    {
+        free(replay);
+        close(fd);
+        return NULL;
+    }
+
+    replay->fd = fd;
+    replay->fileSize = (uint64_t)fileStatus.st_size;
+    replay->pageSize = (size_t)sysconf(_SC_PAGESIZE);
+
+    const uint8_t * cursor = header;
+    if (!readAt(replay, 0, header, sizeof(header)) || memcmp(header, kFrameRecordingMagic, 4) != 0)
+    {
+        releaseFrameReplay(replay);
+        return NULL;
+    }
+
+    cursor += 4;
+    if (readUInt32(&cursor) > kFrameRecordingVersion)
+    {
+        releaseFrameReplay(replay);
+        return NULL;
+    }
+
+    // Read-only shared mapping, pages are loaded on demand (falls back to streaming, ie. a 32-bit address space)
+    if (memoryMapped && replay->fileSize <= SIZE_MAX)
+    {
+        void * mapping = mmap(NULL, (size_t)replay->fileSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            madvise(mapping, (size_t)replay->fileSize, MADV_SEQUENTIAL);
+            replay->mapping = mapping;
+        }
+    }
+
+    replay->offset = kFrameRecordingHeaderSize;
+    return replay;
+}
+
+void releaseFrameReplay(FrameReplay_t * replay)
+{
+    if (!replay)
+    {
+        return;
+    }
+
+    if (replay->mapping)
+    {
+        munmap((void *)replay->mapping, (size_t)replay->fileSize);
+    }
+
+    free(replay->buffer);
+    close(replay->fd);
+    free(replay);
+}
+
+bool frameReplayMemoryMapped(const FrameReplay_t * replay)
+{
+    return replay->mapping != NULL;
+}
+
+bool frameReplayNextEvent(FrameReplay_t * replay, FrameRecordingEvent_t * event)
+{
+    releaseMappingBefore(replay, replay->offset);
+
+    for (;;)
+    {
+        const uint8_t * cursor = replayBytes(replay, replay->offset, kFrameRecordingChunkHeaderSize);
+        if (!cursor)
+        {
+            return false;
+        }
+
+        uint32_t type = readUInt32(&cursor);
+        uint32_t payloadSize = readUInt32(&cursor);
+        uint64_t payloadOffset = replay->offset + kFrameRecordingChunkHeaderSize;
+
+        // Incomplete last chunk
+        const uint8_t * payload = replayBytes(replay, payloadOffset, payloadSize);
+        if (!payload)
+        {
+            return false;
+        }
+
+        replay->offset = payloadOffset + FrameRecordingPadding((uint64_t)payloadSize);
+        cursor = payload;
+
+        switch (type)
+        {
+            case FrameRecordingChunkTypeView:
+                if (payloadSize < 16)
+                {
+                    return false;
+                }
+                event->type = FrameRecordingChunkTypeView;
+                event->timestamp = readFloat64(&cursor);
+                event->view.width = readUInt32(&cursor);
+                event->view.height = readUInt32(&cursor);
+                return true;
+
+            case FrameRecordingChunkTypeBlur:
+                if (payloadSize < 16)
+                {
+                    return false;
+                }
+                event->type = FrameRecordingChunkTypeBlur;
+                event->timestamp = readFloat64(&cursor);
+                event->blur.intensity = readFloat32(&cursor);
+                event->blur.transitionDuration = readFloat32(&cursor);
+                return true;
+
+            case FrameRecordingChunkTypeFrame:
+                if (!parseFrame(payload, payloadSize, &event->frame))
+                {
+                    return false;
+                }
+                event->type = FrameRecordingChunkTypeFrame;
+                event->timestamp = event->frame.timestamp;
+                return true;
+
+            default:
+                // Newer chunk type, skipped
+                break;
+        }
+    }
+}
+
+void frameReplayRewind(FrameReplay_t * replay)
+{
+    replay->offset = kFrameRecordingHeaderSize;
+    replay->releasedOffset = 0;
+}
+
+#pragma mark -
+#pragma mark Blur timeline
+
+void frameReplayBlurTimelineInit(FrameReplayBlurTimeline_t * timeline, float intensity)
+{
+    timeline->intensity = intensity;
+    timeline->targetIntensity = intensity;
+    timeline->transitionDuration = 0.0f;
+    timeline->lastTimestamp = 0.0;
+}
+
+void frameReplayBlurTimelineApplyEvent(FrameReplayBlurTimeline_t * timeline, double timestamp, float intensity, float transitionDuration)
+{
+    // A new transition starts from the intensity reached by the previous one
+    frameReplayBlurTimelineIntensity(timeline, timestamp);
+
+    timeline->targetIntensity = intensity;
+    timeline->transitionDuration = transitionDuration;
+    timeline->lastTimestamp = timestamp;
+
+    if (transitionDuration <= 0.0f)
+    {
+        timeline->intensity = intensity;
+    }
+}
+
+float frameReplayBlurTimelineIntensity(FrameReplayBlurTimeline_t * timeline, double timestamp)
+{
+    double elapsedTime = timestamp - timeline->lastTimestamp;
+    if (elapsedTime <= 0.0)
+    {
+        return timeline->intensity;
+    }
+
+    if (timeline->intensity != timeline->targetIntensity && timeline->transitionDuration > 0.0f)
+    {
+        float step = (float)(elapsedTime / timeline->transitionDuration);
+        if (timeline->intensity < timeline->targetIntensity)
+        {
+            timeline->intensity = timeline->intensity + step < timeline->targetIntensity ? timeline->intensity + step : timeline->targetIntensity;
+        }
+        else
+        {
+            timeline->intensity = timeline->intensity - step > timeline->targetIntensity ? timeline->intensity - step : timeline->targetIntensity;
+        }
+    }
+
+    timeline->lastTimestamp = timestamp;
+    return timeline->intensity;
+}
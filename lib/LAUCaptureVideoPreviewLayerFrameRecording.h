@@ -0,0 +1,184 @@
+/*
+
+ LAUCaptureVideoPreviewLayerFrameRecording.h
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef LAUCaptureVideoPreviewLayerFrameRecording_h
+#define LAUCaptureVideoPreviewLayerFrameRecording_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Recording of the captured frames and the blur timeline, replayed offline (ie. by the headless harness on Linux)
+
+ - The recorder copies the frames on the capture queue and writes them on its own thread, frames that
+   don't fit the pending bytes while the writer is behind are dropped (the frame index has a gap)
+ - The replay reads the file in order, memory-mapped (pages behind the cursor are given back) or streamed,
+   so recordings larger than the memory can be replayed
+ - Timestamps are the presentation timestamps of the sample buffers, the blur changes use the same clock
+
+ File format (integers and floats are little-endian):
+
+ header   "LAUR", version (uint32)
+ chunk    type (uint32), payload size (uint32), payload padded to a multiple of 8 bytes
+
+ 'VIEW'   timestamp (float64), width, height (uint32) of the onscreen renderbuffer
+ 'BLUR'   timestamp (float64), intensity (float32), transition duration from 0 to 1 (float32, 0 if not animated)
+ 'FRME'   timestamp (float64), frame index (uint64), pixel format (uint32), plane count (uint32),
+          width, height, bytes per pixel (uint32) of each plane, then each plane with packed rows (padded to 8 bytes)
+
+ Unknown chunks are skipped, an incomplete last chunk (ie. the app was killed) ends the recording.
+ */
+
+#define FrameRecordingFourCC(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+#define kFrameRecordingVersion 1
+#define kFrameRecordingMaxPlaneCount 2
+
+typedef enum {
+    FrameRecordingChunkTypeView = FrameRecordingFourCC('V', 'I', 'E', 'W'),
+    FrameRecordingChunkTypeBlur = FrameRecordingFourCC('B', 'L', 'U', 'R'),
+    FrameRecordingChunkTypeFrame = FrameRecordingFourCC('F', 'R', 'M', 'E'),
+} FrameRecordingChunkType_t;
+
+// Same values as kCVPixelFormatType_32BGRA and kCVPixelFormatType_420YpCbCr8BiPlanarFullRange
+typedef enum {
+    FrameRecordingPixelFormatBGRA = FrameRecordingFourCC('B', 'G', 'R', 'A'), // 1 plane, 4 bytes per pixel
+    FrameRecordingPixelFormat420f = FrameRecordingFourCC('4', '2', '0', 'f'), // Luma (1 byte per pixel) and half resolution CbCr (2 bytes per pixel)
+} FrameRecordingPixelFormat_t;
+
+struct FrameRecordingPlane {
+    const uint8_t * data;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerPixel;
+    size_t bytesPerRow; // Packed (width * bytesPerPixel) in the recording, the recorder accepts padded rows
+};
+
+typedef struct FrameRecordingPlane FrameRecordingPlane_t;
+
+struct FrameRecordingFrame {
+    double timestamp;
+    uint64_t frameIndex; // Set by the recorder, frames dropped by the recorder leave a gap
+    uint32_t pixelFormat; // FrameRecordingPixelFormat_t
+    uint32_t planeCount;
+    FrameRecordingPlane_t planes[kFrameRecordingMaxPlaneCount];
+};
+
+typedef struct FrameRecordingFrame FrameRecordingFrame_t;
+
+struct FrameRecordingEvent {
+    FrameRecordingChunkType_t type;
+    double timestamp;
+    union {
+        struct {
+            uint32_t width;
+            uint32_t height;
+        } view;
+        struct {
+            float intensity;
+            float transitionDuration;
+        } blur;
+        FrameRecordingFrame_t frame; // Plane data valid until the next frameReplayNextEvent
+    };
+};
+
+typedef struct FrameRecordingEvent FrameRecordingEvent_t;
+
+#pragma mark -
+#pragma mark Recorder
+
+// Counters since the recorder was created
+struct FrameRecorderStatistics {
+    unsigned long recordedFrameCount; // Frames written to the file
+    unsigned long droppedFrameCount; // Frames dropped because the writer was behind (or failed)
+    unsigned long long writtenByteCount;
+    size_t pendingByteCount; // Chunks copied and not written yet
+    bool failed; // A write failed, the following chunks are dropped
+};
+
+typedef struct FrameRecorderStatistics FrameRecorderStatistics_t;
+
+typedef struct FrameRecorder FrameRecorder_t;
+
+// Recorder memory management, creates (truncates) the file and starts the writer thread
+// maxPendingByteCount bounds the copies waiting for the writer, at least one frame must fit
+// Release writes the pending chunks and closes the file
+FrameRecorder_t * createFrameRecorder(const char * path, size_t maxPendingByteCount);
+void releaseFrameRecorder(FrameRecorder_t * recorder);
+
+// Copy the frame (its frameIndex is ignored), returns false if it was dropped. Called from one thread (capture queue)
+bool frameRecorderAppendFrame(FrameRecorder_t * recorder, const FrameRecordingFrame_t * frame);
+
+// View size and blur changes are never dropped (unless the recorder failed)
+bool frameRecorderAppendView(FrameRecorder_t * recorder, double timestamp, uint32_t width, uint32_t height);
+bool frameRecorderAppendBlur(FrameRecorder_t * recorder, double timestamp, float intensity, float transitionDuration);
+
+void frameRecorderStatistics(FrameRecorder_t * recorder, FrameRecorderStatistics_t * statistics);
+
+#pragma mark -
+#pragma mark Replay
+
+typedef struct FrameReplay FrameReplay_t;
+
+// Replay memory management, NULL if the file isn't a recording (or has a newer version)
+// The file is memory-mapped if memoryMapped is true and the mapping succeeds, streamed otherwise
+FrameReplay_t * createFrameReplay(const char * path, bool memoryMapped);
+void releaseFrameReplay(FrameReplay_t * replay);
+
+bool frameReplayMemoryMapped(const FrameReplay_t * replay);
+
+// Next chunk in the file order, false at the end of the recording
+bool frameReplayNextEvent(FrameReplay_t * replay, FrameRecordingEvent_t * event);
+
+// Back to the first chunk
+void frameReplayRewind(FrameReplay_t * replay);
+
+// Intensity of the blur timeline at a time, same transition as setFilterIntensity:animated: with continuous intensity
+// (linear steps towards the target, the duration is for a change from 0 to 1)
+struct FrameReplayBlurTimeline {
+    float intensity; // Intensity at lastTimestamp
+    float targetIntensity;
+    float transitionDuration;
+    double lastTimestamp;
+};
+
+typedef struct FrameReplayBlurTimeline FrameReplayBlurTimeline_t;
+
+void frameReplayBlurTimelineInit(FrameReplayBlurTimeline_t * timeline, float intensity);
+void frameReplayBlurTimelineApplyEvent(FrameReplayBlurTimeline_t * timeline, double timestamp, float intensity, float transitionDuration);
+float frameReplayBlurTimelineIntensity(FrameReplayBlurTimeline_t * timeline, double timestamp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAUCaptureVideoPreviewLayerFrameRecording_h */
@@ -0,0 +1,103 @@
+/*
+
+ LAUCaptureVideoPreviewLayerFrameSignature.c
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "LAUCaptureVideoPreviewLayerFrameSignature.h"
+
+#include <string.h>
+
+static void computeSignature(const uint8_t * data, size_t width, size_t height, size_t bytesPerRow, size_t bytesPerPixel, FrameSignature_t * signature)
+{
+    memset(signature, 0, sizeof(FrameSignature_t));
+    signature->width = width;
+    signature->height = height;
+    
+    if (!data || width < kFrameSignatureSize || height < kFrameSignatureSize)
+    {
+        return;
+    }
+    
+    const size_t sampleCount = kFrameSignatureSize * kFrameSignatureCellSampleCount;
+    
+    for (size_t cy = 0; cy < kFrameSignatureSize; ++cy)
+    {
+        for (size_t cx = 0; cx < kFrameSignatureSize; ++cx)
+        {
+            unsigned int cellLuma = 0;
+            
+            for (size_t sy = 0; sy < kFrameSignatureCellSampleCount; ++sy)
+            {
+                // Sample at the center of each sub-cell
+                size_t y = ((cy * kFrameSignatureCellSampleCount + sy) * 2 + 1) * height / (2 * sampleCount);
+                const uint8_t * row = data + y * bytesPerRow;
+                
+                for (size_t sx = 0; sx < kFrameSignatureCellSampleCount; ++sx)
+                {
+                    size_t x = ((cx * kFrameSignatureCellSampleCount + sx) * 2 + 1) * width / (2 * sampleCount);
+                    const uint8_t * pixel = row + x * bytesPerPixel;
+                    
+                    // Integer approximation of the Rec. 601 luma (B, G, R order), or the luma plane itself
+                    cellLuma += (bytesPerPixel == 1) ? pixel[0] : ((pixel[0] * 29 + pixel[1] * 150 + pixel[2] * 77) >> 8);
+                }
+            }
+            
+            signature->cells[cy * kFrameSignatureSize + cx] = (uint8_t)(cellLuma / (kFrameSignatureCellSampleCount * kFrameSignatureCellSampleCount));
+        }
+    }
+}
+
+void frameSignatureComputeBGRA(const uint8_t * data, size_t width, size_t height, size_t bytesPerRow, FrameSignature_t * signature)
+{
+    computeSignature(data, width, height, bytesPerRow, 4, signature);
+}
+
+void frameSignatureComputeLuma(const uint8_t * data, size_t width, size_t height, size_t bytesPerRow, FrameSignature_t * signature)
+{
+    computeSignature(data, width, height, bytesPerRow, 1, signature);
+}
+
+float frameSignatureDistance(const FrameSignature_t * signature, const FrameSignature_t * otherSignature)
+{
+    if (signature->width != otherSignature->width || signature->height != otherSignature->height)
+    {
+        return 256.0f;
+    }
+    
+    unsigned int difference = 0;
+    
+    for (size_t i = 0; i < kFrameSignatureSize * kFrameSignatureSize; ++i)
+    {
+        int cellDifference = (int)signature->cells[i] - (int)otherSignature->cells[i];
+        difference += cellDifference < 0 ? -cellDifference : cellDifference;
+    }
+    
+    return (float)difference / (kFrameSignatureSize * kFrameSignatureSize);
+}
+
+bool frameSignatureIsSimilar(const FrameSignature_t * signature, const FrameSignature_t * otherSignature, float threshold)
+{
+    return frameSignatureDistance(signature, otherSignature) <= threshold;
+}
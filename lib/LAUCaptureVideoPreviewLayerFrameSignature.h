@@ -0,0 +1,75 @@
+/*
+
+ LAUCaptureVideoPreviewLayerFrameSignature.h
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef LAUCaptureVideoPreviewLayerFrameSignature_h
+#define LAUCaptureVideoPreviewLayerFrameSignature_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Low resolution signature of a frame, used to detect near-identical consecutive frames
+
+ - The frame is divided in kFrameSignatureSize x kFrameSignatureSize cells, each cell is the mean luma of
+   kFrameSignatureCellSampleCount x kFrameSignatureCellSampleCount pixels sampled on a grid (not every pixel is read)
+ - The distance between two signatures is the mean absolute difference of their cells [0,255]
+ - Noise of a static scene is mostly averaged out by the cells, a moving object changes a few cells by a lot
+ */
+
+#define kFrameSignatureSize 8
+#define kFrameSignatureCellSampleCount 4
+
+struct FrameSignature {
+    size_t width; // Frame dimensions, signatures of different dimensions are never similar
+    size_t height;
+    uint8_t cells[kFrameSignatureSize * kFrameSignatureSize];
+};
+
+typedef struct FrameSignature FrameSignature_t;
+
+// Signature of a 32 bits per pixel BGRA frame (ie. kCVPixelFormatType_32BGRA)
+void frameSignatureComputeBGRA(const uint8_t * data, size_t width, size_t height, size_t bytesPerRow, FrameSignature_t * signature);
+
+// Signature of an 8 bits luma plane (ie. plane 0 of kCVPixelFormatType_420YpCbCr8BiPlanarFullRange)
+void frameSignatureComputeLuma(const uint8_t * data, size_t width, size_t height, size_t bytesPerRow, FrameSignature_t * signature);
+
+// Mean absolute difference of the cells, or a value greater than 255 if the dimensions differ
+float frameSignatureDistance(const FrameSignature_t * signature, const FrameSignature_t * otherSignature);
+
+// YES if the distance is lower or equal than the threshold
+bool frameSignatureIsSimilar(const FrameSignature_t * signature, const FrameSignature_t * otherSignature, float threshold);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAUCaptureVideoPreviewLayerFrameSignature_h */
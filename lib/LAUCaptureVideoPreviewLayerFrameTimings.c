@@ -0,0 +1,564 @@
+/*
+
+ LAUCaptureVideoPreviewLayerFrameTimings.c
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "LAUCaptureVideoPreviewLayerFrameTimings.h"
+
+#if TARGET_OS_IPHONE
+    #import <OpenGLES/ES2/glext.h>
+#elif defined(__linux__)
+    #include <GLES2/gl2ext.h>
+#endif
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define kFrameTimingsMaxPendingQueryCount 256
+
+typedef uint64_t FrameTimingStageMask;
+
+#define FrameTimingStageBit(stage) (((FrameTimingStageMask)1) << (stage))
+
+struct FrameTimingRecord {
+
+    unsigned long frameIndex;
+    bool complete; // frameTimingsEndFrame was called
+
+    FrameTimingStageMask cpuStageMask;
+    FrameTimingStageMask gpuStageMask;
+    FrameTimingStageMask gpuPendingStageMask;
+    bool gpuDropped; // A stage has no GPU time, the frame GPU time is not computed
+
+    double cpuTime[FrameTimingStageCount];
+    double gpuTime[FrameTimingStageCount];
+};
+
+typedef struct FrameTimingRecord FrameTimingRecord_t;
+
+struct FrameTimingQuery {
+    GLuint query;
+    unsigned long frameIndex;
+    unsigned int stage;
+    double beginTime; // CPU time when the query began, the GPU can't have spent more time than what elapsed since
+};
+
+typedef struct FrameTimingQuery FrameTimingQuery_t;
+
+struct FrameTimings {
+
+    // Ring of frames
+    FrameTimingRecord_t * records;
+    unsigned int frameCapacity;
+    FrameTimingRecord_t * currentRecord; // NULL outside frames
+    unsigned long nextFrameIndex; // Canceled frames included
+
+    // CPU time at the beginning of the current frame and stages
+    double frameStartTime;
+    double stageStartTime[FrameTimingStageCount];
+
+    // Timer queries
+    FrameTimingsTimerQueryFunctions_t functions;
+    bool timerQueriesEnabled;
+    FrameTimingQuery_t pendingQueries[kFrameTimingsMaxPendingQueryCount]; // Ring, oldest first
+    unsigned int pendingQueryHead;
+    unsigned int pendingQueryCount;
+    GLuint freeQueries[kFrameTimingsMaxPendingQueryCount];
+    unsigned int freeQueryCount;
+    GLuint activeQuery; // 0 if none
+    unsigned int activeQueryStage;
+    double activeQueryBeginTime;
+
+    // Statistics scratch memory (frameCapacity samples)
+    double * samples;
+
+    FrameTimingsCounters_t counters;
+};
+
+static double currentTime(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+#pragma mark -
+#pragma mark Timer queries (GL_EXT_disjoint_timer_query)
+
+#if defined(GL_EXT_disjoint_timer_query) && (TARGET_OS_IPHONE || defined(GL_GLEXT_PROTOTYPES))
+static void beginQueryExt(GLuint query)
+{
+    glBeginQueryEXT(GL_TIME_ELAPSED_EXT, query);
+}
+
+static void endQueryExt(void)
+{
+    glEndQueryEXT(GL_TIME_ELAPSED_EXT);
+}
+
+static bool queryResultExt(GLuint query, uint64_t * elapsedTime)
+{
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuivEXT(query, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+
+    if (!available)
+    {
+        return false;
+    }
+
+    GLuint64 result = 0;
+    glGetQueryObjectui64vEXT(query, GL_QUERY_RESULT_EXT, &result);
+    *elapsedTime = result;
+    return true;
+}
+
+static bool disjointExt(void)
+{
+    GLint disjoint = GL_FALSE;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    return disjoint != GL_FALSE;
+}
+
+static const FrameTimingsTimerQueryFunctions_t timerQueryFunctionsExt = {
+    glGenQueriesEXT, glDeleteQueriesEXT, beginQueryExt, endQueryExt, queryResultExt, disjointExt
+};
+#endif
+
+static void recycleQuery(FrameTimings_t * frameTimings, GLuint query)
+{
+    if (frameTimings->freeQueryCount < kFrameTimingsMaxPendingQueryCount)
+    {
+        frameTimings->freeQueries[frameTimings->freeQueryCount++] = query;
+    }
+    else
+    {
+        frameTimings->functions.deleteQueries(1, &query);
+    }
+}
+
+static void dropPendingQueries(FrameTimings_t * frameTimings)
+{
+    while (frameTimings->pendingQueryCount > 0)
+    {
+        FrameTimingQuery_t * pendingQuery = &frameTimings->pendingQueries[frameTimings->pendingQueryHead];
+
+        FrameTimingRecord_t * record = &frameTimings->records[pendingQuery->frameIndex % frameTimings->frameCapacity];
+        if (record->frameIndex == pendingQuery->frameIndex)
+        {
+            record->gpuPendingStageMask &= ~FrameTimingStageBit(pendingQuery->stage);
+            record->gpuDropped = true;
+        }
+
+        recycleQuery(frameTimings, pendingQuery->query);
+        frameTimings->pendingQueryHead = (frameTimings->pendingQueryHead + 1) % kFrameTimingsMaxPendingQueryCount;
+        frameTimings->pendingQueryCount--;
+        frameTimings->counters.droppedQueryCount++;
+    }
+}
+
+// Collects the results available, in order (the GPU completes the queries in order)
+static void collectQueryResults(FrameTimings_t * frameTimings)
+{
+    if (frameTimings->functions.disjoint && frameTimings->functions.disjoint())
+    {
+        dropPendingQueries(frameTimings);
+        return;
+    }
+
+    double now = currentTime();
+
+    while (frameTimings->pendingQueryCount > 0)
+    {
+        FrameTimingQuery_t * pendingQuery = &frameTimings->pendingQueries[frameTimings->pendingQueryHead];
+        uint64_t elapsedTime = 0;
+
+        if (!frameTimings->functions.queryResult(pendingQuery->query, &elapsedTime))
+        {
+            break;
+        }
+
+        FrameTimingRecord_t * record = &frameTimings->records[pendingQuery->frameIndex % frameTimings->frameCapacity];
+
+        // Drivers can report bogus results (ie. the first query of Mesa llvmpipe)
+        bool valid = elapsedTime * 1e-9 <= now - pendingQuery->beginTime;
+
+        if (record->frameIndex == pendingQuery->frameIndex)
+        {
+            FrameTimingStageMask stageBit = FrameTimingStageBit(pendingQuery->stage);
+            record->gpuPendingStageMask &= ~stageBit;
+
+            if (valid)
+            {
+                record->gpuTime[pendingQuery->stage] = elapsedTime * 1e-9;
+                record->gpuStageMask |= stageBit;
+            }
+            else
+            {
+                record->gpuDropped = true;
+                frameTimings->counters.droppedQueryCount++;
+            }
+
+            // All the stages of a complete frame have their GPU time
+            if (record->complete && !record->gpuDropped && record->gpuPendingStageMask == 0)
+            {
+                double frameTime = 0.0;
+                for (unsigned int stage = 0; stage < FrameTimingStageCount; ++stage)
+                {
+                    if (stage != FrameTimingStageFrame && (record->gpuStageMask & FrameTimingStageBit(stage)))
+                    {
+                        frameTime += record->gpuTime[stage];
+                    }
+                }
+                record->gpuTime[FrameTimingStageFrame] = frameTime;
+                record->gpuStageMask |= FrameTimingStageBit(FrameTimingStageFrame);
+            }
+        }
+        else
+        {
+            frameTimings->counters.droppedQueryCount++;
+        }
+
+        recycleQuery(frameTimings, pendingQuery->query);
+        frameTimings->pendingQueryHead = (frameTimings->pendingQueryHead + 1) % kFrameTimingsMaxPendingQueryCount;
+        frameTimings->pendingQueryCount--;
+    }
+}
+
+#pragma mark -
+#pragma mark Memory management
+
+FrameTimings_t * createFrameTimings(unsigned int frameCapacity)
+{
+    FrameTimings_t * frameTimings = calloc(1, sizeof(FrameTimings_t));
+
+    if (!frameTimings)
+    {
+        return NULL;
+    }
+
+    frameTimings->frameCapacity = frameCapacity > 0 ? frameCapacity : 1;
+    frameTimings->records = calloc(frameTimings->frameCapacity, sizeof(FrameTimingRecord_t));
+    frameTimings->samples = calloc(frameTimings->frameCapacity, sizeof(double));
+
+    if (!frameTimings->records || !frameTimings->samples)
+    {
+        free(frameTimings->records);
+        free(frameTimings->samples);
+        free(frameTimings);
+        return NULL;
+    }
+
+    for (unsigned int i = 0; i < frameTimings->frameCapacity; ++i)
+    {
+        frameTimings->records[i].frameIndex = ULONG_MAX;
+    }
+
+#if defined(GL_EXT_disjoint_timer_query) && (TARGET_OS_IPHONE || defined(GL_GLEXT_PROTOTYPES))
+    const char * extensions = (const char *)glGetString(GL_EXTENSIONS);
+    if (extensions && strstr(extensions, "GL_EXT_disjoint_timer_query"))
+    {
+        frameTimingsSetTimerQueryFunctions(frameTimings, &timerQueryFunctionsExt);
+    }
+#endif
+
+    return frameTimings;
+}
+
+static void deleteQueries(FrameTimings_t * frameTimings)
+{
+    if (!frameTimings->timerQueriesEnabled)
+    {
+        return;
+    }
+
+    if (frameTimings->activeQuery)
+    {
+        frameTimings->functions.endQuery();
+        recycleQuery(frameTimings, frameTimings->activeQuery);
+        frameTimings->activeQuery = 0;
+    }
+
+    dropPendingQueries(frameTimings);
+
+    if (frameTimings->freeQueryCount > 0)
+    {
+        frameTimings->functions.deleteQueries(frameTimings->freeQueryCount, frameTimings->freeQueries);
+        frameTimings->freeQueryCount = 0;
+    }
+}
+
+void releaseFrameTimings(FrameTimings_t * frameTimings)
+{
+    if (!frameTimings)
+    {
+        return;
+    }
+
+    deleteQueries(frameTimings);
+
+    free(frameTimings->records);
+    free(frameTimings->samples);
+    free(frameTimings);
+}
+
+void frameTimingsSetTimerQueryFunctions(FrameTimings_t * frameTimings, const FrameTimingsTimerQueryFunctions_t * functions)
+{
+    deleteQueries(frameTimings);
+
+    if (functions && functions->genQueries && functions->deleteQueries && functions->beginQuery && functions->endQuery && functions->queryResult)
+    {
+        frameTimings->functions = *functions;
+        frameTimings->timerQueriesEnabled = true;
+    }
+    else
+    {
+        memset(&frameTimings->functions, 0, sizeof(FrameTimingsTimerQueryFunctions_t));
+        frameTimings->timerQueriesEnabled = false;
+    }
+}
+
+#pragma mark -
+#pragma mark Frames and stages
+
+void frameTimingsBeginFrame(FrameTimings_t * frameTimings)
+{
+    if (frameTimings->currentRecord)
+    {
+        frameTimingsEndFrame(frameTimings);
+    }
+
+    unsigned long frameIndex = frameTimings->nextFrameIndex++;
+
+    FrameTimingRecord_t * record = &frameTimings->records[frameIndex % frameTimings->frameCapacity];
+    record->frameIndex = frameIndex;
+    record->complete = false;
+    record->cpuStageMask = 0;
+    record->gpuStageMask = 0;
+    record->gpuPendingStageMask = 0;
+    record->gpuDropped = false;
+
+    frameTimings->currentRecord = record;
+    frameTimings->frameStartTime = currentTime();
+}
+
+void frameTimingsEndFrame(FrameTimings_t * frameTimings)
+{
+    FrameTimingRecord_t * record = frameTimings->currentRecord;
+
+    if (!record)
+    {
+        return;
+    }
+
+    if (frameTimings->activeQuery)
+    {
+        frameTimingsEndStage(frameTimings, frameTimings->activeQueryStage);
+    }
+
+    record->cpuTime[FrameTimingStageFrame] = currentTime() - frameTimings->frameStartTime;
+    record->cpuStageMask |= FrameTimingStageBit(FrameTimingStageFrame);
+    record->complete = true;
+
+    frameTimings->currentRecord = NULL;
+    frameTimings->counters.frameCount++;
+
+    if (frameTimings->timerQueriesEnabled)
+    {
+        collectQueryResults(frameTimings);
+    }
+}
+
+void frameTimingsCancelFrame(FrameTimings_t * frameTimings)
+{
+    FrameTimingRecord_t * record = frameTimings->currentRecord;
+
+    if (!record)
+    {
+        return;
+    }
+
+    if (frameTimings->activeQuery)
+    {
+        frameTimingsEndStage(frameTimings, frameTimings->activeQueryStage);
+    }
+
+    // Its pending queries are dropped when collected (the frame index is not in the ring)
+    record->frameIndex = ULONG_MAX;
+    frameTimings->currentRecord = NULL;
+}
+
+void frameTimingsBeginStage(FrameTimings_t * frameTimings, unsigned int stage)
+{
+    if (!frameTimings->currentRecord || stage >= FrameTimingStageCount || stage == FrameTimingStageFrame)
+    {
+        return;
+    }
+
+    // One timer query at a time, the oldest pending query is dropped if there are too many
+    if (frameTimings->timerQueriesEnabled && !frameTimings->activeQuery)
+    {
+        if (frameTimings->pendingQueryCount == kFrameTimingsMaxPendingQueryCount)
+        {
+            collectQueryResults(frameTimings);
+        }
+
+        if (frameTimings->pendingQueryCount < kFrameTimingsMaxPendingQueryCount)
+        {
+            GLuint query = 0;
+
+            if (frameTimings->freeQueryCount > 0)
+            {
+                query = frameTimings->freeQueries[--frameTimings->freeQueryCount];
+            }
+            else
+            {
+                frameTimings->functions.genQueries(1, &query);
+            }
+
+            frameTimings->functions.beginQuery(query);
+            frameTimings->activeQuery = query;
+            frameTimings->activeQueryStage = stage;
+            frameTimings->counters.queryCount++;
+        }
+        else
+        {
+            frameTimings->counters.droppedQueryCount++;
+        }
+    }
+
+    frameTimings->stageStartTime[stage] = currentTime();
+    frameTimings->activeQueryBeginTime = frameTimings->stageStartTime[stage];
+}
+
+void frameTimingsEndStage(FrameTimings_t * frameTimings, unsigned int stage)
+{
+    FrameTimingRecord_t * record = frameTimings->currentRecord;
+
+    if (!record || stage >= FrameTimingStageCount || stage == FrameTimingStageFrame)
+    {
+        return;
+    }
+
+    record->cpuTime[stage] = currentTime() - frameTimings->stageStartTime[stage];
+    record->cpuStageMask |= FrameTimingStageBit(stage);
+
+    if (frameTimings->activeQuery && frameTimings->activeQueryStage == stage)
+    {
+        frameTimings->functions.endQuery();
+
+        unsigned int tail = (frameTimings->pendingQueryHead + frameTimings->pendingQueryCount) % kFrameTimingsMaxPendingQueryCount;
+        FrameTimingQuery_t * pendingQuery = &frameTimings->pendingQueries[tail];
+        pendingQuery->query = frameTimings->activeQuery;
+        pendingQuery->frameIndex = record->frameIndex;
+        pendingQuery->stage = stage;
+        pendingQuery->beginTime = frameTimings->activeQueryBeginTime;
+        frameTimings->pendingQueryCount++;
+
+        record->gpuPendingStageMask |= FrameTimingStageBit(stage);
+        frameTimings->activeQuery = 0;
+    }
+}
+
+#pragma mark -
+#pragma mark Statistics
+
+static int compareSamples(const void * a, const void * b)
+{
+    double sampleA = *(const double *)a;
+    double sampleB = *(const double *)b;
+    return (sampleA > sampleB) - (sampleA < sampleB);
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const double * samples, unsigned int sampleCount, double p)
+{
+    unsigned int rank = (unsigned int)ceil(p * sampleCount);
+    return samples[rank > 0 ? rank - 1 : 0];
+}
+
+bool frameTimingsStatistics(FrameTimings_t * frameTimings, unsigned int stage, bool gpu, FrameTimingStatistics_t * statistics)
+{
+    memset(statistics, 0, sizeof(FrameTimingStatistics_t));
+
+    if (stage >= FrameTimingStageCount)
+    {
+        return false;
+    }
+
+    unsigned int sampleCount = 0;
+    double sum = 0.0;
+
+    for (unsigned int i = 0; i < frameTimings->frameCapacity; ++i)
+    {
+        const FrameTimingRecord_t * record = &frameTimings->records[i];
+        FrameTimingStageMask stageMask = gpu ? record->gpuStageMask : record->cpuStageMask;
+
+        if (record->frameIndex != ULONG_MAX && record->complete && (stageMask & FrameTimingStageBit(stage)))
+        {
+            double sample = gpu ? record->gpuTime[stage] : record->cpuTime[stage];
+            frameTimings->samples[sampleCount++] = sample;
+            sum += sample;
+        }
+    }
+
+    if (sampleCount == 0)
+    {
+        return false;
+    }
+
+    qsort(frameTimings->samples, sampleCount, sizeof(double), compareSamples);
+
+    statistics->sampleCount = sampleCount;
+    statistics->mean = sum / sampleCount;
+    statistics->p50 = percentile(frameTimings->samples, sampleCount, 0.50);
+    statistics->p90 = percentile(frameTimings->samples, sampleCount, 0.90);
+    statistics->p99 = percentile(frameTimings->samples, sampleCount, 0.99);
+    statistics->max = frameTimings->samples[sampleCount - 1];
+
+    return true;
+}
+
+void frameTimingsCounters(const FrameTimings_t * frameTimings, FrameTimingsCounters_t * counters)
+{
+    *counters = frameTimings->counters;
+}
+
+void frameTimingsStageName(unsigned int stage, char * name, size_t nameSize)
+{
+    static const char * const stageNames[] = { "textureImport", "uniformUpdate", "onscreenPass", "present", "frame" };
+
+    if (stage < FrameTimingStageOffscreenPass)
+    {
+        snprintf(name, nameSize, "%s", stageNames[stage]);
+    }
+    else
+    {
+        snprintf(name, nameSize, "offscreenPass%u", stage - FrameTimingStageOffscreenPass);
+    }
+}
@@ -0,0 +1,129 @@
+/*
+
+ LAUCaptureVideoPreviewLayerFrameTimings.h
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef LAUCaptureVideoPreviewLayerFrameTimings_h
+#define LAUCaptureVideoPreviewLayerFrameTimings_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LAUCaptureVideoPreviewLayerUtilities.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ CPU and GPU timings of the stages of the last N frames (drawPixelBuffer:)
+
+ - CPU time is measured between frameTimingsBeginStage and frameTimingsEndStage with a monotonic clock
+ - GPU time is measured with timer queries (GL_TIME_ELAPSED_EXT) around the same stages. Results are collected
+   without waiting, a few frames later, by frameTimingsEndFrame. Query objects are reused.
+ - Stages can't overlap (one timer query at a time), except FrameTimingStageFrame which is the whole frame
+ - Without timer query functions (ie. iOS, no GL_EXT_disjoint_timer_query) only CPU times are recorded
+ - Statistics (mean, percentiles, max) are computed over the frames kept in the ring
+
+ Must be used with the same OpenGL context current as the frames being timed.
+ */
+
+#define kFrameTimingsMaxOffscreenPassCount 24
+
+enum FrameTimingStage {
+    FrameTimingStageTextureImport = 0, // Pixel buffer to texture (CVOpenGLESTextureCache)
+    FrameTimingStageUniformUpdate,
+    FrameTimingStageOnscreenPass,
+    FrameTimingStagePresent,
+    FrameTimingStageFrame, // Whole frame, the GPU time is the sum of the stages
+    FrameTimingStageOffscreenPass, // First offscreen pass, FrameTimingStageOffscreenPass + p for pass p
+    FrameTimingStageCount = FrameTimingStageOffscreenPass + kFrameTimingsMaxOffscreenPassCount
+};
+
+typedef enum FrameTimingStage FrameTimingStage_t;
+
+// Timer query functions (GL_EXT_disjoint_timer_query or equivalent)
+struct FrameTimingsTimerQueryFunctions {
+    void (*genQueries)(GLsizei count, GLuint * queries);
+    void (*deleteQueries)(GLsizei count, const GLuint * queries);
+    void (*beginQuery)(GLuint query); // Elapsed time query
+    void (*endQuery)(void);
+    bool (*queryResult)(GLuint query, uint64_t * elapsedTime); // Nanoseconds, returns false if not available yet (must not wait)
+    bool (*disjoint)(void); // Optional, returns true if the results of the pending queries are invalid (ie. GPU frequency changed)
+};
+
+typedef struct FrameTimingsTimerQueryFunctions FrameTimingsTimerQueryFunctions_t;
+
+// Seconds, over the frames in the ring that have the stage
+struct FrameTimingStatistics {
+    unsigned int sampleCount;
+    double mean;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+};
+
+typedef struct FrameTimingStatistics FrameTimingStatistics_t;
+
+// Counters since the frame timings were created
+struct FrameTimingsCounters {
+    unsigned long frameCount;
+    unsigned long queryCount; // Timer queries issued
+    unsigned long droppedQueryCount; // Timer queries without a result (disjoint, too many pending or frame no longer in the ring)
+};
+
+typedef struct FrameTimingsCounters FrameTimingsCounters_t;
+
+typedef struct FrameTimings FrameTimings_t;
+
+// Frame timings memory management, frameCapacity is the number of frames in the ring (at least 1)
+// The default timer query functions are the GL_EXT_disjoint_timer_query ones of the OpenGL ES headers (if available and supported by the context)
+FrameTimings_t * createFrameTimings(unsigned int frameCapacity);
+void releaseFrameTimings(FrameTimings_t * frameTimings);
+
+// Timer query functions for platforms that resolve extensions at runtime (ie. eglGetProcAddress), NULL disables the GPU timings
+void frameTimingsSetTimerQueryFunctions(FrameTimings_t * frameTimings, const FrameTimingsTimerQueryFunctions_t * functions);
+
+// Frame and stage boundaries, stages outside a frame are ignored
+void frameTimingsBeginFrame(FrameTimings_t * frameTimings);
+void frameTimingsEndFrame(FrameTimings_t * frameTimings);
+void frameTimingsCancelFrame(FrameTimings_t * frameTimings); // Nothing was rendered, the frame is discarded
+void frameTimingsBeginStage(FrameTimings_t * frameTimings, unsigned int stage);
+void frameTimingsEndStage(FrameTimings_t * frameTimings, unsigned int stage);
+
+// Statistics of a stage (CPU or GPU times), returns false if no frame in the ring has the stage
+bool frameTimingsStatistics(FrameTimings_t * frameTimings, unsigned int stage, bool gpu, FrameTimingStatistics_t * statistics);
+
+void frameTimingsCounters(const FrameTimings_t * frameTimings, FrameTimingsCounters_t * counters);
+
+// Name of a stage (ie. "offscreenPass3"), the buffer must hold at least 32 characters
+void frameTimingsStageName(unsigned int stage, char * name, size_t nameSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAUCaptureVideoPreviewLayerFrameTimings_h */
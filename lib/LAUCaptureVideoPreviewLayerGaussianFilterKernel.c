@@ -0,0 +1,710 @@
+/*
+ 
+ LAUCaptureVideoPreviewLayerGaussianFilterKernel.c
+ LAUCaptureVideoPreviewLayer
+ 
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+*/
+
+#include "LAUCaptureVideoPreviewLayerGaussianFilterKernel.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#pragma mark -
+#pragma mark Parameters
+
+GaussianFilterKernelParameters_t const kDtsGaussianFilterKernelDefaultParameters = {
+    .kernelCount = 11,
+    .minSigma = 0.25f,
+    .maxSigma = 9.5f,
+    .sigmaEasing = GaussianFilterSigmaEasingEaseOutQuad,
+    .truncation = 2.0f,
+};
+
+GaussianFilterKernelParameters_t const kBtsGaussianFilterKernelDefaultParameters = {
+    .kernelCount = 11,
+    .minSigma = 0.25f,
+    .maxSigma = 9.5f,
+    .sigmaEasing = GaussianFilterSigmaEasingLinear,
+    .truncation = 2.0f,
+};
+
+bool gaussianFilterKernelParametersEqual(const GaussianFilterKernelParameters_t * parameters, const GaussianFilterKernelParameters_t * otherParameters)
+{
+    return parameters->kernelCount == otherParameters->kernelCount &&
+           parameters->minSigma == otherParameters->minSigma &&
+           parameters->maxSigma == otherParameters->maxSigma &&
+           parameters->sigmaEasing == otherParameters->sigmaEasing &&
+           parameters->truncation == otherParameters->truncation;
+}
+
+#pragma mark -
+#pragma mark Precomputed tables
+
+/*
+ This values are generated from the matlab script:
+ docs/matlab/LAUCaptureVideoPreviewLayer.m
+ See project documentation for more details
+ */
+
+// Number of generated filter kernels
+static unsigned int const kGaussianFilterKernelCount = 11;
+
+// For each step [0,1] there's a different kernel.
+// These kernels are used to animate between filter intensity values
+static float const kDtsGaussianFilterKernel[11][45] = {
+    { /* t */ 0.000000, /* sigma */ 0.250000, /* size */ 3, /* weights */ 0.000335,0.999330,0.000335 },
+    { /* t */ 0.100000, /* sigma */ 1.697019, /* size */ 9, /* weights */ 0.014720,0.049627,0.118230,0.199036,0.236774,0.199036,0.118230,0.049627,0.014720 },
+    { /* t */ 0.200000, /* sigma */ 3.108407, /* size */ 15, /* weights */ 0.010325,0.020232,0.035748,0.056954,0.081816,0.105976,0.123774,0.130348,0.123774,0.105976,0.081816,0.056954,0.035748,0.020232,0.010325 },
+    { /* t */ 0.300000, /* sigma */ 4.449412, /* size */ 19, /* weights */ 0.011980,0.018404,0.026881,0.037328,0.049282,0.061860,0.073822,0.083759,0.090352,0.092663,0.090352,0.083759,0.073822,0.061860,0.049282,0.037328,0.026881,0.018404,0.011980 },
+    { /* t */ 0.400000, /* sigma */ 5.687014, /* size */ 25, /* weights */ 0.007788,0.011113,0.015376,0.020626,0.026825,0.033827,0.041356,0.049022,0.056341,0.062780,0.067825,0.071045,0.072152,0.071045,0.067825,0.062780,0.056341,0.049022,0.041356,0.033827,0.026825,0.020626,0.015376,0.011113,0.007788 },
+    { /* t */ 0.500000, /* sigma */ 6.790738, /* size */ 29, /* weights */ 0.007252,0.009718,0.012744,0.016353,0.020535,0.025232,0.030340,0.035698,0.041102,0.046308,0.051055,0.055081,0.058149,0.060072,0.060727,0.060072,0.058149,0.055081,0.051055,0.046308,0.041102,0.035698,0.030340,0.025232,0.020535,0.016353,0.012744,0.009718,0.007252 },
+    { /* t */ 0.600000, /* sigma */ 7.733407, /* size */ 33, /* weights */ 0.006273,0.008129,0.010360,0.012983,0.016001,0.019394,0.023116,0.027096,0.031234,0.035407,0.039472,0.043274,0.046656,0.049468,0.051580,0.052890,0.053334,0.052890,0.051580,0.049468,0.046656,0.043274,0.039472,0.035407,0.031234,0.027096,0.023116,0.019394,0.016001,0.012983,0.010360,0.008129,0.006273 },
+    { /* t */ 0.700000, /* sigma */ 8.491810, /* size */ 35, /* weights */ 0.006592,0.008287,0.010274,0.012562,0.015149,0.018016,0.021131,0.024443,0.027885,0.031373,0.034812,0.038095,0.041115,0.043762,0.045939,0.047559,0.048559,0.048897,0.048559,0.047559,0.045939,0.043762,0.041115,0.038095,0.034812,0.031373,0.027885,0.024443,0.021131,0.018016,0.015149,0.012562,0.010274,0.008287,0.006592 },
+    { /* t */ 0.800000, /* sigma */ 9.047273, /* size */ 39, /* weights */ 0.005016,0.006289,0.007788,0.009527,0.011513,0.013744,0.016209,0.018883,0.021732,0.024706,0.027746,0.030783,0.033736,0.036525,0.039063,0.041271,0.043074,0.044410,0.045231,0.045508,0.045231,0.044410,0.043074,0.041271,0.039063,0.036525,0.033736,0.030783,0.027746,0.024706,0.021732,0.018883,0.016209,0.013744,0.011513,0.009527,0.007788,0.006289,0.005016 },
+    { /* t */ 0.900000, /* sigma */ 9.386117, /* size */ 39, /* weights */ 0.005692,0.007023,0.008566,0.010330,0.012317,0.014521,0.016926,0.019506,0.022226,0.025039,0.027890,0.030715,0.033444,0.036005,0.038324,0.040333,0.041967,0.043175,0.043917,0.044167,0.043917,0.043175,0.041967,0.040333,0.038324,0.036005,0.033444,0.030715,0.027890,0.025039,0.022226,0.019506,0.016926,0.014521,0.012317,0.010330,0.008566,0.007023,0.005692 },
+    { /* t */ 1.000000, /* sigma */ 9.500000, /* size */ 39, /* weights */ 0.005920,0.007267,0.008822,0.010592,0.012576,0.014768,0.017151,0.019699,0.022376,0.025137,0.027927,0.030686,0.033345,0.035835,0.038086,0.040034,0.041617,0.042786,0.043503,0.043744,0.043503,0.042786,0.041617,0.040034,0.038086,0.035835,0.033345,0.030686,0.027927,0.025137,0.022376,0.019699,0.017151,0.014768,0.012576,0.010592,0.008822,0.007267,0.005920 },
+ 
+};
+
+// For each step [0,1] there's a different kernel.
+// These kernels are used to animate between filter intensity values
+static float const kBtsGaussianFilterKernel[11][25] = {
+    { /* t */ 0.000000, /* sigma */ 0.250000, /* size */ 3, /* samples */ 10, /* offsets */ 0.000670,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000, /* weights */ 0.500000,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000 },
+    { /* t */ 0.100000, /* sigma */ 1.175000, /* size */ 7, /* samples */ 10, /* offsets */ 0.582001,2.140545,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000, /* weights */ 0.407006,0.092994,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000 },
+    { /* t */ 0.200000, /* sigma */ 2.100000, /* size */ 11, /* samples */ 10, /* offsets */ 0.641014,2.361954,4.264948,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000, /* weights */ 0.266782,0.190745,0.042473,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000 },
+    { /* t */ 0.300000, /* sigma */ 3.025000, /* size */ 15, /* samples */ 10, /* offsets */ 0.654416,2.432120,4.379477,6.329525,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000, /* weights */ 0.193274,0.189051,0.089808,0.027867,0.000000,0.000000,0.000000,0.000000,0.000000,0.000000 },
+    { /* t */ 0.400000, /* sigma */ 3.950000, /* size */ 17, /* samples */ 10, /* offsets */ 0.000000,1.475984,3.444153,5.412774,7.382089,0.000000,0.000000,0.000000,0.000000,0.000000, /* weights */ 0.052112,0.192622,0.140526,0.079658,0.035082,0.000000,0.000000,0.000000,0.000000,0.000000 },
+    { /* t */ 0.500000, /* sigma */ 4.875000, /* size */ 21, /* samples */ 10, /* offsets */ 0.000000,1.484226,3.463249,5.442400,7.421753,9.401376,0.000000,0.000000,0.000000,0.000000, /* weights */ 0.042224,0.160323,0.130192,0.089504,0.052091,0.025665,0.000000,0.000000,0.000000,0.000000 },
+    { /* t */ 0.600000, /* sigma */ 5.800000, /* size */ 25, /* samples */ 10, /* offsets */ 0.000000,1.488854,3.474013,5.459217,7.444493,9.429865,11.415359,0.000000,0.000000,0.000000, /* weights */ 0.035490,0.136814,0.118049,0.090517,0.061680,0.037350,0.020099,0.000000,0.000000,0.000000 },
+    { /* t */ 0.700000, /* sigma */ 6.725000, /* size */ 29, /* samples */ 10, /* offsets */ 0.000000,1.491709,3.480662,5.469634,7.458636,9.447678,11.436770,13.425923,0.000000,0.000000, /* weights */ 0.030607,0.119109,0.106707,0.087548,0.065781,0.045264,0.028523,0.016461,0.000000,0.000000 },
+    { /* t */ 0.800000, /* sigma */ 7.650000, /* size */ 33, /* samples */ 10, /* offsets */ 0.000000,1.493593,3.485053,5.476522,7.468005,9.459506,11.451031,13.442584,15.434171,0.000000, /* weights */ 0.026906,0.105358,0.096766,0.083027,0.066551,0.049835,0.034863,0.022784,0.013910,0.000000 },
+    { /* t */ 0.900000, /* sigma */ 8.575000, /* size */ 37, /* samples */ 10, /* offsets */ 0.000000,1.494900,3.488102,5.481309,7.474523,9.467745,11.460980,13.454229,15.447495,17.440780, /* weights */ 0.024003,0.094399,0.088214,0.078084,0.065469,0.051996,0.039117,0.027874,0.018815,0.012030 },
+    { /* t */ 1.000000, /* sigma */ 9.500000, /* size */ 39, /* samples */ 10, /* offsets */ 0.665434,2.493075,4.487537,6.482002,8.476472,10.470947,12.465429,14.459920,16.454421,18.448932, /* weights */ 0.065375,0.084402,0.078120,0.069179,0.058613,0.047513,0.036851,0.027345,0.019414,0.013187 },
+};
+
+unsigned int gaussianFilterKernelCount(void)
+{
+    return kGaussianFilterKernelCount;
+}
+
+#pragma mark -
+#pragma mark Generator
+
+float gaussianFilterStepForKernelIndex(const GaussianFilterKernelParameters_t * parameters, unsigned int kernelIndex)
+{
+    assert(kernelIndex < parameters->kernelCount);
+
+    if (parameters->kernelCount < 2)
+    {
+        return 0.0f;
+    }
+
+    return (float)kernelIndex / (float)(parameters->kernelCount - 1);
+}
+
+float gaussianFilterSigmaForStep(const GaussianFilterKernelParameters_t * parameters, float step)
+{
+    double t = fmax(0.0, fmin(1.0, step));
+
+    switch (parameters->sigmaEasing)
+    {
+        case GaussianFilterSigmaEasingEaseOutQuad:
+            t = sin(t * M_PI * 0.5);
+            break;
+        case GaussianFilterSigmaEasingSmoothStep:
+            t = t * t * (3.0 - 2.0 * t);
+            break;
+        case GaussianFilterSigmaEasingLinear:
+        default:
+            break;
+    }
+
+    return (float)((1.0 - t) * parameters->minSigma + t * parameters->maxSigma);
+}
+
+float gaussianFilterStepForSigma(const GaussianFilterKernelParameters_t * parameters, float sigma)
+{
+    if (parameters->maxSigma <= parameters->minSigma)
+    {
+        return 0.0f;
+    }
+
+    double t = ((double)sigma - parameters->minSigma) / ((double)parameters->maxSigma - parameters->minSigma);
+    t = fmax(0.0, fmin(1.0, t));
+
+    // Out of range sigmas map exactly to the ends (the inverse easings round)
+    if (t == 0.0 || t == 1.0)
+    {
+        return (float)t;
+    }
+
+    switch (parameters->sigmaEasing)
+    {
+        case GaussianFilterSigmaEasingEaseOutQuad:
+            t = asin(t) / (M_PI * 0.5);
+            break;
+        case GaussianFilterSigmaEasingSmoothStep:
+            // Root of 3t^2 - 2t^3 = x in [0,1]
+            t = 0.5 - sin(asin(1.0 - 2.0 * t) / 3.0);
+            break;
+        case GaussianFilterSigmaEasingLinear:
+        default:
+            break;
+    }
+
+    return (float)t;
+}
+
+unsigned int gaussianFilterSizeForSigma(float sigma, float truncation)
+{
+    if (sigma <= 0.0f)
+    {
+        return 1;
+    }
+
+    return 2 * (unsigned int)ceil((double)truncation * (double)sigma) + 1;
+}
+
+unsigned int gaussianFilterRadiusForSize(unsigned int size)
+{
+    return size / 2;
+}
+
+unsigned int btsGaussianFilterSamplesForSize(unsigned int size)
+{
+    return (size / 2) / 2 + 1;
+}
+
+// Unnormalized weight of a pixel at a distance from the kernel center
+static double gaussian(double distance, double sigma)
+{
+    if (sigma <= 0.0)
+    {
+        return distance == 0.0 ? 1.0 : 0.0;
+    }
+
+    return exp(-(distance * distance) / (2.0 * sigma * sigma));
+}
+
+static double gaussianSum(double sigma, unsigned int size)
+{
+    double radius = gaussianFilterRadiusForSize(size);
+    double sum = 0.0;
+    for (unsigned int i = 0; i < size; ++i)
+    {
+        sum += gaussian(i - radius, sigma);
+    }
+    return sum;
+}
+
+void generateDtsGaussianFilterWeights(float sigma, unsigned int size, float * weights)
+{
+    double radius = gaussianFilterRadiusForSize(size);
+    double sum = gaussianSum(sigma, size);
+
+    // Normalized so that the weights sum to 1
+    for (unsigned int i = 0; i < size; ++i)
+    {
+        weights[i] = (float)(gaussian(i - radius, sigma) / sum);
+    }
+}
+
+void generateBtsGaussianFilterOffsetsAndWeights(float sigma, unsigned int size, unsigned int samples, float * offsets, float * weights)
+{
+    unsigned int btsSamples = btsGaussianFilterSamplesForSize(size);
+
+    assert(samples >= btsSamples);
+
+    memset(offsets, 0, samples * sizeof(float));
+    memset(weights, 0, samples * sizeof(float));
+
+    // Pixels are numbered [1,m] like in the matlab script, the center pixel is ceil(m/2)
+    double sum = gaussianSum(sigma, size);
+    long centerPixel = (size + 1) / 2;
+#define dtsWeight(pixel) (gaussian((double)((pixel) - centerPixel), sigma) / sum)
+
+    // Start with the edge of the kernel towards the center,
+    // each pair of pixels (current + neighbor) is merged into one bilinear sample
+    long currentPixel = size;
+    long neighborPixel = currentPixel - 1;
+    long btsIndex = btsSamples - 1;
+    double btsWeightsSum = 0.0;
+    while (currentPixel > centerPixel)
+    {
+        neighborPixel = currentPixel - 1;
+
+        // Skip the center pixel and neighbor, the weight of both is calculated at the end
+        if (neighborPixel != centerPixel)
+        {
+            double weightCurrentPixel = dtsWeight(currentPixel);
+            double weightNeighborPixel = dtsWeight(neighborPixel);
+
+            // The offset is interpolated based on the weight of both
+            weights[btsIndex] = (float)(weightCurrentPixel + weightNeighborPixel);
+            offsets[btsIndex] = (float)((neighborPixel - centerPixel) + weightCurrentPixel / (weightCurrentPixel + weightNeighborPixel));
+            btsWeightsSum += weightCurrentPixel + weightNeighborPixel;
+            --btsIndex;
+        }
+
+        currentPixel -= 2; // Skip neighbor pixel
+    }
+
+    // The total must be 0.5 for each side, so the center weight = 0.5 - sum
+    weights[0] = (float)(0.5 - btsWeightsSum);
+
+    // If the center sample also includes the neighbors, the center pixel is split in 2 samples
+    if (neighborPixel == centerPixel)
+    {
+        double weightCenterPixel = dtsWeight(centerPixel);
+        double weightNeighborPixel = dtsWeight(centerPixel + 1);
+        offsets[0] = (float)(weightNeighborPixel / (weightNeighborPixel + weightCenterPixel / 2.0));
+    }
+    else
+    {
+        offsets[0] = 0.0f; // only the center pixel
+    }
+
+#undef dtsWeight
+}
+
+#pragma mark -
+#pragma mark Kernel bank
+
+unsigned int dtsGaussianFilterMaxSize(const GaussianFilterKernelParameters_t * parameters)
+{
+    return gaussianFilterSizeForSigma(fmaxf(parameters->minSigma, parameters->maxSigma), parameters->truncation);
+}
+
+unsigned int btsGaussianFilterMaxSamples(const GaussianFilterKernelParameters_t * parameters)
+{
+    return btsGaussianFilterSamplesForSize(dtsGaussianFilterMaxSize(parameters));
+}
+
+unsigned int dtsGaussianFilterSizeForIndex(const GaussianFilterKernelParameters_t * parameters, unsigned int kernelIndex)
+{
+    float sigma = gaussianFilterSigmaForStep(parameters, gaussianFilterStepForKernelIndex(parameters, kernelIndex));
+
+    return gaussianFilterSizeForSigma(sigma, parameters->truncation);
+}
+
+void dtsGaussianFilterKernelForIndex(const GaussianFilterKernelParameters_t * parameters, unsigned int kernelIndex, float * weights)
+{
+    unsigned int size = dtsGaussianFilterSizeForIndex(parameters, kernelIndex);
+
+    if (gaussianFilterKernelParametersEqual(parameters, &kDtsGaussianFilterKernelDefaultParameters))
+    {
+        assert(size == dtsGaussianFilterSizeForKernelIndex(kernelIndex));
+        memcpy(weights, &kDtsGaussianFilterKernel[kernelIndex][3], size * sizeof(float));
+        return;
+    }
+
+    float sigma = gaussianFilterSigmaForStep(parameters, gaussianFilterStepForKernelIndex(parameters, kernelIndex));
+    generateDtsGaussianFilterWeights(sigma, size, weights);
+}
+
+void btsGaussianFilterKernelForIndex(const GaussianFilterKernelParameters_t * parameters, unsigned int kernelIndex, float * offsets, float * weights)
+{
+    unsigned int samples = btsGaussianFilterMaxSamples(parameters);
+
+    if (gaussianFilterKernelParametersEqual(parameters, &kBtsGaussianFilterKernelDefaultParameters))
+    {
+        assert(samples == btsGaussianFilterSamplesForKernelIndex(kernelIndex));
+        memcpy(offsets, &kBtsGaussianFilterKernel[kernelIndex][4], samples * sizeof(float));
+        memcpy(weights, &kBtsGaussianFilterKernel[kernelIndex][4+samples], samples * sizeof(float));
+        return;
+    }
+
+    float sigma = gaussianFilterSigmaForStep(parameters, gaussianFilterStepForKernelIndex(parameters, kernelIndex));
+    unsigned int size = gaussianFilterSizeForSigma(sigma, parameters->truncation);
+    generateBtsGaussianFilterOffsetsAndWeights(sigma, size, samples, offsets, weights);
+}
+
+unsigned int btsGaussianFilterKernelBankStride(const GaussianFilterKernelParameters_t * parameters)
+{
+    // Whole vec4 uniforms per kernel
+    return 4 * ((btsGaussianFilterMaxSamples(parameters) + 3) / 4);
+}
+
+void btsGaussianFilterKernelBank(const GaussianFilterKernelParameters_t * parameters, float * offsets, float * weights)
+{
+    unsigned int stride = btsGaussianFilterKernelBankStride(parameters);
+
+    memset(offsets, 0, parameters->kernelCount * stride * sizeof(float));
+    memset(weights, 0, parameters->kernelCount * stride * sizeof(float));
+
+    for (unsigned int kernelIndex = 0; kernelIndex < parameters->kernelCount; ++kernelIndex)
+    {
+        btsGaussianFilterKernelForIndex(parameters, kernelIndex, &offsets[kernelIndex * stride], &weights[kernelIndex * stride]);
+    }
+}
+
+float gaussianFilterKernelBankPositionForStep(const GaussianFilterKernelParameters_t * parameters, float step)
+{
+    if (parameters->kernelCount < 2)
+    {
+        return 0.0f;
+    }
+
+    return fmaxf(0.0f, fminf(1.0f, step)) * (parameters->kernelCount - 1);
+}
+
+// First of the two kernels blended at a position (the last two kernels at the end of the bank)
+static unsigned int kernelBankIndexForPosition(const GaussianFilterKernelParameters_t * parameters, float position, float * blend)
+{
+    if (parameters->kernelCount < 2)
+    {
+        *blend = 0.0f;
+        return 0;
+    }
+
+    float kernelPosition = fmaxf(0.0f, fminf(parameters->kernelCount - 1, position));
+    float kernelIndex = fminf(floorf(kernelPosition), parameters->kernelCount - 2);
+    *blend = kernelPosition - kernelIndex;
+
+    return (unsigned int)kernelIndex;
+}
+
+unsigned int gaussianFilterKernelBankSizeForPosition(const GaussianFilterKernelParameters_t * parameters, float position)
+{
+    float blend;
+    unsigned int kernelIndex = kernelBankIndexForPosition(parameters, position, &blend);
+    unsigned int size = dtsGaussianFilterSizeForIndex(parameters, kernelIndex);
+
+    // The second kernel has zero weights at integer positions
+    if (blend > 0.0f)
+    {
+        unsigned int nextSize = dtsGaussianFilterSizeForIndex(parameters, kernelIndex + 1);
+        size = nextSize > size ? nextSize : size;
+    }
+
+    return size;
+}
+
+void btsGaussianFilterKernelBankKernelForPosition(const GaussianFilterKernelParameters_t * parameters, float position, float * offsets, float * weights)
+{
+    unsigned int samples = btsGaussianFilterMaxSamples(parameters);
+    float blend;
+    unsigned int kernelIndex = kernelBankIndexForPosition(parameters, position, &blend);
+
+    btsGaussianFilterKernelForIndex(parameters, kernelIndex, offsets, weights);
+
+    if (parameters->kernelCount < 2)
+    {
+        return;
+    }
+
+    float nextOffsets[samples], nextWeights[samples];
+    btsGaussianFilterKernelForIndex(parameters, kernelIndex + 1, nextOffsets, nextWeights);
+
+    // Same as mix() in the kernel bank shaders
+    for (unsigned int i = 0; i < samples; ++i)
+    {
+        offsets[i] = offsets[i] * (1.0f - blend) + nextOffsets[i] * blend;
+        weights[i] = weights[i] * (1.0f - blend) + nextWeights[i] * blend;
+    }
+}
+
+#pragma mark -
+#pragma mark Kernel cache
+
+struct GaussianFilterKernelCacheEntry {
+    GaussianFilterKernel_t kernel;
+    long key; // Quantized step, -1 if the entry is empty
+    unsigned long lastUse;
+};
+
+typedef struct GaussianFilterKernelCacheEntry GaussianFilterKernelCacheEntry_t;
+
+struct GaussianFilterKernelCache {
+    GaussianFilterKernelParameters_t parameters;
+    GaussianFilterKernelType_t type;
+    GaussianFilterKernelCacheEntry_t * entries;
+    unsigned int capacity;
+    unsigned long clock;
+    unsigned long hits;
+    unsigned long misses;
+};
+
+GaussianFilterKernelCache_t * createGaussianFilterKernelCache(const GaussianFilterKernelParameters_t * parameters, GaussianFilterKernelType_t type, unsigned int capacity)
+{
+    assert(capacity > 0);
+
+    GaussianFilterKernelCache_t * cache = (GaussianFilterKernelCache_t *)calloc(1, sizeof(GaussianFilterKernelCache_t));
+    if (!cache)
+    {
+        return NULL;
+    }
+
+    cache->parameters = *parameters;
+    cache->type = type;
+    cache->capacity = capacity;
+    cache->entries = (GaussianFilterKernelCacheEntry_t *)calloc(capacity, sizeof(GaussianFilterKernelCacheEntry_t));
+    if (!cache->entries)
+    {
+        free(cache);
+        return NULL;
+    }
+
+    // Allocate the largest kernel for every entry, so that a miss doesn't allocate memory
+    unsigned int maxSize = dtsGaussianFilterMaxSize(parameters);
+    unsigned int maxSamples = btsGaussianFilterMaxSamples(parameters);
+    for (unsigned int i = 0; i < capacity; ++i)
+    {
+        GaussianFilterKernelCacheEntry_t * entry = &cache->entries[i];
+        entry->key = -1;
+
+        if (type == GaussianFilterKernelTypeBts)
+        {
+            entry->kernel.offsets = (float *)calloc(maxSamples, sizeof(float));
+            entry->kernel.weights = (float *)calloc(maxSamples, sizeof(float));
+        }
+        else
+        {
+            entry->kernel.weights = (float *)calloc(maxSize, sizeof(float));
+        }
+
+        if (!entry->kernel.weights || (type == GaussianFilterKernelTypeBts && !entry->kernel.offsets))
+        {
+            releaseGaussianFilterKernelCache(cache);
+            return NULL;
+        }
+    }
+
+    return cache;
+}
+
+void releaseGaussianFilterKernelCache(GaussianFilterKernelCache_t * cache)
+{
+    if (!cache)
+    {
+        return;
+    }
+
+    for (unsigned int i = 0; i < cache->capacity; ++i)
+    {
+        free(cache->entries[i].kernel.offsets);
+        free(cache->entries[i].kernel.weights);
+    }
+
+    free(cache->entries);
+    free(cache);
+}
+
+const GaussianFilterKernel_t * gaussianFilterKernelCacheKernelForStep(GaussianFilterKernelCache_t * cache, float step)
+{
+    long key = lroundf(fmaxf(0.0f, fminf(1.0f, step)) * kGaussianFilterKernelCacheStepResolution);
+
+    // Look up the key, remember the least recently used entry in case it's a miss
+    GaussianFilterKernelCacheEntry_t * leastRecentlyUsedEntry = &cache->entries[0];
+    for (unsigned int i = 0; i < cache->capacity; ++i)
+    {
+        GaussianFilterKernelCacheEntry_t * entry = &cache->entries[i];
+
+        if (entry->key == key)
+        {
+            entry->lastUse = ++cache->clock;
+            ++cache->hits;
+            return &entry->kernel;
+        }
+
+        if (entry->lastUse < leastRecentlyUsedEntry->lastUse)
+        {
+            leastRecentlyUsedEntry = entry;
+        }
+    }
+
+    // Generate the kernel in place of the least recently used entry
+    GaussianFilterKernel_t * kernel = &leastRecentlyUsedEntry->kernel;
+    kernel->step = (float)key / kGaussianFilterKernelCacheStepResolution;
+    kernel->sigma = gaussianFilterSigmaForStep(&cache->parameters, kernel->step);
+    kernel->size = gaussianFilterSizeForSigma(kernel->sigma, cache->parameters.truncation);
+    kernel->radius = gaussianFilterRadiusForSize(kernel->size);
+
+    if (cache->type == GaussianFilterKernelTypeBts)
+    {
+        kernel->samples = btsGaussianFilterMaxSamples(&cache->parameters);
+        generateBtsGaussianFilterOffsetsAndWeights(kernel->sigma, kernel->size, kernel->samples, kernel->offsets, kernel->weights);
+    }
+    else
+    {
+        kernel->samples = 0;
+        generateDtsGaussianFilterWeights(kernel->sigma, kernel->size, kernel->weights);
+    }
+
+    leastRecentlyUsedEntry->key = key;
+    leastRecentlyUsedEntry->lastUse = ++cache->clock;
+    ++cache->misses;
+
+    return kernel;
+}
+
+void gaussianFilterKernelCacheStatistics(const GaussianFilterKernelCache_t * cache, unsigned long * hits, unsigned long * misses)
+{
+    if (hits)
+    {
+        *hits = cache->hits;
+    }
+
+    if (misses)
+    {
+        *misses = cache->misses;
+    }
+}
+
+#pragma mark -
+#pragma mark Dual filter (pyramid)
+
+float dualFilterSigma(unsigned int levelCount, float offset)
+{
+    double clampedOffset = fmax(kDualFilterMinOffset, fmin(kDualFilterMaxOffset, offset));
+    double variance = (2.0 * clampedOffset - 0.25) * (pow(4.0, levelCount) - 1.0) / 3.0;
+
+    return (float)sqrt(variance);
+}
+
+unsigned int dualFilterLevelCountForSigma(float sigma, unsigned int maxLevelCount, float * offset)
+{
+    assert(maxLevelCount > 0);
+
+    // Use the first level count that reaches sigma without spreading the taps too much
+    unsigned int levelCount = 1;
+    double levelOffset = kDualFilterMaxOffset;
+    for (; levelCount <= maxLevelCount; ++levelCount)
+    {
+        levelOffset = (3.0 * sigma * sigma / (pow(4.0, levelCount) - 1.0) + 0.25) / 2.0;
+
+        if (levelOffset <= kDualFilterMaxOffset || levelCount == maxLevelCount)
+        {
+            break;
+        }
+    }
+
+    *offset = (float)fmax(kDualFilterMinOffset, fmin(kDualFilterMaxOffset, levelOffset));
+
+    return levelCount;
+}
+
+#pragma mark -
+#pragma mark Separable filtering with discrete texture sampling weights
+
+float dtsGaussianFilterStepForKernelIndex(int kernelIndex)
+{
+    assert(kernelIndex >= 0 && (unsigned int)kernelIndex < kGaussianFilterKernelCount);
+    
+    return kDtsGaussianFilterKernel[kernelIndex][0];
+}
+
+float dtsGaussianFilterSigmaForKernelIndex(int kernelIndex)
+{
+    assert(kernelIndex >= 0 && (unsigned int)kernelIndex < kGaussianFilterKernelCount);
+    
+    return kDtsGaussianFilterKernel[kernelIndex][1];
+}
+
+unsigned int dtsGaussianFilterSizeForKernelIndex(int kernelIndex)
+{
+    assert(kernelIndex >= 0 && (unsigned int)kernelIndex < kGaussianFilterKernelCount);
+    
+    return (unsigned int)kDtsGaussianFilterKernel[kernelIndex][2];
+}
+
+unsigned int dtsGaussianFilterRadiusForKernelIndex(int kernelIndex)
+{
+    assert(kernelIndex >= 0 && (unsigned int)kernelIndex < kGaussianFilterKernelCount);
+    
+    return (unsigned int)floor(dtsGaussianFilterSizeForKernelIndex(kernelIndex)/2.0f);
+}
+
+float dtsGaussianFilterWeightForIndexes(int kernelIndex, int weightIndex)
+{
+    assert(kernelIndex >= 0 && (unsigned int)kernelIndex < kGaussianFilterKernelCount);
+
+    unsigned int size = dtsGaussianFilterSizeForKernelIndex(kernelIndex);
+    
+    assert(weightIndex >= 0 && (unsigned int)weightIndex < size);
+    
+    return kDtsGaussianFilterKernel[kernelIndex][3+weightIndex]; // TODO make this safer :)
+}
+
+#pragma mark -
+#pragma mark Bilinear texture sampling weights and offsets
+
+float btsGaussianFilterStepForKernelIndex(int kernelIndex)
+{
+    assert(kernelIndex >= 0 && (unsigned int)kernelIndex < kGaussianFilterKernelCount);
+    
+    return kBtsGaussianFilterKernel[kernelIndex][0];
+}
+
+float btsGaussianFilterSigmaForKernelIndex(int kernelIndex)
+{
+    assert(kernelIndex >= 0 && (unsigned int)kernelIndex < kGaussianFilterKernelCount);
+    
+    return kBtsGaussianFilterKernel[kernelIndex][1];
+}
+
+unsigned int btsGaussianFilterSizeForKernelIndex(int kernelIndex)
+{
+    assert(kernelIndex >= 0 && (unsigned int)kernelIndex < kGaussianFilterKernelCount);
+    
+    return (unsigned int)kBtsGaussianFilterKernel[kernelIndex][2];
+}
+
+unsigned int btsGaussianFilterRadiusForKernelIndex(int kernelIndex)
+{
+    assert(kernelIndex >= 0 && (unsigned int)kernelIndex < kGaussianFilterKernelCount);
+    
+    return (unsigned int)floor(btsGaussianFilterSizeForKernelIndex(kernelIndex)/2.0f);
+}
+
+unsigned int btsGaussianFilterSamplesForKernelIndex(int kernelIndex)
+{
+    assert(kernelIndex >= 0 && (unsigned int)kernelIndex < kGaussianFilterKernelCount);
+    
+    return (unsigned int)kBtsGaussianFilterKernel[kernelIndex][3];
+}
+
+float btsGaussianFilterWeightForIndexes(int kernelIndex, int sampleIndex)
+{
+    assert(kernelIndex >= 0 && (unsigned int)kernelIndex < kGaussianFilterKernelCount);
+    
+    unsigned int samples = btsGaussianFilterSamplesForKernelIndex(kernelIndex);
+    
+    assert(sampleIndex >= 0 && (unsigned int)sampleIndex < samples);
+    
+    return kBtsGaussianFilterKernel[kernelIndex][4+samples+sampleIndex]; // TODO make this safer :)
+}
+
+float btsGaussianFilterOffsetForIndexes(int kernelIndex, int sampleIndex)
+{
+    assert(kernelIndex >= 0 && (unsigned int)kernelIndex < kGaussianFilterKernelCount);
+    
+    unsigned int samples = btsGaussianFilterSamplesForKernelIndex(kernelIndex);
+    
+    assert(sampleIndex >= 0 && (unsigned int)sampleIndex < samples);
+    
+    return kBtsGaussianFilterKernel[kernelIndex][4+sampleIndex]; // TODO make this safer :)
+}
@@ -0,0 +1,563 @@
+/*
+
+ LAUCaptureVideoPreviewLayerImageCompare.c
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "LAUCaptureVideoPreviewLayerImageCompare.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #define ImageCompareSSE2Available 1
+    #include <emmintrin.h>
+#else
+    #define ImageCompareSSE2Available 0
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define ImageCompareNEONAvailable 1
+    #include <arm_neon.h>
+#else
+    #define ImageCompareNEONAvailable 0
+#endif
+
+// SSIM window (2x2 blocks of 4x4 pixels, a window every block)
+#define kImageCompareBlockSize 4
+#define kImageCompareWindowSize 8
+
+// SSIM constants, (K * L)^2 with L = 255
+#define kImageCompareSSIMC1 (0.01 * 255.0 * 0.01 * 255.0)
+#define kImageCompareSSIMC2 (0.03 * 255.0 * 0.03 * 255.0)
+
+// Vector iterations between flushes of the 32 bit squared error sums (4096 * 4 * 255^2 < 2^32)
+#define kImageCompareSquaredErrorFlushInterval 4096
+
+// Luma sums of a row of 4x4 blocks
+struct BlockSums {
+    uint32_t * x;
+    uint32_t * y;
+    uint32_t * xx;
+    uint32_t * yy;
+    uint32_t * xy;
+};
+
+typedef struct BlockSums BlockSums_t;
+
+typedef void (*DifferenceRowFunction)(const uint8_t * pixels, const uint8_t * otherPixels, size_t width, unsigned int * maxDifference, uint64_t * squaredErrorSum);
+typedef void (*LumaRowFunction)(const uint8_t * pixels, size_t width, uint8_t * luma);
+typedef void (*BlockSumsRowFunction)(const uint8_t * luma, const uint8_t * otherLuma, size_t blockCount, const BlockSums_t * sums);
+
+struct ImageCompareFunctions {
+    DifferenceRowFunction differenceRow;
+    LumaRowFunction lumaRow;
+    BlockSumsRowFunction blockSumsRow;
+};
+
+typedef struct ImageCompareFunctions ImageCompareFunctions_t;
+
+#pragma mark -
+#pragma mark Rows (Scalar)
+
+static void differenceRowScalar(const uint8_t * pixels, const uint8_t * otherPixels, size_t width, unsigned int * maxDifference, uint64_t * squaredErrorSum)
+{
+    unsigned int rowMaxDifference = *maxDifference;
+    uint64_t rowSquaredErrorSum = 0;
+
+    for (size_t x = 0; x < width; ++x)
+    {
+        for (size_t c = 0; c < 3; ++c)
+        {
+            int difference = abs((int)pixels[4 * x + c] - (int)otherPixels[4 * x + c]);
+            rowMaxDifference = (unsigned int)difference > rowMaxDifference ? (unsigned int)difference : rowMaxDifference;
+            rowSquaredErrorSum += (uint64_t)(difference * difference);
+        }
+    }
+
+    *maxDifference = rowMaxDifference;
+    *squaredErrorSum += rowSquaredErrorSum;
+}
+
+static void lumaRowScalar(const uint8_t * pixels, size_t width, uint8_t * luma)
+{
+    for (size_t x = 0; x < width; ++x)
+    {
+        luma[x] = (uint8_t)((pixels[4 * x] + 2 * pixels[4 * x + 1] + pixels[4 * x + 2] + 2) >> 2);
+    }
+}
+
+static void blockSumsRowScalar(const uint8_t * luma, const uint8_t * otherLuma, size_t blockCount, const BlockSums_t * sums)
+{
+    for (size_t b = 0; b < blockCount; ++b)
+    {
+        for (size_t i = 0; i < kImageCompareBlockSize; ++i)
+        {
+            uint32_t x = luma[kImageCompareBlockSize * b + i];
+            uint32_t y = otherLuma[kImageCompareBlockSize * b + i];
+
+            sums->x[b] += x;
+            sums->y[b] += y;
+            sums->xx[b] += x * x;
+            sums->yy[b] += y * y;
+            sums->xy[b] += x * y;
+        }
+    }
+}
+
+// Remaining blocks (tail of a vectorized row)
+static void blockSumsRowTail(const uint8_t * luma, const uint8_t * otherLuma, size_t firstBlock, size_t blockCount, const BlockSums_t * sums)
+{
+    BlockSums_t tailSums = {
+        sums->x + firstBlock, sums->y + firstBlock, sums->xx + firstBlock, sums->yy + firstBlock, sums->xy + firstBlock
+    };
+
+    blockSumsRowScalar(luma + kImageCompareBlockSize * firstBlock, otherLuma + kImageCompareBlockSize * firstBlock, blockCount - firstBlock, &tailSums);
+}
+
+#pragma mark -
+#pragma mark Rows (SSE2)
+
+#if ImageCompareSSE2Available
+static void differenceRowSSE2(const uint8_t * pixels, const uint8_t * otherPixels, size_t width, unsigned int * maxDifference, uint64_t * squaredErrorSum)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i colorMask = _mm_set1_epi32(0x00ffffff);
+
+    __m128i maxDifferences = zero;
+    __m128i squaredErrors = zero;
+    uint32_t squaredErrorLanes[4];
+    size_t iterations = 0;
+
+    size_t x = 0;
+
+    // 4 pixels per iteration
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128i values = _mm_loadu_si128((const __m128i *)(pixels + 4 * x));
+        __m128i otherValues = _mm_loadu_si128((const __m128i *)(otherPixels + 4 * x));
+
+        // |a - b| with saturated subtractions, alpha masked out
+        __m128i differences = _mm_and_si128(_mm_or_si128(_mm_subs_epu8(values, otherValues), _mm_subs_epu8(otherValues, values)), colorMask);
+        maxDifferences = _mm_max_epu8(maxDifferences, differences);
+
+        __m128i differencesLow = _mm_unpacklo_epi8(differences, zero);
+        __m128i differencesHigh = _mm_unpackhi_epi8(differences, zero);
+        squaredErrors = _mm_add_epi32(squaredErrors, _mm_add_epi32(_mm_madd_epi16(differencesLow, differencesLow), _mm_madd_epi16(differencesHigh, differencesHigh)));
+
+        if (++iterations == kImageCompareSquaredErrorFlushInterval)
+        {
+            _mm_storeu_si128((__m128i *)squaredErrorLanes, squaredErrors);
+            *squaredErrorSum += (uint64_t)squaredErrorLanes[0] + squaredErrorLanes[1] + squaredErrorLanes[2] + squaredErrorLanes[3];
+            squaredErrors = zero;
+            iterations = 0;
+        }
+    }
+
+    _mm_storeu_si128((__m128i *)squaredErrorLanes, squaredErrors);
+    *squaredErrorSum += (uint64_t)squaredErrorLanes[0] + squaredErrorLanes[1] + squaredErrorLanes[2] + squaredErrorLanes[3];
+
+    uint8_t maxDifferenceLanes[16];
+    _mm_storeu_si128((__m128i *)maxDifferenceLanes, maxDifferences);
+    for (size_t i = 0; i < 16; ++i)
+    {
+        *maxDifference = maxDifferenceLanes[i] > *maxDifference ? maxDifferenceLanes[i] : *maxDifference;
+    }
+
+    if (x < width)
+    {
+        differenceRowScalar(pixels + 4 * x, otherPixels + 4 * x, width - x, maxDifference, squaredErrorSum);
+    }
+}
+
+static inline __m128i lumaSSE2(__m128i values)
+{
+    const __m128i channelMask = _mm_set1_epi32(0xff);
+
+    __m128i c0 = _mm_and_si128(values, channelMask);
+    __m128i c1 = _mm_and_si128(_mm_srli_epi32(values, 8), channelMask);
+    __m128i c2 = _mm_and_si128(_mm_srli_epi32(values, 16), channelMask);
+
+    return _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(c0, c2), _mm_add_epi32(_mm_slli_epi32(c1, 1), _mm_set1_epi32(2))), 2);
+}
+
+static void lumaRowSSE2(const uint8_t * pixels, size_t width, uint8_t * luma)
+{
+    size_t x = 0;
+
+    // 16 pixels per iteration, one luma per 32 bit lane
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i luma0 = lumaSSE2(_mm_loadu_si128((const __m128i *)(pixels + 4 * x)));
+        __m128i luma1 = lumaSSE2(_mm_loadu_si128((const __m128i *)(pixels + 4 * x + 16)));
+        __m128i luma2 = lumaSSE2(_mm_loadu_si128((const __m128i *)(pixels + 4 * x + 32)));
+        __m128i luma3 = lumaSSE2(_mm_loadu_si128((const __m128i *)(pixels + 4 * x + 48)));
+
+        _mm_storeu_si128((__m128i *)(luma + x), _mm_packus_epi16(_mm_packs_epi32(luma0, luma1), _mm_packs_epi32(luma2, luma3)));
+    }
+
+    if (x < width)
+    {
+        lumaRowScalar(pixels + 4 * x, width - x, luma + x);
+    }
+}
+
+// Pair sums of 8 pixels (low and high halves) to block sums of 4 blocks
+static inline __m128i blockSumsSSE2(__m128i pairSumsLow, __m128i pairSumsHigh)
+{
+    __m128 low = _mm_castsi128_ps(pairSumsLow);
+    __m128 high = _mm_castsi128_ps(pairSumsHigh);
+
+    __m128i even = _mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i odd = _mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1)));
+
+    return _mm_add_epi32(even, odd);
+}
+
+static inline void accumulateBlockSumsSSE2(uint32_t * sums, __m128i blockSums)
+{
+    _mm_storeu_si128((__m128i *)sums, _mm_add_epi32(_mm_loadu_si128((const __m128i *)sums), blockSums));
+}
+
+static void blockSumsRowSSE2(const uint8_t * luma, const uint8_t * otherLuma, size_t blockCount, const BlockSums_t * sums)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+
+    size_t b = 0;
+
+    // 4 blocks (16 pixels) per iteration, products of pixel pairs with madd
+    for (; b + 4 <= blockCount; b += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(luma + kImageCompareBlockSize * b));
+        __m128i y = _mm_loadu_si128((const __m128i *)(otherLuma + kImageCompareBlockSize * b));
+
+        __m128i xLow = _mm_unpacklo_epi8(x, zero);
+        __m128i xHigh = _mm_unpackhi_epi8(x, zero);
+        __m128i yLow = _mm_unpacklo_epi8(y, zero);
+        __m128i yHigh = _mm_unpackhi_epi8(y, zero);
+
+        accumulateBlockSumsSSE2(sums->x + b, blockSumsSSE2(_mm_madd_epi16(xLow, ones), _mm_madd_epi16(xHigh, ones)));
+        accumulateBlockSumsSSE2(sums->y + b, blockSumsSSE2(_mm_madd_epi16(yLow, ones), _mm_madd_epi16(yHigh, ones)));
+        accumulateBlockSumsSSE2(sums->xx + b, blockSumsSSE2(_mm_madd_epi16(xLow, xLow), _mm_madd_epi16(xHigh, xHigh)));
+        accumulateBlockSumsSSE2(sums->yy + b, blockSumsSSE2(_mm_madd_epi16(yLow, yLow), _mm_madd_epi16(yHigh, yHigh)));
+        accumulateBlockSumsSSE2(sums->xy + b, blockSumsSSE2(_mm_madd_epi16(xLow, yLow), _mm_madd_epi16(xHigh, yHigh)));
+    }
+
+    if (b < blockCount)
+    {
+        blockSumsRowTail(luma, otherLuma, b, blockCount, sums);
+    }
+}
+#endif
+
+#pragma mark -
+#pragma mark Rows (NEON)
+
+#if ImageCompareNEONAvailable
+static void differenceRowNEON(const uint8_t * pixels, const uint8_t * otherPixels, size_t width, unsigned int * maxDifference, uint64_t * squaredErrorSum)
+{
+    const uint8x16_t colorMask = vreinterpretq_u8_u32(vdupq_n_u32(0x00ffffff));
+
+    uint8x16_t maxDifferences = vdupq_n_u8(0);
+    uint32x4_t squaredErrors = vdupq_n_u32(0);
+    uint32_t squaredErrorLanes[4];
+    size_t iterations = 0;
+
+    size_t x = 0;
+
+    // 4 pixels per iteration
+    for (; x + 4 <= width; x += 4)
+    {
+        uint8x16_t differences = vandq_u8(vabdq_u8(vld1q_u8(pixels + 4 * x), vld1q_u8(otherPixels + 4 * x)), colorMask);
+        maxDifferences = vmaxq_u8(maxDifferences, differences);
+
+        squaredErrors = vpadalq_u16(squaredErrors, vmull_u8(vget_low_u8(differences), vget_low_u8(differences)));
+        squaredErrors = vpadalq_u16(squaredErrors, vmull_u8(vget_high_u8(differences), vget_high_u8(differences)));
+
+        if (++iterations == kImageCompareSquaredErrorFlushInterval)
+        {
+            vst1q_u32(squaredErrorLanes, squaredErrors);
+            *squaredErrorSum += (uint64_t)squaredErrorLanes[0] + squaredErrorLanes[1] + squaredErrorLanes[2] + squaredErrorLanes[3];
+            squaredErrors = vdupq_n_u32(0);
+            iterations = 0;
+        }
+    }
+
+    vst1q_u32(squaredErrorLanes, squaredErrors);
+    *squaredErrorSum += (uint64_t)squaredErrorLanes[0] + squaredErrorLanes[1] + squaredErrorLanes[2] + squaredErrorLanes[3];
+
+    uint8_t maxDifferenceLanes[16];
+    vst1q_u8(maxDifferenceLanes, maxDifferences);
+    for (size_t i = 0; i < 16; ++i)
+    {
+        *maxDifference = maxDifferenceLanes[i] > *maxDifference ? maxDifferenceLanes[i] : *maxDifference;
+    }
+
+    if (x < width)
+    {
+        differenceRowScalar(pixels + 4 * x, otherPixels + 4 * x, width - x, maxDifference, squaredErrorSum);
+    }
+}
+
+static void lumaRowNEON(const uint8_t * pixels, size_t width, uint8_t * luma)
+{
+    size_t x = 0;
+
+    // 16 pixels per iteration, channels deinterleaved by vld4q
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16x4_t channels = vld4q_u8(pixels + 4 * x);
+
+        uint16x8_t sumLow = vaddq_u16(vaddl_u8(vget_low_u8(channels.val[0]), vget_low_u8(channels.val[2])), vshll_n_u8(vget_low_u8(channels.val[1]), 1));
+        uint16x8_t sumHigh = vaddq_u16(vaddl_u8(vget_high_u8(channels.val[0]), vget_high_u8(channels.val[2])), vshll_n_u8(vget_high_u8(channels.val[1]), 1));
+
+        // (sum + 2) >> 2
+        vst1q_u8(luma + x, vcombine_u8(vrshrn_n_u16(sumLow, 2), vrshrn_n_u16(sumHigh, 2)));
+    }
+
+    if (x < width)
+    {
+        lumaRowScalar(pixels + 4 * x, width - x, luma + x);
+    }
+}
+
+// Pair sums of 8 pixels (low and high halves) to block sums of 4 blocks
+static inline uint32x4_t blockSumsNEON(uint32x4_t pairSumsLow, uint32x4_t pairSumsHigh)
+{
+    return vcombine_u32(vpadd_u32(vget_low_u32(pairSumsLow), vget_high_u32(pairSumsLow)),
+                        vpadd_u32(vget_low_u32(pairSumsHigh), vget_high_u32(pairSumsHigh)));
+}
+
+static inline uint32x4_t productBlockSumsNEON(uint8x16_t x, uint8x16_t y)
+{
+    return blockSumsNEON(vpaddlq_u16(vmull_u8(vget_low_u8(x), vget_low_u8(y))), vpaddlq_u16(vmull_u8(vget_high_u8(x), vget_high_u8(y))));
+}
+
+static void blockSumsRowNEON(const uint8_t * luma, const uint8_t * otherLuma, size_t blockCount, const BlockSums_t * sums)
+{
+    size_t b = 0;
+
+    // 4 blocks (16 pixels) per iteration
+    for (; b + 4 <= blockCount; b += 4)
+    {
+        uint8x16_t x = vld1q_u8(luma + kImageCompareBlockSize * b);
+        uint8x16_t y = vld1q_u8(otherLuma + kImageCompareBlockSize * b);
+
+        vst1q_u32(sums->x + b, vaddq_u32(vld1q_u32(sums->x + b), vpaddlq_u16(vpaddlq_u8(x))));
+        vst1q_u32(sums->y + b, vaddq_u32(vld1q_u32(sums->y + b), vpaddlq_u16(vpaddlq_u8(y))));
+        vst1q_u32(sums->xx + b, vaddq_u32(vld1q_u32(sums->xx + b), productBlockSumsNEON(x, x)));
+        vst1q_u32(sums->yy + b, vaddq_u32(vld1q_u32(sums->yy + b), productBlockSumsNEON(y, y)));
+        vst1q_u32(sums->xy + b, vaddq_u32(vld1q_u32(sums->xy + b), productBlockSumsNEON(x, y)));
+    }
+
+    if (b < blockCount)
+    {
+        blockSumsRowTail(luma, otherLuma, b, blockCount, sums);
+    }
+}
+#endif
+
+#pragma mark -
+#pragma mark Backends
+
+bool imageCompareBackendAvailable(ImageCompareBackend_t backend)
+{
+    switch (backend)
+    {
+        case ImageCompareBackendScalar:
+            return true;
+        case ImageCompareBackendSSE2:
+            return ImageCompareSSE2Available;
+        case ImageCompareBackendNEON:
+            return ImageCompareNEONAvailable;
+    }
+
+    return false;
+}
+
+ImageCompareBackend_t imageCompareBestBackend(void)
+{
+    if (imageCompareBackendAvailable(ImageCompareBackendSSE2))
+    {
+        return ImageCompareBackendSSE2;
+    }
+    else if (imageCompareBackendAvailable(ImageCompareBackendNEON))
+    {
+        return ImageCompareBackendNEON;
+    }
+
+    return ImageCompareBackendScalar;
+}
+
+static void loadImageCompareFunctions(ImageCompareBackend_t backend, ImageCompareFunctions_t * functions)
+{
+    functions->differenceRow = differenceRowScalar;
+    functions->lumaRow = lumaRowScalar;
+    functions->blockSumsRow = blockSumsRowScalar;
+
+#if ImageCompareSSE2Available
+    if (backend == ImageCompareBackendSSE2)
+    {
+        functions->differenceRow = differenceRowSSE2;
+        functions->lumaRow = lumaRowSSE2;
+        functions->blockSumsRow = blockSumsRowSSE2;
+    }
+#endif
+#if ImageCompareNEONAvailable
+    if (backend == ImageCompareBackendNEON)
+    {
+        functions->differenceRow = differenceRowNEON;
+        functions->lumaRow = lumaRowNEON;
+        functions->blockSumsRow = blockSumsRowNEON;
+    }
+#endif
+}
+
+#pragma mark -
+#pragma mark SSIM
+
+static void resetBlockSums(const BlockSums_t * sums, size_t blockCount)
+{
+    memset(sums->x, 0, blockCount * sizeof(uint32_t));
+    memset(sums->y, 0, blockCount * sizeof(uint32_t));
+    memset(sums->xx, 0, blockCount * sizeof(uint32_t));
+    memset(sums->yy, 0, blockCount * sizeof(uint32_t));
+    memset(sums->xy, 0, blockCount * sizeof(uint32_t));
+}
+
+// Sum of the SSIM of the windows made of two consecutive block rows
+static double blockRowsSSIMSum(const BlockSums_t * top, const BlockSums_t * bottom, size_t blockCount)
+{
+    const double n = kImageCompareWindowSize * kImageCompareWindowSize;
+    double ssimSum = 0.0;
+
+    for (size_t b = 0; b + 1 < blockCount; ++b)
+    {
+        double x = top->x[b] + top->x[b + 1] + bottom->x[b] + bottom->x[b + 1];
+        double y = top->y[b] + top->y[b + 1] + bottom->y[b] + bottom->y[b + 1];
+        double xx = top->xx[b] + top->xx[b + 1] + bottom->xx[b] + bottom->xx[b + 1];
+        double yy = top->yy[b] + top->yy[b + 1] + bottom->yy[b] + bottom->yy[b + 1];
+        double xy = top->xy[b] + top->xy[b + 1] + bottom->xy[b] + bottom->xy[b + 1];
+
+        double meanX = x / n;
+        double meanY = y / n;
+        double varianceX = xx / n - meanX * meanX;
+        double varianceY = yy / n - meanY * meanY;
+        double covariance = xy / n - meanX * meanY;
+
+        ssimSum += ((2.0 * meanX * meanY + kImageCompareSSIMC1) * (2.0 * covariance + kImageCompareSSIMC2)) /
+                   ((meanX * meanX + meanY * meanY + kImageCompareSSIMC1) * (varianceX + varianceY + kImageCompareSSIMC2));
+    }
+
+    return ssimSum;
+}
+
+#pragma mark -
+#pragma mark Compare
+
+bool imageCompareWithBackend(const BlurEngineImage_t * image, const BlurEngineImage_t * otherImage, ImageCompareBackend_t backend, ImageCompareResult_t * result)
+{
+    if (!image->data || !otherImage->data || image->width != otherImage->width || image->height != otherImage->height ||
+        image->width < kImageCompareWindowSize || image->height < kImageCompareWindowSize || !imageCompareBackendAvailable(backend))
+    {
+        return false;
+    }
+
+    ImageCompareFunctions_t functions;
+    loadImageCompareFunctions(backend, &functions);
+
+    size_t width = image->width;
+    size_t height = image->height;
+    size_t blockCount = width / kImageCompareBlockSize;
+    size_t blockRowCount = height / kImageCompareBlockSize;
+
+    // Luma of the current row and sums of the current and previous block rows (the window is two block rows high)
+    uint8_t * luma = (uint8_t *)malloc(2 * width);
+    uint32_t * blockSums = (uint32_t *)calloc(2 * 5 * blockCount, sizeof(uint32_t));
+    if (!luma || !blockSums)
+    {
+        free(luma);
+        free(blockSums);
+        return false;
+    }
+
+    BlockSums_t blockRows[2];
+    for (size_t r = 0; r < 2; ++r)
+    {
+        uint32_t * sums = blockSums + r * 5 * blockCount;
+        BlockSums_t blockRow = {sums, sums + blockCount, sums + 2 * blockCount, sums + 3 * blockCount, sums + 4 * blockCount};
+        blockRows[r] = blockRow;
+    }
+
+    unsigned int maxDifference = 0;
+    uint64_t squaredErrorSum = 0;
+    double ssimSum = 0.0;
+
+    for (size_t y = 0; y < height; ++y)
+    {
+        const uint8_t * row = image->data + y * image->bytesPerRow;
+        const uint8_t * otherRow = otherImage->data + y * otherImage->bytesPerRow;
+
+        functions.differenceRow(row, otherRow, width, &maxDifference, &squaredErrorSum);
+
+        if (y >= blockRowCount * kImageCompareBlockSize)
+        {
+            continue;
+        }
+
+        size_t blockRowIndex = y / kImageCompareBlockSize;
+        const BlockSums_t * blockRow = &blockRows[blockRowIndex % 2];
+
+        if (y % kImageCompareBlockSize == 0)
+        {
+            resetBlockSums(blockRow, blockCount);
+        }
+
+        functions.lumaRow(row, width, luma);
+        functions.lumaRow(otherRow, width, luma + width);
+        functions.blockSumsRow(luma, luma + width, blockCount, blockRow);
+
+        if (y % kImageCompareBlockSize == kImageCompareBlockSize - 1 && blockRowIndex > 0)
+        {
+            ssimSum += blockRowsSSIMSum(&blockRows[(blockRowIndex - 1) % 2], blockRow, blockCount);
+        }
+    }
+
+    free(luma);
+    free(blockSums);
+
+    result->maxDifference = maxDifference;
+    result->meanSquaredError = (double)squaredErrorSum / (3.0 * width * height);
+    result->psnr = result->meanSquaredError > 0.0 ? 10.0 * log10(255.0 * 255.0 / result->meanSquaredError) : INFINITY;
+    result->ssim = ssimSum / ((double)(blockCount - 1) * (blockRowCount - 1));
+
+    return true;
+}
+
+bool imageCompare(const BlurEngineImage_t * image, const BlurEngineImage_t * otherImage, ImageCompareResult_t * result)
+{
+    return imageCompareWithBackend(image, otherImage, imageCompareBestBackend(), result);
+}
@@ -0,0 +1,81 @@
+/*
+
+ LAUCaptureVideoPreviewLayerImageCompare.h
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef LAUCaptureVideoPreviewLayerImageCompare_h
+#define LAUCaptureVideoPreviewLayerImageCompare_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LAUCaptureVideoPreviewLayerBlurEngine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Image similarity metrics for golden-image tests, same purpose as UIImage+Compare similarityWithImage:
+ but plain C (no UIKit) and vectorized
+
+ - Max absolute difference, mean squared error and PSNR of the color channels (the 4th channel, alpha, is ignored)
+ - SSIM of the luma, Y = (c0 + 2 * c1 + c2) / 4 (same for RGBA and BGRA), over 8x8 windows every 4 pixels
+   with the usual constants (K1 = 0.01, K2 = 0.03). The last width % 4 columns and height % 4 rows aren't covered.
+ - The sums are accumulated with integers, all backends return the same result
+
+ Both images must have the same dimensions and channel order (RGBA or BGRA), 8 bits per channel.
+ */
+
+// Kernels used to compare one row
+typedef enum {
+    ImageCompareBackendScalar = 0,
+    ImageCompareBackendSSE2,
+    ImageCompareBackendNEON,
+} ImageCompareBackend_t;
+
+struct ImageCompareResult {
+    unsigned int maxDifference; // [0,255]
+    double meanSquaredError;
+    double psnr; // dB, INFINITY if the images are the same
+    double ssim; // [-1,1], 1 if the images are the same
+};
+
+typedef struct ImageCompareResult ImageCompareResult_t;
+
+// Backend selection, the best available backend is used by imageCompare
+bool imageCompareBackendAvailable(ImageCompareBackend_t backend);
+ImageCompareBackend_t imageCompareBestBackend(void);
+
+// Returns false if the dimensions don't match, the images are smaller than 8x8 or the backend isn't available
+bool imageCompare(const BlurEngineImage_t * image, const BlurEngineImage_t * otherImage, ImageCompareResult_t * result);
+bool imageCompareWithBackend(const BlurEngineImage_t * image, const BlurEngineImage_t * otherImage, ImageCompareBackend_t backend, ImageCompareResult_t * result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAUCaptureVideoPreviewLayerImageCompare_h */
@@ -27,6 +27,9 @@
 
 #import <AVFoundation/AVFoundation.h>
 
+#import "LAUCaptureVideoPreviewLayerFrameQueue.h"
+#import "LAUCaptureVideoPreviewLayerFrameRecording.h"
+
 @protocol LAUCaptureVideoPreviewLayerInternalDelegate;
 
 @interface LAUCaptureVideoPreviewLayerInternal : NSObject
@@ -41,6 +44,16 @@
  */
 @property (nonatomic, strong) AVCaptureSession * session;
 
+/*!
+ @property pixelFormatType
+ @abstract
+ Pixel format of the sample buffers, kCVPixelFormatType_32BGRA (default) or kCVPixelFormatType_420YpCbCr8BiPlanarFullRange.
+ 
+ @discussion
+ Applied to the AVCaptureVideoDataOutput when the session is set, so it must be set before the session.
+ */
+@property (nonatomic) OSType pixelFormatType;
+
 /*!
  @property sampleBuffer
  @abstract
@@ -48,6 +61,74 @@
  */
 @property (nonatomic, readonly) CMSampleBufferRef sampleBuffer;
 
+/*!
+ @property sampleBufferQueueDepth
+ @abstract
+ Maximum number of sample buffers waiting to be displayed. Default is 1.
+ */
+@property (nonatomic, readonly) NSUInteger sampleBufferQueueDepth;
+
+/*!
+ @property sampleBufferQueuePolicy
+ @abstract
+ Which sample buffer is displayed and which is dropped when the queue is full.
+ Default is FrameQueuePolicyLatestOnly.
+ */
+@property (nonatomic, readonly) FrameQueuePolicy_t sampleBufferQueuePolicy;
+
+/*!
+ @property sampleBufferQueueStatistics
+ @abstract
+ Enqueued, dropped and displayed sample buffers and the age of the displayed sample buffers
+ (time between the presentation timestamp and sampleBuffer). Read it from the display link thread.
+ */
+@property (nonatomic, readonly) FrameQueueStatistics_t sampleBufferQueueStatistics;
+
+/*!
+ @method setSampleBufferQueueDepth:policy:
+ @abstract
+ Replaces the sample buffer queue. Queued sample buffers and the counters are discarded.
+ 
+ @discussion
+ Must be called from the display link thread (same as sampleBuffer).
+ */
+- (void)setSampleBufferQueueDepth:(NSUInteger)depth policy:(FrameQueuePolicy_t)policy;
+
+/*!
+ @method startFrameRecordingToPath:
+ @abstract
+ Records the sample buffers into a file (see LAUCaptureVideoPreviewLayerFrameRecording.h), replaces a recording in progress.
+ 
+ @discussion
+ The pixels are copied on the capture queue and written on a background thread. Sample buffers are dropped from
+ the recording (not from the preview) when more than maxPendingByteCount bytes are waiting to be written.
+ Returns NO if the file can't be created.
+ */
+- (BOOL)startFrameRecordingToPath:(NSString *)path maxPendingByteCount:(size_t)maxPendingByteCount;
+
+/*!
+ @method stopFrameRecording
+ @abstract
+ Waits for the pending sample buffers to be written and closes the recording.
+ */
+- (void)stopFrameRecording;
+
+/*!
+ @method recordViewWidth:height:
+ @abstract
+ Adds the view size (recordViewWidth:height:) or a blur change (recordBlur:transitionDuration:) to the recording,
+ in order with the sample buffers. Does nothing if there's no recording in progress.
+ */
+- (void)recordViewWidth:(uint32_t)width height:(uint32_t)height;
+- (void)recordBlur:(float)intensity transitionDuration:(float)transitionDuration;
+
+/*!
+ @property frameRecorderStatistics
+ @abstract
+ Recorded and dropped sample buffers of the recording in progress (all zero without a recording).
+ */
+@property (nonatomic, readonly) FrameRecorderStatistics_t frameRecorderStatistics;
+
 /*!
  @property sessionIsRunning
  @abstract
@@ -27,7 +27,12 @@
 
 #import "LAUCaptureVideoPreviewLayerInternal.h"
 
-#define kVideoDataOutputSampleBuffersSize 2
+// Latest frame wins by default, the display link always renders the newest sample buffer
+#define kVideoDataOutputSampleBufferQueueDefaultDepth 1
+#define kVideoDataOutputSampleBufferQueueDefaultPolicy FrameQueuePolicyLatestOnly
+
+// BGRA by default, both CoreGraphics and OpenGL work well with 'BGRA'
+#define kVideoDataOutputDefaultPixelFormatType kCVPixelFormatType_32BGRA
 
 @interface LAUCaptureVideoPreviewLayerInternal () <AVCaptureVideoDataOutputSampleBufferDelegate>
 {
@@ -38,10 +43,11 @@
     AVCaptureVideoDataOutput * _videoDataOutput;
     dispatch_queue_t _videoDataOutputSampleBufferDelegateQueue;
     
-    // Circular array used to keep the sample buffers
-    NSUInteger _videoDataOutputSampleBuffersHeadIndex;
-    NSUInteger _videoDataOutputSampleBuffersTailIndex;
-    CMSampleBufferRef _videoDataOutputSampleBuffers[kVideoDataOutputSampleBuffersSize];
+    // Sample buffers handed from the capture queue to the display link (lock-free)
+    FrameQueue_t * _videoDataOutputSampleBufferQueue;
+    
+    // Recording in progress, only swapped on the capture queue
+    FrameRecorder_t * _frameRecorder;
     
     // Hijacked AVCaptureVideoDataOutput (check
     dispatch_queue_t _hijackedVideoDataOutputSampleBufferDelegateQueue;
@@ -59,12 +65,18 @@
     self = [super init];
     if (self)
     {
-        _videoDataOutputSampleBuffersHeadIndex = _videoDataOutputSampleBuffersTailIndex = 0;
-        memset(_videoDataOutputSampleBuffers, 0, kVideoDataOutputSampleBuffersSize);
+        _videoDataOutputSampleBufferQueue = createFrameQueue(kVideoDataOutputSampleBufferQueueDefaultDepth, kVideoDataOutputSampleBufferQueueDefaultPolicy, CFRetain, CFRelease);
+        _pixelFormatType = kVideoDataOutputDefaultPixelFormatType;
     }
     return self;
 }
 
+- (void)dealloc
+{
+    releaseFrameQueue(_videoDataOutputSampleBufferQueue);
+    releaseFrameRecorder(_frameRecorder);
+}
+
 - (void)setSession:(AVCaptureSession *)session
 {
     if (_session)
@@ -117,8 +129,8 @@
             _hijackedVideoDataOutputSampleBufferDelegate = currentVideoDataOutput.sampleBufferDelegate;
             _hijackedVideoDataOutputSampleBufferDelegateQueue = currentVideoDataOutput.sampleBufferCallbackQueue;
             
-            // we want BGRA, both CoreGraphics and OpenGL work well with 'BGRA'
-            NSDictionary * videoSettings = @{(id)kCVPixelBufferPixelFormatTypeKey:@(kCMPixelFormat_32BGRA)};
+            // BGRA or 420 bi-planar (see pixelFormatType)
+            NSDictionary * videoSettings = @{(id)kCVPixelBufferPixelFormatTypeKey:@(_pixelFormatType)};
             [currentVideoDataOutput setVideoSettings:videoSettings];
             [currentVideoDataOutput setAlwaysDiscardsLateVideoFrames:YES]; // discard if the data output queue is blocked
             
@@ -188,8 +200,8 @@
 
 - (void)configureVideoDataOutput:(AVCaptureVideoDataOutput *)videoDataOutput
 {
-    // we want BGRA, both CoreGraphics and OpenGL work well with 'BGRA'
-    NSDictionary * videoSettings = @{(id)kCVPixelBufferPixelFormatTypeKey:@(kCMPixelFormat_32BGRA)};
+    // BGRA or 420 bi-planar (see pixelFormatType)
+    NSDictionary * videoSettings = @{(id)kCVPixelBufferPixelFormatTypeKey:@(_pixelFormatType)};
     [videoDataOutput setVideoSettings:videoSettings];
     [videoDataOutput setAlwaysDiscardsLateVideoFrames:YES]; // discard if the data output queue is blocked
     
@@ -207,7 +219,10 @@
 {
     //PrettyLog;
     
-    // Add the sample buffer to the _videoDataOutputSampleBuffers circular array
+    // Copy the pixels before the sample buffer is handed to the display link
+    [self recordSampleBuffer:sampleBuffer];
+    
+    // Add the sample buffer to the _videoDataOutputSampleBufferQueue
     [self addSampleBuffer:sampleBuffer];
     
     // Was the AVCaptureVideoDataOutput's hijacked?
@@ -225,95 +240,203 @@
 }
 
 #pragma mark -
-#pragma mark Ping-pong buffering for videoDataOutputSampleBuffers
+#pragma mark Sample buffer queue
+
+- (NSUInteger)sampleBufferQueueDepth
+{
+    return frameQueueDepth(_videoDataOutputSampleBufferQueue);
+}
+
+- (FrameQueuePolicy_t)sampleBufferQueuePolicy
+{
+    return frameQueuePolicy(_videoDataOutputSampleBufferQueue);
+}
+
+- (void)setSampleBufferQueueDepth:(NSUInteger)depth policy:(FrameQueuePolicy_t)policy
+{
+    FrameQueue_t * newVideoDataOutputSampleBufferQueue = createFrameQueue((unsigned int)MAX(1, depth), policy, CFRetain, CFRelease);
+    __block FrameQueue_t * oldVideoDataOutputSampleBufferQueue = NULL;
+    
+    // Swap on the capture queue so addSampleBuffer: never sees a released queue
+    dispatch_sync([self videoDataOutputSampleBufferDelegateQueue], ^{
+        oldVideoDataOutputSampleBufferQueue = _videoDataOutputSampleBufferQueue;
+        _videoDataOutputSampleBufferQueue = newVideoDataOutputSampleBufferQueue;
+    });
+    
+    releaseFrameQueue(oldVideoDataOutputSampleBufferQueue);
+}
+
+- (FrameQueueStatistics_t)sampleBufferQueueStatistics
+{
+    FrameQueueStatistics_t statistics;
+    frameQueueStatistics(_videoDataOutputSampleBufferQueue, &statistics);
+    return statistics;
+}
+
++ (double)sampleBufferQueueTime
+{
+    // Same clock as the presentation timestamps of the capture session
+    return CMTimeGetSeconds(CMClockGetTime(CMClockGetHostTimeClock()));
+}
+
++ (double)timestampOfSampleBuffer:(CMSampleBufferRef)sampleBuffer
+{
+    CMTime presentationTimeStamp = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
+    return CMTIME_IS_NUMERIC(presentationTimeStamp) ? CMTimeGetSeconds(presentationTimeStamp) : [self sampleBufferQueueTime];
+}
 
 - (CMSampleBufferRef)sampleBuffer
 {
-    @synchronized (self)
+    // Display link: next sample buffer (see sampleBufferQueuePolicy) or NULL (keep the last one rendered)
+    // The sample buffer stays retained until the next call
+    return (CMSampleBufferRef)frameQueueTakeFrame(_videoDataOutputSampleBufferQueue, [[self class] sampleBufferQueueTime], NULL);
+}
+
+- (void)addSampleBuffer:(CMSampleBufferRef)newVideoDataOutputSampleBuffer
+{
+    if (newVideoDataOutputSampleBuffer == NULL)
     {
-        //PrettyLog;
-        
-        CMSampleBufferRef videoDataOutputSampleBuffer = NULL;
-        
-        // Check if the circular array is not empty
-        if (_videoDataOutputSampleBuffersHeadIndex != _videoDataOutputSampleBuffersTailIndex)
-        {
-            // Remove an existing sample buffer from the head
-            CMSampleBufferRef oldVideoDataOutputSampleBuffer = _videoDataOutputSampleBuffers[_videoDataOutputSampleBuffersHeadIndex];
-            
-            // Release the buffer if it exists
-            if(oldVideoDataOutputSampleBuffer != NULL)
-            {
-                videoDataOutputSampleBuffer = oldVideoDataOutputSampleBuffer;
-            }
-            
-            //Log(@"\nsampleBuffer head %d tail %d info %@\n\n\n", _videoDataOutputSampleBuffersHeadIndex, _videoDataOutputSampleBuffersTailIndex, videoDataOutputSampleBuffer);
-            
-            // Move head +1
-            _videoDataOutputSampleBuffersHeadIndex = (_videoDataOutputSampleBuffersHeadIndex+1)%kVideoDataOutputSampleBuffersSize;
-        }
-        
-        return videoDataOutputSampleBuffer;
+        return;
     }
+    
+    // Presentation timestamp is used to measure the age of the sample buffer when it's rendered
+    double timestamp = [[self class] timestampOfSampleBuffer:newVideoDataOutputSampleBuffer];
+    
+    // Capture queue: the policy decides which sample buffer is dropped when the queue is full
+    frameQueueEnqueueFrame(_videoDataOutputSampleBufferQueue, newVideoDataOutputSampleBuffer, timestamp);
 }
 
-- (void)addSampleBuffer:(CMSampleBufferRef)newVideoDataOutputSampleBuffer
+- (void)flushSampleBuffer
+{
+    // Must be called from the same thread as sampleBuffer
+    frameQueueFlush(_videoDataOutputSampleBufferQueue);
+}
+
+#pragma mark -
+#pragma mark Frame recording
+
+- (BOOL)startFrameRecordingToPath:(NSString *)path maxPendingByteCount:(size_t)maxPendingByteCount
+{
+    FrameRecorder_t * newFrameRecorder = createFrameRecorder(path.fileSystemRepresentation, maxPendingByteCount);
+    __block FrameRecorder_t * oldFrameRecorder = NULL;
+    
+    if (!newFrameRecorder)
+    {
+        Log(@"LAUCaptureVideoPreviewLayerInternal: Can't create the frame recording %@", path);
+        return NO;
+    }
+    
+    // Swap on the capture queue so recordSampleBuffer: never sees a released recorder
+    dispatch_sync([self videoDataOutputSampleBufferDelegateQueue], ^{
+        oldFrameRecorder = _frameRecorder;
+        _frameRecorder = newFrameRecorder;
+    });
+    
+    releaseFrameRecorder(oldFrameRecorder);
+    return YES;
+}
+
+- (void)stopFrameRecording
 {
-    @synchronized (self)
+    __block FrameRecorder_t * oldFrameRecorder = NULL;
+    
+    dispatch_sync([self videoDataOutputSampleBufferDelegateQueue], ^{
+        oldFrameRecorder = _frameRecorder;
+        _frameRecorder = NULL;
+    });
+    
+    if (oldFrameRecorder)
     {
-        //PrettyLog;
+        FrameRecorderStatistics_t statistics;
+        frameRecorderStatistics(oldFrameRecorder, &statistics);
+        Log(@"LAUCaptureVideoPreviewLayerInternal: Frame recording stopped, %lu frames recorded, %lu dropped", statistics.recordedFrameCount, statistics.droppedFrameCount);
         
-        if (newVideoDataOutputSampleBuffer != NULL)
+        // Waits for the writer thread
+        releaseFrameRecorder(oldFrameRecorder);
+    }
+}
+
+- (void)recordViewWidth:(uint32_t)width height:(uint32_t)height
+{
+    double timestamp = [[self class] sampleBufferQueueTime];
+    
+    // In order with the sample buffers of the capture queue
+    dispatch_async([self videoDataOutputSampleBufferDelegateQueue], ^{
+        if (_frameRecorder)
         {
-            // Add the new sample buffer to the tail
-            CMSampleBufferRef oldVideoDataOutputSampleBuffer = _videoDataOutputSampleBuffers[_videoDataOutputSampleBuffersTailIndex];
-            
-            // Release an old buffer if it exists
-            if(oldVideoDataOutputSampleBuffer != NULL)
-            {
-                // Release old
-                CFRelease(oldVideoDataOutputSampleBuffer);
-            }
-            
-            // Retain new
-            _videoDataOutputSampleBuffers[_videoDataOutputSampleBuffersTailIndex] = newVideoDataOutputSampleBuffer;
-            CFRetain(newVideoDataOutputSampleBuffer);
-            
-            // Move tail +1
-            _videoDataOutputSampleBuffersTailIndex = (_videoDataOutputSampleBuffersTailIndex+1)%kVideoDataOutputSampleBuffersSize;
-            
-            // As a circular array we make sure old unused sample buffers are discarded by moving head forwards +1
-            if (_videoDataOutputSampleBuffersTailIndex == _videoDataOutputSampleBuffersHeadIndex)
-            {
-                // Move head +1
-                _videoDataOutputSampleBuffersHeadIndex = (_videoDataOutputSampleBuffersTailIndex+1)%kVideoDataOutputSampleBuffersSize;
-            }
-            
-            //Log(@"\naddSampleBuffer head %d tail %d info %@\n\n\n", _videoDataOutputSampleBuffersHeadIndex, _videoDataOutputSampleBuffersTailIndex, newVideoDataOutputSampleBuffer);
+            frameRecorderAppendView(_frameRecorder, timestamp, width, height);
         }
-    }
+    });
 }
 
-- (void)flushSampleBuffer
+- (void)recordBlur:(float)intensity transitionDuration:(float)transitionDuration
 {
-    @synchronized (self)
+    double timestamp = [[self class] sampleBufferQueueTime];
+    
+    dispatch_async([self videoDataOutputSampleBufferDelegateQueue], ^{
+        if (_frameRecorder)
+        {
+            frameRecorderAppendBlur(_frameRecorder, timestamp, intensity, transitionDuration);
+        }
+    });
+}
+
+- (FrameRecorderStatistics_t)frameRecorderStatistics
+{
+    __block FrameRecorderStatistics_t statistics = {0};
+    
+    dispatch_sync([self videoDataOutputSampleBufferDelegateQueue], ^{
+        if (_frameRecorder)
+        {
+            frameRecorderStatistics(_frameRecorder, &statistics);
+        }
+    });
+    
+    return statistics;
+}
+
+- (void)recordSampleBuffer:(CMSampleBufferRef)sampleBuffer
+{
+    // Capture queue
+    CVPixelBufferRef pixelBuffer = _frameRecorder && sampleBuffer ? CMSampleBufferGetImageBuffer(sampleBuffer) : NULL;
+    if (!pixelBuffer)
     {
-        while(_videoDataOutputSampleBuffersHeadIndex != _videoDataOutputSampleBuffersTailIndex)
+        return;
+    }
+    
+    FrameRecordingFrame_t frame = {
+        .timestamp = [[self class] timestampOfSampleBuffer:sampleBuffer],
+        .pixelFormat = CVPixelBufferGetPixelFormatType(pixelBuffer),
+    };
+    
+    CVPixelBufferLockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+    
+    if (CVPixelBufferIsPlanar(pixelBuffer))
+    {
+        // 420 bi-planar, 1 byte of luma and 2 bytes of CbCr per pixel
+        frame.planeCount = (uint32_t)MIN(CVPixelBufferGetPlaneCount(pixelBuffer), kFrameRecordingMaxPlaneCount);
+        for (uint32_t i = 0; i < frame.planeCount; ++i)
         {
-            // Remove an existing sample buffer from the head
-            CMSampleBufferRef videoDataOutputSampleBuffer = _videoDataOutputSampleBuffers[_videoDataOutputSampleBuffersHeadIndex];
-            
-            // Release the buffer if it exists
-            if(videoDataOutputSampleBuffer != NULL)
-            {
-                CFRelease(videoDataOutputSampleBuffer);
-                _videoDataOutputSampleBuffers[_videoDataOutputSampleBuffersHeadIndex] = NULL;
-            }
-            
-            // Move head +1
-            _videoDataOutputSampleBuffersHeadIndex = (_videoDataOutputSampleBuffersHeadIndex+1)%kVideoDataOutputSampleBuffersSize;
+            frame.planes[i].data = CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, i);
+            frame.planes[i].width = (uint32_t)CVPixelBufferGetWidthOfPlane(pixelBuffer, i);
+            frame.planes[i].height = (uint32_t)CVPixelBufferGetHeightOfPlane(pixelBuffer, i);
+            frame.planes[i].bytesPerPixel = (i == 0) ? 1 : 2;
+            frame.planes[i].bytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, i);
         }
     }
+    else
+    {
+        frame.planeCount = 1;
+        frame.planes[0].data = CVPixelBufferGetBaseAddress(pixelBuffer);
+        frame.planes[0].width = (uint32_t)CVPixelBufferGetWidth(pixelBuffer);
+        frame.planes[0].height = (uint32_t)CVPixelBufferGetHeight(pixelBuffer);
+        frame.planes[0].bytesPerPixel = 4;
+        frame.planes[0].bytesPerRow = CVPixelBufferGetBytesPerRow(pixelBuffer);
+    }
+    
+    frameRecorderAppendFrame(_frameRecorder, &frame);
+    
+    CVPixelBufferUnlockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
 }
 
 @end
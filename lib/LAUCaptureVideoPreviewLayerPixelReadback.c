@@ -0,0 +1,542 @@
+/*
+
+ LAUCaptureVideoPreviewLayerPixelReadback.c
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "LAUCaptureVideoPreviewLayerPixelReadback.h"
+
+#if TARGET_OS_IPHONE
+    #import <OpenGLES/ES2/glext.h>
+#elif defined(__linux__)
+    #include <GLES2/gl2ext.h>
+#endif
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct PixelReadbackSlot {
+
+    // Copy of the framebuffer
+    GLuint textureName;
+    GLuint framebuffer;
+    GLsizei textureWidth;
+    GLsizei textureHeight;
+
+    // Destination of the readback (reused)
+    uint8_t * pixels;
+    size_t pixelsCapacity;
+
+    // Request
+    GLsizei width;
+    GLsizei height;
+    PixelReadbackSync sync;
+    PixelReadbackCompletion completion;
+    void * context;
+    unsigned long requestIndex;
+    unsigned long requestPollCount;
+};
+
+typedef struct PixelReadbackSlot PixelReadbackSlot_t;
+
+struct PixelReadback {
+
+    unsigned int depth;
+    PixelReadbackSlot_t * slots;
+    unsigned int head; // Oldest pending slot
+    unsigned int pendingCount;
+    unsigned long pollCount;
+    GLint maxTextureSize; // 0 until the first request
+
+    PixelReadbackFenceSyncFunction fenceSync;
+    PixelReadbackClientWaitSyncFunction clientWaitSync;
+    PixelReadbackDeleteSyncFunction deleteSync;
+
+    PixelReadbackStatistics_t statistics;
+};
+
+struct PixelReadbackBuffer {
+    PixelReadbackBufferPool_t * pool;
+    uint8_t * bytes;
+    size_t capacity;
+};
+
+struct PixelReadbackBufferPool {
+
+    pthread_mutex_t mutex;
+
+    // Free buffers, the last one is reused first
+    PixelReadbackBuffer_t ** freeBuffers;
+    unsigned int freeCount;
+    unsigned int capacity;
+
+    bool released; // The owner released the pool, freed with the last outstanding buffer
+
+    PixelReadbackBufferPoolStatistics_t statistics;
+};
+
+#pragma mark -
+#pragma mark Fences (GL_APPLE_sync)
+
+#if defined(GL_APPLE_sync) && (TARGET_OS_IPHONE || defined(GL_GLEXT_PROTOTYPES))
+static PixelReadbackSync fenceSyncApple(void)
+{
+    return glFenceSyncAPPLE(GL_SYNC_GPU_COMMANDS_COMPLETE_APPLE, 0);
+}
+
+static bool clientWaitSyncApple(PixelReadbackSync sync, uint64_t timeout)
+{
+    GLenum result = glClientWaitSyncAPPLE((GLsync)sync, GL_SYNC_FLUSH_COMMANDS_BIT_APPLE, timeout);
+    return result == GL_ALREADY_SIGNALED_APPLE || result == GL_CONDITION_SATISFIED_APPLE;
+}
+
+static void deleteSyncApple(PixelReadbackSync sync)
+{
+    glDeleteSyncAPPLE((GLsync)sync);
+}
+#endif
+
+#pragma mark -
+#pragma mark Memory management
+
+PixelReadback_t * createPixelReadback(unsigned int depth)
+{
+    PixelReadback_t * readback = calloc(1, sizeof(PixelReadback_t));
+
+    if (!readback)
+    {
+        return NULL;
+    }
+
+    readback->depth = depth > 0 ? depth : 1;
+    readback->slots = calloc(readback->depth, sizeof(PixelReadbackSlot_t));
+
+    if (!readback->slots)
+    {
+        free(readback);
+        return NULL;
+    }
+
+#if defined(GL_APPLE_sync) && (TARGET_OS_IPHONE || defined(GL_GLEXT_PROTOTYPES))
+    pixelReadbackSetFenceFunctions(readback, fenceSyncApple, clientWaitSyncApple, deleteSyncApple);
+#endif
+
+    return readback;
+}
+
+void releasePixelReadback(PixelReadback_t * readback)
+{
+    if (!readback)
+    {
+        return;
+    }
+
+    for (unsigned int i = 0; i < readback->depth; ++i)
+    {
+        PixelReadbackSlot_t * slot = &readback->slots[i];
+
+        if (slot->sync && readback->deleteSync)
+        {
+            readback->deleteSync(slot->sync);
+        }
+
+        if (slot->framebuffer)
+        {
+            glDeleteFramebuffers(1, &slot->framebuffer);
+        }
+
+        if (slot->textureName)
+        {
+            glDeleteTextures(1, &slot->textureName);
+        }
+
+        free(slot->pixels);
+    }
+
+    free(readback->slots);
+    free(readback);
+}
+
+void pixelReadbackSetFenceFunctions(PixelReadback_t * readback, PixelReadbackFenceSyncFunction fenceSync, PixelReadbackClientWaitSyncFunction clientWaitSync, PixelReadbackDeleteSyncFunction deleteSync)
+{
+    // All or nothing
+    bool fences = fenceSync && clientWaitSync && deleteSync;
+
+    readback->fenceSync = fences ? fenceSync : NULL;
+    readback->clientWaitSync = fences ? clientWaitSync : NULL;
+    readback->deleteSync = fences ? deleteSync : NULL;
+}
+
+#pragma mark -
+#pragma mark Readback
+
+static bool loadPixelReadbackSlot(PixelReadback_t * readback, PixelReadbackSlot_t * slot, GLsizei width, GLsizei height)
+{
+    size_t pixelsSize = (size_t)width * (size_t)height * 4;
+
+    if (pixelsSize > slot->pixelsCapacity)
+    {
+        uint8_t * pixels = realloc(slot->pixels, pixelsSize);
+
+        if (!pixels)
+        {
+            return false;
+        }
+
+        slot->pixels = pixels;
+        slot->pixelsCapacity = pixelsSize;
+        readback->statistics.allocationCount++;
+    }
+
+    if (slot->textureWidth == width && slot->textureHeight == height)
+    {
+        return true;
+    }
+
+    if (!slot->textureName)
+    {
+        glGenTextures(1, &slot->textureName);
+        glGenFramebuffers(1, &slot->framebuffer);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, slot->textureName);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, slot->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, slot->textureName, 0);
+
+    // An incomplete slot is allocated again by the next request
+    bool complete = checkFramebufferStatusComplete();
+    slot->textureWidth = complete ? width : 0;
+    slot->textureHeight = complete ? height : 0;
+    readback->statistics.allocationCount++;
+
+    return complete;
+}
+
+static bool completePixelReadbackSlot(PixelReadback_t * readback, PixelReadbackSlot_t * slot, bool wait)
+{
+    // Copy finished ?
+    if (slot->sync)
+    {
+        if (!readback->clientWaitSync(slot->sync, 0))
+        {
+            if (!wait)
+            {
+                return false;
+            }
+
+            readback->clientWaitSync(slot->sync, UINT64_MAX);
+            readback->statistics.waitCount++;
+        }
+
+        readback->deleteSync(slot->sync);
+        slot->sync = NULL;
+    }
+    else if (readback->pollCount - slot->requestPollCount < 2)
+    {
+        if (!wait)
+        {
+            return false;
+        }
+
+        readback->statistics.waitCount++;
+    }
+
+    // Read the slot, keep the caller's framebuffer bound
+    GLint framebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, slot->framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, slot->width, slot->height, GL_RGBA, GL_UNSIGNED_BYTE, slot->pixels);
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)framebuffer);
+
+    PixelReadbackImage_t image = {
+        .data = slot->pixels,
+        .width = (size_t)slot->width,
+        .height = (size_t)slot->height,
+        .bytesPerRow = (size_t)slot->width * 4,
+        .requestIndex = slot->requestIndex,
+    };
+
+    // The slot is free before the callback, it may request again
+    PixelReadbackCompletion completion = slot->completion;
+    void * context = slot->context;
+    slot->completion = NULL;
+    readback->head = (readback->head + 1) % readback->depth;
+    readback->pendingCount--;
+    readback->statistics.completedCount++;
+
+    if (completion)
+    {
+        completion(context, &image);
+    }
+
+    return true;
+}
+
+bool pixelReadbackRequest(PixelReadback_t * readback, GLuint framebuffer, GLsizei width, GLsizei height, PixelReadbackCompletion completion, void * context)
+{
+    // Checked up front, the request path has no glGetError (it can stall the pipeline on some drivers)
+    // Copies larger than the framebuffer aren't errors, the pixels outside it are undefined
+    if (width <= 0 || height <= 0)
+    {
+        return false;
+    }
+
+    // The slot texture can't be larger (queried once)
+    if (!readback->maxTextureSize)
+    {
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &readback->maxTextureSize);
+    }
+
+    if (width > readback->maxTextureSize || height > readback->maxTextureSize)
+    {
+        return false;
+    }
+
+    // Ring full, the oldest request is completed first
+    if (readback->pendingCount == readback->depth)
+    {
+        completePixelReadbackSlot(readback, &readback->slots[readback->head], true);
+    }
+
+    PixelReadbackSlot_t * slot = &readback->slots[(readback->head + readback->pendingCount) % readback->depth];
+
+    if (!loadPixelReadbackSlot(readback, slot, width, height))
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        return false;
+    }
+
+    // GPU side copy, the pixels are read once the fence signals
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glBindTexture(GL_TEXTURE_2D, slot->textureName);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    slot->width = width;
+    slot->height = height;
+    slot->sync = readback->fenceSync ? readback->fenceSync() : NULL;
+    slot->completion = completion;
+    slot->context = context;
+    slot->requestIndex = readback->statistics.requestCount++;
+    slot->requestPollCount = readback->pollCount;
+    readback->pendingCount++;
+
+    return true;
+}
+
+unsigned int pixelReadbackPoll(PixelReadback_t * readback, bool wait)
+{
+    unsigned int completedCount = 0;
+
+    readback->pollCount++;
+
+    // In request order, stops at the first copy that isn't finished
+    while (readback->pendingCount > 0 && completePixelReadbackSlot(readback, &readback->slots[readback->head], wait))
+    {
+        completedCount++;
+    }
+
+    return completedCount;
+}
+
+unsigned int pixelReadbackPendingCount(const PixelReadback_t * readback)
+{
+    return readback->pendingCount;
+}
+
+void pixelReadbackStatistics(const PixelReadback_t * readback, PixelReadbackStatistics_t * statistics)
+{
+    *statistics = readback->statistics;
+}
+
+#pragma mark -
+#pragma mark Destination buffers
+
+PixelReadbackBufferPool_t * createPixelReadbackBufferPool(unsigned int capacity)
+{
+    PixelReadbackBufferPool_t * pool = calloc(1, sizeof(PixelReadbackBufferPool_t));
+
+    if (!pool)
+    {
+        return NULL;
+    }
+
+    pool->capacity = capacity;
+    pool->freeBuffers = calloc(capacity > 0 ? capacity : 1, sizeof(PixelReadbackBuffer_t *));
+
+    if (!pool->freeBuffers)
+    {
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->mutex, NULL);
+
+    return pool;
+}
+
+static void freePixelReadbackBuffer(PixelReadbackBuffer_t * buffer)
+{
+    free(buffer->bytes);
+    free(buffer);
+}
+
+// Called without the lock, once released and without outstanding buffers
+static void destroyPixelReadbackBufferPool(PixelReadbackBufferPool_t * pool)
+{
+    for (unsigned int i = 0; i < pool->freeCount; ++i)
+    {
+        freePixelReadbackBuffer(pool->freeBuffers[i]);
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->freeBuffers);
+    free(pool);
+}
+
+void releasePixelReadbackBufferPool(PixelReadbackBufferPool_t * pool)
+{
+    if (!pool)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->released = true;
+    bool destroy = (pool->statistics.outstandingCount == 0);
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (destroy)
+    {
+        destroyPixelReadbackBufferPool(pool);
+    }
+}
+
+PixelReadbackBuffer_t * pixelReadbackBufferPoolAcquire(PixelReadbackBufferPool_t * pool, size_t size)
+{
+    PixelReadbackBuffer_t * buffer = NULL;
+
+    // Most recently given back first, readbacks of the same framebuffer have the same size
+    pthread_mutex_lock(&pool->mutex);
+
+    if (pool->freeCount > 0)
+    {
+        buffer = pool->freeBuffers[--pool->freeCount];
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    // Allocated (or grown) outside of the lock
+    bool allocated = false;
+
+    if (!buffer)
+    {
+        buffer = calloc(1, sizeof(PixelReadbackBuffer_t));
+
+        if (!buffer)
+        {
+            return NULL;
+        }
+
+        buffer->pool = pool;
+    }
+
+    if (buffer->capacity < size)
+    {
+        uint8_t * bytes = realloc(buffer->bytes, size);
+
+        if (!bytes)
+        {
+            freePixelReadbackBuffer(buffer);
+            return NULL;
+        }
+
+        buffer->bytes = bytes;
+        buffer->capacity = size;
+        allocated = true;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->statistics.acquireCount++;
+    pool->statistics.allocationCount += allocated ? 1 : 0;
+    pool->statistics.outstandingCount++;
+    pthread_mutex_unlock(&pool->mutex);
+
+    return buffer;
+}
+
+void pixelReadbackBufferRelinquish(PixelReadbackBuffer_t * buffer)
+{
+    if (!buffer)
+    {
+        return;
+    }
+
+    PixelReadbackBufferPool_t * pool = buffer->pool;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    pool->statistics.outstandingCount--;
+
+    bool kept = !pool->released && pool->freeCount < pool->capacity;
+    if (kept)
+    {
+        pool->freeBuffers[pool->freeCount++] = buffer;
+    }
+
+    bool destroy = pool->released && pool->statistics.outstandingCount == 0;
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (!kept)
+    {
+        freePixelReadbackBuffer(buffer);
+    }
+
+    if (destroy)
+    {
+        destroyPixelReadbackBufferPool(pool);
+    }
+}
+
+uint8_t * pixelReadbackBufferBytes(PixelReadbackBuffer_t * buffer)
+{
+    return buffer->bytes;
+}
+
+void pixelReadbackBufferPoolStatistics(PixelReadbackBufferPool_t * pool, PixelReadbackBufferPoolStatistics_t * statistics)
+{
+    pthread_mutex_lock(&pool->mutex);
+    *statistics = pool->statistics;
+    pthread_mutex_unlock(&pool->mutex);
+}
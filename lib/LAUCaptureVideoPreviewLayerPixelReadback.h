@@ -0,0 +1,144 @@
+/*
+
+ LAUCaptureVideoPreviewLayerPixelReadback.h
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef LAUCaptureVideoPreviewLayerPixelReadback_h
+#define LAUCaptureVideoPreviewLayerPixelReadback_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LAUCaptureVideoPreviewLayerUtilities.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Asynchronous readback of a framebuffer (ie. the onscreen framebuffer)
+
+ - A request copies the framebuffer into the texture of a ring slot (glCopyTexSubImage2D, GPU side) and inserts a fence
+ - Polling completes the slots whose fence signaled, in request order: the pixels are read from the slot (the GPU is done,
+   glReadPixels doesn't stall the pipeline) into the pixel buffer of the slot and passed to the completion callback
+ - Slot textures and pixel buffers are reused, they are only reallocated when the dimensions grow
+ - A request when every slot is pending completes the oldest one first (waits for its fence)
+ - Without fence functions (GL_APPLE_sync) a request is completed by the second poll after it was made
+   (ie. requested before presenting frame N, polled after presenting frames N and N+1)
+
+ ES 2.0 has no pixel pack buffers, the fence plus the slot copy are what keep the readback off the frame being rendered.
+ Must be used with the same OpenGL context current as the framebuffers.
+
+ Images that outlive the completion callback (ie. CGImages of snapshots) copy the pixels into the buffers of a
+ PixelReadbackBufferPool: buffers are given back by their owner (from any thread) and reused by the next completions.
+ */
+
+typedef void * PixelReadbackSync;
+
+typedef PixelReadbackSync (*PixelReadbackFenceSyncFunction)(void);
+typedef bool (*PixelReadbackClientWaitSyncFunction)(PixelReadbackSync sync, uint64_t timeout); // Nanoseconds, returns true if signaled
+typedef void (*PixelReadbackDeleteSyncFunction)(PixelReadbackSync sync);
+
+// RGBA pixels, rows bottom-up (OpenGL). Only valid during the completion callback.
+struct PixelReadbackImage {
+    const uint8_t * data;
+    size_t width;
+    size_t height;
+    size_t bytesPerRow;
+    unsigned long requestIndex; // Index of the request (0, 1, ...)
+};
+
+typedef struct PixelReadbackImage PixelReadbackImage_t;
+
+typedef void (*PixelReadbackCompletion)(void * context, const PixelReadbackImage_t * image);
+
+// Counters since the readback was created
+struct PixelReadbackStatistics {
+    unsigned long requestCount;
+    unsigned long completedCount;
+    unsigned long waitCount; // Completions that had to wait for the GPU (ring full or poll with wait)
+    unsigned long allocationCount; // Slot textures and pixel buffers (re)allocated
+};
+
+typedef struct PixelReadbackStatistics PixelReadbackStatistics_t;
+
+typedef struct PixelReadback PixelReadback_t;
+
+// Readback memory management, depth is the number of ring slots (at least 1)
+// Releasing the readback drops the pending requests without calling their completion
+PixelReadback_t * createPixelReadback(unsigned int depth);
+void releasePixelReadback(PixelReadback_t * readback);
+
+// Fence functions for platforms that resolve extensions at runtime (ie. EGL_KHR_fence_sync)
+// By default the GL_APPLE_sync functions of the OpenGL ES headers are used if available, NULL functions disable the fences
+void pixelReadbackSetFenceFunctions(PixelReadback_t * readback, PixelReadbackFenceSyncFunction fenceSync, PixelReadbackClientWaitSyncFunction clientWaitSync, PixelReadbackDeleteSyncFunction deleteSync);
+
+// Copies the framebuffer (origin 0,0) into a slot. Returns false if the dimensions are invalid (empty or larger than
+// GL_MAX_TEXTURE_SIZE) or the slot can't be allocated, no completion is called. The copy itself isn't checked (no glGetError).
+// The framebuffer stays bound.
+bool pixelReadbackRequest(PixelReadback_t * readback, GLuint framebuffer, GLsizei width, GLsizei height, PixelReadbackCompletion completion, void * context);
+
+// Completes the pending requests whose copy finished (all of them if wait is true), returns the number completed
+unsigned int pixelReadbackPoll(PixelReadback_t * readback, bool wait);
+
+unsigned int pixelReadbackPendingCount(const PixelReadback_t * readback);
+
+void pixelReadbackStatistics(const PixelReadback_t * readback, PixelReadbackStatistics_t * statistics);
+
+#pragma mark -
+#pragma mark Destination buffers
+
+// Counters since the pool was created
+struct PixelReadbackBufferPoolStatistics {
+    unsigned long acquireCount;
+    unsigned long allocationCount; // Buffers allocated or grown (the other acquires reused a free buffer)
+    unsigned int outstandingCount; // Acquired and not given back yet
+};
+
+typedef struct PixelReadbackBufferPoolStatistics PixelReadbackBufferPoolStatistics_t;
+
+typedef struct PixelReadbackBufferPool PixelReadbackBufferPool_t;
+typedef struct PixelReadbackBuffer PixelReadbackBuffer_t;
+
+// Pool memory management, capacity is the number of free buffers kept for reuse (the others are freed when given back)
+// Buffers still acquired when the pool is released stay valid, they are freed when given back
+PixelReadbackBufferPool_t * createPixelReadbackBufferPool(unsigned int capacity);
+void releasePixelReadbackBufferPool(PixelReadbackBufferPool_t * pool);
+
+// Buffer of at least size bytes, NULL if the allocation failed. Thread safe.
+PixelReadbackBuffer_t * pixelReadbackBufferPoolAcquire(PixelReadbackBufferPool_t * pool, size_t size);
+
+// Gives the buffer back to its pool. Thread safe (ie. called from a CGDataProvider release callback).
+void pixelReadbackBufferRelinquish(PixelReadbackBuffer_t * buffer);
+
+uint8_t * pixelReadbackBufferBytes(PixelReadbackBuffer_t * buffer);
+
+void pixelReadbackBufferPoolStatistics(PixelReadbackBufferPool_t * pool, PixelReadbackBufferPoolStatistics_t * statistics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAUCaptureVideoPreviewLayerPixelReadback_h */
@@ -0,0 +1,373 @@
+/*
+
+ LAUCaptureVideoPreviewLayerProgramCache.c
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "LAUCaptureVideoPreviewLayerProgramCache.h"
+
+#if TARGET_OS_IPHONE
+    #import <OpenGLES/ES2/glext.h>
+#elif defined(__linux__)
+    #include <GLES2/gl2ext.h>
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS_OES
+#define GL_NUM_PROGRAM_BINARY_FORMATS_OES 0x87FE
+#endif
+
+#ifndef GL_PROGRAM_BINARY_LENGTH_OES
+#define GL_PROGRAM_BINARY_LENGTH_OES 0x8741
+#endif
+
+// Cache file layout: header followed by the program binary
+#define kProgramCacheFileMagic 0x5050414cu // 'LAPP'
+#define kProgramCacheFileVersion 1
+
+struct ProgramCacheFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key; // Hash of the sources and driver
+    uint64_t sourceLength; // Length of both sources, checked with the key
+    uint32_t binaryFormat;
+    uint32_t binaryLength;
+    uint64_t binaryChecksum;
+};
+
+typedef struct ProgramCacheFileHeader ProgramCacheFileHeader_t;
+
+struct ProgramCache {
+
+    char * directoryPath;
+
+    ProgramCacheGetProgramBinaryFunction getProgramBinary;
+    ProgramCacheProgramBinaryFunction programBinary;
+
+    // Checked with the first program (needs a current context)
+    int binaryFormatCount; // -1 unknown
+
+    ProgramCacheStatistics_t statistics;
+};
+
+#pragma mark -
+#pragma mark Helpers
+
+static double currentTime(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+// FNV-1a (64 bit), the input can be split in several calls
+static uint64_t hashBytes(uint64_t hash, const void * bytes, size_t length)
+{
+    const uint8_t * data = (const uint8_t *)bytes;
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+static uint64_t hashString(uint64_t hash, const char * string)
+{
+    // The terminator separates consecutive strings ("ab" + "c" != "a" + "bc")
+    return string ? hashBytes(hash, string, strlen(string) + 1) : hashBytes(hash, "", 1);
+}
+
+static uint64_t programKey(const char * vertexShaderSource, const char * fragmentShaderSource)
+{
+    uint64_t key = 0xcbf29ce484222325ull;
+
+    key = hashString(key, vertexShaderSource);
+    key = hashString(key, fragmentShaderSource);
+
+    // Driver identity, a driver update invalidates every binary
+    key = hashString(key, (const char *)glGetString(GL_VENDOR));
+    key = hashString(key, (const char *)glGetString(GL_RENDERER));
+    key = hashString(key, (const char *)glGetString(GL_VERSION));
+
+    return key;
+}
+
+// Errors left by earlier (unrelated) calls, so the next glGetError only reports the checked call
+// Bounded, a lost context can report errors indefinitely
+static void clearPendingErrors(void)
+{
+    for (int i = 0; i < 16; ++i)
+    {
+        if (glGetError() == GL_NO_ERROR)
+        {
+            break;
+        }
+    }
+}
+
+// False if the path doesn't fit, a truncated path could be the file of another program
+static bool programCacheFilePath(const ProgramCache_t * programCache, uint64_t key, char * path, size_t pathSize)
+{
+    int length = snprintf(path, pathSize, "%s/%016llx.program", programCache->directoryPath, (unsigned long long)key);
+    return length >= 0 && (size_t)length < pathSize;
+}
+
+bool programCacheBinarySupported(ProgramCache_t * programCache)
+{
+    if (!programCache->directoryPath || !programCache->getProgramBinary || !programCache->programBinary)
+    {
+        return false;
+    }
+
+    if (programCache->binaryFormatCount < 0)
+    {
+        GLint binaryFormatCount = 0;
+        clearPendingErrors();
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &binaryFormatCount);
+        programCache->binaryFormatCount = (glGetError() == GL_NO_ERROR) ? binaryFormatCount : 0;
+    }
+
+    return programCache->binaryFormatCount > 0;
+}
+
+#pragma mark -
+#pragma mark Memory management
+
+ProgramCache_t * createProgramCache(const char * directoryPath)
+{
+    ProgramCache_t * programCache = calloc(1, sizeof(ProgramCache_t));
+
+    if (!programCache)
+    {
+        return NULL;
+    }
+
+    programCache->directoryPath = directoryPath ? strdup(directoryPath) : NULL;
+    programCache->binaryFormatCount = -1;
+
+#if defined(GL_OES_get_program_binary) && (TARGET_OS_IPHONE || defined(GL_GLEXT_PROTOTYPES))
+    programCache->getProgramBinary = glGetProgramBinaryOES;
+    programCache->programBinary = glProgramBinaryOES;
+#endif
+
+    return programCache;
+}
+
+void releaseProgramCache(ProgramCache_t * programCache)
+{
+    if (!programCache)
+    {
+        return;
+    }
+
+    free(programCache->directoryPath);
+    free(programCache);
+}
+
+void programCacheSetBinaryFunctions(ProgramCache_t * programCache, ProgramCacheGetProgramBinaryFunction getProgramBinary, ProgramCacheProgramBinaryFunction programBinary)
+{
+    programCache->getProgramBinary = getProgramBinary;
+    programCache->programBinary = programBinary;
+    programCache->binaryFormatCount = -1;
+}
+
+void programCacheStatistics(const ProgramCache_t * programCache, ProgramCacheStatistics_t * statistics)
+{
+    *statistics = programCache->statistics;
+}
+
+#pragma mark -
+#pragma mark Loading
+
+// Returns 0 if there is no valid binary for the key
+static GLuint loadCachedProgram(ProgramCache_t * programCache, const char * path, uint64_t key, uint64_t sourceLength, bool * stale)
+{
+    FILE * file = fopen(path, "rb");
+
+    if (!file)
+    {
+        return 0;
+    }
+
+    GLuint programHandle = 0;
+    void * binary = NULL;
+    ProgramCacheFileHeader_t header;
+
+    // Any mismatch means the cached binary can't be used
+    *stale = true;
+
+    if (fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == kProgramCacheFileMagic &&
+        header.version == kProgramCacheFileVersion &&
+        header.key == key &&
+        header.sourceLength == sourceLength &&
+        header.binaryLength > 0 &&
+        (binary = malloc(header.binaryLength)) != NULL &&
+        fread(binary, header.binaryLength, 1, file) == 1 &&
+        hashBytes(0xcbf29ce484222325ull, binary, header.binaryLength) == header.binaryChecksum)
+    {
+        programHandle = glCreateProgram();
+        clearPendingErrors();
+        programCache->programBinary(programHandle, header.binaryFormat, binary, header.binaryLength);
+
+        // The driver rejects binaries it can't use anymore (ie. after an update)
+        GLint linkStatus = GL_FALSE;
+        glGetProgramiv(programHandle, GL_LINK_STATUS, &linkStatus);
+
+        if (glGetError() != GL_NO_ERROR || linkStatus != GL_TRUE)
+        {
+            glDeleteProgram(programHandle);
+            programHandle = 0;
+        }
+        else
+        {
+            *stale = false;
+        }
+    }
+
+    free(binary);
+    fclose(file);
+
+    return programHandle;
+}
+
+static bool storeCachedProgram(ProgramCache_t * programCache, GLuint programHandle, const char * path, uint64_t key, uint64_t sourceLength)
+{
+    GLint binaryLength = 0;
+    clearPendingErrors();
+    glGetProgramiv(programHandle, GL_PROGRAM_BINARY_LENGTH_OES, &binaryLength);
+
+    if (glGetError() != GL_NO_ERROR || binaryLength <= 0)
+    {
+        return false;
+    }
+
+    void * binary = malloc(binaryLength);
+    GLenum binaryFormat = 0;
+    GLsizei length = 0;
+
+    if (!binary)
+    {
+        return false;
+    }
+
+    clearPendingErrors();
+    programCache->getProgramBinary(programHandle, binaryLength, &length, &binaryFormat, binary);
+
+    bool stored = false;
+
+    if (glGetError() == GL_NO_ERROR && length > 0)
+    {
+        ProgramCacheFileHeader_t header = {
+            .magic = kProgramCacheFileMagic,
+            .version = kProgramCacheFileVersion,
+            .key = key,
+            .sourceLength = sourceLength,
+            .binaryFormat = binaryFormat,
+            .binaryLength = (uint32_t)length,
+            .binaryChecksum = hashBytes(0xcbf29ce484222325ull, binary, length),
+        };
+
+        // Write a temporary file and rename it, readers never see a partial file
+        char temporaryPath[1024];
+        int temporaryPathLength = snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", path);
+
+        // Not stored if the temporary path doesn't fit (the rename would replace another file)
+        FILE * file = (temporaryPathLength >= 0 && (size_t)temporaryPathLength < sizeof(temporaryPath)) ? fopen(temporaryPath, "wb") : NULL;
+
+        if (file)
+        {
+            stored = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary, length, 1, file) == 1;
+            stored = (fclose(file) == 0) && stored;
+            stored = stored && rename(temporaryPath, path) == 0;
+
+            if (!stored)
+            {
+                remove(temporaryPath);
+            }
+        }
+    }
+
+    free(binary);
+
+    return stored;
+}
+
+GLuint programCacheLoadProgram(ProgramCache_t * programCache, const char * vertexShaderSource, const char * fragmentShaderSource)
+{
+    double startTime = currentTime();
+
+    bool binaryAvailable = programCacheBinarySupported(programCache);
+    uint64_t key = 0;
+    uint64_t sourceLength = strlen(vertexShaderSource) + strlen(fragmentShaderSource);
+    char path[1024];
+
+    if (binaryAvailable)
+    {
+        key = programKey(vertexShaderSource, fragmentShaderSource);
+        binaryAvailable = programCacheFilePath(programCache, key, path, sizeof(path));
+    }
+
+    if (binaryAvailable)
+    {
+
+        bool stale = false;
+        GLuint programHandle = loadCachedProgram(programCache, path, key, sourceLength, &stale);
+
+        if (programHandle)
+        {
+            programCache->statistics.hitCount++;
+            programCache->statistics.loadTime += currentTime() - startTime;
+            return programHandle;
+        }
+
+        if (stale)
+        {
+            Logc("ProgramCache: Cached program %016llx is stale, compiling from source", (unsigned long long)key);
+            programCache->statistics.staleCount++;
+            remove(path);
+        }
+    }
+
+    // Miss, compile and link from source
+    GLuint programHandle = loadProgram(vertexShaderSource, fragmentShaderSource);
+
+    programCache->statistics.missCount++;
+    programCache->statistics.compileTime += currentTime() - startTime;
+
+    if (binaryAvailable && programHandle && storeCachedProgram(programCache, programHandle, path, key, sourceLength))
+    {
+        programCache->statistics.storeCount++;
+    }
+
+    return programHandle;
+}
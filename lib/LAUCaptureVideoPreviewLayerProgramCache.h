@@ -0,0 +1,85 @@
+/*
+
+ LAUCaptureVideoPreviewLayerProgramCache.h
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef LAUCaptureVideoPreviewLayerProgramCache_h
+#define LAUCaptureVideoPreviewLayerProgramCache_h
+
+#include "LAUCaptureVideoPreviewLayerUtilities.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Persistent cache of linked programs (GL_OES_get_program_binary)
+
+ - Programs are keyed on a hash of the vertex and fragment shader sources and the driver (vendor, renderer, version)
+ - A cached binary that is missing, corrupted or rejected by the driver falls back to loadProgram (source compile)
+   and the new binary replaces the cached one
+ - Without GL_OES_get_program_binary (or binary formats) every load is a miss, same as loadProgram
+
+ Must be used with the same OpenGL context current as the programs.
+ */
+
+typedef void (*ProgramCacheGetProgramBinaryFunction)(GLuint program, GLsizei bufferSize, GLsizei * length, GLenum * binaryFormat, void * binary);
+typedef void (*ProgramCacheProgramBinaryFunction)(GLuint program, GLenum binaryFormat, const void * binary, GLint length);
+
+// Counters since the cache was created
+struct ProgramCacheStatistics {
+    unsigned long hitCount; // Programs loaded from a cached binary
+    unsigned long missCount; // Programs compiled from source
+    unsigned long staleCount; // Cached binaries rejected (subset of the misses)
+    unsigned long storeCount; // Binaries written to the cache
+    double compileTime; // Seconds spent compiling and linking from source
+    double loadTime; // Seconds spent loading cached binaries
+};
+
+typedef struct ProgramCacheStatistics ProgramCacheStatistics_t;
+
+typedef struct ProgramCache ProgramCache_t;
+
+// Cache memory management. The directory must exist, NULL disables the persistent cache
+ProgramCache_t * createProgramCache(const char * directoryPath);
+void releaseProgramCache(ProgramCache_t * programCache);
+
+// Binary functions for platforms that resolve extensions at runtime (ie. eglGetProcAddress)
+// By default the GL_OES_get_program_binary functions of the OpenGL ES headers are used if available
+void programCacheSetBinaryFunctions(ProgramCache_t * programCache, ProgramCacheGetProgramBinaryFunction getProgramBinary, ProgramCacheProgramBinaryFunction programBinary);
+
+// True if programs are stored in and loaded from the cache directory (directory, binary functions and formats available)
+bool programCacheBinarySupported(ProgramCache_t * programCache);
+
+// Same as loadProgram, but uses the cached binary when possible
+GLuint programCacheLoadProgram(ProgramCache_t * programCache, const char * vertexShaderSource, const char * fragmentShaderSource);
+
+void programCacheStatistics(const ProgramCache_t * programCache, ProgramCacheStatistics_t * statistics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAUCaptureVideoPreviewLayerProgramCache_h */
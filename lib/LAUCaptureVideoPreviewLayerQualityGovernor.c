@@ -0,0 +1,373 @@
+/*
+
+ LAUCaptureVideoPreviewLayerQualityGovernor.c
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "LAUCaptureVideoPreviewLayerQualityGovernor.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+const QualityGovernorLevel_t kQualityGovernorDefaultLevels[] = {
+    { .downsamplingFactor = 4.0f, .multiplePassCount = 2, .maxSamples = 0, .cost = 1.00f },
+    { .downsamplingFactor = 6.0f, .multiplePassCount = 2, .maxSamples = 0, .cost = 0.51f },
+    { .downsamplingFactor = 8.0f, .multiplePassCount = 2, .maxSamples = 0, .cost = 0.39f },
+    { .downsamplingFactor = 8.0f, .multiplePassCount = 1, .maxSamples = 0, .cost = 0.36f },
+    { .downsamplingFactor = 8.0f, .multiplePassCount = 1, .maxSamples = 6, .cost = 0.34f },
+};
+
+const unsigned int kQualityGovernorDefaultLevelCount = sizeof(kQualityGovernorDefaultLevels) / sizeof(kQualityGovernorDefaultLevels[0]);
+
+const QualityGovernorParameters_t kQualityGovernorDefaultParameters = {
+    .frameBudget = 0.5 / 60.0,
+    .windowFrameCount = 30,
+};
+
+struct QualityGovernor {
+
+    QualityGovernorLevel_t * levels;
+    unsigned int levelCount;
+    unsigned int levelIndex;
+
+    QualityGovernorParameters_t parameters;
+
+    // Policy, the hysteresis policy is used if none is set
+    QualityGovernorPolicy_t policy;
+    QualityGovernorHysteresisPolicy_t hysteresisPolicy;
+
+    // Frame times of the current window (windowFrameCount values)
+    double * frameTimes;
+    unsigned int frameTimeCount;
+
+    QualityGovernorCounters_t counters;
+};
+
+#pragma mark -
+#pragma mark Hysteresis policy
+
+// Frame time of the window predicted at another level
+static double predictedFrameTime(const QualityGovernorWindow_t * window, unsigned int levelIndex)
+{
+    float cost = window->levels[window->levelIndex].cost;
+    return cost > 0.0f ? window->p90 * window->levels[levelIndex].cost / cost : window->p90;
+}
+
+static unsigned int hysteresisPolicySelectLevel(void * context, const QualityGovernorWindow_t * window)
+{
+    QualityGovernorHysteresisPolicy_t * policy = (QualityGovernorHysteresisPolicy_t *)context;
+
+    bool raised = policy->raised;
+    policy->raised = false;
+
+    if (window->p90 > policy->lowerThreshold * window->frameBudget)
+    {
+        policy->raiseWindowCounter = 0;
+
+        // The higher level didn't fit, back to the previous level and wait longer before the next raise to it
+        if (raised)
+        {
+            if (policy->raiseBackoffs[window->levelIndex] < kQualityGovernorMaxRaiseBackoff)
+            {
+                policy->raiseBackoffs[window->levelIndex] *= 2;
+            }
+
+            return window->levelIndex + 1;
+        }
+
+        // First level predicted to fit, the cheapest one otherwise
+        unsigned int levelIndex = window->levelIndex;
+        while (levelIndex + 1 < window->levelCount)
+        {
+            ++levelIndex;
+
+            if (predictedFrameTime(window, levelIndex) <= policy->raiseThreshold * window->frameBudget)
+            {
+                break;
+            }
+        }
+
+        return levelIndex;
+    }
+
+    // The raise held for a whole window
+    if (raised && policy->raiseBackoffs[window->levelIndex] > 1)
+    {
+        policy->raiseBackoffs[window->levelIndex] /= 2;
+    }
+
+    if (window->levelIndex > 0 && predictedFrameTime(window, window->levelIndex - 1) <= policy->raiseThreshold * window->frameBudget)
+    {
+        if (++policy->raiseWindowCounter >= policy->raiseWindowCount * policy->raiseBackoffs[window->levelIndex - 1])
+        {
+            policy->raiseWindowCounter = 0;
+            policy->raised = true;
+            return window->levelIndex - 1;
+        }
+    }
+    else
+    {
+        policy->raiseWindowCounter = 0;
+    }
+
+    return window->levelIndex;
+}
+
+static void hysteresisPolicyReset(void * context)
+{
+    QualityGovernorHysteresisPolicy_t * policy = (QualityGovernorHysteresisPolicy_t *)context;
+    policy->raiseWindowCounter = 0;
+    policy->raised = false;
+
+    for (unsigned int l = 0; l < kQualityGovernorMaxLevelCount; ++l)
+    {
+        policy->raiseBackoffs[l] = 1;
+    }
+}
+
+void qualityGovernorHysteresisPolicyInit(QualityGovernorHysteresisPolicy_t * policy)
+{
+    policy->lowerThreshold = 1.0f;
+    policy->raiseThreshold = 0.85f;
+    policy->raiseWindowCount = 4;
+    hysteresisPolicyReset(policy);
+}
+
+QualityGovernorPolicy_t qualityGovernorHysteresisPolicy(QualityGovernorHysteresisPolicy_t * policy)
+{
+    QualityGovernorPolicy_t hysteresisPolicy = { hysteresisPolicySelectLevel, hysteresisPolicyReset, policy };
+    return hysteresisPolicy;
+}
+
+#pragma mark -
+#pragma mark Memory management
+
+QualityGovernor_t * createQualityGovernor(const QualityGovernorLevel_t * levels, unsigned int levelCount, const QualityGovernorParameters_t * parameters)
+{
+    if (!levels || levelCount == 0)
+    {
+        levels = kQualityGovernorDefaultLevels;
+        levelCount = kQualityGovernorDefaultLevelCount;
+    }
+
+    if (levelCount > kQualityGovernorMaxLevelCount)
+    {
+        levelCount = kQualityGovernorMaxLevelCount;
+    }
+
+    if (!parameters)
+    {
+        parameters = &kQualityGovernorDefaultParameters;
+    }
+
+    QualityGovernor_t * governor = calloc(1, sizeof(QualityGovernor_t));
+
+    if (!governor)
+    {
+        return NULL;
+    }
+
+    governor->parameters = *parameters;
+    governor->parameters.windowFrameCount = parameters->windowFrameCount > 0 ? parameters->windowFrameCount : 1;
+
+    governor->levels = malloc(levelCount * sizeof(QualityGovernorLevel_t));
+    governor->frameTimes = malloc(governor->parameters.windowFrameCount * sizeof(double));
+
+    if (!governor->levels || !governor->frameTimes)
+    {
+        free(governor->levels);
+        free(governor->frameTimes);
+        free(governor);
+        return NULL;
+    }
+
+    memcpy(governor->levels, levels, levelCount * sizeof(QualityGovernorLevel_t));
+    governor->levelCount = levelCount;
+
+    qualityGovernorHysteresisPolicyInit(&governor->hysteresisPolicy);
+    qualityGovernorSetPolicy(governor, NULL);
+
+    return governor;
+}
+
+void releaseQualityGovernor(QualityGovernor_t * governor)
+{
+    if (!governor)
+    {
+        return;
+    }
+
+    free(governor->levels);
+    free(governor->frameTimes);
+    free(governor);
+}
+
+void qualityGovernorSetPolicy(QualityGovernor_t * governor, const QualityGovernorPolicy_t * policy)
+{
+    governor->policy = policy && policy->selectLevel ? *policy : qualityGovernorHysteresisPolicy(&governor->hysteresisPolicy);
+    governor->frameTimeCount = 0;
+
+    if (governor->policy.reset)
+    {
+        governor->policy.reset(governor->policy.context);
+    }
+}
+
+double qualityGovernorFrameBudget(const QualityGovernor_t * governor)
+{
+    return governor->parameters.frameBudget;
+}
+
+void qualityGovernorSetFrameBudget(QualityGovernor_t * governor, double frameBudget)
+{
+    governor->parameters.frameBudget = frameBudget;
+}
+
+#pragma mark -
+#pragma mark Frames
+
+static int compareFrameTimes(const void * a, const void * b)
+{
+    double frameTime = *(const double *)a;
+    double otherFrameTime = *(const double *)b;
+    return (frameTime > otherFrameTime) - (frameTime < otherFrameTime);
+}
+
+// Nearest rank percentile of sorted frame times
+static double percentile(const double * frameTimes, unsigned int frameTimeCount, double p)
+{
+    unsigned int rank = (unsigned int)ceil(p * frameTimeCount);
+    return frameTimes[rank > 0 ? rank - 1 : 0];
+}
+
+bool qualityGovernorAddFrameTime(QualityGovernor_t * governor, double frameTime)
+{
+    governor->frameTimes[governor->frameTimeCount++] = frameTime;
+    governor->counters.frameCount++;
+
+    if (governor->frameTimeCount < governor->parameters.windowFrameCount)
+    {
+        return false;
+    }
+
+    unsigned int frameTimeCount = governor->frameTimeCount;
+    governor->frameTimeCount = 0;
+    governor->counters.windowCount++;
+
+    qsort(governor->frameTimes, frameTimeCount, sizeof(double), compareFrameTimes);
+
+    QualityGovernorWindow_t window;
+    window.frameCount = frameTimeCount;
+    window.mean = 0.0;
+    for (unsigned int i = 0; i < frameTimeCount; ++i)
+    {
+        window.mean += governor->frameTimes[i];
+    }
+    window.mean /= frameTimeCount;
+    window.p50 = percentile(governor->frameTimes, frameTimeCount, 0.5);
+    window.p90 = percentile(governor->frameTimes, frameTimeCount, 0.9);
+    window.max = governor->frameTimes[frameTimeCount - 1];
+    window.frameBudget = governor->parameters.frameBudget;
+    window.levelIndex = governor->levelIndex;
+    window.levels = governor->levels;
+    window.levelCount = governor->levelCount;
+
+    unsigned int levelIndex = governor->policy.selectLevel(governor->policy.context, &window);
+
+    if (levelIndex >= governor->levelCount)
+    {
+        levelIndex = governor->levelCount - 1;
+    }
+
+    if (levelIndex == governor->levelIndex)
+    {
+        return false;
+    }
+
+    if (levelIndex > governor->levelIndex)
+    {
+        governor->counters.lowerCount++;
+    }
+    else
+    {
+        governor->counters.raiseCount++;
+    }
+
+    governor->levelIndex = levelIndex;
+    return true;
+}
+
+void qualityGovernorReset(QualityGovernor_t * governor)
+{
+    governor->levelIndex = 0;
+    governor->frameTimeCount = 0;
+
+    if (governor->policy.reset)
+    {
+        governor->policy.reset(governor->policy.context);
+    }
+}
+
+unsigned int qualityGovernorLevelIndex(const QualityGovernor_t * governor)
+{
+    return governor->levelIndex;
+}
+
+unsigned int qualityGovernorLevelCount(const QualityGovernor_t * governor)
+{
+    return governor->levelCount;
+}
+
+const QualityGovernorLevel_t * qualityGovernorLevel(const QualityGovernor_t * governor, unsigned int levelIndex)
+{
+    return levelIndex < governor->levelCount ? &governor->levels[levelIndex] : NULL;
+}
+
+void qualityGovernorCounters(const QualityGovernor_t * governor, QualityGovernorCounters_t * counters)
+{
+    *counters = governor->counters;
+}
+
+#pragma mark -
+#pragma mark Sigma
+
+float qualityGovernorEffectiveSigma(const QualityGovernorLevel_t * level, float sigma)
+{
+    // Each pass adds its variance, downsampling scales the kernel
+    return sigma * sqrtf((float)level->multiplePassCount) * level->downsamplingFactor;
+}
+
+float qualityGovernorKernelSigma(const QualityGovernorLevel_t * level, const QualityGovernorLevel_t * referenceLevel, float sigma, const GaussianFilterKernelParameters_t * parameters)
+{
+    float kernelSigma = qualityGovernorEffectiveSigma(referenceLevel, sigma) / qualityGovernorEffectiveSigma(level, 1.0f);
+
+    // Largest sigma with btsGaussianFilterSamplesForSize(size) <= maxSamples, radius = ceil(truncation * sigma) <= 2 * maxSamples - 1
+    if (level->maxSamples > 0 && parameters->truncation > 0.0f)
+    {
+        kernelSigma = fminf(kernelSigma, (2.0f * level->maxSamples - 1.0f) / parameters->truncation);
+    }
+
+    return fmaxf(parameters->minSigma, fminf(parameters->maxSigma, kernelSigma));
+}
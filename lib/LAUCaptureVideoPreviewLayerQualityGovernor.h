@@ -0,0 +1,177 @@
+/*
+
+ LAUCaptureVideoPreviewLayerQualityGovernor.h
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#ifndef LAUCaptureVideoPreviewLayerQualityGovernor_h
+#define LAUCaptureVideoPreviewLayerQualityGovernor_h
+
+#include <stdbool.h>
+
+#include "LAUCaptureVideoPreviewLayerGaussianFilterKernel.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Adaptive quality governor, keeps the render time of the frames under a budget
+
+ - Quality levels are filter parameters (downsampling factor, pass count and kernel samples) ordered
+   from the highest quality (level 0) to the cheapest one
+ - Frame times are collected in windows of windowFrameCount frames. At the end of each window the
+   policy picks the level for the next window from the frame time statistics
+ - The default policy (QualityGovernorHysteresisPolicy_t) lowers the quality as soon as a window is over
+   budget and raises it only after several windows where the higher level is predicted to fit with a margin
+ - The blur stays the same across levels: the kernel sigma of a level is scaled so that the effective
+   std. deviation (in pixel buffer pixels) matches the reference level (see qualityGovernorKernelSigma)
+
+ Not thread safe, frame times are added by the render loop.
+ */
+
+struct QualityGovernorLevel {
+    float downsamplingFactor; // _filterDownsamplingFactor
+    unsigned int multiplePassCount; // _filterMultiplePassCount
+    unsigned int maxSamples; // Largest bts kernel (samples per side), 0 for no limit besides the kernel parameters
+    float cost; // Frame time relative to level 0, used to predict the frame time at another level
+};
+
+typedef struct QualityGovernorLevel QualityGovernorLevel_t;
+
+// Levels beyond are ignored
+#define kQualityGovernorMaxLevelCount 16
+
+// Default levels, level 0 is the default filter parameters of the layer (downsampling factor 4, 2 passes)
+// The costs were measured with the headless renderer (1080p frames, 750x1334 view, see LAUCaptureVideoPreviewLayerQualityGovernorSimulation)
+extern const QualityGovernorLevel_t kQualityGovernorDefaultLevels[];
+extern const unsigned int kQualityGovernorDefaultLevelCount;
+
+struct QualityGovernorParameters {
+    double frameBudget; // Seconds
+    unsigned int windowFrameCount; // Frames per decision (at least 1)
+};
+
+typedef struct QualityGovernorParameters QualityGovernorParameters_t;
+
+// 8ms budget (half a 60Hz display refresh), decisions every 30 frames
+extern const QualityGovernorParameters_t kQualityGovernorDefaultParameters;
+
+// Frame time statistics (seconds) of a complete window, passed to the policy
+struct QualityGovernorWindow {
+    unsigned int frameCount;
+    double mean;
+    double p50;
+    double p90;
+    double max;
+    double frameBudget;
+    unsigned int levelIndex; // Level of the frames of the window
+    const QualityGovernorLevel_t * levels;
+    unsigned int levelCount;
+};
+
+typedef struct QualityGovernorWindow QualityGovernorWindow_t;
+
+// Policy: level index [0, levelCount[ for the next window. The context is owned by the caller
+// reset (optional) is called when the governor is reset or the policy is set
+struct QualityGovernorPolicy {
+    unsigned int (*selectLevel)(void * context, const QualityGovernorWindow_t * window);
+    void (*reset)(void * context);
+    void * context;
+};
+
+typedef struct QualityGovernorPolicy QualityGovernorPolicy_t;
+
+// Default policy
+// - A window with p90 over lowerThreshold * frameBudget lowers the quality, to the first level predicted
+//   (p90 * cost ratio) under raiseThreshold * frameBudget
+// - raiseWindowCount consecutive windows with the higher level predicted under raiseThreshold * frameBudget
+//   raise the quality by one level
+// - A raise over budget in the next window (wrong prediction) goes back to the previous level and doubles the
+//   windows needed for the next raise to the same level, a raise that holds for a window halves them
+struct QualityGovernorHysteresisPolicy {
+    float lowerThreshold;
+    float raiseThreshold;
+    unsigned int raiseWindowCount;
+
+    // State
+    unsigned int raiseWindowCounter; // Consecutive windows the higher level is predicted to fit
+    unsigned int raiseBackoffs[kQualityGovernorMaxLevelCount]; // Multiplier of raiseWindowCount for a raise to each level (1 to kQualityGovernorMaxRaiseBackoff)
+    bool raised; // The last window raised the quality
+};
+
+typedef struct QualityGovernorHysteresisPolicy QualityGovernorHysteresisPolicy_t;
+
+#define kQualityGovernorMaxRaiseBackoff 16
+
+// Thresholds 1.0 and 0.85, 4 windows (2s at 60fps)
+void qualityGovernorHysteresisPolicyInit(QualityGovernorHysteresisPolicy_t * policy);
+QualityGovernorPolicy_t qualityGovernorHysteresisPolicy(QualityGovernorHysteresisPolicy_t * policy);
+
+// Counters since the governor was created
+struct QualityGovernorCounters {
+    unsigned long frameCount;
+    unsigned long windowCount;
+    unsigned long lowerCount; // Level changes to a cheaper level
+    unsigned long raiseCount;
+};
+
+typedef struct QualityGovernorCounters QualityGovernorCounters_t;
+
+typedef struct QualityGovernor QualityGovernor_t;
+
+// Governor memory management, the levels are copied. NULL levels (or parameters) use the defaults
+// The governor starts at level 0 with the hysteresis policy (default thresholds)
+QualityGovernor_t * createQualityGovernor(const QualityGovernorLevel_t * levels, unsigned int levelCount, const QualityGovernorParameters_t * parameters);
+void releaseQualityGovernor(QualityGovernor_t * governor);
+
+// NULL restores the default hysteresis policy, the current window is discarded
+void qualityGovernorSetPolicy(QualityGovernor_t * governor, const QualityGovernorPolicy_t * policy);
+
+double qualityGovernorFrameBudget(const QualityGovernor_t * governor);
+void qualityGovernorSetFrameBudget(QualityGovernor_t * governor, double frameBudget);
+
+// Render time of a frame rendered at the current level. Returns true if the level changed (applies to the next frame)
+bool qualityGovernorAddFrameTime(QualityGovernor_t * governor, double frameTime);
+
+// Back to level 0, the current window is discarded and the policy is reset
+void qualityGovernorReset(QualityGovernor_t * governor);
+
+unsigned int qualityGovernorLevelIndex(const QualityGovernor_t * governor);
+unsigned int qualityGovernorLevelCount(const QualityGovernor_t * governor);
+const QualityGovernorLevel_t * qualityGovernorLevel(const QualityGovernor_t * governor, unsigned int levelIndex);
+
+void qualityGovernorCounters(const QualityGovernor_t * governor, QualityGovernorCounters_t * counters);
+
+// Std. deviation in pixel buffer pixels of a kernel sigma (offscreen pixels) applied with the parameters of a level
+float qualityGovernorEffectiveSigma(const QualityGovernorLevel_t * level, float sigma);
+
+// Kernel sigma at a level with the same effective std. deviation as sigma at the reference level,
+// limited to the kernels of the level (maxSamples) and to the sigma range of the parameters
+float qualityGovernorKernelSigma(const QualityGovernorLevel_t * level, const QualityGovernorLevel_t * referenceLevel, float sigma, const GaussianFilterKernelParameters_t * parameters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAUCaptureVideoPreviewLayerQualityGovernor_h */
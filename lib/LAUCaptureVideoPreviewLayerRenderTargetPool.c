@@ -0,0 +1,367 @@
+/*
+
+ LAUCaptureVideoPreviewLayerRenderTargetPool.c
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "LAUCaptureVideoPreviewLayerRenderTargetPool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct RenderTarget {
+
+    // Key
+    GLsizei width;
+    GLsizei height;
+    GLenum format;
+
+    GLuint textureName;
+    GLuint framebuffer;
+    size_t byteCount;
+
+    bool inUse;
+    unsigned long lastUse; // Tick of the last acquire or relinquish (least recently used free target is deleted first)
+};
+
+typedef struct RenderTarget RenderTarget_t;
+
+struct RenderTargetPool {
+
+    RenderTarget_t * targets;
+    unsigned int targetCount;
+    unsigned int targetCapacity;
+    unsigned long tick;
+
+    GLuint quadVertexBuffer;
+
+    RenderTargetPoolStatistics_t statistics;
+};
+
+#pragma mark -
+#pragma mark Memory management
+
+RenderTargetPool_t * createRenderTargetPool(size_t memoryBudget)
+{
+    RenderTargetPool_t * pool = calloc(1, sizeof(RenderTargetPool_t));
+
+    if (pool)
+    {
+        pool->statistics.memoryBudget = memoryBudget;
+    }
+
+    return pool;
+}
+
+static void deleteRenderTarget(RenderTargetPool_t * pool, unsigned int index)
+{
+    RenderTarget_t * target = &pool->targets[index];
+
+    glDeleteFramebuffers(1, &target->framebuffer);
+    glDeleteTextures(1, &target->textureName);
+
+    pool->statistics.liveByteCount -= target->byteCount;
+    pool->statistics.liveTargetCount--;
+
+    if (target->inUse)
+    {
+        pool->statistics.inUseByteCount -= target->byteCount;
+        pool->statistics.inUseTargetCount--;
+    }
+
+    // Order doesn't matter, move the last target
+    pool->targets[index] = pool->targets[--pool->targetCount];
+}
+
+void releaseRenderTargetPool(RenderTargetPool_t * pool)
+{
+    if (!pool)
+    {
+        return;
+    }
+
+    while (pool->targetCount > 0)
+    {
+        deleteRenderTarget(pool, pool->targetCount - 1);
+    }
+
+    if (pool->quadVertexBuffer)
+    {
+        glDeleteBuffers(1, &pool->quadVertexBuffer);
+    }
+
+    free(pool->targets);
+    free(pool);
+}
+
+static size_t bytesPerPixelForFormat(GLenum format)
+{
+    switch (format)
+    {
+        case GL_RGB:
+            return 3;
+        case GL_LUMINANCE_ALPHA:
+            return 2;
+        case GL_LUMINANCE:
+        case GL_ALPHA:
+            return 1;
+        default:
+            return 4; // GL_RGBA, GL_BGRA_EXT
+    }
+}
+
+static bool evictLeastRecentlyUsedRenderTarget(RenderTargetPool_t * pool)
+{
+    int leastRecentlyUsedIndex = -1;
+
+    for (unsigned int i = 0; i < pool->targetCount; ++i)
+    {
+        if (!pool->targets[i].inUse && (leastRecentlyUsedIndex < 0 || pool->targets[i].lastUse < pool->targets[leastRecentlyUsedIndex].lastUse))
+        {
+            leastRecentlyUsedIndex = (int)i;
+        }
+    }
+
+    if (leastRecentlyUsedIndex < 0)
+    {
+        return false;
+    }
+
+    deleteRenderTarget(pool, (unsigned int)leastRecentlyUsedIndex);
+    pool->statistics.evictionCount++;
+
+    return true;
+}
+
+void renderTargetPoolSetMemoryBudget(RenderTargetPool_t * pool, size_t memoryBudget)
+{
+    pool->statistics.memoryBudget = memoryBudget;
+
+    while (pool->statistics.liveByteCount > memoryBudget && evictLeastRecentlyUsedRenderTarget(pool));
+}
+
+void renderTargetPoolTrim(RenderTargetPool_t * pool)
+{
+    while (evictLeastRecentlyUsedRenderTarget(pool));
+}
+
+#pragma mark -
+#pragma mark Render targets
+
+static int renderTargetIndexForTextureInstance(const RenderTargetPool_t * pool, const TextureInstance_t * textureInstance)
+{
+    if (!textureInstance->textureName)
+    {
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < pool->targetCount; ++i)
+    {
+        if (pool->targets[i].inUse && pool->targets[i].textureName == textureInstance->textureName)
+        {
+            return (int)i;
+        }
+    }
+
+    return -1;
+}
+
+static RenderTarget_t * createRenderTarget(RenderTargetPool_t * pool, GLsizei width, GLsizei height, GLenum format)
+{
+    size_t byteCount = (size_t)width * (size_t)height * bytesPerPixelForFormat(format);
+
+    // Make room with the free targets first
+    while (pool->statistics.liveByteCount + byteCount > pool->statistics.memoryBudget && evictLeastRecentlyUsedRenderTarget(pool));
+
+    if (pool->statistics.liveByteCount + byteCount > pool->statistics.memoryBudget)
+    {
+        pool->statistics.overBudgetCount++;
+    }
+
+    if (pool->targetCount == pool->targetCapacity)
+    {
+        unsigned int targetCapacity = pool->targetCapacity ? 2 * pool->targetCapacity : 8;
+        RenderTarget_t * targets = realloc(pool->targets, targetCapacity * sizeof(RenderTarget_t));
+
+        if (!targets)
+        {
+            return NULL;
+        }
+
+        pool->targets = targets;
+        pool->targetCapacity = targetCapacity;
+    }
+
+    RenderTarget_t * target = &pool->targets[pool->targetCount++];
+    memset(target, 0, sizeof(RenderTarget_t));
+    target->width = width;
+    target->height = height;
+    target->format = format;
+    target->byteCount = byteCount;
+
+    // Same as createFramebufferForOffscreenTextureInstance:
+    glGenFramebuffers(1, &target->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+
+    glGenTextures(1, &target->textureName);
+    glBindTexture(GL_TEXTURE_2D, target->textureName);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, NULL);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->textureName, 0);
+
+    pool->statistics.liveByteCount += byteCount;
+    pool->statistics.liveTargetCount++;
+    pool->statistics.allocationCount++;
+
+    if (pool->statistics.liveByteCount > pool->statistics.peakByteCount)
+    {
+        pool->statistics.peakByteCount = pool->statistics.liveByteCount;
+    }
+
+    return target;
+}
+
+bool renderTargetPoolAcquireTextureInstance(RenderTargetPool_t * pool, TextureInstance_t * textureInstance, GLfloat width, GLfloat height, GLenum format)
+{
+    // glTexImage2D truncates the dimensions
+    GLsizei targetWidth = (GLsizei)width;
+    GLsizei targetHeight = (GLsizei)height;
+
+    if (targetWidth <= 0 || targetHeight <= 0)
+    {
+        return false;
+    }
+
+    textureInstance->textureWidth = width;
+    textureInstance->textureHeight = height;
+
+    // Same key, keep the current target
+    int index = renderTargetIndexForTextureInstance(pool, textureInstance);
+
+    if (index >= 0 && pool->targets[index].width == targetWidth && pool->targets[index].height == targetHeight && pool->targets[index].format == format)
+    {
+        return true;
+    }
+
+    renderTargetPoolRelinquishTextureInstance(pool, textureInstance);
+
+    // Free target with the same key (most recently used first, its memory is more likely to be resident)
+    RenderTarget_t * target = NULL;
+
+    for (unsigned int i = 0; i < pool->targetCount; ++i)
+    {
+        RenderTarget_t * candidate = &pool->targets[i];
+
+        if (!candidate->inUse && candidate->width == targetWidth && candidate->height == targetHeight && candidate->format == format && (!target || candidate->lastUse > target->lastUse))
+        {
+            target = candidate;
+        }
+    }
+
+    bool complete = true;
+
+    if (target)
+    {
+        pool->statistics.reuseCount++;
+    }
+    else
+    {
+        target = createRenderTarget(pool, targetWidth, targetHeight, format);
+
+        if (!target)
+        {
+            return false;
+        }
+
+        complete = checkFramebufferStatusComplete();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    target->inUse = true;
+    target->lastUse = ++pool->tick;
+    pool->statistics.inUseByteCount += target->byteCount;
+    pool->statistics.inUseTargetCount++;
+
+    textureInstance->framebuffer = target->framebuffer;
+    textureInstance->textureName = target->textureName;
+    textureInstance->textureTarget = GL_TEXTURE_2D;
+
+    return complete;
+}
+
+void renderTargetPoolRelinquishTextureInstance(RenderTargetPool_t * pool, TextureInstance_t * textureInstance)
+{
+    int index = renderTargetIndexForTextureInstance(pool, textureInstance);
+
+    if (index >= 0)
+    {
+        RenderTarget_t * target = &pool->targets[index];
+        target->inUse = false;
+        target->lastUse = ++pool->tick;
+        pool->statistics.inUseByteCount -= target->byteCount;
+        pool->statistics.inUseTargetCount--;
+
+        // The budget may have been exceeded while every target was in use
+        while (pool->statistics.liveByteCount > pool->statistics.memoryBudget && evictLeastRecentlyUsedRenderTarget(pool));
+    }
+
+    textureInstance->framebuffer = 0;
+    textureInstance->textureName = 0;
+}
+
+#pragma mark -
+#pragma mark Geometry
+
+GLuint renderTargetPoolQuadVertexBuffer(RenderTargetPool_t * pool)
+{
+    if (!pool->quadVertexBuffer)
+    {
+        // Same quad as loadOffscreenTextureInstance:
+        static const VertexData_t vertexData[] = {
+            {{-1.0f, -1.0f}, {0.0f, 0.0f}}, // bottom left
+            {{ 1.0f, -1.0f}, {1.0f, 0.0f}}, // bottom right
+            {{-1.0f,  1.0f}, {0.0f, 1.0f}}, // top left
+            {{ 1.0f,  1.0f}, {1.0f, 1.0f}}, // top right
+        };
+
+        glGenBuffers(1, &pool->quadVertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, pool->quadVertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    return pool->quadVertexBuffer;
+}
+
+void renderTargetPoolStatistics(const RenderTargetPool_t * pool, RenderTargetPoolStatistics_t * statistics)
+{
+    *statistics = pool->statistics;
+}
@@ -0,0 +1,97 @@
+/*
+
+ LAUCaptureVideoPreviewLayerRenderTargetPool.h
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef LAUCaptureVideoPreviewLayerRenderTargetPool_h
+#define LAUCaptureVideoPreviewLayerRenderTargetPool_h
+
+#include <stddef.h>
+
+#include "LAUCaptureVideoPreviewLayerUtilities.h"
+#include "LAUCaptureVideoPreviewLayerStructures.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Pool of offscreen render targets (texture + framebuffer) and of the offscreen quad geometry
+
+ - Render targets are keyed on (width, height, format), a texture instance that changes dimensions
+   gives its target back to the pool and takes a free one with the new key (or a new one)
+ - Free targets stay allocated (ie. rotating back and forth doesn't allocate) until the memory budget
+   is exceeded, then the least recently used free targets are deleted first
+ - Targets in use are never deleted, an allocation that can't fit in the budget is still made and counted
+ - A single quad vertex buffer (same as loadOffscreenTextureInstance:) is shared by all targets
+
+ Must be used with the same OpenGL context current as the textures.
+ */
+
+// Counters since the pool was created, byte counts are the texture storage (width * height * bytes per pixel)
+struct RenderTargetPoolStatistics {
+    size_t liveByteCount; // Allocated targets, in use or free
+    size_t inUseByteCount; // Targets held by texture instances
+    size_t peakByteCount; // Maximum liveByteCount
+    size_t memoryBudget;
+    unsigned int liveTargetCount;
+    unsigned int inUseTargetCount;
+    unsigned long allocationCount; // Targets created (glGenTextures + glGenFramebuffers)
+    unsigned long reuseCount; // Free targets handed out again
+    unsigned long evictionCount; // Free targets deleted (budget or trim)
+    unsigned long overBudgetCount; // Allocations made over the budget because every target was in use
+};
+
+typedef struct RenderTargetPoolStatistics RenderTargetPoolStatistics_t;
+
+typedef struct RenderTargetPool RenderTargetPool_t;
+
+// Pool memory management, releasing the pool deletes every target (in use or not) and the quad vertex buffer
+RenderTargetPool_t * createRenderTargetPool(size_t memoryBudget);
+void releaseRenderTargetPool(RenderTargetPool_t * pool);
+
+// Changing the budget deletes free targets until the live bytes fit (or no free target is left)
+void renderTargetPoolSetMemoryBudget(RenderTargetPool_t * pool, size_t memoryBudget);
+
+// Sets the framebuffer, texture name/target and dimensions of the texture instance. Keeps its current target if the key didn't change.
+// Format is the texture format with GL_UNSIGNED_BYTE components (ie. GL_RGBA). Returns false if the framebuffer is incomplete.
+bool renderTargetPoolAcquireTextureInstance(RenderTargetPool_t * pool, TextureInstance_t * textureInstance, GLfloat width, GLfloat height, GLenum format);
+
+// Gives the target of the texture instance back to the pool and clears its framebuffer and texture name
+void renderTargetPoolRelinquishTextureInstance(RenderTargetPool_t * pool, TextureInstance_t * textureInstance);
+
+// Deletes every free target (ie. memory warning)
+void renderTargetPoolTrim(RenderTargetPool_t * pool);
+
+// Quad (triangle strip, 4 VertexData_t) covering the target with texture coordinates [0,1], created on first use
+GLuint renderTargetPoolQuadVertexBuffer(RenderTargetPool_t * pool);
+
+void renderTargetPoolStatistics(const RenderTargetPool_t * pool, RenderTargetPoolStatistics_t * statistics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAUCaptureVideoPreviewLayerRenderTargetPool_h */
@@ -0,0 +1,560 @@
+/*
+
+ LAUCaptureVideoPreviewLayerShaderGenerator.c
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "LAUCaptureVideoPreviewLayerShaderGenerator.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#pragma mark -
+#pragma mark Layout
+
+/*
+ Non-array vec2 varyings are packed two per varying vector (GLSL ES 1.0 packing rules),
+ so the budget is 2 * maxVaryingVectors vec2 varyings:
+
+ - Pre-calculated texture coordinates, 2 varyings per sample
+ - Pre-calculated offsets, 1 varying per sample plus FragTextureCoordinate
+ */
+
+unsigned int btsBlurFilterShaderMaxSamples(unsigned int maxVaryingVectors)
+{
+    // All samples as offsets
+    unsigned int varyingBudget = 2 * maxVaryingVectors;
+    return varyingBudget > 1 ? varyingBudget - 1 : 0;
+}
+
+bool btsBlurFilterShaderLayout(unsigned int samples, unsigned int maxVaryingVectors, BtsBlurFilterShaderLayout_t * layout)
+{
+    unsigned int varyingBudget = 2 * maxVaryingVectors;
+
+    if (samples == 0 || samples > btsBlurFilterShaderMaxSamples(maxVaryingVectors))
+    {
+        return false;
+    }
+
+    layout->samples = samples;
+
+    if (2 * samples <= varyingBudget)
+    {
+        // Every texture coordinate is pre-calculated
+        layout->textureCoordinateSamples = samples;
+        layout->offsetSamples = 0;
+        layout->varyingCount = 2 * samples;
+    }
+    else
+    {
+        // Moving a sample to the offsets frees one varying: 2t + (samples - t) + 1 <= budget
+        layout->textureCoordinateSamples = varyingBudget - 1 - samples;
+        layout->offsetSamples = samples - layout->textureCoordinateSamples;
+        layout->varyingCount = 2 * layout->textureCoordinateSamples + layout->offsetSamples + 1;
+    }
+
+    return true;
+}
+
+bool btsBlurFilterKernelBankFits(unsigned int kernelCount, unsigned int bankSamples, unsigned int maxVertexUniformVectors, unsigned int maxFragmentUniformVectors)
+{
+    if (kernelCount == 0 || bankSamples == 0)
+    {
+        return false;
+    }
+
+    // The bank, FilterKernelBankPosition and the direction vector (vertex) or the prefilter offset (fragment)
+    unsigned int uniformVectors = kernelCount * ((bankSamples + 3) / 4) + 2;
+    return uniformVectors <= maxVertexUniformVectors && uniformVectors <= maxFragmentUniformVectors;
+}
+
+bool btsBlurFilterIntensityMapFits(unsigned int kernelCount, unsigned int bankSamples, unsigned int maxFragmentUniformVectors)
+{
+    if (kernelCount == 0 || bankSamples == 0)
+    {
+        return false;
+    }
+
+    // Both banks, FilterKernelBankPosition, the direction vector and the prefilter offset (fragment only)
+    unsigned int uniformVectors = 2 * kernelCount * ((bankSamples + 3) / 4) + 3;
+    return uniformVectors <= maxFragmentUniformVectors;
+}
+
+#pragma mark -
+#pragma mark Source
+
+struct ShaderSource {
+    char * string;
+    size_t length;
+    size_t capacity;
+};
+
+typedef struct ShaderSource ShaderSource_t;
+
+static void appendShaderSource(ShaderSource_t * source, const char * format, ...)
+{
+    va_list arguments;
+
+    for (;;)
+    {
+        va_start(arguments, format);
+        int length = vsnprintf(source->string + source->length, source->capacity - source->length, format, arguments);
+        va_end(arguments);
+
+        if (length < 0)
+        {
+            return;
+        }
+
+        if (source->length + length < source->capacity)
+        {
+            source->length += length;
+            return;
+        }
+
+        // Grow and print again
+        size_t capacity = 2 * (source->capacity + length);
+        char * string = realloc(source->string, capacity);
+
+        if (!string)
+        {
+            return;
+        }
+
+        source->string = string;
+        source->capacity = capacity;
+    }
+}
+
+static ShaderSource_t createShaderSource(void)
+{
+    ShaderSource_t source = {
+        .string = calloc(1, 4096),
+        .length = 0,
+        .capacity = 4096,
+    };
+
+    return source;
+}
+
+// Kernel bank of the kernel bank variants
+struct KernelBank {
+    unsigned int kernelCount;
+    unsigned int kernelVectors; // vec4 uniforms per kernel
+};
+
+typedef struct KernelBank KernelBank_t;
+
+static KernelBank_t kernelBankForSamples(unsigned int kernelCount, unsigned int bankSamples)
+{
+    KernelBank_t kernelBank = {
+        .kernelCount = kernelCount,
+        .kernelVectors = (bankSamples + 3) / 4,
+    };
+
+    return kernelBank;
+}
+
+static void appendKernelBankUniforms(ShaderSource_t * source, const KernelBank_t * kernelBank, const char * name, const char * comment)
+{
+    appendShaderSource(source, "uniform vec4 %s[%u]; // %s, %u kernels of %u vectors\n", name, kernelBank->kernelCount * kernelBank->kernelVectors, comment, kernelBank->kernelCount, kernelBank->kernelVectors);
+}
+
+static void appendKernelBankPositionUniform(ShaderSource_t * source)
+{
+    appendShaderSource(source, "uniform highp float FilterKernelBankPosition; // Kernel index, the fraction blends with the next kernel\n");
+}
+
+// Indices (kernel0, kernel1) and blend of the two kernels of the bank around a position
+static void appendKernelBankIndices(ShaderSource_t * source, const KernelBank_t * kernelBank, const char * position)
+{
+    unsigned int lastKernelIndex = kernelBank->kernelCount - 1;
+
+    appendShaderSource(source,
+                       "  float kernelPosition = clamp(%s, 0.0, %u.0);\n"
+                       "  float kernelIndex = min(floor(kernelPosition), %u.0);\n"
+                       "  float kernelBlend = kernelPosition - kernelIndex;\n"
+                       "  int kernel0 = int(kernelIndex) * %u;\n"
+                       "  int kernel1 = kernel0 + %u;\n",
+                       position, lastKernelIndex, lastKernelIndex ? lastKernelIndex - 1 : 0, kernelBank->kernelVectors, lastKernelIndex ? kernelBank->kernelVectors : 0);
+}
+
+// Blended values of the two kernels, in the vec4 variables <variable>0 ... for the first samples
+static void appendKernelBankValues(ShaderSource_t * source, unsigned int samples, const char * name, const char * variable)
+{
+    for (unsigned int v = 0; v < (samples + 3) / 4; ++v)
+    {
+        appendShaderSource(source, "  vec4 %s%u = mix(%s[kernel0 + %u], %s[kernel1 + %u], kernelBlend);\n", variable, v, name, v, name, v);
+    }
+}
+
+// Blended values of the two kernels around FilterKernelBankPosition
+static void appendKernelBankSelection(ShaderSource_t * source, const KernelBank_t * kernelBank, unsigned int samples, const char * name, const char * variable)
+{
+    appendShaderSource(source, "  // Kernels of the bank around FilterKernelBankPosition\n");
+    appendKernelBankIndices(source, kernelBank, "FilterKernelBankPosition");
+    appendKernelBankValues(source, samples, name, variable);
+    appendShaderSource(source, "\n");
+}
+
+// Value of a sample, an element of the uniform array or a component of the blended kernel bank values
+static const char * kernelValue(char * value, size_t size, const KernelBank_t * kernelBank, const char * name, const char * variable, unsigned int sample)
+{
+    if (kernelBank)
+    {
+        snprintf(value, size, "%s%u.%c", variable, sample / 4, "xyzw"[sample % 4]);
+    }
+    else
+    {
+        snprintf(value, size, "%s[%u]", name, sample);
+    }
+
+    return value;
+}
+
+// Box of one destination texel (prefilteredTexture2D) and its FilterPrefilterOffset uniform
+static void appendPrefilterFunction(ShaderSource_t * source)
+{
+    appendShaderSource(source,
+                       "uniform highp vec2 FilterPrefilterOffset; // Quarter of a destination texel\n"
+                       "\n"
+                       "// Box of one destination texel, 2x2 bilinear samples\n"
+                       "vec4 prefilteredTexture2D(sampler2D textureData, vec2 textureCoordinate)\n"
+                       "{\n"
+                       "  vec2 offset = vec2(FilterPrefilterOffset.x, -FilterPrefilterOffset.y);\n"
+                       "  return 0.25 * (texture2D(textureData, textureCoordinate - FilterPrefilterOffset) +\n"
+                       "                 texture2D(textureData, textureCoordinate - offset) +\n"
+                       "                 texture2D(textureData, textureCoordinate + offset) +\n"
+                       "                 texture2D(textureData, textureCoordinate + FilterPrefilterOffset));\n"
+                       "}\n");
+}
+
+static void appendVaryings(ShaderSource_t * source, const BtsBlurFilterShaderLayout_t * layout)
+{
+    if (layout->offsetSamples)
+    {
+        appendShaderSource(source, "varying vec2 FragTextureCoordinate;\n");
+    }
+
+    for (unsigned int i = 0; i < 2 * layout->textureCoordinateSamples; ++i)
+    {
+        appendShaderSource(source, "varying vec2 FragFilterTextureCoordinate%u;\n", i);
+    }
+
+    for (unsigned int i = 0; i < layout->offsetSamples; ++i)
+    {
+        appendShaderSource(source, "varying vec2 FragFilterSplitPassKernelOffset%u;\n", i);
+    }
+}
+
+static char * createVertexShaderSource(unsigned int samples, unsigned int maxVaryingVectors, const KernelBank_t * kernelBank)
+{
+    BtsBlurFilterShaderLayout_t layout;
+
+    if (!btsBlurFilterShaderLayout(samples, maxVaryingVectors, &layout))
+    {
+        return NULL;
+    }
+
+    ShaderSource_t source = createShaderSource();
+
+    appendShaderSource(&source,
+                       "// (In) Vertex attributes\n"
+                       "attribute vec4 VertPosition;\n"
+                       "attribute vec2 VertTextureCoordinate;\n"
+                       "\n"
+                       "// (In) Vertex uniforms (shared)\n"
+                       "uniform highp vec2 FilterSplitPassDirectionVector;\n"
+                       "\n"
+                       "// (In) Vertex uniforms\n");
+
+    if (kernelBank)
+    {
+        appendKernelBankUniforms(&source, kernelBank, "VertFilterKernelBankOffsets", "Offsets");
+        appendKernelBankPositionUniform(&source);
+    }
+    else
+    {
+        appendShaderSource(&source, "uniform float VertFilterKernelOffsets[%u];\n", samples);
+    }
+
+    appendShaderSource(&source,
+                       "\n"
+                       "// (Out) Fragment variables\n");
+
+    appendVaryings(&source, &layout);
+
+    appendShaderSource(&source,
+                       "\n"
+                       "void main()\n"
+                       "{\n");
+
+    if (kernelBank)
+    {
+        appendKernelBankSelection(&source, kernelBank, samples, "VertFilterKernelBankOffsets", "filterKernelOffsets");
+    }
+
+    appendShaderSource(&source, "  // Unrolled for loop. Constant FilterKernelSamples = %u.\n", samples);
+
+    if (layout.textureCoordinateSamples)
+    {
+        appendShaderSource(&source, "\n  // Pre-calculated texture coordinates\n");
+    }
+
+    char offset[64];
+
+    for (unsigned int s = 0; s < layout.textureCoordinateSamples; ++s)
+    {
+        kernelValue(offset, sizeof(offset), kernelBank, "VertFilterKernelOffsets", "filterKernelOffsets", s);
+        appendShaderSource(&source,
+                           "  FragFilterTextureCoordinate%u = VertTextureCoordinate - (%s*FilterSplitPassDirectionVector);\n"
+                           "  FragFilterTextureCoordinate%u = VertTextureCoordinate + (%s*FilterSplitPassDirectionVector);\n",
+                           2 * s, offset, 2 * s + 1, offset);
+    }
+
+    if (layout.offsetSamples)
+    {
+        appendShaderSource(&source, "\n  // Pre-calculated offsets, the texture coordinates don't fit in the varyings\n");
+    }
+
+    for (unsigned int i = 0; i < layout.offsetSamples; ++i)
+    {
+        kernelValue(offset, sizeof(offset), kernelBank, "VertFilterKernelOffsets", "filterKernelOffsets", layout.textureCoordinateSamples + i);
+        appendShaderSource(&source, "  FragFilterSplitPassKernelOffset%u = %s*FilterSplitPassDirectionVector;\n", i, offset);
+    }
+
+    if (layout.offsetSamples)
+    {
+        appendShaderSource(&source, "\n  FragTextureCoordinate = VertTextureCoordinate;\n");
+    }
+
+    appendShaderSource(&source,
+                       "  gl_Position = VertPosition;\n"
+                       "}\n");
+
+    return source.string;
+}
+
+char * createBtsBlurFilterVertexShaderSource(unsigned int samples, unsigned int maxVaryingVectors)
+{
+    return createVertexShaderSource(samples, maxVaryingVectors, NULL);
+}
+
+char * createBtsKernelBankBlurFilterVertexShaderSource(unsigned int samples, unsigned int maxVaryingVectors, unsigned int kernelCount, unsigned int bankSamples)
+{
+    if (kernelCount == 0 || samples > bankSamples)
+    {
+        return NULL;
+    }
+
+    KernelBank_t kernelBank = kernelBankForSamples(kernelCount, bankSamples);
+    return createVertexShaderSource(samples, maxVaryingVectors, &kernelBank);
+}
+
+static char * createFragmentShaderSource(unsigned int samples, unsigned int maxVaryingVectors, bool prefilter, const KernelBank_t * kernelBank)
+{
+    BtsBlurFilterShaderLayout_t layout;
+
+    if (!btsBlurFilterShaderLayout(samples, maxVaryingVectors, &layout))
+    {
+        return NULL;
+    }
+
+    ShaderSource_t source = createShaderSource();
+
+    appendShaderSource(&source,
+                       "#ifdef GL_ES\n"
+                       "precision highp float;\n"
+                       "#endif\n"
+                       "\n"
+                       "// Texture coordinates for the fragment\n");
+
+    appendVaryings(&source, &layout);
+
+    appendShaderSource(&source,
+                       "\n"
+                       "// Uniforms (VideoFrame)\n"
+                       "uniform sampler2D FragTextureData;\n"
+                       "\n"
+                       "// Uniforms (Filter)\n");
+
+    if (kernelBank)
+    {
+        appendKernelBankUniforms(&source, kernelBank, "FragFilterKernelBankWeights", "Weights");
+        appendKernelBankPositionUniform(&source);
+    }
+    else
+    {
+        appendShaderSource(&source, "uniform float FragFilterKernelWeights[%u]; // Weights\n", samples);
+    }
+
+    // Each sample reads the footprint of a destination texel in the (larger) source texture
+    const char * sampleFunction = "texture2D";
+
+    if (prefilter)
+    {
+        sampleFunction = "prefilteredTexture2D";
+
+        appendPrefilterFunction(&source);
+    }
+
+    appendShaderSource(&source,
+                       "\n"
+                       "void main()\n"
+                       "{\n"
+                       "  // Weighted color sum of all the neighbour pixel\n"
+                       "  vec4 weightedColor = vec4(0.0);\n"
+                       "\n");
+
+    if (kernelBank)
+    {
+        appendKernelBankSelection(&source, kernelBank, samples, "FragFilterKernelBankWeights", "filterKernelWeights");
+    }
+
+    appendShaderSource(&source, "  // Unrolled for loop. Constant FilterKernelSamples = %u.\n", samples);
+
+    char weight[64];
+
+    for (unsigned int s = 0; s < layout.textureCoordinateSamples; ++s)
+    {
+        kernelValue(weight, sizeof(weight), kernelBank, "FragFilterKernelWeights", "filterKernelWeights", s);
+        appendShaderSource(&source,
+                           "  weightedColor += %s * %s(FragTextureData, FragFilterTextureCoordinate%u);\n"
+                           "  weightedColor += %s * %s(FragTextureData, FragFilterTextureCoordinate%u);\n",
+                           weight, sampleFunction, 2 * s, weight, sampleFunction, 2 * s + 1);
+    }
+
+    for (unsigned int i = 0; i < layout.offsetSamples; ++i)
+    {
+        kernelValue(weight, sizeof(weight), kernelBank, "FragFilterKernelWeights", "filterKernelWeights", layout.textureCoordinateSamples + i);
+        appendShaderSource(&source,
+                           "  weightedColor += %s * %s(FragTextureData, FragTextureCoordinate - FragFilterSplitPassKernelOffset%u);\n"
+                           "  weightedColor += %s * %s(FragTextureData, FragTextureCoordinate + FragFilterSplitPassKernelOffset%u);\n",
+                           weight, sampleFunction, i, weight, sampleFunction, i);
+    }
+
+    appendShaderSource(&source,
+                       "\n"
+                       "  gl_FragColor = weightedColor;\n"
+                       "}\n");
+
+    return source.string;
+}
+
+char * createBtsBlurFilterFragmentShaderSource(unsigned int samples, unsigned int maxVaryingVectors)
+{
+    return createFragmentShaderSource(samples, maxVaryingVectors, false, NULL);
+}
+
+char * createBtsPrefilterBlurFilterFragmentShaderSource(unsigned int samples, unsigned int maxVaryingVectors)
+{
+    return createFragmentShaderSource(samples, maxVaryingVectors, true, NULL);
+}
+
+char * createBtsKernelBankBlurFilterFragmentShaderSource(unsigned int samples, unsigned int maxVaryingVectors, unsigned int kernelCount, unsigned int bankSamples, bool prefilter)
+{
+    if (kernelCount == 0 || samples > bankSamples)
+    {
+        return NULL;
+    }
+
+    KernelBank_t kernelBank = kernelBankForSamples(kernelCount, bankSamples);
+    return createFragmentShaderSource(samples, maxVaryingVectors, prefilter, &kernelBank);
+}
+
+char * createBtsIntensityMapBlurFilterFragmentShaderSource(unsigned int samples, unsigned int kernelCount, unsigned int bankSamples, bool prefilter)
+{
+    if (kernelCount == 0 || samples == 0 || samples > bankSamples)
+    {
+        return NULL;
+    }
+
+    KernelBank_t kernelBank = kernelBankForSamples(kernelCount, bankSamples);
+    ShaderSource_t source = createShaderSource();
+
+    appendShaderSource(&source,
+                       "#ifdef GL_ES\n"
+                       "precision highp float;\n"
+                       "#endif\n"
+                       "\n"
+                       "// Texture coordinates for the fragment\n"
+                       "varying vec2 FragTextureCoordinate;\n"
+                       "\n"
+                       "// Uniforms (VideoFrame)\n"
+                       "uniform sampler2D FragTextureData;\n"
+                       "uniform sampler2D FragFilterIntensityMap; // Intensity of the frame [0,1], scales FilterKernelBankPosition\n"
+                       "\n"
+                       "// Uniforms (Filter)\n"
+                       "uniform highp vec2 FilterSplitPassDirectionVector;\n");
+
+    // The offsets are read here, the vertex shader only passes the texture coordinate
+    appendKernelBankUniforms(&source, &kernelBank, "VertFilterKernelBankOffsets", "Offsets");
+    appendKernelBankUniforms(&source, &kernelBank, "FragFilterKernelBankWeights", "Weights");
+    appendKernelBankPositionUniform(&source);
+
+    const char * sampleFunction = "texture2D";
+
+    if (prefilter)
+    {
+        sampleFunction = "prefilteredTexture2D";
+        appendPrefilterFunction(&source);
+    }
+
+    appendShaderSource(&source,
+                       "\n"
+                       "void main()\n"
+                       "{\n"
+                       "  // Weighted color sum of all the neighbour pixel\n"
+                       "  vec4 weightedColor = vec4(0.0);\n"
+                       "\n"
+                       "  // Kernels of the bank around the position of this fragment\n");
+
+    appendKernelBankIndices(&source, &kernelBank, "FilterKernelBankPosition * texture2D(FragFilterIntensityMap, FragTextureCoordinate).r");
+    appendKernelBankValues(&source, samples, "VertFilterKernelBankOffsets", "filterKernelOffsets");
+    appendKernelBankValues(&source, samples, "FragFilterKernelBankWeights", "filterKernelWeights");
+
+    appendShaderSource(&source, "\n  // Unrolled for loop. Constant FilterKernelSamples = %u.\n", samples);
+
+    char offset[64], weight[64];
+
+    for (unsigned int s = 0; s < samples; ++s)
+    {
+        kernelValue(offset, sizeof(offset), &kernelBank, NULL, "filterKernelOffsets", s);
+        kernelValue(weight, sizeof(weight), &kernelBank, NULL, "filterKernelWeights", s);
+        appendShaderSource(&source,
+                           "  vec2 kernelOffset%u = %s*FilterSplitPassDirectionVector;\n"
+                           "  weightedColor += %s * %s(FragTextureData, FragTextureCoordinate - kernelOffset%u);\n"
+                           "  weightedColor += %s * %s(FragTextureData, FragTextureCoordinate + kernelOffset%u);\n",
+                           s, offset, weight, sampleFunction, s, weight, sampleFunction, s);
+    }
+
+    appendShaderSource(&source,
+                       "\n"
+                       "  gl_FragColor = weightedColor;\n"
+                       "}\n");
+
+    return source.string;
+}
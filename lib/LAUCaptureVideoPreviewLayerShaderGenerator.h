@@ -0,0 +1,109 @@
+/*
+
+ LAUCaptureVideoPreviewLayerShaderGenerator.h
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef LAUCaptureVideoPreviewLayerShaderGenerator_h
+#define LAUCaptureVideoPreviewLayerShaderGenerator_h
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Bts blur filter programs unrolled for a constant number of kernel samples
+
+ VertexShaderSourceBlurFilterBts is unrolled for 10 samples (the largest default kernel) so small
+ kernels still read 20 texels with zero weights. The generated variants read 2 texels per sample
+ of the kernel and nothing else.
+
+ - Texture coordinates are pre-calculated in the vertex shader as vec2 varyings (no dependent
+   texture reads) for as many samples as the varying budget allows
+ - The other samples get their offset as a varying and add it to FragTextureCoordinate
+ - Same attributes and uniforms as VertexShaderSourceBlurFilterBts, except FilterKernelSamples,
+   VertFilterKernelOffsets and FragFilterKernelWeights have exactly samples values
+
+ The prefilter fragment shader (first pass, FilterPrefilterEnabled) has the same varyings and replaces each texel
+ read with 4 bilinear reads at +/- FilterPrefilterOffset (a quarter of a destination texel), the average covers
+ the footprint of the destination texel in the source texture. It's used with the same vertex shader.
+
+ The kernel bank variants (FilterKernelBankEnabled) read the kernels from VertFilterKernelBankOffsets and
+ FragFilterKernelBankWeights instead of VertFilterKernelOffsets and FragFilterKernelWeights. The bank holds kernelCount
+ kernels of bankSamples samples (padded to vec4, see btsGaussianFilterKernelBankStride) and is uploaded once.
+ FilterKernelBankPosition selects the kernel: the offsets and weights of the kernels floor(position) and floor(position) + 1
+ are interpolated with the fraction, so changing the intensity only sets one float. Both shaders index the bank with the
+ uniform position, the fragment shader goes beyond the constant-index-expressions required by GLSL ES 1.0 (Appendix A),
+ so the program must be checked to link (it does on iOS and Mesa).
+
+ The intensity map variants (FilterKernelBankEnabled with an intensity map) blur each fragment with its own kernel:
+ FilterKernelBankPosition is scaled by FragFilterIntensityMap (texture unit 2, frame texture coordinates) and the blended
+ offsets and weights are read in the fragment shader, so both banks are fragment uniforms and every texel read is a
+ dependent read. They're used with VertexShaderSourceDefault and unrolled for the samples of the kernel at
+ FilterKernelBankPosition (the largest kernel of the frame).
+ */
+
+// Minimum GL_MAX_VARYING_VECTORS of OpenGL ES 2.0
+#define kBtsBlurFilterShaderMinVaryingVectors 8
+
+struct BtsBlurFilterShaderLayout {
+    unsigned int samples; // Kernel samples (2 texture reads each)
+    unsigned int textureCoordinateSamples; // Samples with pre-calculated texture coordinates
+    unsigned int offsetSamples; // Samples with pre-calculated offsets
+    unsigned int varyingCount; // vec2 varyings used
+};
+
+typedef struct BtsBlurFilterShaderLayout BtsBlurFilterShaderLayout_t;
+
+// Largest number of samples that fits maxVaryingVectors (GL_MAX_VARYING_VECTORS)
+unsigned int btsBlurFilterShaderMaxSamples(unsigned int maxVaryingVectors);
+
+// Split of the samples between texture coordinates and offsets, false if samples doesn't fit maxVaryingVectors
+bool btsBlurFilterShaderLayout(unsigned int samples, unsigned int maxVaryingVectors, BtsBlurFilterShaderLayout_t * layout);
+
+// Shader sources of the variant (free them), NULL if samples doesn't fit maxVaryingVectors
+char * createBtsBlurFilterVertexShaderSource(unsigned int samples, unsigned int maxVaryingVectors);
+char * createBtsBlurFilterFragmentShaderSource(unsigned int samples, unsigned int maxVaryingVectors);
+char * createBtsPrefilterBlurFilterFragmentShaderSource(unsigned int samples, unsigned int maxVaryingVectors);
+
+// True if a kernel bank fits the uniform vectors of both shaders (GL_MAX_VERTEX_UNIFORM_VECTORS and GL_MAX_FRAGMENT_UNIFORM_VECTORS)
+bool btsBlurFilterKernelBankFits(unsigned int kernelCount, unsigned int bankSamples, unsigned int maxVertexUniformVectors, unsigned int maxFragmentUniformVectors);
+
+// Shader sources of the kernel bank variant (free them), NULL if samples doesn't fit maxVaryingVectors or is larger than bankSamples
+char * createBtsKernelBankBlurFilterVertexShaderSource(unsigned int samples, unsigned int maxVaryingVectors, unsigned int kernelCount, unsigned int bankSamples);
+char * createBtsKernelBankBlurFilterFragmentShaderSource(unsigned int samples, unsigned int maxVaryingVectors, unsigned int kernelCount, unsigned int bankSamples, bool prefilter);
+
+// True if both banks fit the fragment uniform vectors of an intensity map variant (GL_MAX_FRAGMENT_UNIFORM_VECTORS)
+bool btsBlurFilterIntensityMapFits(unsigned int kernelCount, unsigned int bankSamples, unsigned int maxFragmentUniformVectors);
+
+// Fragment shader source of the intensity map variant (free it), NULL if samples is larger than bankSamples
+char * createBtsIntensityMapBlurFilterFragmentShaderSource(unsigned int samples, unsigned int kernelCount, unsigned int bankSamples, bool prefilter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAUCaptureVideoPreviewLayerShaderGenerator_h */
@@ -74,6 +74,38 @@ static const char * FragmentShaderSourceDefault =
     "}\n"
 };
 
+/*!
+ Fragment Shader
+ 
+ Implementation:
+ - Filter is disabled
+ - 420 bi-planar input, luma and half resolution chroma textures are converted to RGB (full range BT.601)
+ */
+static const char * FragmentShaderSourceDefaultYUV =
+{
+    "#ifdef GL_ES\n"
+    "precision highp float;\n"
+    "#endif\n"
+    "\n"
+    "// (In) Texture coordinate for the fragment\n"
+    "varying vec2 FragTextureCoordinate;\n"
+    "\n"
+    "// Uniforms (VideoFrame, 420 bi-planar)\n"
+    "uniform sampler2D FragTextureData; // Luma (Y in r)\n"
+    "uniform sampler2D FragChromaTextureData; // Chroma, half resolution (Cb in r, Cr in a)\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "  // Full range BT.601\n"
+    "  float luma = texture2D(FragTextureData, FragTextureCoordinate).r;\n"
+    "  vec2 chroma = texture2D(FragChromaTextureData, FragTextureCoordinate).ra - vec2(128.0 / 255.0);\n"
+    "  gl_FragColor = vec4(luma + 1.402 * chroma.y,\n"
+    "                      luma - 0.344136 * chroma.x - 0.714136 * chroma.y,\n"
+    "                      luma + 1.772 * chroma.x,\n"
+    "                      1.0);\n"
+    "}\n"
+};
+
 /*!
  Vertex Shader
  
@@ -206,60 +238,6 @@ static const char * FragmentShaderSourceBlurFilterBts =
     "}\n"
 };
 
-/*!
- Fragment Shader
- 
- Implementation:
- - Filter is enabled
- - Bilinear texture sampling enabled
- - Filter bounds enabled
- */
-static const char * FragmentShaderSourceBlurFilterBtsBounds =
-{
-    "#ifdef GL_ES\n"
-    "precision highp float;\n"
-    "#endif\n"
-    "\n"
-    "// Texture coordinate for the fragment\n"
-    "varying vec2 FragTextureCoordinate;\n"
-    "varying vec2 FragFilterSplitPassKernelOffsets[14];\n"
-    "\n"
-    "// Uniforms (VideoFrame)\n"
-    "uniform sampler2D FragTextureData;\n"
-    "\n"
-    "// Uniforms (Filter)\n"
-    "uniform lowp int FilterKernelSamples; // Samples per pixel\n"
-    "uniform vec4 FragFilterBounds; // Bounds = { xMin, yMin, xMax, yMax }\n"
-    "uniform float FragFilterKernelWeights[14]; // Weights\n"
-    "\n"
-    "void main()\n"
-    "{\n"
-    "  if (FragTextureCoordinate.x < FragFilterBounds.x ||\n"
-    "      FragTextureCoordinate.y < FragFilterBounds.y ||\n"
-    "      FragTextureCoordinate.x > FragFilterBounds.z ||\n"
-    "      FragTextureCoordinate.y > FragFilterBounds.w)\n"
-    "  {\n"
-    "    gl_FragColor = texture2D(FragTextureData, FragTextureCoordinate);\n"
-    "  }\n"
-    "  else\n"
-    "  {\n"
-    "    // Weighted color sum of all the neighbour pixel\n"
-    "    vec4 weightedColor = vec4(0.0);\n"
-    "\n"
-    "    // Sample with the provided weights and offsets in one direction\n"
-    "    for (int s = 0; s < FilterKernelSamples; ++s)\n"
-    "    {\n"
-    "      float weight = FragFilterKernelWeights[s];\n"
-    "      vec2 offset = FragFilterSplitPassKernelOffsets[s];\n"
-    "      weightedColor += weight * texture2D(FragTextureData, FragTextureCoordinate.xy - offset) +\n"
-    "                       weight * texture2D(FragTextureData, FragTextureCoordinate.xy + offset);\n"
-    "    }\n"
-    "\n"
-    "    gl_FragColor = weightedColor;\n"
-    "  }\n"
-    "}\n"
-};
-
 /*!
  Fragment Shader
  
@@ -34,11 +34,10 @@
 struct UniformHandles {
     
     GLuint FragTextureData;
+    GLuint FragChromaTextureData; // sampler2D (420 bi-planar input only)
     
     GLuint FilterSplitPassDirectionVector; // vec2 (x or y step direction)
     
-    GLuint FragFilterBounds; // vec4
-    
     GLuint VertFilterKernelOffsets; // float[]
     
     GLuint FragFilterKernelWeights; // float[]
@@ -46,6 +45,15 @@ struct UniformHandles {
     GLuint FragFilterKernelSize; // float
     
     GLuint FilterKernelSamples; // float
+    
+    GLuint FilterPrefilterOffset; // vec2 (quarter of a destination texel, first pass only)
+    GLuint VertFilterKernelBankOffsets; // vec4[] (all the kernels, uploaded once)
+    GLuint FragFilterKernelBankWeights; // vec4[] (all the kernels, uploaded once)
+    GLuint FilterKernelBankPosition; // float (kernel index and blend with the next kernel)
+    GLuint FragFilterIntensityMap; // sampler2D (intensity map variants only, texture unit 2)
+    
+    GLuint FilterPyramidUpsample; // int (0 or 1)
+    GLuint FilterPyramidHalfPixelOffset; // vec2
 };
 
 struct AttributeHandles {
@@ -53,6 +61,15 @@ struct AttributeHandles {
     GLuint VertTextureCoordinate;
 };
 
+// Program and its bindings (ie. a blur filter program variant)
+struct ProgramInstance {
+    GLuint program;
+    struct UniformHandles uniforms;
+    struct AttributeHandles attributes;
+};
+
+typedef struct ProgramInstance ProgramInstance_t;
+
 struct FilterKernel {
     GLuint radius;
     GLfloat * weights;
@@ -30,6 +30,9 @@
 
 #if TARGET_OS_IPHONE
     #import <OpenGLES/ES2/gl.h>
+#elif defined(__linux__)
+    #include <GLES2/gl2.h> // Headless renderer (EGL)
+    #include <stdbool.h>
 #else
     #import <OpenGL/gl.h>
 #endif
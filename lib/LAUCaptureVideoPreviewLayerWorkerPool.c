@@ -0,0 +1,323 @@
+/*
+
+ LAUCaptureVideoPreviewLayerWorkerPool.c
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#include "LAUCaptureVideoPreviewLayerWorkerPool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define kWorkerPoolMaxThreadCount 64
+#define kWorkerPoolCacheLineSize 64
+
+// Remaining task indices [front, back) of one worker, the owner takes from the front and thieves from the back
+struct WorkerPoolQueue {
+    pthread_mutex_t mutex;
+    size_t front;
+    size_t back;
+    char padding[kWorkerPoolCacheLineSize]; // Keep the queues of different workers on different cache lines
+};
+
+typedef struct WorkerPoolQueue WorkerPoolQueue_t;
+
+struct WorkerPoolThread {
+    WorkerPool_t * workerPool;
+    unsigned int workerIndex;
+    pthread_t thread;
+};
+
+typedef struct WorkerPoolThread WorkerPoolThread_t;
+
+struct WorkerPool {
+
+    unsigned int threadCount;
+    WorkerPoolThread_t * threads; // Background threads (workers 1 ... threadCount - 1)
+    WorkerPoolQueue_t * queues;
+
+    // Run state, protected by the mutex
+    pthread_mutex_t mutex;
+    pthread_cond_t runCondition;
+    pthread_cond_t doneCondition;
+    unsigned long generation; // Incremented by every run
+    unsigned int busyThreadCount; // Background threads still working on the current run
+    bool shutdown;
+    WorkerPoolTaskFunction function;
+    void * context;
+
+    atomic_ulong stolenTaskCount;
+};
+
+#pragma mark -
+#pragma mark Tasks
+
+// Takes the next task of the worker, or steals half of the remaining tasks of another worker
+static bool takeTask(WorkerPool_t * workerPool, unsigned int workerIndex, size_t * taskIndex)
+{
+    WorkerPoolQueue_t * queue = &workerPool->queues[workerIndex];
+
+    pthread_mutex_lock(&queue->mutex);
+    bool taken = queue->front < queue->back;
+    if (taken)
+    {
+        *taskIndex = queue->front++;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    if (taken)
+    {
+        return true;
+    }
+
+    for (unsigned int v = 1; v < workerPool->threadCount; ++v)
+    {
+        WorkerPoolQueue_t * victimQueue = &workerPool->queues[(workerIndex + v) % workerPool->threadCount];
+
+        pthread_mutex_lock(&victimQueue->mutex);
+        size_t remainingTaskCount = victimQueue->back - victimQueue->front;
+        size_t stolenFront = victimQueue->back - (remainingTaskCount + 1) / 2;
+        size_t stolenBack = victimQueue->back;
+        if (remainingTaskCount > 0)
+        {
+            victimQueue->back = stolenFront;
+        }
+        pthread_mutex_unlock(&victimQueue->mutex);
+
+        if (remainingTaskCount > 0)
+        {
+            // Run the first stolen task now, keep the others (they can be stolen again)
+            pthread_mutex_lock(&queue->mutex);
+            queue->front = stolenFront + 1;
+            queue->back = stolenBack;
+            pthread_mutex_unlock(&queue->mutex);
+
+            atomic_fetch_add_explicit(&workerPool->stolenTaskCount, stolenBack - stolenFront, memory_order_relaxed);
+
+            *taskIndex = stolenFront;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void runTasks(WorkerPool_t * workerPool, unsigned int workerIndex, WorkerPoolTaskFunction function, void * context)
+{
+    size_t taskIndex;
+    while (takeTask(workerPool, workerIndex, &taskIndex))
+    {
+        function(context, taskIndex, workerIndex);
+    }
+}
+
+static void * workerPoolThreadMain(void * argument)
+{
+    WorkerPoolThread_t * thread = (WorkerPoolThread_t *)argument;
+    WorkerPool_t * workerPool = thread->workerPool;
+    unsigned long generation = 0;
+
+    pthread_mutex_lock(&workerPool->mutex);
+
+    while (true)
+    {
+        while (!workerPool->shutdown && workerPool->generation == generation)
+        {
+            pthread_cond_wait(&workerPool->runCondition, &workerPool->mutex);
+        }
+
+        if (workerPool->shutdown)
+        {
+            break;
+        }
+
+        generation = workerPool->generation;
+        WorkerPoolTaskFunction function = workerPool->function;
+        void * context = workerPool->context;
+
+        pthread_mutex_unlock(&workerPool->mutex);
+        runTasks(workerPool, thread->workerIndex, function, context);
+        pthread_mutex_lock(&workerPool->mutex);
+
+        if (--workerPool->busyThreadCount == 0)
+        {
+            pthread_cond_signal(&workerPool->doneCondition);
+        }
+    }
+
+    pthread_mutex_unlock(&workerPool->mutex);
+
+    return NULL;
+}
+
+#pragma mark -
+#pragma mark Pool Memory Management
+
+WorkerPool_t * createWorkerPool(unsigned int threadCount)
+{
+    if (threadCount == 0)
+    {
+        long onlineProcessorCount = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = onlineProcessorCount > 0 ? (unsigned int)onlineProcessorCount : 1;
+    }
+
+    if (threadCount > kWorkerPoolMaxThreadCount)
+    {
+        threadCount = kWorkerPoolMaxThreadCount;
+    }
+
+    WorkerPool_t * workerPool = (WorkerPool_t *)calloc(1, sizeof(WorkerPool_t));
+    if (!workerPool)
+    {
+        return NULL;
+    }
+
+    workerPool->queues = (WorkerPoolQueue_t *)calloc(threadCount, sizeof(WorkerPoolQueue_t));
+    workerPool->threads = (WorkerPoolThread_t *)calloc(threadCount, sizeof(WorkerPoolThread_t));
+    if (!workerPool->queues || !workerPool->threads)
+    {
+        free(workerPool->queues);
+        free(workerPool->threads);
+        free(workerPool);
+        return NULL;
+    }
+
+    for (unsigned int w = 0; w < threadCount; ++w)
+    {
+        pthread_mutex_init(&workerPool->queues[w].mutex, NULL);
+    }
+
+    pthread_mutex_init(&workerPool->mutex, NULL);
+    pthread_cond_init(&workerPool->runCondition, NULL);
+    pthread_cond_init(&workerPool->doneCondition, NULL);
+    atomic_init(&workerPool->stolenTaskCount, 0);
+
+    // Worker 0 is the thread calling workerPoolRun. If a thread can't be created the pool keeps the workers created so far
+    workerPool->threadCount = 1;
+    for (unsigned int w = 1; w < threadCount; ++w)
+    {
+        WorkerPoolThread_t * thread = &workerPool->threads[w];
+        thread->workerPool = workerPool;
+        thread->workerIndex = w;
+
+        if (pthread_create(&thread->thread, NULL, workerPoolThreadMain, thread) != 0)
+        {
+            break;
+        }
+
+        workerPool->threadCount = w + 1;
+    }
+
+    return workerPool;
+}
+
+void releaseWorkerPool(WorkerPool_t * workerPool)
+{
+    if (!workerPool)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&workerPool->mutex);
+    workerPool->shutdown = true;
+    pthread_cond_broadcast(&workerPool->runCondition);
+    pthread_mutex_unlock(&workerPool->mutex);
+
+    for (unsigned int w = 1; w < workerPool->threadCount; ++w)
+    {
+        pthread_join(workerPool->threads[w].thread, NULL);
+    }
+
+    for (unsigned int w = 0; w < workerPool->threadCount; ++w)
+    {
+        pthread_mutex_destroy(&workerPool->queues[w].mutex);
+    }
+
+    pthread_mutex_destroy(&workerPool->mutex);
+    pthread_cond_destroy(&workerPool->runCondition);
+    pthread_cond_destroy(&workerPool->doneCondition);
+
+    free(workerPool->queues);
+    free(workerPool->threads);
+    free(workerPool);
+}
+
+#pragma mark -
+#pragma mark Run
+
+unsigned int workerPoolThreadCount(const WorkerPool_t * workerPool)
+{
+    return workerPool->threadCount;
+}
+
+unsigned long workerPoolStolenTaskCount(const WorkerPool_t * workerPool)
+{
+    return atomic_load_explicit(&((WorkerPool_t *)workerPool)->stolenTaskCount, memory_order_relaxed);
+}
+
+void workerPoolRun(WorkerPool_t * workerPool, size_t taskCount, WorkerPoolTaskFunction function, void * context)
+{
+    if (taskCount == 0)
+    {
+        return;
+    }
+
+    unsigned int threadCount = workerPool->threadCount;
+
+    // Contiguous ranges, worker w starts with tasks [taskCount * w / threadCount, taskCount * (w + 1) / threadCount)
+    for (unsigned int w = 0; w < threadCount; ++w)
+    {
+        WorkerPoolQueue_t * queue = &workerPool->queues[w];
+        pthread_mutex_lock(&queue->mutex);
+        queue->front = taskCount * w / threadCount;
+        queue->back = taskCount * (w + 1) / threadCount;
+        pthread_mutex_unlock(&queue->mutex);
+    }
+
+    if (threadCount > 1)
+    {
+        pthread_mutex_lock(&workerPool->mutex);
+        workerPool->function = function;
+        workerPool->context = context;
+        workerPool->busyThreadCount = threadCount - 1;
+        ++workerPool->generation;
+        pthread_cond_broadcast(&workerPool->runCondition);
+        pthread_mutex_unlock(&workerPool->mutex);
+    }
+
+    runTasks(workerPool, 0, function, context);
+
+    if (threadCount > 1)
+    {
+        // The background threads finish their last task before checking in
+        pthread_mutex_lock(&workerPool->mutex);
+        while (workerPool->busyThreadCount > 0)
+        {
+            pthread_cond_wait(&workerPool->doneCondition, &workerPool->mutex);
+        }
+        pthread_mutex_unlock(&workerPool->mutex);
+    }
+}
@@ -0,0 +1,70 @@
+/*
+
+ LAUCaptureVideoPreviewLayerWorkerPool.h
+ LAUCaptureVideoPreviewLayer
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#ifndef LAUCaptureVideoPreviewLayerWorkerPool_h
+#define LAUCaptureVideoPreviewLayerWorkerPool_h
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Work-stealing thread pool for data parallel loops (ie. the stripes of the CPU blur engine)
+
+ - workerPoolRun calls the task function once for every task index and returns when all tasks are done
+ - The calling thread is worker 0, the pool has threadCount - 1 background threads
+ - Each worker starts with a contiguous range of task indices (neighbouring tasks share cache lines)
+   and takes them in order. A worker without tasks steals the second half of another worker's range
+ - Only one run at a time, workerPoolRun must not be called from a task
+
+ Tasks are expected to be coarse (at least tens of microseconds), each take and steal locks a mutex.
+ */
+
+// workerIndex is in [0, threadCount), tasks with the same worker index never run concurrently
+typedef void (*WorkerPoolTaskFunction)(void * context, size_t taskIndex, unsigned int workerIndex);
+
+typedef struct WorkerPool WorkerPool_t;
+
+// Pool memory management, 0 threads is one per online CPU
+WorkerPool_t * createWorkerPool(unsigned int threadCount);
+void releaseWorkerPool(WorkerPool_t * workerPool);
+
+// Number of workers, including the calling thread
+unsigned int workerPoolThreadCount(const WorkerPool_t * workerPool);
+
+// Number of tasks stolen from another worker since the pool was created
+unsigned long workerPoolStolenTaskCount(const WorkerPool_t * workerPool);
+
+// Runs function(context, taskIndex, workerIndex) for taskIndex in [0, taskCount), blocks until all tasks are done
+void workerPoolRun(WorkerPool_t * workerPool, size_t taskCount, WorkerPoolTaskFunction function, void * context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAUCaptureVideoPreviewLayerWorkerPool_h */
@@ -0,0 +1,671 @@
+/*
+
+ main.c
+ LAUCaptureVideoPreviewLayer Benchmark
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+/*
+ Benchmark suite, sweeps the blur filter over resolutions, intensities and pipeline settings
+ with the headless GL pipeline (Mesa llvmpipe or any EGL driver) and the CPU blur engine backends
+
+ Build (from the repository root):
+
+ make build/LAUCaptureVideoPreviewLayerBenchmark
+
+ Usage:
+
+ LAUCaptureVideoPreviewLayerBenchmark [options]
+   --inputs <720p,1080p,4k,WxH...>    Input frame sizes (default 720p,1080p,4k), the view is the input rotated to portrait
+   --kernels <all|0,5,10...>          Kernel indices (default all 11 kernels)
+   --downsampling <2,4,8...>          Downsampling factors (default 2,4,8)
+   --passes <1,2,3...>                Multiple pass counts (default 1,2,3)
+   --programs <bts,dts>               GL blur filter programs (default bts,dts)
+   --engines <gl,cpu>                 Headless GL pipeline and/or CPU blur engine backends (default gl,cpu)
+   --threads <1,2,4,8...>             CPU blur engine worker threads (default 1), 0 is one per online CPU
+   --frames <n>                       Measured frames per configuration (default 30)
+   --warmup <n>                       Frames rendered before measuring (default 3)
+   --label <name>                     Stored in the report (ie. device or commit)
+   --output <file.json>               Write the report to a file instead of stdout
+
+ Each result has the throughput (fps, input Mpix/s) and the frame latency percentiles (ms) measured with
+ LAUCaptureVideoPreviewLayerFrameTimings, plus the GPU frame time if the context has GL_EXT_disjoint_timer_query.
+ The CPU engines are bts only (the program list doesn't apply). Each CPU result also has the speedup over the
+ first thread count of the list, ie. the scaling curve of the stripes with --inputs 4k --threads 1,2,4,8,16.
+ The curve has only been run on a single CPU (sse2 0.96x to 1.05x from 2 to 16 threads, the pool overhead is
+ within the noise), multi-core scaling of the stripes is unverified.
+ Progress is printed to stderr.
+
+ Exit status is 0 on success.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "LAUCaptureVideoPreviewLayerHeadlessRenderer.h"
+#include "LAUCaptureVideoPreviewLayerBlurEngine.h"
+#include "LAUCaptureVideoPreviewLayerWorkerPool.h"
+#include "LAUCaptureVideoPreviewLayerGaussianFilterKernel.h"
+#include "LAUCaptureVideoPreviewLayerFrameTimings.h"
+
+#define kBenchmarkMaxListCount 16
+
+struct BenchmarkSize {
+    size_t width;
+    size_t height;
+};
+
+typedef struct BenchmarkSize BenchmarkSize_t;
+
+struct BenchmarkOptions {
+    BenchmarkSize_t inputs[kBenchmarkMaxListCount];
+    unsigned int inputCount;
+    unsigned int kernelIndices[kBenchmarkMaxListCount];
+    unsigned int kernelIndexCount; // 0 is all kernels
+    float downsamplingFactors[kBenchmarkMaxListCount];
+    unsigned int downsamplingFactorCount;
+    unsigned int multiplePassCounts[kBenchmarkMaxListCount];
+    unsigned int multiplePassCountCount;
+    GaussianFilterKernelType_t kernelTypes[2];
+    unsigned int kernelTypeCount;
+    unsigned int threadCounts[kBenchmarkMaxListCount];
+    unsigned int threadCountCount;
+    bool gl;
+    bool cpu;
+    unsigned int frames;
+    unsigned int warmupFrames;
+    const char * label;
+    const char * outputPath;
+};
+
+typedef struct BenchmarkOptions BenchmarkOptions_t;
+
+// One configuration of the sweep
+struct BenchmarkConfiguration {
+    const char * engine; // "gl" or "cpu"
+    const char * variant; // Program (bts, dts) or backend (scalar, sse2...)
+    size_t inputWidth;
+    size_t inputHeight;
+    size_t viewWidth;
+    size_t viewHeight;
+    unsigned int kernelIndex;
+    float sigma;
+    float downsamplingFactor;
+    unsigned int multiplePassCount;
+    unsigned int threadCount; // CPU engines only
+};
+
+typedef struct BenchmarkConfiguration BenchmarkConfiguration_t;
+
+struct BenchmarkResult {
+    unsigned int frames;
+    double elapsedTime; // Seconds, measured frames only
+    FrameTimingStatistics_t cpuStatistics; // Frame latency
+    FrameTimingStatistics_t gpuStatistics; // sampleCount is 0 without timer queries
+    double speedup; // CPU engines only, throughput over the first thread count
+};
+
+typedef struct BenchmarkResult BenchmarkResult_t;
+
+static const char * const kBlurEngineBackendNames[] = {"scalar", "sse2", "avx2", "neon"};
+
+static double currentTime(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+#pragma mark -
+#pragma mark Options
+
+static bool parseSize(const char * string, BenchmarkSize_t * size)
+{
+    if (strcmp(string, "720p") == 0) { size->width = 1280; size->height = 720; return true; }
+    if (strcmp(string, "1080p") == 0) { size->width = 1920; size->height = 1080; return true; }
+    if (strcmp(string, "4k") == 0) { size->width = 3840; size->height = 2160; return true; }
+
+    return sscanf(string, "%zux%zu", &size->width, &size->height) == 2 && size->width > 0 && size->height > 0;
+}
+
+// Comma separated list, calls parseItem for each item (at most kBenchmarkMaxListCount)
+static bool parseList(const char * string, unsigned int * count, bool (*parseItem)(const char * item, unsigned int index, void * context), void * context)
+{
+    char buffer[256];
+    if (strlen(string) >= sizeof(buffer))
+    {
+        return false;
+    }
+
+    strcpy(buffer, string);
+    *count = 0;
+
+    for (char * item = strtok(buffer, ","); item; item = strtok(NULL, ","))
+    {
+        if (*count >= kBenchmarkMaxListCount || !parseItem(item, *count, context))
+        {
+            return false;
+        }
+
+        ++(*count);
+    }
+
+    return *count > 0;
+}
+
+static bool parseInputItem(const char * item, unsigned int index, void * context)
+{
+    return parseSize(item, &((BenchmarkOptions_t *)context)->inputs[index]);
+}
+
+static bool parseKernelIndexItem(const char * item, unsigned int index, void * context)
+{
+    int kernelIndex = atoi(item);
+    ((BenchmarkOptions_t *)context)->kernelIndices[index] = kernelIndex;
+    return kernelIndex >= 0 && (unsigned int)kernelIndex < kBtsGaussianFilterKernelDefaultParameters.kernelCount;
+}
+
+static bool parseDownsamplingFactorItem(const char * item, unsigned int index, void * context)
+{
+    float downsamplingFactor = atof(item);
+    ((BenchmarkOptions_t *)context)->downsamplingFactors[index] = downsamplingFactor;
+    return downsamplingFactor > 0.0f;
+}
+
+static bool parseMultiplePassCountItem(const char * item, unsigned int index, void * context)
+{
+    int multiplePassCount = atoi(item);
+    ((BenchmarkOptions_t *)context)->multiplePassCounts[index] = multiplePassCount;
+    return multiplePassCount > 0 && multiplePassCount < kFrameTimingsMaxOffscreenPassCount / 2;
+}
+
+static bool parseThreadCountItem(const char * item, unsigned int index, void * context)
+{
+    int threadCount = atoi(item);
+    ((BenchmarkOptions_t *)context)->threadCounts[index] = threadCount;
+    return threadCount >= 0;
+}
+
+static bool parseKernelTypeItem(const char * item, unsigned int index, void * context)
+{
+    BenchmarkOptions_t * options = context;
+    if (index >= 2)
+    {
+        return false;
+    }
+
+    if (strcmp(item, "bts") == 0) options->kernelTypes[index] = GaussianFilterKernelTypeBts;
+    else if (strcmp(item, "dts") == 0) options->kernelTypes[index] = GaussianFilterKernelTypeDts;
+    else return false;
+
+    return true;
+}
+
+static bool parseEngineItem(const char * item, unsigned int index, void * context)
+{
+    (void)index; // The engines are flags, the order doesn't matter
+    BenchmarkOptions_t * options = context;
+
+    if (strcmp(item, "gl") == 0) options->gl = true;
+    else if (strcmp(item, "cpu") == 0) options->cpu = true;
+    else return false;
+
+    return true;
+}
+
+static bool parseOptions(int argc, const char * argv[], BenchmarkOptions_t * options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char * option = argv[i];
+        const char * value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        unsigned int count = 0;
+        bool parsed = true;
+
+        if (!value)
+        {
+            fprintf(stderr, "Missing value for %s\n", option);
+            return false;
+        }
+
+        if (strcmp(option, "--inputs") == 0) parsed = parseList(value, &options->inputCount, parseInputItem, options);
+        else if (strcmp(option, "--kernels") == 0)
+        {
+            if (strcmp(value, "all") == 0) options->kernelIndexCount = 0;
+            else parsed = parseList(value, &options->kernelIndexCount, parseKernelIndexItem, options);
+        }
+        else if (strcmp(option, "--downsampling") == 0) parsed = parseList(value, &options->downsamplingFactorCount, parseDownsamplingFactorItem, options);
+        else if (strcmp(option, "--passes") == 0) parsed = parseList(value, &options->multiplePassCountCount, parseMultiplePassCountItem, options);
+        else if (strcmp(option, "--programs") == 0) parsed = parseList(value, &options->kernelTypeCount, parseKernelTypeItem, options);
+        else if (strcmp(option, "--engines") == 0)
+        {
+            options->gl = options->cpu = false;
+            parsed = parseList(value, &count, parseEngineItem, options);
+        }
+        else if (strcmp(option, "--threads") == 0) parsed = parseList(value, &options->threadCountCount, parseThreadCountItem, options);
+        else if (strcmp(option, "--frames") == 0) options->frames = atoi(value);
+        else if (strcmp(option, "--warmup") == 0) options->warmupFrames = atoi(value);
+        else if (strcmp(option, "--label") == 0) options->label = value;
+        else if (strcmp(option, "--output") == 0) options->outputPath = value;
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", option);
+            return false;
+        }
+
+        if (!parsed)
+        {
+            fprintf(stderr, "Invalid value for %s: %s\n", option, value);
+            return false;
+        }
+
+        ++i;
+    }
+
+    return options->frames > 0 && (options->gl || options->cpu);
+}
+
+#pragma mark -
+#pragma mark Input
+
+static bool createInputImage(size_t width, size_t height, BlurEngineImage_t * inputImage)
+{
+    inputImage->width = width;
+    inputImage->height = height;
+    inputImage->bytesPerRow = width * 4;
+    inputImage->data = malloc(inputImage->bytesPerRow * height);
+
+    if (!inputImage->data)
+    {
+        return false;
+    }
+
+    // Same test pattern as the headless harness (checkerboard with gradients)
+    for (size_t y = 0; y < height; ++y)
+    {
+        uint8_t * row = inputImage->data + y * inputImage->bytesPerRow;
+        for (size_t x = 0; x < width; ++x)
+        {
+            uint8_t checker = (((x / 64) + (y / 64)) % 2) ? 255 : 0;
+            row[4 * x + 0] = checker;
+            row[4 * x + 1] = (uint8_t)(255 * x / width);
+            row[4 * x + 2] = (uint8_t)(255 * y / height);
+            row[4 * x + 3] = 255;
+        }
+    }
+
+    return true;
+}
+
+static bool createOutputImage(size_t width, size_t height, BlurEngineImage_t * outputImage)
+{
+    outputImage->width = width;
+    outputImage->height = height;
+    outputImage->bytesPerRow = width * 4;
+    outputImage->data = malloc(outputImage->bytesPerRow * height);
+
+    return outputImage->data != NULL;
+}
+
+#pragma mark -
+#pragma mark Measurement
+
+static void collectResult(FrameTimings_t * frameTimings, unsigned int frames, double elapsedTime, BenchmarkResult_t * result)
+{
+    memset(result, 0, sizeof(BenchmarkResult_t));
+    result->frames = frames;
+    result->elapsedTime = elapsedTime;
+
+    frameTimingsStatistics(frameTimings, FrameTimingStageFrame, false, &result->cpuStatistics);
+    frameTimingsStatistics(frameTimings, FrameTimingStageFrame, true, &result->gpuStatistics);
+}
+
+static bool benchmarkHeadlessRenderer(HeadlessRenderer_t * renderer, const BenchmarkOptions_t * options, const BenchmarkConfiguration_t * configuration, const BlurEngineImage_t * inputImage, BenchmarkResult_t * result)
+{
+    headlessRendererSetFilterParameters(renderer, configuration->downsamplingFactor, configuration->multiplePassCount);
+
+    BlurEngineImage_t outputImage;
+    size_t outputWidth, outputHeight;
+    headlessRendererOutputDimensions(renderer, inputImage->width, inputImage->height, configuration->viewWidth, configuration->viewHeight, &outputWidth, &outputHeight);
+    if (!createOutputImage(outputWidth, outputHeight, &outputImage))
+    {
+        return false;
+    }
+
+    // Warm up without timings (program variant switch, render target allocations)
+    bool rendered = true;
+    headlessRendererSetFrameTimings(renderer, NULL);
+    for (unsigned int i = 0; i < options->warmupFrames && rendered; ++i)
+    {
+        rendered = headlessRendererFilterImage(renderer, inputImage, configuration->viewWidth, configuration->viewHeight, &outputImage);
+    }
+
+    // The readback waits for the passes, each call is a complete frame
+    FrameTimings_t * frameTimings = createFrameTimings(options->frames);
+    headlessRendererSetFrameTimings(renderer, frameTimings);
+
+    double startTime = currentTime();
+    for (unsigned int i = 0; i < options->frames && rendered; ++i)
+    {
+        rendered = headlessRendererFilterImage(renderer, inputImage, configuration->viewWidth, configuration->viewHeight, &outputImage);
+    }
+    double elapsedTime = currentTime() - startTime;
+
+    headlessRendererSetFrameTimings(renderer, NULL);
+    collectResult(frameTimings, options->frames, elapsedTime, result);
+
+    releaseFrameTimings(frameTimings);
+    free(outputImage.data);
+
+    return rendered;
+}
+
+static bool benchmarkBlurEngine(BlurEngine_t * blurEngine, const BenchmarkOptions_t * options, const BenchmarkConfiguration_t * configuration, const BlurEngineImage_t * inputImage, BenchmarkResult_t * result)
+{
+    blurEngineSetFilterParameters(blurEngine, configuration->downsamplingFactor, configuration->multiplePassCount);
+
+    BlurEngineImage_t outputImage;
+    size_t outputWidth, outputHeight;
+    blurEngineOutputDimensions(blurEngine, inputImage->width, inputImage->height, configuration->viewWidth, configuration->viewHeight, &outputWidth, &outputHeight);
+    if (!createOutputImage(outputWidth, outputHeight, &outputImage))
+    {
+        return false;
+    }
+
+    bool filtered = true;
+    for (unsigned int i = 0; i < options->warmupFrames && filtered; ++i)
+    {
+        filtered = blurEngineFilterImage(blurEngine, inputImage, configuration->viewWidth, configuration->viewHeight, &outputImage);
+    }
+
+    // No timer query functions, only the CPU frame time is recorded
+    FrameTimings_t * frameTimings = createFrameTimings(options->frames);
+    frameTimingsSetTimerQueryFunctions(frameTimings, NULL);
+
+    double startTime = currentTime();
+    for (unsigned int i = 0; i < options->frames && filtered; ++i)
+    {
+        frameTimingsBeginFrame(frameTimings);
+        filtered = blurEngineFilterImage(blurEngine, inputImage, configuration->viewWidth, configuration->viewHeight, &outputImage);
+        frameTimingsEndFrame(frameTimings);
+    }
+    double elapsedTime = currentTime() - startTime;
+
+    collectResult(frameTimings, options->frames, elapsedTime, result);
+
+    releaseFrameTimings(frameTimings);
+    free(outputImage.data);
+
+    return filtered;
+}
+
+#pragma mark -
+#pragma mark Report
+
+static void writeJSONStatistics(FILE * file, const char * name, const FrameTimingStatistics_t * statistics)
+{
+    fprintf(file, "\"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}", name,
+            1000.0 * statistics->mean, 1000.0 * statistics->p50, 1000.0 * statistics->p90, 1000.0 * statistics->p99, 1000.0 * statistics->max);
+}
+
+static void writeJSONString(FILE * file, const char * string)
+{
+    fputc('"', file);
+    for (const char * c = string; c && *c; ++c)
+    {
+        if (*c == '"' || *c == '\\') fprintf(file, "\\%c", *c);
+        else if ((unsigned char)*c < 0x20) fprintf(file, "\\u%04x", *c);
+        else fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+static void writeJSONResult(FILE * file, bool first, const BenchmarkConfiguration_t * configuration, const BenchmarkResult_t * result)
+{
+    double fps = result->elapsedTime > 0.0 ? result->frames / result->elapsedTime : 0.0;
+    double mpixPerSecond = fps * configuration->inputWidth * configuration->inputHeight * 1e-6;
+
+    fprintf(file, "%s\n    {\"engine\": \"%s\", \"variant\": \"%s\", ", first ? "" : ",", configuration->engine, configuration->variant);
+    fprintf(file, "\"input\": {\"width\": %zu, \"height\": %zu}, \"view\": {\"width\": %zu, \"height\": %zu}, ",
+            configuration->inputWidth, configuration->inputHeight, configuration->viewWidth, configuration->viewHeight);
+    fprintf(file, "\"kernelIndex\": %u, \"sigma\": %.4f, \"downsampling\": %g, \"passes\": %u, ",
+            configuration->kernelIndex, configuration->sigma, configuration->downsamplingFactor, configuration->multiplePassCount);
+    fprintf(file, "\"frames\": %u, \"fps\": %.3f, \"mpixPerSecond\": %.3f, ", result->frames, fps, mpixPerSecond);
+    writeJSONStatistics(file, "latencyMs", &result->cpuStatistics);
+
+    if (configuration->threadCount)
+    {
+        fprintf(file, ", \"threads\": %u, \"speedup\": %.3f", configuration->threadCount, result->speedup);
+    }
+
+    if (result->gpuStatistics.sampleCount)
+    {
+        fprintf(file, ", ");
+        writeJSONStatistics(file, "gpuMs", &result->gpuStatistics);
+    }
+
+    fprintf(file, "}");
+}
+
+#pragma mark -
+#pragma mark Sweep
+
+static float kernelIndexStep(const GaussianFilterKernelParameters_t * parameters, unsigned int kernelIndex, float * sigma)
+{
+    float step = gaussianFilterStepForKernelIndex(parameters, kernelIndex);
+    *sigma = gaussianFilterSigmaForStep(parameters, step);
+    return step;
+}
+
+int main(int argc, const char * argv[])
+{
+    BenchmarkOptions_t options = {
+        .inputs = {{1280, 720}, {1920, 1080}, {3840, 2160}},
+        .inputCount = 3,
+        .downsamplingFactors = {2.0f, 4.0f, 8.0f},
+        .downsamplingFactorCount = 3,
+        .multiplePassCounts = {1, 2, 3},
+        .multiplePassCountCount = 3,
+        .kernelTypes = {GaussianFilterKernelTypeBts, GaussianFilterKernelTypeDts},
+        .kernelTypeCount = 2,
+        .threadCounts = {1},
+        .threadCountCount = 1,
+        .gl = true,
+        .cpu = true,
+        .frames = 30,
+        .warmupFrames = 3,
+    };
+
+    if (!parseOptions(argc, argv, &options))
+    {
+        fprintf(stderr, "Invalid options, see the usage in main.c\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!options.kernelIndexCount)
+    {
+        for (unsigned int k = 0; k < kBtsGaussianFilterKernelDefaultParameters.kernelCount && k < kBenchmarkMaxListCount; ++k)
+        {
+            options.kernelIndices[options.kernelIndexCount++] = k;
+        }
+    }
+
+    FILE * file = options.outputPath ? fopen(options.outputPath, "w") : stdout;
+    if (!file)
+    {
+        fprintf(stderr, "Can't open %s\n", options.outputPath);
+        return EXIT_FAILURE;
+    }
+
+    HeadlessRenderer_t * renderer = options.gl ? createHeadlessRenderer(NULL, NULL, NULL) : NULL;
+    if (options.gl && !renderer)
+    {
+        fprintf(stderr, "Can't create the headless renderer\n");
+        return EXIT_FAILURE;
+    }
+
+    BlurEngine_t * blurEngine = options.cpu ? createBlurEngine() : NULL;
+
+    // One pool per thread count, 1 thread runs the stripes on the calling thread (no pool)
+    WorkerPool_t * workerPools[kBenchmarkMaxListCount] = {NULL};
+    unsigned int threadCounts[kBenchmarkMaxListCount];
+    for (unsigned int t = 0; t < options.threadCountCount; ++t)
+    {
+        workerPools[t] = (options.cpu && options.threadCounts[t] != 1) ? createWorkerPool(options.threadCounts[t]) : NULL;
+        threadCounts[t] = workerPools[t] ? workerPoolThreadCount(workerPools[t]) : 1;
+    }
+    GaussianFilterKernelCache_t * filterKernelCache = options.cpu ? createGaussianFilterKernelCache(&kBtsGaussianFilterKernelDefaultParameters, GaussianFilterKernelTypeBts, 1) : NULL;
+
+    fprintf(file, "{\n  \"renderer\": ");
+    writeJSONString(file, renderer ? headlessRendererName(renderer) : "");
+    fprintf(file, ",\n  \"label\": ");
+    writeJSONString(file, options.label ? options.label : "");
+    fprintf(file, ",\n  \"warmupFrames\": %u,\n  \"results\": [", options.warmupFrames);
+
+    int status = EXIT_SUCCESS;
+    bool first = true;
+
+    for (unsigned int i = 0; i < options.inputCount && status == EXIT_SUCCESS; ++i)
+    {
+        BlurEngineImage_t inputImage;
+        if (!createInputImage(options.inputs[i].width, options.inputs[i].height, &inputImage))
+        {
+            status = EXIT_FAILURE;
+            break;
+        }
+
+        // Landscape camera frame on a portrait view with the same pixel count (ie. 1920x1080 on 1080x1920)
+        BenchmarkConfiguration_t configuration = {
+            .inputWidth = inputImage.width,
+            .inputHeight = inputImage.height,
+            .viewWidth = inputImage.height,
+            .viewHeight = inputImage.width,
+        };
+
+        for (unsigned int d = 0; d < options.downsamplingFactorCount && status == EXIT_SUCCESS; ++d)
+        {
+            configuration.downsamplingFactor = options.downsamplingFactors[d];
+
+            for (unsigned int p = 0; p < options.multiplePassCountCount && status == EXIT_SUCCESS; ++p)
+            {
+                configuration.multiplePassCount = options.multiplePassCounts[p];
+
+                for (unsigned int k = 0; k < options.kernelIndexCount && status == EXIT_SUCCESS; ++k)
+                {
+                    configuration.kernelIndex = options.kernelIndices[k];
+                    BenchmarkResult_t result;
+
+                    for (unsigned int t = 0; renderer && t < options.kernelTypeCount && status == EXIT_SUCCESS; ++t)
+                    {
+                        if (!headlessRendererSetFilterKernelType(renderer, options.kernelTypes[t]))
+                        {
+                            status = EXIT_FAILURE;
+                            break;
+                        }
+
+                        configuration.engine = "gl";
+                        configuration.variant = options.kernelTypes[t] == GaussianFilterKernelTypeDts ? "dts" : "bts";
+                        headlessRendererSetFilterIntensity(renderer, kernelIndexStep(headlessRendererFilterKernelParameters(renderer), configuration.kernelIndex, &configuration.sigma));
+
+                        if (!benchmarkHeadlessRenderer(renderer, &options, &configuration, &inputImage, &result))
+                        {
+                            status = EXIT_FAILURE;
+                            break;
+                        }
+
+                        writeJSONResult(file, first, &configuration, &result);
+                        first = false;
+                        fprintf(stderr, "gl %s %zux%zu kernel %u downsampling %g passes %u: %.2f fps\n", configuration.variant, configuration.inputWidth, configuration.inputHeight,
+                                configuration.kernelIndex, configuration.downsamplingFactor, configuration.multiplePassCount, result.frames / result.elapsedTime);
+                    }
+
+                    for (unsigned int b = 0; blurEngine && b < sizeof(kBlurEngineBackendNames) / sizeof(kBlurEngineBackendNames[0]) && status == EXIT_SUCCESS; ++b)
+                    {
+                        if (!blurEngineBackendAvailable(b) || !blurEngineSetBackend(blurEngine, b))
+                        {
+                            continue;
+                        }
+
+                        // Same kernel as the bts program
+                        const GaussianFilterKernel_t * filterKernel = gaussianFilterKernelCacheKernelForStep(filterKernelCache, kernelIndexStep(&kBtsGaussianFilterKernelDefaultParameters, configuration.kernelIndex, &configuration.sigma));
+                        blurEngineSetFilterKernel(blurEngine, filterKernel->samples, filterKernel->offsets, filterKernel->weights);
+
+                        configuration.engine = "cpu";
+                        configuration.variant = kBlurEngineBackendNames[b];
+
+                        double baseFps = 0.0;
+
+                        for (unsigned int t = 0; t < options.threadCountCount && status == EXIT_SUCCESS; ++t)
+                        {
+                            configuration.threadCount = threadCounts[t];
+
+                            if (!blurEngineSetWorkerPool(blurEngine, workerPools[t]) ||
+                                !benchmarkBlurEngine(blurEngine, &options, &configuration, &inputImage, &result))
+                            {
+                                status = EXIT_FAILURE;
+                                break;
+                            }
+
+                            double fps = result.frames / result.elapsedTime;
+                            baseFps = (t == 0) ? fps : baseFps;
+                            result.speedup = fps / baseFps;
+
+                            writeJSONResult(file, first, &configuration, &result);
+                            first = false;
+                            fprintf(stderr, "cpu %s %zux%zu kernel %u downsampling %g passes %u threads %u: %.2f fps (%.2fx)\n", configuration.variant, configuration.inputWidth, configuration.inputHeight,
+                                    configuration.kernelIndex, configuration.downsamplingFactor, configuration.multiplePassCount, configuration.threadCount, fps, result.speedup);
+                        }
+
+                        configuration.threadCount = 0;
+                    }
+                }
+            }
+        }
+
+        free(inputImage.data);
+    }
+
+    fprintf(file, "\n  ]\n}\n");
+
+    if (status != EXIT_SUCCESS)
+    {
+        fprintf(stderr, "Benchmark failed\n");
+    }
+
+    if (file != stdout)
+    {
+        fclose(file);
+    }
+
+    releaseGaussianFilterKernelCache(filterKernelCache);
+    releaseBlurEngine(blurEngine);
+    for (unsigned int t = 0; t < options.threadCountCount; ++t)
+    {
+        releaseWorkerPool(workerPools[t]);
+    }
+    releaseHeadlessRenderer(renderer);
+
+    return status;
+}
@@ -0,0 +1,298 @@
+/*
+
+ main.c
+ LAUCaptureVideoPreviewLayer Blur Engine Backend Tests
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+/*
+ CPU blur engine backend tests, plain C (no EGL) so the same test runs on x86 and on aarch64 (NEON)
+
+ 1. Every available SIMD backend matches the scalar backend within 1 LSB for BGRA inputs (each filtered plane of
+    420 bi-planar inputs, 3 after the conversion to RGB), for kernels, downsampling factors, pass counts and the prefilter
+ 2. The input widths are not a multiple of the vector loops, so the scalar tails are covered
+ 3. At least one SIMD backend is available (SSE2 on x86_64, NEON on aarch64)
+
+ Build (from the repository root):
+
+ make build/BlurEngineBackendTests && build/BlurEngineBackendTests (or make check for all the tests)
+
+ make check also cross-compiles the test for aarch64 and runs it with qemu when AARCH64_CC and QEMU_AARCH64
+ are installed (see the Makefile), otherwise the NEON run is skipped.
+
+ Usage:
+
+ BlurEngineBackendTests [--verbose]
+
+ Prints PASS and exits with 0 on success, each failure is printed to stderr.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "LAUCaptureVideoPreviewLayerBlurEngine.h"
+#include "LAUCaptureVideoPreviewLayerGaussianFilterKernel.h"
+
+// Same as testBackendsMatchScalarBackend (LAUCaptureVideoPreviewLayerBlurEngineTests)
+#define kBackendMaxDifference 1
+
+// 1 LSB in each filtered plane, the conversion to RGB scales the chroma differences (B = Y + 1.772 Cb, rounded)
+#define kBackendMaxYUVDifference 3
+
+// HD frame and a frame with odd dimensions (tails of every vector loop), rotated view
+static const size_t kBackendInputSizes[][2] = {
+    {1280, 720},
+    {643, 361},
+};
+
+static const unsigned int kBackendKernelIndexes[] = {0, 5, 10};
+static const float kBackendDownsamplingFactors[] = {2.0f, 4.0f};
+static const unsigned int kBackendMultiplePassCounts[] = {1, 2};
+
+#define kBackendInputSizeCount (sizeof(kBackendInputSizes) / sizeof(kBackendInputSizes[0]))
+#define kBackendKernelIndexCount (sizeof(kBackendKernelIndexes) / sizeof(kBackendKernelIndexes[0]))
+#define kBackendDownsamplingFactorCount (sizeof(kBackendDownsamplingFactors) / sizeof(kBackendDownsamplingFactors[0]))
+#define kBackendMultiplePassCountCount (sizeof(kBackendMultiplePassCounts) / sizeof(kBackendMultiplePassCounts[0]))
+
+static const char * const kBackendNames[] = {"scalar", "sse2", "avx2", "neon"};
+
+static bool verbose;
+
+#pragma mark -
+#pragma mark Images
+
+static bool createImage(size_t width, size_t height, BlurEngineImage_t * image)
+{
+    image->width = width;
+    image->height = height;
+    image->bytesPerRow = width * 4;
+    image->data = (uint8_t *)malloc(image->bytesPerRow * height);
+
+    return image->data != NULL;
+}
+
+static bool createYUVImage(size_t width, size_t height, BlurEngineYUVImage_t * image)
+{
+    image->width = width;
+    image->height = height;
+    image->lumaBytesPerRow = width;
+    image->chromaBytesPerRow = ((width + 1) / 2) * 2;
+    image->luma = (uint8_t *)malloc(image->lumaBytesPerRow * height + image->chromaBytesPerRow * ((height + 1) / 2));
+    image->chroma = image->luma ? image->luma + image->lumaBytesPerRow * height : NULL;
+
+    return image->luma != NULL;
+}
+
+// Random values, fixed seed so every backend (and architecture) filters the same frame
+static void fillRandom(uint8_t * data, size_t size, unsigned int seed)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+static int maxDifference(const BlurEngineImage_t * image, const BlurEngineImage_t * otherImage)
+{
+    int difference = 0;
+
+    for (size_t y = 0; y < image->height; ++y)
+    {
+        const uint8_t * row = image->data + y * image->bytesPerRow;
+        const uint8_t * otherRow = otherImage->data + y * otherImage->bytesPerRow;
+        for (size_t x = 0; x < image->width * 4; ++x)
+        {
+            int componentDifference = abs((int)row[x] - (int)otherRow[x]);
+            difference = componentDifference > difference ? componentDifference : difference;
+        }
+    }
+
+    return difference;
+}
+
+#pragma mark -
+#pragma mark Tests
+
+static bool filterImage(BlurEngine_t * blurEngine, BlurEngineBackend_t backend, const BlurEngineImage_t * inputImage, const BlurEngineYUVImage_t * inputYUVImage,
+                        size_t viewWidth, size_t viewHeight, BlurEngineImage_t * outputImage)
+{
+    if (!blurEngineSetBackend(blurEngine, backend))
+    {
+        return false;
+    }
+
+    memset(outputImage->data, 0, outputImage->bytesPerRow * outputImage->height);
+
+    return inputYUVImage ? blurEngineFilterYUVImage(blurEngine, inputYUVImage, viewWidth, viewHeight, outputImage)
+                         : blurEngineFilterImage(blurEngine, inputImage, viewWidth, viewHeight, outputImage);
+}
+
+// Every configuration of one input, filtered with the scalar backend and with each available SIMD backend
+static bool testBackendsMatchScalarBackend(BlurEngine_t * blurEngine, const char * name, const BlurEngineImage_t * inputImage, const BlurEngineYUVImage_t * inputYUVImage)
+{
+    size_t inputWidth = inputYUVImage ? inputYUVImage->width : inputImage->width;
+    size_t inputHeight = inputYUVImage ? inputYUVImage->height : inputImage->height;
+    int allowedDifference = inputYUVImage ? kBackendMaxYUVDifference : kBackendMaxDifference;
+    bool passed = true;
+
+    for (unsigned int k = 0; k < kBackendKernelIndexCount; ++k)
+    {
+        unsigned int samples = btsGaussianFilterMaxSamples(&kBtsGaussianFilterKernelDefaultParameters);
+        float offsets[samples], weights[samples];
+        btsGaussianFilterKernelForIndex(&kBtsGaussianFilterKernelDefaultParameters, kBackendKernelIndexes[k], offsets, weights);
+        blurEngineSetFilterKernel(blurEngine, samples, offsets, weights);
+
+        for (unsigned int d = 0; d < kBackendDownsamplingFactorCount; ++d)
+        {
+            for (unsigned int m = 0; m < kBackendMultiplePassCountCount; ++m)
+            {
+                for (int prefilter = 0; prefilter < 2; ++prefilter)
+                {
+                    blurEngineSetFilterParameters(blurEngine, kBackendDownsamplingFactors[d], kBackendMultiplePassCounts[m]);
+                    blurEngineSetPrefilterEnabled(blurEngine, prefilter);
+
+                    BlurEngineImage_t referenceImage, image;
+                    memset(&referenceImage, 0, sizeof(referenceImage));
+                    memset(&image, 0, sizeof(image));
+
+                    size_t outputWidth, outputHeight;
+                    blurEngineOutputDimensions(blurEngine, inputWidth, inputHeight, inputHeight, inputWidth, &outputWidth, &outputHeight);
+
+                    if (!createImage(outputWidth, outputHeight, &referenceImage) || !createImage(outputWidth, outputHeight, &image) ||
+                        !filterImage(blurEngine, BlurEngineBackendScalar, inputImage, inputYUVImage, inputHeight, inputWidth, &referenceImage))
+                    {
+                        fprintf(stderr, "FAIL: %s kernel %u downsampling %g passes %u: scalar backend failed\n", name, kBackendKernelIndexes[k],
+                                kBackendDownsamplingFactors[d], kBackendMultiplePassCounts[m]);
+                        passed = false;
+                    }
+
+                    for (BlurEngineBackend_t backend = BlurEngineBackendSSE2; passed && backend <= BlurEngineBackendNEON; ++backend)
+                    {
+                        if (!blurEngineBackendAvailable(backend))
+                        {
+                            continue;
+                        }
+
+                        if (!filterImage(blurEngine, backend, inputImage, inputYUVImage, inputHeight, inputWidth, &image))
+                        {
+                            fprintf(stderr, "FAIL: %s %s backend failed\n", name, kBackendNames[backend]);
+                            passed = false;
+                            continue;
+                        }
+
+                        int difference = maxDifference(&referenceImage, &image);
+                        if (verbose)
+                        {
+                            printf("%s %zux%zu %s kernel %u downsampling %g passes %u%s: max difference %d\n", name, inputWidth, inputHeight, kBackendNames[backend],
+                                   kBackendKernelIndexes[k], kBackendDownsamplingFactors[d], kBackendMultiplePassCounts[m], prefilter ? " prefilter" : "", difference);
+                        }
+
+                        if (difference > allowedDifference)
+                        {
+                            fprintf(stderr, "FAIL: %s %zux%zu %s kernel %u downsampling %g passes %u%s: max difference %d with the scalar backend (> %d)\n", name,
+                                    inputWidth, inputHeight, kBackendNames[backend], kBackendKernelIndexes[k], kBackendDownsamplingFactors[d],
+                                    kBackendMultiplePassCounts[m], prefilter ? " prefilter" : "", difference, allowedDifference);
+                            passed = false;
+                        }
+                    }
+
+                    free(referenceImage.data);
+                    free(image.data);
+                }
+            }
+        }
+    }
+
+    return passed;
+}
+
+int main(int argc, const char * argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--verbose") == 0)
+        {
+            verbose = true;
+        }
+        else
+        {
+            fprintf(stderr, "Invalid options, see the usage in main.c\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    bool passed = true;
+
+    if (!blurEngineBackendAvailable(BlurEngineBackendSSE2) && !blurEngineBackendAvailable(BlurEngineBackendNEON))
+    {
+        fprintf(stderr, "FAIL: no SIMD backend on this architecture\n");
+        passed = false;
+    }
+
+    if (verbose)
+    {
+        printf("best backend: %s\n", kBackendNames[blurEngineBestBackend()]);
+    }
+
+    BlurEngine_t * blurEngine = createBlurEngine();
+
+    for (size_t s = 0; s < kBackendInputSizeCount && passed; ++s)
+    {
+        BlurEngineImage_t inputImage;
+        BlurEngineYUVImage_t inputYUVImage;
+        memset(&inputImage, 0, sizeof(inputImage));
+        memset(&inputYUVImage, 0, sizeof(inputYUVImage));
+
+        size_t width = kBackendInputSizes[s][0];
+        size_t height = kBackendInputSizes[s][1];
+
+        if (!createImage(width, height, &inputImage) || !createYUVImage(width, height, &inputYUVImage))
+        {
+            fprintf(stderr, "FAIL: can't allocate the %zux%zu input images\n", width, height);
+            passed = false;
+        }
+        else
+        {
+            fillRandom(inputImage.data, inputImage.bytesPerRow * height, 1);
+            fillRandom(inputYUVImage.luma, inputYUVImage.lumaBytesPerRow * height + inputYUVImage.chromaBytesPerRow * ((height + 1) / 2), 2);
+
+            passed = testBackendsMatchScalarBackend(blurEngine, "BGRA", &inputImage, NULL) && passed;
+            passed = testBackendsMatchScalarBackend(blurEngine, "NV12", NULL, &inputYUVImage) && passed;
+        }
+
+        free(inputImage.data);
+        free(inputYUVImage.luma);
+    }
+
+    releaseBlurEngine(blurEngine);
+
+    if (!passed)
+    {
+        return EXIT_FAILURE;
+    }
+
+    printf("PASS\n");
+    return EXIT_SUCCESS;
+}
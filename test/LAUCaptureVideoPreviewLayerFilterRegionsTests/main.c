@@ -0,0 +1,414 @@
+/*
+
+ main.c
+ LAUCaptureVideoPreviewLayer Filter Regions Tests
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+/*
+ Blur regions tests on Linux, the headless GL pipeline with scissored passes
+
+ 1. Inside the regions the render matches the render without regions (the scissor margins cover the kernel of each pass)
+ 2. Outside the regions the render is the unfiltered frame: it matches a render with other (disjoint) regions
+ 3. Same for the 420 bi-planar input
+ 4. A small region renders faster than the whole frame, the offscreen passes only rasterize the scissor boxes
+
+ Build (from the repository root):
+
+ make build/FilterRegionsTests && build/FilterRegionsTests (or make check for all the tests)
+
+ Usage:
+
+ FilterRegionsTests [--verbose]
+
+ Prints PASS and exits with 0 on success, each failure is printed to stderr.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "LAUCaptureVideoPreviewLayerHeadlessRenderer.h"
+#include "LAUCaptureVideoPreviewLayerFilterRegions.h"
+#include "LAUCaptureVideoPreviewLayerGaussianFilterKernel.h"
+
+// Same view as the golden-image tests (LAUCaptureVideoPreviewLayerTests layer bounds at 2x)
+#define kRegionsViewWidth 750
+#define kRegionsViewHeight 1334
+
+#define kRegionsInputWidth 1280
+#define kRegionsInputHeight 720
+
+// Same passes in the regions, only the rasterized area changes
+#define kRegionsMaxDifference 0
+
+// The unfiltered frame differs from the blurred one (mean absolute difference of the components)
+#define kRegionsMinMeanDifference 4.0
+
+// Frames timed for each configuration, the region covers about 4% of the view
+#define kRegionsTimedFrameCount 10
+#define kRegionsMaxTimeRatio 0.8
+
+static const unsigned int kRegionsKernelIndexes[] = {5, 10};
+
+#define kRegionsKernelIndexCount (sizeof(kRegionsKernelIndexes) / sizeof(kRegionsKernelIndexes[0]))
+
+// A region across the view, one in a corner and one inside it (dropped)
+static const FilterRegionRect_t kRegionsRects[] = {
+    {0.10f, 0.20f, 0.80f, 0.15f},
+    {0.55f, 0.70f, 0.50f, 0.40f},
+    {0.60f, 0.75f, 0.10f, 0.10f},
+};
+
+// Disjoint from kRegionsRects, the rest of the view is unfiltered in both renders
+static const FilterRegionRect_t kRegionsOtherRects[] = {
+    {0.05f, 0.45f, 0.40f, 0.20f},
+};
+
+static const FilterRegionRect_t kRegionsSmallRect = {0.40f, 0.40f, 0.20f, 0.20f};
+
+#define kRegionsRectCount (sizeof(kRegionsRects) / sizeof(kRegionsRects[0]))
+#define kRegionsOtherRectCount (sizeof(kRegionsOtherRects) / sizeof(kRegionsOtherRects[0]))
+
+static bool verbose;
+
+#pragma mark -
+#pragma mark Images
+
+static bool createImage(size_t width, size_t height, BlurEngineImage_t * image)
+{
+    image->width = width;
+    image->height = height;
+    image->bytesPerRow = width * 4;
+    image->data = (uint8_t *)malloc(image->bytesPerRow * height);
+
+    return image->data != NULL;
+}
+
+static bool createYUVImage(size_t width, size_t height, BlurEngineYUVImage_t * image)
+{
+    image->width = width;
+    image->height = height;
+    image->lumaBytesPerRow = width;
+    image->chromaBytesPerRow = ((width + 1) / 2) * 2;
+    image->luma = (uint8_t *)malloc(image->lumaBytesPerRow * height + image->chromaBytesPerRow * ((height + 1) / 2));
+    image->chroma = image->luma ? image->luma + image->lumaBytesPerRow * height : NULL;
+
+    return image->luma != NULL;
+}
+
+// Checkerboard with gradients, the blur is visible everywhere
+static void fillPattern(BlurEngineImage_t * image, BlurEngineYUVImage_t * yuvImage)
+{
+    for (size_t y = 0; y < image->height; ++y)
+    {
+        uint8_t * row = image->data + y * image->bytesPerRow;
+        for (size_t x = 0; x < image->width; ++x)
+        {
+            bool checker = ((x / 24) + (y / 24)) % 2;
+            row[4 * x + 0] = checker ? 230 : (uint8_t)(255 * y / image->height);
+            row[4 * x + 1] = (uint8_t)(255 * x / image->width);
+            row[4 * x + 2] = checker ? 20 : 200;
+            row[4 * x + 3] = 255;
+
+            yuvImage->luma[y * yuvImage->lumaBytesPerRow + x] = checker ? 40 : 220;
+        }
+    }
+
+    for (size_t cy = 0; cy < (yuvImage->height + 1) / 2; ++cy)
+    {
+        for (size_t cx = 0; cx < (yuvImage->width + 1) / 2; ++cx)
+        {
+            uint8_t * chroma = yuvImage->chroma + cy * yuvImage->chromaBytesPerRow + cx * 2;
+            chroma[0] = (uint8_t)(255 * cx / ((yuvImage->width + 1) / 2));
+            chroma[1] = ((cx / 12) + (cy / 12)) % 2 ? 60 : 190;
+        }
+    }
+}
+
+static bool boxesContainPixel(const FilterRegions_t * regions, size_t x, size_t y)
+{
+    for (size_t i = 0; i < regions->count; ++i)
+    {
+        FilterRegionBox_t box = filterRegionsViewBox(regions, i, kRegionsViewWidth, kRegionsViewHeight);
+
+        if ((int)x >= box.x && (int)x < box.x + box.width && (int)y >= box.y && (int)y < box.y + box.height)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static unsigned int pixelDifference(const BlurEngineImage_t * image, const BlurEngineImage_t * otherImage, size_t x, size_t y)
+{
+    const uint8_t * pixel = image->data + y * image->bytesPerRow + x * 4;
+    const uint8_t * otherPixel = otherImage->data + y * otherImage->bytesPerRow + x * 4;
+    unsigned int difference = 0;
+
+    for (int c = 0; c < 3; ++c)
+    {
+        unsigned int componentDifference = (unsigned int)abs((int)pixel[c] - (int)otherPixel[c]);
+        difference = componentDifference > difference ? componentDifference : difference;
+    }
+
+    return difference;
+}
+
+#pragma mark -
+#pragma mark Tests
+
+static bool filterImage(HeadlessRenderer_t * renderer, const BlurEngineImage_t * inputImage, const BlurEngineYUVImage_t * inputYUVImage, BlurEngineImage_t * outputImage)
+{
+    return inputYUVImage ? headlessRendererFilterYUVImage(renderer, inputYUVImage, kRegionsViewWidth, kRegionsViewHeight, outputImage)
+                         : headlessRendererFilterImage(renderer, inputImage, kRegionsViewWidth, kRegionsViewHeight, outputImage);
+}
+
+static bool testRegionsMatchWholeFrame(HeadlessRenderer_t * renderer, const char * name, HeadlessRendererOutput_t output,
+                                       const BlurEngineImage_t * inputImage, const BlurEngineYUVImage_t * inputYUVImage)
+{
+    BlurEngineImage_t wholeImage, regionsImage, otherRegionsImage;
+    bool passed = createImage(kRegionsViewWidth, kRegionsViewHeight, &wholeImage) &&
+                  createImage(kRegionsViewWidth, kRegionsViewHeight, &regionsImage) &&
+                  createImage(kRegionsViewWidth, kRegionsViewHeight, &otherRegionsImage);
+
+    FilterRegions_t regions, otherRegions;
+    filterRegionsSetViewRects(&regions, kRegionsRects, kRegionsRectCount);
+    filterRegionsSetViewRects(&otherRegions, kRegionsOtherRects, kRegionsOtherRectCount);
+
+    if (regions.count != kRegionsRectCount - 1)
+    {
+        fprintf(stderr, "FAIL: %s, %zu regions kept instead of %zu (the inner region is dropped)\n", name, regions.count, kRegionsRectCount - 1);
+        passed = false;
+    }
+
+    headlessRendererSetOutput(renderer, output);
+
+    for (size_t k = 0; passed && k < kRegionsKernelIndexCount; ++k)
+    {
+        headlessRendererSetFilterIntensity(renderer, gaussianFilterStepForKernelIndex(&kBtsGaussianFilterKernelDefaultParameters, kRegionsKernelIndexes[k]));
+
+        headlessRendererSetFilterRegions(renderer, NULL, 0);
+        passed = filterImage(renderer, inputImage, inputYUVImage, &wholeImage);
+
+        headlessRendererSetFilterRegions(renderer, kRegionsRects, kRegionsRectCount);
+        passed = passed && filterImage(renderer, inputImage, inputYUVImage, &regionsImage);
+
+        headlessRendererSetFilterRegions(renderer, kRegionsOtherRects, kRegionsOtherRectCount);
+        passed = passed && filterImage(renderer, inputImage, inputYUVImage, &otherRegionsImage);
+
+        if (!passed)
+        {
+            fprintf(stderr, "FAIL: %s kernel index %u, headless render failed\n", name, kRegionsKernelIndexes[k]);
+            break;
+        }
+
+        unsigned int insideMaxDifference = 0, outsideMaxDifference = 0;
+        double unfilteredDifference = 0.0;
+        size_t unfilteredPixelCount = 0;
+
+        for (size_t y = 0; y < kRegionsViewHeight; ++y)
+        {
+            for (size_t x = 0; x < kRegionsViewWidth; ++x)
+            {
+                if (boxesContainPixel(&regions, x, y))
+                {
+                    unsigned int difference = pixelDifference(&regionsImage, &wholeImage, x, y);
+                    insideMaxDifference = difference > insideMaxDifference ? difference : insideMaxDifference;
+                }
+                else if (!boxesContainPixel(&otherRegions, x, y))
+                {
+                    unsigned int difference = pixelDifference(&regionsImage, &otherRegionsImage, x, y);
+                    outsideMaxDifference = difference > outsideMaxDifference ? difference : outsideMaxDifference;
+                }
+                else
+                {
+                    // Unfiltered in regionsImage, blurred in wholeImage
+                    const uint8_t * pixel = regionsImage.data + y * regionsImage.bytesPerRow + x * 4;
+                    const uint8_t * wholePixel = wholeImage.data + y * wholeImage.bytesPerRow + x * 4;
+                    unfilteredDifference += abs((int)pixel[0] - (int)wholePixel[0]) + abs((int)pixel[1] - (int)wholePixel[1]) + abs((int)pixel[2] - (int)wholePixel[2]);
+                    unfilteredPixelCount += 3;
+                }
+            }
+        }
+
+        double meanUnfilteredDifference = unfilteredPixelCount ? unfilteredDifference / unfilteredPixelCount : 0.0;
+
+        if (verbose)
+        {
+            printf("%s kernel index %2u: max difference %u inside the regions, %u outside, unfiltered mean difference %.2f\n",
+                   name, kRegionsKernelIndexes[k], insideMaxDifference, outsideMaxDifference, meanUnfilteredDifference);
+        }
+
+        if (insideMaxDifference > kRegionsMaxDifference)
+        {
+            fprintf(stderr, "FAIL: %s kernel index %u, regions differ from the whole frame blur (max difference %u)\n", name, kRegionsKernelIndexes[k], insideMaxDifference);
+            passed = false;
+        }
+
+        if (outsideMaxDifference > kRegionsMaxDifference)
+        {
+            fprintf(stderr, "FAIL: %s kernel index %u, unfiltered pixels differ between regions (max difference %u)\n", name, kRegionsKernelIndexes[k], outsideMaxDifference);
+            passed = false;
+        }
+
+        if (meanUnfilteredDifference < kRegionsMinMeanDifference)
+        {
+            fprintf(stderr, "FAIL: %s kernel index %u, pixels outside the regions look blurred (mean difference %.2f)\n", name, kRegionsKernelIndexes[k], meanUnfilteredDifference);
+            passed = false;
+        }
+    }
+
+    headlessRendererSetFilterRegions(renderer, NULL, 0);
+
+    free(wholeImage.data);
+    free(regionsImage.data);
+    free(otherRegionsImage.data);
+
+    return passed;
+}
+
+static double filterTime(HeadlessRenderer_t * renderer, const BlurEngineImage_t * inputImage, BlurEngineImage_t * outputImage)
+{
+    // The first frame allocates the render targets
+    if (!headlessRendererFilterImage(renderer, inputImage, kRegionsViewWidth, kRegionsViewHeight, outputImage))
+    {
+        return -1.0;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < kRegionsTimedFrameCount; ++i)
+    {
+        if (!headlessRendererFilterImage(renderer, inputImage, kRegionsViewWidth, kRegionsViewHeight, outputImage))
+        {
+            return -1.0;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return ((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9) / kRegionsTimedFrameCount;
+}
+
+static bool testSmallRegionIsFaster(HeadlessRenderer_t * renderer, const BlurEngineImage_t * inputImage)
+{
+    BlurEngineImage_t image;
+    bool passed = createImage(kRegionsViewWidth, kRegionsViewHeight, &image);
+
+    // Largest kernel, the offscreen passes dominate the frame
+    headlessRendererSetOutput(renderer, HeadlessRendererOutputOnscreenCopy);
+    headlessRendererSetFilterIntensity(renderer, 1.0f);
+
+    headlessRendererSetFilterRegions(renderer, NULL, 0);
+    double wholeFrameTime = passed ? filterTime(renderer, inputImage, &image) : -1.0;
+
+    headlessRendererSetFilterRegions(renderer, &kRegionsSmallRect, 1);
+    double regionTime = passed ? filterTime(renderer, inputImage, &image) : -1.0;
+
+    headlessRendererSetFilterRegions(renderer, NULL, 0);
+
+    if (wholeFrameTime <= 0.0 || regionTime <= 0.0)
+    {
+        fprintf(stderr, "FAIL: timed headless render failed\n");
+        passed = false;
+    }
+    else
+    {
+        if (verbose)
+        {
+            printf("whole frame %.3f ms, small region %.3f ms per frame (ratio %.2f)\n", wholeFrameTime * 1e3, regionTime * 1e3, regionTime / wholeFrameTime);
+        }
+
+        if (regionTime > wholeFrameTime * kRegionsMaxTimeRatio)
+        {
+            fprintf(stderr, "FAIL: small region takes %.3f ms, whole frame %.3f ms\n", regionTime * 1e3, wholeFrameTime * 1e3);
+            passed = false;
+        }
+    }
+
+    free(image.data);
+
+    return passed;
+}
+
+int main(int argc, const char * argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--verbose") == 0)
+        {
+            verbose = true;
+        }
+        else
+        {
+            fprintf(stderr, "Invalid options, see the usage in main.c\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    BlurEngineImage_t inputImage;
+    BlurEngineYUVImage_t inputYUVImage;
+    memset(&inputImage, 0, sizeof(inputImage));
+    memset(&inputYUVImage, 0, sizeof(inputYUVImage));
+
+    bool passed = createImage(kRegionsInputWidth, kRegionsInputHeight, &inputImage) && createYUVImage(kRegionsInputWidth, kRegionsInputHeight, &inputYUVImage);
+
+    if (passed)
+    {
+        fillPattern(&inputImage, &inputYUVImage);
+    }
+
+    HeadlessRenderer_t * renderer = passed ? createHeadlessRenderer(NULL, NULL, NULL) : NULL;
+    if (passed && !renderer)
+    {
+        fprintf(stderr, "FAIL: can't create the headless renderer\n");
+        passed = false;
+    }
+
+    if (renderer)
+    {
+        // Same filter parameters as the layer
+        headlessRendererSetFilterParameters(renderer, 4.0f, 2);
+
+        passed = testRegionsMatchWholeFrame(renderer, "BGRA onscreen copy", HeadlessRendererOutputOnscreenCopy, &inputImage, NULL) && passed;
+        passed = testRegionsMatchWholeFrame(renderer, "NV12 onscreen copy", HeadlessRendererOutputOnscreenCopy, NULL, &inputYUVImage) && passed;
+        passed = testSmallRegionIsFaster(renderer, &inputImage) && passed;
+
+        releaseHeadlessRenderer(renderer);
+    }
+
+    free(inputImage.data);
+    free(inputYUVImage.luma);
+
+    if (!passed)
+    {
+        return EXIT_FAILURE;
+    }
+
+    printf("PASS\n");
+    return EXIT_SUCCESS;
+}
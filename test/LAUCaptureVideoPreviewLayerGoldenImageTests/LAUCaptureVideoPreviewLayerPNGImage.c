@@ -0,0 +1,247 @@
+/*
+
+ LAUCaptureVideoPreviewLayerPNGImage.c
+ LAUCaptureVideoPreviewLayer Golden Image Tests
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "LAUCaptureVideoPreviewLayerPNGImage.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+enum PNGColorType {
+    PNGColorTypeGray = 0,
+    PNGColorTypeRGB = 2,
+    PNGColorTypeGrayAlpha = 4,
+    PNGColorTypeRGBA = 6,
+};
+
+static const uint8_t kPNGSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+static uint32_t readUInt32(const uint8_t * data)
+{
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | (uint32_t)data[3];
+}
+
+static unsigned int channelCountForColorType(uint8_t colorType)
+{
+    switch (colorType)
+    {
+        case PNGColorTypeGray: return 1;
+        case PNGColorTypeGrayAlpha: return 2;
+        case PNGColorTypeRGB: return 3;
+        case PNGColorTypeRGBA: return 4;
+    }
+
+    return 0;
+}
+
+static uint8_t paethPredictor(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+
+    if (pa <= pb && pa <= pc)
+    {
+        return (uint8_t)a;
+    }
+
+    return (uint8_t)(pb <= pc ? b : c);
+}
+
+// Reverses the filter of each scanline in place (the first byte of each scanline is the filter type)
+static bool unfilterScanlines(uint8_t * scanlines, size_t height, size_t rowSize, unsigned int bytesPerPixel)
+{
+    const uint8_t * previous = NULL;
+
+    for (size_t y = 0; y < height; ++y)
+    {
+        uint8_t filterType = scanlines[y * (rowSize + 1)];
+        uint8_t * row = scanlines + y * (rowSize + 1) + 1;
+
+        for (size_t i = 0; i < rowSize; ++i)
+        {
+            int left = i >= bytesPerPixel ? row[i - bytesPerPixel] : 0;
+            int up = previous ? previous[i] : 0;
+            int upLeft = (previous && i >= bytesPerPixel) ? previous[i - bytesPerPixel] : 0;
+
+            switch (filterType)
+            {
+                case 0: break; // None
+                case 1: row[i] += left; break; // Sub
+                case 2: row[i] += up; break; // Up
+                case 3: row[i] += (left + up) / 2; break; // Average
+                case 4: row[i] += paethPredictor(left, up, upLeft); break; // Paeth
+                default: return false;
+            }
+        }
+
+        previous = row;
+    }
+
+    return true;
+}
+
+bool decodePNGImage(const uint8_t * data, size_t size, BlurEngineImage_t * image)
+{
+    if (size < sizeof(kPNGSignature) || memcmp(data, kPNGSignature, sizeof(kPNGSignature)) != 0)
+    {
+        return false;
+    }
+
+    size_t width = 0, height = 0;
+    uint8_t colorType = 0;
+    uint8_t * compressedData = NULL;
+    size_t compressedSize = 0;
+    bool valid = true;
+
+    // Chunks: length, type, data, CRC (not checked)
+    for (size_t offset = sizeof(kPNGSignature); valid && offset + 12 <= size; )
+    {
+        uint32_t length = readUInt32(data + offset);
+        const uint8_t * type = data + offset + 4;
+        const uint8_t * chunkData = data + offset + 8;
+
+        if (length > size - offset - 12)
+        {
+            valid = false;
+            break;
+        }
+
+        if (memcmp(type, "IHDR", 4) == 0 && length >= 13)
+        {
+            width = readUInt32(chunkData);
+            height = readUInt32(chunkData + 4);
+            colorType = chunkData[9];
+
+            // 8 bit depth, deflate, adaptive filtering, no interlace
+            valid = chunkData[8] == 8 && chunkData[10] == 0 && chunkData[11] == 0 && chunkData[12] == 0 && channelCountForColorType(colorType) > 0;
+        }
+        else if (memcmp(type, "IDAT", 4) == 0)
+        {
+            uint8_t * newCompressedData = (uint8_t *)realloc(compressedData, compressedSize + length);
+            if (!newCompressedData)
+            {
+                valid = false;
+                break;
+            }
+
+            compressedData = newCompressedData;
+            memcpy(compressedData + compressedSize, chunkData, length);
+            compressedSize += length;
+        }
+        else if (memcmp(type, "IEND", 4) == 0)
+        {
+            break;
+        }
+
+        offset += 12 + length;
+    }
+
+    if (!valid || !width || !height || !compressedData)
+    {
+        free(compressedData);
+        return false;
+    }
+
+    unsigned int bytesPerPixel = channelCountForColorType(colorType);
+    size_t rowSize = width * bytesPerPixel;
+    uLongf scanlinesSize = (uLongf)((rowSize + 1) * height);
+    uint8_t * scanlines = (uint8_t *)malloc(scanlinesSize);
+
+    valid = scanlines &&
+            uncompress(scanlines, &scanlinesSize, compressedData, (uLong)compressedSize) == Z_OK &&
+            scanlinesSize == (rowSize + 1) * height &&
+            unfilterScanlines(scanlines, height, rowSize, bytesPerPixel);
+
+    free(compressedData);
+
+    image->width = width;
+    image->height = height;
+    image->bytesPerRow = width * 4;
+    image->data = valid ? (uint8_t *)malloc(image->bytesPerRow * height) : NULL;
+
+    if (!image->data)
+    {
+        free(scanlines);
+        return false;
+    }
+
+    // Expand to RGBA
+    for (size_t y = 0; y < height; ++y)
+    {
+        const uint8_t * row = scanlines + y * (rowSize + 1) + 1;
+        uint8_t * pixels = image->data + y * image->bytesPerRow;
+
+        for (size_t x = 0; x < width; ++x, row += bytesPerPixel, pixels += 4)
+        {
+            switch (colorType)
+            {
+                case PNGColorTypeGray:
+                    pixels[0] = pixels[1] = pixels[2] = row[0];
+                    pixels[3] = 255;
+                    break;
+                case PNGColorTypeGrayAlpha:
+                    pixels[0] = pixels[1] = pixels[2] = row[0];
+                    pixels[3] = row[1];
+                    break;
+                case PNGColorTypeRGB:
+                    memcpy(pixels, row, 3);
+                    pixels[3] = 255;
+                    break;
+                case PNGColorTypeRGBA:
+                    memcpy(pixels, row, 4);
+                    break;
+            }
+        }
+    }
+
+    free(scanlines);
+    return true;
+}
+
+bool loadPNGImage(const char * path, BlurEngineImage_t * image)
+{
+    FILE * file = fopen(path, "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint8_t * data = fileSize > 0 ? (uint8_t *)malloc(fileSize) : NULL;
+    bool loaded = data && fread(data, 1, fileSize, file) == (size_t)fileSize && decodePNGImage(data, fileSize, image);
+
+    free(data);
+    fclose(file);
+
+    return loaded;
+}
@@ -0,0 +1,57 @@
+/*
+
+ LAUCaptureVideoPreviewLayerPNGImage.h
+ LAUCaptureVideoPreviewLayer Golden Image Tests
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef LAUCaptureVideoPreviewLayerPNGImage_h
+#define LAUCaptureVideoPreviewLayerPNGImage_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LAUCaptureVideoPreviewLayerBlurEngine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Minimal PNG decoder for the sample images (test/Samples.xcassets), inflated with zlib
+
+ - 8 bit gray, gray + alpha, RGB and RGBA, non-interlaced (the formats of the samples)
+ - The decoded image is RGBA8 (alpha 255 if the PNG has none), rows aren't padded
+ - Ancillary chunks (gAMA, cHRM, iTXt...) are ignored, no color management
+ */
+
+// Returns false if the file can't be read or the format isn't supported, the image data must be freed with free()
+bool loadPNGImage(const char * path, BlurEngineImage_t * image);
+bool decodePNGImage(const uint8_t * data, size_t size, BlurEngineImage_t * image);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAUCaptureVideoPreviewLayerPNGImage_h */
@@ -0,0 +1,590 @@
+/*
+
+ main.c
+ LAUCaptureVideoPreviewLayer Golden Image Tests
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+/*
+ Golden-image tests on Linux, the sample images of LAUCaptureVideoPreviewLayerTests (test/Samples.xcassets)
+ compared with LAUCaptureVideoPreviewLayerImageCompare (max difference, PSNR and SSIM) for every kernel index
+
+ 1. The source image is the same as itself (testSourceImageSimilarityWithItself)
+ 2. The headless GL pipeline (offscreen texture) matches the CPU blur engine, bts program
+ 3. The blur increases with the kernel index: the SSIM with the kernel index 0 render decreases, bts and dts programs
+ 4. The onscreen render (375x667 points at 2x, like LAUCaptureVideoPreviewLayerTests) is closest to each target image
+    (target-image-12/36/48px-radius) at the expected kernel index and within the PSNR/SSIM tolerances
+ 5. The kernel bank variants (FilterKernelBankEnabled) match the CPU blur engine with the blended kernel of each
+    bank position, at the kernel indices and halfway between them
+ 6. With an intensity map, uniform maps match the blended kernel of the scaled position, and a map that is 255 on the
+    left half and 0 on the right half matches the intensity 1 and intensity 0 renders away from the seam
+
+ Build (from the repository root):
+
+ make build/GoldenImageTests && build/GoldenImageTests (or make check for all the tests)
+
+ Usage:
+
+ GoldenImageTests [--samples <Samples.xcassets directory>] [--verbose]
+
+ Prints PASS and exits with 0 on success, each failure is printed to stderr.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "LAUCaptureVideoPreviewLayerHeadlessRenderer.h"
+#include "LAUCaptureVideoPreviewLayerBlurEngine.h"
+#include "LAUCaptureVideoPreviewLayerGaussianFilterKernel.h"
+#include "LAUCaptureVideoPreviewLayerImageCompare.h"
+#include "LAUCaptureVideoPreviewLayerPNGImage.h"
+
+// LAUCaptureVideoPreviewLayerTests layer bounds (points) at 2x
+#define kGoldenImageViewWidth 750
+#define kGoldenImageViewHeight 1334
+
+// The GL pipeline and the CPU blur engine round each pass differently (off by one, twice at most)
+#define kGoldenImageEngineMaxDifference 2
+#define kGoldenImageEngineMinPSNR 55.0
+
+// Bank positions between the kernels of the bank (0, 0.5, 1 ... kernelCount-1)
+#define kGoldenImageKernelBankPositionSteps 2
+
+// Intensity map values of the uniform maps
+static const uint8_t kGoldenImageIntensityMapValues[] = {255, 128, 0};
+
+// A render matches a target image within these tolerances
+#define kGoldenImageTargetMinPSNR 35.0
+#define kGoldenImageTargetMinSSIM 0.99
+
+// Another kernel index is only a better match if its SSIM is higher by more than this
+#define kGoldenImageTargetSSIMTolerance 0.001
+
+struct GoldenImageTarget {
+    const char * name;
+    GaussianFilterKernelType_t kernelType;
+    unsigned int kernelIndex; // Closest kernel index
+};
+
+typedef struct GoldenImageTarget GoldenImageTarget_t;
+
+static const GoldenImageTarget_t kGoldenImageTargets[] = {
+    {"target-image-12px-radius", GaussianFilterKernelTypeBts, 2},
+    {"target-image-36px-radius", GaussianFilterKernelTypeBts, 7},
+    {"target-image-48px-radius", GaussianFilterKernelTypeBts, 10},
+    {"target-image-36px-radius", GaussianFilterKernelTypeDts, 5},
+    {"target-image-48px-radius", GaussianFilterKernelTypeDts, 10},
+};
+
+#define kGoldenImageTargetCount (sizeof(kGoldenImageTargets) / sizeof(kGoldenImageTargets[0]))
+
+static bool verbose;
+
+static const char * kernelTypeName(GaussianFilterKernelType_t kernelType)
+{
+    return kernelType == GaussianFilterKernelTypeDts ? "dts" : "bts";
+}
+
+static bool loadSampleImage(const char * samplesPath, const char * name, BlurEngineImage_t * image)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s.imageset/%s.png", samplesPath, name, name);
+
+    if (!loadPNGImage(path, image))
+    {
+        fprintf(stderr, "FAIL: can't load %s\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+static bool createImage(size_t width, size_t height, BlurEngineImage_t * image)
+{
+    image->width = width;
+    image->height = height;
+    image->bytesPerRow = width * 4;
+    image->data = (uint8_t *)malloc(image->bytesPerRow * height);
+
+    return image->data != NULL;
+}
+
+static void printCompareResult(const char * description, const ImageCompareResult_t * result)
+{
+    if (verbose)
+    {
+        printf("%s: max difference %u, PSNR %.2f dB, SSIM %.4f\n", description, result->maxDifference, result->psnr, result->ssim);
+    }
+}
+
+// Largest difference of the channels of the columns [beginColumn, endColumn)
+static unsigned int maxDifferenceInColumns(const BlurEngineImage_t * image, const BlurEngineImage_t * otherImage, size_t beginColumn, size_t endColumn)
+{
+    unsigned int maxDifference = 0;
+
+    for (size_t y = 0; y < image->height; ++y)
+    {
+        const uint8_t * row = image->data + y * image->bytesPerRow;
+        const uint8_t * otherRow = otherImage->data + y * otherImage->bytesPerRow;
+
+        for (size_t i = 4 * beginColumn; i < 4 * endColumn; ++i)
+        {
+            unsigned int difference = abs((int)row[i] - (int)otherRow[i]);
+            maxDifference = difference > maxDifference ? difference : maxDifference;
+        }
+    }
+
+    return maxDifference;
+}
+
+#pragma mark -
+#pragma mark Renders
+
+static void setKernelIndex(HeadlessRenderer_t * renderer, unsigned int kernelIndex)
+{
+    headlessRendererSetFilterIntensity(renderer, gaussianFilterStepForKernelIndex(headlessRendererFilterKernelParameters(renderer), kernelIndex));
+}
+
+// Onscreen render (view sized, portrait). glReadPixels rows are bottom-up, flipped to match the PNG rows
+static bool renderOnscreenImage(HeadlessRenderer_t * renderer, const BlurEngineImage_t * sourceImage, BlurEngineImage_t * image)
+{
+    headlessRendererSetOutput(renderer, HeadlessRendererOutputOnscreenCopy);
+
+    if (!headlessRendererFilterImage(renderer, sourceImage, image->width, image->height, image))
+    {
+        return false;
+    }
+
+    uint8_t * row = (uint8_t *)malloc(image->bytesPerRow);
+    for (size_t y = 0; row && y < image->height / 2; ++y)
+    {
+        uint8_t * top = image->data + y * image->bytesPerRow;
+        uint8_t * bottom = image->data + (image->height - 1 - y) * image->bytesPerRow;
+
+        memcpy(row, top, image->bytesPerRow);
+        memcpy(top, bottom, image->bytesPerRow);
+        memcpy(bottom, row, image->bytesPerRow);
+    }
+    free(row);
+
+    return true;
+}
+
+#pragma mark -
+#pragma mark Tests
+
+static bool testSourceImageSimilarityWithItself(const BlurEngineImage_t * sourceImage)
+{
+    for (ImageCompareBackend_t backend = ImageCompareBackendScalar; backend <= ImageCompareBackendNEON; ++backend)
+    {
+        ImageCompareResult_t result;
+
+        if (imageCompareBackendAvailable(backend) &&
+            (!imageCompareWithBackend(sourceImage, sourceImage, backend, &result) || result.maxDifference != 0 || !isinf(result.psnr) || result.ssim != 1.0))
+        {
+            fprintf(stderr, "FAIL: source image is not the same as itself (backend %d)\n", backend);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool testHeadlessRendererMatchesBlurEngine(HeadlessRenderer_t * renderer, const BlurEngineImage_t * sourceImage)
+{
+    BlurEngine_t * blurEngine = createBlurEngine();
+    GaussianFilterKernelCache_t * cache = createGaussianFilterKernelCache(&kBtsGaussianFilterKernelDefaultParameters, GaussianFilterKernelTypeBts, 1);
+
+    headlessRendererSetFilterKernelType(renderer, GaussianFilterKernelTypeBts);
+    blurEngineSetPrefilterEnabled(blurEngine, headlessRendererPrefilterEnabled(renderer));
+    headlessRendererSetOutput(renderer, HeadlessRendererOutputOffscreen);
+
+    BlurEngineImage_t image, referenceImage;
+    size_t width, height;
+    headlessRendererOutputDimensions(renderer, sourceImage->width, sourceImage->height, kGoldenImageViewWidth, kGoldenImageViewHeight, &width, &height);
+    bool passed = createImage(width, height, &image) && createImage(width, height, &referenceImage);
+
+    for (unsigned int kernelIndex = 0; passed && kernelIndex < kBtsGaussianFilterKernelDefaultParameters.kernelCount; ++kernelIndex)
+    {
+        float step = gaussianFilterStepForKernelIndex(&kBtsGaussianFilterKernelDefaultParameters, kernelIndex);
+        const GaussianFilterKernel_t * filterKernel = gaussianFilterKernelCacheKernelForStep(cache, step);
+        blurEngineSetFilterKernel(blurEngine, filterKernel->samples, filterKernel->offsets, filterKernel->weights);
+        setKernelIndex(renderer, kernelIndex);
+
+        ImageCompareResult_t result;
+        passed = headlessRendererFilterImage(renderer, sourceImage, kGoldenImageViewWidth, kGoldenImageViewHeight, &image) &&
+                 blurEngineFilterImage(blurEngine, sourceImage, kGoldenImageViewWidth, kGoldenImageViewHeight, &referenceImage) &&
+                 imageCompare(&image, &referenceImage, &result);
+
+        if (!passed || result.maxDifference > kGoldenImageEngineMaxDifference || result.psnr < kGoldenImageEngineMinPSNR)
+        {
+            fprintf(stderr, "FAIL: kernel index %u, headless renderer and CPU blur engine differ (max difference %u, PSNR %.2f dB)\n",
+                    kernelIndex, passed ? result.maxDifference : 0, passed ? result.psnr : 0.0);
+            passed = false;
+            break;
+        }
+
+        char description[64];
+        snprintf(description, sizeof(description), "bts kernel index %2u, GL vs CPU", kernelIndex);
+        printCompareResult(description, &result);
+    }
+
+    free(image.data);
+    free(referenceImage.data);
+    releaseGaussianFilterKernelCache(cache);
+    releaseBlurEngine(blurEngine);
+
+    return passed;
+}
+
+// Offscreen render and the CPU blur engine with the blended kernel at a bank position
+static bool renderKernelBankImages(HeadlessRenderer_t * renderer, BlurEngine_t * blurEngine, const BlurEngineImage_t * sourceImage, float step, float position,
+                                   BlurEngineImage_t * image, BlurEngineImage_t * referenceImage)
+{
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+    unsigned int samples = btsGaussianFilterMaxSamples(parameters);
+    float offsets[samples], weights[samples];
+    btsGaussianFilterKernelBankKernelForPosition(parameters, position, offsets, weights);
+    blurEngineSetFilterKernel(blurEngine, samples, offsets, weights);
+    headlessRendererSetFilterIntensity(renderer, step);
+
+    return (!image || headlessRendererFilterImage(renderer, sourceImage, kGoldenImageViewWidth, kGoldenImageViewHeight, image)) &&
+           blurEngineFilterImage(blurEngine, sourceImage, kGoldenImageViewWidth, kGoldenImageViewHeight, referenceImage);
+}
+
+static bool testKernelBankMatchesBlurEngine(HeadlessRenderer_t * renderer, const BlurEngineImage_t * sourceImage)
+{
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+
+    headlessRendererSetFilterKernelType(renderer, GaussianFilterKernelTypeBts);
+    headlessRendererSetOutput(renderer, HeadlessRendererOutputOffscreen);
+
+    if (!headlessRendererSetKernelBankEnabled(renderer, true))
+    {
+        fprintf(stderr, "FAIL: kernel bank variants not supported (the bank doesn't fit the uniforms or the programs don't link)\n");
+        return false;
+    }
+
+    BlurEngine_t * blurEngine = createBlurEngine();
+    blurEngineSetPrefilterEnabled(blurEngine, headlessRendererPrefilterEnabled(renderer));
+
+    BlurEngineImage_t image = {NULL, 0, 0, 0}, referenceImage = {NULL, 0, 0, 0};
+    size_t width, height;
+    headlessRendererOutputDimensions(renderer, sourceImage->width, sourceImage->height, kGoldenImageViewWidth, kGoldenImageViewHeight, &width, &height);
+    bool passed = createImage(width, height, &image) && createImage(width, height, &referenceImage);
+
+    unsigned int positionCount = (parameters->kernelCount - 1) * kGoldenImageKernelBankPositionSteps + 1;
+
+    for (unsigned int p = 0; passed && p < positionCount; ++p)
+    {
+        float position = (float)p / kGoldenImageKernelBankPositionSteps;
+        float step = position / (parameters->kernelCount - 1);
+
+        ImageCompareResult_t result;
+        passed = renderKernelBankImages(renderer, blurEngine, sourceImage, step, gaussianFilterKernelBankPositionForStep(parameters, step), &image, &referenceImage) &&
+                 imageCompare(&image, &referenceImage, &result);
+
+        if (!passed || result.maxDifference > kGoldenImageEngineMaxDifference || result.psnr < kGoldenImageEngineMinPSNR)
+        {
+            fprintf(stderr, "FAIL: kernel bank position %.2f, headless renderer and CPU blur engine differ (max difference %u, PSNR %.2f dB)\n",
+                    position, passed ? result.maxDifference : 0, passed ? result.psnr : 0.0);
+            passed = false;
+            break;
+        }
+
+        char description[64];
+        snprintf(description, sizeof(description), "bts kernel bank position %5.2f, GL vs CPU", position);
+        printCompareResult(description, &result);
+    }
+
+    headlessRendererSetKernelBankEnabled(renderer, false);
+
+    free(image.data);
+    free(referenceImage.data);
+    releaseBlurEngine(blurEngine);
+
+    return passed;
+}
+
+static bool testIntensityMapMatchesBlurEngine(HeadlessRenderer_t * renderer, const BlurEngineImage_t * sourceImage)
+{
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+
+    headlessRendererSetFilterKernelType(renderer, GaussianFilterKernelTypeBts);
+    headlessRendererSetOutput(renderer, HeadlessRendererOutputOffscreen);
+
+    // Same dimensions as the source image, any dimensions work (frame texture coordinates)
+    size_t mapWidth = sourceImage->width, mapHeight = sourceImage->height;
+    uint8_t * intensityMap = (uint8_t *)malloc(mapWidth * mapHeight);
+
+    if (!intensityMap || !headlessRendererSetKernelBankEnabled(renderer, true))
+    {
+        fprintf(stderr, "FAIL: kernel bank variants not supported (the bank doesn't fit the uniforms or the programs don't link)\n");
+        free(intensityMap);
+        return false;
+    }
+
+    BlurEngine_t * blurEngine = createBlurEngine();
+    blurEngineSetPrefilterEnabled(blurEngine, headlessRendererPrefilterEnabled(renderer));
+
+    BlurEngineImage_t image = {NULL, 0, 0, 0}, referenceImage = {NULL, 0, 0, 0}, otherReferenceImage = {NULL, 0, 0, 0};
+    size_t width, height;
+    headlessRendererOutputDimensions(renderer, sourceImage->width, sourceImage->height, kGoldenImageViewWidth, kGoldenImageViewHeight, &width, &height);
+    bool passed = createImage(width, height, &image) && createImage(width, height, &referenceImage) && createImage(width, height, &otherReferenceImage);
+
+    // Uniform maps scale the bank position of the intensity
+    float step = 0.75f;
+    float position = gaussianFilterKernelBankPositionForStep(parameters, step);
+
+    for (size_t v = 0; passed && v < sizeof(kGoldenImageIntensityMapValues); ++v)
+    {
+        uint8_t value = kGoldenImageIntensityMapValues[v];
+        memset(intensityMap, value, mapWidth * mapHeight);
+
+        if (!headlessRendererSetIntensityMap(renderer, intensityMap, mapWidth, mapHeight, mapWidth))
+        {
+            fprintf(stderr, "FAIL: intensity map variants not supported (the banks don't fit the fragment uniforms or the programs don't link)\n");
+            passed = false;
+            break;
+        }
+
+        ImageCompareResult_t result;
+        passed = renderKernelBankImages(renderer, blurEngine, sourceImage, step, position * value / 255.0f, &image, &referenceImage) &&
+                 imageCompare(&image, &referenceImage, &result);
+
+        if (!passed || result.maxDifference > kGoldenImageEngineMaxDifference || result.psnr < kGoldenImageEngineMinPSNR)
+        {
+            fprintf(stderr, "FAIL: intensity map %u, headless renderer and CPU blur engine differ (max difference %u, PSNR %.2f dB)\n",
+                    value, passed ? result.maxDifference : 0, passed ? result.psnr : 0.0);
+            passed = false;
+            break;
+        }
+
+        char description[64];
+        snprintf(description, sizeof(description), "bts intensity map %3u, GL vs CPU", value);
+        printCompareResult(description, &result);
+    }
+
+    // Full intensity on the left half, none on the right half
+    for (size_t y = 0; passed && y < mapHeight; ++y)
+    {
+        memset(intensityMap + y * mapWidth, 255, mapWidth / 2);
+        memset(intensityMap + y * mapWidth + mapWidth / 2, 0, mapWidth - mapWidth / 2);
+    }
+
+    if (passed)
+    {
+        headlessRendererSetIntensityMap(renderer, intensityMap, mapWidth, mapHeight, mapWidth);
+        passed = renderKernelBankImages(renderer, blurEngine, sourceImage, 1.0f, gaussianFilterKernelBankPositionForStep(parameters, 1.0f), &image, &referenceImage) &&
+                 renderKernelBankImages(renderer, blurEngine, sourceImage, 1.0f, 0.0f, NULL, &otherReferenceImage);
+
+        // Each horizontal pass reads the radius of the largest kernel across the seam (plus the bilinear map and prefilter taps)
+        unsigned int radius = gaussianFilterRadiusForSize(gaussianFilterKernelBankSizeForPosition(parameters, parameters->kernelCount - 1));
+        size_t margin = 2 * (radius + 2);
+        size_t seam = width / 2;
+
+        unsigned int leftDifference = passed ? maxDifferenceInColumns(&image, &referenceImage, 0, seam > margin ? seam - margin : 0) : 0;
+        unsigned int rightDifference = passed ? maxDifferenceInColumns(&image, &otherReferenceImage, seam + margin < width ? seam + margin : width, width) : 0;
+
+        if (!passed || seam <= margin || leftDifference > kGoldenImageEngineMaxDifference || rightDifference > kGoldenImageEngineMaxDifference)
+        {
+            fprintf(stderr, "FAIL: split intensity map, headless renderer and CPU blur engine differ (max difference %u left, %u right)\n", leftDifference, rightDifference);
+            passed = false;
+        }
+        else if (verbose)
+        {
+            printf("bts split intensity map, GL vs CPU: max difference %u left (intensity 1), %u right (intensity 0), %zu columns around the seam skipped\n",
+                   leftDifference, rightDifference, 2 * margin);
+        }
+    }
+
+    headlessRendererSetIntensityMap(renderer, NULL, 0, 0, 0);
+    headlessRendererSetKernelBankEnabled(renderer, false);
+
+    free(intensityMap);
+    free(image.data);
+    free(referenceImage.data);
+    free(otherReferenceImage.data);
+    releaseBlurEngine(blurEngine);
+
+    return passed;
+}
+
+static bool testBlurIncreasesWithKernelIndex(HeadlessRenderer_t * renderer, const BlurEngineImage_t * sourceImage, GaussianFilterKernelType_t kernelType)
+{
+    headlessRendererSetFilterKernelType(renderer, kernelType);
+
+    BlurEngineImage_t firstImage, image;
+    bool passed = createImage(kGoldenImageViewWidth, kGoldenImageViewHeight, &firstImage) && createImage(kGoldenImageViewWidth, kGoldenImageViewHeight, &image);
+
+    setKernelIndex(renderer, 0);
+    passed = passed && renderOnscreenImage(renderer, sourceImage, &firstImage);
+
+    double previousSSIM = 1.0;
+    unsigned int kernelCount = headlessRendererFilterKernelParameters(renderer)->kernelCount;
+
+    for (unsigned int kernelIndex = 1; passed && kernelIndex < kernelCount; ++kernelIndex)
+    {
+        ImageCompareResult_t result;
+        setKernelIndex(renderer, kernelIndex);
+        passed = renderOnscreenImage(renderer, sourceImage, &image) && imageCompare(&image, &firstImage, &result);
+
+        if (!passed || result.ssim >= previousSSIM)
+        {
+            fprintf(stderr, "FAIL: %s kernel index %u is not blurrier than %u\n", kernelTypeName(kernelType), kernelIndex, kernelIndex - 1);
+            passed = false;
+            break;
+        }
+
+        char description[64];
+        snprintf(description, sizeof(description), "%s kernel index %2u vs 0", kernelTypeName(kernelType), kernelIndex);
+        printCompareResult(description, &result);
+
+        previousSSIM = result.ssim;
+    }
+
+    free(firstImage.data);
+    free(image.data);
+
+    return passed;
+}
+
+static bool testRenderedImageSimilarityWithTargetImage(HeadlessRenderer_t * renderer, const BlurEngineImage_t * sourceImage, const char * samplesPath, const GoldenImageTarget_t * target)
+{
+    BlurEngineImage_t targetImage, image;
+    if (!loadSampleImage(samplesPath, target->name, &targetImage))
+    {
+        return false;
+    }
+
+    headlessRendererSetFilterKernelType(renderer, target->kernelType);
+
+    bool passed = createImage(kGoldenImageViewWidth, kGoldenImageViewHeight, &image);
+    unsigned int kernelCount = headlessRendererFilterKernelParameters(renderer)->kernelCount;
+    ImageCompareResult_t results[kernelCount];
+
+    for (unsigned int kernelIndex = 0; passed && kernelIndex < kernelCount; ++kernelIndex)
+    {
+        setKernelIndex(renderer, kernelIndex);
+        passed = renderOnscreenImage(renderer, sourceImage, &image) && imageCompare(&image, &targetImage, &results[kernelIndex]);
+
+        char description[96];
+        snprintf(description, sizeof(description), "%s kernel index %2u vs %s", kernelTypeName(target->kernelType), kernelIndex, target->name);
+        printCompareResult(description, &results[kernelIndex]);
+    }
+
+    if (!passed)
+    {
+        fprintf(stderr, "FAIL: %s can't be compared with the %s renders\n", target->name, kernelTypeName(target->kernelType));
+    }
+
+    const ImageCompareResult_t * expectedResult = &results[target->kernelIndex];
+
+    if (passed && (expectedResult->psnr < kGoldenImageTargetMinPSNR || expectedResult->ssim < kGoldenImageTargetMinSSIM))
+    {
+        fprintf(stderr, "FAIL: %s kernel index %u vs %s, PSNR %.2f dB and SSIM %.4f (expected at least %.2f dB and %.4f)\n",
+                kernelTypeName(target->kernelType), target->kernelIndex, target->name, expectedResult->psnr, expectedResult->ssim,
+                kGoldenImageTargetMinPSNR, kGoldenImageTargetMinSSIM);
+        passed = false;
+    }
+
+    for (unsigned int kernelIndex = 0; passed && kernelIndex < kernelCount; ++kernelIndex)
+    {
+        if (results[kernelIndex].ssim > expectedResult->ssim + kGoldenImageTargetSSIMTolerance)
+        {
+            fprintf(stderr, "FAIL: %s kernel index %u is closer to %s than the expected kernel index %u (SSIM %.4f > %.4f)\n",
+                    kernelTypeName(target->kernelType), kernelIndex, target->name, target->kernelIndex, results[kernelIndex].ssim, expectedResult->ssim);
+            passed = false;
+        }
+    }
+
+    free(image.data);
+    free(targetImage.data);
+
+    return passed;
+}
+
+int main(int argc, const char * argv[])
+{
+    const char * samplesPath = "test/Samples.xcassets";
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--verbose") == 0)
+        {
+            verbose = true;
+        }
+        else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+        {
+            samplesPath = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Invalid options, see the usage in main.c\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    BlurEngineImage_t sourceImage;
+    if (!loadSampleImage(samplesPath, "source-image", &sourceImage))
+    {
+        return EXIT_FAILURE;
+    }
+
+    HeadlessRenderer_t * renderer = createHeadlessRenderer(NULL, NULL, NULL);
+    if (!renderer)
+    {
+        fprintf(stderr, "FAIL: can't create the headless renderer\n");
+        free(sourceImage.data);
+        return EXIT_FAILURE;
+    }
+
+    // Same filter parameters as the layer
+    headlessRendererSetFilterParameters(renderer, 4.0f, 2);
+
+    bool passed = testSourceImageSimilarityWithItself(&sourceImage);
+    passed = testHeadlessRendererMatchesBlurEngine(renderer, &sourceImage) && passed;
+    passed = testBlurIncreasesWithKernelIndex(renderer, &sourceImage, GaussianFilterKernelTypeBts) && passed;
+    passed = testBlurIncreasesWithKernelIndex(renderer, &sourceImage, GaussianFilterKernelTypeDts) && passed;
+
+    for (size_t t = 0; t < kGoldenImageTargetCount; ++t)
+    {
+        passed = testRenderedImageSimilarityWithTargetImage(renderer, &sourceImage, samplesPath, &kGoldenImageTargets[t]) && passed;
+    }
+
+    passed = testKernelBankMatchesBlurEngine(renderer, &sourceImage) && passed;
+    passed = testIntensityMapMatchesBlurEngine(renderer, &sourceImage) && passed;
+
+    releaseHeadlessRenderer(renderer);
+    free(sourceImage.data);
+
+    if (!passed)
+    {
+        return EXIT_FAILURE;
+    }
+
+    printf("PASS\n");
+    return EXIT_SUCCESS;
+}
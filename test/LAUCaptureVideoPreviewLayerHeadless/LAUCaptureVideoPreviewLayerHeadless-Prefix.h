@@ -0,0 +1,41 @@
+/*
+
+ LAUCaptureVideoPreviewLayerHeadless-Prefix.h
+ LAUCaptureVideoPreviewLayer Headless
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+//
+// Prefix header for the headless renderer (Linux, no Apple frameworks)
+// Same logging macros as support/LAUCaptureVideoPreviewLayer-Prefix.pch
+//
+
+#include <stdio.h>
+
+#ifdef DEBUG
+#define Logc(format, ...) printf((format "\n"), ## __VA_ARGS__)
+#define PrettyLogc printf("%s\n", __PRETTY_FUNCTION__)
+#else
+#define Logc(format, ...)
+#define PrettyLogc
+#endif
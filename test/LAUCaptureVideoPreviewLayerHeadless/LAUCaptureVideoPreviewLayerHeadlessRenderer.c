@@ -0,0 +1,1495 @@
+/*
+
+ LAUCaptureVideoPreviewLayerHeadlessRenderer.c
+ LAUCaptureVideoPreviewLayer Headless
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "LAUCaptureVideoPreviewLayerHeadlessRenderer.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "LAUCaptureVideoPreviewLayerUtilities.h"
+#include "LAUCaptureVideoPreviewLayerStructures.h"
+#include "LAUCaptureVideoPreviewLayerShaders.h"
+#include "LAUCaptureVideoPreviewLayerGaussianFilterKernel.h"
+#include "LAUCaptureVideoPreviewLayerShaderGenerator.h"
+#include "LAUCaptureVideoPreviewLayerRenderTargetPool.h"
+
+// Number of kernels kept in the kernel cache (same as kFilterKernelCacheCapacity)
+#define kHeadlessRendererKernelCacheCapacity 16
+
+// Largest blur filter program variant (same as kFilterKernelVariantMaxSamples)
+#define kHeadlessRendererVariantMaxSamples 14
+
+// Same as kFilterRenderTargetMemoryBudget
+#define kHeadlessRendererRenderTargetMemoryBudget (16 * 1024 * 1024)
+
+struct HeadlessRenderer {
+
+    // EGL
+    EGLDisplay display;
+    EGLContext context;
+
+    // Shader program and bindings
+    ProgramCache_t * programCache;
+    GLuint blurFilterProgram; // Current program
+    struct UniformHandles blurFilterUniforms;
+    struct AttributeHandles blurFilterAttributes;
+    ProgramInstance_t blurFilterProgramVariants[kHeadlessRendererVariantMaxSamples+1]; // Index is the number of kernel samples, none with custom shaders
+    unsigned int blurFilterProgramSamples; // Samples of the current variant
+    ProgramInstance_t blurFilterPrefilterProgramVariants[kHeadlessRendererVariantMaxSamples+1]; // First pass of each variant (FilterPrefilterEnabled)
+    bool prefilterEnabled;
+    bool kernelBankEnabled; // The variants are the kernel bank variants (FilterKernelBankEnabled)
+    bool intensityMapEnabled; // The variants are the intensity map variants (kernel bank with an intensity map)
+    ProgramInstance_t blurFilterProgramDts; // Discrete texture sampling program (loaded by headlessRendererSetFilterKernelType)
+    ProgramInstance_t blurFilterProgramBts; // Bts program (or variant) in use before switching to dts
+    GLuint defaultProgram;
+    struct UniformHandles defaultUniforms;
+    struct AttributeHandles defaultAttributes;
+    GLuint defaultYUVProgram; // Conversion of the 420 bi-planar planes (loaded by the first headlessRendererFilterYUVImage)
+    struct UniformHandles defaultYUVUniforms;
+    struct AttributeHandles defaultYUVAttributes;
+    GLuint vertexBuffer;
+
+    // Input frame (pixel buffer) and offscreen ping-pong textures
+    RenderTargetPool_t * renderTargetPool;
+    TextureInstance_t inputTextureInstance;
+    GLsizei inputTextureWidth;
+    GLsizei inputTextureHeight;
+    TextureInstance_t offscreenTextureInstances[2];
+
+    // Intensity map of the frame (texture unit 2, see headlessRendererSetIntensityMap)
+    TextureInstance_t intensityMapTextureInstance;
+    GLsizei intensityMapTextureWidth;
+    GLsizei intensityMapTextureHeight;
+
+    // 420 bi-planar input frame (luma and chroma planes) and chroma ping-pong textures, the luma plane uses offscreenTextureInstances
+    TextureInstance_t inputLumaTextureInstance;
+    GLsizei inputLumaTextureWidth;
+    GLsizei inputLumaTextureHeight;
+    TextureInstance_t inputChromaTextureInstance;
+    GLsizei inputChromaTextureWidth;
+    GLsizei inputChromaTextureHeight;
+    TextureInstance_t offscreenChromaTextureInstances[2];
+    TextureInstance_t convertedTextureInstance; // Conversion pass of the offscreen output (filtered luma dimensions)
+
+    // Onscreen renderbuffer (a view sized texture), vertices are loaded for the texture dimensions of onscreenVertexBuffer
+    HeadlessRendererOutput_t output;
+    TextureInstance_t onscreenTextureInstance;
+    GLuint onscreenVertexBuffer;
+    GLfloat onscreenVertexBufferTextureWidth;
+    GLfloat onscreenVertexBufferTextureHeight;
+
+    // Filter (Kernel)
+    GaussianFilterKernelType_t filterKernelType;
+    GaussianFilterKernelParameters_t filterKernelParameters;
+    GaussianFilterKernelCache_t * filterKernelCache;
+    float filterKernelStep;
+    unsigned int filterKernelRadius; // Radius of the kernel in use (scissor margin of the filter regions)
+    bool filterIntensityNeedsUpdate;
+
+    // Filter (Parameters)
+    GLfloat filterSplitPassDirectionVector[2];
+    GLfloat filterKernelOffsetScale; // 1, 0.5 for the chroma plane (half resolution texels, same blur radius in view pixels)
+    GLuint filterMultiplePassCount;
+    GLfloat filterDownsamplingFactor;
+    
+    // Filter (Regions), only used by the onscreen outputs
+    FilterRegions_t filterRegions;
+
+    // Stage timings of headlessRendererFilterImage (optional)
+    FrameTimings_t * frameTimings;
+};
+
+#pragma mark -
+#pragma mark EGL context
+
+static bool createHeadlessContext(HeadlessRenderer_t * renderer)
+{
+    // Surfaceless platform (Mesa), no window system or pbuffer needed
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    renderer->display = getPlatformDisplay ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL) : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    if (renderer->display == EGL_NO_DISPLAY || !eglInitialize(renderer->display, NULL, NULL))
+    {
+        fprintf(stderr, "HeadlessRenderer: Can't initialize EGL display (0x%x)\n", eglGetError());
+        return false;
+    }
+
+    EGLint configAttributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT, EGL_NONE};
+    EGLConfig config;
+    EGLint configCount = 0;
+    eglChooseConfig(renderer->display, configAttributes, &config, 1, &configCount);
+
+    eglBindAPI(EGL_OPENGL_ES_API);
+
+    EGLint contextAttributes[] = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
+    renderer->context = eglCreateContext(renderer->display, configCount ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttributes);
+
+    if (renderer->context == EGL_NO_CONTEXT || !eglMakeCurrent(renderer->display, EGL_NO_SURFACE, EGL_NO_SURFACE, renderer->context))
+    {
+        fprintf(stderr, "HeadlessRenderer: Can't create surfaceless OpenGL ES 2.0 context (0x%x)\n", eglGetError());
+        return false;
+    }
+
+    return true;
+}
+
+#pragma mark -
+#pragma mark Memory management
+
+static bool loadBlurFilterProgramInstance(HeadlessRenderer_t * renderer, const char * vertexShaderSource, const char * fragmentShaderSource, ProgramInstance_t * programInstance)
+{
+    // Load blur filter program, same bindings as loadBlurFilterProgram
+    programInstance->program = programCacheLoadProgram(renderer->programCache, vertexShaderSource, fragmentShaderSource);
+
+    if (!programInstance->program)
+    {
+        return false;
+    }
+
+    validateProgram(programInstance->program);
+
+    programInstance->attributes.VertPosition = glGetAttribLocation(programInstance->program, "VertPosition");
+    programInstance->attributes.VertTextureCoordinate = glGetAttribLocation(programInstance->program, "VertTextureCoordinate");
+
+    programInstance->uniforms.FragTextureData = glGetUniformLocation(programInstance->program, "FragTextureData");
+    programInstance->uniforms.FilterKernelSamples = glGetUniformLocation(programInstance->program, "FilterKernelSamples");
+    programInstance->uniforms.VertFilterKernelOffsets = glGetUniformLocation(programInstance->program, "VertFilterKernelOffsets");
+    programInstance->uniforms.FragFilterKernelWeights = glGetUniformLocation(programInstance->program, "FragFilterKernelWeights");
+    programInstance->uniforms.FilterSplitPassDirectionVector = glGetUniformLocation(programInstance->program, "FilterSplitPassDirectionVector");
+    programInstance->uniforms.FragFilterKernelRadius = glGetUniformLocation(programInstance->program, "FragFilterKernelRadius");
+    programInstance->uniforms.FragFilterKernelSize = glGetUniformLocation(programInstance->program, "FragFilterKernelSize");
+    programInstance->uniforms.FilterPrefilterOffset = glGetUniformLocation(programInstance->program, "FilterPrefilterOffset");
+    programInstance->uniforms.VertFilterKernelBankOffsets = glGetUniformLocation(programInstance->program, "VertFilterKernelBankOffsets");
+    programInstance->uniforms.FragFilterKernelBankWeights = glGetUniformLocation(programInstance->program, "FragFilterKernelBankWeights");
+    programInstance->uniforms.FilterKernelBankPosition = glGetUniformLocation(programInstance->program, "FilterKernelBankPosition");
+    programInstance->uniforms.FragFilterIntensityMap = glGetUniformLocation(programInstance->program, "FragFilterIntensityMap");
+
+    glUseProgram(programInstance->program);
+    glUniform1i(programInstance->uniforms.FragTextureData, 0);
+    glUniform1i(programInstance->uniforms.FragFilterIntensityMap, 2);
+
+    return true;
+}
+
+static void useBlurFilterProgramInstance(HeadlessRenderer_t * renderer, const ProgramInstance_t * programInstance)
+{
+    renderer->blurFilterProgram = programInstance->program;
+    renderer->blurFilterUniforms = programInstance->uniforms;
+    renderer->blurFilterAttributes = programInstance->attributes;
+
+    glUseProgram(renderer->blurFilterProgram);
+}
+
+static void loadBlurFilterProgramVariants(HeadlessRenderer_t * renderer)
+{
+    // Same as loadBlurFilterProgram (FilterKernelVariantsEnabled)
+    GLint maxVaryingVectors = kBtsBlurFilterShaderMinVaryingVectors;
+    glGetIntegerv(GL_MAX_VARYING_VECTORS, &maxVaryingVectors);
+
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+    unsigned int maxSamples = btsGaussianFilterMaxSamples(parameters);
+    const ProgramInstance_t * firstProgramInstance = NULL;
+
+    // Same as loadFilterKernelBank (FilterKernelBankEnabled), uploaded once to every variant
+    unsigned int bankStride = btsGaussianFilterKernelBankStride(parameters);
+    float bankOffsets[parameters->kernelCount * bankStride], bankWeights[parameters->kernelCount * bankStride];
+    if (renderer->kernelBankEnabled)
+    {
+        btsGaussianFilterKernelBank(parameters, bankOffsets, bankWeights);
+    }
+
+    for (unsigned int samples = 1; samples <= maxSamples && samples <= kHeadlessRendererVariantMaxSamples; ++samples)
+    {
+        char * vertexShaderSource = NULL;
+        char * fragmentShaderSources[2] = {NULL, NULL};
+
+        if (renderer->intensityMapEnabled)
+        {
+            // Same as loadFilterIntensityMapProgramVariants, the kernel of each fragment is read in the fragment shader
+            vertexShaderSource = strdup(VertexShaderSourceDefault);
+            fragmentShaderSources[0] = createBtsIntensityMapBlurFilterFragmentShaderSource(samples, parameters->kernelCount, maxSamples, false);
+            fragmentShaderSources[1] = createBtsIntensityMapBlurFilterFragmentShaderSource(samples, parameters->kernelCount, maxSamples, true);
+        }
+        else if (renderer->kernelBankEnabled)
+        {
+            vertexShaderSource = createBtsKernelBankBlurFilterVertexShaderSource(samples, maxVaryingVectors, parameters->kernelCount, maxSamples);
+            fragmentShaderSources[0] = createBtsKernelBankBlurFilterFragmentShaderSource(samples, maxVaryingVectors, parameters->kernelCount, maxSamples, false);
+            fragmentShaderSources[1] = createBtsKernelBankBlurFilterFragmentShaderSource(samples, maxVaryingVectors, parameters->kernelCount, maxSamples, true);
+        }
+        else
+        {
+            vertexShaderSource = createBtsBlurFilterVertexShaderSource(samples, maxVaryingVectors);
+            fragmentShaderSources[0] = createBtsBlurFilterFragmentShaderSource(samples, maxVaryingVectors);
+            fragmentShaderSources[1] = createBtsPrefilterBlurFilterFragmentShaderSource(samples, maxVaryingVectors);
+        }
+
+        ProgramInstance_t * programInstances[2] = {&renderer->blurFilterProgramVariants[samples], &renderer->blurFilterPrefilterProgramVariants[samples]};
+
+        for (int i = 0; i < 2; ++i)
+        {
+            if (vertexShaderSource && fragmentShaderSources[i] && loadBlurFilterProgramInstance(renderer, vertexShaderSource, fragmentShaderSources[i], programInstances[i]))
+            {
+                // The vertex buffer is shared by all variants
+                firstProgramInstance = firstProgramInstance ? firstProgramInstance : programInstances[i];
+
+                if (programInstances[i]->attributes.VertPosition != firstProgramInstance->attributes.VertPosition ||
+                    programInstances[i]->attributes.VertTextureCoordinate != firstProgramInstance->attributes.VertTextureCoordinate)
+                {
+                    unloadProgram(&programInstances[i]->program);
+                }
+                else if (renderer->kernelBankEnabled)
+                {
+                    GLsizei vectorCount = parameters->kernelCount * bankStride / 4;
+                    glUniform4fv(programInstances[i]->uniforms.VertFilterKernelBankOffsets, vectorCount, bankOffsets);
+                    glUniform4fv(programInstances[i]->uniforms.FragFilterKernelBankWeights, vectorCount, bankWeights);
+                }
+            }
+
+            free(fragmentShaderSources[i]);
+        }
+
+        free(vertexShaderSource);
+    }
+}
+
+static void useBlurFilterProgramVariantForSamples(HeadlessRenderer_t * renderer, unsigned int samples)
+{
+    // Smallest variant with enough samples (extra samples have zero weights)
+    for (unsigned int variantSamples = samples; variantSamples <= kHeadlessRendererVariantMaxSamples; ++variantSamples)
+    {
+        const ProgramInstance_t * programInstance = &renderer->blurFilterProgramVariants[variantSamples];
+
+        if (programInstance->program)
+        {
+            if (variantSamples != renderer->blurFilterProgramSamples)
+            {
+                useBlurFilterProgramInstance(renderer, programInstance);
+                renderer->blurFilterProgramSamples = variantSamples;
+            }
+
+            return;
+        }
+    }
+}
+
+static void unloadBlurFilterProgramVariants(HeadlessRenderer_t * renderer)
+{
+    for (unsigned int samples = 0; samples <= kHeadlessRendererVariantMaxSamples; ++samples)
+    {
+        unloadProgram(&renderer->blurFilterProgramVariants[samples].program);
+        unloadProgram(&renderer->blurFilterPrefilterProgramVariants[samples].program);
+    }
+
+    renderer->blurFilterProgram = 0;
+    renderer->blurFilterProgramSamples = 0;
+}
+
+static void loadVertexBuffer(HeadlessRenderer_t * renderer)
+{
+    // Same quad as loadOffscreenTextureInstance:
+    static const VertexData_t vertexData[] = {
+        {{-1.0f, -1.0f}, {0.0f, 0.0f}}, // bottom left
+        {{ 1.0f, -1.0f}, {1.0f, 0.0f}}, // bottom right
+        {{-1.0f,  1.0f}, {0.0f, 1.0f}}, // top left
+        {{ 1.0f,  1.0f}, {1.0f, 1.0f}}, // top right
+    };
+
+    glGenBuffers(1, &renderer->vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, renderer->vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData, GL_STATIC_DRAW);
+}
+
+static void bindVertexBuffer(GLuint vertexBuffer, const struct AttributeHandles * attributes)
+{
+    static const GLsizei stride = sizeof(VertexData_t);
+
+    // No VAO in plain ES 2.0, the attributes are set again when the VBO changes
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glEnableVertexAttribArray(attributes->VertPosition);
+    glVertexAttribPointer(attributes->VertPosition, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid *)offsetof(VertexData_t, position));
+    glEnableVertexAttribArray(attributes->VertTextureCoordinate);
+    glVertexAttribPointer(attributes->VertTextureCoordinate, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid *)offsetof(VertexData_t, textureCoordinate));
+}
+
+static void loadDefaultProgram(HeadlessRenderer_t * renderer)
+{
+    // Same as loadDefaultProgram
+    renderer->defaultProgram = programCacheLoadProgram(renderer->programCache, VertexShaderSourceDefault, FragmentShaderSourceDefault);
+    validateProgram(renderer->defaultProgram);
+
+    renderer->defaultAttributes.VertPosition = glGetAttribLocation(renderer->defaultProgram, "VertPosition");
+    renderer->defaultAttributes.VertTextureCoordinate = glGetAttribLocation(renderer->defaultProgram, "VertTextureCoordinate");
+    renderer->defaultUniforms.FragTextureData = glGetUniformLocation(renderer->defaultProgram, "FragTextureData");
+
+    glUseProgram(renderer->defaultProgram);
+    glUniform1i(renderer->defaultUniforms.FragTextureData, 0);
+}
+
+static bool loadDefaultYUVProgram(HeadlessRenderer_t * renderer)
+{
+    // Same as loadDefaultYUVProgram, luma on texture unit 0 and chroma on texture unit 1
+    renderer->defaultYUVProgram = programCacheLoadProgram(renderer->programCache, VertexShaderSourceDefault, FragmentShaderSourceDefaultYUV);
+
+    if (!renderer->defaultYUVProgram)
+    {
+        return false;
+    }
+
+    validateProgram(renderer->defaultYUVProgram);
+
+    renderer->defaultYUVAttributes.VertPosition = glGetAttribLocation(renderer->defaultYUVProgram, "VertPosition");
+    renderer->defaultYUVAttributes.VertTextureCoordinate = glGetAttribLocation(renderer->defaultYUVProgram, "VertTextureCoordinate");
+    renderer->defaultYUVUniforms.FragTextureData = glGetUniformLocation(renderer->defaultYUVProgram, "FragTextureData");
+    renderer->defaultYUVUniforms.FragChromaTextureData = glGetUniformLocation(renderer->defaultYUVProgram, "FragChromaTextureData");
+
+    glUseProgram(renderer->defaultYUVProgram);
+    glUniform1i(renderer->defaultYUVUniforms.FragTextureData, 0);
+    glUniform1i(renderer->defaultYUVUniforms.FragChromaTextureData, 1);
+
+    return true;
+}
+
+HeadlessRenderer_t * createHeadlessRenderer(const char * vertexShaderSource, const char * fragmentShaderSource, const char * programCacheDirectoryPath)
+{
+    HeadlessRenderer_t * renderer = calloc(1, sizeof(HeadlessRenderer_t));
+
+    if (!renderer || !createHeadlessContext(renderer))
+    {
+        releaseHeadlessRenderer(renderer);
+        return NULL;
+    }
+
+    // Extension functions aren't exported by libGLESv2
+    renderer->programCache = createProgramCache(programCacheDirectoryPath);
+    programCacheSetBinaryFunctions(renderer->programCache,
+                                   (ProgramCacheGetProgramBinaryFunction)eglGetProcAddress("glGetProgramBinaryOES"),
+                                   (ProgramCacheProgramBinaryFunction)eglGetProcAddress("glProgramBinaryOES"));
+
+    // Default shaders are generated for each number of kernel samples
+    if (!vertexShaderSource && !fragmentShaderSource)
+    {
+        loadBlurFilterProgramVariants(renderer);
+        useBlurFilterProgramVariantForSamples(renderer, 1);
+    }
+
+    if (!renderer->blurFilterProgram)
+    {
+        ProgramInstance_t programInstance;
+        loadBlurFilterProgramInstance(renderer,
+                                      vertexShaderSource ? vertexShaderSource : VertexShaderSourceBlurFilterBts,
+                                      fragmentShaderSource ? fragmentShaderSource : FragmentShaderSourceBlurFilterBts,
+                                      &programInstance);
+        useBlurFilterProgramInstance(renderer, &programInstance);
+    }
+
+    loadDefaultProgram(renderer);
+    loadVertexBuffer(renderer);
+    renderer->renderTargetPool = createRenderTargetPool(kHeadlessRendererRenderTargetMemoryBudget);
+
+    glDisable(GL_DEPTH_TEST);
+    glActiveTexture(GL_TEXTURE0);
+
+    // Same as loadFilter (bts, continuous intensity)
+    renderer->filterKernelType = GaussianFilterKernelTypeBts;
+    renderer->filterKernelParameters = kBtsGaussianFilterKernelDefaultParameters;
+    renderer->filterKernelCache = createGaussianFilterKernelCache(&renderer->filterKernelParameters, GaussianFilterKernelTypeBts, kHeadlessRendererKernelCacheCapacity);
+    renderer->filterKernelStep = -1.0f;
+    renderer->filterDownsamplingFactor = 4.0f;
+    renderer->filterKernelOffsetScale = 1.0f;
+    renderer->filterMultiplePassCount = 2;
+    renderer->prefilterEnabled = true;
+
+    headlessRendererSetFilterIntensity(renderer, 1.0f);
+
+    return renderer;
+}
+
+static void releaseTextureInstance(TextureInstance_t * textureInstance)
+{
+    if (textureInstance->framebuffer)
+    {
+        glDeleteFramebuffers(1, &textureInstance->framebuffer);
+    }
+
+    if (textureInstance->textureName)
+    {
+        glDeleteTextures(1, &textureInstance->textureName);
+    }
+
+    memset(textureInstance, 0, sizeof(TextureInstance_t));
+}
+
+void releaseHeadlessRenderer(HeadlessRenderer_t * renderer)
+{
+    if (!renderer)
+    {
+        return;
+    }
+
+    if (renderer->context != EGL_NO_CONTEXT && renderer->context)
+    {
+        releaseTextureInstance(&renderer->inputTextureInstance);
+        releaseTextureInstance(&renderer->inputLumaTextureInstance);
+        releaseTextureInstance(&renderer->inputChromaTextureInstance);
+        releaseTextureInstance(&renderer->intensityMapTextureInstance);
+        releaseRenderTargetPool(renderer->renderTargetPool);
+        glDeleteBuffers(1, &renderer->vertexBuffer);
+        glDeleteBuffers(1, &renderer->onscreenVertexBuffer);
+        unloadProgram(&renderer->defaultProgram);
+        unloadProgram(&renderer->defaultYUVProgram);
+        unloadProgram(&renderer->blurFilterProgramDts.program);
+        if (renderer->filterKernelType == GaussianFilterKernelTypeDts)
+        {
+            renderer->blurFilterProgram = renderer->blurFilterProgramBts.program;
+        }
+
+        if (!renderer->blurFilterProgramSamples)
+        {
+            unloadProgram(&renderer->blurFilterProgram);
+        }
+
+        unloadBlurFilterProgramVariants(renderer);
+
+        eglMakeCurrent(renderer->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(renderer->display, renderer->context);
+    }
+
+    if (renderer->display && renderer->display != EGL_NO_DISPLAY)
+    {
+        eglTerminate(renderer->display);
+    }
+
+    releaseGaussianFilterKernelCache(renderer->filterKernelCache);
+    releaseProgramCache(renderer->programCache);
+    free(renderer);
+}
+
+const char * headlessRendererName(const HeadlessRenderer_t * renderer)
+{
+    (void)renderer; // The context of the renderer is current
+    return (const char *)glGetString(GL_RENDERER);
+}
+
+unsigned int headlessRendererProgramSamples(const HeadlessRenderer_t * renderer)
+{
+    if (renderer->filterKernelType == GaussianFilterKernelTypeDts)
+    {
+        return 0;
+    }
+
+    return renderer->blurFilterProgramSamples;
+}
+
+void headlessRendererRenderTargetPoolStatistics(const HeadlessRenderer_t * renderer, RenderTargetPoolStatistics_t * statistics)
+{
+    renderTargetPoolStatistics(renderer->renderTargetPool, statistics);
+}
+
+void headlessRendererProgramCacheStatistics(const HeadlessRenderer_t * renderer, ProgramCacheStatistics_t * statistics)
+{
+    programCacheStatistics(renderer->programCache, statistics);
+}
+
+static void uploadTexture(TextureInstance_t * textureInstance, GLsizei * textureWidth, GLsizei * textureHeight, GLenum format, size_t bytesPerPixel,
+                          const uint8_t * data, size_t width, size_t height, size_t bytesPerRow)
+{
+    if (!textureInstance->textureName)
+    {
+        glGenTextures(1, &textureInstance->textureName);
+        textureInstance->textureTarget = GL_TEXTURE_2D;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, textureInstance->textureName);
+
+    // Rows are uploaded one by one if they are padded (no GL_UNPACK_ROW_LENGTH in ES 2.0)
+    if (*textureWidth != (GLsizei)width || *textureHeight != (GLsizei)height)
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, format, (GLsizei)width, (GLsizei)height, 0, format, GL_UNSIGNED_BYTE, NULL);
+        *textureWidth = (GLsizei)width;
+        *textureHeight = (GLsizei)height;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, (bytesPerPixel == 4) ? 4 : 1);
+
+    if (bytesPerRow == width * bytesPerPixel)
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, (GLsizei)width, (GLsizei)height, format, GL_UNSIGNED_BYTE, data);
+    }
+    else
+    {
+        for (size_t y = 0; y < height; ++y)
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, (GLint)y, (GLsizei)width, 1, format, GL_UNSIGNED_BYTE, data + y * bytesPerRow);
+        }
+    }
+}
+
+#pragma mark -
+#pragma mark Filter
+
+void headlessRendererSetFilterIntensity(HeadlessRenderer_t * renderer, float intensity)
+{
+    float filterKernelStep = fmaxf(0.0f, fminf(1.0f, intensity));
+
+    // Uniforms are only uploaded if the kernel actually changed
+    if (filterKernelStep != renderer->filterKernelStep)
+    {
+        renderer->filterKernelStep = filterKernelStep;
+        renderer->filterIntensityNeedsUpdate = true;
+    }
+}
+
+bool headlessRendererSetFilterKernelType(HeadlessRenderer_t * renderer, GaussianFilterKernelType_t type)
+{
+    if (type == renderer->filterKernelType)
+    {
+        return true;
+    }
+
+    if (type == GaussianFilterKernelTypeDts)
+    {
+        // Same program as loadBlurFilterProgram (!FilterBilinearTextureSamplingEnabled)
+        if (!renderer->blurFilterProgramDts.program &&
+            !loadBlurFilterProgramInstance(renderer, VertexShaderSourceDefault, FragmentShaderSourceBlurFilterDts, &renderer->blurFilterProgramDts))
+        {
+            return false;
+        }
+
+        // The variant in use is restored when switching back to bts (blurFilterProgramSamples is kept)
+        renderer->blurFilterProgramBts.program = renderer->blurFilterProgram;
+        renderer->blurFilterProgramBts.uniforms = renderer->blurFilterUniforms;
+        renderer->blurFilterProgramBts.attributes = renderer->blurFilterAttributes;
+        useBlurFilterProgramInstance(renderer, &renderer->blurFilterProgramDts);
+        renderer->filterKernelParameters = kDtsGaussianFilterKernelDefaultParameters;
+    }
+    else
+    {
+        useBlurFilterProgramInstance(renderer, &renderer->blurFilterProgramBts);
+        renderer->filterKernelParameters = kBtsGaussianFilterKernelDefaultParameters;
+    }
+
+    releaseGaussianFilterKernelCache(renderer->filterKernelCache);
+    renderer->filterKernelCache = createGaussianFilterKernelCache(&renderer->filterKernelParameters, type, kHeadlessRendererKernelCacheCapacity);
+    renderer->filterKernelType = type;
+    renderer->filterIntensityNeedsUpdate = true;
+
+    return true;
+}
+
+const GaussianFilterKernelParameters_t * headlessRendererFilterKernelParameters(const HeadlessRenderer_t * renderer)
+{
+    return &renderer->filterKernelParameters;
+}
+
+void headlessRendererSetFilterParameters(HeadlessRenderer_t * renderer, float downsamplingFactor, unsigned int multiplePassCount)
+{
+    if (downsamplingFactor > 0.0f)
+    {
+        renderer->filterDownsamplingFactor = downsamplingFactor;
+    }
+
+    if (multiplePassCount > 0)
+    {
+        renderer->filterMultiplePassCount = multiplePassCount;
+    }
+}
+
+// Prefilter program of the variant in use, NULL if the first pass isn't prefiltered
+static const ProgramInstance_t * prefilterProgramInstance(const HeadlessRenderer_t * renderer)
+{
+    if (!renderer->prefilterEnabled || renderer->filterKernelType != GaussianFilterKernelTypeBts || !renderer->blurFilterProgramSamples)
+    {
+        return NULL;
+    }
+
+    const ProgramInstance_t * programInstance = &renderer->blurFilterPrefilterProgramVariants[renderer->blurFilterProgramSamples];
+    return programInstance->program ? programInstance : NULL;
+}
+
+void headlessRendererSetPrefilterEnabled(HeadlessRenderer_t * renderer, bool prefilterEnabled)
+{
+    renderer->prefilterEnabled = prefilterEnabled;
+}
+
+bool headlessRendererPrefilterEnabled(const HeadlessRenderer_t * renderer)
+{
+    return prefilterProgramInstance(renderer) != NULL;
+}
+
+bool headlessRendererSetKernelBankEnabled(HeadlessRenderer_t * renderer, bool kernelBankEnabled)
+{
+    if (kernelBankEnabled == renderer->kernelBankEnabled)
+    {
+        return true;
+    }
+
+    // Only the generated bts variants have a kernel bank
+    if (renderer->filterKernelType != GaussianFilterKernelTypeBts || !renderer->blurFilterProgramSamples)
+    {
+        return false;
+    }
+
+    if (kernelBankEnabled)
+    {
+        GLint maxVertexUniformVectors = 0, maxFragmentUniformVectors = 0;
+        glGetIntegerv(GL_MAX_VERTEX_UNIFORM_VECTORS, &maxVertexUniformVectors);
+        glGetIntegerv(GL_MAX_FRAGMENT_UNIFORM_VECTORS, &maxFragmentUniformVectors);
+
+        const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+        if (!btsBlurFilterKernelBankFits(parameters->kernelCount, btsGaussianFilterMaxSamples(parameters), maxVertexUniformVectors, maxFragmentUniformVectors))
+        {
+            return false;
+        }
+    }
+
+    // Same variants, the kernels come from the bank or from the uniforms of each kernel (the intensity map needs the bank)
+    unloadBlurFilterProgramVariants(renderer);
+    renderer->kernelBankEnabled = kernelBankEnabled;
+    renderer->intensityMapEnabled = false;
+    loadBlurFilterProgramVariants(renderer);
+    useBlurFilterProgramVariantForSamples(renderer, 1);
+
+    if (!renderer->blurFilterProgram)
+    {
+        // Variants that don't link, back to the uniforms of each kernel
+        unloadBlurFilterProgramVariants(renderer);
+        renderer->kernelBankEnabled = false;
+        loadBlurFilterProgramVariants(renderer);
+        useBlurFilterProgramVariantForSamples(renderer, 1);
+        renderer->filterIntensityNeedsUpdate = true;
+        return !kernelBankEnabled;
+    }
+
+    renderer->filterIntensityNeedsUpdate = true;
+    return true;
+}
+
+bool headlessRendererKernelBankEnabled(const HeadlessRenderer_t * renderer)
+{
+    return renderer->kernelBankEnabled;
+}
+
+bool headlessRendererSetIntensityMap(HeadlessRenderer_t * renderer, const uint8_t * intensities, size_t width, size_t height, size_t bytesPerRow)
+{
+    bool intensityMapEnabled = intensities != NULL;
+
+    if (intensityMapEnabled)
+    {
+        if (!renderer->kernelBankEnabled || width == 0 || height == 0)
+        {
+            return false;
+        }
+
+        GLint maxFragmentUniformVectors = 0;
+        glGetIntegerv(GL_MAX_FRAGMENT_UNIFORM_VECTORS, &maxFragmentUniformVectors);
+
+        const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+        if (!btsBlurFilterIntensityMapFits(parameters->kernelCount, btsGaussianFilterMaxSamples(parameters), maxFragmentUniformVectors))
+        {
+            return false;
+        }
+
+        // Same as loadFilterIntensityMap, bound to texture unit 2 for all the passes
+        glActiveTexture(GL_TEXTURE2);
+        uploadTexture(&renderer->intensityMapTextureInstance, &renderer->intensityMapTextureWidth, &renderer->intensityMapTextureHeight, GL_LUMINANCE, 1,
+                      intensities, width, height, bytesPerRow);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    if (intensityMapEnabled == renderer->intensityMapEnabled)
+    {
+        return true;
+    }
+
+    // Same bank, the variants read the kernel of each fragment or of the whole frame
+    unloadBlurFilterProgramVariants(renderer);
+    renderer->intensityMapEnabled = intensityMapEnabled;
+    loadBlurFilterProgramVariants(renderer);
+    useBlurFilterProgramVariantForSamples(renderer, 1);
+
+    if (!renderer->blurFilterProgram)
+    {
+        // Variants that don't link, back to the kernel of the whole frame
+        unloadBlurFilterProgramVariants(renderer);
+        renderer->intensityMapEnabled = false;
+        loadBlurFilterProgramVariants(renderer);
+        useBlurFilterProgramVariantForSamples(renderer, 1);
+        renderer->filterIntensityNeedsUpdate = true;
+        return !intensityMapEnabled;
+    }
+
+    renderer->filterIntensityNeedsUpdate = true;
+    return true;
+}
+
+bool headlessRendererIntensityMapEnabled(const HeadlessRenderer_t * renderer)
+{
+    return renderer->intensityMapEnabled;
+}
+
+void headlessRendererSetFilterRegions(HeadlessRenderer_t * renderer, const FilterRegionRect_t * rects, size_t count)
+{
+    filterRegionsSetViewRects(&renderer->filterRegions, rects, count);
+}
+
+static void updateBlurFilterProgramUniforms(HeadlessRenderer_t * renderer)
+{
+    if (renderer->filterIntensityNeedsUpdate && renderer->filterKernelType == GaussianFilterKernelTypeDts)
+    {
+        // Same as updateBlurFilterProgramUniforms (!FilterBilinearTextureSamplingEnabled)
+        const GaussianFilterKernel_t * filterKernel = gaussianFilterKernelCacheKernelForStep(renderer->filterKernelCache, renderer->filterKernelStep);
+
+        glUniform1i(renderer->blurFilterUniforms.FragFilterKernelRadius, filterKernel->radius);
+        glUniform1i(renderer->blurFilterUniforms.FragFilterKernelSize, filterKernel->size);
+        glUniform1fv(renderer->blurFilterUniforms.FragFilterKernelWeights, filterKernel->size, filterKernel->weights);
+
+        renderer->filterKernelRadius = filterKernel->radius;
+        renderer->filterIntensityNeedsUpdate = false;
+    }
+
+    if (renderer->filterIntensityNeedsUpdate && renderer->kernelBankEnabled)
+    {
+        // Same as updateBlurFilterProgramUniforms (FilterKernelBankEnabled), one float
+        float position = gaussianFilterKernelBankPositionForStep(&renderer->filterKernelParameters, renderer->filterKernelStep);
+        unsigned int size = gaussianFilterKernelBankSizeForPosition(&renderer->filterKernelParameters, position);
+
+        useBlurFilterProgramVariantForSamples(renderer, btsGaussianFilterSamplesForSize(size));
+        glUniform1f(renderer->blurFilterUniforms.FilterKernelBankPosition, position);
+
+        const ProgramInstance_t * prefilterInstance = prefilterProgramInstance(renderer);
+        if (prefilterInstance)
+        {
+            glUseProgram(prefilterInstance->program);
+            glUniform1f(prefilterInstance->uniforms.FilterKernelBankPosition, position);
+            glUseProgram(renderer->blurFilterProgram);
+        }
+
+        renderer->filterKernelRadius = gaussianFilterRadiusForSize(size);
+        renderer->filterIntensityNeedsUpdate = false;
+    }
+
+    if (renderer->filterIntensityNeedsUpdate)
+    {
+        const GaussianFilterKernel_t * filterKernel = gaussianFilterKernelCacheKernelForStep(renderer->filterKernelCache, renderer->filterKernelStep);
+        unsigned int samples = filterKernel->samples;
+
+        if (renderer->blurFilterProgramSamples)
+        {
+            // Same as updateBlurFilterProgramUniforms (FilterKernelVariantsEnabled)
+            useBlurFilterProgramVariantForSamples(renderer, btsGaussianFilterSamplesForSize(filterKernel->size));
+            samples = renderer->blurFilterProgramSamples;
+        }
+
+        glUniform1i(renderer->blurFilterUniforms.FilterKernelSamples, samples);
+        glUniform1fv(renderer->blurFilterUniforms.VertFilterKernelOffsets, samples, filterKernel->offsets);
+        glUniform1fv(renderer->blurFilterUniforms.FragFilterKernelWeights, samples, filterKernel->weights);
+
+        // Same kernel in the prefilter program of the variant
+        const ProgramInstance_t * prefilterInstance = prefilterProgramInstance(renderer);
+        if (prefilterInstance)
+        {
+            glUseProgram(prefilterInstance->program);
+            glUniform1fv(prefilterInstance->uniforms.VertFilterKernelOffsets, samples, filterKernel->offsets);
+            glUniform1fv(prefilterInstance->uniforms.FragFilterKernelWeights, samples, filterKernel->weights);
+            glUseProgram(renderer->blurFilterProgram);
+        }
+
+        renderer->filterKernelRadius = filterKernel->radius;
+        renderer->filterIntensityNeedsUpdate = false;
+    }
+}
+
+#pragma mark -
+#pragma mark Offscreen rendering
+
+// Same as scaleDownPixelBufferTextureInstanceDimensions
+static void scaledDownDimensions(float downsamplingFactor, float inputWidth, float inputHeight, float viewWidth, float viewHeight, float * scaledWidth, float * scaledHeight)
+{
+    float textureDownsamplingFactor;
+    float inputRatio = inputWidth / inputHeight;
+    float viewRatio = viewHeight / viewWidth;
+
+    if (viewRatio > inputRatio)
+    {
+        textureDownsamplingFactor = inputWidth / (viewHeight / downsamplingFactor);
+    }
+    else
+    {
+        textureDownsamplingFactor = inputHeight / (viewWidth / downsamplingFactor);
+    }
+
+    *scaledWidth = inputWidth / textureDownsamplingFactor;
+    *scaledHeight = inputHeight / textureDownsamplingFactor;
+}
+
+void headlessRendererSetOutput(HeadlessRenderer_t * renderer, HeadlessRendererOutput_t output)
+{
+    renderer->output = output;
+}
+
+void headlessRendererOutputDimensions(const HeadlessRenderer_t * renderer, size_t inputWidth, size_t inputHeight, size_t viewWidth, size_t viewHeight, size_t * outputWidth, size_t * outputHeight)
+{
+    if (renderer->output != HeadlessRendererOutputOffscreen)
+    {
+        *outputWidth = viewWidth;
+        *outputHeight = viewHeight;
+        return;
+    }
+
+    float scaledWidth, scaledHeight;
+    scaledDownDimensions(renderer->filterDownsamplingFactor, inputWidth, inputHeight, viewWidth, viewHeight, &scaledWidth, &scaledHeight);
+
+    // glTexImage2D/glViewport truncate the float texture dimensions
+    *outputWidth = (size_t)scaledWidth;
+    *outputHeight = (size_t)scaledHeight;
+}
+
+static bool loadOffscreenTextureInstance(HeadlessRenderer_t * renderer, TextureInstance_t * offscreenTextureInstance)
+{
+    // Same as createFramebufferForOffscreenTextureInstance: (the previous target goes back to the pool)
+    offscreenTextureInstance->primitiveType = GL_TRIANGLE_STRIP;
+    offscreenTextureInstance->vertexCount = 4;
+
+    return renderTargetPoolAcquireTextureInstance(renderer->renderTargetPool, offscreenTextureInstance, offscreenTextureInstance->textureWidth, offscreenTextureInstance->textureHeight, GL_RGBA);
+}
+
+static void setFilterSplitPassDirectionVector(HeadlessRenderer_t * renderer, TextureInstance_t * textureInstance)
+{
+    // Switch the previous vector (x, y, x, y...)
+    if (renderer->filterSplitPassDirectionVector[0] == 0)
+    {
+        renderer->filterSplitPassDirectionVector[0] = 1;
+        renderer->filterSplitPassDirectionVector[1] = 0;
+    }
+    else
+    {
+        renderer->filterSplitPassDirectionVector[0] = 0;
+        renderer->filterSplitPassDirectionVector[1] = 1;
+    }
+
+    GLfloat scale = renderer->filterKernelOffsetScale;
+    glUniform2f(renderer->blurFilterUniforms.FilterSplitPassDirectionVector, scale*renderer->filterSplitPassDirectionVector[0]/textureInstance->textureWidth, scale*renderer->filterSplitPassDirectionVector[1]/textureInstance->textureHeight);
+}
+
+// Same as drawOffscreenTextureInstanceInFilterRegions:, NULL regions draw the whole texture
+static void drawTextureInstanceInFilterRegions(HeadlessRenderer_t * renderer, const TextureInstance_t * destTextureInstance, const FilterRegions_t * regions, unsigned int remainingPassCount)
+{
+    if (!regions || regions->count == 0)
+    {
+        glDrawArrays(destTextureInstance->primitiveType, 0, destTextureInstance->vertexCount);
+        return;
+    }
+    
+    float margin = filterRegionsPassMargin(remainingPassCount, renderer->filterKernelRadius);
+    
+    glEnable(GL_SCISSOR_TEST);
+    
+    for (size_t i = 0; i < regions->count; ++i)
+    {
+        FilterRegionBox_t box = filterRegionsTextureBox(regions, i, destTextureInstance->textureWidth, destTextureInstance->textureHeight, margin);
+        
+        if (box.width > 0 && box.height > 0)
+        {
+            glScissor(box.x, box.y, box.width, box.height);
+            glDrawArrays(destTextureInstance->primitiveType, 0, destTextureInstance->vertexCount);
+        }
+    }
+    
+    glDisable(GL_SCISSOR_TEST);
+}
+
+static bool drawOffscreenTextureInstance(HeadlessRenderer_t * renderer, TextureInstance_t * srcTextureInstance, TextureInstance_t * destTextureInstance,
+                                         const FilterRegions_t * regions, unsigned int remainingPassCount)
+{
+    // Same as drawOffscreenTextureInstance:onOffscreenTextureInstance:
+    GLfloat width = srcTextureInstance->textureWidth;
+    GLfloat height = srcTextureInstance->textureHeight;
+
+    if (destTextureInstance->textureWidth != width || destTextureInstance->textureHeight != height || !destTextureInstance->framebuffer)
+    {
+        destTextureInstance->textureWidth = width;
+        destTextureInstance->textureHeight = height;
+
+        if (!loadOffscreenTextureInstance(renderer, destTextureInstance))
+        {
+            return false;
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, destTextureInstance->framebuffer);
+    glViewport(0, 0, destTextureInstance->textureWidth, destTextureInstance->textureHeight);
+
+    glBindTexture(srcTextureInstance->textureTarget, srcTextureInstance->textureName);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    setFilterSplitPassDirectionVector(renderer, destTextureInstance);
+
+    drawTextureInstanceInFilterRegions(renderer, destTextureInstance, regions, remainingPassCount);
+
+    return true;
+}
+
+// Same as drawPrefilteredOffscreenTextureInstance:onOffscreenTextureInstance: (first pass)
+static bool drawPrefilteredOffscreenTextureInstance(HeadlessRenderer_t * renderer, TextureInstance_t * srcTextureInstance, TextureInstance_t * destTextureInstance,
+                                                    const FilterRegions_t * regions, unsigned int remainingPassCount)
+{
+    const ProgramInstance_t * prefilterInstance = prefilterProgramInstance(renderer);
+
+    if (!prefilterInstance)
+    {
+        return drawOffscreenTextureInstance(renderer, srcTextureInstance, destTextureInstance, regions, remainingPassCount);
+    }
+
+    // The split-pass uniforms go to the prefilter program for this draw
+    GLuint blurFilterProgram = renderer->blurFilterProgram;
+    struct UniformHandles blurFilterUniforms = renderer->blurFilterUniforms;
+    renderer->blurFilterProgram = prefilterInstance->program;
+    renderer->blurFilterUniforms = prefilterInstance->uniforms;
+    glUseProgram(renderer->blurFilterProgram);
+
+    // A quarter of a destination texel (same dimensions as the scaled down source)
+    glUniform2f(renderer->blurFilterUniforms.FilterPrefilterOffset, 0.25f/srcTextureInstance->textureWidth, 0.25f/srcTextureInstance->textureHeight);
+
+    bool drawn = drawOffscreenTextureInstance(renderer, srcTextureInstance, destTextureInstance, regions, remainingPassCount);
+
+    renderer->blurFilterProgram = blurFilterProgram;
+    renderer->blurFilterUniforms = blurFilterUniforms;
+    glUseProgram(renderer->blurFilterProgram);
+
+    return drawn;
+}
+
+#pragma mark -
+#pragma mark Onscreen rendering
+
+static void loadOnscreenVertexBuffer(HeadlessRenderer_t * renderer, const TextureInstance_t * textureInstance, GLfloat viewWidth, GLfloat viewHeight)
+{
+    // Same as onscreenTextureCoordinatesOffsetsForTextureInstance: (landscape texture rotated 90 degrees, aspect-fill)
+    GLfloat textureWidth = textureInstance->textureWidth;
+    GLfloat textureHeight = textureInstance->textureHeight;
+    GLfloat textureScale = (textureWidth / textureHeight > viewHeight / viewWidth) ? viewWidth / textureHeight : viewHeight / textureWidth;
+    GLfloat deltaS = (textureWidth * textureScale - viewHeight) / (textureWidth * textureScale) / 2.0f;
+    GLfloat deltaT = (textureHeight * textureScale - viewWidth) / (textureHeight * textureScale) / 2.0f;
+
+    // Same vertices as loadOnscreenTextureInstance:forTextureInstance:attributes:
+    const VertexData_t vertexData[] = {
+        {{-1.0f, -1.0f}, {1.0f - deltaS, 1.0f - deltaT}}, // bottom left
+        {{ 1.0f, -1.0f}, {1.0f - deltaS, 0.0f + deltaT}}, // bottom right
+        {{-1.0f,  1.0f}, {0.0f + deltaS, 1.0f - deltaT}}, // top left
+        {{ 1.0f,  1.0f}, {0.0f + deltaS, 0.0f + deltaT}}, // top right
+    };
+
+    if (!renderer->onscreenVertexBuffer)
+    {
+        glGenBuffers(1, &renderer->onscreenVertexBuffer);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, renderer->onscreenVertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData, GL_STATIC_DRAW);
+
+    renderer->onscreenVertexBufferTextureWidth = textureWidth;
+    renderer->onscreenVertexBufferTextureHeight = textureHeight;
+}
+
+static bool drawOnscreenTextureInstance(HeadlessRenderer_t * renderer, TextureInstance_t * srcTextureInstance, size_t viewWidth, size_t viewHeight)
+{
+    // View sized texture instead of the CAEAGLLayer renderbuffer
+    TextureInstance_t * onscreenTextureInstance = &renderer->onscreenTextureInstance;
+
+    if (onscreenTextureInstance->textureWidth != viewWidth || onscreenTextureInstance->textureHeight != viewHeight || !onscreenTextureInstance->framebuffer)
+    {
+        onscreenTextureInstance->textureWidth = viewWidth;
+        onscreenTextureInstance->textureHeight = viewHeight;
+        renderer->onscreenVertexBufferTextureWidth = 0.0f;
+
+        if (!loadOffscreenTextureInstance(renderer, onscreenTextureInstance))
+        {
+            return false;
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, onscreenTextureInstance->framebuffer);
+    glViewport(0, 0, (GLsizei)viewWidth, (GLsizei)viewHeight);
+
+    glBindTexture(srcTextureInstance->textureTarget, srcTextureInstance->textureName);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    if (renderer->onscreenVertexBufferTextureWidth != srcTextureInstance->textureWidth || renderer->onscreenVertexBufferTextureHeight != srcTextureInstance->textureHeight)
+    {
+        loadOnscreenVertexBuffer(renderer, srcTextureInstance, viewWidth, viewHeight);
+    }
+
+    // Same as drawOnscreenOffscreenTextureInstance:
+    glUseProgram(renderer->defaultProgram);
+    bindVertexBuffer(renderer->onscreenVertexBuffer, &renderer->defaultAttributes);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    return true;
+}
+
+static bool drawYUVTextureInstances(HeadlessRenderer_t * renderer, TextureInstance_t * lumaTextureInstance, TextureInstance_t * chromaTextureInstance, size_t viewWidth, size_t viewHeight)
+{
+    // Conversion pass, in a texture with the filtered luma dimensions (same quad as the offscreen passes)
+    // or in the view sized texture (same as drawOnscreenOffscreenTextureInstance:chromaTextureInstance:)
+    bool onscreen = renderer->output != HeadlessRendererOutputOffscreen;
+    TextureInstance_t * destTextureInstance = onscreen ? &renderer->onscreenTextureInstance : &renderer->convertedTextureInstance;
+    GLfloat width = onscreen ? viewWidth : lumaTextureInstance->textureWidth;
+    GLfloat height = onscreen ? viewHeight : lumaTextureInstance->textureHeight;
+
+    if (destTextureInstance->textureWidth != width || destTextureInstance->textureHeight != height || !destTextureInstance->framebuffer)
+    {
+        destTextureInstance->textureWidth = width;
+        destTextureInstance->textureHeight = height;
+        renderer->onscreenVertexBufferTextureWidth = onscreen ? 0.0f : renderer->onscreenVertexBufferTextureWidth;
+
+        if (!loadOffscreenTextureInstance(renderer, destTextureInstance))
+        {
+            return false;
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, destTextureInstance->framebuffer);
+    glViewport(0, 0, destTextureInstance->textureWidth, destTextureInstance->textureHeight);
+
+    // Chroma on texture unit 1, linear filtering upsamples it to the luma dimensions
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(chromaTextureInstance->textureTarget, chromaTextureInstance->textureName);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(lumaTextureInstance->textureTarget, lumaTextureInstance->textureName);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    if (onscreen && (renderer->onscreenVertexBufferTextureWidth != lumaTextureInstance->textureWidth || renderer->onscreenVertexBufferTextureHeight != lumaTextureInstance->textureHeight))
+    {
+        loadOnscreenVertexBuffer(renderer, lumaTextureInstance, viewWidth, viewHeight);
+    }
+
+    glUseProgram(renderer->defaultYUVProgram);
+    bindVertexBuffer(onscreen ? renderer->onscreenVertexBuffer : renderer->vertexBuffer, &renderer->defaultYUVAttributes);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    return true;
+}
+
+static bool drawOnscreenFilterRegions(HeadlessRenderer_t * renderer, TextureInstance_t * filteredTextureInstance, TextureInstance_t * filteredChromaTextureInstance,
+                                      size_t viewWidth, size_t viewHeight)
+{
+    // Same as drawOnscreenFilteredTextureInstance:chromaTextureInstance:, the unfiltered input is drawn first
+    const FilterRegions_t * regions = &renderer->filterRegions;
+    bool drawn = filteredChromaTextureInstance ? drawYUVTextureInstances(renderer, &renderer->inputLumaTextureInstance, &renderer->inputChromaTextureInstance, viewWidth, viewHeight)
+                                               : drawOnscreenTextureInstance(renderer, &renderer->inputTextureInstance, viewWidth, viewHeight);
+    
+    glEnable(GL_SCISSOR_TEST);
+    
+    for (size_t i = 0; i < regions->count && drawn; ++i)
+    {
+        FilterRegionBox_t box = filterRegionsViewBox(regions, i, viewWidth, viewHeight);
+        
+        if (box.width == 0 || box.height == 0)
+        {
+            continue;
+        }
+        
+        glScissor(box.x, box.y, box.width, box.height);
+        
+        if (filteredChromaTextureInstance)
+        {
+            drawn = drawYUVTextureInstances(renderer, filteredTextureInstance, filteredChromaTextureInstance, viewWidth, viewHeight);
+            continue;
+        }
+        
+        drawn = drawOnscreenTextureInstance(renderer, filteredTextureInstance, viewWidth, viewHeight);
+    }
+    
+    glDisable(GL_SCISSOR_TEST);
+    
+    return drawn;
+}
+
+static void uploadInputImage(HeadlessRenderer_t * renderer, const BlurEngineImage_t * inputImage)
+{
+    // BGRA like the kCVPixelFormatType_32BGRA pixel buffers (GL_EXT_texture_format_BGRA8888)
+    uploadTexture(&renderer->inputTextureInstance, &renderer->inputTextureWidth, &renderer->inputTextureHeight, GL_BGRA_EXT, 4,
+                  inputImage->data, inputImage->width, inputImage->height, inputImage->bytesPerRow);
+}
+
+static void uploadInputYUVImage(HeadlessRenderer_t * renderer, const BlurEngineYUVImage_t * inputImage)
+{
+    // Same textures as the planes of kCVPixelFormatType_420YpCbCr8BiPlanarFullRange pixel buffers (oglTextureFromPixelBuffer:planeIndex:)
+    uploadTexture(&renderer->inputLumaTextureInstance, &renderer->inputLumaTextureWidth, &renderer->inputLumaTextureHeight, GL_LUMINANCE, 1,
+                  inputImage->luma, inputImage->width, inputImage->height, inputImage->lumaBytesPerRow);
+    uploadTexture(&renderer->inputChromaTextureInstance, &renderer->inputChromaTextureWidth, &renderer->inputChromaTextureHeight, GL_LUMINANCE_ALPHA, 2,
+                  inputImage->chroma, (inputImage->width + 1) / 2, (inputImage->height + 1) / 2, inputImage->chromaBytesPerRow);
+}
+
+static bool readOutputImage(const TextureInstance_t * textureInstance, BlurEngineImage_t * outputImage)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, textureInstance->framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    // GL_EXT_read_format_bgra gives BGRA directly, rows are read one by one if the output is padded
+    if (outputImage->bytesPerRow == outputImage->width * 4)
+    {
+        glReadPixels(0, 0, (GLsizei)outputImage->width, (GLsizei)outputImage->height, GL_BGRA_EXT, GL_UNSIGNED_BYTE, outputImage->data);
+    }
+    else
+    {
+        for (size_t y = 0; y < outputImage->height; ++y)
+        {
+            glReadPixels(0, (GLint)y, (GLsizei)outputImage->width, 1, GL_BGRA_EXT, GL_UNSIGNED_BYTE, outputImage->data + y * outputImage->bytesPerRow);
+        }
+    }
+
+    return glGetError() == GL_NO_ERROR;
+}
+
+#pragma mark -
+#pragma mark Frame timings
+
+// GL_EXT_disjoint_timer_query resolved with eglGetProcAddress (no GL_GLEXT_PROTOTYPES)
+static PFNGLGENQUERIESEXTPROC genQueriesExt;
+static PFNGLDELETEQUERIESEXTPROC deleteQueriesExt;
+static PFNGLBEGINQUERYEXTPROC beginQueryExt;
+static PFNGLENDQUERYEXTPROC endQueryExt;
+static PFNGLGETQUERYOBJECTUIVEXTPROC getQueryObjectuivExt;
+static PFNGLGETQUERYOBJECTUI64VEXTPROC getQueryObjectui64vExt;
+
+static void genQueries(GLsizei count, GLuint * queries)
+{
+    genQueriesExt(count, queries);
+}
+
+static void deleteQueries(GLsizei count, const GLuint * queries)
+{
+    deleteQueriesExt(count, queries);
+}
+
+static void beginTimeElapsedQuery(GLuint query)
+{
+    beginQueryExt(GL_TIME_ELAPSED_EXT, query);
+}
+
+static void endTimeElapsedQuery(void)
+{
+    endQueryExt(GL_TIME_ELAPSED_EXT);
+}
+
+static bool timeElapsedQueryResult(GLuint query, uint64_t * elapsedTime)
+{
+    GLuint available = GL_FALSE;
+    getQueryObjectuivExt(query, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+
+    if (!available)
+    {
+        return false;
+    }
+
+    GLuint64 result = 0;
+    getQueryObjectui64vExt(query, GL_QUERY_RESULT_EXT, &result);
+    *elapsedTime = result;
+    return true;
+}
+
+static bool gpuDisjoint(void)
+{
+    GLint disjoint = GL_FALSE;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    return disjoint != GL_FALSE;
+}
+
+void headlessRendererSetFrameTimings(HeadlessRenderer_t * renderer, FrameTimings_t * frameTimings)
+{
+    renderer->frameTimings = frameTimings;
+
+    const char * extensions = (const char *)glGetString(GL_EXTENSIONS);
+
+    if (!frameTimings || !extensions || !strstr(extensions, "GL_EXT_disjoint_timer_query"))
+    {
+        return;
+    }
+
+    genQueriesExt = (PFNGLGENQUERIESEXTPROC)eglGetProcAddress("glGenQueriesEXT");
+    deleteQueriesExt = (PFNGLDELETEQUERIESEXTPROC)eglGetProcAddress("glDeleteQueriesEXT");
+    beginQueryExt = (PFNGLBEGINQUERYEXTPROC)eglGetProcAddress("glBeginQueryEXT");
+    endQueryExt = (PFNGLENDQUERYEXTPROC)eglGetProcAddress("glEndQueryEXT");
+    getQueryObjectuivExt = (PFNGLGETQUERYOBJECTUIVEXTPROC)eglGetProcAddress("glGetQueryObjectuivEXT");
+    getQueryObjectui64vExt = (PFNGLGETQUERYOBJECTUI64VEXTPROC)eglGetProcAddress("glGetQueryObjectui64vEXT");
+
+    if (genQueriesExt && deleteQueriesExt && beginQueryExt && endQueryExt && getQueryObjectuivExt && getQueryObjectui64vExt)
+    {
+        FrameTimingsTimerQueryFunctions_t functions = {
+            genQueries, deleteQueries, beginTimeElapsedQuery, endTimeElapsedQuery, timeElapsedQueryResult, gpuDisjoint
+        };
+        frameTimingsSetTimerQueryFunctions(frameTimings, &functions);
+    }
+}
+
+static void beginFrameTimingStage(HeadlessRenderer_t * renderer, unsigned int stage)
+{
+    if (renderer->frameTimings)
+    {
+        frameTimingsBeginStage(renderer->frameTimings, stage);
+    }
+}
+
+static void endFrameTimingStage(HeadlessRenderer_t * renderer, unsigned int stage)
+{
+    if (renderer->frameTimings)
+    {
+        frameTimingsEndStage(renderer->frameTimings, stage);
+    }
+}
+
+static bool filterImage(HeadlessRenderer_t * renderer, const BlurEngineImage_t * inputImage, size_t viewWidth, size_t viewHeight, BlurEngineImage_t * outputImage)
+{
+    size_t outputWidth, outputHeight;
+    headlessRendererOutputDimensions(renderer, inputImage->width, inputImage->height, viewWidth, viewHeight, &outputWidth, &outputHeight);
+
+    if (outputImage->width != outputWidth || outputImage->height != outputHeight || outputImage->bytesPerRow < outputWidth * 4)
+    {
+        return false;
+    }
+
+    glUseProgram(renderer->blurFilterProgram);
+    bindVertexBuffer(renderer->vertexBuffer, &renderer->blurFilterAttributes);
+
+    // Update any uniform value that changed since last frame
+    beginFrameTimingStage(renderer, FrameTimingStageUniformUpdate);
+    updateBlurFilterProgramUniforms(renderer);
+    endFrameTimingStage(renderer, FrameTimingStageUniformUpdate);
+
+    // Input frame, downsampled dimensions like the pixel buffer texture instance
+    beginFrameTimingStage(renderer, FrameTimingStageTextureImport);
+    uploadInputImage(renderer, inputImage);
+    endFrameTimingStage(renderer, FrameTimingStageTextureImport);
+    scaledDownDimensions(renderer->filterDownsamplingFactor, inputImage->width, inputImage->height, viewWidth, viewHeight,
+                         &renderer->inputTextureInstance.textureWidth, &renderer->inputTextureInstance.textureHeight);
+
+    TextureInstance_t * offscreenTextureInstances = renderer->offscreenTextureInstances;
+    GLuint passCount = 2*renderer->filterMultiplePassCount;
+
+    // Regions in the texture coordinates of the offscreen passes (onscreen outputs only)
+    FilterRegions_t * regions = (renderer->output != HeadlessRendererOutputOffscreen && renderer->filterRegions.count > 0) ? &renderer->filterRegions : NULL;
+
+    if (regions)
+    {
+        filterRegionsMapToTexture(regions, renderer->inputTextureInstance.textureWidth, renderer->inputTextureInstance.textureHeight, viewWidth, viewHeight);
+    }
+
+    // First Draw the input frame in an offscreen texture instance, then ping-pong
+    beginFrameTimingStage(renderer, FrameTimingStageOffscreenPass);
+    bool drawn = drawPrefilteredOffscreenTextureInstance(renderer, &renderer->inputTextureInstance, &offscreenTextureInstances[0], regions, passCount - 1);
+    endFrameTimingStage(renderer, FrameTimingStageOffscreenPass);
+
+    if (!drawn)
+    {
+        return false;
+    }
+
+    for (GLuint p=1; p<passCount; ++p)
+    {
+        beginFrameTimingStage(renderer, FrameTimingStageOffscreenPass + p);
+        drawn = drawOffscreenTextureInstance(renderer, &offscreenTextureInstances[(p+1)%2], &offscreenTextureInstances[p%2], regions, passCount - 1 - p);
+        endFrameTimingStage(renderer, FrameTimingStageOffscreenPass + p);
+
+        if (!drawn)
+        {
+            return false;
+        }
+    }
+
+    TextureInstance_t * filteredTextureInstance = &offscreenTextureInstances[(passCount+1)%2];
+
+    if (renderer->output != HeadlessRendererOutputOffscreen)
+    {
+        beginFrameTimingStage(renderer, FrameTimingStageOnscreenPass);
+        drawn = regions ? drawOnscreenFilterRegions(renderer, filteredTextureInstance, NULL, viewWidth, viewHeight)
+                        : drawOnscreenTextureInstance(renderer, filteredTextureInstance, viewWidth, viewHeight);
+        endFrameTimingStage(renderer, FrameTimingStageOnscreenPass);
+
+        if (!drawn)
+        {
+            return false;
+        }
+
+        filteredTextureInstance = &renderer->onscreenTextureInstance;
+    }
+
+    // The readback plays the role of presentRenderbuffer:
+    beginFrameTimingStage(renderer, FrameTimingStagePresent);
+    bool read = readOutputImage(filteredTextureInstance, outputImage);
+    endFrameTimingStage(renderer, FrameTimingStagePresent);
+
+    return read;
+}
+
+static bool filterYUVImage(HeadlessRenderer_t * renderer, const BlurEngineYUVImage_t * inputImage, size_t viewWidth, size_t viewHeight, BlurEngineImage_t * outputImage)
+{
+    size_t outputWidth, outputHeight;
+    headlessRendererOutputDimensions(renderer, inputImage->width, inputImage->height, viewWidth, viewHeight, &outputWidth, &outputHeight);
+
+    if (outputImage->width != outputWidth || outputImage->height != outputHeight || outputImage->bytesPerRow < outputWidth * 4)
+    {
+        return false;
+    }
+
+    if (!renderer->defaultYUVProgram && !loadDefaultYUVProgram(renderer))
+    {
+        return false;
+    }
+
+    glUseProgram(renderer->blurFilterProgram);
+    bindVertexBuffer(renderer->vertexBuffer, &renderer->blurFilterAttributes);
+
+    // Update any uniform value that changed since last frame
+    beginFrameTimingStage(renderer, FrameTimingStageUniformUpdate);
+    updateBlurFilterProgramUniforms(renderer);
+    endFrameTimingStage(renderer, FrameTimingStageUniformUpdate);
+
+    // Input planes, downsampled dimensions like scaleDownPixelBufferTextureInstanceDimensions (the chroma plane has half the luma dimensions)
+    beginFrameTimingStage(renderer, FrameTimingStageTextureImport);
+    uploadInputYUVImage(renderer, inputImage);
+    endFrameTimingStage(renderer, FrameTimingStageTextureImport);
+    scaledDownDimensions(renderer->filterDownsamplingFactor, inputImage->width, inputImage->height, viewWidth, viewHeight,
+                         &renderer->inputLumaTextureInstance.textureWidth, &renderer->inputLumaTextureInstance.textureHeight);
+    scaledDownDimensions(2.0f * renderer->filterDownsamplingFactor, renderer->inputChromaTextureWidth, renderer->inputChromaTextureHeight, viewWidth, viewHeight,
+                         &renderer->inputChromaTextureInstance.textureWidth, &renderer->inputChromaTextureInstance.textureHeight);
+
+    // Same ping-pong passes for each plane, the pass count is even so the split-pass direction starts again with x
+    TextureInstance_t * inputTextureInstances[2] = {&renderer->inputLumaTextureInstance, &renderer->inputChromaTextureInstance};
+    TextureInstance_t * offscreenTextureInstances[2] = {renderer->offscreenTextureInstances, renderer->offscreenChromaTextureInstances};
+    GLuint offscreenPassCount = 2*renderer->filterMultiplePassCount;
+
+    // Regions in the texture coordinates of the offscreen passes (onscreen outputs only), the chroma plane has the same ratio
+    FilterRegions_t * regions = (renderer->output != HeadlessRendererOutputOffscreen && renderer->filterRegions.count > 0) ? &renderer->filterRegions : NULL;
+
+    if (regions)
+    {
+        filterRegionsMapToTexture(regions, renderer->inputLumaTextureInstance.textureWidth, renderer->inputLumaTextureInstance.textureHeight, viewWidth, viewHeight);
+    }
+
+    for (int plane=0; plane<2; ++plane)
+    {
+        // The chroma texels are twice as large, half the kernel offsets give the same blur radius in view pixels
+        renderer->filterKernelOffsetScale = (plane == 0) ? 1.0f : 0.5f;
+
+        for (GLuint p=0; p<offscreenPassCount; ++p)
+        {
+            TextureInstance_t * srcTextureInstance = (p == 0) ? inputTextureInstances[plane] : &offscreenTextureInstances[plane][(p+1)%2];
+
+            beginFrameTimingStage(renderer, FrameTimingStageOffscreenPass + plane * offscreenPassCount + p);
+            bool drawn = (p == 0) ? drawPrefilteredOffscreenTextureInstance(renderer, srcTextureInstance, &offscreenTextureInstances[plane][p%2], regions, offscreenPassCount - 1 - p)
+                                  : drawOffscreenTextureInstance(renderer, srcTextureInstance, &offscreenTextureInstances[plane][p%2], regions, offscreenPassCount - 1 - p);
+            endFrameTimingStage(renderer, FrameTimingStageOffscreenPass + plane * offscreenPassCount + p);
+
+            if (!drawn)
+            {
+                renderer->filterKernelOffsetScale = 1.0f;
+                return false;
+            }
+        }
+    }
+
+    renderer->filterKernelOffsetScale = 1.0f;
+
+    // Conversion to RGB
+    beginFrameTimingStage(renderer, FrameTimingStageOnscreenPass);
+    TextureInstance_t * filteredTextureInstance = &offscreenTextureInstances[0][(offscreenPassCount+1)%2];
+    TextureInstance_t * filteredChromaTextureInstance = &offscreenTextureInstances[1][(offscreenPassCount+1)%2];
+    bool drawn = regions ? drawOnscreenFilterRegions(renderer, filteredTextureInstance, filteredChromaTextureInstance, viewWidth, viewHeight)
+                         : drawYUVTextureInstances(renderer, filteredTextureInstance, filteredChromaTextureInstance, viewWidth, viewHeight);
+    endFrameTimingStage(renderer, FrameTimingStageOnscreenPass);
+
+    if (!drawn)
+    {
+        return false;
+    }
+
+    // The readback plays the role of presentRenderbuffer:
+    beginFrameTimingStage(renderer, FrameTimingStagePresent);
+    bool read = readOutputImage(renderer->output == HeadlessRendererOutputOffscreen ? &renderer->convertedTextureInstance : &renderer->onscreenTextureInstance, outputImage);
+    endFrameTimingStage(renderer, FrameTimingStagePresent);
+
+    return read;
+}
+
+bool headlessRendererFilterImage(HeadlessRenderer_t * renderer, const BlurEngineImage_t * inputImage, size_t viewWidth, size_t viewHeight, BlurEngineImage_t * outputImage)
+{
+    if (!renderer->frameTimings)
+    {
+        return filterImage(renderer, inputImage, viewWidth, viewHeight, outputImage);
+    }
+
+    frameTimingsBeginFrame(renderer->frameTimings);
+    bool filtered = filterImage(renderer, inputImage, viewWidth, viewHeight, outputImage);
+    frameTimingsEndFrame(renderer->frameTimings);
+
+    return filtered;
+}
+
+bool headlessRendererFilterYUVImage(HeadlessRenderer_t * renderer, const BlurEngineYUVImage_t * inputImage, size_t viewWidth, size_t viewHeight, BlurEngineImage_t * outputImage)
+{
+    if (!renderer->frameTimings)
+    {
+        return filterYUVImage(renderer, inputImage, viewWidth, viewHeight, outputImage);
+    }
+
+    frameTimingsBeginFrame(renderer->frameTimings);
+    bool filtered = filterYUVImage(renderer, inputImage, viewWidth, viewHeight, outputImage);
+    frameTimingsEndFrame(renderer->frameTimings);
+
+    return filtered;
+}
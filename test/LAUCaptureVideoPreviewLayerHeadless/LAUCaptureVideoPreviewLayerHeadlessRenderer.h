@@ -0,0 +1,143 @@
+/*
+
+ LAUCaptureVideoPreviewLayerHeadlessRenderer.h
+ LAUCaptureVideoPreviewLayer Headless
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef LAUCaptureVideoPreviewLayerHeadlessRenderer_h
+#define LAUCaptureVideoPreviewLayerHeadlessRenderer_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "LAUCaptureVideoPreviewLayerBlurEngine.h"
+#include "LAUCaptureVideoPreviewLayerProgramCache.h"
+#include "LAUCaptureVideoPreviewLayerRenderTargetPool.h"
+#include "LAUCaptureVideoPreviewLayerFrameTimings.h"
+#include "LAUCaptureVideoPreviewLayerGaussianFilterKernel.h"
+#include "LAUCaptureVideoPreviewLayerFilterRegions.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Runs the offscreen passes of drawPixelBuffer: without an EAGLContext
+
+ - Surfaceless EGL context with OpenGL ES 2.0 (ie. Mesa llvmpipe), no window system needed
+ - Programs are loaded with programCacheLoadProgram (LAUCaptureVideoPreviewLayerProgramCache),
+   GL_OES_get_program_binary is resolved with eglGetProcAddress
+ - The BGRA input frame plays the role of the pixel buffer texture, it's downsampled and filtered
+   with the same ping-pong passes and the filtered offscreen texture is read back
+
+ The output has the same dimensions and layout as blurEngineFilterImage, so both can be compared.
+ */
+
+typedef struct HeadlessRenderer HeadlessRenderer_t;
+
+// Renderer memory management, creates (and destroys) the EGL context
+// NULL shader sources use the bts blur filter program variants of LAUCaptureVideoPreviewLayerShaderGenerator
+// NULL program cache directory compiles the program from source
+HeadlessRenderer_t * createHeadlessRenderer(const char * vertexShaderSource, const char * fragmentShaderSource, const char * programCacheDirectoryPath);
+void releaseHeadlessRenderer(HeadlessRenderer_t * renderer);
+
+// GL_RENDERER string of the context
+const char * headlessRendererName(const HeadlessRenderer_t * renderer);
+
+// Kernel samples of the blur filter program variant in use, 0 with custom shaders or dts (set by headlessRendererFilterImage)
+unsigned int headlessRendererProgramSamples(const HeadlessRenderer_t * renderer);
+
+// Program cache hits, misses and compile time of the blur filter program
+void headlessRendererProgramCacheStatistics(const HeadlessRenderer_t * renderer, ProgramCacheStatistics_t * statistics);
+
+// Render targets allocated and reused by the offscreen (and onscreen) texture instances
+void headlessRendererRenderTargetPoolStatistics(const HeadlessRenderer_t * renderer, RenderTargetPoolStatistics_t * statistics);
+
+// Filter intensity [0,1], same as setFilterIntensity: with continuous intensity
+void headlessRendererSetFilterIntensity(HeadlessRenderer_t * renderer, float intensity);
+
+// Kernel type, GaussianFilterKernelTypeBts (default) or GaussianFilterKernelTypeDts (same as !FilterBilinearTextureSamplingEnabled)
+// Dts loads FragmentShaderSourceBlurFilterDts once and uses kDtsGaussianFilterKernelDefaultParameters, bts restores the previous program
+// Returns false if the dts program can't be loaded
+bool headlessRendererSetFilterKernelType(HeadlessRenderer_t * renderer, GaussianFilterKernelType_t type);
+
+// Parameters of the kernels for the current kernel type (ie. to map a kernel index to an intensity with gaussianFilterStepForKernelIndex)
+const GaussianFilterKernelParameters_t * headlessRendererFilterKernelParameters(const HeadlessRenderer_t * renderer);
+
+// Filter parameters, same meaning as _filterDownsamplingFactor and _filterMultiplePassCount (defaults are 4.0 and 2)
+void headlessRendererSetFilterParameters(HeadlessRenderer_t * renderer, float downsamplingFactor, unsigned int multiplePassCount);
+
+// Prefilter of the first pass, same as FilterPrefilterEnabled (default is true)
+// Only the generated bts variants have a prefilter program, headlessRendererPrefilterEnabled is false with custom shaders or dts
+void headlessRendererSetPrefilterEnabled(HeadlessRenderer_t * renderer, bool prefilterEnabled);
+bool headlessRendererPrefilterEnabled(const HeadlessRenderer_t * renderer);
+
+// Kernel bank variants, same as FilterKernelBankEnabled (default is false): all the kernels are uploaded once and
+// an intensity change only sets FilterKernelBankPosition (the two kernels around the position are blended, see
+// btsGaussianFilterKernelBankKernelForPosition). Returns false with custom shaders, dts, or if the bank doesn't fit or link
+bool headlessRendererSetKernelBankEnabled(HeadlessRenderer_t * renderer, bool kernelBankEnabled);
+bool headlessRendererKernelBankEnabled(const HeadlessRenderer_t * renderer);
+
+// Intensity map of the frame (8 bits, any dimensions, frame texture coordinates), same as setBlurIntensityMap:width:height:bytesPerRow:
+// The kernel bank position of each fragment is scaled by the map, 255 is the filter intensity and 0 is the smallest kernel.
+// NULL intensities removes the map. Returns false without the kernel bank, or if the banks don't fit the fragment uniforms or link
+bool headlessRendererSetIntensityMap(HeadlessRenderer_t * renderer, const uint8_t * intensities, size_t width, size_t height, size_t bytesPerRow);
+bool headlessRendererIntensityMapEnabled(const HeadlessRenderer_t * renderer);
+
+// Where the filtered image is read back from
+enum HeadlessRendererOutput {
+    HeadlessRendererOutputOffscreen = 0, // Last offscreen texture (downsampled dimensions), default
+    HeadlessRendererOutputOnscreenCopy, // View sized framebuffer, filtered texture drawn with the default program
+};
+
+typedef enum HeadlessRendererOutput HeadlessRendererOutput_t;
+
+void headlessRendererSetOutput(HeadlessRenderer_t * renderer, HeadlessRendererOutput_t output);
+
+// Dimensions of the filtered image for a given input and view (onscreen renderbuffer) size, the view size for onscreen outputs
+void headlessRendererOutputDimensions(const HeadlessRenderer_t * renderer, size_t inputWidth, size_t inputHeight, size_t viewWidth, size_t viewHeight, size_t * outputWidth, size_t * outputHeight);
+
+// Blurred regions in normalized view coordinates (same as blurRegions), the rest of the view is the unfiltered input
+// No region (default) blurs the whole view. Regions only apply to the onscreen outputs, the offscreen output is always fully filtered
+void headlessRendererSetFilterRegions(HeadlessRenderer_t * renderer, const FilterRegionRect_t * rects, size_t count);
+
+// Stage timings of headlessRendererFilterImage (one frame per call), the readback is timed as FrameTimingStagePresent
+// NULL disables the timings (default). The frame timings are not owned by the renderer.
+// GPU times are measured with GL_EXT_disjoint_timer_query if the context supports it.
+void headlessRendererSetFrameTimings(HeadlessRenderer_t * renderer, FrameTimings_t * frameTimings);
+
+// Filter the input image and read back the result. The output image must have the dimensions returned by headlessRendererOutputDimensions
+// Returns false if the dimensions don't match or a GL error occurred
+bool headlessRendererFilterImage(HeadlessRenderer_t * renderer, const BlurEngineImage_t * inputImage, size_t viewWidth, size_t viewHeight, BlurEngineImage_t * outputImage);
+
+// Filter a 420 bi-planar input image (same as FilterYUVInputEnabled), the luma and chroma planes are filtered separately and
+// converted to BGRA by the last pass, drawn with FragmentShaderSourceDefaultYUV. The offscreen output is the conversion pass
+// at the filtered luma dimensions (same layout as blurEngineFilterYUVImage)
+bool headlessRendererFilterYUVImage(HeadlessRenderer_t * renderer, const BlurEngineYUVImage_t * inputImage, size_t viewWidth, size_t viewHeight, BlurEngineImage_t * outputImage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAUCaptureVideoPreviewLayerHeadlessRenderer_h */
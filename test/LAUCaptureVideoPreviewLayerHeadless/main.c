@@ -0,0 +1,831 @@
+/*
+
+ main.c
+ LAUCaptureVideoPreviewLayer Headless
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+/*
+ Headless render harness, runs the blur filter shaders on Linux (Mesa llvmpipe) without an iPhone
+ 
+ Build (from the repository root):
+ 
+ make build/LAUCaptureVideoPreviewLayerHeadless
+ 
+ Usage:
+ 
+ LAUCaptureVideoPreviewLayerHeadless [options]
+   --input <file.bgra> --size <width>x<height>   Raw BGRA frame (default is a 1920x1080 test pattern)
+   --view <width>x<height>                       Onscreen renderbuffer size (default 1242x2208)
+   --intensity <0..1>                            Filter intensity (default 1)
+   --passes <n>                                  Multiple pass count (default 2)
+   --downsampling <factor>                       Downsampling factor (default 4)
+   --no-prefilter                                First pass without the 2x2 prefilter (FilterPrefilterEnabled 0)
+   --kernel-bank                                 Kernels uploaded once and selected by FilterKernelBankPosition (FilterKernelBankEnabled 1)
+   --intensity-map <split|ramp>                  Intensity of each pixel (needs --kernel-bank): 1 on the left half and 0 on the right
+                                                 half, or 0 to 1 from left to right (setBlurIntensityMap:width:height:bytesPerRow:)
+   --vertex-shader <file.vsh>                    Shaders to use instead of LAUCaptureVideoPreviewLayerShaders.h
+   --fragment-shader <file.fsh>                  (ie. resources/shaders/blur_filter_bts.vsh/fsh)
+   --program-cache <directory>                   Load the program from (and store it in) a program binary cache
+   --iterations <n>                              Number of frames to render (default 1)
+   --rotate                                      Swap the view width and height every frame (render target reuse)
+   --onscreen                                    Render into a view sized framebuffer (copy pass with the default program)
+   --output <file.bgra>                          Write the filtered frame
+   --timings                                     Print the CPU and GPU time percentiles of each stage
+   --compare                                     Compare with the CPU blur engine (max difference)
+   --record <file.laur>                          Record the input frames (60 fps) and an animated blur to the intensity
+   --replay <file.laur>                          Filter the frames of a recording (startFrameRecordingToPath:) with its
+                                                 blur timeline and view size (unless --view), --iterations times
+   --max-speed                                   Replay without waiting for the recorded timestamps
+   --stream                                      Read the recording instead of memory-mapping it
+ 
+ Exit status is 0 on success.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "LAUCaptureVideoPreviewLayerHeadlessRenderer.h"
+#include "LAUCaptureVideoPreviewLayerBlurEngine.h"
+#include "LAUCaptureVideoPreviewLayerGaussianFilterKernel.h"
+#include "LAUCaptureVideoPreviewLayerFrameRecording.h"
+
+// Frames of the replay kept by the frame timings (10s at 60fps)
+#define kReplayFrameTimingsCapacity 600
+
+// Recording of the input frames, same transition as kFilterIntensityTransitionDuration
+#define kRecordFrameInterval (1.0 / 60.0)
+#define kRecordIntensityTransitionDuration 0.25f
+
+struct HeadlessOptions {
+    const char * inputPath;
+    size_t inputWidth;
+    size_t inputHeight;
+    size_t viewWidth;
+    size_t viewHeight;
+    bool viewSize; // --view was given, the view size of a recording is ignored
+    float intensity;
+    unsigned int multiplePassCount;
+    float downsamplingFactor;
+    const char * vertexShaderPath;
+    const char * fragmentShaderPath;
+    const char * programCachePath;
+    unsigned int iterations;
+    HeadlessRendererOutput_t output;
+    const char * outputPath;
+    bool compare;
+    bool rotate;
+    bool noPrefilter;
+    bool kernelBank;
+    const char * intensityMap;
+    bool timings;
+    const char * recordPath;
+    const char * replayPath;
+    bool maxSpeed;
+    bool stream;
+};
+
+typedef struct HeadlessOptions HeadlessOptions_t;
+
+static double currentTime(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static char * readFile(const char * path, size_t * size)
+{
+    FILE * file = fopen(path, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "Can't open %s\n", path);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char * data = malloc(fileSize + 1);
+    if (data && fread(data, 1, fileSize, file) != (size_t)fileSize)
+    {
+        free(data);
+        data = NULL;
+    }
+
+    if (data)
+    {
+        data[fileSize] = 0;
+        if (size)
+        {
+            *size = fileSize;
+        }
+    }
+
+    fclose(file);
+    return data;
+}
+
+static void printFrameTimings(FrameTimings_t * frameTimings)
+{
+    FrameTimingsCounters_t counters;
+    frameTimingsCounters(frameTimings, &counters);
+    printf("timings (ms): %lu frames, %lu timer queries (%lu dropped)\n", counters.frameCount, counters.queryCount, counters.droppedQueryCount);
+
+    for (unsigned int stage = 0; stage < FrameTimingStageCount; ++stage)
+    {
+        FrameTimingStatistics_t cpuStatistics, gpuStatistics;
+
+        if (!frameTimingsStatistics(frameTimings, stage, false, &cpuStatistics))
+        {
+            continue;
+        }
+
+        char name[32];
+        frameTimingsStageName(stage, name, sizeof(name));
+        printf("  %-16s cpu p50 %8.3f p90 %8.3f p99 %8.3f max %8.3f", name,
+               1000.0 * cpuStatistics.p50, 1000.0 * cpuStatistics.p90, 1000.0 * cpuStatistics.p99, 1000.0 * cpuStatistics.max);
+
+        if (frameTimingsStatistics(frameTimings, stage, true, &gpuStatistics))
+        {
+            printf(" | gpu p50 %8.3f p90 %8.3f p99 %8.3f max %8.3f",
+                   1000.0 * gpuStatistics.p50, 1000.0 * gpuStatistics.p90, 1000.0 * gpuStatistics.p99, 1000.0 * gpuStatistics.max);
+        }
+
+        printf("\n");
+    }
+}
+
+static bool parseSize(const char * string, size_t * width, size_t * height)
+{
+    return sscanf(string, "%zux%zu", width, height) == 2 && *width > 0 && *height > 0;
+}
+
+static bool parseOptions(int argc, const char * argv[], HeadlessOptions_t * options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char * option = argv[i];
+        const char * value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (strcmp(option, "--compare") == 0)
+        {
+            options->compare = true;
+            continue;
+        }
+
+        if (strcmp(option, "--rotate") == 0)
+        {
+            options->rotate = true;
+            continue;
+        }
+
+        if (strcmp(option, "--onscreen") == 0)
+        {
+            options->output = HeadlessRendererOutputOnscreenCopy;
+            continue;
+        }
+
+        if (strcmp(option, "--timings") == 0)
+        {
+            options->timings = true;
+            continue;
+        }
+
+        if (strcmp(option, "--no-prefilter") == 0)
+        {
+            options->noPrefilter = true;
+            continue;
+        }
+
+        if (strcmp(option, "--kernel-bank") == 0)
+        {
+            options->kernelBank = true;
+            continue;
+        }
+
+        if (strcmp(option, "--max-speed") == 0)
+        {
+            options->maxSpeed = true;
+            continue;
+        }
+
+        if (strcmp(option, "--stream") == 0)
+        {
+            options->stream = true;
+            continue;
+        }
+
+        if (!value)
+        {
+            fprintf(stderr, "Missing value for %s\n", option);
+            return false;
+        }
+
+        if (strcmp(option, "--input") == 0) options->inputPath = value;
+        else if (strcmp(option, "--size") == 0) { if (!parseSize(value, &options->inputWidth, &options->inputHeight)) return false; }
+        else if (strcmp(option, "--view") == 0) { if (!parseSize(value, &options->viewWidth, &options->viewHeight)) return false; options->viewSize = true; }
+        else if (strcmp(option, "--intensity") == 0) options->intensity = atof(value);
+        else if (strcmp(option, "--passes") == 0) options->multiplePassCount = atoi(value);
+        else if (strcmp(option, "--downsampling") == 0) options->downsamplingFactor = atof(value);
+        else if (strcmp(option, "--vertex-shader") == 0) options->vertexShaderPath = value;
+        else if (strcmp(option, "--fragment-shader") == 0) options->fragmentShaderPath = value;
+        else if (strcmp(option, "--program-cache") == 0) options->programCachePath = value;
+        else if (strcmp(option, "--iterations") == 0) options->iterations = atoi(value);
+        else if (strcmp(option, "--output") == 0) options->outputPath = value;
+        else if (strcmp(option, "--record") == 0) options->recordPath = value;
+        else if (strcmp(option, "--replay") == 0) options->replayPath = value;
+        else if (strcmp(option, "--intensity-map") == 0) options->intensityMap = value;
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", option);
+            return false;
+        }
+
+        ++i;
+    }
+
+    return options->iterations > 0 && options->multiplePassCount > 0 && options->downsamplingFactor > 0.0f;
+}
+
+static bool loadInputImage(const HeadlessOptions_t * options, BlurEngineImage_t * inputImage)
+{
+    inputImage->width = options->inputWidth;
+    inputImage->height = options->inputHeight;
+    inputImage->bytesPerRow = options->inputWidth * 4;
+
+    if (options->inputPath)
+    {
+        size_t size = 0;
+        inputImage->data = (uint8_t *)readFile(options->inputPath, &size);
+
+        if (inputImage->data && size < inputImage->bytesPerRow * inputImage->height)
+        {
+            fprintf(stderr, "%s is smaller than %zux%zu BGRA\n", options->inputPath, inputImage->width, inputImage->height);
+            free(inputImage->data);
+            inputImage->data = NULL;
+        }
+
+        return inputImage->data != NULL;
+    }
+
+    // Test pattern, checkerboard with gradients (sharp edges show the blur)
+    inputImage->data = malloc(inputImage->bytesPerRow * inputImage->height);
+    for (size_t y = 0; y < inputImage->height; ++y)
+    {
+        uint8_t * row = inputImage->data + y * inputImage->bytesPerRow;
+        for (size_t x = 0; x < inputImage->width; ++x)
+        {
+            uint8_t checker = (((x / 64) + (y / 64)) % 2) ? 255 : 0;
+            row[4 * x + 0] = checker;
+            row[4 * x + 1] = (uint8_t)(255 * x / inputImage->width);
+            row[4 * x + 2] = (uint8_t)(255 * y / inputImage->height);
+            row[4 * x + 3] = 255;
+        }
+    }
+
+    return true;
+}
+
+static uint8_t * createIntensityMap(const char * name, size_t width, size_t height)
+{
+    bool split = strcmp(name, "split") == 0;
+
+    if (!split && strcmp(name, "ramp") != 0)
+    {
+        fprintf(stderr, "Unknown intensity map %s\n", name);
+        return NULL;
+    }
+
+    uint8_t * intensityMap = malloc(width * height);
+    for (size_t y = 0; intensityMap && y < height; ++y)
+    {
+        for (size_t x = 0; x < width; ++x)
+        {
+            intensityMap[y * width + x] = split ? ((x < width / 2) ? 255 : 0) : (uint8_t)(255 * x / (width > 1 ? width - 1 : 1));
+        }
+    }
+
+    return intensityMap;
+}
+
+// Largest difference of the channels of the columns [beginColumn, endColumn)
+static int maxDifferenceInColumns(const BlurEngineImage_t * image, const BlurEngineImage_t * otherImage, size_t beginColumn, size_t endColumn)
+{
+    int maxDifference = 0;
+    for (size_t y = 0; y < image->height; ++y)
+    {
+        for (size_t i = 4 * beginColumn; i < 4 * endColumn; ++i)
+        {
+            int difference = abs((int)image->data[y * image->bytesPerRow + i] - (int)otherImage->data[y * otherImage->bytesPerRow + i]);
+            maxDifference = difference > maxDifference ? difference : maxDifference;
+        }
+    }
+    return maxDifference;
+}
+
+static int compareWithBlurEngineForIntensity(const HeadlessOptions_t * options, const HeadlessRenderer_t * renderer, const BlurEngineImage_t * inputImage, const BlurEngineImage_t * outputImage,
+                                             float intensity, size_t beginColumn, size_t endColumn)
+{
+    BlurEngine_t * blurEngine = createBlurEngine();
+    blurEngineSetFilterParameters(blurEngine, options->downsamplingFactor, options->multiplePassCount);
+    blurEngineSetPrefilterEnabled(blurEngine, headlessRendererPrefilterEnabled(renderer));
+
+    // Same kernel as the renderer (continuous intensity, or the blended kernels of the bank)
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+    GaussianFilterKernelCache_t * cache = createGaussianFilterKernelCache(parameters, GaussianFilterKernelTypeBts, 1);
+
+    if (headlessRendererKernelBankEnabled(renderer))
+    {
+        unsigned int samples = btsGaussianFilterMaxSamples(parameters);
+        float offsets[samples], weights[samples];
+        btsGaussianFilterKernelBankKernelForPosition(parameters, gaussianFilterKernelBankPositionForStep(parameters, intensity), offsets, weights);
+        blurEngineSetFilterKernel(blurEngine, samples, offsets, weights);
+    }
+    else
+    {
+        const GaussianFilterKernel_t * filterKernel = gaussianFilterKernelCacheKernelForStep(cache, intensity);
+        blurEngineSetFilterKernel(blurEngine, filterKernel->samples, filterKernel->offsets, filterKernel->weights);
+    }
+
+    BlurEngineImage_t referenceImage = *outputImage;
+    referenceImage.data = malloc(referenceImage.bytesPerRow * referenceImage.height);
+
+    int maxDifference = -1;
+    if (blurEngineFilterImage(blurEngine, inputImage, options->viewWidth, options->viewHeight, &referenceImage))
+    {
+        maxDifference = maxDifferenceInColumns(&referenceImage, outputImage, beginColumn, endColumn);
+    }
+
+    free(referenceImage.data);
+    releaseGaussianFilterKernelCache(cache);
+    releaseBlurEngine(blurEngine);
+
+    return maxDifference;
+}
+
+static int compareWithBlurEngine(const HeadlessOptions_t * options, const HeadlessRenderer_t * renderer, const BlurEngineImage_t * inputImage, const BlurEngineImage_t * outputImage)
+{
+    if (!headlessRendererIntensityMapEnabled(renderer))
+    {
+        return compareWithBlurEngineForIntensity(options, renderer, inputImage, outputImage, options->intensity, 0, outputImage->width);
+    }
+
+    if (strcmp(options->intensityMap, "split") != 0)
+    {
+        fprintf(stderr, "No CPU reference for the %s intensity map\n", options->intensityMap);
+        return -1;
+    }
+
+    // The left half has the intensity, the right half none. Each horizontal pass reads the radius of the largest kernel across the seam
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+    unsigned int radius = gaussianFilterRadiusForSize(gaussianFilterKernelBankSizeForPosition(parameters, gaussianFilterKernelBankPositionForStep(parameters, options->intensity)));
+    size_t margin = options->multiplePassCount * (radius + 2);
+    size_t seam = outputImage->width / 2;
+
+    if (seam <= margin)
+    {
+        fprintf(stderr, "Output too narrow for the split intensity map\n");
+        return -1;
+    }
+
+    int leftDifference = compareWithBlurEngineForIntensity(options, renderer, inputImage, outputImage, options->intensity, 0, seam - margin);
+    int rightDifference = compareWithBlurEngineForIntensity(options, renderer, inputImage, outputImage, 0.0f, seam + margin < outputImage->width ? seam + margin : outputImage->width, outputImage->width);
+
+    return (leftDifference < 0 || rightDifference < 0) ? -1 : (leftDifference > rightDifference ? leftDifference : rightDifference);
+}
+
+static bool writeOutputImage(const char * path, const BlurEngineImage_t * outputImage)
+{
+    FILE * file = fopen(path, "wb");
+    bool written = file && fwrite(outputImage->data, 1, outputImage->bytesPerRow * outputImage->height, file) == outputImage->bytesPerRow * outputImage->height;
+    if (!written)
+    {
+        fprintf(stderr, "Can't write %s\n", path);
+    }
+    if (file)
+    {
+        fclose(file);
+    }
+    return written;
+}
+
+static void waitUntil(double time)
+{
+    double remainingTime = time - currentTime();
+    if (remainingTime > 0.0)
+    {
+        struct timespec duration = {(time_t)remainingTime, (long)((remainingTime - (time_t)remainingTime) * 1e9)};
+        nanosleep(&duration, NULL);
+    }
+}
+
+// FNV-1a of the filtered frames, the same recording and options give the same checksum at any replay speed
+static uint64_t updateChecksum(uint64_t checksum, const BlurEngineImage_t * image)
+{
+    for (size_t i = 0; i < image->bytesPerRow * image->height; ++i)
+    {
+        checksum = (checksum ^ image->data[i]) * 0x100000001b3ULL;
+    }
+    return checksum;
+}
+
+static bool recordInputImage(const HeadlessOptions_t * options, const BlurEngineImage_t * inputImage)
+{
+    FrameRecorder_t * recorder = createFrameRecorder(options->recordPath, 4 * inputImage->bytesPerRow * inputImage->height);
+    if (!recorder)
+    {
+        fprintf(stderr, "Can't create %s\n", options->recordPath);
+        return false;
+    }
+
+    // Same chunks as startFrameRecordingToPath: followed by setBlur:animated:
+    frameRecorderAppendView(recorder, 0.0, (uint32_t)options->viewWidth, (uint32_t)options->viewHeight);
+    frameRecorderAppendBlur(recorder, 0.0, 0.0f, 0.0f);
+    frameRecorderAppendBlur(recorder, 0.0, options->intensity, kRecordIntensityTransitionDuration);
+
+    FrameRecordingFrame_t frame = {
+        .pixelFormat = FrameRecordingPixelFormatBGRA,
+        .planeCount = 1,
+    };
+    frame.planes[0] = (FrameRecordingPlane_t){inputImage->data, (uint32_t)inputImage->width, (uint32_t)inputImage->height, 4, inputImage->bytesPerRow};
+
+    // The writer thread is waited for instead of dropping frames (a dropped frame is a gap in the recording)
+    FrameRecorderStatistics_t statistics;
+    for (unsigned int i = 0; i < options->iterations; ++i)
+    {
+        frameRecorderStatistics(recorder, &statistics);
+        while (!statistics.failed && statistics.pendingByteCount > 2 * inputImage->bytesPerRow * inputImage->height)
+        {
+            waitUntil(currentTime() + 0.001);
+            frameRecorderStatistics(recorder, &statistics);
+        }
+
+        frame.timestamp = i * kRecordFrameInterval;
+        frameRecorderAppendFrame(recorder, &frame);
+    }
+
+    frameRecorderStatistics(recorder, &statistics);
+    releaseFrameRecorder(recorder);
+
+    if (statistics.failed)
+    {
+        fprintf(stderr, "Can't write %s\n", options->recordPath);
+        return false;
+    }
+
+    printf("recorded %u frames in %s\n", options->iterations, options->recordPath);
+    return true;
+}
+
+static int replayRecording(const HeadlessOptions_t * options, HeadlessRenderer_t * renderer)
+{
+    FrameReplay_t * replay = createFrameReplay(options->replayPath, !options->stream);
+    if (!replay)
+    {
+        fprintf(stderr, "%s is not a frame recording\n", options->replayPath);
+        return EXIT_FAILURE;
+    }
+
+    size_t viewWidth = options->viewWidth;
+    size_t viewHeight = options->viewHeight;
+    BlurEngineImage_t outputImage = {NULL, 0, 0, 0};
+
+    unsigned long frameCount = 0;
+    unsigned long droppedFrameCount = 0; // Gaps in the frame indexes, dropped by the recorder
+    unsigned long overIntervalFrameCount = 0; // Rendered in more time than the interval to the next recorded frame
+    double renderTime = 0.0;
+    double recordedDuration = 0.0;
+    uint64_t checksum = 0xcbf29ce484222325ULL;
+
+    int status = EXIT_SUCCESS;
+    double startTime = currentTime();
+
+    for (unsigned int i = 0; i < options->iterations && status == EXIT_SUCCESS; ++i)
+    {
+        // Every iteration starts from the same state, the output only depends on the recording
+        FrameReplayBlurTimeline_t timeline;
+        frameReplayBlurTimelineInit(&timeline, options->intensity);
+        frameReplayRewind(replay);
+
+        uint64_t nextFrameIndex = 0;
+        bool firstFrame = true;
+        double firstTimestamp = 0.0, previousTimestamp = 0.0, previousRenderTime = 0.0;
+        double iterationStartTime = currentTime();
+
+        FrameRecordingEvent_t event;
+        while (status == EXIT_SUCCESS && frameReplayNextEvent(replay, &event))
+        {
+            if (event.type == FrameRecordingChunkTypeView)
+            {
+                viewWidth = options->viewSize ? viewWidth : event.view.width;
+                viewHeight = options->viewSize ? viewHeight : event.view.height;
+                continue;
+            }
+
+            if (event.type == FrameRecordingChunkTypeBlur)
+            {
+                frameReplayBlurTimelineApplyEvent(&timeline, event.timestamp, event.blur.intensity, event.blur.transitionDuration);
+                continue;
+            }
+
+            const FrameRecordingFrame_t * frame = &event.frame;
+            droppedFrameCount += frame->frameIndex > nextFrameIndex ? frame->frameIndex - nextFrameIndex : 0;
+            nextFrameIndex = frame->frameIndex + 1;
+
+            if (firstFrame)
+            {
+                firstTimestamp = previousTimestamp = frame->timestamp;
+                iterationStartTime = currentTime();
+            }
+            else if (previousRenderTime > frame->timestamp - previousTimestamp)
+            {
+                ++overIntervalFrameCount;
+            }
+
+            // Original speed: the frame is filtered when it was captured, relative to the first frame
+            if (!options->maxSpeed)
+            {
+                waitUntil(iterationStartTime + (frame->timestamp - firstTimestamp));
+            }
+
+            // Intensity at the capture time, not at the replay time
+            headlessRendererSetFilterIntensity(renderer, frameReplayBlurTimelineIntensity(&timeline, frame->timestamp));
+
+            size_t outputWidth, outputHeight;
+            headlessRendererOutputDimensions(renderer, frame->planes[0].width, frame->planes[0].height, viewWidth, viewHeight, &outputWidth, &outputHeight);
+            if (outputWidth != outputImage.width || outputHeight != outputImage.height)
+            {
+                outputImage.width = outputWidth;
+                outputImage.height = outputHeight;
+                outputImage.bytesPerRow = outputWidth * 4;
+                free(outputImage.data);
+                outputImage.data = malloc(outputImage.bytesPerRow * outputImage.height);
+            }
+
+            bool rendered = false;
+            double frameStartTime = currentTime();
+            if (frame->pixelFormat == FrameRecordingPixelFormatBGRA && frame->planeCount == 1)
+            {
+                BlurEngineImage_t inputImage = {(uint8_t *)frame->planes[0].data, frame->planes[0].width, frame->planes[0].height, frame->planes[0].bytesPerRow};
+                rendered = headlessRendererFilterImage(renderer, &inputImage, viewWidth, viewHeight, &outputImage);
+            }
+            else if (frame->pixelFormat == FrameRecordingPixelFormat420f && frame->planeCount == 2)
+            {
+                BlurEngineYUVImage_t inputImage = {
+                    (uint8_t *)frame->planes[0].data, frame->planes[0].bytesPerRow,
+                    (uint8_t *)frame->planes[1].data, frame->planes[1].bytesPerRow,
+                    frame->planes[0].width, frame->planes[0].height,
+                };
+                rendered = headlessRendererFilterYUVImage(renderer, &inputImage, viewWidth, viewHeight, &outputImage);
+            }
+            previousRenderTime = currentTime() - frameStartTime;
+            renderTime += previousRenderTime;
+
+            if (!rendered)
+            {
+                fprintf(stderr, "Frame %llu failed (pixel format 0x%08x, %u planes)\n", (unsigned long long)frame->frameIndex, frame->pixelFormat, frame->planeCount);
+                status = EXIT_FAILURE;
+                break;
+            }
+
+            checksum = updateChecksum(checksum, &outputImage);
+            recordedDuration += firstFrame ? 0.0 : frame->timestamp - previousTimestamp;
+            previousTimestamp = frame->timestamp;
+            firstFrame = false;
+            ++frameCount;
+        }
+    }
+
+    double elapsedTime = currentTime() - startTime;
+
+    printf("replay of %s (%s): %lu frames (%lu dropped by the recorder), view %zux%zu\n", options->replayPath,
+           frameReplayMemoryMapped(replay) ? "memory-mapped" : "streamed", frameCount, droppedFrameCount, viewWidth, viewHeight);
+    printf("%.3f s recorded, replayed in %.3f s%s, %.3f ms per frame, %lu frames over the capture interval\n", recordedDuration, elapsedTime,
+           options->maxSpeed ? " (max speed)" : "", frameCount ? 1000.0 * renderTime / frameCount : 0.0, overIntervalFrameCount);
+    printf("output checksum %016llx\n", (unsigned long long)checksum);
+
+    if (status == EXIT_SUCCESS && frameCount == 0)
+    {
+        fprintf(stderr, "%s has no frames\n", options->replayPath);
+        status = EXIT_FAILURE;
+    }
+
+    if (status == EXIT_SUCCESS && options->outputPath && !writeOutputImage(options->outputPath, &outputImage))
+    {
+        status = EXIT_FAILURE;
+    }
+
+    free(outputImage.data);
+    releaseFrameReplay(replay);
+
+    return status;
+}
+
+int main(int argc, const char * argv[])
+{
+    HeadlessOptions_t options = {
+        .inputWidth = 1920,
+        .inputHeight = 1080,
+        .viewWidth = 1242,
+        .viewHeight = 2208,
+        .intensity = 1.0f,
+        .multiplePassCount = 2,
+        .downsamplingFactor = 4.0f,
+        .iterations = 1,
+    };
+
+    if (!parseOptions(argc, argv, &options))
+    {
+        fprintf(stderr, "Invalid options, see the usage in main.c\n");
+        return EXIT_FAILURE;
+    }
+
+    char * vertexShaderSource = options.vertexShaderPath ? readFile(options.vertexShaderPath, NULL) : NULL;
+    char * fragmentShaderSource = options.fragmentShaderPath ? readFile(options.fragmentShaderPath, NULL) : NULL;
+
+    if ((options.vertexShaderPath && !vertexShaderSource) || (options.fragmentShaderPath && !fragmentShaderSource))
+    {
+        return EXIT_FAILURE;
+    }
+
+    BlurEngineImage_t inputImage = {NULL, 0, 0, 0};
+    if (!options.replayPath && !loadInputImage(&options, &inputImage))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (options.recordPath)
+    {
+        bool recorded = recordInputImage(&options, &inputImage);
+        free(inputImage.data);
+        free(vertexShaderSource);
+        free(fragmentShaderSource);
+        return recorded ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    double createStartTime = currentTime();
+    HeadlessRenderer_t * renderer = createHeadlessRenderer(vertexShaderSource, fragmentShaderSource, options.programCachePath);
+    double createTime = currentTime() - createStartTime;
+    if (!renderer)
+    {
+        return EXIT_FAILURE;
+    }
+
+    headlessRendererSetFilterParameters(renderer, options.downsamplingFactor, options.multiplePassCount);
+    headlessRendererSetFilterIntensity(renderer, options.intensity);
+    headlessRendererSetPrefilterEnabled(renderer, !options.noPrefilter);
+
+    if (options.kernelBank && !headlessRendererSetKernelBankEnabled(renderer, true))
+    {
+        fprintf(stderr, "Kernel bank not supported (custom shaders, or the bank doesn't fit the uniforms)\n");
+    }
+
+    if (options.intensityMap)
+    {
+        // Frame texture coordinates, the map has the dimensions of the input
+        uint8_t * intensityMap = createIntensityMap(options.intensityMap, options.inputWidth, options.inputHeight);
+        bool intensityMapEnabled = intensityMap && headlessRendererSetIntensityMap(renderer, intensityMap, options.inputWidth, options.inputHeight, options.inputWidth);
+        free(intensityMap);
+
+        if (!intensityMapEnabled)
+        {
+            fprintf(stderr, "Intensity map not supported (needs --kernel-bank, the banks must fit the fragment uniforms)\n");
+            releaseHeadlessRenderer(renderer);
+            free(vertexShaderSource);
+            free(fragmentShaderSource);
+            free(inputImage.data);
+            return EXIT_FAILURE;
+        }
+    }
+
+    headlessRendererSetOutput(renderer, options.output);
+
+    FrameTimings_t * frameTimings = options.timings ? createFrameTimings(options.replayPath ? kReplayFrameTimingsCapacity : options.iterations) : NULL;
+    headlessRendererSetFrameTimings(renderer, frameTimings);
+
+    if (options.replayPath)
+    {
+        printf("renderer: %s\n", headlessRendererName(renderer));
+        int status = replayRecording(&options, renderer);
+
+        if (frameTimings)
+        {
+            printFrameTimings(frameTimings);
+        }
+
+        releaseFrameTimings(frameTimings);
+        releaseHeadlessRenderer(renderer);
+        free(vertexShaderSource);
+        free(fragmentShaderSource);
+
+        return status;
+    }
+
+    BlurEngineImage_t outputImage;
+    headlessRendererOutputDimensions(renderer, inputImage.width, inputImage.height, options.viewWidth, options.viewHeight, &outputImage.width, &outputImage.height);
+    outputImage.bytesPerRow = outputImage.width * 4;
+    outputImage.data = malloc(outputImage.bytesPerRow * outputImage.height);
+
+    ProgramCacheStatistics_t programCacheStatistics;
+    headlessRendererProgramCacheStatistics(renderer, &programCacheStatistics);
+
+    printf("renderer: %s\n", headlessRendererName(renderer));
+    printf("renderer created in %.3f ms, program cache %lu hits, %lu misses (%lu stale), compile %.3f ms, load %.3f ms\n", 1000.0 * createTime,
+           programCacheStatistics.hitCount, programCacheStatistics.missCount, programCacheStatistics.staleCount,
+           1000.0 * programCacheStatistics.compileTime, 1000.0 * programCacheStatistics.loadTime);
+    printf("input %zux%zu, view %zux%zu, output %zux%zu, intensity %.3f, %u passes%s%s%s%s\n", inputImage.width, inputImage.height, options.viewWidth, options.viewHeight, outputImage.width, outputImage.height, options.intensity, options.multiplePassCount,
+           headlessRendererPrefilterEnabled(renderer) ? ", prefiltered first pass" : "", headlessRendererKernelBankEnabled(renderer) ? ", kernel bank" : "",
+           headlessRendererIntensityMapEnabled(renderer) ? ", intensity map " : "", headlessRendererIntensityMapEnabled(renderer) ? options.intensityMap : "");
+
+    // The readback waits for the passes, each iteration is a complete frame
+    int status = EXIT_SUCCESS;
+    double startTime = currentTime();
+    for (unsigned int i = 0; i < options.iterations && status == EXIT_SUCCESS; ++i)
+    {
+        bool rendered;
+
+        // Odd frames are rendered in the other orientation, the output is the last even frame
+        if (options.rotate && (i % 2) == 1)
+        {
+            BlurEngineImage_t rotatedImage;
+            headlessRendererOutputDimensions(renderer, inputImage.width, inputImage.height, options.viewHeight, options.viewWidth, &rotatedImage.width, &rotatedImage.height);
+            rotatedImage.bytesPerRow = rotatedImage.width * 4;
+            rotatedImage.data = malloc(rotatedImage.bytesPerRow * rotatedImage.height);
+            rendered = headlessRendererFilterImage(renderer, &inputImage, options.viewHeight, options.viewWidth, &rotatedImage);
+            free(rotatedImage.data);
+        }
+        else
+        {
+            rendered = headlessRendererFilterImage(renderer, &inputImage, options.viewWidth, options.viewHeight, &outputImage);
+        }
+
+        if (!rendered)
+        {
+            fprintf(stderr, "Frame %u failed\n", i);
+            status = EXIT_FAILURE;
+        }
+    }
+    double elapsedTime = currentTime() - startTime;
+
+    printf("%u frames, %.3f ms per frame\n", options.iterations, 1000.0 * elapsedTime / options.iterations);
+
+    RenderTargetPoolStatistics_t renderTargetPoolStatistics;
+    headlessRendererRenderTargetPoolStatistics(renderer, &renderTargetPoolStatistics);
+    printf("render targets: %u live (%zu bytes, peak %zu), %lu allocations, %lu reuses, %lu evictions\n",
+           renderTargetPoolStatistics.liveTargetCount, renderTargetPoolStatistics.liveByteCount, renderTargetPoolStatistics.peakByteCount,
+           renderTargetPoolStatistics.allocationCount, renderTargetPoolStatistics.reuseCount, renderTargetPoolStatistics.evictionCount);
+
+    if (frameTimings)
+    {
+        printFrameTimings(frameTimings);
+    }
+
+    if (headlessRendererProgramSamples(renderer))
+    {
+        printf("program variant for %u kernel samples\n", headlessRendererProgramSamples(renderer));
+    }
+
+    if (status == EXIT_SUCCESS && options.compare && options.output == HeadlessRendererOutputOffscreen)
+    {
+        int maxDifference = compareWithBlurEngine(&options, renderer, &inputImage, &outputImage);
+        printf("max difference with the CPU blur engine: %d\n", maxDifference);
+    }
+
+    if (status == EXIT_SUCCESS && options.outputPath && !writeOutputImage(options.outputPath, &outputImage))
+    {
+        status = EXIT_FAILURE;
+    }
+
+    releaseFrameTimings(frameTimings);
+    releaseHeadlessRenderer(renderer);
+    free(inputImage.data);
+    free(outputImage.data);
+    free(vertexShaderSource);
+    free(fragmentShaderSource);
+
+    return status;
+}
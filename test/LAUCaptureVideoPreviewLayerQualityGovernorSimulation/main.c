@@ -0,0 +1,702 @@
+/*
+
+ main.c
+ LAUCaptureVideoPreviewLayer Quality Governor Simulation
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+/*
+ Quality governor simulation on Linux, LAUCaptureVideoPreviewLayerQualityGovernor driven by recorded frame times
+
+ The recorded frame times (recorded-frame-timings.csv) are the render times of the headless GL pipeline at each
+ default level: 1080p frames, 750x1334 view (onscreen copy and readback included), largest blur. The frame time of a
+ simulated frame at level l is the next recorded time of level l multiplied by a load factor (ie. thermal throttling).
+ The budget is 1.25 times the p90 of level 0, so level 0 fits without load.
+
+ 1. Steady: no load, the governor stays at level 0
+ 2. Throttling: under load the governor lowers the quality within 2 windows and then keeps the windows under
+    budget, without oscillating. It's back to level 0 once the load is gone
+ 3. Borderline: frame times around the budget with noise, hysteresis keeps the level changes rare
+    Mispredicted: level costs measured on another device, the raises that don't fit are backed off
+ 4. Custom policy: a policy set with qualityGovernorSetPolicy picks the levels
+ 5. Sigma: the kernel sigma of each level keeps the effective std. deviation of level 0 (unless clamped)
+
+ Build (from the repository root):
+
+ make build/QualityGovernorSimulation && build/QualityGovernorSimulation (or make check for all the tests)
+
+ Usage:
+
+ QualityGovernorSimulation [--timings <recorded-frame-timings.csv>] [--record <recorded-frame-timings.csv>] [--verbose]
+
+ --record renders the frames with the headless renderer and writes the frame times instead of running the simulation.
+ The level costs of kQualityGovernorDefaultLevels are printed with --verbose (relative p50 of the recorded times).
+
+ Prints PASS and exits with 0 on success, each failure is printed to stderr.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "LAUCaptureVideoPreviewLayerHeadlessRenderer.h"
+#include "LAUCaptureVideoPreviewLayerGaussianFilterKernel.h"
+#include "LAUCaptureVideoPreviewLayerQualityGovernor.h"
+
+// Recorded frames (same as the view of the golden-image tests)
+#define kRecordInputWidth 1920
+#define kRecordInputHeight 1080
+#define kRecordViewWidth 750
+#define kRecordViewHeight 1334
+#define kRecordWarmupFrameCount 5
+#define kRecordFrameCount 60
+
+#define kSimulationMaxLevelCount 8
+#define kSimulationMaxFrameCount 1024
+
+// Budget relative to the p90 of level 0
+#define kSimulationBudgetScale 1.25
+
+// Simulated frames per phase
+#define kSimulationPhaseFrameCount 1800
+
+// Throttling load, the cheapest level must fit with a margin
+#define kSimulationMaxThrottlingLoad 2.0
+#define kSimulationThrottlingLoadMargin 0.85
+
+// Windows allowed over budget once the governor settled, and level changes while throttled
+#define kSimulationSettleWindowCount 3
+#define kSimulationMaxOverBudgetWindowRatio 0.1
+#define kSimulationMaxThrottlingLevelChangeCount 6
+
+// Noise of the borderline frame times, and level changes allowed
+#define kSimulationBorderlineNoise 0.15
+#define kSimulationMaxBorderlineLevelChangeCount 8
+
+// Level 0 over budget but predicted to fit (cost underestimated), and level changes allowed (raise backoff)
+#define kSimulationMispredictedLoad 1.1
+#define kSimulationMispredictedCost 0.6f
+#define kSimulationMaxMispredictedLevelChangeCount 12
+
+// Effective std. deviation of the unclamped kernel sigmas, relative to level 0
+#define kSimulationMaxSigmaError 1e-3
+
+struct RecordedFrameTimings {
+    double frameTimes[kSimulationMaxLevelCount][kSimulationMaxFrameCount];
+    unsigned int frameCounts[kSimulationMaxLevelCount];
+    unsigned int levelCount;
+};
+
+typedef struct RecordedFrameTimings RecordedFrameTimings_t;
+
+static bool verbose;
+
+static double currentTime(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static int compareDoubles(const void * a, const void * b)
+{
+    double value = *(const double *)a;
+    double otherValue = *(const double *)b;
+    return (value > otherValue) - (value < otherValue);
+}
+
+// Nearest rank percentile (same as the governor windows)
+static double percentile(const double * values, unsigned int count, double p)
+{
+    double sortedValues[kSimulationMaxFrameCount];
+    memcpy(sortedValues, values, count * sizeof(double));
+    qsort(sortedValues, count, sizeof(double), compareDoubles);
+
+    unsigned int rank = (unsigned int)ceil(p * count);
+    return sortedValues[rank > 0 ? rank - 1 : 0];
+}
+
+// Kernel step of a level, same blur as the largest one at level 0
+static float levelFilterStep(const QualityGovernorLevel_t * level, const GaussianFilterKernelParameters_t * parameters)
+{
+    float sigma = qualityGovernorKernelSigma(level, &kQualityGovernorDefaultLevels[0], parameters->maxSigma, parameters);
+    return gaussianFilterStepForSigma(parameters, sigma);
+}
+
+#pragma mark -
+#pragma mark Recording
+
+static bool recordFrameTimings(const char * path)
+{
+    HeadlessRenderer_t * renderer = createHeadlessRenderer(NULL, NULL, NULL);
+    if (!renderer)
+    {
+        fprintf(stderr, "FAIL: can't create the headless renderer\n");
+        return false;
+    }
+
+    FILE * file = fopen(path, "w");
+    if (!file)
+    {
+        fprintf(stderr, "FAIL: can't write %s\n", path);
+        releaseHeadlessRenderer(renderer);
+        return false;
+    }
+
+    BlurEngineImage_t inputImage, outputImage;
+    inputImage.width = kRecordInputWidth;
+    inputImage.height = kRecordInputHeight;
+    inputImage.bytesPerRow = kRecordInputWidth * 4;
+    inputImage.data = malloc(inputImage.bytesPerRow * inputImage.height);
+    outputImage.width = kRecordViewWidth;
+    outputImage.height = kRecordViewHeight;
+    outputImage.bytesPerRow = kRecordViewWidth * 4;
+    outputImage.data = malloc(outputImage.bytesPerRow * outputImage.height);
+
+    bool recorded = inputImage.data && outputImage.data;
+
+    // Gradients, the content doesn't change the frame time
+    for (size_t y = 0; recorded && y < inputImage.height; ++y)
+    {
+        for (size_t x = 0; x < inputImage.width; ++x)
+        {
+            uint8_t * pixel = inputImage.data + y * inputImage.bytesPerRow + 4 * x;
+            pixel[0] = (uint8_t)x;
+            pixel[1] = (uint8_t)y;
+            pixel[2] = (uint8_t)(x + y);
+            pixel[3] = 255;
+        }
+    }
+
+    fprintf(file, "# Headless renderer (%s), %ux%u frames, %ux%u view, onscreen copy\n", headlessRendererName(renderer), kRecordInputWidth, kRecordInputHeight, kRecordViewWidth, kRecordViewHeight);
+    fprintf(file, "# level,frameTime\n");
+
+    headlessRendererSetOutput(renderer, HeadlessRendererOutputOnscreenCopy);
+
+    for (unsigned int l = 0; recorded && l < kQualityGovernorDefaultLevelCount; ++l)
+    {
+        const QualityGovernorLevel_t * level = &kQualityGovernorDefaultLevels[l];
+
+        headlessRendererSetFilterParameters(renderer, level->downsamplingFactor, level->multiplePassCount);
+        headlessRendererSetFilterIntensity(renderer, levelFilterStep(level, headlessRendererFilterKernelParameters(renderer)));
+
+        for (unsigned int f = 0; recorded && f < kRecordWarmupFrameCount + kRecordFrameCount; ++f)
+        {
+            double startTime = currentTime();
+            recorded = headlessRendererFilterImage(renderer, &inputImage, kRecordViewWidth, kRecordViewHeight, &outputImage);
+            double frameTime = currentTime() - startTime;
+
+            if (f >= kRecordWarmupFrameCount)
+            {
+                fprintf(file, "%u,%.6f\n", l, frameTime);
+            }
+        }
+    }
+
+    if (!recorded)
+    {
+        fprintf(stderr, "FAIL: can't render the frames\n");
+    }
+
+    free(inputImage.data);
+    free(outputImage.data);
+    fclose(file);
+    releaseHeadlessRenderer(renderer);
+
+    return recorded;
+}
+
+static bool loadFrameTimings(const char * path, RecordedFrameTimings_t * timings)
+{
+    memset(timings, 0, sizeof(RecordedFrameTimings_t));
+
+    FILE * file = fopen(path, "r");
+    if (!file)
+    {
+        fprintf(stderr, "FAIL: can't open %s\n", path);
+        return false;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        unsigned int levelIndex;
+        double frameTime;
+
+        if (line[0] == '#' || sscanf(line, "%u,%lf", &levelIndex, &frameTime) != 2)
+        {
+            continue;
+        }
+
+        if (levelIndex < kSimulationMaxLevelCount && timings->frameCounts[levelIndex] < kSimulationMaxFrameCount)
+        {
+            timings->frameTimes[levelIndex][timings->frameCounts[levelIndex]++] = frameTime;
+            timings->levelCount = levelIndex + 1 > timings->levelCount ? levelIndex + 1 : timings->levelCount;
+        }
+    }
+
+    fclose(file);
+
+    for (unsigned int l = 0; l < timings->levelCount; ++l)
+    {
+        if (timings->frameCounts[l] == 0)
+        {
+            fprintf(stderr, "FAIL: %s has no frame times for level %u\n", path, l);
+            return false;
+        }
+    }
+
+    if (timings->levelCount != kQualityGovernorDefaultLevelCount)
+    {
+        fprintf(stderr, "FAIL: %s has %u levels, kQualityGovernorDefaultLevels has %u\n", path, timings->levelCount, kQualityGovernorDefaultLevelCount);
+        return false;
+    }
+
+    return true;
+}
+
+#pragma mark -
+#pragma mark Simulation
+
+// Deterministic noise [-1,1]
+static double noise(unsigned int * state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return ((*state >> 8) / (double)(1u << 24)) * 2.0 - 1.0;
+}
+
+struct SimulationPhase {
+    double load;
+    double noise; // Relative amplitude
+    unsigned int frameCount;
+};
+
+typedef struct SimulationPhase SimulationPhase_t;
+
+struct SimulationResult {
+    unsigned int levelChangeCount;
+    unsigned int windowCount;
+    unsigned int overBudgetWindowCount; // After kSimulationSettleWindowCount windows
+    unsigned int firstLowerWindow; // Index of the first window followed by a lower level, UINT32_MAX if none
+    unsigned int finalLevelIndex;
+};
+
+typedef struct SimulationResult SimulationResult_t;
+
+static void printLevelTrace(const char * description, const char * trace)
+{
+    if (verbose)
+    {
+        printf("%-24s %s\n", description, trace);
+    }
+}
+
+// Runs a phase, *frameIndex is the index of the next recorded frame
+static void simulatePhase(QualityGovernor_t * governor, const RecordedFrameTimings_t * timings, const SimulationPhase_t * phase, unsigned int * frameIndex, unsigned int * noiseState, unsigned int windowFrameCount, SimulationResult_t * result, char * trace, size_t traceSize)
+{
+    memset(result, 0, sizeof(SimulationResult_t));
+    result->firstLowerWindow = UINT32_MAX;
+
+    double windowFrameTimes[kSimulationMaxFrameCount];
+    unsigned int windowFrameTimeCount = 0;
+    size_t traceLength = strlen(trace);
+
+    for (unsigned int f = 0; f < phase->frameCount; ++f, ++*frameIndex)
+    {
+        unsigned int levelIndex = qualityGovernorLevelIndex(governor);
+        double frameTime = timings->frameTimes[levelIndex][*frameIndex % timings->frameCounts[levelIndex]] * phase->load;
+        frameTime *= 1.0 + phase->noise * noise(noiseState);
+
+        windowFrameTimes[windowFrameTimeCount++] = frameTime;
+
+        bool levelChanged = qualityGovernorAddFrameTime(governor, frameTime);
+
+        if (windowFrameTimeCount == windowFrameCount)
+        {
+            if (result->windowCount >= kSimulationSettleWindowCount && percentile(windowFrameTimes, windowFrameTimeCount, 0.9) > qualityGovernorFrameBudget(governor))
+            {
+                result->overBudgetWindowCount++;
+            }
+
+            if (levelChanged && qualityGovernorLevelIndex(governor) > levelIndex && result->firstLowerWindow == UINT32_MAX)
+            {
+                result->firstLowerWindow = result->windowCount;
+            }
+
+            if (traceLength + 1 < traceSize)
+            {
+                trace[traceLength++] = (char)('0' + qualityGovernorLevelIndex(governor));
+                trace[traceLength] = '\0';
+            }
+
+            result->windowCount++;
+            windowFrameTimeCount = 0;
+        }
+
+        result->levelChangeCount += levelChanged;
+    }
+
+    result->finalLevelIndex = qualityGovernorLevelIndex(governor);
+}
+
+static bool testSteady(const RecordedFrameTimings_t * timings, double frameBudget)
+{
+    QualityGovernor_t * governor = createQualityGovernor(NULL, 0, NULL);
+    qualityGovernorSetFrameBudget(governor, frameBudget);
+
+    SimulationPhase_t phase = { 1.0, 0.0, kSimulationPhaseFrameCount };
+    SimulationResult_t result;
+    unsigned int frameIndex = 0, noiseState = 1;
+    char trace[256] = "";
+
+    simulatePhase(governor, timings, &phase, &frameIndex, &noiseState, kQualityGovernorDefaultParameters.windowFrameCount, &result, trace, sizeof(trace));
+    printLevelTrace("steady", trace);
+
+    bool passed = result.levelChangeCount == 0 && result.finalLevelIndex == 0;
+    if (!passed)
+    {
+        fprintf(stderr, "FAIL: steady, %u level changes without load\n", result.levelChangeCount);
+    }
+
+    releaseQualityGovernor(governor);
+    return passed;
+}
+
+static bool testThrottling(const RecordedFrameTimings_t * timings, double frameBudget)
+{
+    QualityGovernor_t * governor = createQualityGovernor(NULL, 0, NULL);
+    qualityGovernorSetFrameBudget(governor, frameBudget);
+
+    // Largest load the cheapest level absorbs (it must still be a load for level 0)
+    unsigned int cheapestLevelIndex = timings->levelCount - 1;
+    double cheapestFrameTime = percentile(timings->frameTimes[cheapestLevelIndex], timings->frameCounts[cheapestLevelIndex], 0.9);
+    double load = fmin(kSimulationMaxThrottlingLoad, kSimulationThrottlingLoadMargin * frameBudget / cheapestFrameTime);
+
+    if (load * percentile(timings->frameTimes[0], timings->frameCounts[0], 0.9) <= frameBudget)
+    {
+        fprintf(stderr, "FAIL: throttling, the cheapest level isn't cheap enough to absorb a load (frame time %.2fms, budget %.2fms)\n", cheapestFrameTime * 1e3, frameBudget * 1e3);
+        releaseQualityGovernor(governor);
+        return false;
+    }
+
+    unsigned int windowFrameCount = kQualityGovernorDefaultParameters.windowFrameCount;
+    SimulationPhase_t phases[] = {
+        { 1.0, 0.0, kSimulationPhaseFrameCount },
+        { load, 0.0, kSimulationPhaseFrameCount },
+        { 1.0, 0.0, kSimulationPhaseFrameCount },
+    };
+    SimulationResult_t results[3];
+    unsigned int frameIndex = 0, noiseState = 1;
+    char trace[256] = "";
+
+    for (unsigned int p = 0; p < 3; ++p)
+    {
+        simulatePhase(governor, timings, &phases[p], &frameIndex, &noiseState, windowFrameCount, &results[p], trace, sizeof(trace));
+        if (p < 2)
+        {
+            strncat(trace, "|", sizeof(trace) - strlen(trace) - 1);
+        }
+    }
+
+    char description[64];
+    snprintf(description, sizeof(description), "throttling (load %.2f)", load);
+    printLevelTrace(description, trace);
+
+    bool passed = true;
+
+    if (results[1].firstLowerWindow > 1)
+    {
+        fprintf(stderr, "FAIL: throttling, the quality wasn't lowered within 2 windows (window %u)\n", results[1].firstLowerWindow);
+        passed = false;
+    }
+
+    unsigned int settledWindowCount = results[1].windowCount - kSimulationSettleWindowCount;
+    if (results[1].overBudgetWindowCount > kSimulationMaxOverBudgetWindowRatio * settledWindowCount)
+    {
+        fprintf(stderr, "FAIL: throttling, %u of %u windows over budget once settled\n", results[1].overBudgetWindowCount, settledWindowCount);
+        passed = false;
+    }
+
+    if (results[1].levelChangeCount > kSimulationMaxThrottlingLevelChangeCount)
+    {
+        fprintf(stderr, "FAIL: throttling, %u level changes (oscillation)\n", results[1].levelChangeCount);
+        passed = false;
+    }
+
+    if (results[2].finalLevelIndex != 0)
+    {
+        fprintf(stderr, "FAIL: throttling, level %u after the load is gone\n", results[2].finalLevelIndex);
+        passed = false;
+    }
+
+    releaseQualityGovernor(governor);
+    return passed;
+}
+
+static bool testBorderline(const RecordedFrameTimings_t * timings, double frameBudget)
+{
+    QualityGovernor_t * governor = createQualityGovernor(NULL, 0, NULL);
+    qualityGovernorSetFrameBudget(governor, frameBudget);
+
+    // Level 0 right at the budget
+    double load = frameBudget / percentile(timings->frameTimes[0], timings->frameCounts[0], 0.9);
+
+    SimulationPhase_t phase = { load, kSimulationBorderlineNoise, 2 * kSimulationPhaseFrameCount };
+    SimulationResult_t result;
+    unsigned int frameIndex = 0, noiseState = 1;
+    char trace[256] = "";
+
+    simulatePhase(governor, timings, &phase, &frameIndex, &noiseState, kQualityGovernorDefaultParameters.windowFrameCount, &result, trace, sizeof(trace));
+    printLevelTrace("borderline", trace);
+
+    bool passed = result.levelChangeCount <= kSimulationMaxBorderlineLevelChangeCount;
+    if (!passed)
+    {
+        fprintf(stderr, "FAIL: borderline, %u level changes in %u windows\n", result.levelChangeCount, result.windowCount);
+    }
+
+    releaseQualityGovernor(governor);
+    return passed;
+}
+
+static bool testMispredictedCosts(const RecordedFrameTimings_t * timings, double frameBudget)
+{
+    QualityGovernorLevel_t levels[kSimulationMaxLevelCount];
+    memcpy(levels, kQualityGovernorDefaultLevels, kQualityGovernorDefaultLevelCount * sizeof(QualityGovernorLevel_t));
+    levels[0].cost = kSimulationMispredictedCost;
+
+    QualityGovernor_t * governor = createQualityGovernor(levels, kQualityGovernorDefaultLevelCount, NULL);
+    qualityGovernorSetFrameBudget(governor, frameBudget);
+
+    double load = kSimulationMispredictedLoad * frameBudget / percentile(timings->frameTimes[0], timings->frameCounts[0], 0.9);
+
+    SimulationPhase_t phase = { load, 0.0, 2 * kSimulationPhaseFrameCount };
+    SimulationResult_t result;
+    unsigned int frameIndex = 0, noiseState = 1;
+    char trace[256] = "";
+
+    simulatePhase(governor, timings, &phase, &frameIndex, &noiseState, kQualityGovernorDefaultParameters.windowFrameCount, &result, trace, sizeof(trace));
+    printLevelTrace("mispredicted", trace);
+
+    bool passed = result.levelChangeCount <= kSimulationMaxMispredictedLevelChangeCount;
+    if (!passed)
+    {
+        fprintf(stderr, "FAIL: mispredicted, %u level changes in %u windows\n", result.levelChangeCount, result.windowCount);
+    }
+
+    releaseQualityGovernor(governor);
+    return passed;
+}
+
+struct CheapestLevelPolicy {
+    unsigned int windowCount;
+    unsigned int resetCount;
+};
+
+static unsigned int cheapestLevelPolicySelectLevel(void * context, const QualityGovernorWindow_t * window)
+{
+    struct CheapestLevelPolicy * policy = (struct CheapestLevelPolicy *)context;
+    policy->windowCount++;
+    return window->levelCount - 1;
+}
+
+static void cheapestLevelPolicyReset(void * context)
+{
+    ((struct CheapestLevelPolicy *)context)->resetCount++;
+}
+
+static bool testCustomPolicy(const RecordedFrameTimings_t * timings, double frameBudget)
+{
+    QualityGovernor_t * governor = createQualityGovernor(NULL, 0, NULL);
+    qualityGovernorSetFrameBudget(governor, frameBudget);
+
+    struct CheapestLevelPolicy cheapestLevelPolicy = { 0, 0 };
+    QualityGovernorPolicy_t policy = { cheapestLevelPolicySelectLevel, cheapestLevelPolicyReset, &cheapestLevelPolicy };
+    qualityGovernorSetPolicy(governor, &policy);
+
+    SimulationPhase_t phase = { 1.0, 0.0, 4 * kQualityGovernorDefaultParameters.windowFrameCount };
+    SimulationResult_t result;
+    unsigned int frameIndex = 0, noiseState = 1;
+    char trace[256] = "";
+
+    simulatePhase(governor, timings, &phase, &frameIndex, &noiseState, kQualityGovernorDefaultParameters.windowFrameCount, &result, trace, sizeof(trace));
+    printLevelTrace("custom policy", trace);
+
+    bool passed = cheapestLevelPolicy.windowCount == 4 && cheapestLevelPolicy.resetCount == 1 &&
+                  result.levelChangeCount == 1 && result.finalLevelIndex == timings->levelCount - 1;
+
+    qualityGovernorReset(governor);
+    passed = passed && cheapestLevelPolicy.resetCount == 2 && qualityGovernorLevelIndex(governor) == 0;
+
+    if (!passed)
+    {
+        fprintf(stderr, "FAIL: custom policy, %u windows, %u resets, %u level changes\n", cheapestLevelPolicy.windowCount, cheapestLevelPolicy.resetCount, result.levelChangeCount);
+    }
+
+    releaseQualityGovernor(governor);
+    return passed;
+}
+
+static bool testSigma(void)
+{
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+    const QualityGovernorLevel_t * referenceLevel = &kQualityGovernorDefaultLevels[0];
+    bool passed = true;
+
+    for (unsigned int l = 0; l < kQualityGovernorDefaultLevelCount; ++l)
+    {
+        const QualityGovernorLevel_t * level = &kQualityGovernorDefaultLevels[l];
+        double maxError = 0.0;
+        unsigned int clampedCount = 0, count = 0;
+
+        for (float step = 0.0f; step <= 1.0f; step += 1.0f / 64.0f, ++count)
+        {
+            float sigma = gaussianFilterSigmaForStep(parameters, step);
+            float kernelSigma = qualityGovernorKernelSigma(level, referenceLevel, sigma, parameters);
+            float kernelStep = gaussianFilterStepForSigma(parameters, kernelSigma);
+
+            // Unclamped kernels of the level: same effective std. deviation and a kernel within maxSamples
+            unsigned int samples = btsGaussianFilterSamplesForSize(gaussianFilterSizeForSigma(kernelSigma, parameters->truncation));
+            if (level->maxSamples && samples > level->maxSamples)
+            {
+                fprintf(stderr, "FAIL: sigma, level %u kernel has %u samples (max %u)\n", l, samples, level->maxSamples);
+                passed = false;
+            }
+
+            double referenceSigma = qualityGovernorEffectiveSigma(referenceLevel, sigma);
+            double effectiveSigma = qualityGovernorEffectiveSigma(level, gaussianFilterSigmaForStep(parameters, kernelStep));
+            double error = fabs(effectiveSigma - referenceSigma) / referenceSigma;
+
+            if (error > kSimulationMaxSigmaError)
+            {
+                // Clamped, the closest sigma available
+                bool clampedToRange = kernelSigma == parameters->minSigma || kernelSigma == parameters->maxSigma;
+                bool clampedToSamples = level->maxSamples && kernelSigma == (2.0f * level->maxSamples - 1.0f) / parameters->truncation;
+
+                if (!clampedToRange && !clampedToSamples)
+                {
+                    fprintf(stderr, "FAIL: sigma, level %u step %.3f effective sigma %.3f instead of %.3f\n", l, step, effectiveSigma, referenceSigma);
+                    passed = false;
+                }
+
+                clampedCount++;
+            }
+            else
+            {
+                maxError = fmax(maxError, error);
+            }
+        }
+
+        if (verbose)
+        {
+            printf("level %u (downsampling %.0f, %u passes, max samples %u): sigma error %.2e, %u of %u sigmas clamped\n",
+                   l, level->downsamplingFactor, level->multiplePassCount, level->maxSamples, maxError, clampedCount, count);
+        }
+    }
+
+    return passed;
+}
+
+int main(int argc, const char * argv[])
+{
+    const char * timingsPath = "test/LAUCaptureVideoPreviewLayerQualityGovernorSimulation/recorded-frame-timings.csv";
+    const char * recordPath = NULL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--verbose") == 0)
+        {
+            verbose = true;
+        }
+        else if (strcmp(argv[i], "--timings") == 0 && i + 1 < argc)
+        {
+            timingsPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            recordPath = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Invalid options, see the usage in main.c\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (recordPath)
+    {
+        timingsPath = recordPath;
+
+        if (!recordFrameTimings(recordPath))
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    RecordedFrameTimings_t * timings = malloc(sizeof(RecordedFrameTimings_t));
+
+    if (!timings || !loadFrameTimings(timingsPath, timings))
+    {
+        free(timings);
+        return EXIT_FAILURE;
+    }
+
+    double levelZeroFrameTime = percentile(timings->frameTimes[0], timings->frameCounts[0], 0.5);
+    double frameBudget = kSimulationBudgetScale * percentile(timings->frameTimes[0], timings->frameCounts[0], 0.9);
+
+    if (verbose)
+    {
+        printf("budget %.2fms\n", frameBudget * 1e3);
+
+        for (unsigned int l = 0; l < timings->levelCount; ++l)
+        {
+            double frameTime = percentile(timings->frameTimes[l], timings->frameCounts[l], 0.5);
+            printf("level %u: p50 %.2fms, p90 %.2fms, cost %.2f (kQualityGovernorDefaultLevels %.2f)\n", l, frameTime * 1e3,
+                   percentile(timings->frameTimes[l], timings->frameCounts[l], 0.9) * 1e3, frameTime / levelZeroFrameTime, kQualityGovernorDefaultLevels[l].cost);
+        }
+    }
+
+    bool passed = true;
+
+    if (!recordPath)
+    {
+        passed = testSteady(timings, frameBudget) && passed;
+        passed = testThrottling(timings, frameBudget) && passed;
+        passed = testBorderline(timings, frameBudget) && passed;
+        passed = testMispredictedCosts(timings, frameBudget) && passed;
+        passed = testCustomPolicy(timings, frameBudget) && passed;
+        passed = testSigma() && passed;
+    }
+
+    free(timings);
+
+    if (!passed)
+    {
+        return EXIT_FAILURE;
+    }
+
+    printf("PASS\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,181 @@
+/*
+ 
+ LAUCaptureVideoPreviewLayerFrameQueueStressTest.c
+ LAUCaptureVideoPreviewLayer Tests
+ 
+ Stress test of the frame queue, runs without Xcode (ie. Linux with ThreadSanitizer):
+ 
+ make build/FrameQueueStressTest && build/FrameQueueStressTest (or make check for all the tests)
+ 
+ For every policy and a few depths, the producer enqueues refcounted frames as fast as it can
+ (hundreds of thousands per second), the consumer takes them and checks the frame contents.
+ The test fails if:
+ - a frame is read after being freed (ThreadSanitizer/AddressSanitizer report)
+ - frames are taken out of order or more than once
+ - a frame is leaked or released too many times
+ - the counters don't add up (enqueued = dropped + taken + queued)
+ 
+ */
+
+#include "LAUCaptureVideoPreviewLayerFrameQueue.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define kStressTestFrameCount 200000
+#define kStressTestFramePayloadSize 16
+
+struct StressTestFrame {
+    atomic_int retainCount;
+    unsigned int number;
+    unsigned int payload[kStressTestFramePayloadSize]; // Written by the producer, checked by the consumer
+};
+
+typedef struct StressTestFrame StressTestFrame_t;
+
+static atomic_long liveFrameCount;
+static atomic_int producerDone;
+
+static const void * retainStressTestFrame(const void * frame)
+{
+    atomic_fetch_add_explicit(&((StressTestFrame_t *)frame)->retainCount, 1, memory_order_relaxed);
+    return frame;
+}
+
+static void releaseStressTestFrame(const void * frame)
+{
+    StressTestFrame_t * stressTestFrame = (StressTestFrame_t *)frame;
+    
+    int retainCount = atomic_fetch_sub_explicit(&stressTestFrame->retainCount, 1, memory_order_acq_rel);
+    
+    if (retainCount <= 0)
+    {
+        fprintf(stderr, "FAIL: frame %u over-released\n", stressTestFrame->number);
+        abort();
+    }
+    
+    if (retainCount == 1)
+    {
+        atomic_fetch_sub_explicit(&liveFrameCount, 1, memory_order_relaxed);
+        free(stressTestFrame);
+    }
+}
+
+static void * producer(void * queue)
+{
+    for (unsigned int i = 0; i < kStressTestFrameCount; ++i)
+    {
+        StressTestFrame_t * frame = malloc(sizeof(StressTestFrame_t));
+        atomic_init(&frame->retainCount, 1);
+        frame->number = i;
+        for (unsigned int p = 0; p < kStressTestFramePayloadSize; ++p)
+        {
+            frame->payload[p] = i + p;
+        }
+        atomic_fetch_add_explicit(&liveFrameCount, 1, memory_order_relaxed);
+        
+        // Same as captureOutput:didOutputSampleBuffer:fromConnection: (the capture pipeline releases its reference)
+        frameQueueEnqueueFrame(queue, frame, (double)i);
+        releaseStressTestFrame(frame);
+    }
+    
+    atomic_store_explicit(&producerDone, 1, memory_order_release);
+    
+    return NULL;
+}
+
+static int runStressTest(unsigned int depth, FrameQueuePolicy_t policy)
+{
+    FrameQueue_t * queue = createFrameQueue(depth, policy, retainStressTestFrame, releaseStressTestFrame);
+    atomic_store(&producerDone, 0);
+    
+    pthread_t producerThread;
+    pthread_create(&producerThread, NULL, producer, queue);
+    
+    // Consumer (display link)
+    long lastFrameNumber = -1;
+    
+    for (;;)
+    {
+        int done = atomic_load_explicit(&producerDone, memory_order_acquire);
+        
+        double timestamp;
+        const StressTestFrame_t * frame = frameQueueTakeFrame(queue, (double)kStressTestFrameCount, &timestamp);
+        
+        if (frame)
+        {
+            if ((long)frame->number <= lastFrameNumber || timestamp != (double)frame->number)
+            {
+                fprintf(stderr, "FAIL: frame %u taken after frame %ld\n", frame->number, lastFrameNumber);
+                return EXIT_FAILURE;
+            }
+            
+            for (unsigned int p = 0; p < kStressTestFramePayloadSize; ++p)
+            {
+                if (frame->payload[p] != frame->number + p)
+                {
+                    fprintf(stderr, "FAIL: frame %u has corrupted payload\n", frame->number);
+                    return EXIT_FAILURE;
+                }
+            }
+            
+            lastFrameNumber = frame->number;
+        }
+        else if (done)
+        {
+            break;
+        }
+    }
+    
+    pthread_join(producerThread, NULL);
+    
+    FrameQueueStatistics_t statistics;
+    frameQueueStatistics(queue, &statistics);
+    printf("depth %u, policy %d: %lu enqueued, %lu dropped, %lu taken, max age %.0f frames\n", depth, policy, statistics.enqueuedFrameCount, statistics.droppedFrameCount, statistics.takenFrameCount, statistics.maxFrameAge);
+    
+    if (statistics.enqueuedFrameCount != kStressTestFrameCount ||
+        statistics.enqueuedFrameCount != statistics.droppedFrameCount + statistics.takenFrameCount + statistics.queuedFrameCount)
+    {
+        fprintf(stderr, "FAIL: counters don't add up\n");
+        return EXIT_FAILURE;
+    }
+    
+    // The newest frame is never dropped, except when the bounded queue is full
+    if (policy != FrameQueuePolicyBoundedFIFO && lastFrameNumber != kStressTestFrameCount - 1)
+    {
+        fprintf(stderr, "FAIL: last frame %ld was not taken\n", (long)kStressTestFrameCount - 1);
+        return EXIT_FAILURE;
+    }
+    
+    releaseFrameQueue(queue);
+    
+    if (atomic_load(&liveFrameCount) != 0)
+    {
+        fprintf(stderr, "FAIL: %ld frames leaked\n", atomic_load(&liveFrameCount));
+        return EXIT_FAILURE;
+    }
+    
+    return EXIT_SUCCESS;
+}
+
+int main(void)
+{
+    const unsigned int depths[] = {1, 2, 8};
+    const FrameQueuePolicy_t policies[] = {FrameQueuePolicyLatestOnly, FrameQueuePolicyBoundedFIFO, FrameQueuePolicyDropOldest};
+    
+    for (unsigned int d = 0; d < sizeof(depths) / sizeof(depths[0]); ++d)
+    {
+        for (unsigned int p = 0; p < sizeof(policies) / sizeof(policies[0]); ++p)
+        {
+            if (runStressTest(depths[d], policies[p]) != EXIT_SUCCESS)
+            {
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    
+    printf("PASS\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,229 @@
+//
+//  LAUCaptureVideoPreviewLayerBlurEngineTests.m
+//  LAUCaptureVideoPreviewLayerUnitTests
+//
+//  Created by Luis Laugga on 10/17/16.
+//  Copyright © 2016 Luis Laugga. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "LAUCaptureVideoPreviewLayerBlurEngine.h"
+
+// Bts kernel for t = 1.0 (sigma = 9.5), same values as kBtsGaussianFilterKernel[10]
+static const float kTestFilterKernelOffsets[10] = {0.665434f, 2.493075f, 4.487537f, 6.482002f, 8.476472f, 10.470947f, 12.465429f, 14.459920f, 16.454421f, 18.448932f};
+static const float kTestFilterKernelWeights[10] = {0.065375f, 0.084402f, 0.078120f, 0.069179f, 0.058613f, 0.047513f, 0.036851f, 0.027345f, 0.019414f, 0.013187f};
+
+// Full HD camera frame rendered on a 1242x2208 (iPhone Plus) renderbuffer
+static const size_t kTestInputWidth = 1920;
+static const size_t kTestInputHeight = 1080;
+static const size_t kTestViewWidth = 1242;
+static const size_t kTestViewHeight = 2208;
+
+@interface LAUCaptureVideoPreviewLayerBlurEngineTests : XCTestCase
+{
+    BlurEngine_t * blurEngine;
+    BlurEngineImage_t inputImage;
+    BlurEngineImage_t outputImage;
+}
+@end
+
+@implementation LAUCaptureVideoPreviewLayerBlurEngineTests
+
+- (void)setUp {
+    [super setUp];
+
+    blurEngine = createBlurEngine();
+    blurEngineSetFilterKernel(blurEngine, 10, kTestFilterKernelOffsets, kTestFilterKernelWeights);
+
+    // Random input, fixed seed so every backend sees the same frame
+    inputImage.width = kTestInputWidth;
+    inputImage.height = kTestInputHeight;
+    inputImage.bytesPerRow = kTestInputWidth * 4;
+    inputImage.data = malloc(inputImage.bytesPerRow * inputImage.height);
+    srand(1);
+    for (size_t i = 0; i < inputImage.bytesPerRow * inputImage.height; ++i) {
+        inputImage.data[i] = rand() & 0xff;
+    }
+
+    blurEngineOutputDimensions(blurEngine, kTestInputWidth, kTestInputHeight, kTestViewWidth, kTestViewHeight, &outputImage.width, &outputImage.height);
+    outputImage.bytesPerRow = outputImage.width * 4;
+    outputImage.data = malloc(outputImage.bytesPerRow * outputImage.height);
+}
+
+- (void)tearDown {
+    releaseBlurEngine(blurEngine);
+    free(inputImage.data);
+    free(outputImage.data);
+    [super tearDown];
+}
+
+- (void)testOutputDimensionsMatchDownsampledTexture {
+
+    // Same as scaleDownPixelBufferTextureInstanceDimensions with _filterDownsamplingFactor = 4.0
+    XCTAssertEqual(outputImage.width, 552);
+    XCTAssertEqual(outputImage.height, 310);
+
+    BlurEngineImage_t invalidImage = outputImage;
+    invalidImage.width -= 1;
+    XCTAssertFalse(blurEngineFilterImage(blurEngine, &inputImage, kTestViewWidth, kTestViewHeight, &invalidImage), @"Output dimensions must be checked");
+}
+
+- (void)testUniformImageIsNotChanged {
+
+    memset(inputImage.data, 77, inputImage.bytesPerRow * inputImage.height);
+
+    XCTAssertTrue(blurEngineFilterImage(blurEngine, &inputImage, kTestViewWidth, kTestViewHeight, &outputImage));
+
+    for (size_t i = 0; i < outputImage.bytesPerRow * outputImage.height; ++i) {
+        if (outputImage.data[i] != 77) {
+            XCTFail(@"Blurring a uniform image must not change it (byte %zu is %d)", i, outputImage.data[i]);
+            break;
+        }
+    }
+}
+
+- (void)testSingleColumnInputIsClampedToEdge {
+
+    // Every bilinear sample of the first pass reads the only column (the pairs of texels can't start before it)
+    BlurEngineImage_t columnImage = { inputImage.data, 1, 64, 4 };
+    memset(columnImage.data, 201, columnImage.bytesPerRow * columnImage.height);
+
+    BlurEngineImage_t image;
+    blurEngineSetFilterParameters(blurEngine, 1.0f, 2);
+    blurEngineOutputDimensions(blurEngine, columnImage.width, columnImage.height, 4, 4, &image.width, &image.height);
+    XCTAssertGreaterThan(image.width * image.height, 0);
+    image.bytesPerRow = image.width * 4;
+    image.data = malloc(image.bytesPerRow * image.height);
+
+    XCTAssertTrue(blurEngineFilterImage(blurEngine, &columnImage, 4, 4, &image));
+    for (size_t i = 0; i < image.bytesPerRow * image.height; ++i) {
+        if (image.data[i] != 201) {
+            XCTFail(@"A single column must be repeated (byte %zu is %d)", i, image.data[i]);
+            break;
+        }
+    }
+
+    free(image.data);
+}
+
+- (void)testPrefilterCoversTheTexelFootprint {
+
+    XCTAssertFalse(blurEnginePrefilterEnabled(blurEngine), @"The prefilter must be enabled explicitly");
+
+    // Rotated view with the dimensions of the input, every texel covers 4x4 pixels
+    BlurEngineImage_t image;
+    blurEngineOutputDimensions(blurEngine, kTestInputWidth, kTestInputHeight, kTestInputHeight, kTestInputWidth, &image.width, &image.height);
+    XCTAssertEqual(image.width, kTestInputWidth / 4);
+    XCTAssertEqual(image.height, kTestInputHeight / 4);
+    image.bytesPerRow = image.width * 4;
+    image.data = malloc(image.bytesPerRow * image.height);
+
+    // Only the 2 middle rows and columns of each texel are white (a quarter of the pixels)
+    for (size_t y = 0; y < kTestInputHeight; ++y) {
+        for (size_t x = 0; x < kTestInputWidth; ++x) {
+            bool white = (x % 4 == 1 || x % 4 == 2) && (y % 4 == 1 || y % 4 == 2);
+            memset(inputImage.data + y * inputImage.bytesPerRow + x * 4, white ? 255 : 0, 4);
+        }
+    }
+
+    // Difference with the mean of the input, skipping the texels that read the clamped edges
+    const size_t margin = 64;
+    bool prefilterEnabled[] = {true, false};
+    int maxDifferences[2] = {0, 0};
+    for (size_t p = 0; p < 2; ++p) {
+
+        blurEngineSetPrefilterEnabled(blurEngine, prefilterEnabled[p]);
+        XCTAssertEqual(blurEnginePrefilterEnabled(blurEngine), prefilterEnabled[p]);
+        XCTAssertTrue(blurEngineFilterImage(blurEngine, &inputImage, kTestInputHeight, kTestInputWidth, &image));
+
+        for (size_t y = margin; y < image.height - margin; ++y) {
+            for (size_t x = margin * 4; x < (image.width - margin) * 4; ++x) {
+                maxDifferences[p] = MAX(maxDifferences[p], abs((int)image.data[y * image.bytesPerRow + x] - 64));
+            }
+        }
+    }
+
+    // The 2x2 taps average the 16 pixels of each texel, the single taps alias to the black pixels
+    XCTAssertLessThanOrEqual(maxDifferences[0], 1);
+    XCTAssertGreaterThan(maxDifferences[1], 32);
+
+    free(image.data);
+}
+
+- (void)testBackendsMatchScalarBackend {
+
+    size_t outputSize = outputImage.bytesPerRow * outputImage.height;
+    uint8_t * referenceData = malloc(outputSize);
+
+    XCTAssertTrue(blurEngineSetBackend(blurEngine, BlurEngineBackendScalar));
+    XCTAssertTrue(blurEngineFilterImage(blurEngine, &inputImage, kTestViewWidth, kTestViewHeight, &outputImage));
+    memcpy(referenceData, outputImage.data, outputSize);
+
+    BlurEngineBackend_t backends[] = {BlurEngineBackendSSE2, BlurEngineBackendAVX2, BlurEngineBackendNEON};
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); ++b) {
+
+        if (!blurEngineSetBackend(blurEngine, backends[b])) {
+            continue; // not available on this architecture
+        }
+
+        XCTAssertTrue(blurEngineFilterImage(blurEngine, &inputImage, kTestViewWidth, kTestViewHeight, &outputImage));
+
+        int maxDifference = 0;
+        for (size_t i = 0; i < outputSize; ++i) {
+            maxDifference = MAX(maxDifference, abs((int)outputImage.data[i] - (int)referenceData[i]));
+        }
+
+        XCTAssertLessThanOrEqual(maxDifference, 1, @"Backend %d must match the scalar backend within 1 LSB", backends[b]);
+    }
+
+    free(referenceData);
+}
+
+- (void)testWorkerPoolMatchesCallingThread {
+
+    size_t outputSize = outputImage.bytesPerRow * outputImage.height;
+    uint8_t * referenceData = malloc(outputSize);
+
+    XCTAssertTrue(blurEngineFilterImage(blurEngine, &inputImage, kTestViewWidth, kTestViewHeight, &outputImage));
+    memcpy(referenceData, outputImage.data, outputSize);
+
+    // Odd thread counts give stripes of different heights, the vertical pass reads rows of the neighbouring stripes
+    unsigned int threadCounts[] = {2, 3, 8};
+    for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); ++t) {
+
+        WorkerPool_t * workerPool = createWorkerPool(threadCounts[t]);
+        XCTAssertTrue(blurEngineSetWorkerPool(blurEngine, workerPool));
+
+        memset(outputImage.data, 0, outputSize);
+        XCTAssertTrue(blurEngineFilterImage(blurEngine, &inputImage, kTestViewWidth, kTestViewHeight, &outputImage));
+        XCTAssertEqual(memcmp(outputImage.data, referenceData, outputSize), 0, @"%u threads must give the same output as the calling thread", threadCounts[t]);
+
+        XCTAssertTrue(blurEngineSetWorkerPool(blurEngine, NULL));
+        releaseWorkerPool(workerPool);
+    }
+
+    free(referenceData);
+}
+
+- (void)testPerformanceFullHD {
+
+    [self measureBlock:^{
+        blurEngineFilterImage(blurEngine, &inputImage, kTestViewWidth, kTestViewHeight, &outputImage);
+    }];
+}
+
+- (void)testPerformanceFullHDWorkerPool {
+
+    WorkerPool_t * workerPool = createWorkerPool(0);
+    blurEngineSetWorkerPool(blurEngine, workerPool);
+
+    [self measureBlock:^{
+        blurEngineFilterImage(blurEngine, &inputImage, kTestViewWidth, kTestViewHeight, &outputImage);
+    }];
+
+    blurEngineSetWorkerPool(blurEngine, NULL);
+    releaseWorkerPool(workerPool);
+}
+
+@end
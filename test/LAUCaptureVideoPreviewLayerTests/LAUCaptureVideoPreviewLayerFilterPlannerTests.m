@@ -0,0 +1,208 @@
+//
+//  LAUCaptureVideoPreviewLayerFilterPlannerTests.m
+//  LAUCaptureVideoPreviewLayerUnitTests
+//
+//  Created by Luis Laugga on 10/17/16.
+//  Copyright © 2016 Luis Laugga. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "LAUCaptureVideoPreviewLayerFilterPlanner.h"
+#import "LAUCaptureVideoPreviewLayerBlurEngine.h"
+
+// Landscape input filtered for a portrait view, the input rows become the view columns
+static const size_t kTestInputWidth = 2048;
+static const size_t kTestInputHeight = 64;
+
+// Amplitude of a sinusoid along the middle row of an image, least squares fit on the texel centers
+// (the texel x samples the input at (x + 0.5) * scale - 0.5), so the rounding of the 8-bit values averages out
+static double sinusoidAmplitude(const BlurEngineImage_t * image, double scale, double period, size_t margin) {
+    double m[3][3] = {{0}};
+    double b[3] = {0};
+    const uint8_t * row = image->data + (image->height / 2) * image->bytesPerRow;
+    for (size_t x = margin; x + margin < image->width; ++x) {
+        double phase = ((x + 0.5) * scale - 0.5) * 2.0 * M_PI / period;
+        double f[3] = {1.0, cos(phase), sin(phase)};
+        for (int i = 0; i < 3; ++i) {
+            b[i] += f[i] * row[x * 4 + 1];
+            for (int j = 0; j < 3; ++j) {
+                m[i][j] += f[i] * f[j];
+            }
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        for (int k = i + 1; k < 3; ++k) {
+            double r = m[k][i] / m[i][i];
+            for (int j = 0; j < 3; ++j) {
+                m[k][j] -= r * m[i][j];
+            }
+            b[k] -= r * b[i];
+        }
+    }
+    double c[3];
+    for (int i = 2; i >= 0; --i) {
+        double s = b[i];
+        for (int j = i + 1; j < 3; ++j) {
+            s -= m[i][j] * c[j];
+        }
+        c[i] = s / m[i][i];
+    }
+    return sqrt(c[1] * c[1] + c[2] * c[2]);
+}
+
+@interface LAUCaptureVideoPreviewLayerFilterPlannerTests : XCTestCase
+{
+    const GaussianFilterKernelParameters_t * kernelParameters;
+    const FilterPlannerParameters_t * plannerParameters;
+}
+@end
+
+@implementation LAUCaptureVideoPreviewLayerFilterPlannerTests
+
+- (void)setUp {
+    [super setUp];
+    kernelParameters = &kBtsGaussianFilterKernelDefaultParameters;
+    plannerParameters = &kFilterPlannerDefaultParameters;
+}
+
+- (void)testKernelSigmaSolvesTargetSigma {
+    float downsamplingFactors[] = {1.0f, 2.0f, 4.0f};
+    for (size_t f = 0; f < 3; ++f) {
+        for (unsigned int n = 1; n <= 2; ++n) {
+            // Targets reachable with the sigma range of the kernels
+            float minSigma = filterPlannerEffectiveSigma(plannerParameters, kernelParameters, downsamplingFactors[f], n, kernelParameters->minSigma);
+            float maxSigma = filterPlannerEffectiveSigma(plannerParameters, kernelParameters, downsamplingFactors[f], n, kernelParameters->maxSigma);
+            for (float t = 0.1f; t < 1.0f; t += 0.2f) {
+                float targetSigma = minSigma + t * (maxSigma - minSigma);
+                float kernelSigma = filterPlannerKernelSigma(plannerParameters, kernelParameters, downsamplingFactors[f], n, targetSigma);
+                // The variance jumps when the kernel size changes, the target can fall in between
+                XCTAssertEqualWithAccuracy(filterPlannerEffectiveSigma(plannerParameters, kernelParameters, downsamplingFactors[f], n, kernelSigma), targetSigma, 0.05f * targetSigma);
+            }
+        }
+    }
+}
+
+- (void)testPlanIsTheCheapestUnderMaxError {
+    const FilterPlannerParameters_t * parameters = &kFilterPlannerDefaultParameters;
+    float targetSigmas[] = {2.0f, 5.0f, 10.0f, 20.0f};
+    for (size_t s = 0; s < 4; ++s) {
+        FilterPlan_t plan;
+        XCTAssertTrue(filterPlannerPlanForSigma(parameters, kernelParameters, targetSigmas[s], &plan));
+        XCTAssertLessThanOrEqual(plan.error, parameters->maxError);
+        XCTAssertEqualWithAccuracy(plan.effectiveSigma, targetSigmas[s], 0.05f * targetSigmas[s]);
+
+        // No other candidate under the error is cheaper
+        for (unsigned int f = 0; f < parameters->downsamplingFactorCount; ++f) {
+            for (unsigned int n = 1; n <= parameters->maxPassCount; ++n) {
+                float kernelSigma = filterPlannerKernelSigma(parameters, kernelParameters, parameters->downsamplingFactors[f], n, targetSigmas[s]);
+                FilterPlan_t candidate;
+                filterPlannerEvaluate(parameters, kernelParameters, parameters->downsamplingFactors[f], n, kernelSigma, targetSigmas[s], &candidate);
+                if (candidate.error <= parameters->maxError) {
+                    XCTAssertGreaterThanOrEqual(candidate.fetchesPerPixel, plan.fetchesPerPixel);
+                }
+            }
+        }
+    }
+}
+
+- (void)testOutOfRangeTargetReturnsTheSmallestError {
+    FilterPlan_t plan;
+    XCTAssertFalse(filterPlannerPlanForSigma(&kFilterPlannerDefaultParameters, kernelParameters, 200.0f, &plan));
+    XCTAssertGreaterThan(plan.error, kFilterPlannerDefaultParameters.maxError);
+    XCTAssertLessThan(plan.effectiveSigma, 200.0f);
+}
+
+- (void)testFixedParametersOfTheLayer {
+    FilterPlannerParameters_t parameters = kFilterPlannerDefaultParameters;
+    parameters.prefilterEnabled = false;
+
+    // Downsampling factor 4 and 2 passes, kernel of step 0.5
+    float kernelSigma = gaussianFilterSigmaForStep(kernelParameters, 0.5f);
+    float targetSigma = filterPlannerEffectiveSigma(&parameters, kernelParameters, 4.0f, 2, kernelSigma);
+
+    FilterPlan_t fixedPlan;
+    filterPlannerEvaluate(&parameters, kernelParameters, 4.0f, 2, kernelSigma, targetSigma, &fixedPlan);
+    XCTAssertEqual(fixedPlan.downsamplingFactor, 4.0f);
+    XCTAssertEqual(fixedPlan.multiplePassCount, 2u);
+    XCTAssertEqualWithAccuracy(fixedPlan.effectiveSigma, targetSigma, 1e-3f * targetSigma);
+
+    // The first pass reads 2 of every 4 rows of the pixel buffer, a plan under the error costs more fetches
+    FilterPlan_t plan;
+    XCTAssertTrue(filterPlannerPlanForSigma(&parameters, kernelParameters, targetSigma, &plan));
+    XCTAssertLessThan(plan.error, fixedPlan.error);
+    XCTAssertGreaterThan(plan.fetchesPerPixel, fixedPlan.fetchesPerPixel);
+}
+
+- (void)testPrefilteredFixedParametersOfTheLayer {
+    // Same chain with the 2x2 taps of the prefilter in the first pass
+    float kernelSigma = gaussianFilterSigmaForStep(kernelParameters, 0.5f);
+    float targetSigma = filterPlannerEffectiveSigma(plannerParameters, kernelParameters, 4.0f, 2, kernelSigma);
+
+    FilterPlan_t fixedPlan;
+    filterPlannerEvaluate(plannerParameters, kernelParameters, 4.0f, 2, kernelSigma, targetSigma, &fixedPlan);
+    XCTAssertLessThanOrEqual(fixedPlan.error, plannerParameters->maxError);
+
+    // Every texel of the first pass covers its 4 rows of the pixel buffer, the fixed chain is the plan
+    FilterPlan_t plan;
+    XCTAssertTrue(filterPlannerPlanForSigma(plannerParameters, kernelParameters, targetSigma, &plan));
+    XCTAssertEqual(plan.downsamplingFactor, 4.0f);
+    XCTAssertEqual(plan.multiplePassCount, 2u);
+    XCTAssertEqualWithAccuracy(plan.fetchesPerPixel, fixedPlan.fetchesPerPixel, 1e-3f);
+}
+
+- (void)testEffectiveSigmaMatchesBlurEngine {
+    // Downsampling factor, passes and kernel sigma of each chain
+    float downsamplingFactors[] = {1.0f, 2.0f, 2.0f, 3.0f, 4.0f};
+    unsigned int passCounts[] = {1, 1, 2, 2, 2};
+    float kernelSigmas[] = {2.0f, 4.0f, 3.0f, 5.0f, 3.0f};
+
+    BlurEngineImage_t inputImage = {NULL, kTestInputWidth, kTestInputHeight, kTestInputWidth * 4};
+    inputImage.data = malloc(inputImage.bytesPerRow * inputImage.height);
+
+    for (size_t c = 0; c < 5; ++c) {
+        float d = downsamplingFactors[c];
+        unsigned int size = gaussianFilterSizeForSigma(kernelSigmas[c], kernelParameters->truncation);
+        unsigned int samples = btsGaussianFilterSamplesForSize(size);
+        float offsets[samples], weights[samples];
+        generateBtsGaussianFilterOffsetsAndWeights(kernelSigmas[c], size, samples, offsets, weights);
+
+        BlurEngine_t * blurEngine = createBlurEngine();
+        blurEngineSetPrefilterEnabled(blurEngine, plannerParameters->prefilterEnabled);
+        blurEngineSetFilterKernel(blurEngine, samples, offsets, weights);
+        blurEngineSetFilterParameters(blurEngine, d, passCounts[c]);
+
+        BlurEngineImage_t outputImage;
+        blurEngineOutputDimensions(blurEngine, kTestInputWidth, kTestInputHeight, kTestInputHeight, kTestInputWidth, &outputImage.width, &outputImage.height);
+        outputImage.bytesPerRow = outputImage.width * 4;
+        outputImage.data = malloc(outputImage.bytesPerRow * outputImage.height);
+
+        // Variance of the offscreen passes, without the bilinear upsampling of the onscreen pass
+        float effectiveSigma = filterPlannerEffectiveSigma(plannerParameters, kernelParameters, d, passCounts[c], kernelSigmas[c]);
+        double variance = effectiveSigma * effectiveSigma - (d > 1.0f ? d * d / 6.0 : 0.0);
+
+        // A gaussian attenuates a sinusoid of period p by exp(-2 pi^2 variance / p^2), pick p for an attenuation of 0.5
+        double period = 2.0 * M_PI * sqrt(variance / log(2.0));
+        for (size_t y = 0; y < kTestInputHeight; ++y) {
+            for (size_t x = 0; x < kTestInputWidth; ++x) {
+                memset(inputImage.data + y * inputImage.bytesPerRow + x * 4, (int)lround(127.5 + 120.0 * cos(2.0 * M_PI * x / period)), 4);
+            }
+        }
+
+        XCTAssertTrue(blurEngineFilterImage(blurEngine, &inputImage, kTestInputHeight, kTestInputWidth, &outputImage));
+
+        // Skip the texels that read the clamped edges
+        size_t margin = (size_t)(4.0f * effectiveSigma / d) + 2;
+        double attenuation = sinusoidAmplitude(&outputImage, (double)kTestInputWidth / outputImage.width, period, margin) / sinusoidAmplitude(&inputImage, 1.0, period, 0);
+        double measuredVariance = -log(attenuation) * period * period / (2.0 * M_PI * M_PI);
+
+        XCTAssertEqualWithAccuracy(sqrt(measuredVariance), sqrt(variance), 0.03 * sqrt(variance));
+
+        free(outputImage.data);
+        releaseBlurEngine(blurEngine);
+    }
+
+    free(inputImage.data);
+}
+
+@end
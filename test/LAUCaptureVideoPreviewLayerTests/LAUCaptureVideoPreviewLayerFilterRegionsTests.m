@@ -0,0 +1,144 @@
+//
+//  LAUCaptureVideoPreviewLayerFilterRegionsTests.m
+//  LAUCaptureVideoPreviewLayerUnitTests
+//
+//  Created by Luis Laugga on 10/17/16.
+//  Copyright © 2016 Luis Laugga. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "LAUCaptureVideoPreviewLayerFilterRegions.h"
+
+// Landscape texture with the ratio of the portrait view, the texture coordinates have no aspect-fill offsets
+#define kTextureWidth 1334.0f
+#define kTextureHeight 750.0f
+#define kViewWidth 750.0f
+#define kViewHeight 1334.0f
+
+@interface LAUCaptureVideoPreviewLayerFilterRegionsTests : XCTestCase
+
+@end
+
+@implementation LAUCaptureVideoPreviewLayerFilterRegionsTests
+
+- (void)testRectsAreClippedToTheView {
+
+    FilterRegionRect_t rects[] = {
+        {-0.5f, 0.5f, 1.0f, 1.0f}, // Partially outside
+        {1.5f, 0.0f, 0.5f, 0.5f}, // Outside
+        {0.2f, 0.2f, 0.0f, 0.3f}, // Empty
+    };
+
+    FilterRegions_t regions;
+    XCTAssertEqual(filterRegionsSetViewRects(&regions, rects, 3), 1);
+    XCTAssertEqualWithAccuracy(regions.viewRects[0].x, 0.0f, 1e-6f);
+    XCTAssertEqualWithAccuracy(regions.viewRects[0].y, 0.5f, 1e-6f);
+    XCTAssertEqualWithAccuracy(regions.viewRects[0].width, 0.5f, 1e-6f);
+    XCTAssertEqualWithAccuracy(regions.viewRects[0].height, 0.5f, 1e-6f);
+    XCTAssertEqualWithAccuracy(filterRegionsArea(&regions), 0.25f, 1e-6f);
+}
+
+- (void)testContainedRectsAreDropped {
+
+    FilterRegionRect_t rects[] = {
+        {0.4f, 0.4f, 0.1f, 0.1f}, // Inside the next one
+        {0.2f, 0.2f, 0.5f, 0.5f},
+        {0.3f, 0.3f, 0.2f, 0.2f}, // Inside the previous one
+        {0.6f, 0.6f, 0.3f, 0.3f}, // Overlaps
+    };
+
+    FilterRegions_t regions;
+    XCTAssertEqual(filterRegionsSetViewRects(&regions, rects, 4), 2);
+    XCTAssertEqual(regions.viewRects[0].x, 0.2f);
+    XCTAssertEqual(regions.viewRects[1].x, 0.6f);
+
+    // No region, the whole frame
+    XCTAssertEqual(filterRegionsSetViewRects(&regions, NULL, 0), 0);
+    XCTAssertEqual(filterRegionsArea(&regions), 1.0f);
+}
+
+- (void)testAtMostMaxCountRegions {
+
+    FilterRegionRect_t rects[kFilterRegionMaxCount + 4];
+    for (size_t i = 0; i < kFilterRegionMaxCount + 4; ++i) {
+        rects[i] = (FilterRegionRect_t){0.0f, i * 0.05f, 0.5f, 0.02f};
+    }
+
+    FilterRegions_t regions;
+    XCTAssertEqual(filterRegionsSetViewRects(&regions, rects, kFilterRegionMaxCount + 4), kFilterRegionMaxCount);
+}
+
+- (void)testTextureRectsAreRotated {
+
+    // Left half of the top quarter of the view
+    FilterRegionRect_t rect = {0.0f, 0.0f, 0.5f, 0.25f};
+
+    FilterRegions_t regions;
+    filterRegionsSetViewRects(&regions, &rect, 1);
+    filterRegionsMapToTexture(&regions, kTextureWidth, kTextureHeight, kViewWidth, kViewHeight);
+
+    // The view rows are the texture columns (S), the view columns are the texture rows (T) from the top
+    FilterRegionRect_t textureRect = regions.textureRects[0];
+    XCTAssertEqualWithAccuracy(textureRect.x, 0.0f, 1e-5f);
+    XCTAssertEqualWithAccuracy(textureRect.width, 0.25f, 1e-5f);
+    XCTAssertEqualWithAccuracy(textureRect.y, 0.5f, 1e-5f);
+    XCTAssertEqualWithAccuracy(textureRect.height, 0.5f, 1e-5f);
+}
+
+- (void)testTextureRectsAreCroppedLikeAspectFill {
+
+    // Wider texture (16:9 view ratio is 1.78, texture ratio 2.0), the texture columns are cropped
+    FilterRegionRect_t rect = {0.0f, 0.0f, 1.0f, 1.0f};
+
+    FilterRegions_t regions;
+    filterRegionsSetViewRects(&regions, &rect, 1);
+    filterRegionsMapToTexture(&regions, 1500.0f, kTextureHeight, kViewWidth, kViewHeight);
+
+    FilterRegionRect_t textureRect = regions.textureRects[0];
+    XCTAssertEqualWithAccuracy(textureRect.x, (1500.0f - kViewHeight) / 1500.0f / 2.0f, 1e-5f);
+    XCTAssertEqualWithAccuracy(textureRect.width, kViewHeight / 1500.0f, 1e-5f);
+    XCTAssertEqualWithAccuracy(textureRect.y, 0.0f, 1e-5f);
+    XCTAssertEqualWithAccuracy(textureRect.height, 1.0f, 1e-5f);
+}
+
+- (void)testTextureBoxIncludesTheMargin {
+
+    FilterRegionRect_t rect = {0.0f, 0.0f, 0.5f, 0.25f};
+
+    FilterRegions_t regions;
+    filterRegionsSetViewRects(&regions, &rect, 1);
+    filterRegionsMapToTexture(&regions, kTextureWidth, kTextureHeight, kViewWidth, kViewHeight);
+
+    // Downsampled texture, 2 remaining passes of a radius 9 kernel
+    float margin = filterRegionsPassMargin(2, 9);
+    XCTAssertEqual(margin, 21.0f);
+
+    FilterRegionBox_t box = filterRegionsTextureBox(&regions, 0, 333.5f, 187.5f, margin);
+
+    // Clipped at the texture edges (the truncated dimensions)
+    XCTAssertEqual(box.x, 0);
+    XCTAssertEqual(box.width, (int)ceilf(0.25f * 333.5f + margin));
+    XCTAssertEqual(box.y, (int)floorf(0.5f * 187.5f - margin));
+    XCTAssertEqual(box.y + box.height, 187);
+
+    // Last pass, only the linear filtering of the onscreen copy
+    XCTAssertEqual(filterRegionsPassMargin(0, 9), 1.0f);
+}
+
+- (void)testViewBoxIsFlipped {
+
+    FilterRegionRect_t rect = {0.1f, 0.0f, 0.5f, 0.25f};
+
+    FilterRegions_t regions;
+    filterRegionsSetViewRects(&regions, &rect, 1);
+
+    // Top of the view, the renderbuffer rows start at the bottom
+    FilterRegionBox_t box = filterRegionsViewBox(&regions, 0, kViewWidth, kViewHeight);
+    XCTAssertEqual(box.x, 75);
+    XCTAssertEqual(box.width, 375);
+    XCTAssertEqual(box.y, 1001);
+    XCTAssertEqual(box.y + box.height, 1334);
+}
+
+@end
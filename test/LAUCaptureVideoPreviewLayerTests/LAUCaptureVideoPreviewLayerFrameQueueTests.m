@@ -0,0 +1,219 @@
+//
+//  LAUCaptureVideoPreviewLayerFrameQueueTests.m
+//  LAUCaptureVideoPreviewLayerUnitTests
+//
+//  Created by Luis Laugga on 10/17/16.
+//  Copyright © 2016 Luis Laugga. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "LAUCaptureVideoPreviewLayerFrameQueue.h"
+
+// Frames are plain counters, retain count per frame
+static int retainCounts[8];
+
+static const void * retainTestFrame(const void * frame) {
+    retainCounts[*(const int *)frame]++;
+    return frame;
+}
+
+static void releaseTestFrame(const void * frame) {
+    retainCounts[*(const int *)frame]--;
+}
+
+@interface LAUCaptureVideoPreviewLayerFrameQueueTests : XCTestCase
+{
+    FrameQueue_t * queue;
+    int frames[8];
+}
+@end
+
+@implementation LAUCaptureVideoPreviewLayerFrameQueueTests
+
+- (void)setUp {
+    [super setUp];
+
+    memset(retainCounts, 0, sizeof(retainCounts));
+    for (int i = 0; i < 8; ++i) {
+        frames[i] = i;
+    }
+
+    // Latest frame wins (default of LAUCaptureVideoPreviewLayerInternal)
+    queue = createFrameQueue(1, FrameQueuePolicyLatestOnly, retainTestFrame, releaseTestFrame);
+}
+
+- (void)tearDown {
+    releaseFrameQueue(queue);
+
+    for (int i = 0; i < 8; ++i) {
+        XCTAssertEqual(retainCounts[i], 0, @"Frame %d must be released", i);
+    }
+
+    [super tearDown];
+}
+
+- (void)replaceQueueWithDepth:(unsigned int)depth policy:(FrameQueuePolicy_t)policy {
+    releaseFrameQueue(queue);
+    queue = createFrameQueue(depth, policy, retainTestFrame, releaseTestFrame);
+}
+
+- (void)testEmptyQueueHasNoFrame {
+
+    XCTAssertTrue(frameQueueTakeFrame(queue, 0.0, NULL) == NULL);
+}
+
+- (void)testLatestFrameWins {
+
+    XCTAssertTrue(frameQueueEnqueueFrame(queue, &frames[1], 0.0));
+    XCTAssertFalse(frameQueueEnqueueFrame(queue, &frames[2], 0.0), @"Frame 1 wasn't taken and must be dropped");
+    XCTAssertEqual(retainCounts[1], 0);
+
+    XCTAssertTrue(frameQueueTakeFrame(queue, 0.0, NULL) == &frames[2]);
+    XCTAssertTrue(frameQueueTakeFrame(queue, 0.0, NULL) == NULL, @"Frames are only taken once");
+}
+
+- (void)testTakenFrameIsRetainedUntilNextTake {
+
+    frameQueueEnqueueFrame(queue, &frames[1], 0.0);
+    frameQueueTakeFrame(queue, 0.0, NULL);
+    XCTAssertEqual(retainCounts[1], 1);
+
+    // Still retained while there isn't a new frame (the last frame is rendered again)
+    frameQueueTakeFrame(queue, 0.0, NULL);
+    XCTAssertEqual(retainCounts[1], 1);
+
+    frameQueueEnqueueFrame(queue, &frames[2], 0.0);
+    XCTAssertTrue(frameQueueTakeFrame(queue, 0.0, NULL) == &frames[2]);
+    XCTAssertEqual(retainCounts[1], 0);
+    XCTAssertEqual(retainCounts[2], 1);
+}
+
+- (void)testFlushReleasesAllFrames {
+
+    frameQueueEnqueueFrame(queue, &frames[1], 0.0);
+    frameQueueTakeFrame(queue, 0.0, NULL);
+    frameQueueEnqueueFrame(queue, &frames[2], 0.0);
+
+    frameQueueFlush(queue);
+    XCTAssertEqual(retainCounts[1], 0);
+    XCTAssertEqual(retainCounts[2], 0);
+    XCTAssertTrue(frameQueueTakeFrame(queue, 0.0, NULL) == NULL);
+}
+
+- (void)testLatestOnlySkipsQueuedFrames {
+
+    [self replaceQueueWithDepth:4 policy:FrameQueuePolicyLatestOnly];
+
+    for (int i = 1; i <= 3; ++i) {
+        XCTAssertTrue(frameQueueEnqueueFrame(queue, &frames[i], i));
+    }
+
+    double timestamp;
+    XCTAssertTrue(frameQueueTakeFrame(queue, 3.5, &timestamp) == &frames[3]);
+    XCTAssertEqual(timestamp, 3.0);
+    XCTAssertEqual(retainCounts[1], 0);
+    XCTAssertEqual(retainCounts[2], 0);
+
+    FrameQueueStatistics_t statistics;
+    frameQueueStatistics(queue, &statistics);
+    XCTAssertEqual(statistics.droppedFrameCount, 2);
+    XCTAssertEqual(statistics.takenFrameCount, 1);
+}
+
+- (void)testBoundedFIFODropsNewFramesWhenFull {
+
+    [self replaceQueueWithDepth:2 policy:FrameQueuePolicyBoundedFIFO];
+
+    XCTAssertTrue(frameQueueEnqueueFrame(queue, &frames[1], 1.0));
+    XCTAssertTrue(frameQueueEnqueueFrame(queue, &frames[2], 2.0));
+    XCTAssertFalse(frameQueueEnqueueFrame(queue, &frames[3], 3.0));
+    XCTAssertEqual(retainCounts[3], 0);
+
+    XCTAssertTrue(frameQueueTakeFrame(queue, 3.0, NULL) == &frames[1]);
+    XCTAssertTrue(frameQueueTakeFrame(queue, 3.0, NULL) == &frames[2]);
+    XCTAssertTrue(frameQueueTakeFrame(queue, 3.0, NULL) == NULL);
+}
+
+- (void)testDropOldestKeepsNewestFramesInOrder {
+
+    [self replaceQueueWithDepth:2 policy:FrameQueuePolicyDropOldest];
+
+    XCTAssertTrue(frameQueueEnqueueFrame(queue, &frames[1], 1.0));
+    XCTAssertTrue(frameQueueEnqueueFrame(queue, &frames[2], 2.0));
+    XCTAssertFalse(frameQueueEnqueueFrame(queue, &frames[3], 3.0), @"Frame 1 must be dropped");
+    XCTAssertEqual(retainCounts[1], 0);
+
+    XCTAssertTrue(frameQueueTakeFrame(queue, 3.0, NULL) == &frames[2]);
+    XCTAssertTrue(frameQueueTakeFrame(queue, 3.0, NULL) == &frames[3]);
+    XCTAssertTrue(frameQueueTakeFrame(queue, 3.0, NULL) == NULL);
+}
+
+- (void)testStatisticsCountFramesAndAges {
+
+    [self replaceQueueWithDepth:3 policy:FrameQueuePolicyDropOldest];
+
+    for (int i = 1; i <= 5; ++i) {
+        frameQueueEnqueueFrame(queue, &frames[i], i);
+    }
+
+    frameQueueTakeFrame(queue, 6.0, NULL); // frame 3, age 3
+    frameQueueTakeFrame(queue, 6.0, NULL); // frame 4, age 2
+
+    FrameQueueStatistics_t statistics;
+    frameQueueStatistics(queue, &statistics);
+    XCTAssertEqual(statistics.enqueuedFrameCount, 5);
+    XCTAssertEqual(statistics.droppedFrameCount, 2);
+    XCTAssertEqual(statistics.takenFrameCount, 2);
+    XCTAssertEqual(statistics.queuedFrameCount, 1);
+    XCTAssertEqual(statistics.enqueuedFrameCount, statistics.droppedFrameCount + statistics.takenFrameCount + statistics.queuedFrameCount);
+    XCTAssertEqualWithAccuracy(statistics.lastFrameAge, 2.0, 1e-9);
+    XCTAssertEqualWithAccuracy(statistics.averageFrameAge, 2.5, 1e-9);
+    XCTAssertEqualWithAccuracy(statistics.maxFrameAge, 3.0, 1e-9);
+}
+
+- (void)testConcurrentProducerAndConsumer {
+
+    const int frameCount = 100000;
+    FrameQueuePolicy_t policies[] = {FrameQueuePolicyLatestOnly, FrameQueuePolicyBoundedFIFO, FrameQueuePolicyDropOldest};
+
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); ++p) {
+
+        FrameQueue_t * concurrentQueue = createFrameQueue(4, policies[p], CFRetain, CFRelease);
+        __block int lastFrameNumber = -1;
+        __block BOOL framesInOrder = YES;
+
+        dispatch_group_t group = dispatch_group_create();
+        dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+            for (int i = 0; i < frameCount; ++i) {
+                CFNumberRef frame = CFNumberCreate(NULL, kCFNumberIntType, &i);
+                frameQueueEnqueueFrame(concurrentQueue, frame, i);
+                CFRelease(frame);
+            }
+        });
+
+        // Consumer on this thread until the producer is done and the queue is empty
+        for (;;) {
+            BOOL producerDone = dispatch_group_wait(group, DISPATCH_TIME_NOW) == 0;
+            CFNumberRef frame = frameQueueTakeFrame(concurrentQueue, frameCount, NULL);
+            if (frame) {
+                int frameNumber;
+                CFNumberGetValue(frame, kCFNumberIntType, &frameNumber);
+                framesInOrder = framesInOrder && frameNumber > lastFrameNumber;
+                lastFrameNumber = frameNumber;
+            } else if (producerDone) {
+                break;
+            }
+        }
+
+        FrameQueueStatistics_t statistics;
+        frameQueueStatistics(concurrentQueue, &statistics);
+
+        XCTAssertTrue(framesInOrder, @"Policy %d", policies[p]);
+        XCTAssertEqual(statistics.enqueuedFrameCount, frameCount);
+        XCTAssertEqual(statistics.enqueuedFrameCount, statistics.droppedFrameCount + statistics.takenFrameCount);
+        releaseFrameQueue(concurrentQueue);
+    }
+}
+
+@end
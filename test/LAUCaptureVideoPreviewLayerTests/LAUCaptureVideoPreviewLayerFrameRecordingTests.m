@@ -0,0 +1,264 @@
+//
+//  LAUCaptureVideoPreviewLayerFrameRecordingTests.m
+//  LAUCaptureVideoPreviewLayerUnitTests
+//
+//  Created by Luis Laugga on 10/17/16.
+//  Copyright © 2016 Luis Laugga. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "LAUCaptureVideoPreviewLayerFrameRecording.h"
+
+// BGRA frame with padded rows (same as a pixel buffer), the recording has packed rows
+static const uint32_t kTestFrameWidth = 7;
+static const uint32_t kTestFrameHeight = 5;
+static const size_t kTestFrameBytesPerRow = 7 * 4 + 4;
+
+@interface LAUCaptureVideoPreviewLayerFrameRecordingTests : XCTestCase
+{
+    NSString * _path;
+    uint8_t _pixels[5 * (7 * 4 + 4)];
+}
+
+@end
+
+@implementation LAUCaptureVideoPreviewLayerFrameRecordingTests
+
+- (void)setUp {
+    [super setUp];
+
+    _path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    for (size_t i = 0; i < sizeof(_pixels); ++i) {
+        _pixels[i] = (uint8_t)i;
+    }
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath:_path error:nil];
+
+    [super tearDown];
+}
+
+- (FrameRecordingFrame_t)testFrameWithTimestamp:(double)timestamp {
+    FrameRecordingFrame_t frame = {
+        .timestamp = timestamp,
+        .pixelFormat = FrameRecordingPixelFormatBGRA,
+        .planeCount = 1,
+    };
+    frame.planes[0] = (FrameRecordingPlane_t){_pixels, kTestFrameWidth, kTestFrameHeight, 4, kTestFrameBytesPerRow};
+    return frame;
+}
+
+- (void)recordView:(BOOL)view blur:(BOOL)blur frameCount:(unsigned int)frameCount {
+    FrameRecorder_t * recorder = createFrameRecorder(_path.fileSystemRepresentation, 1024 * 1024);
+    XCTAssertTrue(recorder != NULL);
+
+    if (view) {
+        XCTAssertTrue(frameRecorderAppendView(recorder, 0.5, 1242, 2208));
+    }
+    if (blur) {
+        XCTAssertTrue(frameRecorderAppendBlur(recorder, 1.0, 0.75f, 0.25f));
+    }
+    for (unsigned int i = 0; i < frameCount; ++i) {
+        FrameRecordingFrame_t frame = [self testFrameWithTimestamp:1.0 + i / 60.0];
+        XCTAssertTrue(frameRecorderAppendFrame(recorder, &frame));
+    }
+
+    releaseFrameRecorder(recorder);
+}
+
+- (void)testReplayReadsRecordedChunksInOrder {
+
+    [self recordView:YES blur:YES frameCount:3];
+
+    // Same chunks memory-mapped and streamed
+    for (int memoryMapped = 0; memoryMapped < 2; ++memoryMapped) {
+
+        FrameReplay_t * replay = createFrameReplay(_path.fileSystemRepresentation, memoryMapped);
+        XCTAssertTrue(replay != NULL);
+        XCTAssertEqual(frameReplayMemoryMapped(replay), (bool)memoryMapped);
+
+        FrameRecordingEvent_t event;
+        XCTAssertTrue(frameReplayNextEvent(replay, &event));
+        XCTAssertEqual(event.type, FrameRecordingChunkTypeView);
+        XCTAssertEqual(event.view.width, 1242);
+        XCTAssertEqual(event.view.height, 2208);
+
+        XCTAssertTrue(frameReplayNextEvent(replay, &event));
+        XCTAssertEqual(event.type, FrameRecordingChunkTypeBlur);
+        XCTAssertEqual(event.timestamp, 1.0);
+        XCTAssertEqual(event.blur.intensity, 0.75f);
+        XCTAssertEqual(event.blur.transitionDuration, 0.25f);
+
+        for (unsigned int i = 0; i < 3; ++i) {
+            XCTAssertTrue(frameReplayNextEvent(replay, &event));
+            XCTAssertEqual(event.type, FrameRecordingChunkTypeFrame);
+            XCTAssertEqual(event.timestamp, 1.0 + i / 60.0);
+            XCTAssertEqual(event.frame.frameIndex, i);
+            XCTAssertEqual(event.frame.pixelFormat, FrameRecordingPixelFormatBGRA);
+            XCTAssertEqual(event.frame.planeCount, 1);
+
+            const FrameRecordingPlane_t * plane = &event.frame.planes[0];
+            XCTAssertEqual(plane->width, kTestFrameWidth);
+            XCTAssertEqual(plane->height, kTestFrameHeight);
+            XCTAssertEqual(plane->bytesPerRow, kTestFrameWidth * 4);
+            XCTAssertEqual((uintptr_t)plane->data % 8, 0);
+            for (uint32_t y = 0; y < kTestFrameHeight; ++y) {
+                XCTAssertEqual(memcmp(plane->data + y * plane->bytesPerRow, _pixels + y * kTestFrameBytesPerRow, kTestFrameWidth * 4), 0);
+            }
+        }
+
+        XCTAssertFalse(frameReplayNextEvent(replay, &event));
+
+        // The released pages are read again after a rewind
+        frameReplayRewind(replay);
+        XCTAssertTrue(frameReplayNextEvent(replay, &event));
+        XCTAssertEqual(event.type, FrameRecordingChunkTypeView);
+
+        releaseFrameReplay(replay);
+    }
+}
+
+- (void)testBiPlanarFrameKeepsBothPlanes {
+
+    uint8_t luma[4 * 4], chroma[2 * 2 * 2];
+    memset(luma, 16, sizeof(luma));
+    memset(chroma, 128, sizeof(chroma));
+
+    FrameRecordingFrame_t frame = {
+        .timestamp = 2.0,
+        .pixelFormat = FrameRecordingPixelFormat420f,
+        .planeCount = 2,
+    };
+    frame.planes[0] = (FrameRecordingPlane_t){luma, 4, 4, 1, 4};
+    frame.planes[1] = (FrameRecordingPlane_t){chroma, 2, 2, 2, 4};
+
+    FrameRecorder_t * recorder = createFrameRecorder(_path.fileSystemRepresentation, 1024);
+    XCTAssertTrue(frameRecorderAppendFrame(recorder, &frame));
+    releaseFrameRecorder(recorder);
+
+    FrameReplay_t * replay = createFrameReplay(_path.fileSystemRepresentation, true);
+    FrameRecordingEvent_t event;
+    XCTAssertTrue(frameReplayNextEvent(replay, &event));
+    XCTAssertEqual(event.frame.pixelFormat, FrameRecordingPixelFormat420f);
+    XCTAssertEqual(event.frame.planeCount, 2);
+    XCTAssertEqual(event.frame.planes[1].width, 2);
+    XCTAssertEqual(event.frame.planes[1].bytesPerPixel, 2);
+    XCTAssertEqual(memcmp(event.frame.planes[0].data, luma, sizeof(luma)), 0);
+    XCTAssertEqual(memcmp(event.frame.planes[1].data, chroma, sizeof(chroma)), 0);
+    releaseFrameReplay(replay);
+}
+
+- (void)testFramesOverPendingBytesAreDropped {
+
+    // A frame doesn't fit, the blur change is still recorded
+    FrameRecorder_t * recorder = createFrameRecorder(_path.fileSystemRepresentation, 64);
+    FrameRecordingFrame_t frame = [self testFrameWithTimestamp:1.0];
+    XCTAssertFalse(frameRecorderAppendFrame(recorder, &frame));
+    XCTAssertTrue(frameRecorderAppendBlur(recorder, 1.0, 1.0f, 0.0f));
+    releaseFrameRecorder(recorder);
+
+    FrameReplay_t * replay = createFrameReplay(_path.fileSystemRepresentation, true);
+    FrameRecordingEvent_t event;
+    XCTAssertTrue(frameReplayNextEvent(replay, &event));
+    XCTAssertEqual(event.type, FrameRecordingChunkTypeBlur);
+    XCTAssertFalse(frameReplayNextEvent(replay, &event));
+    releaseFrameReplay(replay);
+}
+
+- (void)testStatisticsCountWrittenBytes {
+
+    FrameRecorder_t * recorder = createFrameRecorder(_path.fileSystemRepresentation, 1024 * 1024);
+    FrameRecordingFrame_t frame = [self testFrameWithTimestamp:1.0];
+    XCTAssertTrue(frameRecorderAppendFrame(recorder, &frame));
+
+    // Wait for the writer thread
+    FrameRecorderStatistics_t statistics;
+    for (int i = 0; i < 1000; ++i) {
+        frameRecorderStatistics(recorder, &statistics);
+        if (statistics.pendingByteCount == 0) {
+            break;
+        }
+        usleep(1000);
+    }
+
+    XCTAssertEqual(statistics.recordedFrameCount, 1);
+    XCTAssertEqual(statistics.droppedFrameCount, 0);
+    XCTAssertFalse(statistics.failed);
+    releaseFrameRecorder(recorder);
+
+    NSDictionary * attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:_path error:nil];
+    XCTAssertEqual(attributes.fileSize, statistics.writtenByteCount);
+}
+
+- (void)testIncompleteLastChunkEndsTheRecording {
+
+    [self recordView:NO blur:NO frameCount:2];
+
+    // The app was killed while the second frame was written
+    NSDictionary * attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:_path error:nil];
+    XCTAssertEqual(truncate(_path.fileSystemRepresentation, (off_t)attributes.fileSize - 16), 0);
+
+    for (int memoryMapped = 0; memoryMapped < 2; ++memoryMapped) {
+        FrameReplay_t * replay = createFrameReplay(_path.fileSystemRepresentation, memoryMapped);
+        FrameRecordingEvent_t event;
+        XCTAssertTrue(frameReplayNextEvent(replay, &event));
+        XCTAssertEqual(event.frame.frameIndex, 0);
+        XCTAssertFalse(frameReplayNextEvent(replay, &event));
+        releaseFrameReplay(replay);
+    }
+}
+
+- (void)testUnknownChunksAreSkipped {
+
+    [self recordView:NO blur:NO frameCount:1];
+
+    // Chunk of a newer version, 4 bytes of payload padded to 8
+    FILE * file = fopen(_path.fileSystemRepresentation, "ab");
+    uint32_t header[2] = {FrameRecordingFourCC('X', 'T', 'R', 'A'), 4};
+    uint8_t payload[8] = {0};
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(payload, sizeof(payload), 1, file);
+    fclose(file);
+
+    FrameReplay_t * replay = createFrameReplay(_path.fileSystemRepresentation, true);
+    FrameRecordingEvent_t event;
+    XCTAssertTrue(frameReplayNextEvent(replay, &event));
+    XCTAssertEqual(event.type, FrameRecordingChunkTypeFrame);
+    XCTAssertFalse(frameReplayNextEvent(replay, &event));
+    releaseFrameReplay(replay);
+}
+
+- (void)testOtherFilesAreNotRecordings {
+
+    FILE * file = fopen(_path.fileSystemRepresentation, "wb");
+    fputs("not a recording", file);
+    fclose(file);
+
+    XCTAssertTrue(createFrameReplay(_path.fileSystemRepresentation, true) == NULL);
+    XCTAssertTrue(createFrameReplay("/nonexistent/recording", true) == NULL);
+}
+
+- (void)testBlurTimelineFollowsAnimatedTransition {
+
+    FrameReplayBlurTimeline_t timeline;
+    frameReplayBlurTimelineInit(&timeline, 0.0f);
+
+    // 0 to 1 in 0.25s
+    frameReplayBlurTimelineApplyEvent(&timeline, 1.0, 1.0f, 0.25f);
+    XCTAssertEqualWithAccuracy(frameReplayBlurTimelineIntensity(&timeline, 1.1), 0.4f, 1e-5f);
+    XCTAssertEqualWithAccuracy(frameReplayBlurTimelineIntensity(&timeline, 1.2), 0.8f, 1e-5f);
+
+    // A new transition starts where the previous one is, back to 0 takes 0.2s
+    frameReplayBlurTimelineApplyEvent(&timeline, 1.2, 0.0f, 0.25f);
+    XCTAssertEqualWithAccuracy(frameReplayBlurTimelineIntensity(&timeline, 1.3), 0.4f, 1e-5f);
+    XCTAssertEqual(frameReplayBlurTimelineIntensity(&timeline, 1.5), 0.0f);
+
+    // Not animated
+    frameReplayBlurTimelineApplyEvent(&timeline, 2.0, 0.6f, 0.0f);
+    XCTAssertEqual(frameReplayBlurTimelineIntensity(&timeline, 2.0), 0.6f);
+    XCTAssertEqual(frameReplayBlurTimelineIntensity(&timeline, 3.0), 0.6f);
+}
+
+@end
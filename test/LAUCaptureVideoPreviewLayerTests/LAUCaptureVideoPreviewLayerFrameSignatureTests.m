@@ -0,0 +1,125 @@
+//
+//  LAUCaptureVideoPreviewLayerFrameSignatureTests.m
+//  LAUCaptureVideoPreviewLayerUnitTests
+//
+//  Created by Luis Laugga on 10/17/16.
+//  Copyright © 2016 Luis Laugga. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "LAUCaptureVideoPreviewLayerFrameSignature.h"
+
+#define kFrameWidth 192
+#define kFrameHeight 108
+
+@interface LAUCaptureVideoPreviewLayerFrameSignatureTests : XCTestCase
+{
+    uint8_t * _frame;
+    size_t _bytesPerRow;
+}
+
+@end
+
+@implementation LAUCaptureVideoPreviewLayerFrameSignatureTests
+
+- (void)setUp {
+    [super setUp];
+
+    // Padded rows, like most CVPixelBuffers
+    _bytesPerRow = kFrameWidth * 4 + 64;
+    _frame = malloc(_bytesPerRow * kFrameHeight);
+
+    // Horizontal gradient
+    for (size_t y = 0; y < kFrameHeight; ++y) {
+        for (size_t x = 0; x < kFrameWidth; ++x) {
+            uint8_t * pixel = _frame + y * _bytesPerRow + x * 4;
+            pixel[0] = pixel[1] = pixel[2] = (uint8_t)(x * 255 / kFrameWidth);
+            pixel[3] = 255;
+        }
+    }
+}
+
+- (void)tearDown {
+    free(_frame);
+
+    [super tearDown];
+}
+
+- (void)testIdenticalFramesAreSimilar {
+
+    FrameSignature_t signature, otherSignature;
+    frameSignatureComputeBGRA(_frame, kFrameWidth, kFrameHeight, _bytesPerRow, &signature);
+    frameSignatureComputeBGRA(_frame, kFrameWidth, kFrameHeight, _bytesPerRow, &otherSignature);
+
+    XCTAssertEqual(frameSignatureDistance(&signature, &otherSignature), 0.0f);
+    XCTAssertTrue(frameSignatureIsSimilar(&signature, &otherSignature, 0.0f));
+
+    // Gray levels are kept (luma of R = G = B)
+    XCTAssertLessThan(signature.cells[0], signature.cells[kFrameSignatureSize - 1]);
+}
+
+- (void)testLumaPlaneMatchesGrayFrame {
+
+    // Luma plane of the gray gradient
+    uint8_t * lumaPlane = malloc(kFrameWidth * kFrameHeight);
+    for (size_t y = 0; y < kFrameHeight; ++y) {
+        for (size_t x = 0; x < kFrameWidth; ++x) {
+            lumaPlane[y * kFrameWidth + x] = _frame[y * _bytesPerRow + x * 4];
+        }
+    }
+
+    FrameSignature_t signature, lumaSignature;
+    frameSignatureComputeBGRA(_frame, kFrameWidth, kFrameHeight, _bytesPerRow, &signature);
+    frameSignatureComputeLuma(lumaPlane, kFrameWidth, kFrameHeight, kFrameWidth, &lumaSignature);
+    free(lumaPlane);
+
+    XCTAssertEqual(frameSignatureDistance(&signature, &lumaSignature), 0.0f);
+}
+
+- (void)testNoiseIsSimilar {
+
+    FrameSignature_t signature, noisySignature;
+    frameSignatureComputeBGRA(_frame, kFrameWidth, kFrameHeight, _bytesPerRow, &signature);
+
+    // +-1 sensor noise
+    srand(7);
+    for (size_t y = 0; y < kFrameHeight; ++y) {
+        for (size_t x = 0; x < kFrameWidth; ++x) {
+            uint8_t * pixel = _frame + y * _bytesPerRow + x * 4;
+            int noise = (rand() % 3) - 1;
+            for (int c = 0; c < 3; ++c) {
+                pixel[c] = (uint8_t)MAX(0, MIN(255, pixel[c] + noise));
+            }
+        }
+    }
+
+    frameSignatureComputeBGRA(_frame, kFrameWidth, kFrameHeight, _bytesPerRow, &noisySignature);
+    XCTAssertLessThanOrEqual(frameSignatureDistance(&signature, &noisySignature), 1.0f);
+}
+
+- (void)testMovingObjectIsNotSimilar {
+
+    FrameSignature_t signature, movedSignature;
+    frameSignatureComputeBGRA(_frame, kFrameWidth, kFrameHeight, _bytesPerRow, &signature);
+
+    // White square over a quarter of the frame
+    for (size_t y = 0; y < kFrameHeight / 2; ++y) {
+        memset(_frame + y * _bytesPerRow, 255, kFrameWidth * 2);
+    }
+
+    frameSignatureComputeBGRA(_frame, kFrameWidth, kFrameHeight, _bytesPerRow, &movedSignature);
+    XCTAssertGreaterThan(frameSignatureDistance(&signature, &movedSignature), 10.0f);
+    XCTAssertFalse(frameSignatureIsSimilar(&signature, &movedSignature, 1.5f));
+}
+
+- (void)testDifferentDimensionsAreNotSimilar {
+
+    FrameSignature_t signature, croppedSignature;
+    frameSignatureComputeBGRA(_frame, kFrameWidth, kFrameHeight, _bytesPerRow, &signature);
+    frameSignatureComputeBGRA(_frame, kFrameWidth / 2, kFrameHeight, _bytesPerRow, &croppedSignature);
+
+    XCTAssertFalse(frameSignatureIsSimilar(&signature, &croppedSignature, 255.0f));
+}
+
+@end
@@ -0,0 +1,224 @@
+//
+//  LAUCaptureVideoPreviewLayerFrameTimingsTests.m
+//  LAUCaptureVideoPreviewLayerUnitTests
+//
+//  Created by Luis Laugga on 10/17/16.
+//  Copyright © 2016 Luis Laugga. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <unistd.h>
+
+#import "LAUCaptureVideoPreviewLayerFrameTimings.h"
+
+// Fake timer queries, results are available one frame later (after the next frameTimingsEndFrame)
+static GLuint fakeQueryCount;
+static GLuint fakeActiveQueryCount;
+static unsigned int fakeAvailableFrameCount;
+static unsigned int fakeQueryFrame[256];
+static bool fakeDisjoint;
+
+static void fakeGenQueries(GLsizei count, GLuint * queries)
+{
+    for (GLsizei i = 0; i < count; ++i) {
+        queries[i] = ++fakeQueryCount;
+    }
+}
+
+static void fakeDeleteQueries(GLsizei count, const GLuint * queries)
+{
+}
+
+static unsigned int fakeFrame;
+
+static void fakeBeginQuery(GLuint query)
+{
+    fakeQueryFrame[query] = fakeFrame;
+    fakeActiveQueryCount++;
+}
+
+static void fakeEndQuery(void)
+{
+    fakeActiveQueryCount--;
+}
+
+static bool fakeQueryResult(GLuint query, uint64_t * elapsedTime)
+{
+    if (fakeQueryFrame[query] >= fakeAvailableFrameCount) {
+        return false;
+    }
+
+    *elapsedTime = 100; // 100ns
+    return true;
+}
+
+static bool fakeQueryDisjoint(void)
+{
+    bool disjoint = fakeDisjoint;
+    fakeDisjoint = false;
+    return disjoint;
+}
+
+static const FrameTimingsTimerQueryFunctions_t fakeTimerQueryFunctions = {
+    fakeGenQueries, fakeDeleteQueries, fakeBeginQuery, fakeEndQuery, fakeQueryResult, fakeQueryDisjoint
+};
+
+@interface LAUCaptureVideoPreviewLayerFrameTimingsTests : XCTestCase
+
+@end
+
+@implementation LAUCaptureVideoPreviewLayerFrameTimingsTests
+
+- (void)setUp {
+    [super setUp];
+
+    fakeQueryCount = 0;
+    fakeActiveQueryCount = 0;
+    fakeAvailableFrameCount = 0;
+    fakeFrame = 0;
+    fakeDisjoint = false;
+}
+
+- (void)renderFrame:(FrameTimings_t *)frameTimings passCount:(unsigned int)passCount {
+
+    frameTimingsBeginFrame(frameTimings);
+
+    frameTimingsBeginStage(frameTimings, FrameTimingStageUniformUpdate);
+    frameTimingsEndStage(frameTimings, FrameTimingStageUniformUpdate);
+
+    for (unsigned int p = 0; p < passCount; ++p) {
+        frameTimingsBeginStage(frameTimings, FrameTimingStageOffscreenPass + p);
+        usleep(100);
+        frameTimingsEndStage(frameTimings, FrameTimingStageOffscreenPass + p);
+    }
+
+    frameTimingsEndFrame(frameTimings);
+    fakeFrame++;
+}
+
+- (void)testCPUTimesAreKeptForTheLastFrames {
+
+    FrameTimings_t * frameTimings = createFrameTimings(8);
+    frameTimingsSetTimerQueryFunctions(frameTimings, NULL);
+
+    for (unsigned int i = 0; i < 20; ++i) {
+        [self renderFrame:frameTimings passCount:2];
+    }
+
+    FrameTimingStatistics_t statistics;
+    XCTAssertTrue(frameTimingsStatistics(frameTimings, FrameTimingStageOffscreenPass + 1, false, &statistics));
+    XCTAssertEqual(statistics.sampleCount, 8);
+    XCTAssertGreaterThanOrEqual(statistics.p50, 100e-6);
+    XCTAssertLessThanOrEqual(statistics.p50, statistics.p90);
+    XCTAssertLessThanOrEqual(statistics.p90, statistics.p99);
+    XCTAssertLessThanOrEqual(statistics.p99, statistics.max);
+
+    // The frame includes its stages
+    FrameTimingStatistics_t frameStatistics;
+    XCTAssertTrue(frameTimingsStatistics(frameTimings, FrameTimingStageFrame, false, &frameStatistics));
+    XCTAssertGreaterThanOrEqual(frameStatistics.p50, 200e-6);
+
+    // Stages that never ran and GPU times (no timer queries)
+    XCTAssertFalse(frameTimingsStatistics(frameTimings, FrameTimingStageOffscreenPass + 2, false, &statistics));
+    XCTAssertFalse(frameTimingsStatistics(frameTimings, FrameTimingStageOffscreenPass, true, &statistics));
+
+    FrameTimingsCounters_t counters;
+    frameTimingsCounters(frameTimings, &counters);
+    XCTAssertEqual(counters.frameCount, 20);
+    XCTAssertEqual(counters.queryCount, 0);
+
+    releaseFrameTimings(frameTimings);
+}
+
+- (void)testGPUTimesAreCollectedWhenAvailable {
+
+    FrameTimings_t * frameTimings = createFrameTimings(8);
+    frameTimingsSetTimerQueryFunctions(frameTimings, &fakeTimerQueryFunctions);
+
+    // Results of frame 0 are not available yet
+    [self renderFrame:frameTimings passCount:2];
+
+    FrameTimingStatistics_t statistics;
+    XCTAssertFalse(frameTimingsStatistics(frameTimings, FrameTimingStageFrame, true, &statistics));
+
+    // Collected at the end of frame 1
+    fakeAvailableFrameCount = 1;
+    [self renderFrame:frameTimings passCount:2];
+
+    XCTAssertTrue(frameTimingsStatistics(frameTimings, FrameTimingStageOffscreenPass, true, &statistics));
+    XCTAssertEqual(statistics.sampleCount, 1);
+    XCTAssertEqualWithAccuracy(statistics.p50, 100e-9, 1e-12);
+
+    // The frame GPU time is the sum of its 3 stages
+    XCTAssertTrue(frameTimingsStatistics(frameTimings, FrameTimingStageFrame, true, &statistics));
+    XCTAssertEqualWithAccuracy(statistics.p50, 300e-9, 1e-12);
+
+    // Query objects are reused, one query at a time
+    fakeAvailableFrameCount = 100;
+    for (unsigned int i = 0; i < 10; ++i) {
+        [self renderFrame:frameTimings passCount:2];
+    }
+
+    XCTAssertEqual(fakeActiveQueryCount, 0);
+    XCTAssertLessThanOrEqual(fakeQueryCount, 9);
+
+    FrameTimingsCounters_t counters;
+    frameTimingsCounters(frameTimings, &counters);
+    XCTAssertEqual(counters.queryCount, 36);
+    XCTAssertEqual(counters.droppedQueryCount, 0);
+
+    releaseFrameTimings(frameTimings);
+}
+
+- (void)testDisjointDropsPendingQueries {
+
+    FrameTimings_t * frameTimings = createFrameTimings(8);
+    frameTimingsSetTimerQueryFunctions(frameTimings, &fakeTimerQueryFunctions);
+
+    [self renderFrame:frameTimings passCount:1];
+
+    fakeDisjoint = true;
+    fakeAvailableFrameCount = 1;
+    [self renderFrame:frameTimings passCount:1];
+
+    FrameTimingStatistics_t statistics;
+    XCTAssertFalse(frameTimingsStatistics(frameTimings, FrameTimingStageFrame, true, &statistics));
+
+    FrameTimingsCounters_t counters;
+    frameTimingsCounters(frameTimings, &counters);
+    XCTAssertEqual(counters.droppedQueryCount, 4);
+
+    releaseFrameTimings(frameTimings);
+}
+
+- (void)testCanceledFrameIsDiscarded {
+
+    FrameTimings_t * frameTimings = createFrameTimings(8);
+    frameTimingsSetTimerQueryFunctions(frameTimings, NULL);
+
+    frameTimingsBeginFrame(frameTimings);
+    frameTimingsBeginStage(frameTimings, FrameTimingStageTextureImport);
+    frameTimingsEndStage(frameTimings, FrameTimingStageTextureImport);
+    frameTimingsCancelFrame(frameTimings);
+
+    FrameTimingStatistics_t statistics;
+    XCTAssertFalse(frameTimingsStatistics(frameTimings, FrameTimingStageTextureImport, false, &statistics));
+    XCTAssertFalse(frameTimingsStatistics(frameTimings, FrameTimingStageFrame, false, &statistics));
+
+    FrameTimingsCounters_t counters;
+    frameTimingsCounters(frameTimings, &counters);
+    XCTAssertEqual(counters.frameCount, 0);
+
+    releaseFrameTimings(frameTimings);
+}
+
+- (void)testStageNames {
+
+    char name[32];
+    frameTimingsStageName(FrameTimingStageTextureImport, name, sizeof(name));
+    XCTAssertEqualObjects(@(name), @"textureImport");
+    frameTimingsStageName(FrameTimingStageOffscreenPass + 3, name, sizeof(name));
+    XCTAssertEqualObjects(@(name), @"offscreenPass3");
+}
+
+@end
@@ -0,0 +1,307 @@
+//
+//  LAUCaptureVideoPreviewLayerGaussianFilterKernelTests.m
+//  LAUCaptureVideoPreviewLayerUnitTests
+//
+//  Created by Luis Laugga on 10/17/16.
+//  Copyright © 2016 Luis Laugga. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "LAUCaptureVideoPreviewLayerGaussianFilterKernel.h"
+
+// The precomputed tables are printed with 6 decimals
+static const float kTestTableAccuracy = 1e-5f;
+
+@interface LAUCaptureVideoPreviewLayerGaussianFilterKernelTests : XCTestCase
+
+@end
+
+@implementation LAUCaptureVideoPreviewLayerGaussianFilterKernelTests
+
+- (void)testDtsGeneratorMatchesPrecomputedTable {
+
+    const GaussianFilterKernelParameters_t * parameters = &kDtsGaussianFilterKernelDefaultParameters;
+
+    XCTAssertEqual(parameters->kernelCount, gaussianFilterKernelCount());
+
+    for (unsigned int kernelIndex = 0; kernelIndex < parameters->kernelCount; ++kernelIndex) {
+
+        float step = gaussianFilterStepForKernelIndex(parameters, kernelIndex);
+        float sigma = gaussianFilterSigmaForStep(parameters, step);
+        unsigned int size = gaussianFilterSizeForSigma(sigma, parameters->truncation);
+
+        XCTAssertEqualWithAccuracy(step, dtsGaussianFilterStepForKernelIndex(kernelIndex), kTestTableAccuracy);
+        XCTAssertEqualWithAccuracy(sigma, dtsGaussianFilterSigmaForKernelIndex(kernelIndex), kTestTableAccuracy);
+        XCTAssertEqual(size, dtsGaussianFilterSizeForKernelIndex(kernelIndex));
+        XCTAssertEqual(gaussianFilterRadiusForSize(size), dtsGaussianFilterRadiusForKernelIndex(kernelIndex));
+
+        float weights[size];
+        generateDtsGaussianFilterWeights(sigma, size, weights);
+
+        for (unsigned int weightIndex = 0; weightIndex < size; ++weightIndex) {
+            XCTAssertEqualWithAccuracy(weights[weightIndex], dtsGaussianFilterWeightForIndexes(kernelIndex, weightIndex), kTestTableAccuracy, @"Kernel %u, weight %u", kernelIndex, weightIndex);
+        }
+    }
+}
+
+- (void)testBtsGeneratorMatchesPrecomputedTable {
+
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+    unsigned int samples = btsGaussianFilterMaxSamples(parameters);
+
+    XCTAssertEqual(parameters->kernelCount, gaussianFilterKernelCount());
+
+    for (unsigned int kernelIndex = 0; kernelIndex < parameters->kernelCount; ++kernelIndex) {
+
+        float step = gaussianFilterStepForKernelIndex(parameters, kernelIndex);
+        float sigma = gaussianFilterSigmaForStep(parameters, step);
+        unsigned int size = gaussianFilterSizeForSigma(sigma, parameters->truncation);
+
+        XCTAssertEqualWithAccuracy(step, btsGaussianFilterStepForKernelIndex(kernelIndex), kTestTableAccuracy);
+        XCTAssertEqualWithAccuracy(sigma, btsGaussianFilterSigmaForKernelIndex(kernelIndex), kTestTableAccuracy);
+        XCTAssertEqual(size, btsGaussianFilterSizeForKernelIndex(kernelIndex));
+        XCTAssertEqual(samples, btsGaussianFilterSamplesForKernelIndex(kernelIndex));
+
+        float offsets[samples];
+        float weights[samples];
+        generateBtsGaussianFilterOffsetsAndWeights(sigma, size, samples, offsets, weights);
+
+        for (unsigned int sampleIndex = 0; sampleIndex < samples; ++sampleIndex) {
+            XCTAssertEqualWithAccuracy(offsets[sampleIndex], btsGaussianFilterOffsetForIndexes(kernelIndex, sampleIndex), kTestTableAccuracy, @"Kernel %u, offset %u", kernelIndex, sampleIndex);
+            XCTAssertEqualWithAccuracy(weights[sampleIndex], btsGaussianFilterWeightForIndexes(kernelIndex, sampleIndex), kTestTableAccuracy, @"Kernel %u, weight %u", kernelIndex, sampleIndex);
+        }
+    }
+}
+
+- (void)testStepForSigmaInvertsSigmaForStep {
+
+    GaussianFilterSigmaEasing_t easings[] = {GaussianFilterSigmaEasingLinear, GaussianFilterSigmaEasingEaseOutQuad, GaussianFilterSigmaEasingSmoothStep};
+
+    for (unsigned int e = 0; e < sizeof(easings) / sizeof(easings[0]); ++e) {
+
+        GaussianFilterKernelParameters_t parameters = kBtsGaussianFilterKernelDefaultParameters;
+        parameters.sigmaEasing = easings[e];
+
+        for (float step = 0.0f; step <= 1.0f; step += 0.05f) {
+            float sigma = gaussianFilterSigmaForStep(&parameters, step);
+            XCTAssertEqualWithAccuracy(gaussianFilterStepForSigma(&parameters, sigma), step, 1e-3, @"Easing %u, step %f", easings[e], step);
+        }
+
+        // Out of range sigmas are clamped
+        XCTAssertEqual(gaussianFilterStepForSigma(&parameters, 0.0f), 0.0f);
+        XCTAssertEqual(gaussianFilterStepForSigma(&parameters, 2.0f * parameters.maxSigma), 1.0f);
+    }
+}
+
+- (void)testKernelBankWithDefaultParametersUsesPrecomputedTable {
+
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+    unsigned int samples = btsGaussianFilterMaxSamples(parameters);
+
+    for (unsigned int kernelIndex = 0; kernelIndex < parameters->kernelCount; ++kernelIndex) {
+
+        float offsets[samples];
+        float weights[samples];
+        btsGaussianFilterKernelForIndex(parameters, kernelIndex, offsets, weights);
+
+        for (unsigned int sampleIndex = 0; sampleIndex < samples; ++sampleIndex) {
+            XCTAssertEqual(offsets[sampleIndex], btsGaussianFilterOffsetForIndexes(kernelIndex, sampleIndex));
+            XCTAssertEqual(weights[sampleIndex], btsGaussianFilterWeightForIndexes(kernelIndex, sampleIndex));
+        }
+    }
+}
+
+- (void)testKernelBankBlendsNeighbouringKernels {
+
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+    unsigned int samples = btsGaussianFilterMaxSamples(parameters);
+    unsigned int stride = btsGaussianFilterKernelBankStride(parameters);
+
+    XCTAssertEqual(stride % 4, 0);
+    XCTAssertTrue(stride >= samples && stride < samples + 4);
+
+    float bankOffsets[parameters->kernelCount * stride];
+    float bankWeights[parameters->kernelCount * stride];
+    btsGaussianFilterKernelBank(parameters, bankOffsets, bankWeights);
+
+    for (unsigned int kernelIndex = 0; kernelIndex < parameters->kernelCount; ++kernelIndex) {
+
+        float offsets[samples];
+        float weights[samples];
+        btsGaussianFilterKernelForIndex(parameters, kernelIndex, offsets, weights);
+
+        // Integer positions select a kernel of the bank
+        float position = gaussianFilterKernelBankPositionForStep(parameters, (float)kernelIndex / (parameters->kernelCount - 1));
+        XCTAssertEqualWithAccuracy(position, (float)kernelIndex, 1e-5f);
+        XCTAssertEqual(gaussianFilterKernelBankSizeForPosition(parameters, kernelIndex), dtsGaussianFilterSizeForIndex(parameters, kernelIndex));
+
+        float blendedOffsets[samples];
+        float blendedWeights[samples];
+        btsGaussianFilterKernelBankKernelForPosition(parameters, kernelIndex, blendedOffsets, blendedWeights);
+
+        for (unsigned int sampleIndex = 0; sampleIndex < stride; ++sampleIndex) {
+            float offset = sampleIndex < samples ? offsets[sampleIndex] : 0.0f;
+            float weight = sampleIndex < samples ? weights[sampleIndex] : 0.0f;
+            XCTAssertEqual(bankOffsets[kernelIndex * stride + sampleIndex], offset);
+            XCTAssertEqual(bankWeights[kernelIndex * stride + sampleIndex], weight);
+            if (sampleIndex < samples) {
+                XCTAssertEqualWithAccuracy(blendedOffsets[sampleIndex], offset, 1e-5f);
+                XCTAssertEqualWithAccuracy(blendedWeights[sampleIndex], weight, 1e-6f);
+            }
+        }
+
+        if (kernelIndex + 1 == parameters->kernelCount) {
+            continue;
+        }
+
+        // Between two kernels, the weights of both are interpolated (still normalized) and the samples cover the larger one
+        float middlePosition = kernelIndex + 0.5f;
+        btsGaussianFilterKernelBankKernelForPosition(parameters, middlePosition, blendedOffsets, blendedWeights);
+
+        float weightsSum = 0.0f;
+        for (unsigned int sampleIndex = 0; sampleIndex < samples; ++sampleIndex) {
+            weightsSum += 2.0f * blendedWeights[sampleIndex];
+        }
+        XCTAssertEqualWithAccuracy(weightsSum, 1.0f, 1e-5f);
+
+        unsigned int size = gaussianFilterKernelBankSizeForPosition(parameters, middlePosition);
+        XCTAssertEqual(size, MAX(dtsGaussianFilterSizeForIndex(parameters, kernelIndex), dtsGaussianFilterSizeForIndex(parameters, kernelIndex + 1)));
+        for (unsigned int sampleIndex = btsGaussianFilterSamplesForSize(size); sampleIndex < samples; ++sampleIndex) {
+            XCTAssertEqual(blendedWeights[sampleIndex], 0.0f);
+        }
+    }
+}
+
+- (void)testGeneratedKernelsAreNormalized {
+
+    // Wider sigma range, more kernels and 3-sigma truncation than the precomputed tables
+    GaussianFilterKernelParameters_t parameters = {
+        .kernelCount = 32,
+        .minSigma = 0.5f,
+        .maxSigma = 24.0f,
+        .sigmaEasing = GaussianFilterSigmaEasingSmoothStep,
+        .truncation = 3.0f,
+    };
+
+    unsigned int maxSize = dtsGaussianFilterMaxSize(&parameters);
+    unsigned int maxSamples = btsGaussianFilterMaxSamples(&parameters);
+
+    XCTAssertEqual(maxSize, 2 * 72 + 1);
+    XCTAssertEqual(maxSamples, btsGaussianFilterSamplesForSize(maxSize));
+
+    for (unsigned int kernelIndex = 0; kernelIndex < parameters.kernelCount; ++kernelIndex) {
+
+        unsigned int size = dtsGaussianFilterSizeForIndex(&parameters, kernelIndex);
+        XCTAssertTrue(size % 2 == 1 && size <= maxSize);
+
+        float dtsWeights[size];
+        dtsGaussianFilterKernelForIndex(&parameters, kernelIndex, dtsWeights);
+
+        float dtsWeightsSum = 0.0f;
+        for (unsigned int i = 0; i < size; ++i) {
+            dtsWeightsSum += dtsWeights[i];
+            XCTAssertEqualWithAccuracy(dtsWeights[i], dtsWeights[size - 1 - i], 1e-7f, @"Kernel must be symmetric");
+        }
+        XCTAssertEqualWithAccuracy(dtsWeightsSum, 1.0f, 1e-5f);
+
+        float btsOffsets[maxSamples];
+        float btsWeights[maxSamples];
+        btsGaussianFilterKernelForIndex(&parameters, kernelIndex, btsOffsets, btsWeights);
+
+        // Each sample is used on both sides of the center pixel
+        float btsWeightsSum = 0.0f;
+        for (unsigned int i = 0; i < maxSamples; ++i) {
+            btsWeightsSum += 2.0f * btsWeights[i];
+            XCTAssertTrue(i == 0 || btsWeights[i] == 0.0f || btsOffsets[i] > btsOffsets[i - 1], @"Offsets must increase");
+        }
+        XCTAssertEqualWithAccuracy(btsWeightsSum, 1.0f, 1e-5f);
+    }
+}
+
+- (void)testKernelCacheGeneratesKernelForExactStep {
+
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+    GaussianFilterKernelCache_t * cache = createGaussianFilterKernelCache(parameters, GaussianFilterKernelTypeBts, 4);
+
+    // Steps of the precomputed kernels give the same kernels
+    const GaussianFilterKernel_t * kernel = gaussianFilterKernelCacheKernelForStep(cache, 0.5f);
+    XCTAssertEqual(kernel->size, btsGaussianFilterSizeForKernelIndex(5));
+    XCTAssertEqual(kernel->samples, btsGaussianFilterSamplesForKernelIndex(5));
+    for (unsigned int sampleIndex = 0; sampleIndex < kernel->samples; ++sampleIndex) {
+        XCTAssertEqualWithAccuracy(kernel->offsets[sampleIndex], btsGaussianFilterOffsetForIndexes(5, sampleIndex), kTestTableAccuracy);
+        XCTAssertEqualWithAccuracy(kernel->weights[sampleIndex], btsGaussianFilterWeightForIndexes(5, sampleIndex), kTestTableAccuracy);
+    }
+
+    // Steps in between have a sigma in between
+    kernel = gaussianFilterKernelCacheKernelForStep(cache, 0.55f);
+    XCTAssertGreaterThan(kernel->sigma, btsGaussianFilterSigmaForKernelIndex(5));
+    XCTAssertLessThan(kernel->sigma, btsGaussianFilterSigmaForKernelIndex(6));
+
+    releaseGaussianFilterKernelCache(cache);
+}
+
+- (void)testKernelCacheEvictsLeastRecentlyUsedKernel {
+
+    GaussianFilterKernelCache_t * cache = createGaussianFilterKernelCache(&kDtsGaussianFilterKernelDefaultParameters, GaussianFilterKernelTypeDts, 2);
+    unsigned long hits, misses;
+
+    const GaussianFilterKernel_t * kernelA = gaussianFilterKernelCacheKernelForStep(cache, 0.25f);
+    float sigmaA = kernelA->sigma;
+    gaussianFilterKernelCacheKernelForStep(cache, 0.5f);
+
+    // Quantized steps share the same kernel
+    XCTAssertEqual(gaussianFilterKernelCacheKernelForStep(cache, 0.25f + 0.1f / kGaussianFilterKernelCacheStepResolution), kernelA);
+    gaussianFilterKernelCacheStatistics(cache, &hits, &misses);
+    XCTAssertEqual(hits, 1);
+    XCTAssertEqual(misses, 2);
+
+    // 0.5 is the least recently used kernel and gets replaced
+    gaussianFilterKernelCacheKernelForStep(cache, 0.75f);
+    XCTAssertEqual(gaussianFilterKernelCacheKernelForStep(cache, 0.25f)->sigma, sigmaA);
+    gaussianFilterKernelCacheStatistics(cache, &hits, &misses);
+    XCTAssertEqual(hits, 2);
+    XCTAssertEqual(misses, 3);
+
+    gaussianFilterKernelCacheKernelForStep(cache, 0.5f);
+    gaussianFilterKernelCacheStatistics(cache, &hits, &misses);
+    XCTAssertEqual(misses, 4);
+
+    releaseGaussianFilterKernelCache(cache);
+}
+
+- (void)testDualFilterLevelCountMatchesSigma {
+
+    const unsigned int maxLevelCount = 6;
+    float previousSigma = 0.0f;
+    unsigned int previousLevelCount = 1;
+
+    for (float sigma = 1.0f; sigma <= 40.0f; sigma += 0.5f) {
+
+        float offset;
+        unsigned int levelCount = dualFilterLevelCountForSigma(sigma, maxLevelCount, &offset);
+
+        XCTAssertTrue(levelCount >= 1 && levelCount <= maxLevelCount);
+        XCTAssertTrue(offset >= kDualFilterMinOffset && offset <= kDualFilterMaxOffset);
+        XCTAssertGreaterThanOrEqual(levelCount, previousLevelCount, @"Wider blurs must not use fewer levels");
+
+        // Sigma of the selected levels and offset increases with the target sigma
+        float dualSigma = dualFilterSigma(levelCount, offset);
+        XCTAssertGreaterThanOrEqual(dualSigma, previousSigma);
+
+        // Offsets within [min,max] reproduce the target sigma
+        if (offset > kDualFilterMinOffset && offset < kDualFilterMaxOffset) {
+            XCTAssertEqualWithAccuracy(dualSigma, sigma, 1e-3f * sigma, @"Sigma %f", sigma);
+        }
+
+        previousSigma = dualSigma;
+        previousLevelCount = levelCount;
+    }
+
+    // Sigmas beyond the widest pyramid are clamped to the maximum offset
+    float offset;
+    XCTAssertEqual(dualFilterLevelCountForSigma(1000.0f, maxLevelCount, &offset), maxLevelCount);
+    XCTAssertEqual(offset, kDualFilterMaxOffset);
+}
+
+@end
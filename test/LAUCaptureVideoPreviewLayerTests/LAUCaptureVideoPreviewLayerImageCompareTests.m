@@ -0,0 +1,156 @@
+//
+//  LAUCaptureVideoPreviewLayerImageCompareTests.m
+//  LAUCaptureVideoPreviewLayerUnitTests
+//
+//  Created by Luis Laugga on 10/17/16.
+//  Copyright © 2016 Luis Laugga. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "LAUCaptureVideoPreviewLayerImageCompare.h"
+
+#define kImageWidth 203
+#define kImageHeight 117
+
+@interface LAUCaptureVideoPreviewLayerImageCompareTests : XCTestCase
+{
+    BlurEngineImage_t _image;
+    BlurEngineImage_t _otherImage;
+}
+
+@end
+
+@implementation LAUCaptureVideoPreviewLayerImageCompareTests
+
+- (void)setUp {
+    [super setUp];
+
+    // Padded rows, odd width (vector tails)
+    _image.width = _otherImage.width = kImageWidth;
+    _image.height = _otherImage.height = kImageHeight;
+    _image.bytesPerRow = _otherImage.bytesPerRow = kImageWidth * 4 + 16;
+    _image.data = malloc(_image.bytesPerRow * kImageHeight);
+    _otherImage.data = malloc(_otherImage.bytesPerRow * kImageHeight);
+
+    // Checkerboard with gradients, values in [0,200] so that an offset doesn't saturate
+    for (size_t y = 0; y < kImageHeight; ++y) {
+        for (size_t x = 0; x < kImageWidth; ++x) {
+            uint8_t * pixel = _image.data + y * _image.bytesPerRow + x * 4;
+            pixel[0] = (((x / 16) + (y / 16)) % 2) ? 200 : 0;
+            pixel[1] = (uint8_t)(200 * x / kImageWidth);
+            pixel[2] = (uint8_t)(200 * y / kImageHeight);
+            pixel[3] = 255;
+        }
+    }
+
+    memcpy(_otherImage.data, _image.data, _image.bytesPerRow * kImageHeight);
+}
+
+- (void)tearDown {
+    free(_image.data);
+    free(_otherImage.data);
+
+    [super tearDown];
+}
+
+- (void)testSameImage {
+
+    ImageCompareResult_t result;
+    XCTAssertTrue(imageCompare(&_image, &_otherImage, &result));
+
+    XCTAssertEqual(result.maxDifference, 0);
+    XCTAssertEqual(result.meanSquaredError, 0.0);
+    XCTAssertTrue(isinf(result.psnr));
+    XCTAssertEqual(result.ssim, 1.0);
+}
+
+- (void)testOffsetImage {
+
+    // +10 on every color channel, alpha differences are ignored
+    for (size_t y = 0; y < kImageHeight; ++y) {
+        for (size_t x = 0; x < kImageWidth; ++x) {
+            uint8_t * pixel = _otherImage.data + y * _otherImage.bytesPerRow + x * 4;
+            pixel[0] += 10;
+            pixel[1] += 10;
+            pixel[2] += 10;
+            pixel[3] = 0;
+        }
+    }
+
+    ImageCompareResult_t result;
+    XCTAssertTrue(imageCompare(&_image, &_otherImage, &result));
+
+    XCTAssertEqual(result.maxDifference, 10);
+    XCTAssertEqualWithAccuracy(result.meanSquaredError, 100.0, 1e-9);
+    XCTAssertEqualWithAccuracy(result.psnr, 10.0 * log10(255.0 * 255.0 / 100.0), 1e-9);
+
+    // Luminance shift only, the structure is the same
+    XCTAssertLessThan(result.ssim, 1.0);
+    XCTAssertGreaterThan(result.ssim, 0.95);
+}
+
+- (void)testBackendsAgree {
+
+    // Noise, correlated with the image
+    srand(11);
+    for (size_t i = 0; i < _otherImage.bytesPerRow * kImageHeight; ++i) {
+        _otherImage.data[i] = (uint8_t)((3 * _image.data[i] + (rand() & 255)) / 4);
+    }
+
+    ImageCompareResult_t scalarResult;
+    XCTAssertTrue(imageCompareWithBackend(&_image, &_otherImage, ImageCompareBackendScalar, &scalarResult));
+    XCTAssertLessThan(scalarResult.ssim, 0.95);
+
+    for (ImageCompareBackend_t backend = ImageCompareBackendSSE2; backend <= ImageCompareBackendNEON; ++backend) {
+        if (!imageCompareBackendAvailable(backend)) {
+            continue;
+        }
+
+        // Integer sums, same result
+        ImageCompareResult_t result;
+        XCTAssertTrue(imageCompareWithBackend(&_image, &_otherImage, backend, &result));
+        XCTAssertEqual(result.maxDifference, scalarResult.maxDifference);
+        XCTAssertEqual(result.meanSquaredError, scalarResult.meanSquaredError);
+        XCTAssertEqual(result.ssim, scalarResult.ssim);
+    }
+}
+
+- (void)testBlurLowersSSIM {
+
+    // 3x3 box blur of the color channels
+    for (size_t y = 1; y + 1 < kImageHeight; ++y) {
+        for (size_t x = 1; x + 1 < kImageWidth; ++x) {
+            for (size_t c = 0; c < 3; ++c) {
+                unsigned int sum = 0;
+                for (int dy = -1; dy <= 1; ++dy) {
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        sum += _image.data[(y + dy) * _image.bytesPerRow + (x + dx) * 4 + c];
+                    }
+                }
+                _otherImage.data[y * _otherImage.bytesPerRow + x * 4 + c] = (uint8_t)((sum + 4) / 9);
+            }
+        }
+    }
+
+    ImageCompareResult_t result;
+    XCTAssertTrue(imageCompare(&_image, &_otherImage, &result));
+
+    XCTAssertGreaterThan(result.maxDifference, 0);
+    XCTAssertLessThan(result.ssim, 1.0);
+    XCTAssertGreaterThan(result.psnr, 20.0);
+}
+
+- (void)testDimensionsMustMatch {
+
+    ImageCompareResult_t result;
+
+    _otherImage.width = kImageWidth - 1;
+    XCTAssertFalse(imageCompare(&_image, &_otherImage, &result));
+
+    // At least one SSIM window
+    _image.width = _otherImage.width = 7;
+    XCTAssertFalse(imageCompare(&_image, &_otherImage, &result));
+}
+
+@end
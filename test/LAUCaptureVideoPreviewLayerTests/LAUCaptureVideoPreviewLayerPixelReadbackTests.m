@@ -0,0 +1,182 @@
+//
+//  LAUCaptureVideoPreviewLayerPixelReadbackTests.m
+//  LAUCaptureVideoPreviewLayerUnitTests
+//
+//  Created by Luis Laugga on 10/17/16.
+//  Copyright © 2016 Luis Laugga. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <OpenGLES/EAGL.h>
+
+#import "LAUCaptureVideoPreviewLayerPixelReadback.h"
+
+#define kReadbackWidth 16
+#define kReadbackHeight 8
+
+struct ReadbackResults {
+    unsigned int count;
+    unsigned long requestIndex[8];
+    uint8_t red[8];
+    size_t width;
+    size_t height;
+};
+
+static void recordReadback(void * context, const PixelReadbackImage_t * image)
+{
+    struct ReadbackResults * results = (struct ReadbackResults *)context;
+    results->requestIndex[results->count] = image->requestIndex;
+    results->red[results->count] = image->data[(image->height - 1) * image->bytesPerRow + (image->width - 1) * 4];
+    results->width = image->width;
+    results->height = image->height;
+    results->count++;
+}
+
+@interface LAUCaptureVideoPreviewLayerPixelReadbackTests : XCTestCase
+{
+    EAGLContext * _context;
+    GLuint _framebuffer;
+    GLuint _renderbuffer;
+}
+
+@end
+
+@implementation LAUCaptureVideoPreviewLayerPixelReadbackTests
+
+- (void)setUp {
+    [super setUp];
+
+    _context = [[EAGLContext alloc] initWithAPI:kEAGLRenderingAPIOpenGLES2];
+    [EAGLContext setCurrentContext:_context];
+
+    glGenRenderbuffers(1, &_renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, _renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8_OES, kReadbackWidth, kReadbackHeight);
+    glGenFramebuffers(1, &_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _renderbuffer);
+}
+
+- (void)tearDown {
+    glDeleteFramebuffers(1, &_framebuffer);
+    glDeleteRenderbuffers(1, &_renderbuffer);
+
+    [EAGLContext setCurrentContext:nil];
+    _context = nil;
+
+    [super tearDown];
+}
+
+- (void)clearFramebufferWithRed:(uint8_t)red {
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    glClearColor(red / 255.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+}
+
+- (void)testRequestsCompleteInOrderWithTheirFrame {
+
+    PixelReadback_t * readback = createPixelReadback(2);
+    struct ReadbackResults results = {0};
+
+    // Each request copies the framebuffer contents at the time of the request
+    for (uint8_t i = 0; i < 5; ++i) {
+        [self clearFramebufferWithRed:i * 50];
+        XCTAssertTrue(pixelReadbackRequest(readback, _framebuffer, kReadbackWidth, kReadbackHeight, recordReadback, &results));
+        pixelReadbackPoll(readback, false);
+    }
+
+    pixelReadbackPoll(readback, true);
+    XCTAssertEqual(pixelReadbackPendingCount(readback), 0);
+    XCTAssertEqual(results.count, 5);
+    XCTAssertEqual(results.width, kReadbackWidth);
+    XCTAssertEqual(results.height, kReadbackHeight);
+
+    for (unsigned int i = 0; i < 5; ++i) {
+        XCTAssertEqual(results.requestIndex[i], i);
+        XCTAssertEqualWithAccuracy(results.red[i], i * 50, 1);
+    }
+
+    // Slots are reused, only the first two allocate (texture and pixel buffer)
+    PixelReadbackStatistics_t statistics;
+    pixelReadbackStatistics(readback, &statistics);
+    XCTAssertEqual(statistics.requestCount, 5);
+    XCTAssertEqual(statistics.completedCount, 5);
+    XCTAssertEqual(statistics.allocationCount, 4);
+    XCTAssertEqual(glGetError(), GL_NO_ERROR);
+
+    releasePixelReadback(readback);
+}
+
+- (void)testRequestsWithoutFencesCompleteOnSecondPoll {
+
+    PixelReadback_t * readback = createPixelReadback(2);
+    pixelReadbackSetFenceFunctions(readback, NULL, NULL, NULL);
+    struct ReadbackResults results = {0};
+
+    [self clearFramebufferWithRed:200];
+    XCTAssertTrue(pixelReadbackRequest(readback, _framebuffer, kReadbackWidth, kReadbackHeight, recordReadback, &results));
+
+    XCTAssertEqual(pixelReadbackPoll(readback, false), 0);
+    XCTAssertEqual(results.count, 0);
+    XCTAssertEqual(pixelReadbackPoll(readback, false), 1);
+    XCTAssertEqual(results.count, 1);
+    XCTAssertEqualWithAccuracy(results.red[0], 200, 1);
+
+    releasePixelReadback(readback);
+}
+
+- (void)testReleaseDropsPendingRequests {
+
+    PixelReadback_t * readback = createPixelReadback(1);
+    struct ReadbackResults results = {0};
+
+    [self clearFramebufferWithRed:100];
+    XCTAssertTrue(pixelReadbackRequest(readback, _framebuffer, kReadbackWidth, kReadbackHeight, recordReadback, &results));
+    XCTAssertEqual(pixelReadbackPendingCount(readback), 1);
+
+    releasePixelReadback(readback);
+    XCTAssertEqual(results.count, 0);
+}
+
+- (void)testBufferPoolReusesGivenBackBuffers {
+
+    PixelReadbackBufferPool_t * pool = createPixelReadbackBufferPool(2);
+    size_t size = kReadbackWidth * kReadbackHeight * 4;
+
+    // Two images alive at the same time need two buffers
+    PixelReadbackBuffer_t * first = pixelReadbackBufferPoolAcquire(pool, size);
+    PixelReadbackBuffer_t * second = pixelReadbackBufferPoolAcquire(pool, size);
+    XCTAssertTrue(first != NULL && second != NULL && first != second);
+    pixelReadbackBufferRelinquish(first);
+    pixelReadbackBufferRelinquish(second);
+
+    // The next snapshots reuse them
+    for (int i = 0; i < 10; ++i) {
+        PixelReadbackBuffer_t * buffer = pixelReadbackBufferPoolAcquire(pool, size);
+        memset(pixelReadbackBufferBytes(buffer), i, size);
+        pixelReadbackBufferRelinquish(buffer);
+    }
+
+    PixelReadbackBufferPoolStatistics_t statistics;
+    pixelReadbackBufferPoolStatistics(pool, &statistics);
+    XCTAssertEqual(statistics.acquireCount, 12);
+    XCTAssertEqual(statistics.allocationCount, 2);
+    XCTAssertEqual(statistics.outstandingCount, 0);
+
+    releasePixelReadbackBufferPool(pool);
+}
+
+- (void)testBufferOutlivesReleasedPool {
+
+    PixelReadbackBufferPool_t * pool = createPixelReadbackBufferPool(1);
+    size_t size = kReadbackWidth * kReadbackHeight * 4;
+
+    // ie. a snapshot image kept by the app after the layer was deallocated
+    PixelReadbackBuffer_t * buffer = pixelReadbackBufferPoolAcquire(pool, size);
+    releasePixelReadbackBufferPool(pool);
+
+    memset(pixelReadbackBufferBytes(buffer), 0xff, size);
+    pixelReadbackBufferRelinquish(buffer);
+}
+
+@end
@@ -0,0 +1,162 @@
+//
+//  LAUCaptureVideoPreviewLayerProgramCacheTests.m
+//  LAUCaptureVideoPreviewLayerUnitTests
+//
+//  Created by Luis Laugga on 10/17/16.
+//  Copyright © 2016 Luis Laugga. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <OpenGLES/EAGL.h>
+
+#import "LAUCaptureVideoPreviewLayerProgramCache.h"
+#import "LAUCaptureVideoPreviewLayerShaders.h"
+#import "LAUCaptureVideoPreviewLayerUtilities.h"
+
+@interface LAUCaptureVideoPreviewLayerProgramCacheTests : XCTestCase
+{
+    EAGLContext * _context;
+    NSString * _directoryPath;
+}
+
+@end
+
+@implementation LAUCaptureVideoPreviewLayerProgramCacheTests
+
+- (void)setUp {
+    [super setUp];
+
+    _context = [[EAGLContext alloc] initWithAPI:kEAGLRenderingAPIOpenGLES2];
+    [EAGLContext setCurrentContext:_context];
+
+    _directoryPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    [[NSFileManager defaultManager] createDirectoryAtPath:_directoryPath withIntermediateDirectories:YES attributes:nil error:nil];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath:_directoryPath error:nil];
+    [EAGLContext setCurrentContext:nil];
+    _context = nil;
+
+    [super tearDown];
+}
+
+- (void)testSecondLoadUsesCachedBinary {
+
+    ProgramCacheStatistics_t statistics;
+
+    // First launch compiles from source
+    ProgramCache_t * programCache = createProgramCache(_directoryPath.fileSystemRepresentation);
+    GLuint program = programCacheLoadProgram(programCache, VertexShaderSourceBlurFilterBts, FragmentShaderSourceBlurFilterBts);
+    XCTAssertNotEqual(program, 0);
+    programCacheStatistics(programCache, &statistics);
+    XCTAssertEqual(statistics.hitCount, 0);
+    XCTAssertEqual(statistics.missCount, 1);
+    glDeleteProgram(program);
+    releaseProgramCache(programCache);
+
+    // Next launch loads the binary (if the driver supports it)
+    programCache = createProgramCache(_directoryPath.fileSystemRepresentation);
+    BOOL programBinarySupported = programCacheBinarySupported(programCache);
+    program = programCacheLoadProgram(programCache, VertexShaderSourceBlurFilterBts, FragmentShaderSourceBlurFilterBts);
+    XCTAssertNotEqual(program, 0);
+    XCTAssertEqual(validateProgram(program), 0);
+    programCacheStatistics(programCache, &statistics);
+    XCTAssertEqual(statistics.hitCount, programBinarySupported ? 1 : 0);
+    XCTAssertEqual(statistics.missCount, programBinarySupported ? 0 : 1);
+    glDeleteProgram(program);
+
+    // Different sources are a different program
+    program = programCacheLoadProgram(programCache, VertexShaderSourceDefault, FragmentShaderSourceDefault);
+    XCTAssertNotEqual(program, 0);
+    programCacheStatistics(programCache, &statistics);
+    XCTAssertEqual(statistics.missCount, programBinarySupported ? 1 : 2);
+    glDeleteProgram(program);
+    releaseProgramCache(programCache);
+}
+
+- (void)testCorruptedBinaryFallsBackToSource {
+
+    ProgramCache_t * programCache = createProgramCache(_directoryPath.fileSystemRepresentation);
+
+    if (!programCacheBinarySupported(programCache)) {
+        releaseProgramCache(programCache);
+        return;
+    }
+
+    glDeleteProgram(programCacheLoadProgram(programCache, VertexShaderSourceDefault, FragmentShaderSourceDefault));
+
+    // Corrupt every cached binary
+    for (NSString * fileName in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:_directoryPath error:nil]) {
+        NSString * path = [_directoryPath stringByAppendingPathComponent:fileName];
+        NSMutableData * data = [NSMutableData dataWithContentsOfFile:path];
+        ((uint8_t *)data.mutableBytes)[data.length - 1] ^= 0xff;
+        [data writeToFile:path atomically:YES];
+    }
+
+    GLuint program = programCacheLoadProgram(programCache, VertexShaderSourceDefault, FragmentShaderSourceDefault);
+    XCTAssertNotEqual(program, 0);
+    glDeleteProgram(program);
+
+    ProgramCacheStatistics_t statistics;
+    programCacheStatistics(programCache, &statistics);
+    XCTAssertEqual(statistics.hitCount, 0);
+    XCTAssertEqual(statistics.missCount, 2);
+    XCTAssertEqual(statistics.staleCount, 1);
+    XCTAssertEqual(statistics.storeCount, 2);
+
+    // The binary was replaced
+    glDeleteProgram(programCacheLoadProgram(programCache, VertexShaderSourceDefault, FragmentShaderSourceDefault));
+    programCacheStatistics(programCache, &statistics);
+    XCTAssertEqual(statistics.hitCount, 1);
+
+    releaseProgramCache(programCache);
+}
+
+- (void)testPendingErrorDoesNotInvalidateCachedBinary {
+
+    ProgramCache_t * programCache = createProgramCache(_directoryPath.fileSystemRepresentation);
+
+    if (!programCacheBinarySupported(programCache)) {
+        releaseProgramCache(programCache);
+        return;
+    }
+
+    glDeleteProgram(programCacheLoadProgram(programCache, VertexShaderSourceDefault, FragmentShaderSourceDefault));
+
+    // Error left by an unrelated call before the load
+    glBindTexture(GL_FRAMEBUFFER, 0);
+
+    GLuint program = programCacheLoadProgram(programCache, VertexShaderSourceDefault, FragmentShaderSourceDefault);
+    XCTAssertNotEqual(program, 0);
+    glDeleteProgram(program);
+
+    ProgramCacheStatistics_t statistics;
+    programCacheStatistics(programCache, &statistics);
+    XCTAssertEqual(statistics.hitCount, 1);
+    XCTAssertEqual(statistics.staleCount, 0);
+
+    releaseProgramCache(programCache);
+}
+
+- (void)testNoDirectoryCompilesFromSource {
+
+    ProgramCache_t * programCache = createProgramCache(NULL);
+    XCTAssertFalse(programCacheBinarySupported(programCache));
+
+    for (int i = 0; i < 2; ++i) {
+        GLuint program = programCacheLoadProgram(programCache, VertexShaderSourceDefault, FragmentShaderSourceDefault);
+        XCTAssertNotEqual(program, 0);
+        glDeleteProgram(program);
+    }
+
+    ProgramCacheStatistics_t statistics;
+    programCacheStatistics(programCache, &statistics);
+    XCTAssertEqual(statistics.hitCount, 0);
+    XCTAssertEqual(statistics.missCount, 2);
+    XCTAssertEqual(statistics.storeCount, 0);
+
+    releaseProgramCache(programCache);
+}
+
+@end
@@ -0,0 +1,234 @@
+//
+//  LAUCaptureVideoPreviewLayerQualityGovernorTests.m
+//  LAUCaptureVideoPreviewLayerUnitTests
+//
+//  Created by Luis Laugga on 10/17/16.
+//  Copyright © 2016 Luis Laugga. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "LAUCaptureVideoPreviewLayerQualityGovernor.h"
+
+// 3 levels, each one half the cost of the previous
+static const QualityGovernorLevel_t testLevels[] = {
+    { 4.0f, 2, 0, 1.0f },
+    { 8.0f, 2, 0, 0.5f },
+    { 8.0f, 1, 0, 0.25f },
+};
+
+static const QualityGovernorParameters_t testParameters = { 0.010, 10 };
+
+static unsigned int testPolicyLevelIndex;
+static unsigned int testPolicyResetCount;
+
+static unsigned int testPolicySelectLevel(void * context, const QualityGovernorWindow_t * window) {
+    *(QualityGovernorWindow_t *)context = *window;
+    return testPolicyLevelIndex;
+}
+
+static void testPolicyReset(void * context) {
+    testPolicyResetCount++;
+}
+
+@interface LAUCaptureVideoPreviewLayerQualityGovernorTests : XCTestCase
+{
+    QualityGovernor_t * governor;
+}
+@end
+
+@implementation LAUCaptureVideoPreviewLayerQualityGovernorTests
+
+- (void)setUp {
+    [super setUp];
+    governor = createQualityGovernor(testLevels, 3, &testParameters);
+}
+
+- (void)tearDown {
+    releaseQualityGovernor(governor);
+    [super tearDown];
+}
+
+// Adds a window of frames with the same time, returns YES if the level changed
+- (BOOL)addWindowWithFrameTime:(double)frameTime {
+    BOOL levelChanged = NO;
+    for (unsigned int i = 0; i < testParameters.windowFrameCount; ++i) {
+        levelChanged = qualityGovernorAddFrameTime(governor, frameTime) || levelChanged;
+    }
+    return levelChanged;
+}
+
+- (void)testDefaults {
+    releaseQualityGovernor(governor);
+    governor = createQualityGovernor(NULL, 0, NULL);
+
+    XCTAssertEqual(qualityGovernorLevelCount(governor), kQualityGovernorDefaultLevelCount);
+    XCTAssertEqual(qualityGovernorLevelIndex(governor), 0u);
+    XCTAssertEqualWithAccuracy(qualityGovernorFrameBudget(governor), kQualityGovernorDefaultParameters.frameBudget, 1e-9);
+
+    // Level 0 is the default filter parameters of the layer, each level is cheaper than the previous one
+    XCTAssertEqual(qualityGovernorLevel(governor, 0)->downsamplingFactor, 4.0f);
+    XCTAssertEqual(qualityGovernorLevel(governor, 0)->multiplePassCount, 2u);
+    for (unsigned int l = 1; l < kQualityGovernorDefaultLevelCount; ++l) {
+        XCTAssertLessThan(qualityGovernorLevel(governor, l)->cost, qualityGovernorLevel(governor, l - 1)->cost);
+    }
+    XCTAssertTrue(qualityGovernorLevel(governor, kQualityGovernorDefaultLevelCount) == NULL);
+}
+
+- (void)testUnderBudgetKeepsLevel {
+    for (int w = 0; w < 20; ++w) {
+        XCTAssertFalse([self addWindowWithFrameTime:0.008]);
+    }
+
+    QualityGovernorCounters_t counters;
+    qualityGovernorCounters(governor, &counters);
+    XCTAssertEqual(qualityGovernorLevelIndex(governor), 0u);
+    XCTAssertEqual(counters.windowCount, 20ul);
+    XCTAssertEqual(counters.frameCount, 200ul);
+}
+
+- (void)testOverBudgetLowersToPredictedLevel {
+    // 15ms at level 0, level 1 is predicted at 7.5ms (under 0.85 * 10ms)
+    XCTAssertTrue([self addWindowWithFrameTime:0.015]);
+    XCTAssertEqual(qualityGovernorLevelIndex(governor), 1u);
+
+    qualityGovernorReset(governor);
+
+    // 30ms at level 0, level 1 is predicted at 15ms and level 2 at 7.5ms
+    XCTAssertTrue([self addWindowWithFrameTime:0.030]);
+    XCTAssertEqual(qualityGovernorLevelIndex(governor), 2u);
+
+    // Still over budget at the cheapest level
+    XCTAssertFalse([self addWindowWithFrameTime:0.020]);
+    XCTAssertEqual(qualityGovernorLevelIndex(governor), 2u);
+}
+
+- (void)testWindowIsNotDecidedBeforeItsLastFrame {
+    for (unsigned int i = 0; i + 1 < testParameters.windowFrameCount; ++i) {
+        XCTAssertFalse(qualityGovernorAddFrameTime(governor, 0.1));
+    }
+    XCTAssertTrue(qualityGovernorAddFrameTime(governor, 0.1));
+}
+
+- (void)testSpikesUnderP90AreIgnored {
+    // 1 slow frame out of 10
+    for (unsigned int i = 0; i < testParameters.windowFrameCount; ++i) {
+        XCTAssertFalse(qualityGovernorAddFrameTime(governor, i == 0 ? 0.050 : 0.008));
+    }
+    XCTAssertEqual(qualityGovernorLevelIndex(governor), 0u);
+}
+
+- (void)testRaiseNeedsConsecutiveWindows {
+    [self addWindowWithFrameTime:0.015];
+    XCTAssertEqual(qualityGovernorLevelIndex(governor), 1u);
+
+    // 4ms at level 1, level 0 predicted at 8ms: raised after 4 windows
+    for (int w = 0; w < 3; ++w) {
+        XCTAssertFalse([self addWindowWithFrameTime:0.004]);
+    }
+
+    // A window where level 0 isn't predicted to fit restarts the count
+    XCTAssertFalse([self addWindowWithFrameTime:0.0045]);
+    for (int w = 0; w < 3; ++w) {
+        XCTAssertFalse([self addWindowWithFrameTime:0.004]);
+    }
+    XCTAssertTrue([self addWindowWithFrameTime:0.004]);
+    XCTAssertEqual(qualityGovernorLevelIndex(governor), 0u);
+
+    QualityGovernorCounters_t counters;
+    qualityGovernorCounters(governor, &counters);
+    XCTAssertEqual(counters.lowerCount, 1ul);
+    XCTAssertEqual(counters.raiseCount, 1ul);
+}
+
+- (void)testFailedRaiseBacksOff {
+    [self addWindowWithFrameTime:0.015];
+    XCTAssertEqual(qualityGovernorLevelIndex(governor), 1u);
+
+    // Level 0 is predicted to fit but it doesn't (the costs are wrong)
+    unsigned int raiseWindowCount = 4;
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        for (unsigned int w = 0; w + 1 < raiseWindowCount; ++w) {
+            XCTAssertFalse([self addWindowWithFrameTime:0.004], @"Attempt %d, window %u", attempt, w);
+        }
+        XCTAssertTrue([self addWindowWithFrameTime:0.004], @"Attempt %d", attempt);
+        XCTAssertEqual(qualityGovernorLevelIndex(governor), 0u);
+
+        // Back to level 1 (not lower)
+        XCTAssertTrue([self addWindowWithFrameTime:0.015]);
+        XCTAssertEqual(qualityGovernorLevelIndex(governor), 1u);
+
+        raiseWindowCount *= 2;
+    }
+}
+
+- (void)testEffectiveSigmaIsKept {
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+
+    // Twice the downsampling factor, half the kernel sigma
+    XCTAssertEqualWithAccuracy(qualityGovernorKernelSigma(&testLevels[1], &testLevels[0], 4.0f, parameters), 2.0f, 1e-5);
+
+    // One pass instead of two, sqrt(2) times the kernel sigma
+    XCTAssertEqualWithAccuracy(qualityGovernorKernelSigma(&testLevels[2], &testLevels[1], 4.0f, parameters), 4.0f * sqrtf(2.0f), 1e-5);
+
+    for (float sigma = 1.0f; sigma < 4.0f; sigma += 0.25f) {
+        float kernelSigma = qualityGovernorKernelSigma(&testLevels[2], &testLevels[0], sigma, parameters);
+        XCTAssertEqualWithAccuracy(qualityGovernorEffectiveSigma(&testLevels[2], kernelSigma), qualityGovernorEffectiveSigma(&testLevels[0], sigma), 1e-4);
+    }
+
+    // Clamped to the sigma range of the parameters
+    XCTAssertEqual(qualityGovernorKernelSigma(&testLevels[0], &testLevels[2], parameters->maxSigma, parameters), parameters->maxSigma);
+    XCTAssertEqual(qualityGovernorKernelSigma(&testLevels[2], &testLevels[0], parameters->minSigma, parameters), parameters->minSigma);
+}
+
+- (void)testKernelSigmaIsLimitedToMaxSamples {
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+    QualityGovernorLevel_t level = testLevels[0];
+
+    for (unsigned int maxSamples = 2; maxSamples <= btsGaussianFilterMaxSamples(parameters); ++maxSamples) {
+        level.maxSamples = maxSamples;
+        float kernelSigma = qualityGovernorKernelSigma(&level, &testLevels[0], parameters->maxSigma, parameters);
+        XCTAssertLessThanOrEqual(btsGaussianFilterSamplesForSize(gaussianFilterSizeForSigma(kernelSigma, parameters->truncation)), maxSamples);
+    }
+}
+
+- (void)testCustomPolicy {
+    QualityGovernorWindow_t window;
+    QualityGovernorPolicy_t policy = { testPolicySelectLevel, testPolicyReset, &window };
+
+    testPolicyResetCount = 0;
+    testPolicyLevelIndex = 2;
+    qualityGovernorSetPolicy(governor, &policy);
+    XCTAssertEqual(testPolicyResetCount, 1u);
+
+    for (unsigned int i = 0; i < testParameters.windowFrameCount; ++i) {
+        qualityGovernorAddFrameTime(governor, 0.001 * (i + 1));
+    }
+
+    // Window statistics (nearest rank percentiles)
+    XCTAssertEqual(window.frameCount, testParameters.windowFrameCount);
+    XCTAssertEqualWithAccuracy(window.mean, 0.0055, 1e-9);
+    XCTAssertEqualWithAccuracy(window.p50, 0.005, 1e-9);
+    XCTAssertEqualWithAccuracy(window.p90, 0.009, 1e-9);
+    XCTAssertEqualWithAccuracy(window.max, 0.010, 1e-9);
+    XCTAssertEqualWithAccuracy(window.frameBudget, testParameters.frameBudget, 1e-9);
+    XCTAssertEqual(window.levelIndex, 0u);
+    XCTAssertEqual(window.levelCount, 3u);
+    XCTAssertEqual(qualityGovernorLevelIndex(governor), 2u);
+
+    // Out of range levels are clamped
+    testPolicyLevelIndex = 7;
+    [self addWindowWithFrameTime:0.001];
+    XCTAssertEqual(qualityGovernorLevelIndex(governor), 2u);
+
+    qualityGovernorReset(governor);
+    XCTAssertEqual(testPolicyResetCount, 2u);
+    XCTAssertEqual(qualityGovernorLevelIndex(governor), 0u);
+
+    // Back to the hysteresis policy
+    qualityGovernorSetPolicy(governor, NULL);
+    XCTAssertTrue([self addWindowWithFrameTime:0.015]);
+    XCTAssertEqual(qualityGovernorLevelIndex(governor), 1u);
+}
+
+@end
@@ -0,0 +1,128 @@
+//
+//  LAUCaptureVideoPreviewLayerRenderTargetPoolTests.m
+//  LAUCaptureVideoPreviewLayerUnitTests
+//
+//  Created by Luis Laugga on 10/17/16.
+//  Copyright © 2016 Luis Laugga. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <OpenGLES/EAGL.h>
+
+#import "LAUCaptureVideoPreviewLayerRenderTargetPool.h"
+
+@interface LAUCaptureVideoPreviewLayerRenderTargetPoolTests : XCTestCase
+{
+    EAGLContext * _context;
+}
+
+@end
+
+@implementation LAUCaptureVideoPreviewLayerRenderTargetPoolTests
+
+- (void)setUp {
+    [super setUp];
+
+    _context = [[EAGLContext alloc] initWithAPI:kEAGLRenderingAPIOpenGLES2];
+    [EAGLContext setCurrentContext:_context];
+}
+
+- (void)tearDown {
+    [EAGLContext setCurrentContext:nil];
+    _context = nil;
+
+    [super tearDown];
+}
+
+- (void)testRotationReusesRenderTargets {
+
+    RenderTargetPool_t * pool = createRenderTargetPool(16 * 1024 * 1024);
+    RenderTargetPoolStatistics_t statistics;
+    TextureInstance_t textureInstance = {0};
+
+    // Portrait, landscape and back to portrait
+    XCTAssertTrue(renderTargetPoolAcquireTextureInstance(pool, &textureInstance, 310.5f, 552.0f, GL_RGBA));
+    GLuint portraitTextureName = textureInstance.textureName;
+    XCTAssertTrue(renderTargetPoolAcquireTextureInstance(pool, &textureInstance, 552.0f, 310.5f, GL_RGBA));
+    XCTAssertNotEqual(textureInstance.textureName, portraitTextureName);
+    XCTAssertTrue(renderTargetPoolAcquireTextureInstance(pool, &textureInstance, 310.5f, 552.0f, GL_RGBA));
+    XCTAssertEqual(textureInstance.textureName, portraitTextureName);
+    XCTAssertTrue(glIsFramebuffer(textureInstance.framebuffer));
+
+    // Same key keeps the target
+    XCTAssertTrue(renderTargetPoolAcquireTextureInstance(pool, &textureInstance, 310.75f, 552.0f, GL_RGBA));
+    XCTAssertEqual(textureInstance.textureName, portraitTextureName);
+    XCTAssertEqual(textureInstance.textureWidth, 310.75f);
+
+    renderTargetPoolStatistics(pool, &statistics);
+    XCTAssertEqual(statistics.allocationCount, 2);
+    XCTAssertEqual(statistics.reuseCount, 1);
+    XCTAssertEqual(statistics.liveTargetCount, 2);
+    XCTAssertEqual(statistics.inUseTargetCount, 1);
+    XCTAssertEqual(statistics.liveByteCount, 2 * 310 * 552 * 4);
+    XCTAssertEqual(statistics.inUseByteCount, 310 * 552 * 4);
+    XCTAssertEqual(glGetError(), GL_NO_ERROR);
+
+    renderTargetPoolRelinquishTextureInstance(pool, &textureInstance);
+    XCTAssertEqual(textureInstance.textureName, 0);
+    XCTAssertEqual(textureInstance.framebuffer, 0);
+
+    releaseRenderTargetPool(pool);
+}
+
+- (void)testMemoryBudgetEvictsLeastRecentlyUsedFreeTargets {
+
+    // Room for two 64x64 RGBA targets
+    RenderTargetPool_t * pool = createRenderTargetPool(2 * 64 * 64 * 4);
+    RenderTargetPoolStatistics_t statistics;
+    TextureInstance_t textureInstances[2] = {{0}};
+
+    renderTargetPoolAcquireTextureInstance(pool, &textureInstances[0], 64, 64, GL_RGBA);
+    renderTargetPoolAcquireTextureInstance(pool, &textureInstances[1], 64, 64, GL_RGBA);
+    XCTAssertNotEqual(textureInstances[0].textureName, textureInstances[1].textureName);
+
+    // Both in use, the third one is allocated over budget
+    TextureInstance_t textureInstance = {0};
+    renderTargetPoolAcquireTextureInstance(pool, &textureInstance, 32, 64, GL_RGBA);
+    renderTargetPoolStatistics(pool, &statistics);
+    XCTAssertEqual(statistics.overBudgetCount, 1);
+    XCTAssertEqual(statistics.evictionCount, 0);
+    XCTAssertGreaterThan(statistics.liveByteCount, statistics.memoryBudget);
+
+    // Giving it back deletes it (least recently used free target) to get within budget
+    renderTargetPoolRelinquishTextureInstance(pool, &textureInstance);
+    renderTargetPoolStatistics(pool, &statistics);
+    XCTAssertEqual(statistics.evictionCount, 1);
+    XCTAssertEqual(statistics.liveTargetCount, 2);
+    XCTAssertEqual(statistics.liveByteCount, statistics.memoryBudget);
+    XCTAssertEqual(statistics.peakByteCount, 2 * 64 * 64 * 4 + 32 * 64 * 4);
+
+    // Smaller budget deletes free targets only
+    renderTargetPoolRelinquishTextureInstance(pool, &textureInstances[0]);
+    renderTargetPoolSetMemoryBudget(pool, 0);
+    renderTargetPoolStatistics(pool, &statistics);
+    XCTAssertEqual(statistics.liveTargetCount, 1);
+    XCTAssertEqual(statistics.inUseTargetCount, 1);
+    XCTAssertTrue(glIsTexture(textureInstances[1].textureName));
+
+    releaseRenderTargetPool(pool);
+    XCTAssertEqual(glGetError(), GL_NO_ERROR);
+}
+
+- (void)testQuadVertexBufferIsShared {
+
+    RenderTargetPool_t * pool = createRenderTargetPool(0);
+
+    GLuint vertexBuffer = renderTargetPoolQuadVertexBuffer(pool);
+    XCTAssertTrue(glIsBuffer(vertexBuffer));
+    XCTAssertEqual(renderTargetPoolQuadVertexBuffer(pool), vertexBuffer);
+
+    GLint size = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+    XCTAssertEqual(size, 4 * sizeof(VertexData_t));
+
+    releaseRenderTargetPool(pool);
+}
+
+@end
@@ -0,0 +1,181 @@
+//
+//  LAUCaptureVideoPreviewLayerShaderGeneratorTests.m
+//  LAUCaptureVideoPreviewLayerUnitTests
+//
+//  Created by Luis Laugga on 10/17/16.
+//  Copyright © 2016 Luis Laugga. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <OpenGLES/EAGL.h>
+
+#import "LAUCaptureVideoPreviewLayerShaderGenerator.h"
+#import "LAUCaptureVideoPreviewLayerGaussianFilterKernel.h"
+#import "LAUCaptureVideoPreviewLayerUtilities.h"
+
+@interface LAUCaptureVideoPreviewLayerShaderGeneratorTests : XCTestCase
+
+@end
+
+@implementation LAUCaptureVideoPreviewLayerShaderGeneratorTests
+
+- (void)testLayoutFitsVaryingBudget {
+
+    const unsigned int maxVaryingVectors = kBtsBlurFilterShaderMinVaryingVectors;
+    unsigned int maxSamples = btsBlurFilterShaderMaxSamples(maxVaryingVectors);
+
+    // The default kernels must fit the minimum budget of OpenGL ES 2.0
+    XCTAssertGreaterThanOrEqual(maxSamples, btsGaussianFilterMaxSamples(&kBtsGaussianFilterKernelDefaultParameters));
+
+    for (unsigned int samples = 1; samples <= maxSamples; ++samples) {
+
+        BtsBlurFilterShaderLayout_t layout;
+        XCTAssertTrue(btsBlurFilterShaderLayout(samples, maxVaryingVectors, &layout));
+        XCTAssertEqual(layout.textureCoordinateSamples + layout.offsetSamples, samples);
+        XCTAssertLessThanOrEqual(layout.varyingCount, 2 * maxVaryingVectors);
+
+        // Texture coordinates are only given up when they don't fit
+        if (2 * samples <= 2 * maxVaryingVectors) {
+            XCTAssertEqual(layout.offsetSamples, 0);
+        } else {
+            XCTAssertEqual(layout.varyingCount, 2 * maxVaryingVectors);
+        }
+    }
+
+    BtsBlurFilterShaderLayout_t layout;
+    XCTAssertFalse(btsBlurFilterShaderLayout(0, maxVaryingVectors, &layout));
+    XCTAssertFalse(btsBlurFilterShaderLayout(maxSamples + 1, maxVaryingVectors, &layout));
+    XCTAssertTrue(createBtsBlurFilterVertexShaderSource(maxSamples + 1, maxVaryingVectors) == NULL);
+}
+
+- (void)testSourcesReadTwoTexelsPerSample {
+
+    for (unsigned int samples = 1; samples <= 10; ++samples) {
+
+        char * fragmentShaderSource = createBtsBlurFilterFragmentShaderSource(samples, kBtsBlurFilterShaderMinVaryingVectors);
+        NSString * source = [NSString stringWithUTF8String:fragmentShaderSource];
+        free(fragmentShaderSource);
+
+        NSUInteger textureReadCount = [source componentsSeparatedByString:@"texture2D("].count - 1;
+        XCTAssertEqual(textureReadCount, 2 * samples);
+    }
+}
+
+- (void)testPrefilterSourcesReadFourTexelsPerTap {
+
+    for (unsigned int samples = 1; samples <= 10; ++samples) {
+
+        char * fragmentShaderSource = createBtsPrefilterBlurFilterFragmentShaderSource(samples, kBtsBlurFilterShaderMinVaryingVectors);
+        NSString * source = [NSString stringWithUTF8String:fragmentShaderSource];
+        free(fragmentShaderSource);
+
+        // The 4 reads are in prefilteredTexture2D, called for every tap (and declared once)
+        XCTAssertEqual([source componentsSeparatedByString:@"texture2D("].count - 1, 4);
+        XCTAssertEqual([source componentsSeparatedByString:@"prefilteredTexture2D("].count - 1, 2 * samples + 1);
+        XCTAssertTrue([source containsString:@"uniform highp vec2 FilterPrefilterOffset;"]);
+    }
+}
+
+- (void)testKernelBankSourcesReadTwoTexelsPerSample {
+
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+    unsigned int bankSamples = btsGaussianFilterMaxSamples(parameters);
+
+    for (unsigned int samples = 1; samples <= bankSamples; ++samples) {
+
+        char * vertexShaderSource = createBtsKernelBankBlurFilterVertexShaderSource(samples, kBtsBlurFilterShaderMinVaryingVectors, parameters->kernelCount, bankSamples);
+        char * fragmentShaderSource = createBtsKernelBankBlurFilterFragmentShaderSource(samples, kBtsBlurFilterShaderMinVaryingVectors, parameters->kernelCount, bankSamples, false);
+        NSString * vertexSource = [NSString stringWithUTF8String:vertexShaderSource];
+        NSString * fragmentSource = [NSString stringWithUTF8String:fragmentShaderSource];
+        free(vertexShaderSource);
+        free(fragmentShaderSource);
+
+        // The kernel comes from the bank, selected by the position
+        XCTAssertEqual([fragmentSource componentsSeparatedByString:@"texture2D("].count - 1, 2 * samples);
+        XCTAssertFalse([vertexSource containsString:@"VertFilterKernelOffsets"]);
+        XCTAssertFalse([fragmentSource containsString:@"FragFilterKernelWeights"]);
+        XCTAssertTrue([vertexSource containsString:@"uniform highp float FilterKernelBankPosition;"]);
+        XCTAssertTrue([fragmentSource containsString:@"uniform highp float FilterKernelBankPosition;"]);
+    }
+
+    // A kernel can't have more samples than the bank
+    XCTAssertTrue(createBtsKernelBankBlurFilterVertexShaderSource(bankSamples + 1, kBtsBlurFilterShaderMinVaryingVectors, parameters->kernelCount, bankSamples) == NULL);
+    XCTAssertTrue(createBtsKernelBankBlurFilterFragmentShaderSource(1, kBtsBlurFilterShaderMinVaryingVectors, 0, bankSamples, false) == NULL);
+}
+
+- (void)testKernelBankFitsUniformBudget {
+
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+    unsigned int bankSamples = btsGaussianFilterMaxSamples(parameters);
+
+    // The default bank exceeds the minimum of 16 fragment uniform vectors of OpenGL ES 2.0 (128 vertex)
+    XCTAssertFalse(btsBlurFilterKernelBankFits(parameters->kernelCount, bankSamples, 128, 16));
+    XCTAssertTrue(btsBlurFilterKernelBankFits(parameters->kernelCount, bankSamples, 128, 64));
+    XCTAssertFalse(btsBlurFilterKernelBankFits(0, bankSamples, 128, 64));
+}
+
+- (void)testIntensityMapSourcesReadTheMapAndTwoTexelsPerSample {
+
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+    unsigned int bankSamples = btsGaussianFilterMaxSamples(parameters);
+
+    for (unsigned int samples = 1; samples <= bankSamples; ++samples) {
+
+        char * fragmentShaderSource = createBtsIntensityMapBlurFilterFragmentShaderSource(samples, parameters->kernelCount, bankSamples, false);
+        NSString * fragmentSource = [NSString stringWithUTF8String:fragmentShaderSource];
+        free(fragmentShaderSource);
+
+        // Both banks in the fragment shader, one map read then two texels per sample
+        XCTAssertEqual([fragmentSource componentsSeparatedByString:@"texture2D("].count - 1, 2 * samples + 1);
+        XCTAssertTrue([fragmentSource containsString:@"uniform sampler2D FragFilterIntensityMap;"]);
+        XCTAssertTrue([fragmentSource containsString:@"VertFilterKernelBankOffsets"]);
+        XCTAssertTrue([fragmentSource containsString:@"FragFilterKernelBankWeights"]);
+    }
+
+    XCTAssertTrue(createBtsIntensityMapBlurFilterFragmentShaderSource(bankSamples + 1, parameters->kernelCount, bankSamples, false) == NULL);
+    XCTAssertTrue(createBtsIntensityMapBlurFilterFragmentShaderSource(1, 0, bankSamples, false) == NULL);
+}
+
+- (void)testIntensityMapFitsUniformBudget {
+
+    const GaussianFilterKernelParameters_t * parameters = &kBtsGaussianFilterKernelDefaultParameters;
+    unsigned int bankSamples = btsGaussianFilterMaxSamples(parameters);
+
+    // Both banks are fragment uniforms (69 vectors for the default bank)
+    XCTAssertFalse(btsBlurFilterIntensityMapFits(parameters->kernelCount, bankSamples, 64));
+    XCTAssertTrue(btsBlurFilterIntensityMapFits(parameters->kernelCount, bankSamples, 224));
+    XCTAssertFalse(btsBlurFilterIntensityMapFits(0, bankSamples, 224));
+}
+
+- (void)testVariantsCompileAndLink {
+
+    EAGLContext * context = [[EAGLContext alloc] initWithAPI:kEAGLRenderingAPIOpenGLES2];
+    [EAGLContext setCurrentContext:context];
+
+    GLint maxVaryingVectors = 0;
+    glGetIntegerv(GL_MAX_VARYING_VECTORS, &maxVaryingVectors);
+
+    // Minimum budget and the budget of the device
+    const unsigned int varyingBudgets[] = { kBtsBlurFilterShaderMinVaryingVectors, (unsigned int)maxVaryingVectors };
+
+    for (int i = 0; i < 2; ++i) {
+        for (unsigned int samples = 1; samples <= btsGaussianFilterMaxSamples(&kBtsGaussianFilterKernelDefaultParameters); ++samples) {
+
+            char * vertexShaderSource = createBtsBlurFilterVertexShaderSource(samples, varyingBudgets[i]);
+            char * fragmentShaderSource = createBtsBlurFilterFragmentShaderSource(samples, varyingBudgets[i]);
+
+            GLuint program = buildProgram(vertexShaderSource, fragmentShaderSource);
+            XCTAssertNotEqual(program, 0, @"%u samples, %u varying vectors", samples, varyingBudgets[i]);
+            XCTAssertNotEqual(glGetUniformLocation(program, "VertFilterKernelOffsets"), -1);
+            XCTAssertNotEqual(glGetUniformLocation(program, "FragFilterKernelWeights"), -1);
+            glDeleteProgram(program);
+
+            free(vertexShaderSource);
+            free(fragmentShaderSource);
+        }
+    }
+
+    [EAGLContext setCurrentContext:nil];
+}
+
+@end
@@ -77,6 +77,21 @@
     XCTAssertTrue(similarity3 < 0.08f, @"For Radius = 48px the images must be the similar within 0.08 tolerance");
 }
 
+- (void)testRenderedImagePSNRAndSSIMWithTargetImage {
+    
+    UIImage * targetImage = [UIImage imageNamed:@"target-image-48px-radius.png" inBundle:[NSBundle bundleForClass:[self class]] compatibleWithTraitCollection:nil];
+    UIImage * renderedImage = [UIImage imageFromLayer:videoPreviewLayer];
+    
+    ImageCompareResult_t result;
+    XCTAssertTrue([renderedImage compareWithImage:targetImage result:&result]);
+    
+    NSLog(@"*** Rendered image and reference image 3: max difference %u, PSNR %.2f dB, SSIM %.4f ***", result.maxDifference, result.psnr, result.ssim);
+    
+    // Same tolerances as the golden-image tests (LAUCaptureVideoPreviewLayerGoldenImageTests), relaxed for the device GPUs
+    XCTAssertGreaterThan(result.psnr, 30.0, @"For Radius = 48px the PSNR must be above 30 dB");
+    XCTAssertGreaterThan(result.ssim, 0.95, @"For Radius = 48px the SSIM must be above 0.95");
+}
+
 - (void)testRenderedImageSimilarityWithAnotherRenderedImage {
     
     UIImage * renderedImage1 = [UIImage imageFromLayer:videoPreviewLayer];
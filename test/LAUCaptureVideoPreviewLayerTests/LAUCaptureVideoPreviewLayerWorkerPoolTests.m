@@ -0,0 +1,123 @@
+//
+//  LAUCaptureVideoPreviewLayerWorkerPoolTests.m
+//  LAUCaptureVideoPreviewLayerUnitTests
+//
+//  Created by Luis Laugga on 10/17/16.
+//  Copyright © 2016 Luis Laugga. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <stdatomic.h>
+#import <unistd.h>
+
+#import "LAUCaptureVideoPreviewLayerWorkerPool.h"
+
+#define kTestTaskCount 1000
+
+// Runs per task index, and the worker that ran it
+struct TestTasks {
+    atomic_int runCounts[kTestTaskCount];
+    unsigned int workerIndices[kTestTaskCount];
+    useconds_t slowTaskDuration; // Tasks of worker 0's initial range sleep, so the other workers steal them
+};
+
+static void runTestTask(void * context, size_t taskIndex, unsigned int workerIndex) {
+    struct TestTasks * tasks = context;
+    atomic_fetch_add(&tasks->runCounts[taskIndex], 1);
+    tasks->workerIndices[taskIndex] = workerIndex;
+
+    if (tasks->slowTaskDuration && taskIndex < kTestTaskCount / 4) {
+        usleep(tasks->slowTaskDuration);
+    }
+}
+
+@interface LAUCaptureVideoPreviewLayerWorkerPoolTests : XCTestCase
+{
+    struct TestTasks tasks;
+}
+@end
+
+@implementation LAUCaptureVideoPreviewLayerWorkerPoolTests
+
+- (void)setUp {
+    [super setUp];
+
+    memset(&tasks, 0, sizeof(tasks));
+}
+
+- (void)assertEveryTaskRanOnce:(size_t)taskCount {
+    for (size_t i = 0; i < kTestTaskCount; ++i) {
+        int expectedRunCount = i < taskCount ? 1 : 0;
+        if (atomic_load(&tasks.runCounts[i]) != expectedRunCount) {
+            XCTFail(@"Task %zu ran %d times, expected %d", i, atomic_load(&tasks.runCounts[i]), expectedRunCount);
+            break;
+        }
+    }
+}
+
+- (void)testEveryTaskRunsOnce {
+
+    unsigned int threadCounts[] = {1, 2, 3, 8};
+    for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); ++t) {
+
+        WorkerPool_t * workerPool = createWorkerPool(threadCounts[t]);
+        XCTAssertEqual(workerPoolThreadCount(workerPool), threadCounts[t]);
+
+        // Fewer tasks than workers, then many runs in a row
+        size_t taskCounts[] = {0, 1, 5, kTestTaskCount};
+        for (size_t c = 0; c < sizeof(taskCounts) / sizeof(taskCounts[0]); ++c) {
+            for (int run = 0; run < 10; ++run) {
+                memset(&tasks, 0, sizeof(tasks));
+                workerPoolRun(workerPool, taskCounts[c], runTestTask, &tasks);
+                [self assertEveryTaskRanOnce:taskCounts[c]];
+            }
+        }
+
+        releaseWorkerPool(workerPool);
+    }
+}
+
+- (void)testSingleThreadRunsTasksInOrderOnCallingThread {
+
+    WorkerPool_t * workerPool = createWorkerPool(1);
+
+    workerPoolRun(workerPool, kTestTaskCount, runTestTask, &tasks);
+
+    [self assertEveryTaskRanOnce:kTestTaskCount];
+    for (size_t i = 0; i < kTestTaskCount; ++i) {
+        XCTAssertEqual(tasks.workerIndices[i], 0);
+    }
+    XCTAssertEqual(workerPoolStolenTaskCount(workerPool), 0);
+
+    releaseWorkerPool(workerPool);
+}
+
+- (void)testIdleWorkersStealTasks {
+
+    WorkerPool_t * workerPool = createWorkerPool(4);
+
+    // Worker 0 starts with the slow quarter, the others finish their ranges and steal from it
+    tasks.slowTaskDuration = 1000;
+    workerPoolRun(workerPool, kTestTaskCount, runTestTask, &tasks);
+
+    [self assertEveryTaskRanOnce:kTestTaskCount];
+    XCTAssertGreaterThan(workerPoolStolenTaskCount(workerPool), 0);
+
+    size_t stolenSlowTaskCount = 0;
+    for (size_t i = 0; i < kTestTaskCount / 4; ++i) {
+        stolenSlowTaskCount += tasks.workerIndices[i] != 0;
+    }
+    XCTAssertGreaterThan(stolenSlowTaskCount, 0, @"The slow tasks of worker 0 must be shared");
+
+    releaseWorkerPool(workerPool);
+}
+
+- (void)testDefaultThreadCountIsOnlineProcessorCount {
+
+    WorkerPool_t * workerPool = createWorkerPool(0);
+    XCTAssertEqual(workerPoolThreadCount(workerPool), (unsigned int)sysconf(_SC_NPROCESSORS_ONLN));
+    releaseWorkerPool(workerPool);
+}
+
+@end
@@ -27,9 +27,14 @@
 
 #import <UIKit/UIKit.h>
 
+#import "LAUCaptureVideoPreviewLayerImageCompare.h"
+
 @interface UIImage (Compare)
 
 + (UIImage *)imageFromLayer:(CALayer *)layer;
 - (CGFloat)similarityWithImage:(UIImage *)image;
 
+// Max difference, PSNR and SSIM (LAUCaptureVideoPreviewLayerImageCompare), the image is drawn with the pixel dimensions of the receiver
+- (BOOL)compareWithImage:(UIImage *)image result:(ImageCompareResult_t *)result;
+
 @end
@@ -127,6 +127,42 @@
     return comparedPixelSum/comparedPixelCount;
 }
 
+- (BOOL)compareWithImage:(UIImage *)image result:(ImageCompareResult_t *)result
+{
+    NSAssert(image, @"image is nil");
+    
+    size_t width = CGImageGetWidth(self.CGImage);
+    size_t height = CGImageGetHeight(self.CGImage);
+    
+    BlurEngineImage_t self_image = {calloc(width * height, 4), width, height, width * 4};
+    BlurEngineImage_t otherImage = {calloc(width * height, 4), width, height, width * 4};
+    
+    NSAssert(self_image.data, @"self_image data is NULL");
+    NSAssert(otherImage.data, @"otherImage data is NULL");
+    
+    // Both images are drawn in RGBA8 bitmaps of the same size
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef self_imageContext = CGBitmapContextCreate(self_image.data, width, height, 8, self_image.bytesPerRow, colorSpace, (CGBitmapInfo)kCGImageAlphaPremultipliedLast);
+    CGContextRef imageContext = CGBitmapContextCreate(otherImage.data, width, height, 8, otherImage.bytesPerRow, colorSpace, (CGBitmapInfo)kCGImageAlphaPremultipliedLast);
+    CGColorSpaceRelease(colorSpace);
+    
+    NSAssert(self_imageContext, @"self_imageContext is NULL");
+    NSAssert(imageContext, @"imageContext is NULL");
+    
+    CGContextDrawImage(self_imageContext, CGRectMake(0, 0, width, height), self.CGImage);
+    CGContextDrawImage(imageContext, CGRectMake(0, 0, width, height), image.CGImage);
+    
+    CGContextRelease(self_imageContext);
+    CGContextRelease(imageContext);
+    
+    BOOL compared = imageCompare(&self_image, &otherImage, result);
+    
+    free(self_image.data);
+    free(otherImage.data);
+    
+    return compared;
+}
+
 typedef union {
     uint32_t raw;
     unsigned char bytes[4];
@@ -0,0 +1,526 @@
+/*
+
+ main.c
+ LAUCaptureVideoPreviewLayer YUV Tests
+
+ Copyright (c) 2016 Luis Laugga.
+ Some rights reserved, all wrongs deserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+/*
+ 420 bi-planar (NV12) input tests on Linux, the headless GL pipeline fed with raw NV12 frames
+
+ 1. The conversion pass of the filtered planes (offscreen output) matches the CPU reference (blurEngineFilterYUVImage)
+ 2. A gray frame (Cb = Cr = 128) renders like the same BGRA frame, the luma plane goes through the same passes
+ 3. The onscreen render is close to the render of the BGRA frame, the chroma plane has the same blur radius (in view
+    pixels) and is only subsampled
+
+ Each input frame is tested with a few kernel indices. Without --input, the source image of test/Samples.xcassets
+ (converted to NV12) and a test pattern with odd dimensions are used.
+
+ Build (from the repository root):
+
+ make build/YUVTests && build/YUVTests (or make check for all the tests)
+
+ Usage:
+
+ YUVTests [--input <file.nv12> --size <width>x<height>]... [--samples <Samples.xcassets directory>] [--verbose]
+
+ Raw NV12 files are the luma plane (width x height) followed by the interleaved CbCr plane ((width+1)/2 x (height+1)/2 pairs),
+ full range, ie. ffmpeg -i image.png -pix_fmt nv12 -color_range pc -f rawvideo image.nv12
+
+ Prints PASS and exits with 0 on success, each failure is printed to stderr.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "LAUCaptureVideoPreviewLayerHeadlessRenderer.h"
+#include "LAUCaptureVideoPreviewLayerBlurEngine.h"
+#include "LAUCaptureVideoPreviewLayerGaussianFilterKernel.h"
+#include "LAUCaptureVideoPreviewLayerImageCompare.h"
+#include "LAUCaptureVideoPreviewLayerPNGImage.h"
+
+// Same view as the golden-image tests (LAUCaptureVideoPreviewLayerTests layer bounds at 2x)
+#define kYUVViewWidth 750
+#define kYUVViewHeight 1334
+
+// Maximum number of --input files
+#define kYUVMaxInputCount 16
+
+// The GL pipeline and the CPU reference round each pass (and the chroma sampling) differently
+#define kYUVEngineMaxDifference 5
+#define kYUVEngineMinPSNR 45.0
+
+// Gray frames only differ by the rounding of the conversion
+#define kYUVGrayMaxDifference 1
+
+// The chroma plane is filtered with the radius (in view pixels) of the BGRA render, twice the radius is below 45 dB
+#define kYUVBGRAMinPSNR 45.0
+#define kYUVBGRAMinSSIM 0.99
+
+static const unsigned int kYUVKernelIndexes[] = {0, 5, 10};
+
+#define kYUVKernelIndexCount (sizeof(kYUVKernelIndexes) / sizeof(kYUVKernelIndexes[0]))
+
+// Without a visible blur, the 420 subsampling of sharp chroma edges dominates the difference with the BGRA render
+static const unsigned int kYUVBGRAKernelIndexes[] = {5, 10};
+
+#define kYUVBGRAKernelIndexCount (sizeof(kYUVBGRAKernelIndexes) / sizeof(kYUVBGRAKernelIndexes[0]))
+
+struct YUVInput {
+    const char * name;
+    BlurEngineYUVImage_t image;
+    BlurEngineImage_t bgraImage; // Same frame as BGRA (NULL data for the --input files)
+};
+
+typedef struct YUVInput YUVInput_t;
+
+static bool verbose;
+
+#pragma mark -
+#pragma mark Images
+
+static bool createImage(size_t width, size_t height, BlurEngineImage_t * image)
+{
+    image->width = width;
+    image->height = height;
+    image->bytesPerRow = width * 4;
+    image->data = (uint8_t *)malloc(image->bytesPerRow * height);
+
+    return image->data != NULL;
+}
+
+static bool createYUVImage(size_t width, size_t height, BlurEngineYUVImage_t * image)
+{
+    image->width = width;
+    image->height = height;
+    image->lumaBytesPerRow = width;
+    image->chromaBytesPerRow = ((width + 1) / 2) * 2;
+    image->luma = (uint8_t *)malloc(image->lumaBytesPerRow * height + image->chromaBytesPerRow * ((height + 1) / 2));
+    image->chroma = image->luma ? image->luma + image->lumaBytesPerRow * height : NULL;
+
+    return image->luma != NULL;
+}
+
+static uint8_t clampComponent(float value)
+{
+    return (uint8_t)(value < 0.0f ? 0 : (value > 255.0f ? 255 : (int)(value + 0.5f)));
+}
+
+// Full range BT.601 (the inverse of FragmentShaderSourceDefaultYUV), chroma is the mean of each 2x2 block
+static void convertBGRAToYUVImage(const BlurEngineImage_t * bgraImage, BlurEngineYUVImage_t * image)
+{
+    for (size_t y = 0; y < image->height; ++y)
+    {
+        const uint8_t * pixel = bgraImage->data + y * bgraImage->bytesPerRow;
+
+        for (size_t x = 0; x < image->width; ++x, pixel += 4)
+        {
+            image->luma[y * image->lumaBytesPerRow + x] = clampComponent(0.114f * pixel[0] + 0.587f * pixel[1] + 0.299f * pixel[2]);
+        }
+    }
+
+    for (size_t cy = 0; cy < (image->height + 1) / 2; ++cy)
+    {
+        for (size_t cx = 0; cx < (image->width + 1) / 2; ++cx)
+        {
+            float b = 0.0f, g = 0.0f, r = 0.0f;
+            unsigned int count = 0;
+
+            for (size_t y = 2 * cy; y < 2 * cy + 2 && y < image->height; ++y)
+            {
+                for (size_t x = 2 * cx; x < 2 * cx + 2 && x < image->width; ++x, ++count)
+                {
+                    const uint8_t * pixel = bgraImage->data + y * bgraImage->bytesPerRow + x * 4;
+                    b += pixel[0];
+                    g += pixel[1];
+                    r += pixel[2];
+                }
+            }
+
+            b /= count;
+            g /= count;
+            r /= count;
+
+            uint8_t * chroma = image->chroma + cy * image->chromaBytesPerRow + cx * 2;
+            chroma[0] = clampComponent(128.0f - 0.168736f * r - 0.331264f * g + 0.5f * b);
+            chroma[1] = clampComponent(128.0f + 0.5f * r - 0.418688f * g - 0.081312f * b);
+        }
+    }
+}
+
+static bool loadYUVInput(const char * path, size_t width, size_t height, YUVInput_t * input)
+{
+    memset(input, 0, sizeof(YUVInput_t));
+    input->name = path;
+
+    FILE * file = fopen(path, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "FAIL: can't open %s\n", path);
+        return false;
+    }
+
+    bool loaded = createYUVImage(width, height, &input->image);
+    size_t size = input->image.lumaBytesPerRow * height + input->image.chromaBytesPerRow * ((height + 1) / 2);
+
+    if (!loaded || fread(input->image.luma, 1, size, file) != size)
+    {
+        fprintf(stderr, "FAIL: %s is smaller than %zux%zu NV12\n", path, width, height);
+        loaded = false;
+    }
+
+    fclose(file);
+    return loaded;
+}
+
+static bool loadSourceImageInput(const char * samplesPath, YUVInput_t * input)
+{
+    memset(input, 0, sizeof(YUVInput_t));
+    input->name = "source-image";
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/source-image.imageset/source-image.png", samplesPath);
+
+    if (!loadPNGImage(path, &input->bgraImage))
+    {
+        fprintf(stderr, "FAIL: can't load %s\n", path);
+        return false;
+    }
+
+    // The decoded PNG is RGBA
+    for (size_t i = 0; i < input->bgraImage.width * input->bgraImage.height; ++i)
+    {
+        uint8_t * pixel = input->bgraImage.data + i * 4;
+        uint8_t r = pixel[0];
+        pixel[0] = pixel[2];
+        pixel[2] = r;
+    }
+
+    if (!createYUVImage(input->bgraImage.width, input->bgraImage.height, &input->image))
+    {
+        return false;
+    }
+
+    convertBGRAToYUVImage(&input->bgraImage, &input->image);
+    return true;
+}
+
+static bool createPatternInput(size_t width, size_t height, YUVInput_t * input)
+{
+    memset(input, 0, sizeof(YUVInput_t));
+    input->name = "pattern";
+
+    if (!createImage(width, height, &input->bgraImage) || !createYUVImage(width, height, &input->image))
+    {
+        return false;
+    }
+
+    // Colored checkerboard with gradients (sharp chroma edges show the chroma blur)
+    for (size_t y = 0; y < height; ++y)
+    {
+        uint8_t * row = input->bgraImage.data + y * input->bgraImage.bytesPerRow;
+        for (size_t x = 0; x < width; ++x)
+        {
+            bool checker = ((x / 48) + (y / 48)) % 2;
+            row[4 * x + 0] = checker ? 230 : (uint8_t)(255 * y / height);
+            row[4 * x + 1] = (uint8_t)(255 * x / width);
+            row[4 * x + 2] = checker ? 20 : 200;
+            row[4 * x + 3] = 255;
+        }
+    }
+
+    convertBGRAToYUVImage(&input->bgraImage, &input->image);
+    return true;
+}
+
+static void releaseYUVInput(YUVInput_t * input)
+{
+    free(input->image.luma);
+    free(input->bgraImage.data);
+}
+
+static void printCompareResult(const char * description, const ImageCompareResult_t * result)
+{
+    if (verbose)
+    {
+        printf("%s: max difference %u, PSNR %.2f dB, SSIM %.4f\n", description, result->maxDifference, result->psnr, result->ssim);
+    }
+}
+
+static void setKernelIndex(HeadlessRenderer_t * renderer, BlurEngine_t * blurEngine, GaussianFilterKernelCache_t * cache, unsigned int kernelIndex)
+{
+    float step = gaussianFilterStepForKernelIndex(&kBtsGaussianFilterKernelDefaultParameters, kernelIndex);
+    headlessRendererSetFilterIntensity(renderer, step);
+
+    if (blurEngine)
+    {
+        const GaussianFilterKernel_t * filterKernel = gaussianFilterKernelCacheKernelForStep(cache, step);
+        blurEngineSetFilterKernel(blurEngine, filterKernel->samples, filterKernel->offsets, filterKernel->weights);
+    }
+}
+
+#pragma mark -
+#pragma mark Tests
+
+static bool testHeadlessRendererMatchesBlurEngine(HeadlessRenderer_t * renderer, const YUVInput_t * input)
+{
+    BlurEngine_t * blurEngine = createBlurEngine();
+    GaussianFilterKernelCache_t * cache = createGaussianFilterKernelCache(&kBtsGaussianFilterKernelDefaultParameters, GaussianFilterKernelTypeBts, 1);
+
+    headlessRendererSetOutput(renderer, HeadlessRendererOutputOffscreen);
+    blurEngineSetPrefilterEnabled(blurEngine, headlessRendererPrefilterEnabled(renderer));
+
+    BlurEngineImage_t image, referenceImage;
+    size_t width, height;
+    headlessRendererOutputDimensions(renderer, input->image.width, input->image.height, kYUVViewWidth, kYUVViewHeight, &width, &height);
+    bool passed = createImage(width, height, &image) && createImage(width, height, &referenceImage);
+
+    for (size_t k = 0; passed && k < kYUVKernelIndexCount; ++k)
+    {
+        setKernelIndex(renderer, blurEngine, cache, kYUVKernelIndexes[k]);
+
+        ImageCompareResult_t result;
+        passed = headlessRendererFilterYUVImage(renderer, &input->image, kYUVViewWidth, kYUVViewHeight, &image) &&
+                 blurEngineFilterYUVImage(blurEngine, &input->image, kYUVViewWidth, kYUVViewHeight, &referenceImage) &&
+                 imageCompare(&image, &referenceImage, &result);
+
+        if (!passed || result.maxDifference > kYUVEngineMaxDifference || result.psnr < kYUVEngineMinPSNR)
+        {
+            fprintf(stderr, "FAIL: %s kernel index %u, headless renderer and CPU reference differ (max difference %u, PSNR %.2f dB)\n",
+                    input->name, kYUVKernelIndexes[k], passed ? result.maxDifference : 0, passed ? result.psnr : 0.0);
+            passed = false;
+            break;
+        }
+
+        char description[96];
+        snprintf(description, sizeof(description), "%s kernel index %2u, GL vs CPU", input->name, kYUVKernelIndexes[k]);
+        printCompareResult(description, &result);
+    }
+
+    free(image.data);
+    free(referenceImage.data);
+    releaseGaussianFilterKernelCache(cache);
+    releaseBlurEngine(blurEngine);
+
+    return passed;
+}
+
+static bool testGrayFrameMatchesBGRAFrame(HeadlessRenderer_t * renderer, const YUVInput_t * input)
+{
+    // Same luma plane, no chroma
+    BlurEngineYUVImage_t grayImage;
+    BlurEngineImage_t grayBGRAImage, image, bgraImage;
+    bool passed = createYUVImage(input->image.width, input->image.height, &grayImage) &&
+                  createImage(input->image.width, input->image.height, &grayBGRAImage) &&
+                  createImage(kYUVViewWidth, kYUVViewHeight, &image) &&
+                  createImage(kYUVViewWidth, kYUVViewHeight, &bgraImage);
+
+    for (size_t y = 0; passed && y < input->image.height; ++y)
+    {
+        for (size_t x = 0; x < input->image.width; ++x)
+        {
+            uint8_t luma = input->image.luma[y * input->image.lumaBytesPerRow + x];
+            uint8_t * pixel = grayBGRAImage.data + y * grayBGRAImage.bytesPerRow + x * 4;
+            grayImage.luma[y * grayImage.lumaBytesPerRow + x] = luma;
+            pixel[0] = pixel[1] = pixel[2] = luma;
+            pixel[3] = 255;
+        }
+    }
+
+    if (passed)
+    {
+        memset(grayImage.chroma, 128, grayImage.chromaBytesPerRow * ((grayImage.height + 1) / 2));
+    }
+
+    headlessRendererSetOutput(renderer, HeadlessRendererOutputOnscreenCopy);
+
+    for (size_t k = 0; passed && k < kYUVKernelIndexCount; ++k)
+    {
+        setKernelIndex(renderer, NULL, NULL, kYUVKernelIndexes[k]);
+
+        ImageCompareResult_t result;
+        passed = headlessRendererFilterYUVImage(renderer, &grayImage, kYUVViewWidth, kYUVViewHeight, &image) &&
+                 headlessRendererFilterImage(renderer, &grayBGRAImage, kYUVViewWidth, kYUVViewHeight, &bgraImage) &&
+                 imageCompare(&image, &bgraImage, &result);
+
+        if (!passed || result.maxDifference > kYUVGrayMaxDifference)
+        {
+            fprintf(stderr, "FAIL: %s kernel index %u, gray frame differs from the BGRA frame (max difference %u)\n",
+                    input->name, kYUVKernelIndexes[k], passed ? result.maxDifference : 0);
+            passed = false;
+            break;
+        }
+
+        char description[96];
+        snprintf(description, sizeof(description), "%s kernel index %2u, gray NV12 vs BGRA", input->name, kYUVKernelIndexes[k]);
+        printCompareResult(description, &result);
+    }
+
+    free(grayImage.luma);
+    free(grayBGRAImage.data);
+    free(image.data);
+    free(bgraImage.data);
+
+    return passed;
+}
+
+static bool testOnscreenImageSimilarityWithBGRAFrame(HeadlessRenderer_t * renderer, const YUVInput_t * input)
+{
+    if (!input->bgraImage.data)
+    {
+        return true;
+    }
+
+    BlurEngineImage_t image, bgraImage;
+    bool passed = createImage(kYUVViewWidth, kYUVViewHeight, &image) && createImage(kYUVViewWidth, kYUVViewHeight, &bgraImage);
+
+    headlessRendererSetOutput(renderer, HeadlessRendererOutputOnscreenCopy);
+
+    for (size_t k = 0; passed && k < kYUVBGRAKernelIndexCount; ++k)
+    {
+        setKernelIndex(renderer, NULL, NULL, kYUVBGRAKernelIndexes[k]);
+
+        ImageCompareResult_t result;
+        passed = headlessRendererFilterYUVImage(renderer, &input->image, kYUVViewWidth, kYUVViewHeight, &image) &&
+                 headlessRendererFilterImage(renderer, &input->bgraImage, kYUVViewWidth, kYUVViewHeight, &bgraImage) &&
+                 imageCompare(&image, &bgraImage, &result);
+
+        if (!passed || result.psnr < kYUVBGRAMinPSNR || result.ssim < kYUVBGRAMinSSIM)
+        {
+            fprintf(stderr, "FAIL: %s kernel index %u, NV12 render differs from the BGRA render (PSNR %.2f dB, SSIM %.4f)\n",
+                    input->name, kYUVBGRAKernelIndexes[k], passed ? result.psnr : 0.0, passed ? result.ssim : 0.0);
+            passed = false;
+            break;
+        }
+
+        char description[96];
+        snprintf(description, sizeof(description), "%s kernel index %2u, NV12 vs BGRA", input->name, kYUVBGRAKernelIndexes[k]);
+        printCompareResult(description, &result);
+    }
+
+    free(image.data);
+    free(bgraImage.data);
+
+    return passed;
+}
+
+static bool parseSize(const char * string, size_t * width, size_t * height)
+{
+    return sscanf(string, "%zux%zu", width, height) == 2 && *width > 0 && *height > 0;
+}
+
+int main(int argc, const char * argv[])
+{
+    const char * samplesPath = "test/Samples.xcassets";
+    const char * inputPaths[kYUVMaxInputCount];
+    size_t inputWidths[kYUVMaxInputCount], inputHeights[kYUVMaxInputCount];
+    size_t inputPathCount = 0, inputSizeCount = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--verbose") == 0)
+        {
+            verbose = true;
+        }
+        else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+        {
+            samplesPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc && inputPathCount < kYUVMaxInputCount)
+        {
+            inputPaths[inputPathCount++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc && inputSizeCount < kYUVMaxInputCount &&
+                 parseSize(argv[i + 1], &inputWidths[inputSizeCount], &inputHeights[inputSizeCount]))
+        {
+            ++inputSizeCount;
+            ++i;
+        }
+        else
+        {
+            fprintf(stderr, "Invalid options, see the usage in main.c\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (inputPathCount != inputSizeCount)
+    {
+        fprintf(stderr, "Each --input needs a --size, see the usage in main.c\n");
+        return EXIT_FAILURE;
+    }
+
+    YUVInput_t inputs[kYUVMaxInputCount];
+    size_t inputCount = 0;
+    bool passed = true;
+
+    if (inputPathCount)
+    {
+        for (size_t i = 0; passed && i < inputPathCount; ++i)
+        {
+            passed = loadYUVInput(inputPaths[i], inputWidths[i], inputHeights[i], &inputs[inputCount++]);
+        }
+    }
+    else
+    {
+        // Odd dimensions, the chroma plane has a partial last column and row
+        passed = loadSourceImageInput(samplesPath, &inputs[inputCount++]);
+        passed = passed && createPatternInput(1279, 719, &inputs[inputCount++]);
+    }
+
+    HeadlessRenderer_t * renderer = passed ? createHeadlessRenderer(NULL, NULL, NULL) : NULL;
+    if (passed && !renderer)
+    {
+        fprintf(stderr, "FAIL: can't create the headless renderer\n");
+        passed = false;
+    }
+
+    if (renderer)
+    {
+        // Same filter parameters as the layer
+        headlessRendererSetFilterParameters(renderer, 4.0f, 2);
+
+        for (size_t i = 0; i < inputCount; ++i)
+        {
+            passed = testHeadlessRendererMatchesBlurEngine(renderer, &inputs[i]) && passed;
+            passed = testGrayFrameMatchesBGRAFrame(renderer, &inputs[i]) && passed;
+            passed = testOnscreenImageSimilarityWithBGRAFrame(renderer, &inputs[i]) && passed;
+        }
+
+        releaseHeadlessRenderer(renderer);
+    }
+
+    for (size_t i = 0; i < inputCount; ++i)
+    {
+        releaseYUVInput(&inputs[i]);
+    }
+
+    if (!passed)
+    {
+        return EXIT_FAILURE;
+    }
+
+    printf("PASS\n");
+    return EXIT_SUCCESS;
+}